@@ -0,0 +1,278 @@
+/* app_icons.c
+ * The launcher's icons for the apps on flash, decoded once into one file
+ * RebbleOS
+ *
+ * Each app's icon is a resource in its own resource file, so drawing it
+ * as its row scrolls in would be a file lookup, a resource header read
+ * and a PNG decode, every time. Instead every icon is decoded once into
+ * the "appicons" file, as PBIs one after the other, and the launcher
+ * loads the whole file in one read when it opens. The rows then draw
+ * from RAM, with no I/O at all.
+ *
+ * The file is stamped with a hash of the apps it was made from: their
+ * ids, icon ids and where their resources are. When that doesn't match
+ * the apps there are now, which it won't after an install or on first
+ * boot, the launcher builds it again before loading it.
+ */
+
+#include "rebbleos.h"
+#include "fs.h"
+#include "app_icons.h"
+
+#define APP_ICONS_FILE      "appicons"
+/* "ICNS" */
+#define APP_ICONS_MAGIC     0x534e4349
+#define APP_ICONS_VERSION   1
+
+typedef struct __attribute__((__packed__)) AppIconsHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t stamp;
+} AppIconsHeader;
+
+/* count of these follow the header */
+typedef struct __attribute__((__packed__)) AppIconsEntry {
+    uint32_t app_id;
+    uint32_t offset;    /* of its PBI in the file, 0 if it has no icon */
+} AppIconsEntry;
+
+/* how gbitmap_create_with_data wants it */
+typedef struct __attribute__((__packed__)) AppIconsPbi {
+    uint16_t row_size_bytes;
+    uint16_t info_flags;
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+} AppIconsPbi;
+
+#define PBI_VERSION_1       (1 << 12)
+
+static uint8_t *_atlas;
+static GBitmap **_icons;
+static uint16_t _count;
+
+static uint32_t _stamp_add(uint32_t h, uint32_t v)
+{
+    for (uint8_t i = 0; i < 4; i++, v >>= 8)
+        h = (h ^ (v & 0xFF)) * 16777619u;
+
+    return h;
+}
+
+static uint32_t _stamp(uint16_t *count)
+{
+    uint32_t h = 2166136261u;
+    App *app;
+
+    *count = 0;
+    list_foreach(app, app_manager_get_apps_head(), App, node)
+    {
+        if (app->is_internal)
+            continue;
+        h = _stamp_add(h, app->id);
+        h = _stamp_add(h, app->icon);
+        h = _stamp_add(h, app->resource_file.startpage);
+        (*count)++;
+    }
+
+    return h;
+}
+
+static uint32_t _pbi_size(const GBitmap *bitmap)
+{
+    uint32_t rows = bitmap->bounds.origin.y + bitmap->bounds.size.h;
+
+    return (sizeof(AppIconsPbi) + bitmap->row_size_bytes * rows +
+            bitmap->palette_size * sizeof(GColor) + 3) & ~3;
+}
+
+static void _pbi_write(struct fd *fd, const GBitmap *bitmap)
+{
+    uint32_t rows = bitmap->bounds.origin.y + bitmap->bounds.size.h;
+    AppIconsPbi pbi = {
+        .row_size_bytes = bitmap->row_size_bytes,
+        .info_flags = PBI_VERSION_1 | (bitmap->format << 1),
+        .x = bitmap->bounds.origin.x,
+        .y = bitmap->bounds.origin.y,
+        .w = bitmap->bounds.size.w,
+        .h = bitmap->bounds.size.h,
+    };
+    uint32_t len = sizeof(pbi) + bitmap->row_size_bytes * rows + bitmap->palette_size * sizeof(GColor);
+
+    fs_write(fd, &pbi, sizeof(pbi));
+    fs_write(fd, bitmap->addr, bitmap->row_size_bytes * rows);
+    if (bitmap->palette_size)
+        fs_write(fd, bitmap->palette, bitmap->palette_size * sizeof(GColor));
+    /* the padding stays erased */
+    fs_seek(fd, _pbi_size(bitmap) - len, FS_SEEK_CUR);
+}
+
+/*
+ * Decode every app's icon and write them out. Slow, and only when the
+ * apps have changed
+ */
+static void _build(uint32_t stamp, uint16_t count)
+{
+    AppIconsHeader hdr = { APP_ICONS_MAGIC, APP_ICONS_VERSION, count, stamp };
+    GBitmap **decoded;
+    AppIconsEntry entry;
+    struct fd fd, pixels;
+    uint32_t size, offset;
+    TickType_t started = xTaskGetTickCount();
+    uint16_t i = 0, n = 0;
+    App *app;
+
+    decoded = app_calloc(count ? count : 1, sizeof(GBitmap *));
+    if (!decoded)
+        return;
+
+    size = sizeof(hdr) + count * sizeof(AppIconsEntry);
+    list_foreach(app, app_manager_get_apps_head(), App, node)
+    {
+        GBitmap *bitmap;
+
+        if (app->is_internal)
+            continue;
+        if (app->icon && (bitmap = gbitmap_create_with_resource_app(app->icon, &app->resource_file)))
+        {
+            if (bitmap->addr && bitmap->bounds.size.w <= APP_ICONS_MAX_SIDE &&
+                bitmap->bounds.size.h <= APP_ICONS_MAX_SIDE)
+            {
+                decoded[i] = bitmap;
+                size += _pbi_size(bitmap);
+                n++;
+            }
+            else
+            {
+                gbitmap_destroy(bitmap);
+            }
+        }
+        i++;
+    }
+
+    if (fs_creat(&fd, APP_ICONS_FILE, size) < 0)
+        goto done;
+
+    fs_write(&fd, &hdr, sizeof(hdr));
+    pixels = fd;
+    offset = sizeof(hdr) + count * sizeof(AppIconsEntry);
+    fs_seek(&pixels, offset, FS_SEEK_SET);
+    i = 0;
+    list_foreach(app, app_manager_get_apps_head(), App, node)
+    {
+        if (app->is_internal)
+            continue;
+        entry.app_id = app->id;
+        entry.offset = decoded[i] ? offset : 0;
+        fs_write(&fd, &entry, sizeof(entry));
+        if (decoded[i])
+        {
+            _pbi_write(&pixels, decoded[i]);
+            offset += _pbi_size(decoded[i]);
+        }
+        i++;
+    }
+
+    if (fs_commit(&fd) < 0)
+        fs_delete(&fd.file);
+    else
+        SYS_LOG("icons", APP_LOG_LEVEL_INFO, "%d icons of %d apps in %d bytes, %d ms", n, count,
+                offset, (xTaskGetTickCount() - started) * portTICK_PERIOD_MS);
+
+done:
+    for (i = 0; i < count; i++)
+        if (decoded[i])
+            gbitmap_destroy(decoded[i]);
+    app_free(decoded);
+}
+
+/* The atlas, if it's there and made from these apps */
+static bool _find(struct file *file, uint32_t stamp, uint16_t count)
+{
+    AppIconsHeader hdr;
+    struct fd fd;
+
+    if (fs_find_file(file, APP_ICONS_FILE) < 0)
+        return false;
+
+    fs_open(&fd, file);
+    return fs_read(&fd, &hdr, sizeof(hdr)) == sizeof(hdr) && hdr.magic == APP_ICONS_MAGIC &&
+           hdr.version == APP_ICONS_VERSION && hdr.stamp == stamp && hdr.count == count;
+}
+
+bool app_icons_open(void)
+{
+    struct file file;
+    struct fd fd;
+    uint16_t count;
+    uint32_t stamp = _stamp(&count);
+    AppIconsEntry *entry;
+
+    app_icons_close();
+    if (!count)
+        return false;
+
+    if (!_find(&file, stamp, count))
+    {
+        _build(stamp, count);
+        if (!_find(&file, stamp, count))
+            return false;
+    }
+
+    _atlas = app_malloc(file.size);
+    _icons = app_calloc(count, sizeof(GBitmap *));
+    if (!_atlas || !_icons)
+    {
+        app_icons_close();
+        return false;
+    }
+
+    fs_open(&fd, &file);
+    if (fs_read(&fd, _atlas, file.size) != file.size)
+    {
+        app_icons_close();
+        return false;
+    }
+
+    _count = count;
+    entry = (AppIconsEntry *)(_atlas + sizeof(AppIconsHeader));
+    for (uint16_t i = 0; i < count; i++)
+        if (entry[i].offset && entry[i].offset < file.size)
+            _icons[i] = gbitmap_create_with_data(_atlas + entry[i].offset);
+
+    return true;
+}
+
+GBitmap *app_icons_get(const App *app)
+{
+    AppIconsEntry *entry;
+
+    if (!_atlas || app->is_internal)
+        return NULL;
+
+    entry = (AppIconsEntry *)(_atlas + sizeof(AppIconsHeader));
+    for (uint16_t i = 0; i < _count; i++)
+        if (entry[i].app_id == app->id)
+            return _icons[i];
+
+    return NULL;
+}
+
+void app_icons_close(void)
+{
+    if (_icons)
+    {
+        for (uint16_t i = 0; i < _count; i++)
+            if (_icons[i])
+                gbitmap_destroy(_icons[i]);
+        app_free(_icons);
+    }
+    if (_atlas)
+        app_free(_atlas);
+
+    _icons = NULL;
+    _atlas = NULL;
+    _count = 0;
+}
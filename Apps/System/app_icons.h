@@ -0,0 +1,18 @@
+#pragma once
+/* app_icons.h
+ * The launcher's icons for the apps on flash, decoded once into one file
+ * RebbleOS
+ */
+
+#include "librebble.h"
+#include "appmanager.h"
+
+/* bigger icons than this are left out */
+#define APP_ICONS_MAX_SIDE  32
+
+/* Load the atlas into the app heap, building it first if the apps have
+ * changed since it was. false if there are no icons to be had */
+bool app_icons_open(void);
+/* the app's icon, or NULL. Good until app_icons_close */
+GBitmap *app_icons_get(const App *app);
+void app_icons_close(void);
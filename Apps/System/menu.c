@@ -57,6 +57,17 @@ static uint16_t get_num_rows_callback(MenuLayer *menu_layer, uint16_t section_in
     return menu->items->count;
 }
 
+static void _menu_highlight(Menu *menu, uint16_t row)
+{
+    if (menu->callbacks.on_highlight && row < menu->items->count)
+        menu->callbacks.on_highlight(menu, &menu->items->items[row], menu->context);
+}
+
+static void selection_changed_callback(MenuLayer *menu_layer, MenuIndex *new_index, MenuIndex *old_index, Menu *menu)
+{
+    _menu_highlight(menu, new_index->row);
+}
+
 static void select_click_callback(MenuLayer *menu_layer, MenuIndex *index, Menu *menu)
 {
     MenuItem item = menu->items->items[index->row];
@@ -70,6 +81,7 @@ static void select_click_callback(MenuLayer *menu_layer, MenuIndex *index, Menu
             menu->items = submenu;
             menu_layer_reload_data(menu->layer);
             menu_layer_set_selected_index(menu->layer, MenuIndex(0, 0), MenuRowAlignTop, false);
+            _menu_highlight(menu, 0);
         }
     }
 }
@@ -98,7 +110,7 @@ static GBitmap *_cached_resource(uint16_t res_id, uint16_t capacity)
 static void draw_row_callback(GContext *ctx, const Layer *cell_layer, MenuIndex *index, Menu *menu)
 {
     MenuItem *item = &menu->items->items[index->row];
-    GBitmap *gbitmap = _cached_resource(item->image_res_id, menu->items->count);
+    GBitmap *gbitmap = item->icon ? item->icon : _cached_resource(item->image_res_id, menu->items->count);
     
 #ifdef PBL_RECT
     menu_cell_basic_draw(ctx, cell_layer, item->text, item->sub_text, gbitmap);
@@ -118,11 +130,14 @@ Menu* menu_create(GRect frame)
     Menu *menu = (Menu *) app_calloc(1, sizeof(Menu));
     menu->items = menu_items_create(0);
     menu->layer = menu_layer_create(frame);
+    // every row is the same height, and there can be a lot of them
+    menu_layer_set_virtual(menu->layer, true);
     menu_layer_set_highlight_colors(menu->layer, GColorRed, GColorWhite);
     menu_layer_set_callbacks(menu->layer, menu, (MenuLayerCallbacks) {
         .get_num_rows = (MenuLayerGetNumberOfRowsInSectionsCallback) get_num_rows_callback,
         .draw_row = (MenuLayerDrawRowCallback) draw_row_callback,
         .select_click = (MenuLayerSelectCallback) select_click_callback,
+        .selection_changed = (MenuLayerSelectionChangedCallback) selection_changed_callback,
     });
 
     return menu;
@@ -24,6 +24,7 @@ typedef struct MenuItem
     uint16_t image_res_id;
     MenuItemCallback on_select;
     void *context;
+    GBitmap *icon; // drawn instead of image_res_id, and not ours to free
 } MenuItem;
 
 #define MenuItem(text, sub_text, image, on_select) ((MenuItem) { text, sub_text, image, on_select })
@@ -45,9 +46,13 @@ void menu_items_add(MenuItems *items, MenuItem item);
 // called when back is pressed while in top menu
 typedef void (*MenuExitCallback)(struct Menu *menu, void *context);
 
+// called when the highlight lands on an item
+typedef void (*MenuHighlightCallback)(struct Menu *menu, const MenuItem *item, void *context);
+
 typedef struct MenuCallbacks
 {
     MenuExitCallback on_menu_exit;
+    MenuHighlightCallback on_highlight;
 } MenuCallbacks;
 
 typedef struct Menu
@@ -21,6 +21,9 @@ static NotificationLayer* _notif_layer;
 static Window* _notif_window;
 static Menu *s_menu;
 static Window *s_main_window;
+/* the messages the menu shows, held until it goes */
+static full_msg_t **_held;
+static uint16_t _held_count;
 
 static void _notif_window_load(Window *window);
 static void _notif_window_unload(Window *window);
@@ -45,12 +48,12 @@ static MenuItems* _msg_list_item_selected(const MenuItem *item)
     char *title = "Message";
     full_msg_t *msg = (full_msg_t *)item->context;
 
-    cmd_phone_attribute_t *attr = list_elem(list_get_head(&msg->attributes_list_head), cmd_phone_attribute_t, node);
+    const char *text = notification_attribute_get(msg, 0);
 
     Layer *layer = window_get_root_layer(s_main_window);
     GRect bounds = layer_get_unobstructed_bounds(layer);
     _notif_layer = notification_layer_create(bounds);
-    Notification *notification = notification_create(app, title, (const char *)attr->data, gbitmap_create_with_resource(RESOURCE_ID_SPEECH_BUBBLE), GColorRed);
+    Notification *notification = notification_create(app, title, text ? text : "", gbitmap_create_with_resource(RESOURCE_ID_SPEECH_BUBBLE), GColorRed);
     
     notification_layer_stack_push_notification(_notif_layer, notification);
     notification_layer_configure_click_config(_notif_layer, s_main_window, _notif_destroy_layer_cb);
@@ -95,16 +98,19 @@ static void _notif_window_load(Window *window)
         return;
     }
     
-    items = menu_items_create(message_count());
-    full_msg_t *msg;
-    cmd_phone_attribute_t *a;
-    list_head *message_head = message_get_head();
+    uint16_t count = message_count();
+    items = menu_items_create(count);
+    const char *text;
     
-    list_foreach(msg, message_head, full_msg_t, node)
+    _held = app_calloc(count, sizeof(full_msg_t *));
+    _held_count = _held ? message_hold_all(_held, count) : 0;
+
+    for (uint16_t m = 0; m < _held_count; m++)
     {
-        list_foreach(a, &msg->attributes_list_head, cmd_phone_attribute_t, node)
+        full_msg_t *msg = _held[m];
+        for (uint8_t i = 0; (text = notification_attribute_get(msg, i)); i++)
         {
-            MenuItem mi = MenuItem((char *)a->data, NULL, RESOURCE_ID_SPEECH_BUBBLE, _msg_list_item_selected);
+            MenuItem mi = MenuItem((char *)text, NULL, RESOURCE_ID_SPEECH_BUBBLE, _msg_list_item_selected);
             mi.context = msg;
             menu_items_add(items, mi);
         }
@@ -123,6 +129,13 @@ static void _notif_window_unload(Window *window)
         notification_layer_destroy(_notif_layer);
         _notif_layer = NULL;
     }
+
+    for (uint16_t i = 0; i < _held_count; i++)
+        message_release(_held[i]);
+    if (_held)
+        app_free(_held);
+    _held = NULL;
+    _held_count = 0;
 }
 
 void notif_deinit(void)
@@ -12,6 +12,7 @@
 #include "platform_config.h"
 #include "platform_res.h"
 #include "node_list.h"
+#include "app_icons.h"
 
 extern void flash_dump(void);
 
@@ -72,11 +73,20 @@ static MenuItems* watch_list_item_selected(const MenuItem *item) {
         {
             continue;
         }
-        menu_items_add(items, MenuItem(app->name, NULL, RESOURCE_ID_CLOCK, app_item_selected));
+        MenuItem entry = MenuItem(app->name, NULL, RESOURCE_ID_CLOCK, app_item_selected);
+        entry.icon = app_icons_get(app);
+        menu_items_add(items, entry);
     }
     return items;
 }
 
+/* get a head start reading the app in while the user decides */
+static void app_item_highlighted(struct Menu *menu, const MenuItem *item, void *context)
+{
+    if (item->on_select == app_item_selected)
+        appmanager_app_prefetch(item->text);
+}
+
 static void exit_to_watchface(struct Menu *menu, void *context)
 {
     // Exit to watchface
@@ -93,11 +103,13 @@ static void systemapp_window_load(Window *window)
     s_menu = menu_create(GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS));
 #endif
     menu_set_callbacks(s_menu, s_menu, (MenuCallbacks) {
-        .on_menu_exit = exit_to_watchface
+        .on_menu_exit = exit_to_watchface,
+        .on_highlight = app_item_highlighted
     });
     layer_add_child(window_layer, menu_get_layer(s_menu));
 
     menu_set_click_config_onto_window(s_menu, window);
+    app_icons_open();
 
     MenuItems *items = menu_items_create(5);
     menu_items_add(items, MenuItem("Watchfaces", "All your faces", RESOURCE_ID_CLOCK, watch_list_item_selected));
@@ -119,6 +131,7 @@ static void systemapp_window_load(Window *window)
 static void systemapp_window_unload(Window *window)
 {
     menu_destroy(s_menu);
+    app_icons_close();
 }
 
 void systemapp_init(void)
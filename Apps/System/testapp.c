@@ -96,6 +96,13 @@ app_test _tests[] = {
         .test_init = &vibes_test_init,
         .test_execute = &vibes_test_exec,
         .test_deinit = &vibes_test_deinit
+    },
+    {
+        .test_name = "Bench Test",
+        .test_desc = "Cycle Counts",
+        .test_init = &bench_test_init,
+        .test_execute = &bench_test_exec,
+        .test_deinit = &bench_test_deinit
     }
 };
 
@@ -375,6 +382,17 @@ void testapp_init(void)
     });
 
     window_stack_push(s_main_window, true);
+
+#ifdef PERF_AUTORUN
+    /* the perf build goes straight to the benchmarks */
+    for (int i = 0; i < TEST_COUNT; i++)
+    {
+        if (strcmp(_tests[i].test_name, "Bench Test"))
+            continue;
+        MenuItem mi = { .context = &_tests[i] };
+        test_test_item_selected(&mi);
+    }
+#endif
 }
 
 void testapp_deinit(void)
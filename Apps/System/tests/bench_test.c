@@ -0,0 +1,330 @@
+/* bench_test.c
+ * Micro-benchmarks, timed on the cycle counter, to compare hardware
+ * revisions and catch regressions
+ * RebbleOS
+ *
+ * Each case runs a fixed number of times and logs cycles per go, and
+ * microseconds at the clock we are on. The drawing cases run in the
+ * layer's first update proc, so they draw into the frame as an app would;
+ * the rest run at exec. The results are then painted on the window, and
+ * logged as "[BENCH] name cycles/op us/op", one line each, for diffing.
+ *
+ * There is no echo on the phone side of the protocol, so the BT case
+ * times the watch's half of a loopback: packets queued with
+ * bluetooth_send_async until each is handed to the radio. It is skipped
+ * when the phone isn't connected.
+ *
+ * In a PERF_AUTORUN build the test app starts here, and once every case is
+ * in the boot profile is dumped after them and "[BENCH] done" logged, for
+ * Utilities/perfcheck.py.
+ */
+
+#include "rebbleos.h"
+#include "systemapp.h"
+#include "menu.h"
+#include "test_defs.h"
+#include "platform_res.h"
+#include "endpoint.h"
+#include "boot_profile.h"
+
+#define BENCH_DRAW_RUNS   50
+#define BENCH_FLASH_CHUNK 4096
+#define BENCH_FLASH_RUNS  16
+#define BENCH_ALLOC_RUNS  500
+#define BENCH_ALLOC_LIVE  16
+#define BENCH_TIMERS      64
+#define BENCH_BT_PACKETS  8
+#define BENCH_BT_SIZE     200
+#define BENCH_BT_POLL_MS  50
+#define BENCH_BT_WAIT_MS  3000
+#define BENCH_MAX_RESULTS 12
+
+typedef struct BenchResult {
+    const char *name;
+    uint32_t cycles;    /* per op */
+} BenchResult;
+
+static Window *_main_window;
+static Layer *_bench_layer;
+static BenchResult _results[BENCH_MAX_RESULTS];
+static uint8_t _result_count;
+static bool _drawn;
+
+static uint8_t *_bt_buf;
+static volatile uint8_t _bt_done;
+static volatile uint32_t _bt_end;
+static uint32_t _bt_start;
+static uint16_t _bt_waited;
+
+static void _bench_layer_update_proc(Layer *layer, GContext *ctx);
+static void _bench_finish(void *priv);
+
+static void _result(const char *name, uint32_t cycles, uint32_t runs)
+{
+    uint32_t per = cycles / runs;
+    uint32_t mhz = hw_cycles_per_us();
+
+    APP_LOG("test", APP_LOG_LEVEL_ERROR, "[BENCH] %s %lu %lu.%02lu", name, per,
+            per / mhz, (per % mhz) * 100 / mhz);
+    if (_result_count < BENCH_MAX_RESULTS)
+        _results[_result_count++] = (BenchResult) { name, per };
+    if (_bench_layer)
+        layer_mark_dirty(_bench_layer);
+}
+
+/* The drawing cases */
+
+static void _bench_draw(GContext *ctx)
+{
+    GFont font = fonts_get_system_font(FONT_KEY_GOTHIC_18_BOLD);
+    GBitmap *bitmap = gbitmap_create_with_resource(RESOURCE_ID_SPEECH_BUBBLE);
+    uint32_t t;
+
+    graphics_context_set_fill_color(ctx, GColorBlue);
+    t = hw_cycle_count();
+    for (int i = 0; i < BENCH_DRAW_RUNS; i++)
+        graphics_fill_rect(ctx, GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS), 0, GCornerNone);
+    _result("fill_rect", hw_cycle_count() - t, BENCH_DRAW_RUNS);
+
+    graphics_context_set_stroke_color(ctx, GColorWhite);
+    graphics_context_set_stroke_width(ctx, 1);
+    t = hw_cycle_count();
+    for (int i = 0; i < BENCH_DRAW_RUNS; i++)
+        graphics_draw_line(ctx, GPoint(0, i), GPoint(DISPLAY_COLS - 1, DISPLAY_ROWS - 1 - i));
+    _result("draw_line", hw_cycle_count() - t, BENCH_DRAW_RUNS);
+
+    graphics_context_set_fill_color(ctx, GColorRed);
+    t = hw_cycle_count();
+    for (int i = 0; i < BENCH_DRAW_RUNS; i++)
+        graphics_fill_circle(ctx, GPoint(DISPLAY_COLS / 2, DISPLAY_ROWS / 2), 60);
+    _result("fill_circle", hw_cycle_count() - t, BENCH_DRAW_RUNS);
+
+    graphics_context_set_text_color(ctx, GColorBlack);
+    t = hw_cycle_count();
+    for (int i = 0; i < BENCH_DRAW_RUNS; i++)
+        graphics_draw_text(ctx, "The quick brown fox jumps over the lazy dog", font,
+                           GRect(4, 20, DISPLAY_COLS - 8, 60), GTextOverflowModeWordWrap,
+                           GTextAlignmentLeft, NULL);
+    _result("draw_text", hw_cycle_count() - t, BENCH_DRAW_RUNS);
+
+    if (bitmap)
+    {
+        GRect bounds = gbitmap_get_bounds(bitmap);
+        bounds.origin = GPoint(20, 90);
+        t = hw_cycle_count();
+        for (int i = 0; i < BENCH_DRAW_RUNS; i++)
+            graphics_draw_bitmap_in_rect(ctx, bitmap, bounds);
+        _result("bitmap", hw_cycle_count() - t, BENCH_DRAW_RUNS);
+        gbitmap_destroy(bitmap);
+    }
+}
+
+/* The rest */
+
+static void _bench_flash(void)
+{
+    uint8_t *buf = app_malloc(BENCH_FLASH_CHUNK);
+    if (!test_assert_point_is_not_null(buf))
+        return;
+
+    uint32_t t = hw_cycle_count();
+    for (int i = 0; i < BENCH_FLASH_RUNS; i++)
+        flash_read_bytes(REGION_RES_START + i * BENCH_FLASH_CHUNK, buf, BENCH_FLASH_CHUNK);
+    _result("flash_4k", hw_cycle_count() - t, BENCH_FLASH_RUNS);
+
+    app_free(buf);
+}
+
+/* a window of live blocks, freed and refilled in a shuffled order */
+static void _bench_alloc(void)
+{
+    void *live[BENCH_ALLOC_LIVE] = { NULL };
+    uint32_t seed = 1;
+
+    uint32_t t = hw_cycle_count();
+    for (int i = 0; i < BENCH_ALLOC_RUNS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint8_t slot = (seed >> 16) % BENCH_ALLOC_LIVE;
+        app_free(live[slot]);
+        live[slot] = app_malloc(16 + ((seed >> 8) & 0x1f0));
+    }
+    _result("alloc_free", hw_cycle_count() - t, BENCH_ALLOC_RUNS);
+
+    for (int i = 0; i < BENCH_ALLOC_LIVE; i++)
+        app_free(live[i]);
+}
+
+static void _bench_timer_cb(CoreTimer *timer)
+{
+}
+
+static void _bench_timers(void)
+{
+    CoreTimer *timers = app_calloc(BENCH_TIMERS, sizeof(CoreTimer));
+    if (!test_assert_point_is_not_null(timers))
+        return;
+
+    /* far enough out that none can fire before they are gone */
+    TickType_t now = xTaskGetTickCount() + pdMS_TO_TICKS(60000);
+    uint32_t t = hw_cycle_count();
+    for (int i = 0; i < BENCH_TIMERS; i++)
+    {
+        timers[i].when = now + (i * 7919) % 1000;
+        timers[i].callback = _bench_timer_cb;
+        appmanager_timer_add(&timers[i]);
+    }
+    _result("timer_add", hw_cycle_count() - t, BENCH_TIMERS);
+
+    t = hw_cycle_count();
+    for (int i = 0; i < BENCH_TIMERS; i++)
+        appmanager_timer_remove(&timers[i]);
+    _result("timer_remove", hw_cycle_count() - t, BENCH_TIMERS);
+
+    app_free(timers);
+}
+
+/* On the BTCmd thread */
+static void _bt_sent(uint8_t *data, size_t len, bool sent)
+{
+    if (sent)
+        _bt_end = hw_cycle_count();
+    _bt_done++;
+}
+
+static void _bt_poll(void *priv)
+{
+    _bt_waited += BENCH_BT_POLL_MS;
+    if (_bt_done < BENCH_BT_PACKETS && _bt_waited < BENCH_BT_WAIT_MS)
+    {
+        app_timer_register(BENCH_BT_POLL_MS, _bt_poll, NULL);
+        return;
+    }
+
+    if (_bt_done == BENCH_BT_PACKETS && _bt_end)
+        _result("bt_packet", _bt_end - _bt_start, BENCH_BT_PACKETS);
+    else
+        APP_LOG("test", APP_LOG_LEVEL_ERROR, "[BENCH] bt_packet: %d of %d went", _bt_done, BENCH_BT_PACKETS);
+    _bench_finish(NULL);
+}
+
+/* false if there is nothing to wait for */
+static bool _bench_bt(void)
+{
+    if (!bluetooth_is_device_connected())
+    {
+        APP_LOG("test", APP_LOG_LEVEL_ERROR, "[BENCH] bt_packet: not connected, skipped");
+        return false;
+    }
+
+    /* framed for an endpoint the phone will drop */
+    _bt_buf = app_calloc(BENCH_BT_PACKETS, BENCH_BT_SIZE + 4);
+    if (!test_assert_point_is_not_null(_bt_buf))
+        return false;
+
+    _bt_done = 0;
+    _bt_end = 0;
+    _bt_waited = 0;
+    _bt_start = hw_cycle_count();
+    for (int i = 0; i < BENCH_BT_PACKETS; i++)
+    {
+        uint8_t *p = _bt_buf + i * (BENCH_BT_SIZE + 4);
+        p[0] = BENCH_BT_SIZE >> 8;
+        p[1] = BENCH_BT_SIZE & 0xff;
+        p[2] = ENDPOINT_LOG_STREAM >> 8;
+        p[3] = ENDPOINT_LOG_STREAM & 0xff;
+        if (!bluetooth_send_async(p, BENCH_BT_SIZE + 4, _bt_sent))
+            _bt_done++;
+    }
+    app_timer_register(BENCH_BT_POLL_MS, _bt_poll, NULL);
+    return true;
+}
+
+/* The drawing cases may not be in yet, so wait for them */
+static void _bench_finish(void *priv)
+{
+#ifdef PERF_AUTORUN
+    if (!_drawn)
+    {
+        app_timer_register(BENCH_BT_POLL_MS, _bench_finish, NULL);
+        return;
+    }
+    boot_profile_dump();
+    APP_LOG("test", APP_LOG_LEVEL_ERROR, "[BENCH] done");
+#endif
+}
+
+bool bench_test_init(Window *window)
+{
+    APP_LOG("test", APP_LOG_LEVEL_ERROR, "Init: Bench Test");
+    _main_window = window;
+    _result_count = 0;
+    _drawn = false;
+    _bt_buf = NULL;
+
+    if (!test_assert(hw_cycle_count() != 0))
+        return false;
+
+    Layer *window_layer = window_get_root_layer(window);
+    _bench_layer = layer_create(layer_get_unobstructed_bounds(window_layer));
+    layer_set_update_proc(_bench_layer, _bench_layer_update_proc);
+    layer_add_child(window_layer, _bench_layer);
+    layer_mark_dirty(_bench_layer);
+
+    return true;
+}
+
+bool bench_test_exec(void)
+{
+    APP_LOG("test", APP_LOG_LEVEL_ERROR, "Exec: Bench Test");
+    _bench_flash();
+    _bench_alloc();
+    _bench_timers();
+    if (!_bench_bt())
+        _bench_finish(NULL);
+
+    return true;
+}
+
+bool bench_test_deinit(void)
+{
+    APP_LOG("test", APP_LOG_LEVEL_ERROR, "De-Init: Bench Test");
+    /* the radio may still have them; let them go, rather than free under it */
+    if (_bt_done == BENCH_BT_PACKETS)
+        app_free(_bt_buf);
+    _bt_buf = NULL;
+
+    if (_bench_layer)
+    {
+        layer_remove_from_parent(_bench_layer);
+        layer_destroy(_bench_layer);
+    }
+    _bench_layer = NULL;
+    _main_window = NULL;
+
+    return true;
+}
+
+static void _bench_layer_update_proc(Layer *layer, GContext *ctx)
+{
+    GRect bounds = layer_get_bounds(layer);
+    static char text[BENCH_MAX_RESULTS * 24];
+    uint16_t len = 0;
+
+    if (!_drawn)
+    {
+        _drawn = true;
+        _bench_draw(ctx);
+    }
+
+    graphics_context_set_fill_color(ctx, GColorWhite);
+    graphics_fill_rect(ctx, bounds, 0, GCornerNone);
+
+    for (int i = 0; i < _result_count && len < sizeof(text); i++)
+        len += snprintf(text + len, sizeof(text) - len, "%s %lu\n", _results[i].name, _results[i].cycles);
+
+    graphics_context_set_text_color(ctx, GColorBlack);
+    graphics_draw_text(ctx, _result_count ? text : "Running", fonts_get_system_font(FONT_KEY_GOTHIC_14),
+                       GRect(4, 0, bounds.size.w - 8, bounds.size.h), GTextOverflowModeWordWrap,
+                       GTextAlignmentLeft, NULL);
+}
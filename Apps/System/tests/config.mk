@@ -8,3 +8,4 @@ SRCS_all += Apps/System/tests/menu_simple_test.c
 SRCS_all += Apps/System/tests/menu_multi_column_test.c
 SRCS_all += Apps/System/tests/action_menu_test.c
 SRCS_all += Apps/System/tests/vibes_test.c
+SRCS_all += Apps/System/tests/bench_test.c
@@ -94,14 +94,31 @@
 
 #define configUSE_PREEMPTION   1
 #define configUSE_IDLE_HOOK    0
-#define configUSE_TICK_HOOK    0
+#define configUSE_TICK_HOOK    1
+/* Tickless idle: with every task blocked, the idle task stops the tick
+ * and sleeps until the next one is due. stm32_power_sleep chooses WFI or
+ * STOP from what clocks are held. Comment out to tick at 1kHz throughout */
+#define configUSE_TICKLESS_IDLE 1
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP 2
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime ) stm32_power_sleep( xExpectedIdleTime )
+#ifndef __ASSEMBLER__
+extern void stm32_power_sleep(uint32_t idle_ticks);
+#endif
 #define configCPU_CLOCK_HZ    ( SystemCoreClock )
 #define configTICK_RATE_HZ    ( ( TickType_t ) 1000 )
-#define configMAX_PRIORITIES   ( 5 )
+/* Priorities, above idle, and what they are for:
+ *   9  ISR bottom halves (defer.c), and the overlay, so the app's draw
+ *      handoff to it goes straight through
+ *   6  app, OS, init
+ *   5  app manager, flash, buttons, watchdog
+ *   4  BT commands   3  BT stack   2  backlight, timers, endpoints
+ *   1  worker, FS GC: only what everyone else leaves
+ * Anything at or above configMAX_PRIORITIES is quietly clamped to the top */
+#define configMAX_PRIORITIES   ( 10 )
 #define configMINIMAL_STACK_SIZE  ( ( unsigned short ) 180 )
 #define configTOTAL_HEAP_SIZE   ( ( size_t ) ( RTOS_HEAP_SIZE ) )
 #define configMAX_TASK_NAME_LEN   ( 10 )
-#define configUSE_TRACE_FACILITY  0
+#define configUSE_TRACE_FACILITY  1 /* uxTaskGetSystemState, for the stack sampler in watchdog.c */
 #define configUSE_16_BIT_TICKS   0
 #define configIDLE_SHOULD_YIELD   1
 #define configUSE_MUTEXES    1
@@ -111,7 +128,25 @@
 #define configUSE_MALLOC_FAILED_HOOK 1
 #define configUSE_APPLICATION_TASK_TAG 0
 #define configUSE_COUNTING_SEMAPHORES 1
-#define configGENERATE_RUN_TIME_STATS 0
+/* Run time is counted in core cycles, see cpu_stats.c. The counter stops
+ * in STOP mode, so a task's run time is time it was actually awake */
+#define configGENERATE_RUN_TIME_STATS 1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() ( ( void ) hw_cycle_count() )
+#define portGET_RUN_TIME_COUNTER_VALUE() hw_cycle_count()
+#ifndef __ASSEMBLER__
+extern uint32_t hw_cycle_count(void);
+/* the rest of the trace hooks, see SCHED_TRACE */
+#include "sched_trace.h"
+#endif
+/* Slot 0 counts the times each task is switched in, see cpu_stats.c */
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 1
+#define CPU_STATS_TLS_SWITCHES 0
+#define traceTASK_SWITCHED_IN() \
+    do { \
+        void **tls = &pxCurrentTCB->pvThreadLocalStoragePointers[ CPU_STATS_TLS_SWITCHES ]; \
+        *tls = ( void * )( ( uint32_t )*tls + 1 ); \
+        SCHED_TRACE_SWITCHED_IN(); \
+    } while( 0 )
 #define configUSE_TASK_NOTIFICATIONS            1
 //#define portBYTE_ALIGNMENT 4
 
@@ -135,6 +170,7 @@
 #define INCLUDE_vTaskDelayUntil   1
 #define INCLUDE_vTaskDelay    1
 #define INCLUDE_xTaskGetCurrentTaskHandle 1
+#define INCLUDE_xTaskGetSchedulerState 1
 // #define INCLUDE_xSemaphoreGetMutexHolder 1
 
 /* Cortex-M specific definitions. */
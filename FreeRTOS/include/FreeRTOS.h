@@ -772,6 +772,12 @@ extern "C" {
 	#define portTICK_TYPE_IS_ATOMIC 0
 #endif
 
+#ifndef portDONT_DISCARD
+	/* Marks what only the port's assembly refers to, which link time
+	optimisation would otherwise drop. */
+	#define portDONT_DISCARD
+#endif
+
 #ifndef configSUPPORT_STATIC_ALLOCATION
 	/* Defaults to 0 for backward compatibility. */
 	#define configSUPPORT_STATIC_ALLOCATION 0
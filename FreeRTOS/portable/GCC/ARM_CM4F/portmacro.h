@@ -118,6 +118,9 @@ typedef unsigned long UBaseType_t;
 	not need to be guarded with a critical section. */
 	#define portTICK_TYPE_IS_ATOMIC 1
 #endif
+
+/* The context switch calls into tasks.c from assembly. */
+#define portDONT_DISCARD __attribute__( ( used ) )
 /*-----------------------------------------------------------*/
 
 /* Architecture specifics. */
@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+
+"""
+Prints a crash record (see rcore/crash_dump.c), as fetched on
+ENDPOINT_CRASH_DUMP: why and where it crashed, the stack, where every
+other task was switched out, and the heaps. The log ring and scheduler
+trace in it can be written out for Utilities/logdecode.py and
+Utilities/schedtrace.py.
+RebbleOS
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+
+parser = argparse.ArgumentParser(description = "Crash record reader for RebbleOS.")
+parser.add_argument("-e", "--elf", nargs = 1, default = None, help = "firmware ELF, to name code addresses with addr2line")
+parser.add_argument("-a", "--addr2line", nargs = 1, default = ["arm-none-eabi-addr2line"], help = "addr2line to use")
+parser.add_argument("-l", "--log", nargs = 1, default = None, help = "write the log records here, for logdecode.py")
+parser.add_argument("-t", "--trace", nargs = 1, default = None, help = "write the trace here, for schedtrace.py")
+parser.add_argument("record", nargs = "?", help = "the record (default stdin)")
+args = parser.parse_args()
+
+# crash_dump.h
+MAGIC = 0x48535243
+HEADER = struct.Struct("<IBBBBIII")
+SECTION = struct.Struct("<HH")
+NAME_LEN = 10   # configMAX_TASK_NAME_LEN
+REGS = struct.Struct("<4I10I%ds64s" % NAME_LEN)
+TASK = struct.Struct("<%dsBBBBHIII" % NAME_LEN)
+HEAP = struct.Struct("<II")
+HEAP_THREAD = struct.Struct("<III")
+(REGS_S, STACK_S, TASKS_S, HEAP_S, TRACE_S, LOG_S) = range(6)
+SECTION_NAMES = ["registers", "stack", "tasks", "heap", "trace", "log"]
+REASONS = ["panic", "hard fault", "bus fault", "usage fault", "memory fault"]
+# eTaskState in task.h
+STATES = ["running", "ready", "blocked", "suspended", "deleted"]
+THREADS = ["app", "worker", "overlay"]
+# LOG_BIN_SYNC in log_binary.c
+LOG_SYNC = 0x1e
+TRACE_RECORD = 8
+
+data = bytes((open(args.record, "rb") if args.record else getattr(sys.stdin, "buffer", sys.stdin)).read())
+start = data.find(struct.pack("<I", MAGIC))
+if start < 0:
+    sys.exit("no crash record in there")
+data = data[start:]
+
+(magic, version, reason, whole, _, length, tick, capture_us) = HEADER.unpack_from(data, 0)
+if version != 1:
+    sys.exit("record version %d, this knows 1" % version)
+if length > len(data):
+    print("record says %d bytes, only %d here" % (length, len(data)))
+    length = len(data)
+
+sections = {}
+pos = HEADER.size
+while pos + SECTION.size <= length:
+    (type, n) = SECTION.unpack_from(data, pos)
+    if type == 0xFFFF:
+        break
+    sections[type] = data[pos + SECTION.size:pos + SECTION.size + n]
+    pos = (pos + SECTION.size + n + 3) & ~3
+
+names = {}
+def where(addrs):
+    if not args.elf:
+        return
+    addrs = sorted(set(a for a in addrs if a and a not in names))
+    if not addrs:
+        return
+    out = subprocess.check_output([args.addr2line[0], "-f", "-s", "-e", args.elf[0]] +
+                                  ["0x%x" % (a & ~1) for a in addrs]).decode().splitlines()
+    for i, a in enumerate(addrs):
+        names[a] = "%s %s" % (out[i * 2], out[i * 2 + 1])
+
+def name(a):
+    return names.get(a, "")
+
+def cstr(b):
+    return b.split(b"\0")[0].decode("latin-1")
+
+print("%s at tick %d, %d bytes, taken in %d us" % (
+      REASONS[reason] if reason < len(REASONS) else "reason %d" % reason, tick, length, capture_us))
+missing = [SECTION_NAMES[i] for i in range(len(SECTION_NAMES)) if not whole & (1 << i)]
+if missing:
+    print("not all there: %s" % ", ".join(missing))
+
+tasks = []
+if TASKS_S in sections:
+    d = sections[TASKS_S]
+    tasks = [TASK.unpack_from(d, i) for i in range(0, len(d) - TASK.size + 1, TASK.size)]
+
+if REGS_S in sections and len(sections[REGS_S]) >= REGS.size:
+    v = REGS.unpack_from(sections[REGS_S])
+    (r0, r1, r2, r3) = v[0:4]
+    (r12, sp, lr, pc, xpsr, exc_return, cfsr, hfsr, mmfar, bfar) = v[4:14]
+    where([pc, lr])
+    print("")
+    print("task %s%s" % (cstr(v[14]) or "(none)", ", in exception %d" % (xpsr & 0x1ff) if xpsr & 0x1ff else ""))
+    if cstr(v[15]):
+        print("  %s" % cstr(v[15]))
+    print("  pc %08x %s" % (pc, name(pc)))
+    print("  lr %08x %s" % (lr, name(lr)))
+    print("  r0 %08x r1 %08x r2 %08x r3 %08x r12 %08x sp %08x xpsr %08x" % (r0, r1, r2, r3, r12, sp, xpsr))
+    print("  cfsr %08x hfsr %08x mmfar %08x bfar %08x exc_return %08x" % (cfsr, hfsr, mmfar, bfar, exc_return))
+
+if STACK_S in sections and len(sections[STACK_S]) >= 4:
+    d = sections[STACK_S]
+    base, = struct.unpack_from("<I", d)
+    words = struct.unpack_from("<%dI" % ((len(d) - 4) // 4), d, 4)
+    # anything that could be a return address into the image
+    where([w for w in words if w & 1 and 0x08000000 <= w < 0x08200000])
+    print("")
+    print("stack from %08x" % base)
+    for i, w in enumerate(words):
+        if name(w):
+            print("  %08x: %08x %s" % (base + i * 4, w, name(w)))
+    if not args.elf:
+        for i in range(0, len(words), 8):
+            print("  %08x: %s" % (base + i * 4, " ".join("%08x" % w for w in words[i:i + 8])))
+
+if tasks:
+    where([t[7] for t in tasks] + [t[8] for t in tasks])
+    print("")
+    print("%-3s %-10s %-9s %4s %6s %-8s %-8s %s" % ("#", "task", "state", "pri", "free", "pc", "lr", "where"))
+    for (tname, num, state, pri, _, free, sp, pc, lr) in tasks:
+        print("%-3d %-10s %-9s %4d %6d %08x %08x %s" % (num, cstr(tname),
+              STATES[state] if state < len(STATES) else state, pri, free, pc, lr, name(pc)))
+
+if HEAP_S in sections:
+    d = sections[HEAP_S]
+    (free, min_free) = HEAP.unpack_from(d)
+    print("")
+    print("system heap %d free, %d at the least" % (free, min_free))
+    for i in range((len(d) - HEAP.size) // HEAP_THREAD.size):
+        (size, used, peak) = HEAP_THREAD.unpack_from(d, HEAP.size + i * HEAP_THREAD.size)
+        if size:
+            print("%s heap %d of %d used, %d at the most" % (THREADS[i] if i < len(THREADS) else i, used, size, peak))
+
+if TRACE_S in sections:
+    d = sections[TRACE_S]
+    cycles_per_us, = struct.unpack_from("<I", d)
+    n = (len(d) - 4) // TRACE_RECORD
+    print("")
+    print("%d trace records" % n)
+    if args.trace:
+        # as sched_trace_dump logs it
+        with open(args.trace[0], "w") as out:
+            out.write("schedtrace %d records, 0 dropped, %d cycles/us\n" % (n, cycles_per_us))
+            for t in tasks:
+                out.write("schedtask %d %s\n" % (t[1], cstr(t[0])))
+            for i in range(4, 4 + n * TRACE_RECORD, TRACE_RECORD * 4):
+                chunk = d[i:min(i + TRACE_RECORD * 4, 4 + n * TRACE_RECORD)]
+                out.write("schedtrace %s\n" % "".join("%02x" % c for c in bytearray(chunk)))
+
+if LOG_S in sections:
+    d = bytearray(sections[LOG_S])
+    # each ring entry is the thread type, then a record; the oldest may be
+    # cut off. Keep whichever records check out
+    recs = bytearray()
+    count = 0
+    i = 0
+    while i + 2 < len(d):
+        n = d[i + 1]
+        end = i + 2 + n
+        if d[i] == LOG_SYNC and end < len(d) and sum(d[i + 1:end]) & 0xff == d[end]:
+            recs += d[i:end + 1]
+            count += 1
+            i = end + 1
+        else:
+            i += 1
+    print("%d log records" % count)
+    if args.log:
+        open(args.log[0], "wb").write(recs)
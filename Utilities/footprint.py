@@ -0,0 +1,224 @@
+#!/usr/bin/env python
+
+"""
+Where the RAM and flash go, from the linker's map (tintin_fw.map, next to
+the ELF). Splits .text, .rodata, .data, .bss and .ccmram by the module
+each object came from, a directory a couple of levels deep (rcore,
+rwatch/ui, lib/btstack, hw/chip, ...), and lists the largest symbols.
+Given two maps, shows what changed between the builds, down to the
+symbol, and what it did to the heap.
+
+Symbols are the input sections: with -ffunction-sections and
+-fdata-sections each function and static gets its own.
+
+What HOT_RAMFUNC and HOT_DATA put in RAM is listed by object, against
+what the platform's config.mk allows. A whole object's HOT_RAMFUNC
+functions share one input section, so there is no finer split.
+RebbleOS
+"""
+
+import argparse
+import os
+import re
+
+parser = argparse.ArgumentParser(description = "RAM and flash footprint by module for RebbleOS.")
+parser.add_argument("-d", "--depth", nargs = 1, type = int, default = [2], help = "directory levels that make a module (default 2)")
+parser.add_argument("-n", "--symbols", nargs = 1, type = int, default = [20], help = "how many symbols to list (default 20)")
+parser.add_argument("-m", "--module", nargs = 1, default = None, help = "only symbols from modules under this path")
+parser.add_argument("map", nargs = "+", help = "link map, or an old one and a new one to compare")
+args = parser.parse_args()
+
+if len(args.map) > 2:
+    parser.error("one map, or two to compare")
+
+KINDS = [ "text", "rodata", "data", "bss", "ccmram" ]
+# output sections as the .lds files have them; the rest of flash is code
+OUTPUT = { ".rodata": "rodata", ".data": "data", ".bss": "bss", ".ccmram": "ccmram" }
+
+INPUT = re.compile(r"^ (\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(.+)$")
+WRAPPED = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(.+)$")
+SYMBOL = re.compile(r"^\s+0x([0-9a-f]+)\s+(\w+)$")
+ASSIGN = re.compile(r"^\s+0x([0-9a-f]+)\s+(\w+) = ")
+SECTION = re.compile(r"^(\.\S+)")
+
+class Footprint(object):
+    def __init__(self, path):
+        self.base = os.path.dirname(path)
+        self.modules = {}   # module -> { kind: bytes }
+        self.symbols = {}   # (kind, name, module) -> bytes
+        self.syms = {}      # linker symbols, _end and friends
+        self.hot = {}       # (what, object) -> bytes, for HOT_RAMFUNC and HOT_DATA
+        self.parse(open(path).read().splitlines())
+
+    def module(self, obj):
+        # an archive member is its archive
+        m = re.match(r"(.*\.a)\(.*\)$", obj)
+        if m:
+            return os.path.basename(m.group(1))
+        obj = os.path.normpath(obj)
+        if self.base and obj.startswith(self.base + os.sep):
+            obj = obj[len(self.base) + 1:]
+        else:
+            # a map that has been copied away from its build
+            obj = re.sub(r"^(.*/)?build/[^/]+/", "", obj)
+        parts = os.path.dirname(obj).split(os.sep)
+        return "/".join(parts[:args.depth[0]]) or "."
+
+    def add(self, kind, section, size, obj, symbol):
+        if not size or kind is None:
+            return
+        module = self.module(obj) if obj != "*fill*" else "(fill)"
+        for (prefix, what) in ((".ramfunc", "code"), (".ccmram.hot", "data")):
+            if section.startswith(prefix):
+                key = (what, os.path.basename(obj))
+                self.hot[key] = self.hot.get(key, 0) + size
+        mod = self.modules.setdefault(module, dict.fromkeys(KINDS, 0))
+        mod[kind] += size
+        # .text.foo is foo; a plain .text or COMMON is named by its first symbol
+        name = section.split(".", 2)[2] if section.count(".") >= 2 else symbol or section
+        key = (kind, name, module)
+        self.symbols[key] = self.symbols.get(key, 0) + size
+
+    def parse(self, lines):
+        kind = None
+        pending = None      # an input section whose name had a line to itself
+        last = None         # the input section symbols are being read under
+        started = False
+
+        for line in lines:
+            if not started:
+                started = line.startswith("Linker script and memory map")
+                continue
+
+            m = ASSIGN.match(line)
+            if m:
+                self.syms[m.group(2)] = int(m.group(1), 16)
+                continue
+
+            m = SECTION.match(line)
+            if m:
+                self.flush(last)
+                last = None
+                name = m.group(1)
+                kind = OUTPUT.get(name, "text")
+                if name.startswith(".debug") or name.startswith(".comment") or name in (".ARM.attributes", ".stab", ".stabstr"):
+                    kind = None
+                continue
+
+            if pending:
+                m = WRAPPED.match(line)
+                if m:
+                    last = [ kind, pending, int(m.group(2), 16), m.group(3).strip(), None ]
+                    pending = None
+                    continue
+                pending = None
+
+            m = INPUT.match(line)
+            if m and not line.startswith(" *"):
+                self.flush(last)
+                last = [ kind, m.group(1), int(m.group(3), 16), m.group(4).strip(), None ]
+                continue
+            if line.startswith(" *fill*"):
+                self.flush(last)
+                last = None
+                f = line.split()
+                if len(f) >= 3:
+                    self.add(kind, "*fill*", int(f[2], 16), "*fill*", None)
+                continue
+
+            m = re.match(r"^ (\S+)$", line)
+            if m and not line.startswith(" *"):
+                self.flush(last)
+                last = None
+                pending = m.group(1)
+                continue
+
+            m = SYMBOL.match(line)
+            if m and last and last[4] is None:
+                last[4] = m.group(2)
+        self.flush(last)
+
+    def flush(self, last):
+        if last:
+            self.add(*last)
+
+    def total(self, kind):
+        return sum(m[kind] for m in self.modules.values())
+
+    def heap(self):
+        if "_ram_top" in self.syms and "_end" in self.syms:
+            return self.syms["_ram_top"] - self.syms["_end"]
+        return None
+
+def flash(m):
+    return m["text"] + m["rodata"] + m["data"]
+
+def ram(m):
+    return m["data"] + m["bss"]
+
+COLS = KINDS + [ "flash", "ram" ]
+
+def row(m):
+    return [ m[k] for k in KINDS ] + [ flash(m), ram(m) ]
+
+def wanted(module):
+    return not args.module or module.startswith(args.module[0])
+
+def report(fp):
+    print(("%-24s" + " %8s" * len(COLS)) % tuple([ "module" ] + COLS))
+    for name in sorted(fp.modules, key = lambda n: -(flash(fp.modules[n]) + ram(fp.modules[n]))):
+        print(("%-24s" + " %8d" * len(COLS)) % tuple([ name ] + row(fp.modules[name])))
+    totals = dict((k, fp.total(k)) for k in KINDS)
+    print(("%-24s" + " %8d" * len(COLS)) % tuple([ "total" ] + row(totals)))
+    if fp.heap() is not None:
+        print("\n%d bytes of RAM left for the heap" % fp.heap())
+
+    print("\n%-8s %8s  %-40s %s" % ("section", "bytes", "symbol", "module"))
+    syms = [ (size, key) for (key, size) in fp.symbols.items() if wanted(key[2]) ]
+    for (size, (kind, name, module)) in sorted(syms, reverse = True)[:args.symbols[0]]:
+        print("%-8s %8d  %-40s %s" % (kind, size, name, module))
+
+    if fp.hot:
+        hot_report(fp)
+
+def hot_report(fp):
+    print("")
+    for (what, limit) in (("code", "_hot_text_limit"), ("data", "_hot_data_limit")):
+        used = sum(size for ((w, _), size) in fp.hot.items() if w == what)
+        if used or limit in fp.syms:
+            print("hot %s: %d of %d bytes" % (what, used, fp.syms.get(limit, 0)))
+    print("%-8s %8s  %s" % ("hot", "bytes", "object"))
+    for ((what, obj), size) in sorted(fp.hot.items(), key = lambda kv: -kv[1]):
+        print("%-8s %8d  %s" % (what, size, obj))
+
+def compare(old, new):
+    print(("%-24s" + " %8s" * len(COLS)) % tuple([ "module" ] + COLS))
+    empty = dict.fromkeys(KINDS, 0)
+    changed = []
+    for name in set(old.modules) | set(new.modules):
+        a = row(old.modules.get(name, empty))
+        b = row(new.modules.get(name, empty))
+        delta = [ y - x for (x, y) in zip(a, b) ]
+        if any(delta):
+            changed.append((name, delta))
+    for (name, delta) in sorted(changed, key = lambda c: -abs(c[1][-1]) - abs(c[1][-2])):
+        print(("%-24s" + " %+8d" * len(COLS)) % tuple([ name ] + delta))
+    a = row(dict((k, old.total(k)) for k in KINDS))
+    b = row(dict((k, new.total(k)) for k in KINDS))
+    print(("%-24s" + " %+8d" * len(COLS)) % tuple([ "total" ] + [ y - x for (x, y) in zip(a, b) ]))
+    if old.heap() is not None and new.heap() is not None:
+        print("\n%d bytes of RAM left for the heap, was %d (%+d)" % (new.heap(), old.heap(), new.heap() - old.heap()))
+
+    print("\n%-8s %8s %8s  %-40s %s" % ("section", "bytes", "change", "symbol", "module"))
+    deltas = []
+    for key in set(old.symbols) | set(new.symbols):
+        d = new.symbols.get(key, 0) - old.symbols.get(key, 0)
+        if d and wanted(key[2]):
+            deltas.append((abs(d), d, key))
+    for (_, d, (kind, name, module)) in sorted(deltas, reverse = True)[:args.symbols[0]]:
+        print("%-8s %8d %+8d  %-40s %s" % (kind, new.symbols.get((kind, name, module), 0), d, name, module))
+
+if len(args.map) == 1:
+    report(Footprint(args.map[0]))
+else:
+    compare(Footprint(args.map[0]), Footprint(args.map[1]))
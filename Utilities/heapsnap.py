@@ -0,0 +1,106 @@
+#!/usr/bin/env python
+
+"""
+Diffs two heap snapshots out of the debug log (ask for them through the
+heap snapshot debug endpoint, see memory_heap_snapshot in
+rcore/rebble_memory.c): what is allocated in the later one that wasn't in
+the earlier, by call site and size, and how the free space has broken up.
+Call sites are there for blocks the MEMORY_TRACE ring still had.
+
+The snapshots can be in one log or two. By default the first and last
+found are compared.
+RebbleOS
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+
+parser = argparse.ArgumentParser(description = "Heap snapshot diff for RebbleOS.")
+parser.add_argument("-e", "--elf", nargs = 1, default = None, help = "firmware ELF, to name call sites with addr2line")
+parser.add_argument("-a", "--addr2line", nargs = 1, default = ["arm-none-eabi-addr2line"], help = "addr2line to use")
+parser.add_argument("-f", "--from", dest = "first", type = int, default = 0, help = "snapshot to diff from (default the first)")
+parser.add_argument("-t", "--to", dest = "last", type = int, default = -1, help = "snapshot to diff to (default the last)")
+parser.add_argument("-c", "--count", type = int, default = 30, help = "how many sites to list (default 30)")
+parser.add_argument("log", nargs = "*", help = "serial logs (default stdin)")
+args = parser.parse_args()
+
+# HeapSnapshotRecord in rebble_memory.c
+RECORD = struct.Struct("<III")
+# first fit walks for these sizes get counted
+WALK_SIZES = [16, 64, 256, 1024]
+
+class Snapshot:
+    def __init__(self, header):
+        words = header.replace(",", "").split()
+        self.heap = words[0]
+        self.seen = int(words[4])
+        self.size = int(words[words.index("size") + 1])
+        self.used = int(words[words.index("used") + 1])
+        self.tick = int(words[words.index("at") + 1])
+        self.blocks = []    # (ptr, size, free, pc) in address order
+
+    def summary(self):
+        used = [b for b in self.blocks if not b[2]]
+        free = [b for b in self.blocks if b[2]]
+        print("%s heap at tick %d: %d blocks%s, %d allocated in %d bytes, %d free in %d bytes, largest free %d" % (
+              self.heap, self.tick, len(self.blocks),
+              "" if self.seen == len(self.blocks) else " (of %d)" % self.seen,
+              len(used), sum(b[1] for b in used), len(free), sum(b[1] for b in free),
+              max([b[1] for b in free] or [0])))
+        walks = []
+        for want in WALK_SIZES:
+            for i, b in enumerate(self.blocks):
+                if b[2] and b[1] >= want:
+                    walks.append("%d: %d" % (want, i + 1))
+                    break
+            else:
+                walks.append("%d: none fits" % want)
+        print("  blocks a first fit walks, by size asked for  " + ", ".join(walks))
+
+snaps = []
+logs = [open(name) for name in args.log] if args.log else [sys.stdin]
+for log in logs:
+    for line in log:
+        if "heapsnap " in line:
+            rest = line.split("heapsnap ", 1)[1]
+            if " blocks of " in rest:
+                snaps.append(Snapshot(rest))
+        elif "heapblk " in line and snaps:
+            for word in line.split("heapblk ", 1)[1].split():
+                if len(word) != RECORD.size * 2:
+                    continue
+                ptr, size, pc = RECORD.unpack(bytes(bytearray.fromhex(word)))
+                snaps[-1].blocks.append((ptr, size & ~3, bool(size & 1), pc))
+
+if len(snaps) < 2:
+    sys.exit("need two snapshots, found %d" % len(snaps))
+
+a = snaps[args.first]
+b = snaps[args.last]
+a.summary()
+b.summary()
+
+before = set((p, s) for p, s, free, _ in a.blocks if not free)
+grown = {}      # (pc, size) -> count
+for p, s, free, pc in b.blocks:
+    if not free and (p, s) not in before:
+        grown[(pc, s)] = grown.get((pc, s), 0) + 1
+gone = len(before - set((p, s) for p, s, free, _ in b.blocks if not free))
+
+names = {}
+if args.elf:
+    pcs = sorted(set(pc for pc, _ in grown if pc))
+    if pcs:
+        out = subprocess.check_output([args.addr2line[0], "-f", "-s", "-e", args.elf[0]] +
+                                      ["0x%x" % (pc - 1) for pc in pcs]).decode().splitlines()
+        for i, pc in enumerate(pcs):
+            names[pc] = "%s %s" % (out[i * 2], out[i * 2 + 1])
+
+print("")
+print("%d blocks allocated since, %d bytes; %d freed" % (
+      sum(grown.values()), sum(s * n for (_, s), n in grown.items()), gone))
+print("%-10s %8s %8s %8s  %s" % ("pc", "size", "blocks", "bytes", "where"))
+for (pc, s), n in sorted(grown.items(), key = lambda kv: -kv[0][1] * kv[1])[:args.count]:
+    print("0x%08x %8d %8d %8d  %s" % (pc, s, n, s * n, names.get(pc, "" if pc else "(not traced)")))
@@ -0,0 +1,207 @@
+#!/usr/bin/env python
+
+"""
+Expands binary log records (see rcore/log_binary.c) back into log lines,
+as the text log would have printed them. Format strings, file names and
+module names are looked up by address in the firmware ELF, which must be
+the one the watch is running. Text between records is passed through, so
+a serial log with both in it reads as one.
+RebbleOS
+"""
+
+import argparse
+import struct
+import sys
+
+parser = argparse.ArgumentParser(description = "Binary log records to text for RebbleOS.")
+parser.add_argument("-e", "--elf", nargs = 1, required = True, help = "firmware ELF the watch is running")
+parser.add_argument("-o", "--output", nargs = 1, default = None, help = "text log (default stdout)")
+parser.add_argument("log", nargs = "?", help = "serial log or BT dump of ENDPOINT_LOG_STREAM (default stdin)")
+args = parser.parse_args()
+
+# LOG_BIN_ in log_binary.c
+SYNC = 0x1e
+FLAG_ISR = 1 << 3
+FLAG_NAME = 1 << 4
+HEADER = struct.Struct("<BBBBIH")
+# LogLevel in log.h
+LEVELS = "EWIDV"
+
+class Elf(object):
+    """Just enough of ELF32 to read a string at an address"""
+    def __init__(self, path):
+        self.data = open(path, "rb").read()
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (name, type, flags, addr, offset, size) = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            # SHT_PROGBITS and SHF_ALLOC: in the image, with bytes in the file
+            if type == 1 and flags & 2 and addr:
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for (base, offset, size) in self.sections:
+            if base <= addr < base + size:
+                start = offset + addr - base
+                end = self.data.index(b"\0", start)
+                return self.data[start:end].decode("latin-1")
+        return "<%08x?>" % addr
+
+def cstring(data, pos):
+    end = data.index(b"\0", pos)
+    return data[pos:end].decode("latin-1"), end + 1
+
+def vsfmt(fmt, args):
+    """As lib/minilib/fmt.c does it, widths and all"""
+    out = []
+    i = 0
+    while i < len(fmt):
+        c = fmt[i]
+        i += 1
+        if c != "%":
+            out.append(c)
+            continue
+        flags = ""
+        while fmt[i:i + 1] in ("0", "-"):
+            flags += fmt[i]
+            i += 1
+        width = 0
+        if fmt[i:i + 1] == "*":
+            width = args.pop(0) if args else 0
+            if width & 0x80000000:
+                width -= 0x100000000
+            if width < 0:
+                flags += "-"
+                width = -width
+            i += 1
+        else:
+            w = ""
+            while i < len(fmt) and fmt[i].isdigit():
+                w += fmt[i]
+                i += 1
+            width = int(w or "0")
+        prec = None
+        if fmt[i:i + 1] == ".":
+            i += 1
+            if fmt[i:i + 1] == "*":
+                prec = args.pop(0) if args else 0
+                i += 1
+            else:
+                p = ""
+                while i < len(fmt) and fmt[i].isdigit():
+                    p += fmt[i]
+                    i += 1
+                prec = int(p or "0")
+        longer = False
+        if fmt[i:i + 1] == "l":
+            i += 1
+            if fmt[i:i + 1] == "l":
+                longer = True
+                i += 1
+        if i >= len(fmt):
+            break
+        c = fmt[i]
+        i += 1
+        if c == "%":
+            out.append("%")
+            continue
+        if c not in "spdiuoxXc":
+            continue
+        v = args.pop(0) if args else 0
+        left = "-" in flags
+        if c == "s":
+            s = v[:prec] if prec is not None else v
+        elif c == "c":
+            s = chr(v & 0xff)
+        else:
+            bits = 64 if longer else 32
+            if c == "p":
+                flags, width, prec, left = "0", 8, None, False
+            neg = c in "di" and (v >> (bits - 1)) & 1
+            if neg:
+                v = (1 << bits) - v
+            s = { "d": "%d", "i": "%d", "u": "%d", "o": "%o", "x": "%x", "X": "%X", "p": "%x" }[c] % v
+            if prec is not None:
+                s = "" if prec == 0 and v == 0 else s.rjust(prec, "0")
+            elif "0" in flags and not left:
+                s = s.rjust(width - neg, "0")
+            s = ("-" if neg else "") + s
+        out.append(s.ljust(width) if left else s.rjust(width))
+    return "".join(out)
+
+def pad(s, n):
+    # as log.c's text lines: cut from the left, or pad on the right
+    return s[-n:] if len(s) > n else s.ljust(n)
+
+elf = Elf(args.elf[0])
+tasks = {}
+
+def record(rec):
+    (flags, inl, task, time, line) = HEADER.unpack_from(rec, 1)[1:]
+    pos = 1 + HEADER.size
+    if flags & FLAG_NAME:
+        tasks[task], pos = cstring(rec, pos)
+    strs = []
+    for bit in range(4):
+        if inl & (1 << bit):
+            s, pos = cstring(rec, pos)
+        else:
+            s = elf.string(struct.unpack_from("<I", rec, pos)[0])
+            pos += 4
+        strs.append(s)
+    (fmt, filename, module, layer) = strs
+
+    # the arguments, as log_binary.c's _put_args took them
+    fargs = []
+    f = fmt.replace("%%", "")
+    i = f.find("%")
+    while i >= 0 and pos < len(rec):
+        j = i + 1
+        while j < len(f) and (f[j].isdigit() or f[j] in ".*l-"):
+            if f[j] == "*":
+                fargs.append(struct.unpack_from("<I", rec, pos)[0])
+                pos += 4
+            j += 1
+        if j < len(f) and f[j] == "s":
+            s, pos = cstring(rec, pos)
+            fargs.append(s)
+        elif j < len(f) and f[j] in "pdiuoxXc":
+            words = 2 if f[i:j].endswith("ll") else 1
+            if pos + 4 * words > len(rec):
+                break
+            if words == 2:
+                fargs.append(struct.unpack_from("<Q", rec, pos)[0])
+            else:
+                fargs.append(struct.unpack_from("<I", rec, pos)[0])
+            pos += 4 * words
+        i = f.find("%", j + 1)
+
+    level = LEVELS[flags & 7] if flags & 7 < len(LEVELS) else "?"
+    who = "isr" if flags & FLAG_ISR else tasks.get(task, "#%d" % task)
+    return "%10.3f [%s][%s][%s][%s][%s:%d] %s" % (time / 1000.0, who, level,
+        pad(module, 6), pad(layer, 6), pad(filename, 13), line, vsfmt(fmt, fargs))
+
+data = bytearray((open(args.log, "rb") if args.log else getattr(sys.stdin, "buffer", sys.stdin)).read())
+out = open(args.output[0], "w") if args.output else sys.stdout
+
+text = bytearray()
+i = 0
+while i < len(data):
+    if data[i] == SYNC and i + 2 < len(data):
+        n = data[i + 1]
+        end = i + 2 + n
+        if end < len(data) and n >= HEADER.size - 1 and sum(data[i + 1:end]) & 0xff == data[end]:
+            if text:
+                out.write(text.decode("latin-1"))
+                text = bytearray()
+            try:
+                out.write(record(bytes(data[i:end])) + "\n")
+            except (ValueError, struct.error):
+                out.write("<bad record at %d>\n" % i)
+            i = end + 1
+            continue
+    text.append(data[i])
+    i += 1
+if text:
+    out.write(text.decode("latin-1"))
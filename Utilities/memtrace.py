@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+
+"""
+Turns a memtrace dump out of the debug log (build with MEMORY_TRACE in
+rcore/rebble_memory.h) into a report per call site: what is still
+allocated, and the most each site had out at once.
+RebbleOS
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+
+parser = argparse.ArgumentParser(description = "Allocation trace report for RebbleOS.")
+parser.add_argument("-e", "--elf", nargs = 1, default = None, help = "firmware ELF, to name call sites with addr2line")
+parser.add_argument("-a", "--addr2line", nargs = 1, default = ["arm-none-eabi-addr2line"], help = "addr2line to use")
+parser.add_argument("log", nargs = "?", help = "serial log (default stdin)")
+args = parser.parse_args()
+
+# MemoryTraceRecord in rebble_memory.c
+RECORD = struct.Struct("<IIIHBB")
+OP_ALLOC, OP_FREE, OP_FAIL = range(3)
+HEAPS = { 0: "app", 1: "worker", 2: "overlay", 0xFF: "system" }
+
+class Site:
+    def __init__(self):
+        self.allocs = 0
+        self.frees = 0
+        self.fails = 0
+        self.live = 0
+        self.peak = 0
+
+sites = {}
+live = {}       # (heap, ptr) -> (site, size)
+orphans = 0     # frees of something allocated before the ring starts
+
+def site(heap, pc):
+    return sites.setdefault((heap, pc), Site())
+
+log = open(args.log) if args.log else sys.stdin
+for line in log:
+    if "memtrace " not in line:
+        continue
+    word = line.split("memtrace ", 1)[1].split()[0]
+    if len(word) != RECORD.size * 2:
+        continue
+    pc, ptr, size, tick, op, heap = RECORD.unpack(bytes(bytearray.fromhex(word)))
+
+    if op == OP_ALLOC:
+        s = site(heap, pc)
+        s.allocs += 1
+        s.live += size
+        s.peak = max(s.peak, s.live)
+        live[(heap, ptr)] = (s, size)
+    elif op == OP_FAIL:
+        site(heap, pc).fails += 1
+    elif op == OP_FREE and ptr:
+        if (heap, ptr) not in live:
+            orphans += 1
+            continue
+        s, size = live.pop((heap, ptr))
+        s.live -= size
+        s.frees += 1
+
+names = {}
+if args.elf:
+    pcs = sorted(set(pc for _, pc in sites))
+    out = subprocess.check_output([args.addr2line[0], "-f", "-s", "-e", args.elf[0]] +
+                                  ["0x%x" % (pc - 1) for pc in pcs]).decode().splitlines()
+    for i, pc in enumerate(pcs):
+        names[pc] = "%s %s" % (out[i * 2], out[i * 2 + 1])
+
+print("%-8s %-10s %8s %8s %6s %8s %8s  %s" % ("heap", "pc", "allocs", "frees", "fails", "live", "peak", "where"))
+for (heap, pc), s in sorted(sites.items(), key = lambda kv: -kv[1].live):
+    print("%-8s 0x%08x %8d %8d %6d %8d %8d  %s" % (HEAPS.get(heap, heap), pc, s.allocs, s.frees,
+          s.fails, s.live, s.peak, names.get(pc, "")))
+if orphans:
+    print("%d frees of blocks allocated before the trace starts" % orphans)
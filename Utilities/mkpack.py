@@ -46,6 +46,12 @@ crush_png = None # To be imported
 TAB_OFS = 0x0C
 RES_OFS = 0x200C
 
+# Set in a table entry's index for a resource stored LZ4 compressed; see
+# rcore/resource.c.  Its data is then the compressed length, as a uint32,
+# then one LZ4 block.  The size and CRC are still those of what it unpacks
+# to.
+RES_FLAG_LZ4 = 0x80000000
+
 def find_pebble_sdk():
     """
     Returns a valid path to the currently installed pebble sdk or 
@@ -75,6 +81,59 @@ def import_crush_png(sdk_path):
     return convert_png_to_pebble_png_bytes
 
 
+def lz4_compress(data):
+    """
+    Packs |data| as one LZ4 block.  This is a plain greedy packer that
+    remembers the last place it saw each four bytes, which does well
+    enough on fonts and bitmaps without needing anything past the standard
+    library.
+    """
+    
+    out = bytearray()
+    
+    def length(v):
+        while v >= 255:
+            out.append(255)
+            v -= 255
+        out.append(v)
+    
+    def sequence(lit, mlen, dist):
+        token = min(len(lit), 15) << 4
+        if mlen:
+            token |= min(mlen - 4, 15)
+        out.append(token)
+        if len(lit) >= 15:
+            length(len(lit) - 15)
+        out.extend(lit)
+        if mlen:
+            out.extend(struct.pack('<H', dist))
+            if mlen - 4 >= 15:
+                length(mlen - 4 - 15)
+    
+    # The format wants the last match to start at least 12 bytes from the
+    # end, and the last five bytes left as literals.
+    end = len(data)
+    seen = {}
+    anchor = 0
+    i = 0
+    while i < end - 12:
+        key = data[i:i + 4]
+        cand = seen.get(key)
+        seen[key] = i
+        if cand is None or i - cand > 0xFFFF:
+            i += 1
+            continue
+        
+        mlen = 4
+        while i + mlen < end - 5 and data[cand + mlen] == data[i + mlen]:
+            mlen += 1
+        sequence(data[anchor:i], mlen, i - cand)
+        i += mlen
+        anchor = i
+    sequence(data[anchor:], 0, 0)
+    
+    return bytes(out)
+
 def load_resource_from_pbpack(fname, resid):
     """
     Returns resource number |resid| from the pbpack file specified by
@@ -86,9 +145,11 @@ def load_resource_from_pbpack(fname, resid):
         
         for i in range(nrsrc):
             f.seek(TAB_OFS + i * 16)
-            (idx, ofs, sz, crc) = struct.unpack('iiiI', f.read(16))
+            (idx, ofs, sz, crc) = struct.unpack('IiiI', f.read(16))
             
-            if idx == resid:
+            if idx & ~RES_FLAG_LZ4 == resid:
+                if idx & RES_FLAG_LZ4:
+                    raise IOError("res {} in pbpack \"{}\" is compressed".format(resid, fname))
                 break
         else:
             raise IOError("res {} not found in pbpack \"{}\"".format(resid, fname))
@@ -116,13 +177,24 @@ def save_pbpack(fname, rsrcs):
     it wants.  (And, further, every Pebble pbpack that I can find only has
     them in order.)  So we, in keeping, will only generate things like that.
     
+    Each resource comes with whether it should be compressed.  It's only
+    stored compressed if that comes out smaller.
+    
     """
     
     # First, turn the resource table into a list of entries, including
     # index, offset, size, and CRC.
-    def mk_ent(data):
-        ent = {"idx": mk_ent.idx, "offset": mk_ent.offset, "size": len(data), "crc": crc32(data), "data": data}
-        mk_ent.offset += len(data)
+    def mk_ent(res):
+        (data, compress) = res
+        idx = mk_ent.idx
+        stored = data
+        if compress:
+            packed = lz4_compress(data)
+            if len(packed) + 4 < len(data):
+                idx |= RES_FLAG_LZ4
+                stored = struct.pack('I', len(packed)) + packed
+        ent = {"idx": idx, "offset": mk_ent.offset, "size": len(data), "crc": crc32(data), "data": stored}
+        mk_ent.offset += len(stored)
         mk_ent.idx += 1
         return ent
     mk_ent.offset = 0
@@ -136,7 +208,7 @@ def save_pbpack(fname, rsrcs):
         # Write out the table.
         f.seek(TAB_OFS)
         for ent in rsrc_ents:
-            f.write(struct.pack('iiiI', ent["idx"], ent["offset"], ent["size"], ent["crc"]))
+            f.write(struct.pack('IiiI', ent["idx"], ent["offset"], ent["size"], ent["crc"]))
         
         # Write out the resources themselves.
         for ent in rsrc_ents:
@@ -158,6 +230,7 @@ class Resource(object):
     def __init__(self, coll, j):
         self.coll = coll
         self.name = j["name"]
+        self.compress = j.get("compress", False)
 
 class ResourceRef(Resource):
     def __init__(self, coll, j):
@@ -229,6 +302,10 @@ class ResourceCollection:
             key, with a filename; if "resource", then there should be a
             "ref" key, with a reference from "references" above, and an "id"
             key, with a resource ID to load from that reference.
+          
+          * "compress": Optional.  If true, store the resource LZ4
+            compressed.  Only for resources that are loaded whole, such as
+            fonts, as the firmware can't start reading part way into one.
     
     """
 
@@ -276,10 +353,11 @@ class ResourceCollection:
     
     def rsrcs(self):
         """
-        List of raw resource data in this resource pack.
+        List of raw resource data in this resource pack, each with whether
+        to compress it.
         """
         
-        return [r.data() for r in self.resources]
+        return [(r.data(), r.compress) for r in self.resources]
     
     def write_pbpack(self, fname):
         """
@@ -0,0 +1,102 @@
+#!/usr/bin/env python
+
+"""
+Turns a pcprofile dump out of the debug log (build with PC_PROFILE=1, and
+start and dump it through the debug endpoint, see rcore/pc_profile.c)
+into a flat profile: the functions the samples landed in, most first, and
+each task's share.
+
+A bucket that spans several functions is split between them by how many
+of its bytes each has; the smaller the buckets (the smaller the image),
+the less that matters. The ELF must be the one that took the samples.
+RebbleOS
+"""
+
+import argparse
+import bisect
+import subprocess
+import sys
+
+parser = argparse.ArgumentParser(description = "Sampling profile by function for RebbleOS.")
+parser.add_argument("-e", "--elf", nargs = 1, required = True, help = "firmware ELF, tintin_fw.elf")
+parser.add_argument("-n", "--nm", nargs = 1, default = ["arm-none-eabi-nm"], help = "nm to use")
+parser.add_argument("-c", "--count", nargs = 1, type = int, default = [40], help = "how many functions to list (default 40)")
+parser.add_argument("log", nargs = "?", help = "serial log (default stdin)")
+args = parser.parse_args()
+
+samples = 0
+hz = 0
+base = 0
+shift = 0
+other = {}
+tasks = []
+buckets = {}
+
+log = open(args.log) if args.log else sys.stdin
+for line in log:
+    if "pcprofile " in line:
+        words = line.split("pcprofile ", 1)[1].replace(",", "").split()
+        samples = int(words[0])
+        hz = int(words[words.index("at") + 1])
+        base = int(words[words.index("base") + 1], 16)
+        shift = int(words[words.index("shift") + 1])
+        other = dict((k, int(words[words.index(k) + 1])) for k in ("isr", "outside", "saturated", "untasked"))
+        tasks = []
+        buckets = {}
+    elif "pctask " in line:
+        count, name = line.split("pctask ", 1)[1].split(None, 1)
+        tasks.append((int(count), name.strip()))
+    elif "pcbucket " in line:
+        for word in line.split("pcbucket ", 1)[1].split():
+            b, count = word.split(":")
+            buckets[int(b, 16)] = int(count)
+
+if not samples:
+    sys.stderr.write("no pcprofile dump in the log\n")
+    sys.exit(1)
+
+# functions, by address. Thumb symbols have bit 0 set
+funcs = []
+out = subprocess.check_output([args.nm[0], "-S", "-n", args.elf[0]]).decode().splitlines()
+for sym in out:
+    parts = sym.split()
+    if len(parts) == 4 and parts[2] in "tTwW":
+        funcs.append((int(parts[0], 16) & ~1, int(parts[1], 16), parts[3]))
+starts = [ f[0] for f in funcs ]
+
+profile = {}
+size = 1 << shift
+for b, count in buckets.items():
+    lo = base + (b << shift)
+    hi = lo + size
+    i = max(0, bisect.bisect_right(starts, lo) - 1)
+    shares = []
+    while i < len(funcs) and funcs[i][0] < hi:
+        start, length, name = funcs[i]
+        overlap = min(hi, start + length) - max(lo, start)
+        if overlap > 0:
+            shares.append((overlap, name))
+        i += 1
+    covered = sum(s[0] for s in shares)
+    if not covered:
+        profile["0x%08x" % lo] = profile.get("0x%08x" % lo, 0) + count
+        continue
+    for overlap, name in shares:
+        profile[name] = profile.get(name, 0) + count * float(overlap) / covered
+
+print("%d samples at %d Hz, %.1f s awake; %d-byte buckets" % (samples, hz, samples / float(hz or 1), size))
+print("%d in handlers, %d outside .text, %d lost to full buckets\n" % (other["isr"], other["outside"], other["saturated"]))
+
+print("%8s %6s  %s" % ("samples", "%", "task"))
+for count, name in sorted(tasks, reverse = True):
+    print("%8d %6.1f  %s" % (count, count * 100.0 / samples, name))
+if other["isr"]:
+    print("%8d %6.1f  %s" % (other["isr"], other["isr"] * 100.0 / samples, "(handlers)"))
+if other["untasked"]:
+    print("%8d %6.1f  %s" % (other["untasked"], other["untasked"] * 100.0 / samples, "(other tasks)"))
+
+print("\n%8s %6s %6s  %s" % ("samples", "%", "cum %", "function"))
+total = 0.0
+for name, count in sorted(profile.items(), key = lambda p: -p[1])[:args.count[0]]:
+    total += count
+    print("%8.1f %6.1f %6.1f  %s" % (count, count * 100.0 / samples, total * 100.0 / samples, name))
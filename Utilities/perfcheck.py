@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+
+"""
+Runs a PERF_AUTORUN build under QEMU, and checks what the benchmarks and
+the boot profile log over serial against a baseline. Run by the _perf
+targets in the Makefile, with the QEMU command line after "--".
+
+The results are "[BENCH] name cycles/op ..." lines from the bench test,
+and the boot profile's spans and events, in microseconds. Under
+qemu -icount the clock counts instructions, so the same build gives the
+same numbers every time, and a change past the tolerance is the code's.
+
+The baseline is JSON: "tolerance" is in percent, a default and any
+overrides by name, and "results" is what the last good run gave. Anything
+slower than that by more than the tolerance fails the run; faster is only
+reported, and -w takes the run as the new baseline.
+RebbleOS
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import threading
+
+parser = argparse.ArgumentParser(description = "QEMU performance regression check for RebbleOS.")
+parser.add_argument("-b", "--baseline", nargs = 1, required = True, help = "baseline JSON to compare with")
+parser.add_argument("-w", "--write", action = "store_true", help = "write this run's results as the baseline")
+parser.add_argument("-t", "--timeout", nargs = 1, type = int, default = [300], help = "seconds to wait for the run (default 300)")
+parser.add_argument("-l", "--log", nargs = 1, default = None, help = "keep the serial log here")
+parser.add_argument("command", nargs = argparse.REMAINDER, help = "-- and the QEMU command line")
+args = parser.parse_args()
+
+command = args.command[1:] if args.command[:1] == ["--"] else args.command
+if not command:
+    parser.error("no QEMU command line")
+
+BENCH = re.compile(r"\[BENCH\] (\w+) (\d+) ")
+DONE = "[BENCH] done"
+# boot_profile_dump: "name: at N us took N us", or just "name: at N us"
+BOOT = re.compile(r"\[boot\s*\].*?\] (.+?): at (\d+) us(?: took (\d+) us)?$")
+
+results = {}
+done = False
+log = open(args.log[0], "w") if args.log else None
+
+qemu = subprocess.Popen(command, stdout = subprocess.PIPE, stdin = open(os.devnull))
+timer = threading.Timer(args.timeout[0], qemu.kill)
+timer.start()
+
+for line in iter(qemu.stdout.readline, b""):
+    line = line.decode("latin-1").rstrip("\r\n")
+    if log:
+        log.write(line + "\n")
+    if DONE in line:
+        done = True
+        break
+    m = BENCH.search(line)
+    if m:
+        results["bench." + m.group(1)] = int(m.group(2))
+        continue
+    m = BOOT.search(line)
+    if m:
+        name = "boot." + m.group(1).replace(" ", "_")
+        if m.group(3) is not None:
+            results[name] = int(m.group(3))
+        else:
+            results[name + ".at"] = int(m.group(2))
+
+timer.cancel()
+if qemu.poll() is None:
+    qemu.kill()
+qemu.wait()
+
+if not done:
+    sys.stderr.write("run didn't finish (timed out, or QEMU went away); %d results\n" % len(results))
+    sys.exit(1)
+
+try:
+    baseline = json.load(open(args.baseline[0]))
+except IOError:
+    baseline = { "tolerance": { "default": 2 }, "results": {} }
+
+if args.write:
+    baseline["results"] = results
+    with open(args.baseline[0], "w") as f:
+        json.dump(baseline, f, indent = 2, sort_keys = True)
+        f.write("\n")
+    print("wrote %d results to %s" % (len(results), args.baseline[0]))
+    sys.exit(0)
+
+if not baseline["results"]:
+    sys.stderr.write("%s has no results yet; run with -w to take these as the baseline\n" % args.baseline[0])
+    sys.exit(1)
+
+tolerance = baseline.get("tolerance", {})
+failed = 0
+for name in sorted(set(baseline["results"]) | set(results)):
+    base = baseline["results"].get(name)
+    now = results.get(name)
+    if base is None:
+        print("%-28s %10s %10d  new" % (name, "-", now))
+        continue
+    if now is None:
+        print("%-28s %10d %10s  MISSING" % (name, base, "-"))
+        failed += 1
+        continue
+    tol = tolerance.get(name, tolerance.get("default", 2))
+    change = (now - base) * 100.0 / base if base else 0.0
+    if change > tol:
+        verdict = "SLOWER"
+        failed += 1
+    elif change < -tol:
+        verdict = "faster"
+    else:
+        verdict = ""
+    print(("%-28s %10d %10d %+7.1f%%  %s" % (name, base, now, change, verdict)).rstrip())
+
+if failed:
+    sys.stderr.write("%d of %d results regressed past tolerance\n" % (failed, len(baseline["results"])))
+    sys.exit(1)
@@ -0,0 +1,127 @@
+#!/usr/bin/env python
+
+"""
+Turns a schedtrace dump out of the debug log (build with SCHED_TRACE in
+rcore/sched_trace.h) into a Chrome trace, for chrome://tracing or
+https://ui.perfetto.dev. Each task and each interrupt is a row; queue,
+semaphore and notification traffic are marks on whoever did it.
+RebbleOS
+"""
+
+import argparse
+import json
+import struct
+import subprocess
+import sys
+
+parser = argparse.ArgumentParser(description = "Scheduler trace to Chrome trace JSON for RebbleOS.")
+parser.add_argument("-e", "--elf", nargs = 1, default = None, help = "firmware ELF, to name queues with nm")
+parser.add_argument("-n", "--nm", nargs = 1, default = ["arm-none-eabi-nm"], help = "nm to use")
+parser.add_argument("-o", "--output", nargs = 1, default = None, help = "trace JSON (default stdout)")
+parser.add_argument("log", nargs = "?", help = "serial log (default stdin)")
+args = parser.parse_args()
+
+# SchedTraceRecord and SchedTraceEvent in sched_trace.h
+RECORD = struct.Struct("<IBBH")
+(SWITCH_IN, SWITCH_OUT, QUEUE_SEND, QUEUE_SEND_ISR, QUEUE_RECEIVE, QUEUE_RECEIVE_ISR,
+ QUEUE_BLOCK_SEND, QUEUE_BLOCK_RECEIVE, NOTIFY, NOTIFY_ISR, NOTIFY_TAKE, ISR_ENTER, ISR_EXIT) = range(13)
+# queueQUEUE_TYPE_* in queue.h
+QUEUE_TYPES = { 0: "queue", 1: "mutex", 2: "semaphore", 3: "semaphore", 4: "mutex" }
+ISR_TID = 1000
+
+cycles_per_us = 1
+tasks = {}
+records = []
+
+log = open(args.log) if args.log else sys.stdin
+for line in log:
+    if "schedtask " in line:
+        num, name = line.split("schedtask ", 1)[1].split(None, 1)
+        tasks[int(num)] = name.strip()
+        continue
+    if "schedtrace " not in line:
+        continue
+    words = line.split("schedtrace ", 1)[1].split()
+    if "records," in words:
+        cycles_per_us = max(1, int(words[words.index("cycles/us") - 1].rstrip(",")))
+        records = []
+        continue
+    data = bytes(bytearray.fromhex(words[0]))
+    for i in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        records.append(RECORD.unpack(data[i:i + RECORD.size]))
+
+objects = {}
+if args.elf:
+    out = subprocess.check_output([args.nm[0], args.elf[0]]).decode().splitlines()
+    for sym in out:
+        parts = sym.split()
+        if len(parts) == 3 and parts[1] in "bBdD":
+            objects.setdefault((int(parts[0], 16) >> 2) & 0xFFFF, parts[2])
+
+def obj_name(obj):
+    return objects.get(obj, "0x%04x" % obj)
+
+def isr_name(exc):
+    return "IRQ %d" % (exc - 16) if exc >= 16 else "exception %d" % exc
+
+events = []
+def mark(name, tid, ts, **kw):
+    events.append({ "name": name, "ph": "i", "s": "t", "pid": 0, "tid": tid, "ts": ts, "args": kw })
+
+# unwrap the 32 bit counter, assuming no gap between records is a whole wrap
+now = 0
+last = None
+running = None      # (task, since)
+isrs = []           # [(exc, since)]
+seen = set()
+
+for cycles, event, arg, obj in records:
+    if last is not None:
+        now += (cycles - last) & 0xFFFFFFFF
+    last = cycles
+    ts = now / float(cycles_per_us)
+    tid = ISR_TID + isrs[-1][0] if isrs else (running[0] if running else 0)
+
+    if event == SWITCH_IN:
+        running = (arg, ts)
+        seen.add(arg)
+    elif event == SWITCH_OUT:
+        if running and running[0] == arg:
+            events.append({ "name": tasks.get(arg, "task %d" % arg), "ph": "X", "pid": 0, "tid": arg,
+                            "ts": running[1], "dur": ts - running[1] })
+        running = None
+    elif event == ISR_ENTER:
+        isrs.append((obj, ts))
+        seen.add(ISR_TID + obj)
+    elif event == ISR_EXIT:
+        if isrs and isrs[-1][0] == obj:
+            exc, since = isrs.pop()
+            events.append({ "name": isr_name(exc), "ph": "X", "pid": 0, "tid": ISR_TID + exc,
+                            "ts": since, "dur": ts - since })
+    elif event in (QUEUE_SEND, QUEUE_SEND_ISR, QUEUE_BLOCK_SEND):
+        kind = QUEUE_TYPES.get(arg, "queue")
+        verb = "send" if kind == "queue" else "give"
+        if event == QUEUE_BLOCK_SEND:
+            verb = "wait to " + verb
+        mark("%s %s" % (verb, kind), tid, ts, obj = obj_name(obj))
+    elif event in (QUEUE_RECEIVE, QUEUE_RECEIVE_ISR, QUEUE_BLOCK_RECEIVE):
+        kind = QUEUE_TYPES.get(arg, "queue")
+        verb = "receive" if kind == "queue" else "take"
+        if event == QUEUE_BLOCK_RECEIVE:
+            verb = "wait to " + verb
+        mark("%s %s" % (verb, kind), tid, ts, obj = obj_name(obj))
+    elif event in (NOTIFY, NOTIFY_ISR):
+        mark("notify", tid, ts, task = tasks.get(arg, "task %d" % arg))
+    elif event == NOTIFY_TAKE:
+        mark("notified", tid, ts)
+
+for tid in seen:
+    name = isr_name(tid - ISR_TID) if tid >= ISR_TID else tasks.get(tid, "task %d" % tid)
+    events.append({ "name": "thread_name", "ph": "M", "pid": 0, "tid": tid, "args": { "name": name } })
+    # interrupts above the tasks
+    events.append({ "name": "thread_sort_index", "ph": "M", "pid": 0, "tid": tid,
+                    "args": { "sort_index": tid - ISR_TID if tid >= ISR_TID else ISR_TID + tid } })
+
+out = open(args.output[0], "w") if args.output else sys.stdout
+json.dump({ "traceEvents": events, "displayTimeUnit": "ns" }, out)
+sys.stderr.write("%d records, %d events, %.1f ms\n" % (len(records), len(events), now / float(cycles_per_us) / 1000))
@@ -14,4 +14,11 @@ if [[ $(getsym _ccm_top) ]]; then
 fi
 
 echo "$RAM_REMAIN bytes of RAM available for heap."
+
+if [[ $(getsym _hot_text_limit) ]]; then
+  echo "$(($(getsym _eramfunc) - $(getsym _sramfunc))) of $(($(getsym _hot_text_limit))) bytes of HOT_RAMFUNC code used."
+fi
+if [[ $(getsym _hot_data_limit) ]]; then
+  echo "$(($(getsym _ehotdata) - $(getsym _shotdata))) of $(($(getsym _hot_data_limit))) bytes of HOT_DATA used."
+fi
 echo "$FLASH_REMAIN bytes of flash unused."
@@ -10,6 +10,8 @@
 #include "stdio.h"
 #include "string.h"
 #include "math.h"
+#include "clock_format.h"
+#include "utils.h"
 
 
 // const char *app_name = "Simple";
@@ -24,12 +26,14 @@ static Window *s_main_window;
 static Layer *s_canvas_layer;
 static TextLayer *s_text_layer;
 
-typedef struct {
-    uint8_t hours;
-    uint8_t minutes;
-} Time;
+/* the four digits, as drawn */
+static ClockFormat s_clock;
 
-static Time s_last_time;
+static GRect _digit_rect(GRect bounds, uint8_t i)
+{
+    return GRect((bounds.size.w / 2) + (i & 1 ? 8 : -52),
+                 (bounds.size.h / 2) + (i & 2 ? 8 : -82), 43, 74);
+}
 
 static void nivz_window_load(Window *window)
 {
@@ -39,6 +43,7 @@ static void nivz_window_load(Window *window)
 
     s_canvas_layer = layer_create(bounds);
     layer_set_update_proc(s_canvas_layer, nivz_update_proc);
+    s_canvas_layer->paints_damage = true;
     layer_add_child(window_layer, s_canvas_layer);
 
     s_text_layer = text_layer_create(bounds);
@@ -47,7 +52,9 @@ static void nivz_window_load(Window *window)
     //layer_add_child(window_layer, s_text_layer);
     //text_layer_set_text(s_text_layer, "Hello\n");
 
-    tick_timer_service_subscribe(SECOND_UNIT, nivz_tick);
+    clock_format_init(&s_clock, "%H%M");
+    clock_format_cached(&s_clock, rebble_time_get_tm(), 0, NULL);
+    tick_timer_service_subscribe(MINUTE_UNIT, nivz_tick);
     layer_mark_dirty(s_canvas_layer);
 }
 
@@ -57,20 +64,20 @@ static void nivz_window_unload(Window *window)
     layer_destroy(s_canvas_layer);
 }
 
-// tick
+// tick. Only the digits that changed get repainted; most minutes that's one
 void nivz_tick(struct tm *tick_time, TimeUnits tick_units)
 {   
-    APP_LOG("nivz", APP_LOG_LEVEL_DEBUG, "appmain");
-    // Store time
-    s_last_time.hours = tick_time->tm_hour;
-    s_last_time.minutes = tick_time->tm_min;
+    uint8_t first;
+    uint8_t count = clock_format_cached(&s_clock, tick_time, tick_units, &first);
 
-    
-    // Redraw
-    if (s_canvas_layer)
-    {
-        layer_mark_dirty(s_canvas_layer);
-    }
+    if (!s_canvas_layer || !count)
+        return;
+
+    GRect bounds = layer_get_bounds(s_canvas_layer);
+    GRect dirty = _digit_rect(bounds, first);
+    for (uint8_t i = first + 1; i < first + count && i < 4; i++)
+        dirty = rect_union(dirty, _digit_rect(bounds, i));
+    window_dirty_rect(s_main_window, layer_convert_rect_to_screen(s_canvas_layer, dirty));
 }
 
 void nivz_init(void)
@@ -184,21 +191,34 @@ void draw_digit(GContext *nGContext, uint8_t d, uint8_t x, uint8_t y)
 
 static void nivz_update_proc(Layer *layer, GContext *nGContext)
 {
-  // Get the time
-  uint8_t hour = s_last_time.hours;
-  uint8_t minute = s_last_time.minutes;
-  
   GRect full_bounds = layer_get_bounds(layer);
+
+  // Keep to the damage, in our coordinates. A digit is drawn whole, so
+  // one that pokes into it gets all of its rect repainted
+  GRect damage = layer_draw_get_damage();
+  GRect paint = GRect(damage.origin.x - nGContext->offset.origin.x,
+                      damage.origin.y - nGContext->offset.origin.y,
+                      damage.size.w, damage.size.h);
+  for (int8_t i = 0; i < 4; i++)
+  {
+    GRect digit = _digit_rect(full_bounds, i);
+    if (RECT_INTERSECTS(paint, digit) && !RECT_CONTAINS(paint, digit))
+    {
+      paint = rect_union(paint, digit);
+      layer_draw_add_damage(layer_convert_rect_to_screen(layer, digit));
+      i = -1; // and the grown rect may catch ones already passed
+    }
+  }
+
   // Clear the screen
   graphics_context_set_fill_color(nGContext, GColorBlack);
-  graphics_fill_rect(nGContext, full_bounds, 0, GCornerNone);
-  
-  // Draw the Hours 
-  draw_digit(nGContext, (int)(hour/10), (full_bounds.size.w/2) - 52, (full_bounds.size.h/2) - 82);
-  draw_digit(nGContext, (int)(hour%10), (full_bounds.size.w/2) + 8, (full_bounds.size.h/2) - 82);
-  
-  //Draw the Minutes
-  draw_digit(nGContext, (int)(minute/10), (full_bounds.size.w/2) - 52, (full_bounds.size.h/2) + 8);
-  draw_digit(nGContext, (int)(minute%10), (full_bounds.size.w/2) + 8, (full_bounds.size.h/2) + 8);
+  graphics_fill_rect(nGContext, paint, 0, GCornerNone);
   
+  // Draw the Hours, then the Minutes
+  for (uint8_t i = 0; i < 4 && s_clock.text[i]; i++)
+  {
+    GRect digit = _digit_rect(full_bounds, i);
+    if (RECT_INTERSECTS(paint, digit))
+      draw_digit(nGContext, s_clock.text[i] - '0', digit.origin.x, digit.origin.y);
+  }
 }
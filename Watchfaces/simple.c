@@ -9,11 +9,13 @@
 #include "stdio.h"
 #include "string.h"
 #include "math.h"
+#include "utils.h"
 
 
 // const char *app_name = "Simple";
 
 static void simple_update_proc(Layer *layer, GContext *nGContext);
+static void simple_dial_update_proc(Layer *layer, GContext *nGContext);
 void simple_main(void);
 void simple_init(void);
 void simple_deinit(void);
@@ -21,6 +23,7 @@ void simple_tick(struct tm *tick_time, TimeUnits tick_units);
 
 static Window *s_main_window;
 static Layer *s_canvas_layer;
+static Layer *s_dial_layer;
 static TextLayer *s_text_layer;
 
 uint8_t s_color_channels[3];
@@ -32,22 +35,49 @@ typedef struct {
 
 static Time s_last_time;
 
+#define HAND_MARGIN 10
+#define DIAL_RADIUS 60
+/* the dial's outline is 4 wide, half of it outside the radius */
+#define DIAL_EDGE   3
+
+static void _new_colour(void)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        s_color_channels[i] = rand() % 256;
+    }
+}
+
 static void simple_window_load(Window *window)
 {
     Layer *window_layer = window_get_root_layer(s_main_window);
     GRect bounds = layer_get_unobstructed_bounds(window_layer);
+    GPoint center = n_grect_center_point(&bounds);
 
+    // The background only ever fills what's being repainted, so the
+    // dial on top of it can be redrawn on its own
     s_canvas_layer = layer_create(bounds);
     layer_set_update_proc(s_canvas_layer, simple_update_proc);
+    s_canvas_layer->paints_damage = true;
     layer_add_child(window_layer, s_canvas_layer);
 
+    s_dial_layer = layer_create(GRect(center.x - DIAL_RADIUS - DIAL_EDGE, center.y - DIAL_RADIUS - DIAL_EDGE,
+                                      2 * (DIAL_RADIUS + DIAL_EDGE) + 1, 2 * (DIAL_RADIUS + DIAL_EDGE) + 1));
+    layer_set_update_proc(s_dial_layer, simple_dial_update_proc);
+    layer_add_child(s_canvas_layer, s_dial_layer);
+
+    struct tm *now = rebble_time_get_tm();
+    s_last_time.hours = now->tm_hour > 12 ? now->tm_hour - 12 : now->tm_hour;
+    s_last_time.minutes = now->tm_min;
+    _new_colour();
+
     s_text_layer = text_layer_create(bounds);
     // TODO until we compile those fonts in, this wil crash
     // as we have no font set
     //layer_add_child(window_layer, s_text_layer);
     //text_layer_set_text(s_text_layer, "Hello\n");
 
-    tick_timer_service_subscribe(SECOND_UNIT, simple_tick);
+    tick_timer_service_subscribe(MINUTE_UNIT, simple_tick);
     layer_mark_dirty(s_canvas_layer);
     APP_LOG("simple", APP_LOG_LEVEL_DEBUG, "WF load done");
 }
@@ -55,6 +85,7 @@ static void simple_window_load(Window *window)
 
 static void simple_window_unload(Window *window)
 {
+    layer_destroy(s_dial_layer);
     layer_destroy(s_canvas_layer);
 }
 
@@ -85,46 +116,52 @@ void simple_deinit(void)
 }
 
 
+/*
+ * A new colour every hour repaints the lot; any other minute, just the
+ * dial the hands are on
+ */
 void simple_tick(struct tm *tick_time, TimeUnits tick_units)
 {   
-    APP_LOG("simple", APP_LOG_LEVEL_DEBUG, "Simple");
-    APP_LOG("simple", APP_LOG_LEVEL_DEBUG, "Simple: Tick %d",tick_time->tm_hour);
     // Store time
     s_last_time.hours = tick_time->tm_hour;
     s_last_time.hours -= (s_last_time.hours > 12) ? 12 : 0;
     s_last_time.minutes = tick_time->tm_min;
 
-    for (int i = 0; i < 3; i++)
-    {
-        s_color_channels[i] = rand() % 256;
-    }
-
     // Redraw
-    if (s_canvas_layer)
+    if (!s_canvas_layer)
+        return;
+
+    if (tick_units & HOUR_UNIT)
     {
-        APP_LOG("simple", APP_LOG_LEVEL_DEBUG, "Dirty");
+        _new_colour();
         layer_mark_dirty(s_canvas_layer);
     }
+    else
+        layer_mark_dirty(s_dial_layer);
 }
 
-#define HAND_MARGIN 10
-
 static void simple_update_proc(Layer *layer, GContext *nGContext)
 {   
-    GRect full_bounds = layer_get_bounds(layer);
-    //graphics_context_set_fill_color(nGContext, GColorWhite);
+    GRect damage = layer_draw_get_damage();
+    GRect paint = GRect(damage.origin.x - nGContext->offset.origin.x,
+                        damage.origin.y - nGContext->offset.origin.y,
+                        damage.size.w, damage.size.h);
+
     graphics_context_set_fill_color(nGContext, GColorFromRGB(s_color_channels[0], s_color_channels[1], s_color_channels[2]));
-     
-    graphics_fill_rect(nGContext, full_bounds, 0, GCornerNone);
+    graphics_fill_rect(nGContext, paint, 0, GCornerNone);
+}
+
+static void simple_dial_update_proc(Layer *layer, GContext *nGContext)
+{   
+    GRect full_bounds = layer_get_bounds(layer);
     
     graphics_context_set_stroke_color(nGContext, GColorBlack);
     graphics_context_set_stroke_width(nGContext, 4);
     //graphics_context_set_antialiased(nGContext, ANTIALIASING);
  
-    uint8_t s_radius = 60;
+    uint8_t s_radius = DIAL_RADIUS;
     
     graphics_context_set_fill_color(nGContext, GColorWhite);
-    //GPoint s_center = { .x = 70, .y = 90 };
     GPoint s_center = n_grect_center_point(&full_bounds);
     graphics_fill_circle(nGContext, s_center, s_radius);
  
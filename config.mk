@@ -30,14 +30,62 @@ CFLAGS_all += -Irwatch/event
 CFLAGS_all += -DNGFX_IS_CORE
 
 # XXX: nostdinc
-CFLAGS_all += -O0 -ggdb -Wall -ffunction-sections -fdata-sections -mthumb -mlittle-endian -finline-functions -std=gnu99 -falign-functions=16
+CFLAGS_all += -ggdb -Wall -ffunction-sections -fdata-sections -mthumb -mlittle-endian -finline-functions -std=gnu99 -falign-functions=16
 # CFLAGS_all += -Wno-implicit-function-declaration
 CFLAGS_all += -Wno-unused-variable -Wno-unused-function
 
+# The build flavour, debug or release, set here, in localconfig.mk or on
+# the command line. A release is built into $(BUILD)/release.
+#
+# Debug is unoptimised. A release is built at OPT, apart from what is
+# listed under OPT_<level>: directories (with a trailing /) or files built
+# at that level instead, which LTO keeps to. The graphics and display
+# kernels want speed more than they want the space. A release also links
+# with LTO and section GC, and drops the heap cookies and the debug logs.
+# Both keep their symbols in the ELF, for profiling.
+FLAVOUR ?= debug
+
+OPT ?= -Os
+OPT_LEVELS = O3 O2 O1 Os
+OPT_O2 += lib/neographics/ rwatch/graphics/ hw/drivers/stm32_dma2d/
+OPT_O2 += hw/platform/snowy_family/snowy_display.c hw/platform/snowy_family/snowy_scanlines.c
+OPT_O2 += hw/platform/tintin/tintin_display.c rcore/display.c
+
+CFLAGS_debug = -O0
+CFLAGS_release = $(OPT) -flto -DREBBLE_RELEASE
+CFLAGS_all += $(CFLAGS_$(FLAVOUR))
+LDFLAGS_release = -Wl,--gc-sections
+LDFLAGS_all += $(LDFLAGS_$(FLAVOUR))
+
+# Log lines above this level are compiled out, strings and all (see
+# log.h). A release drops DEBUG and VERBOSE; localconfig.mk can go further
+LOG_COMPILE_LEVEL_debug = APP_LOG_LEVEL_DEBUG_VERBOSE
+LOG_COMPILE_LEVEL_release = APP_LOG_LEVEL_INFO
+LOG_COMPILE_LEVEL ?= $(LOG_COMPILE_LEVEL_$(FLAVOUR))
+CFLAGS_all += -DLOG_COMPILE_LEVEL=$(LOG_COMPILE_LEVEL)
+
+# Boot straight into the benchmarks, for the _perf targets, which build
+# with this in a directory of their own (see Utilities/perfcheck.py)
+ifneq ($(PERF),)
+CFLAGS_all += -DPERF_AUTORUN
+endif
+
+# The sampling profiler, see rcore/pc_profile.c. Costs a timer, and some
+# CCRAM for the histogram, so it is only there when asked for
+ifneq ($(PC_PROFILE),)
+CFLAGS_all += -DPC_PROFILE
+endif
+
+# Count and time every call apps make through the jump table, logged when
+# the app quits; see rcore/api_profile.c. Costs a trampoline per slot
+ifneq ($(API_PROFILE),)
+CFLAGS_all += -DAPI_PROFILE
+endif
+
 LDFLAGS_all += -nostartfiles -nostdlib
 LIBS_all += -lgcc
 
-SRCS_all += build/version.c
+SRCS_all += $(BUILD)/version.c
 
 SRCS_all += FreeRTOS/croutine.c
 SRCS_all += FreeRTOS/event_groups.c
@@ -55,6 +103,7 @@ SRCS_all += lib/minilib/fmt.c
 SRCS_all += lib/minilib/unfmt.c
 SRCS_all += lib/minilib/rand.c
 SRCS_all += lib/minilib/qalloc.c
+SRCS_all += lib/minilib/qalloc_seg.c
 SRCS_all += lib/musl/time/localtime.c
 SRCS_all += lib/musl/time/localtime_r.c
 SRCS_all += lib/musl/time/mktime.c
@@ -87,13 +136,24 @@ SRCS_all += rcore/appmanager.c
 SRCS_all += rcore/appmanager_app.c
 SRCS_all += rcore/appmanager_app_api.c
 SRCS_all += rcore/appmanager_app_runloop.c
+SRCS_all += rcore/appmanager_worker.c
 SRCS_all += rcore/appmanager_app_timer.c
 SRCS_all += rcore/backlight.c
+SRCS_all += rcore/boot_profile.c
+SRCS_all += rcore/blobdb.c
 SRCS_all += rcore/bluetooth.c
 SRCS_all += rcore/buttons.c
+SRCS_all += rcore/cpu_stats.c
+SRCS_all += rcore/power_stats.c
+SRCS_all += rcore/data_logging.c
+SRCS_all += rcore/defer.c
 SRCS_all += rcore/display.c
+SRCS_all += rcore/frame_profile.c
+SRCS_all += rcore/input_latency.c
 SRCS_all += rcore/debug.c
+SRCS_all += rcore/crash_dump.c
 SRCS_all += rcore/gyro.c
+SRCS_all += rcore/activity.c
 SRCS_all += rcore/main.c
 SRCS_all += rcore/notification_manager.c
 SRCS_all += rcore/notification_message.c
@@ -102,21 +162,35 @@ SRCS_all += rcore/rebbleos.c
 SRCS_all += rcore/smartstrap.c
 SRCS_all += rcore/rebble_time.c
 SRCS_all += rcore/rebble_memory.c
+SRCS_all += rcore/rebble_crc.c
+SRCS_all += rcore/sched_trace.c
+SRCS_all += rcore/pc_profile.c
+SRCS_all += rcore/api_profile.c
 SRCS_all += rcore/vibrate.c
 SRCS_all += rcore/flash.c
 SRCS_all += rcore/fs.c
 SRCS_all += rcore/log.c
+SRCS_all += rcore/log_binary.c
 SRCS_all += rcore/resource.c
+SRCS_all += rcore/rocky.c
 SRCS_all += rcore/watchdog.c
 SRCS_all += rcore/overlay_manager.c
 SRCS_all += rcore/rebble_util.c
 
+SRCS_all += rcore/protocol/endpoint.c
 SRCS_all += rcore/protocol/protocol_notification.c
+SRCS_all += rcore/protocol/protocol_putbytes.c
+SRCS_all += rcore/protocol/protocol_screenshot.c
 SRCS_all += rcore/protocol/protocol_system.c
 
 SRCS_all += rwatch/librebble.c
 SRCS_all += rwatch/ngfxwrap.c
 SRCS_all += rwatch/math_sin.c
+SRCS_all += rwatch/persist.c
+SRCS_all += rwatch/dictionary.c
+SRCS_all += rwatch/app_message.c
+SRCS_all += rwatch/clock_format.c
+SRCS_all += rwatch/packbits.c
 SRCS_all += rwatch/ui/layer/layer.c
 SRCS_all += rwatch/ui/layer/bitmap_layer.c
 SRCS_all += rwatch/ui/layer/menu_layer.c
@@ -130,16 +204,26 @@ SRCS_all += rwatch/ui/action_menu.c
 SRCS_all += rwatch/graphics/gbitmap.c
 SRCS_all += rwatch/graphics/graphics.c
 SRCS_all += rwatch/graphics/font_loader.c
+SRCS_all += rwatch/graphics/font_pager.c
+SRCS_all += rwatch/graphics/glyph_cache.c
+SRCS_all += rwatch/graphics/gpath_cache.c
+SRCS_all += rwatch/graphics/pdc_cache.c
+SRCS_all += rwatch/graphics/blit_bw.c
+SRCS_all += rwatch/graphics/blit_palette.c
+SRCS_all += rwatch/graphics/blit_blend.c
 SRCS_all += rwatch/event/tick_timer_service.c
 SRCS_all += rwatch/event/app_timer.c
 SRCS_all += rwatch/event/battery_state_service.c
 SRCS_all += rwatch/event/connection_service.c
+SRCS_all += rwatch/event/accel_service.c
+SRCS_all += rwatch/event/unobstructed_area_service.c
 SRCS_all += rwatch/ui/layer/status_bar_layer.c
 SRCS_all += rwatch/ui/animation/animation.c
 SRCS_all += rwatch/ui/animation/property_animation.c
 SRCS_all += rwatch/ui/notifications/notification_window.c
 SRCS_all += rwatch/ui/notifications/battery_overlay.c
 SRCS_all += rwatch/ui/notifications/mini_message.c
+SRCS_all += rwatch/ui/notifications/perf_hud.c
 SRCS_all += rwatch/ui/vibes.c
 
 SRCS_all += Watchfaces/simple.c
@@ -147,6 +231,7 @@ SRCS_all += Watchfaces/nivz.c
 
 SRCS_all += Apps/System/systemapp.c
 SRCS_all += Apps/System/menu.c
+SRCS_all += Apps/System/app_icons.c
 SRCS_all += Apps/System/testapp.c
 
 SRCS_all += Apps/System/test.c
@@ -162,10 +247,15 @@ include hw/drivers/stm32_buttons/config.mk
 include hw/drivers/stm32_power/config.mk
 include hw/drivers/stm32_rtc/config.mk
 include hw/drivers/stm32_backlight/config.mk
+include hw/drivers/stm32_dma2d/config.mk
+include hw/drivers/stm32_crc/config.mk
+include hw/drivers/stm32_delay/config.mk
+include hw/drivers/stm32_pc_sample/config.mk
 include hw/drivers/stm32_bluetooth_cc256x/config.mk
 include hw/platform/snowy_family/config.mk
 include hw/platform/snowy/config.mk
 include hw/platform/tintin/config.mk
 include hw/platform/chalk/config.mk
+include hw/platform/host/config.mk
 include Apps/System/tests/config.mk
 include lib/btstack/config.mk
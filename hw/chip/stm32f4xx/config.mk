@@ -19,7 +19,7 @@ SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_crc.c
 # SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_dbgmcu.c
 SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_dcmi.c
 SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_dma.c
-# SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_dma2d.c
+SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_dma2d.c
 SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_dsi.c
 SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_exti.c
 SRCS_stm32f4xx += hw/chip/stm32f4xx/stm32f4xx_flash.c
@@ -59,7 +59,7 @@ void NMI_Handler(void)
 /**
  * @see http://www.freertos.org/Debugging-Hard-Faults-On-Cortex-M-Microcontrollers.html
  */
-void prvGetRegistersFromStack(uint32_t *pulFaultStackAddress) {
+__attribute__((used)) void prvGetRegistersFromStack(uint32_t *pulFaultStackAddress) {
 /* These are volatile to try and prevent the compiler/linker optimising them
 away as the variables never actually get used. If the debugger won't show the
 values of the variables, make them global my moving their declaration outside
@@ -18,6 +18,7 @@
 #    include "snowy_display.h"
 #    include <stm32f4xx_spi.h>
 #    include <stm32f4xx_tim.h>
+#    include <stm32f4xx_dma.h>
 #elif defined(STM32F2XX)
 #    include "stm32f2xx.h"
 #    include "stm32f2xx_spi.h"
@@ -25,16 +26,44 @@
 #    include "stm32f2xx_gpio.h"
 #    include "stm32f2xx_rcc.h"
 #    include "stm32f2xx_usart.h"
+#    include "stm32f2xx_dma.h"
 #else
 #    error "I have no idea what kind of stm32 this is; sorry"
 #endif
 #include "stm32_power.h"
+#include "stm32_dma.h"
 #include "stm32_backlight_platform.h"
 #define _TIM_Func(CH, Func) TIM_OC ## CH ## Func
 #define TIM_Func(CH, Func) _TIM_Func(CH, Func)
+#define _TIM_CCR(CH) CCR ## CH
+#define TIM_CCR(CH) _TIM_CCR(CH)
+
+/*
+ * Fades are played by DMA. TIM6 paces it, and each of its updates has
+ * DMA1 copy the next step of a precomputed curve straight into the PWM
+ * timer's compare register. The CPU works out the curve and is told
+ * when it's over, and that's it. Both chips have TIM6's update on DMA1
+ * stream 1 channel 7, and both PWM timers are on APB1, where DMA1 can
+ * reach them.
+ */
+#define BL_RAMP_STEPS       64
+#define BL_RAMP_TIM         TIM6
+#define BL_RAMP_TIM_CLOCK   RCC_APB1Periph_TIM6
+#define BL_RAMP_TICK_HZ     10000
+#define BL_RAMP_DMA_STREAM  DMA1_Stream1
+#define BL_RAMP_DMA_CHANNEL DMA_Channel_7
+#define BL_RAMP_DMA_IRQ     DMA1_Stream1_IRQn
+#define BL_RAMP_DMA_FLAGS   STM32_DMA_MK_FLAGS(1)
+
+static uint16_t _ramp[BL_RAMP_STEPS];
+static uint16_t _ramp_to;
+static volatile uint8_t _ramp_running;
+
 /*** backlight init ***/
 
 static uint8_t _backlight_clocks_on = 0;
+static void _ramp_init(void);
+
 void hw_backlight_init(void) {
     RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOB, ENABLE);
 
@@ -50,14 +79,18 @@ void hw_backlight_init(void) {
     /* And multivac pronounced "and let there be backlight" */
     GPIO_SetBits(GPIOB, platform_backlight.pin);
 
+    _ramp_init();
 }
 
-void hw_backlight_set(uint16_t val) {
+/* Clocks on and PWM running, at whatever the compare register says */
+static void _pwm_on(void) {
     TIM_TimeBaseInitTypeDef TIM_BaseStruct;
     TIM_OCInitTypeDef TIM_OCStruct;
 
-    if (!_backlight_clocks_on)
-        stm32_power_request(STM32_POWER_APB1, platform_backlight.rcc_tim);
+    if (_backlight_clocks_on)
+        return;
+
+    stm32_power_request(STM32_POWER_APB1, platform_backlight.rcc_tim);
 
     TIM_BaseStruct.TIM_Prescaler = 0;
     TIM_BaseStruct.TIM_CounterMode = TIM_CounterMode_Up;
@@ -71,7 +104,7 @@ void hw_backlight_set(uint16_t val) {
     TIM_OCStruct.TIM_OutputState = TIM_OutputState_Enable;
     TIM_OCStruct.TIM_OCPolarity = TIM_OCPolarity_Low;
 
-    TIM_OCStruct.TIM_Pulse = val;
+    TIM_OCStruct.TIM_Pulse = 0;
 
     TIM_Func(BL_TIM_CH, Init)(platform_backlight.tim, &TIM_OCStruct);
     TIM_Func(BL_TIM_CH, PreloadConfig)(platform_backlight.tim, TIM_OCPreload_Enable);
@@ -81,7 +114,167 @@ void hw_backlight_set(uint16_t val) {
 
     GPIO_PinAFConfig(GPIOB, platform_backlight.pin_source, platform_backlight.af);
 
-    _backlight_clocks_on = val > 0;
+    _backlight_clocks_on = 1;
+}
+
+static void _pwm_off(void) {
     if (!_backlight_clocks_on)
-        stm32_power_release(STM32_POWER_APB1, platform_backlight.rcc_tim);
+        return;
+
+    stm32_power_release(STM32_POWER_APB1, platform_backlight.rcc_tim);
+    _backlight_clocks_on = 0;
+}
+
+/* Straight to val, now rather than at the end of the PWM period */
+static void _pwm_set(uint16_t val) {
+    if (val)
+        _pwm_on();
+    else if (!_backlight_clocks_on)
+        return;
+
+    platform_backlight.tim->TIM_CCR(BL_TIM_CH) = val;
+    TIM_GenerateEvent(platform_backlight.tim, TIM_EventSource_Update);
+
+    if (!val)
+        _pwm_off();
+}
+
+static uint16_t _pwm_get(void) {
+    return _backlight_clocks_on ? platform_backlight.tim->TIM_CCR(BL_TIM_CH) : 0;
+}
+
+static void _ramp_init(void) {
+    DMA_InitTypeDef DMA_InitStruct;
+    NVIC_InitTypeDef NVIC_InitStruct;
+
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA1);
+
+    DMA_DeInit(BL_RAMP_DMA_STREAM);
+    DMA_StructInit(&DMA_InitStruct);
+    DMA_InitStruct.DMA_Channel = BL_RAMP_DMA_CHANNEL;
+    DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)&platform_backlight.tim->TIM_CCR(BL_TIM_CH);
+    DMA_InitStruct.DMA_Memory0BaseAddr = (uint32_t)_ramp;
+    DMA_InitStruct.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+    DMA_InitStruct.DMA_BufferSize = BL_RAMP_STEPS;
+    DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStruct.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStruct.DMA_Priority = DMA_Priority_Low;
+    DMA_InitStruct.DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_Init(BL_RAMP_DMA_STREAM, &DMA_InitStruct);
+    DMA_ITConfig(BL_RAMP_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA1);
+
+    NVIC_InitStruct.NVIC_IRQChannel = BL_RAMP_DMA_IRQ;
+    NVIC_InitStruct.NVIC_IRQChannelPreemptionPriority = 6;  // must be > 5
+    NVIC_InitStruct.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStruct);
+}
+
+/* Pacer and DMA off, clocks back. DMA interrupt masked or in it */
+static void _ramp_end(void) {
+    TIM_Cmd(BL_RAMP_TIM, DISABLE);
+    TIM_DMACmd(BL_RAMP_TIM, TIM_DMA_Update, DISABLE);
+    DMA_Cmd(BL_RAMP_DMA_STREAM, DISABLE);
+    while (BL_RAMP_DMA_STREAM->CR & DMA_SxCR_EN);
+    DMA_ClearFlag(BL_RAMP_DMA_STREAM, BL_RAMP_DMA_FLAGS);
+
+    stm32_power_release(STM32_POWER_APB1, BL_RAMP_TIM_CLOCK);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA1);
+    _ramp_running = 0;
+}
+
+/* Stop a fade where it has got to */
+static void _ramp_stop(void) {
+    NVIC_DisableIRQ(BL_RAMP_DMA_IRQ);
+    if (_ramp_running)
+        _ramp_end();
+    NVIC_EnableIRQ(BL_RAMP_DMA_IRQ);
+}
+
+static uint16_t _isqrt(uint32_t v) {
+    uint32_t r = 0;
+
+    for (uint32_t bit = 1 << 14; bit; bit >>= 1)
+        if ((r + bit) * (r + bit) <= v)
+            r += bit;
+
+    return r;
+}
+
+void hw_backlight_set(uint16_t val) {
+    _ramp_stop();
+    _pwm_set(val);
+}
+
+/*
+ * Fade from wherever it is now to val over ms, and return at once.
+ * The steps are even in the square root of the duty cycle, which looks
+ * a lot more even than steps in the duty cycle do
+ */
+void hw_backlight_fade(uint16_t val, uint32_t ms) {
+    RCC_ClocksTypeDef clocks;
+    uint32_t ticks = ms * (BL_RAMP_TICK_HZ / 1000) / BL_RAMP_STEPS;
+
+    _ramp_stop();
+
+    uint16_t from = _pwm_get();
+    if (!ticks || from == val) {
+        _pwm_set(val);
+        return;
+    }
+
+    int32_t a = _isqrt(from * 1024), b = _isqrt(val * 1024);
+    for (int32_t i = 0; i < BL_RAMP_STEPS; i++) {
+        int32_t r = a + (b - a) * (i + 1) / BL_RAMP_STEPS;
+        _ramp[i] = (r * r) / 1024;
+    }
+    _ramp[BL_RAMP_STEPS - 1] = val;
+    _ramp_to = val;
+
+    /* off is kept on until the last step is out */
+    _pwm_on();
+
+    /* APB1 timers run at twice PCLK1 whenever APB1 is divided down */
+    RCC_GetClocksFreq(&clocks);
+    uint32_t tim_hz = clocks.PCLK1_Frequency == clocks.HCLK_Frequency ?
+                      clocks.PCLK1_Frequency : clocks.PCLK1_Frequency * 2;
+
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA1);
+    stm32_power_request(STM32_POWER_APB1, BL_RAMP_TIM_CLOCK);
+    _ramp_running = 1;
+
+    DMA_ClearFlag(BL_RAMP_DMA_STREAM, BL_RAMP_DMA_FLAGS);
+    BL_RAMP_DMA_STREAM->M0AR = (uint32_t)_ramp;
+    BL_RAMP_DMA_STREAM->NDTR = BL_RAMP_STEPS;
+    DMA_Cmd(BL_RAMP_DMA_STREAM, ENABLE);
+
+    TIM_PrescalerConfig(BL_RAMP_TIM, tim_hz / BL_RAMP_TICK_HZ - 1, TIM_PSCReloadMode_Immediate);
+    TIM_SetAutoreload(BL_RAMP_TIM, ticks > 0xFFFF ? 0xFFFF : ticks - 1);
+    TIM_SetCounter(BL_RAMP_TIM, 0);
+    /* that reload was an update, and would be the first step early */
+    TIM_ClearFlag(BL_RAMP_TIM, TIM_FLAG_Update);
+    TIM_DMACmd(BL_RAMP_TIM, TIM_DMA_Update, ENABLE);
+    TIM_Cmd(BL_RAMP_TIM, ENABLE);
+}
+
+static void _ramp_dma_isr(void) {
+    if (!DMA_GetITStatus(BL_RAMP_DMA_STREAM, DMA_IT_TCIF1) &&
+        !DMA_GetITStatus(BL_RAMP_DMA_STREAM, DMA_IT_TEIF1))
+        return;
+
+    _ramp_end();
+
+    /* a failed transfer still lands where it was going */
+    _pwm_set(_ramp_to);
+}
+
+void DMA1_Stream1_IRQHandler(void) {
+    traceISR_ENTER();
+    _ramp_dma_isr();
+    traceISR_EXIT();
 }
@@ -12,5 +12,6 @@
 
 void hw_backlight_init(void);
 void hw_backlight_set(uint16_t val);
+void hw_backlight_fade(uint16_t val, uint32_t ms);
 
 #endif
@@ -14,7 +14,8 @@
 #define ENABLE_LOG_INFO
 #define ENABLE_LOG_ERROR
 // #define ENABLE_LOG_DEBUG
-// #define ENABLE_EHCILL
+// TI's sleep protocol, so the UART can stop between packets
+#define ENABLE_EHCILL
 
 // BTstack configuration. buffers, sizes, ...
 #define HCI_ACL_PAYLOAD_SIZE 1020
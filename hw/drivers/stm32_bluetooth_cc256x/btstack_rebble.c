@@ -13,6 +13,8 @@
 #include "hal_time_ms.h"
 #include "rbl_bluetooth.h"
 #include "platform_config.h"
+#include "ring.h"
+#include "boot_profile.h"
 
 /* The standard chanel we will use for RFCOMM serial proto comms */
 #define RFCOMM_SERVER_CHANNEL 1
@@ -38,9 +40,36 @@ static int att_write_callback(hci_con_handle_t con_handle, uint16_t att_handle,
 static uint8_t _bt_enabled = 0;
 static btstack_packet_callback_registration_t hci_event_callback_registration;
 
-/* TX outboung buffer pointer.  */
+/* TX outboung buffer pointer. It may have a header to go in front,
+ * the two are put together in the stack's outgoing buffer */
+static uint8_t *_tx_head = NULL;
+static uint16_t _tx_head_len = 0;
 static uint8_t *_tx_buf = NULL;
-static uint8_t _tx_buf_len = 0;
+static uint16_t _tx_buf_len = 0;
+/* LE wants it all in one piece */
+static uint8_t _tx_flat_buf[HCI_ACL_PAYLOAD_SIZE];
+
+/* LE link tuning. The phone picks a quick interval to connect on; once
+ * we're up it goes to the idle one, with slave latency so the radio can
+ * skip events when there's nothing to say. A boost asks for the fast one
+ * until a while after the last boost. Intervals are in 1.25ms units, the
+ * supervision timeouts in 10ms, as the spec has them */
+#define LINK_FAST_INTERVAL_MIN  6     /* 7.5ms */
+#define LINK_FAST_INTERVAL_MAX  12    /* 15ms */
+#define LINK_FAST_LATENCY       0
+#define LINK_FAST_TIMEOUT       200   /* 2s */
+#define LINK_IDLE_INTERVAL_MIN  144   /* 180ms */
+#define LINK_IDLE_INTERVAL_MAX  160   /* 200ms */
+#define LINK_IDLE_LATENCY       4
+#define LINK_IDLE_TIMEOUT       600   /* 6s */
+/* the ATT MTU we will go up to, if the phone asks. The spec's largest */
+#define LINK_MAX_ATT_MTU        517
+
+static hci_con_handle_t _le_con_handle = HCI_CON_HANDLE_INVALID;
+static bt_link_params_t _link;
+static uint8_t _link_fast_wanted;
+static volatile uint32_t _link_boost_ms;
+static btstack_timer_source_t _link_boost_timer;
 
 /* BTStack handlers */
 static void dummy_handler(void);
@@ -49,16 +78,36 @@ static void (*rx_done_handler)(void) = &dummy_handler;
 static void (*tx_done_handler)(void) = &dummy_handler;
 static void (*cts_irq_handler)(void) = &dummy_handler;
 
+/* The receive DMA goes round this for good, and it is the ring itself:
+ * the ISR only moves head up to wherever the DMA has got, and hands it
+ * on to the block btstack is waiting for. The DMA always drains the
+ * USART, so flow control won't hold the chip off any more; this is the
+ * slack instead, ~10ms at 4Mbps. Only ever touched in the rx ISRs */
+static uint8_t _rx_buf[4096];
+static ring _rx = RING_INIT(_rx_buf);
+static uint8_t *_rx_block;
+static volatile uint16_t _rx_block_len;
+static uint16_t _rx_block_got;
+
 
 int btstack_main(int argc, const char ** argv);
 static void packet_handler (uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size);
+static void _load(void);
+
 
+/* Bluetooth UART speed configuguration. Past the APB2 clock /16 the
+ * USART samples at 8x, see stm32_usart */
+#ifndef BLUETOOTH_MODULE_UART_BAUD
+#define BLUETOOTH_MODULE_UART_BAUD 460800
+#endif
+
+/* the chip comes up at this, and _load takes it from there */
+#define BLUETOOTH_MODULE_BOOT_BAUD 115200
 
-/* Bluetooth UART speed configuguration */
 static const hci_transport_config_uart_t config = {
     HCI_TRANSPORT_CONFIG_UART,
-    115200, /* start slow */
-    460800,  /* This is pretty fast, but can we go faster? */
+    BLUETOOTH_MODULE_UART_BAUD, /* _load has already gone fast */
+    BLUETOOTH_MODULE_UART_BAUD,
     1,  /* Use hardware flow control */
     NULL
 };
@@ -113,6 +162,8 @@ void bt_device_init(void)
     hci_init(hci_transport_h4_instance(btstack_uart_block_freertos_instance()), (void*) &config);
     hci_set_link_key_db(btstack_link_key_db_memory_instance());
     hci_set_chipset(btstack_chipset_cc256x_instance()); // Do I need this ??
+    /* the init script turns on the chip's half of the sleep protocol */
+    btstack_chipset_cc256x_enable_ehcill(1);
     
     hci_event_callback_registration.callback = &packet_handler;
     hci_add_event_handler(&hci_event_callback_registration);
@@ -147,7 +198,9 @@ void bt_device_init(void)
     /* setup SM: Display only */
     sm_init();
 
-    /* setup ATT server */
+    /* setup ATT server. The MTU is the client's to start, we only say
+     * how far we'll go */
+    l2cap_set_max_le_mtu(LINK_MAX_ATT_MTU);
     att_server_init(profile_data, att_read_callback, att_write_callback);    
     att_server_register_packet_handler(packet_handler);
 
@@ -174,12 +227,23 @@ void bt_device_init(void)
  */
 void bt_device_request_tx(uint8_t *data, uint16_t len)
 {
-    if (len > HCI_ACL_PAYLOAD_SIZE)
+    bt_device_request_tx_iov(NULL, 0, data, len);
+}
+
+/*
+ * The same, with a header to go in front of data. Neither is copied
+ * until the stack is ready for them
+ */
+void bt_device_request_tx_iov(uint8_t *head, uint16_t head_len, uint8_t *data, uint16_t len)
+{
+    if (head_len + len > HCI_ACL_PAYLOAD_SIZE)
     {
-        SYS_LOG("BTSPP", APP_LOG_LEVEL_ERROR, "Data size %d > buffer size %d", len, HCI_ACL_PAYLOAD_SIZE);
+        SYS_LOG("BTSPP", APP_LOG_LEVEL_ERROR, "Data size %d > buffer size %d", head_len + len, HCI_ACL_PAYLOAD_SIZE);
         return;
     }
 
+    _tx_head = head;
+    _tx_head_len = head_len;
     _tx_buf = data;
     _tx_buf_len = len;
     
@@ -197,6 +261,74 @@ void bt_device_request_tx(uint8_t *data, uint16_t len)
     }
 }
 
+/* On the stack's thread: ask the phone for the parameters we want now,
+ * unless we have them */
+static void _link_apply(void)
+{
+    uint8_t fast = _link_fast_wanted;
+
+    if (_le_con_handle == HCI_CON_HANDLE_INVALID)
+        return;
+    if (fast ? _link.interval <= LINK_FAST_INTERVAL_MAX : _link.interval >= LINK_IDLE_INTERVAL_MIN)
+        return;
+
+    if (fast)
+        gap_request_connection_parameter_update(_le_con_handle, LINK_FAST_INTERVAL_MIN, LINK_FAST_INTERVAL_MAX,
+                                                LINK_FAST_LATENCY, LINK_FAST_TIMEOUT);
+    else
+        gap_request_connection_parameter_update(_le_con_handle, LINK_IDLE_INTERVAL_MIN, LINK_IDLE_INTERVAL_MAX,
+                                                LINK_IDLE_LATENCY, LINK_IDLE_TIMEOUT);
+}
+
+static void _link_boost_expired(btstack_timer_source_t *ts)
+{
+    _link_fast_wanted = 0;
+    _link.fast = 0;
+    _link_apply();
+}
+
+static void _link_boost(void *arg)
+{
+    btstack_run_loop_remove_timer(&_link_boost_timer);
+    btstack_run_loop_set_timer_handler(&_link_boost_timer, _link_boost_expired);
+    btstack_run_loop_set_timer(&_link_boost_timer, _link_boost_ms);
+    btstack_run_loop_add_timer(&_link_boost_timer);
+
+    if (!_link_fast_wanted)
+    {
+        _link_fast_wanted = 1;
+        _link.fast = 1;
+        _link_apply();
+    }
+}
+
+/*
+ * Ask for the fast link until ms after the last call. Any thread; the
+ * stack is only touched on its own
+ */
+void bt_device_link_boost(uint32_t ms)
+{
+    _link_boost_ms = ms;
+    btstack_run_loop_freertos_execute_code_on_main_thread(_link_boost, NULL);
+}
+
+/* the link as it stands, for the stats */
+void bt_device_link_params(bt_link_params_t *params)
+{
+    *params = _link;
+}
+
+/* The packet in one piece, for the APIs that only take that */
+static uint8_t *_tx_flat(void)
+{
+    if (!_tx_head_len)
+        return _tx_buf;
+    
+    memcpy(_tx_flat_buf, _tx_head, _tx_head_len);
+    memcpy(_tx_flat_buf + _tx_head_len, _tx_buf, _tx_buf_len);
+    return _tx_flat_buf;
+}
+
 /*
  * HAL-x functions are stubs that BTStack requires
  * These will proxy BTstack functionality to our own RebbleOS funcs
@@ -223,14 +355,24 @@ void hal_cpu_enable_irqs_and_sleep(void)
     __asm__("wfe"); /* go to sleep if event flag isn't set. if set, just clear it. IRQs set event flag */
 }
 
+/* eHCILL has agreed with the chip that the link can sleep, or it's
+ * waking. See stm32_cc256x_sleep */
 void hal_uart_dma_set_sleep(uint8_t sleep)
 {
-    /* later.. */
+    hw_bluetooth_sleep(sleep);
 }
 
 void hal_uart_dma_init(void)
 {
-    bluetooth_power_cycle();
+    /* the receive runs from now on, whatever the chip says */
+    taskENTER_CRITICAL();
+    ring_init(&_rx, _rx_buf, sizeof(_rx_buf));
+    _rx_block_len = 0;
+    stm32_usart_recv_circular(hw_bluetooth_get_usart(), _rx_buf, sizeof(_rx_buf));
+    taskEXIT_CRITICAL();
+
+    if (bluetooth_power_cycle() == 0)
+        _load();
 }
 
 void hal_uart_dma_set_block_received( void (*the_block_handler)(void))
@@ -267,9 +409,16 @@ void hal_uart_dma_send_block(const uint8_t *data, uint16_t size)
     stm32_usart_send_dma(hw_bluetooth_get_usart(), (uint32_t *)data, size);
 }
 
+/*
+ * Nothing to start, only somewhere to put the next size bytes. It may
+ * well be in the ring already, so the rx ISR is kicked to go and look
+ */
 void hal_uart_dma_receive_block(uint8_t *data, uint16_t size)
 {
-    stm32_usart_recv_dma(hw_bluetooth_get_usart(), (uint32_t *)data, size);
+    _rx_block = data;
+    _rx_block_got = 0;
+    _rx_block_len = size;
+    NVIC_SetPendingIRQ(hw_bluetooth_get_usart()->dma->dma_irq_rx_channel);
 }
 
 
@@ -277,12 +426,233 @@ void hal_uart_dma_receive_block(uint8_t *data, uint16_t size)
  * BTStack wants to reset.
  * Call up to RebbleOS to find out how to do that
  */
-void bluetooth_power_cycle(void)
+uint8_t bluetooth_power_cycle(void)
+{
+    uint8_t err = hw_bluetooth_power_cycle();
+
+    bluetooth_init_complete(err ? INIT_RESP_ERROR : INIT_RESP_OK);
+    return err;
+}
+
+/*
+ * The init script, the chip's patches and settings, goes up here, as
+ * the transport opens and before btstack says anything to the chip.
+ *
+ * The chip comes up at 115200, so the first thing is to take it to the
+ * full baud. Then the script goes as it is in flash: it is H4 command
+ * packets back to back already, so as many as the chip has command
+ * credits for go in one DMA straight out of flash, with no copy and no
+ * trip round btstack's run loop for each command complete.
+ *
+ * btstack's cc256x driver still walks the script alongside, as it tunes
+ * a few commands on the way (the power vectors). One it has changed goes
+ * from its copy instead. When btstack's own init gets to the script, the
+ * driver has none of it left to send. If it doesn't go, the chip is
+ * started over and btstack is left to send the script itself, one
+ * command at a time, as it always has
+ */
+#define LOAD_TIMEOUT_MS                 500
+#define HCI_VS_UPDATE_UART_HCI_BAUDRATE 0xff36
+
+static TaskHandle_t _load_task;
+static volatile uint8_t _load_tx_busy;
+/* the command btstack's driver gives us, behind its H4 type */
+static uint8_t _load_cmd[1 + 3 + 255];
+/* type, code, length and up to 255 of parameters */
+static uint8_t _load_event[3 + 255];
+static uint16_t _load_event_got;
+static uint8_t _load_credits;
+static uint8_t _load_pending;
+
+/* from bt_stack_rx_done and bt_stack_tx_done */
+static void _load_wake_from_isr(void)
+{
+    BaseType_t woken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(_load_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void _load_tx_done(void)
+{
+    _load_tx_busy = 0;
+    _load_wake_from_isr();
+}
+
+static int _load_send(const uint8_t *data, uint32_t len)
+{
+    _load_tx_busy = 1;
+    stm32_usart_send_dma(hw_bluetooth_get_usart(), (uint32_t *)data, len);
+    while (_load_tx_busy)
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOAD_TIMEOUT_MS)))
+            return -1;
+
+    return 0;
+}
+
+/* The next event off the ring, or NULL if none comes in time */
+static const uint8_t *_load_next_event(void)
+{
+    uint16_t want;
+
+    for (;;)
+    {
+        if (_load_event_got < 3)
+            _load_event_got += ring_read(&_rx, _load_event + _load_event_got, 3 - _load_event_got);
+        if (_load_event_got >= 3)
+        {
+            /* nothing else should be coming, so we're out of step */
+            if (_load_event[0] != HCI_EVENT_PACKET)
+                return NULL;
+            want = 3 + _load_event[2];
+            _load_event_got += ring_read(&_rx, _load_event + _load_event_got, want - _load_event_got);
+            if (_load_event_got == want)
+            {
+                _load_event_got = 0;
+                return _load_event;
+            }
+        }
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOAD_TIMEOUT_MS)))
+            return NULL;
+    }
+}
+
+/* Wait for a command to be done with, or for the chip to give credits
+ * with no command at all, and take the credits it gives */
+static int _load_wait(void)
+{
+    const uint8_t *ev;
+    uint16_t opcode;
+    uint8_t status;
+
+    for (;;)
+    {
+        if (!(ev = _load_next_event()))
+            return -1;
+        if (ev[1] == HCI_EVENT_COMMAND_COMPLETE)
+        {
+            _load_credits = ev[3];
+            opcode = little_endian_read_16(ev, 4);
+            status = opcode ? ev[6] : 0;
+            break;
+        }
+        if (ev[1] == HCI_EVENT_COMMAND_STATUS)
+        {
+            _load_credits = ev[4];
+            opcode = little_endian_read_16(ev, 5);
+            status = ev[3];
+            break;
+        }
+    }
+
+    if (opcode && _load_pending)
+        _load_pending--;
+    if (status)
+    {
+        SYS_LOG("BTSPP", APP_LOG_LEVEL_ERROR, "init script: chip said %d", status);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* HCI_VS_Update_UART_HCI_Baudrate. Its command complete comes at the
+ * old speed, and the chip is at the new one after that */
+static int _load_baud(uint32_t baud)
 {
-    if (hw_bluetooth_power_cycle())
-        os_module_init_complete(INIT_RESP_ERROR);
+    static uint8_t cmd[8];
+
+    cmd[0] = HCI_COMMAND_DATA_PACKET;
+    little_endian_store_16(cmd, 1, HCI_VS_UPDATE_UART_HCI_BAUDRATE);
+    cmd[3] = 4;
+    little_endian_store_32(cmd, 4, baud);
+
+    _load_pending = 1;
+    if (_load_send(cmd, sizeof(cmd)) || _load_wait())
+        return -1;
+    stm32_usart_set_baud(hw_bluetooth_get_usart(), baud);
+
+    return 0;
+}
+
+static int _load_script(uint16_t *commands)
+{
+    const btstack_chipset_t *chipset = btstack_chipset_cc256x_instance();
+    uint32_t pos = 0, run_at, run;
+    uint16_t len = 0;
+    uint8_t more = 1, copied;
+
+    _load_cmd[0] = HCI_COMMAND_DATA_PACKET;
+    _load_credits = 1;
+    _load_pending = 0;
+
+    while (more || _load_pending)
+    {
+        /* as many as there are credits for, in one piece of flash.
+         * One the driver has changed ends the piece and goes after it */
+        run_at = pos;
+        run = 0;
+        copied = 0;
+        while (more && _load_credits && !copied)
+        {
+            if (chipset->next_command(_load_cmd + 1) != BTSTACK_CHIPSET_VALID_COMMAND)
+            {
+                more = 0;
+                break;
+            }
+            len = 4 + _load_cmd[3];
+            if (pos + len <= cc256x_init_script_size && !memcmp(&cc256x_init_script[pos], _load_cmd, len))
+                run += len;
+            else
+                copied = 1;
+            pos += len;
+            _load_credits--;
+            _load_pending++;
+            (*commands)++;
+        }
+
+        if (run && _load_send(&cc256x_init_script[run_at], run))
+            return -1;
+        if (copied && _load_send(_load_cmd, len))
+            return -1;
+
+        if ((!_load_credits || (!more && _load_pending)) && _load_wait())
+            return -1;
+    }
+
+    return 0;
+}
+
+static void _load(void)
+{
+    const btstack_chipset_t *chipset = btstack_chipset_cc256x_instance();
+    void (*tx_done)(void) = tx_done_handler;
+    TickType_t started = xTaskGetTickCount();
+    uint16_t commands = 0;
+
+    _load_task = xTaskGetCurrentTaskHandle();
+    _load_event_got = 0;
+    tx_done_handler = _load_tx_done;
+    stm32_usart_set_baud(hw_bluetooth_get_usart(), BLUETOOTH_MODULE_BOOT_BAUD);
+
+    if (_load_baud(BLUETOOTH_MODULE_UART_BAUD) == 0 && _load_script(&commands) == 0)
+    {
+        SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "init script: %d bytes in %d commands, %d ms",
+                cc256x_init_script_size, commands, (xTaskGetTickCount() - started) * portTICK_PERIOD_MS);
+        boot_profile_event(BootProfileBluetoothPatched);
+    }
     else
-        os_module_init_complete(INIT_RESP_OK);
+    {
+        SYS_LOG("BTSPP", APP_LOG_LEVEL_ERROR, "init script didn't go, btstack will send it");
+        hw_bluetooth_power_cycle();
+        stm32_usart_set_baud(hw_bluetooth_get_usart(), BLUETOOTH_MODULE_BOOT_BAUD);
+        _load_event_got = 0;
+        _load_baud(BLUETOOTH_MODULE_UART_BAUD);
+        chipset->init(&config);
+    }
+
+    tx_done_handler = tx_done;
+    _load_task = NULL;
 }
 
 /*
@@ -300,11 +670,33 @@ void bt_stack_tx_done()
 }
 
 /*
- * RX is complete. Tell BTStack
+ * The DMA is half way or round again, the line went quiet, or btstack
+ * wants a block. Take in what has come, and tell BTStack once its block
+ * is full
  */
 void bt_stack_rx_done()
 {
-    (*rx_done_handler)();
+    uint32_t pos = stm32_usart_rx_circular_pos(hw_bluetooth_get_usart());
+    uint32_t fresh = (pos - _rx.head) & (_rx.size - 1);
+
+    /* a ring behind, the DMA has written over what btstack never took.
+     * The stream is broken either way, carry on from the newest */
+    if (fresh > ring_free(&_rx))
+        ring_consume(&_rx, ring_used(&_rx));
+    ring_commit(&_rx, fresh);
+
+    while (_rx_block_len && ring_used(&_rx))
+    {
+        _rx_block_got += ring_read(&_rx, _rx_block + _rx_block_got, _rx_block_len - _rx_block_got);
+        if (_rx_block_got < _rx_block_len)
+            break;
+
+        _rx_block_len = 0;
+        (*rx_done_handler)();
+    }
+
+    if (_load_task)
+        _load_wake_from_isr();
 }
 
 /*
@@ -330,7 +722,7 @@ static uint16_t att_read_callback(hci_con_handle_t con_handle, uint16_t att_hand
 
     if (att_handle == ATT_CHARACTERISTIC_0000FF11_0000_1000_8000_00805F9B34FB_01_VALUE_HANDLE)
     {
-        return att_read_callback_handle_blob((const uint8_t *)_tx_buf, _tx_buf_len, offset, buffer, buffer_size);
+        return att_read_callback_handle_blob((const uint8_t *)_tx_flat(), _tx_head_len + _tx_buf_len, offset, buffer, buffer_size);
     }
     return 0;
 }
@@ -350,8 +742,8 @@ static int att_write_callback(hci_con_handle_t con_handle, uint16_t att_handle,
             att_con_handle = con_handle;
             return 0;
         case ATT_CHARACTERISTIC_0000FF11_0000_1000_8000_00805F9B34FB_01_VALUE_HANDLE:
-            SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "Write on test characteristic: ");
-            printf_hexdump(buffer, buffer_size);
+            /* the same stream as over SPP, in smaller pieces */
+            bluetooth_data_rx(buffer, buffer_size);
             return 0;
         default:
             SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "WRITE Callback, handle %04x, mode %u, offset %u, data: ", con_handle, transaction_mode, offset);
@@ -368,7 +760,6 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
 {
     bd_addr_t event_addr;
     uint16_t  mtu;
-    int i;
     uint8_t event;
 
     if (packet_type == HCI_EVENT_PACKET)
@@ -411,14 +802,53 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
 
                 case HCI_EVENT_DISCONNECTION_COMPLETE:
                     le_notification_enabled = 0;
+                    if (hci_event_disconnection_complete_get_connection_handle(packet) == _le_con_handle)
+                    {
+                        _le_con_handle = HCI_CON_HANDLE_INVALID;
+                        _link.interval = _link.latency = _link.timeout = 0;
+                        _link.att_mtu = 0;
+                    }
+                    break;
+
+                case HCI_EVENT_LE_META:
+                    switch (hci_event_le_meta_get_subevent_code(packet))
+                    {
+                        case HCI_SUBEVENT_LE_CONNECTION_COMPLETE:
+                            if (hci_subevent_le_connection_complete_get_status(packet))
+                                break;
+                            _le_con_handle = hci_subevent_le_connection_complete_get_connection_handle(packet);
+                            _link.interval = hci_subevent_le_connection_complete_get_conn_interval(packet);
+                            _link.latency = hci_subevent_le_connection_complete_get_conn_latency(packet);
+                            _link.timeout = hci_subevent_le_connection_complete_get_supervision_timeout(packet);
+                            _link.att_mtu = ATT_DEFAULT_MTU;
+                            _link_apply();
+                            break;
+                        case HCI_SUBEVENT_LE_CONNECTION_UPDATE_COMPLETE:
+                            _link.interval = hci_subevent_le_connection_update_complete_get_conn_interval(packet);
+                            _link.latency = hci_subevent_le_connection_update_complete_get_conn_latency(packet);
+                            _link.timeout = hci_subevent_le_connection_update_complete_get_supervision_timeout(packet);
+                            SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "LE link: interval %d latency %d timeout %d",
+                                    _link.interval, _link.latency, _link.timeout);
+                            break;
+                    }
+                    break;
+
+                case L2CAP_EVENT_CONNECTION_PARAMETER_UPDATE_RESPONSE:
+                    if (little_endian_read_16(packet, 4))
+                        SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "LE link: phone kept its parameters");
+                    break;
+
+                case ATT_EVENT_MTU_EXCHANGE_COMPLETE:
+                    _link.att_mtu = att_event_mtu_exchange_complete_get_MTU(packet);
+                    SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "LE link: ATT MTU %d", _link.att_mtu);
                     break;
 
                 case ATT_EVENT_CAN_SEND_NOW:
                     SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "ATT %d %d", packet_type, channel);
                     
-                    if (_tx_buf_len == 0)
+                    if (_tx_head_len + _tx_buf_len == 0)
                         break;
-                    att_server_notify(att_con_handle, ATT_CHARACTERISTIC_0000FF11_0000_1000_8000_00805F9B34FB_01_VALUE_HANDLE, (uint8_t*)  _tx_buf, _tx_buf_len);
+                    att_server_notify(att_con_handle, ATT_CHARACTERISTIC_0000FF11_0000_1000_8000_00805F9B34FB_01_VALUE_HANDLE, _tx_flat(), _tx_head_len + _tx_buf_len);
                     break;
 
                 case RFCOMM_EVENT_INCOMING_CONNECTION:
@@ -441,19 +871,29 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
                     {
                         rfcomm_channel_id = rfcomm_event_channel_opened_get_rfcomm_cid(packet);
                         mtu = rfcomm_event_channel_opened_get_max_frame_size(packet);
+                        _link.rfcomm_frame = mtu;
                         SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "RFCOMM channel open succeeded. New RFCOMM Channel ID %d, max frame size %d", rfcomm_channel_id, mtu);
                         bluetooth_device_connected();
                     }
                     break;
 
                 case RFCOMM_EVENT_CAN_SEND_NOW:
-                    /* We have been instructed to send data safely. We;re ready */
-                    rfcomm_send(rfcomm_channel_id, _tx_buf, _tx_buf_len);
+                    /* We have been instructed to send data safely. We;re ready.
+                     * Both pieces go straight into the stack's buffer, which
+                     * is the one copy rfcomm_send would have made anyway */
+                    rfcomm_reserve_packet_buffer();
+                    uint8_t *out = rfcomm_get_outgoing_buffer();
+                    if (_tx_head_len)
+                        memcpy(out, _tx_head, _tx_head_len);
+                    memcpy(out + _tx_head_len, _tx_buf, _tx_buf_len);
+                    if (rfcomm_send_prepared(rfcomm_channel_id, _tx_head_len + _tx_buf_len))
+                        rfcomm_release_packet_buffer();
                     break;
 
                 case RFCOMM_EVENT_CHANNEL_CLOSED:
                     SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "RFCOMM channel closed");
                     rfcomm_channel_id = 0;
+                    _link.rfcomm_frame = 0;
                     bluetooth_device_disconnected();
                     break;
                 
@@ -463,12 +903,6 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
             break;
                 
         case RFCOMM_DATA_PACKET:
-            SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "RCV: '");
-            for (i = 0; i < size; i++)
-            {
-                SYS_LOG("BTSPP", APP_LOG_LEVEL_INFO, "0x%x", packet[i]);
-            }
-            
             /* pack the packet onto the bluetooth generic handler */
             bluetooth_data_rx(packet, size);
             break;
@@ -5,7 +5,8 @@
 void port_main(void);
 void bt_device_init(void);
 void bt_device_request_tx(uint8_t *data, uint16_t len);
-void bluetooth_power_cycle(void);
+void bt_device_request_tx_iov(uint8_t *head, uint16_t head_len, uint8_t *data, uint16_t len);
+uint8_t bluetooth_power_cycle(void);
 void bt_stack_tx_done();
 void bt_stack_rx_done();
 void bt_stack_cts_irq();
@@ -28,6 +28,7 @@
 #include "stm32_usart.h"
 #include "stm32_cc256x.h"
 #include "rebble_util.h"
+#include "sched_trace.h"
 
 static stm32_bluetooth_config_t *_cc256x;
 
@@ -75,7 +76,7 @@ uint8_t stm32_cc256x_init(const stm32_bluetooth_config_t *cc256x)
     /* configure DMA and set initial speed */
     stm32_usart_init_device(_cc256x->usart);
     
-    /* I'm going to request the usart stay on for now pending bluetooth */
+    /* the usart stays on unless the chip is asleep, see stm32_cc256x_sleep */
     stm32_power_request(_cc256x->usart->config->usart_periph_bus, _cc256x->usart->config->usart_clock);
 
     stm32_cc256x_clock_on();
@@ -129,10 +130,8 @@ void stm32_cc256x_clock_on(void)
     IWDG_ReloadCounter();
     
     DRV_LOG("BT", APP_LOG_LEVEL_DEBUG, "BT: Power ON!");
-    /* XXX TODO NOTE. Until we get eHCILL setup, we can't turn off
- 
-     * the USART1. That would cause problems */
- 
+    /* the USART1 is only let go while eHCILL has the chip asleep, see
+     * stm32_cc256x_sleep */
     stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_PWR);
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
 }
@@ -180,6 +179,67 @@ uint8_t stm32_cc256x_power_cycle(void)
 }
 
 
+/*
+ * eHCILL sleep, as btstack's H4 transport drives it. Once the chip and
+ * the stack have agreed to sleep, RTS goes high as a plain GPIO so the
+ * chip holds off, and the UART and DMA clocks are let go: the one held
+ * since init, and the pair the circular receive is sitting on. With
+ * nothing else running, the idle task can then take us down to STOP
+ * between packets. The chip wakes us with a pulse on CTS
+ * (EXTI 11, which works in STOP), the stack calls us back with 0, and
+ * the clocks and RTS come back for the wake up handshake. The receive
+ * carries on where it was.
+ */
+static uint8_t _asleep;
+static uint8_t _asleep_rx_armed;
+
+void stm32_cc256x_sleep(uint8_t sleep)
+{
+    const stm32_usart_config_t *u = _cc256x->usart->config;
+    const stm32_dma_t *dma = _cc256x->usart->dma;
+    GPIO_InitTypeDef gpio_init;
+
+    if (!sleep == !_asleep)
+        return;
+
+    stm32_power_request(STM32_POWER_AHB1, u->gpio_clock);
+    gpio_init.GPIO_Pin = 1 << u->gpio_pin_rts_num;
+    gpio_init.GPIO_Speed = GPIO_Speed_100MHz;
+    gpio_init.GPIO_OType = GPIO_OType_PP;
+    gpio_init.GPIO_PuPd = GPIO_PuPd_NOPULL;
+
+    if (sleep)
+    {
+        GPIO_SetBits(u->gpio_ptr, 1 << u->gpio_pin_rts_num);
+        gpio_init.GPIO_Mode = GPIO_Mode_OUT;
+        GPIO_Init(u->gpio_ptr, &gpio_init);
+
+        _asleep_rx_armed = DMA_GetCmdStatus(dma->dma_rx_stream) == ENABLE;
+        if (_asleep_rx_armed)
+        {
+            stm32_power_release(u->usart_periph_bus, u->usart_clock);
+            stm32_power_release(STM32_POWER_AHB1, dma->dma_clock);
+        }
+        stm32_power_release(u->usart_periph_bus, u->usart_clock);
+        _asleep = 1;
+    }
+    else
+    {
+        stm32_power_request(u->usart_periph_bus, u->usart_clock);
+        if (_asleep_rx_armed)
+        {
+            stm32_power_request(u->usart_periph_bus, u->usart_clock);
+            stm32_power_request(STM32_POWER_AHB1, dma->dma_clock);
+        }
+
+        /* back to the UART's own flow control, which drops RTS */
+        gpio_init.GPIO_Mode = GPIO_Mode_AF;
+        GPIO_Init(u->gpio_ptr, &gpio_init);
+        _asleep = 0;
+    }
+    stm32_power_release(STM32_POWER_AHB1, u->gpio_clock);
+}
+
 /*
  * IRQ trigger for EXT 11 for bluetooth
  * This is for low power shutdown wakeup
@@ -188,6 +248,7 @@ uint8_t stm32_cc256x_power_cycle(void)
  */
 void EXTI15_10_IRQHandler(void)
 {
+    traceISR_ENTER();
     if (EXTI_GetITStatus(EXTI_Line11) != RESET)
     {
         EXTI_ClearITPendingBit(EXTI_Line11);
@@ -199,6 +260,7 @@ void EXTI15_10_IRQHandler(void)
         /* Display used me */
         EXTI_ClearITPendingBit(EXTI_Line10);
     }
+    traceISR_EXIT();
 }
 
 
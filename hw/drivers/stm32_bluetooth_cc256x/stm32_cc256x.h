@@ -16,9 +16,11 @@ const typedef struct {
 
 static stm32_bluetooth_config_t *_cc256x;
 
-#define STM32_CC256X_MK_IRQ_HANDLERS(usart, dma, txstr, rxstr) \
+/* rx is circular, see hal_uart_dma_receive_block. usart_n is which
+ * USART, for its idle line IRQ */
+#define STM32_CC256X_MK_IRQ_HANDLERS(usart, dma, txstr, rxstr, usart_n) \
     STM32_USART_MK_TX_IRQ_HANDLER(usart, dma, txstr, bt_stack_tx_done) \
-    STM32_USART_MK_RX_IRQ_HANDLER(usart, dma, rxstr, bt_stack_rx_done)
+    STM32_USART_MK_RX_CIRCULAR_IRQ_HANDLERS(usart, dma, rxstr, usart_n, bt_stack_rx_done)
 
     
 uint8_t stm32_cc256x_init(const stm32_bluetooth_config_t *cc256x);
@@ -26,3 +28,4 @@ void stm32_cc256x_clock_on(void);
 uint8_t stm32_cc256x_power_cycle(void);
 void stm32_cc256x_enable_cts_irq();
 void stm32_cc256x_disable_cts_irq(void);
+void stm32_cc256x_sleep(uint8_t sleep);
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include "stm32_buttons.h"
+#include "sched_trace.h"
 
 typedef struct {
     uint16_t gpio_pin;
@@ -39,7 +40,9 @@ extern void stm32_buttons_raw_isr();
 #define STM32_BUTTONS_MK_IRQ_HANDLER(exti) \
     void EXTI ## exti ## _IRQHandler(void) \
     { \
+        traceISR_ENTER(); \
         stm32_buttons_raw_isr(); \
+        traceISR_EXIT(); \
     }
 
 #endif
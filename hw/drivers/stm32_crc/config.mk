@@ -0,0 +1,3 @@
+CFLAGS_driver_stm32_crc = -Ihw/drivers/stm32_crc
+
+SRCS_driver_stm32_crc = hw/drivers/stm32_crc/stm32_crc.c
@@ -0,0 +1,144 @@
+/* stm32_crc.c
+ * The CRC unit. It's the same CRC32 as Utilities/stm32_crc.py, so what
+ * the SDK and mkpack put in app and resource headers can be checked
+ * RebbleOS
+ *
+ * Long runs of words are fed in by DMA2, memory to memory, with the CRC
+ * data register as a fixed destination. It finishes in the ISR, and the
+ * CPU is free to go and read the next lot from flash meanwhile.
+ */
+#if defined(STM32F4XX)
+#    include "stm32f4xx.h"
+#    include "stm32f4xx_dma.h"
+#elif defined(STM32F2XX)
+#    include "stm32f2xx.h"
+#    include "stm32f2xx_dma.h"
+#    include "stm32f2xx_rcc.h"
+#    include "misc.h"
+#else
+#    error "I have no idea what kind of stm32 this is; sorry"
+#endif
+#include "stm32_power.h"
+#include "stm32_dma.h"
+#include "stm32_crc.h"
+#include "rebble_crc.h"
+#include "sched_trace.h"
+
+/* only DMA2 does memory to memory, and the NOR has stream 0 */
+#define CRC_DMA_STREAM  DMA2_Stream1
+#define CRC_DMA_IRQ     DMA2_Stream1_IRQn
+#define CRC_DMA_FLAGS   STM32_DMA_MK_FLAGS(1)
+#define CRC_DMA_MAX     0xFFFF /* NDTR counts words */
+
+/* The DMA can't see CCM */
+#define CCMRAM_START 0x10000000
+#define CCMRAM_END   (CCMRAM_START + 64 * 1024)
+
+void hw_crc_init(void)
+{
+    DMA_InitTypeDef dma_init_struct;
+    NVIC_InitTypeDef nvic_init_struct;
+    
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    
+    DMA_DeInit(CRC_DMA_STREAM);
+    DMA_StructInit(&dma_init_struct);
+    dma_init_struct.DMA_Channel = DMA_Channel_0;
+    dma_init_struct.DMA_DIR = DMA_DIR_MemoryToMemory;
+    /* memory to memory reads the peripheral side, so that's our data */
+    dma_init_struct.DMA_Memory0BaseAddr = (uint32_t)&CRC->DR;
+    dma_init_struct.DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+    dma_init_struct.DMA_MemoryInc = DMA_MemoryInc_Disable;
+    dma_init_struct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    dma_init_struct.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+    dma_init_struct.DMA_Mode = DMA_Mode_Normal;
+    dma_init_struct.DMA_Priority = DMA_Priority_Low;
+    dma_init_struct.DMA_FIFOMode = DMA_FIFOMode_Enable;
+    dma_init_struct.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+    dma_init_struct.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+    dma_init_struct.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+    DMA_Init(CRC_DMA_STREAM, &dma_init_struct);
+    DMA_ITConfig(CRC_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+    
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    
+    nvic_init_struct.NVIC_IRQChannel = CRC_DMA_IRQ;
+    nvic_init_struct.NVIC_IRQChannelPreemptionPriority = 6;  // must be > 5
+    nvic_init_struct.NVIC_IRQChannelSubPriority = 0;
+    nvic_init_struct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic_init_struct);
+}
+
+/* power the unit up and start a new CRC. It stays up until hw_crc_release */
+void hw_crc_reset(void)
+{
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_CRC);
+    CRC->CR = CRC_CR_RESET;
+}
+
+void hw_crc_release(void)
+{
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_CRC);
+}
+
+/* words needn't be aligned, the M3 and M4 load them either way */
+void hw_crc_feed(const uint32_t *words, size_t count)
+{
+    while (count--)
+        CRC->DR = *words++;
+}
+
+/*
+ * Start the DMA on a run of words, which completes with
+ * rcore_crc_complete_isr. False if it can't take this one, for the CPU
+ * to do instead. Nothing else can be fed in until it's done
+ */
+bool hw_crc_feed_dma(const uint32_t *words, size_t count)
+{
+    uint32_t start = (uint32_t)words;
+    uint32_t end = start + count * 4;
+    
+    if ((start & 3) || count > CRC_DMA_MAX || !(end <= CCMRAM_START || start >= CCMRAM_END))
+        return false;
+    
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    while (CRC_DMA_STREAM->CR & DMA_SxCR_EN);
+    DMA_ClearFlag(CRC_DMA_STREAM, CRC_DMA_FLAGS);
+    
+    CRC_DMA_STREAM->PAR = start;
+    CRC_DMA_STREAM->NDTR = count;
+    DMA_Cmd(CRC_DMA_STREAM, ENABLE);
+    /* the DMA clock is given back in DMA2_Stream1_IRQHandler */
+    
+    return true;
+}
+
+uint32_t hw_crc_value(void)
+{
+    return CRC->DR;
+}
+
+static void _crc_dma_isr(void)
+{
+    uint8_t err = 0;
+    
+    if (DMA_GetITStatus(CRC_DMA_STREAM, DMA_IT_TEIF1))
+    {
+        /* the CRC is junk now, the caller gets told so */
+        DMA_Cmd(CRC_DMA_STREAM, DISABLE);
+        err = 1;
+    }
+    else if (!DMA_GetITStatus(CRC_DMA_STREAM, DMA_IT_TCIF1))
+        return;
+    
+    DMA_ClearFlag(CRC_DMA_STREAM, CRC_DMA_FLAGS);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    rcore_crc_complete_isr(err);
+}
+
+void DMA2_Stream1_IRQHandler(void)
+{
+    traceISR_ENTER();
+    _crc_dma_isr();
+    traceISR_EXIT();
+}
@@ -0,0 +1,21 @@
+/*
+ * stm32_crc.h
+ * The STM32 CRC unit, fed by the CPU or over DMA
+ * RebbleOS
+ */
+
+#ifndef __STM32_CRC_H
+#define __STM32_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+void hw_crc_init(void);
+void hw_crc_reset(void);
+void hw_crc_feed(const uint32_t *words, size_t count);
+bool hw_crc_feed_dma(const uint32_t *words, size_t count);
+uint32_t hw_crc_value(void);
+void hw_crc_release(void);
+
+#endif
@@ -0,0 +1,3 @@
+CFLAGS_driver_stm32_delay = -Ihw/drivers/stm32_delay
+
+SRCS_driver_stm32_delay = hw/drivers/stm32_delay/stm32_delay.c
@@ -0,0 +1,119 @@
+/* stm32_delay.c
+ * Busy waits timed off the core clock
+ * RebbleOS
+ *
+ * Waits are counted on the DWT cycle counter against SystemCoreClock, so
+ * they don't move with the optimisation level or the clock we run at.
+ * Some emulators don't implement the counter, so if it doesn't tick we
+ * fall back to a fixed length loop. Safe before the scheduler and in
+ * ISRs; anything long from a task should use delay_ms instead.
+ *
+ * Without the counter, hw_cycle_count is made up from the RTOS tick and
+ * what SysTick has counted since it. That is good to a few cycles while
+ * the scheduler runs, and under qemu -icount it counts instructions, which
+ * is what the perf target compares. Before the scheduler there is no
+ * SysTick, and it stays 0.
+ */
+#if defined(STM32F4XX)
+#    include "stm32f4xx.h"
+#elif defined(STM32F2XX)
+#    include "stm32f2xx.h"
+#else
+#    error "I have no idea what kind of stm32 this is; sorry"
+#endif
+#include "stm32_delay.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* subs + taken bne */
+#define LOOP_CYCLES 3
+
+/* 1 if the cycle counter runs, 0 if not, -1 until we've looked */
+static int8_t _cyccnt_works = -1;
+
+static void _delay_loop(uint32_t n)
+{
+    if (!n)
+        return;
+    __asm volatile(
+        "1: subs %0, #1\n"
+        "   bne 1b\n"
+        : "+r" (n) : : "cc");
+}
+
+static uint8_t _cyccnt_start(void)
+{
+    if (_cyccnt_works >= 0)
+        return _cyccnt_works;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    uint32_t start = DWT->CYCCNT;
+    _delay_loop(16);
+    _cyccnt_works = DWT->CYCCNT != start;
+
+    return _cyccnt_works;
+}
+
+void delay_us(uint32_t us)
+{
+    uint32_t cycles = us * (SystemCoreClock / 1000000);
+
+    if (!_cyccnt_start())
+    {
+        _delay_loop(cycles / LOOP_CYCLES);
+        return;
+    }
+
+    /* unsigned subtraction copes with the counter wrapping */
+    uint32_t start = DWT->CYCCNT;
+    while (DWT->CYCCNT - start < cycles)
+        ;
+}
+
+void delay_large(uint16_t ms)
+{
+    /* a millisecond at a time so the cycle count can't overflow */
+    while (ms--)
+        delay_us(1000);
+}
+
+/*
+ * Free running core cycle count, for timing things.
+ * Always 0 if the counter doesn't run
+ */
+/* Ticks in, plus how far SysTick is into the next. Tickless idle reloads
+ * it for longer sleeps, and steps the tick count for them after */
+static uint32_t _systick_cycles(void)
+{
+    uint32_t per_tick = SystemCoreClock / configTICK_RATE_HZ;
+    TickType_t ticks;
+    uint32_t into;
+
+    if (!(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk))
+        return 0;
+
+    do
+    {
+        ticks = xTaskGetTickCount();
+        into = SysTick->LOAD == per_tick - 1 ? per_tick - 1 - SysTick->VAL : 0;
+    } while (ticks != xTaskGetTickCount());
+
+    return ticks * per_tick + into;
+}
+
+uint32_t hw_cycle_count(void)
+{
+    if (!_cyccnt_start())
+        return _systick_cycles();
+
+    return DWT->CYCCNT;
+}
+
+/* For turning cycle counts into time, at the clock we run at now */
+uint32_t hw_cycles_per_us(void)
+{
+    return SystemCoreClock / 1000000;
+}
@@ -0,0 +1,17 @@
+/*
+ * stm32_delay.h
+ * Busy waits timed off the core clock
+ * RebbleOS
+ */
+
+#ifndef __STM32_DELAY_H
+#define __STM32_DELAY_H
+
+#include <stdint.h>
+
+void delay_us(uint32_t us);
+void delay_large(uint16_t ms);
+uint32_t hw_cycle_count(void);
+uint32_t hw_cycles_per_us(void);
+
+#endif
@@ -25,10 +25,15 @@
 #include "stm32_usart.h"
 #include "stm32_dma.h"
 #include "rebble_util.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+static void _mem_init(void);
 
 void hw_dma_init(void)
 {
-    
+    _mem_init();
 }
 
 static void _init_dma(stm32_dma_t *dma);
@@ -78,6 +83,8 @@ void stm32_dma_tx_disable(stm32_dma_t *dma)
     stm32_power_release(STM32_POWER_AHB1, dma->dma_clock);
 }
 
+static void _tx_init(stm32_dma_t *dma, void *periph_address, uint8_t *data, size_t len, uint8_t single_byte, uint32_t mode);
+
 /*
  * Initialise the DMA channel, and set the data pointers
  * NOTE: This will not send data yet
@@ -85,7 +92,26 @@ void stm32_dma_tx_disable(stm32_dma_t *dma)
 void stm32_dma_tx_init(stm32_dma_t *dma, void *periph_address, uint8_t *data, size_t len, uint8_t single_byte)
 {
     stm32_power_request(STM32_POWER_AHB1, dma->dma_clock);
+    _tx_init(dma, periph_address, data, len, single_byte, DMA_Mode_Normal);
+}
+
+/*
+ * Double buffered. The stream sends buf0, then buf1, then buf0 again and
+ * so on for ever, flipping between them in hardware with no gap, and
+ * interrupts at the end of each. While one is going out the other is the
+ * caller's to refill, or swap for another with stm32_dma_tx_retarget.
+ * The clock is the caller's to hold for as long as it runs, and it is
+ * stopped with stm32_dma_tx_disable
+ */
+void stm32_dma_tx_init_double(stm32_dma_t *dma, void *periph_address, uint8_t *buf0, uint8_t *buf1, size_t len)
+{
+    _tx_init(dma, periph_address, buf0, len, 0, DMA_Mode_Circular);
+    DMA_DoubleBufferModeConfig(dma->dma_tx_stream, (uint32_t)buf1, DMA_Memory_0);
+    DMA_DoubleBufferModeCmd(dma->dma_tx_stream, ENABLE);
+}
 
+static void _tx_init(stm32_dma_t *dma, void *periph_address, uint8_t *data, size_t len, uint8_t single_byte, uint32_t mode)
+{
     DMA_InitTypeDef dma_init_struct;
 
     /* Configure DMA controller to manage TX DMA requests */
@@ -99,7 +125,7 @@ void stm32_dma_tx_init(stm32_dma_t *dma, void *periph_address, uint8_t *data, si
     dma_init_struct.DMA_BufferSize = len;
     dma_init_struct.DMA_DIR = DMA_DIR_MemoryToPeripheral;
     dma_init_struct.DMA_MemoryInc =  single_byte == 1 ? DMA_MemoryInc_Disable : DMA_MemoryInc_Enable;
-    dma_init_struct.DMA_Mode = DMA_Mode_Normal;
+    dma_init_struct.DMA_Mode = mode;
     dma_init_struct.DMA_PeripheralInc  = DMA_PeripheralInc_Disable;
     dma_init_struct.DMA_FIFOMode  = DMA_FIFOMode_Disable;
     dma_init_struct.DMA_FIFOThreshold = DMA_FIFOThreshold_1QuarterFull;
@@ -135,6 +161,8 @@ void stm32_dma_rx_disable(stm32_dma_t *dma)
     stm32_power_release(STM32_POWER_AHB1, dma->dma_clock);
 }
 
+static void _rx_init(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_t len, uint32_t mode, uint8_t mem_inc);
+
 /*
  * Initialise the DMA channel for RX, and set the data pointers
  * NOTE: This will not receive data yet
@@ -142,7 +170,90 @@ void stm32_dma_rx_disable(stm32_dma_t *dma)
 void stm32_dma_rx_init(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_t len)
 {
     stm32_power_request(STM32_POWER_AHB1, dma->dma_clock);
+    _rx_init(dma, periph_addr, data, len, DMA_Mode_Normal, 1);
+    DMA_ITConfig(dma->dma_rx_stream, DMA_IT_TC, ENABLE);
+}
+
+/*
+ * RX that nobody wants, the replies to a TX on a full duplex bus. Into
+ * the one byte, over and over, just for the completion
+ */
+void stm32_dma_rx_init_discard(stm32_dma_t *dma, void *periph_addr, size_t len)
+{
+    static uint8_t discard;
+
+    stm32_power_request(STM32_POWER_AHB1, dma->dma_clock);
+    _rx_init(dma, periph_addr, &discard, len, DMA_Mode_Normal, 0);
+    DMA_ITConfig(dma->dma_rx_stream, DMA_IT_TC, ENABLE);
+}
+
+/*
+ * The same, but round and round the buffer for ever, with an interrupt
+ * at each half. The clock is the caller's to hold for as long as it runs
+ */
+void stm32_dma_rx_init_circular(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_t len)
+{
+    _rx_init(dma, periph_addr, data, len, DMA_Mode_Circular, 1);
+    DMA_ITConfig(dma->dma_rx_stream, DMA_IT_HT | DMA_IT_TC, ENABLE);
+}
+
+/*
+ * Double buffered RX, as for TX above: buf0 fills, then buf1, then buf0
+ * again, with an interrupt as each is full. By then the DMA is writing
+ * the other, and the full one is the caller's until it comes round again
+ */
+void stm32_dma_rx_init_double(stm32_dma_t *dma, void *periph_addr, uint8_t *buf0, uint8_t *buf1, size_t len)
+{
+    _rx_init(dma, periph_addr, buf0, len, DMA_Mode_Circular, 1);
+    DMA_DoubleBufferModeConfig(dma->dma_rx_stream, (uint32_t)buf1, DMA_Memory_0);
+    DMA_DoubleBufferModeCmd(dma->dma_rx_stream, ENABLE);
+    DMA_ITConfig(dma->dma_rx_stream, DMA_IT_TC, ENABLE);
+}
+
+/*
+ * Which of a double buffered stream's two buffers the DMA is on, 0 or 1.
+ * The other is the one that just finished
+ */
+uint8_t stm32_dma_tx_target(stm32_dma_t *dma)
+{
+    return DMA_GetCurrentMemoryTarget(dma->dma_tx_stream);
+}
 
+uint8_t stm32_dma_rx_target(stm32_dma_t *dma)
+{
+    return DMA_GetCurrentMemoryTarget(dma->dma_rx_stream);
+}
+
+/*
+ * Point the buffer the DMA isn't on at another, same length. It takes
+ * effect when the DMA next flips to it, so do it before then
+ */
+void stm32_dma_tx_retarget(stm32_dma_t *dma, uint8_t *buf)
+{
+    uint32_t idle = DMA_GetCurrentMemoryTarget(dma->dma_tx_stream) ? DMA_Memory_0 : DMA_Memory_1;
+    DMA_MemoryTargetConfig(dma->dma_tx_stream, (uint32_t)buf, idle);
+}
+
+void stm32_dma_rx_retarget(stm32_dma_t *dma, uint8_t *buf)
+{
+    uint32_t idle = DMA_GetCurrentMemoryTarget(dma->dma_rx_stream) ? DMA_Memory_0 : DMA_Memory_1;
+    DMA_MemoryTargetConfig(dma->dma_rx_stream, (uint32_t)buf, idle);
+}
+
+/* how far through the buffer a circular RX has got */
+size_t stm32_dma_rx_pos(stm32_dma_t *dma, size_t len)
+{
+    return (len - DMA_GetCurrDataCounter(dma->dma_rx_stream)) % len;
+}
+
+/* a circular RX's half or full. Cleared whichever it was */
+void stm32_dma_rx_circular_isr(stm32_dma_t *dma)
+{
+    DMA_ClearFlag(dma->dma_rx_stream, dma->dma_rx_channel_flags);
+}
+
+static void _rx_init(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_t len, uint32_t mode, uint8_t mem_inc)
+{
     DMA_InitTypeDef dma_init_struct;
     
     /* Configure DMA controller to manage RX DMA requests */
@@ -153,11 +264,11 @@ void stm32_dma_rx_init(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_
     dma_init_struct.DMA_PeripheralBaseAddr = (uint32_t)periph_addr;
     dma_init_struct.DMA_Channel = dma->dma_rx_channel;
     dma_init_struct.DMA_DIR = DMA_DIR_PeripheralToMemory;
-    dma_init_struct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    dma_init_struct.DMA_MemoryInc = mem_inc ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
     dma_init_struct.DMA_Memory0BaseAddr = (uint32_t)data;
     dma_init_struct.DMA_BufferSize = len;
     dma_init_struct.DMA_PeripheralInc  = DMA_PeripheralInc_Disable;
-    dma_init_struct.DMA_Mode = DMA_Mode_Normal;
+    dma_init_struct.DMA_Mode = mode;
     dma_init_struct.DMA_FIFOMode  = DMA_FIFOMode_Disable;
     dma_init_struct.DMA_FIFOThreshold = DMA_FIFOThreshold_1QuarterFull;
     dma_init_struct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
@@ -167,7 +278,6 @@ void stm32_dma_rx_init(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_
     DMA_Init(dma->dma_rx_stream, &dma_init_struct);
 
     NVIC_EnableIRQ(dma->dma_irq_rx_channel);
-    DMA_ITConfig(dma->dma_rx_stream, DMA_IT_TC, ENABLE);
 }
 
 /*
@@ -207,3 +317,258 @@ uint8_t stm32_dma_tx_isr(stm32_dma_t *dma)
     }
     return 0;
 }
+
+/*
+ * Memory to memory, on a DMA2 stream nobody else has (DMA1 can't do it).
+ *
+ * One transfer at a time. The async calls run the callback from the
+ * ISR once it's all there; the sync ones put the calling task to sleep
+ * until then, so the CPU is free for everyone else, and are what a big
+ * memcpy or memset is handed to. Anything that can't be done here (CCM
+ * RAM isn't on the DMA's bus, an ISR can't sleep, the stream is busy)
+ * is refused, and the caller does it by hand.
+ *
+ * The head is copied by hand up to a word boundary of the destination,
+ * and so is the odd tail. A source that isn't aligned is read a byte at
+ * a time and packed into words by the FIFO.
+ */
+#define MEM_DMA_STREAM      DMA2_Stream1
+#define MEM_DMA_IRQ         DMA2_Stream1_IRQn
+#define MEM_DMA_FLAGS       STM32_DMA_MK_FLAGS(1)
+#define MEM_DMA_ERRORS      (DMA_FLAG_TEIF1 | DMA_FLAG_DMEIF1)
+/* NDTR is 16 bits, of whatever the source side moves */
+#define MEM_DMA_MAX_ITEMS   0xFFFC
+#define CCMRAM_START        0x10000000
+#define CCMRAM_END          0x10010000
+
+static volatile uint8_t _mem_busy;
+static StaticSemaphore_t _mem_done_buf;
+static SemaphoreHandle_t _mem_done;
+
+/* the transfer in flight, re-armed from the ISR until it's all done */
+static uint8_t *_mem_dest;
+static const uint8_t *_mem_src;
+static size_t _mem_left;
+static uint8_t _mem_fill;
+static uint32_t _mem_pattern;
+static stm32_dma_mem_callback _mem_callback;
+static void *_mem_priv;
+
+static void _mem_init(void)
+{
+    NVIC_InitTypeDef nvic_init_struct;
+
+    _mem_done = xSemaphoreCreateBinaryStatic(&_mem_done_buf);
+
+    nvic_init_struct.NVIC_IRQChannel = MEM_DMA_IRQ;
+    nvic_init_struct.NVIC_IRQChannelPreemptionPriority = 6;  // must be > 5
+    nvic_init_struct.NVIC_IRQChannelSubPriority = 0;
+    nvic_init_struct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic_init_struct);
+}
+
+static uint8_t _mem_reachable(const void *p, size_t len)
+{
+    return (uint32_t)p + len <= CCMRAM_START || (uint32_t)p >= CCMRAM_END;
+}
+
+/* The next stretch, the most one go can do */
+static void _mem_start(void)
+{
+    DMA_InitTypeDef dma_init_struct;
+    uint8_t bytewise = !_mem_fill && ((uint32_t)_mem_src & 3);
+    size_t items = bytewise ? _mem_left : _mem_left / 4;
+
+    if (items > MEM_DMA_MAX_ITEMS)
+        items = MEM_DMA_MAX_ITEMS;
+
+    DMA_DeInit(MEM_DMA_STREAM);
+    DMA_ClearFlag(MEM_DMA_STREAM, MEM_DMA_FLAGS);
+
+    DMA_StructInit(&dma_init_struct);
+    dma_init_struct.DMA_Channel = DMA_Channel_0;
+    /* memory to memory reads from the peripheral side */
+    dma_init_struct.DMA_PeripheralBaseAddr = _mem_fill ? (uint32_t)&_mem_pattern : (uint32_t)_mem_src;
+    dma_init_struct.DMA_Memory0BaseAddr = (uint32_t)_mem_dest;
+    dma_init_struct.DMA_DIR = DMA_DIR_MemoryToMemory;
+    dma_init_struct.DMA_BufferSize = items;
+    dma_init_struct.DMA_PeripheralInc = _mem_fill ? DMA_PeripheralInc_Disable : DMA_PeripheralInc_Enable;
+    dma_init_struct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    dma_init_struct.DMA_PeripheralDataSize = bytewise ? DMA_PeripheralDataSize_Byte : DMA_PeripheralDataSize_Word;
+    dma_init_struct.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+    dma_init_struct.DMA_Mode = DMA_Mode_Normal;
+    dma_init_struct.DMA_Priority = DMA_Priority_Low;
+    /* memory to memory has to go through the FIFO */
+    dma_init_struct.DMA_FIFOMode = DMA_FIFOMode_Enable;
+    dma_init_struct.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+    dma_init_struct.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+    dma_init_struct.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+    DMA_Init(MEM_DMA_STREAM, &dma_init_struct);
+
+    items *= bytewise ? 1 : 4;
+    _mem_dest += items;
+    if (!_mem_fill)
+        _mem_src += items;
+    _mem_left -= items;
+
+    DMA_ITConfig(MEM_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+    DMA_Cmd(MEM_DMA_STREAM, ENABLE);
+}
+
+/* From anywhere, ISRs included */
+static uint8_t _mem_claim(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint8_t was;
+
+    __disable_irq();
+    was = _mem_busy;
+    _mem_busy = 1;
+    __set_PRIMASK(primask);
+
+    return !was;
+}
+
+static uint8_t _mem_begin(void *dest, const void *src, uint8_t fill, uint8_t c, size_t len,
+                          stm32_dma_mem_callback callback, void *priv)
+{
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+
+    if (!_mem_done || !_mem_reachable(dest, len) || (!fill && !_mem_reachable(src, len)))
+        return 0;
+    if (!_mem_claim())
+        return 0;
+
+    /* by hand to a word boundary of the destination, and the tail */
+    while ((uint32_t)d & 3)
+    {
+        *d++ = fill ? c : *s++;
+        len--;
+    }
+    for (size_t i = len & ~3; i < len; i++)
+        d[i] = fill ? c : s[i];
+    len &= ~3;
+
+    _mem_dest = d;
+    _mem_src = s;
+    _mem_left = len;
+    _mem_fill = fill;
+    _mem_pattern = c * 0x01010101u;
+    _mem_callback = callback;
+    _mem_priv = priv;
+
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    _mem_start();
+
+    return 1;
+}
+
+/*
+ * Start a copy, and call back from the ISR once it's all there. 0 if it
+ * can't be done here, and nothing was touched
+ */
+uint8_t stm32_dma_mem_copy_async(void *dest, const void *src, size_t len,
+                                 stm32_dma_mem_callback callback, void *priv)
+{
+    if (len < 8)
+        return 0;
+    return _mem_begin(dest, src, 0, 0, len, callback, priv);
+}
+
+uint8_t stm32_dma_mem_set_async(void *dest, uint8_t c, size_t len,
+                                stm32_dma_mem_callback callback, void *priv)
+{
+    if (len < 8)
+        return 0;
+    return _mem_begin(dest, NULL, 1, c, len, callback, priv);
+}
+
+/* Only from a task that can sleep: not an ISR, nor a critical section */
+static uint8_t _mem_can_sleep(void)
+{
+    return !__get_IPSR() && !__get_PRIMASK() && !__get_BASEPRI() &&
+           xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+static void _mem_wake(void *priv)
+{
+    BaseType_t woken = pdFALSE;
+
+    xSemaphoreGiveFromISR(_mem_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/*
+ * The same, sleeping until it's done. 0 if it couldn't be done here
+ */
+uint8_t stm32_dma_mem_copy(void *dest, const void *src, size_t len)
+{
+    if (!_mem_can_sleep() || !stm32_dma_mem_copy_async(dest, src, len, _mem_wake, NULL))
+        return 0;
+    xSemaphoreTake(_mem_done, portMAX_DELAY);
+    return 1;
+}
+
+uint8_t stm32_dma_mem_set(void *dest, uint8_t c, size_t len)
+{
+    if (!_mem_can_sleep() || !stm32_dma_mem_set_async(dest, c, len, _mem_wake, NULL))
+        return 0;
+    xSemaphoreTake(_mem_done, portMAX_DELAY);
+    return 1;
+}
+
+/* minilib's memcpy and memset hand big ones over here */
+int _memcpy_offload(void *dest, const void *src, int bytes)
+{
+    return stm32_dma_mem_copy(dest, src, bytes);
+}
+
+int _memset_offload(void *dest, int data, int bytes)
+{
+    return stm32_dma_mem_set(dest, data, bytes);
+}
+
+void DMA2_Stream1_IRQHandler(void)
+{
+    traceISR_ENTER();
+
+    if (DMA_GetFlagStatus(MEM_DMA_STREAM, MEM_DMA_ERRORS & ~DMA_FLAG_FEIF1) != RESET)
+    {
+        /* shouldn't happen, but the caller still wants it done */
+        DMA_Cmd(MEM_DMA_STREAM, DISABLE);
+        uint32_t left = DMA_GetCurrDataCounter(MEM_DMA_STREAM);
+        uint32_t size = (MEM_DMA_STREAM->CR & DMA_SxCR_PSIZE) ? 4 : 1;
+        _mem_dest -= left * size;
+        if (!_mem_fill)
+            _mem_src -= left * size;
+        _mem_left += left * size;
+        for (size_t i = 0; i < _mem_left; i++)
+            _mem_dest[i] = _mem_fill ? (uint8_t)_mem_pattern : _mem_src[i];
+        _mem_left = 0;
+    }
+    else if (DMA_GetITStatus(MEM_DMA_STREAM, DMA_IT_TCIF1) == RESET)
+    {
+        traceISR_EXIT();
+        return;
+    }
+
+    DMA_ClearFlag(MEM_DMA_STREAM, MEM_DMA_FLAGS);
+
+    if (_mem_left)
+    {
+        _mem_start();
+        traceISR_EXIT();
+        return;
+    }
+
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    /* free before the callback, which may well start the next */
+    stm32_dma_mem_callback callback = _mem_callback;
+    void *priv = _mem_priv;
+    _mem_busy = 0;
+    if (callback)
+        callback(priv);
+
+    traceISR_EXIT();
+}
@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include "sched_trace.h"
+
 #define STM32_DMA_MK_FLAGS(CHAN) DMA_FLAG_FEIF##CHAN|DMA_FLAG_DMEIF##CHAN|DMA_FLAG_TEIF##CHAN|DMA_FLAG_HTIF##CHAN|DMA_FLAG_TCIF##CHAN
 
 
@@ -29,36 +31,60 @@ const typedef struct {
 } stm32_dma_t;
 
 typedef void (*dma_callback)(void);
+/* from the ISR, once a memory to memory transfer is all done */
+typedef void (*stm32_dma_mem_callback)(void *priv);
 
    
 void stm32_dma_init_device(stm32_dma_t *dma);
 void stm32_dma_tx_disable(stm32_dma_t *dma);
 void stm32_dma_tx_init(stm32_dma_t *dma, void *periph_address, uint8_t *data, size_t len, uint8_t mem_inc);
 void stm32_dma_tx_begin(stm32_dma_t *dma);
+void stm32_dma_tx_init_double(stm32_dma_t *dma, void *periph_address, uint8_t *buf0, uint8_t *buf1, size_t len);
+uint8_t stm32_dma_tx_target(stm32_dma_t *dma);
+void stm32_dma_tx_retarget(stm32_dma_t *dma, uint8_t *buf);
 
 void stm32_dma_rx_disable(stm32_dma_t *dma);
 void stm32_dma_rx_init(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_t len);
+void stm32_dma_rx_init_discard(stm32_dma_t *dma, void *periph_addr, size_t len);
 void stm32_dma_rx_begin(stm32_dma_t *dma);
+void stm32_dma_rx_init_circular(stm32_dma_t *dma, void *periph_addr, uint8_t *data, size_t len);
+size_t stm32_dma_rx_pos(stm32_dma_t *dma, size_t len);
+void stm32_dma_rx_circular_isr(stm32_dma_t *dma);
+void stm32_dma_rx_init_double(stm32_dma_t *dma, void *periph_addr, uint8_t *buf0, uint8_t *buf1, size_t len);
+uint8_t stm32_dma_rx_target(stm32_dma_t *dma);
+void stm32_dma_rx_retarget(stm32_dma_t *dma, uint8_t *buf);
 uint8_t stm32_dma_rx_isr(stm32_dma_t *dma);
 uint8_t stm32_dma_tx_isr(stm32_dma_t *dma);
 
+void hw_dma_init(void);
+uint8_t stm32_dma_mem_copy_async(void *dest, const void *src, size_t len,
+                                 stm32_dma_mem_callback callback, void *priv);
+uint8_t stm32_dma_mem_set_async(void *dest, uint8_t c, size_t len,
+                                stm32_dma_mem_callback callback, void *priv);
+uint8_t stm32_dma_mem_copy(void *dest, const void *src, size_t len);
+uint8_t stm32_dma_mem_set(void *dest, uint8_t c, size_t len);
+
 #define STM32_DMA_MK_TX_IRQ_HANDLER(dma_t, dma_channel, dma_stream, callback) \
     void DMA ## dma_channel ## _Stream ## dma_stream ## _IRQHandler(void) \
     { \
+        traceISR_ENTER(); \
         if(stm32_dma_tx_isr(dma_t)) { \
             callback  (); \
             stm32_power_release(STM32_POWER_AHB1, dma_t->dma_clock); \
         } \
+        traceISR_EXIT(); \
     }
 
 
 #define STM32_DMA_MK_RX_IRQ_HANDLER(dma_t, dma_channel, dma_stream, callback) \
     void DMA ## dma_channel ## _Stream ## dma_stream ## _IRQHandler(void) \
     { \
+        traceISR_ENTER(); \
         if(stm32_dma_rx_isr(dma_t)) { \
             callback  (); \
             stm32_power_release(STM32_POWER_AHB1, dma_t->dma_clock); \
         } \
+        traceISR_EXIT(); \
     }
 
 
@@ -0,0 +1,3 @@
+CFLAGS_driver_stm32_dma2d = -Ihw/drivers/stm32_dma2d
+
+SRCS_driver_stm32_dma2d = hw/drivers/stm32_dma2d/stm32_dma2d.c
@@ -0,0 +1,174 @@
+/* stm32_dma2d.c
+ * Rect fill and copy offload onto the Chrom-ART (DMA2D) engine
+ * RebbleOS
+ *
+ * DMA2D has no 8-bit output format, and our framebuffer is 8bpp ARGB2222.
+ * For plain fills and GCompOpAssign copies we don't need any conversion,
+ * so we lie to it and move pixel pairs as RGB565. The odd column at either
+ * edge of the rect is done by the CPU while the engine runs.
+ *
+ * Anything involving blending has to stay in software.
+ */
+#if defined(STM32F4XX)
+#    include "stm32f4xx.h"
+#    include <stm32f4xx_dma2d.h>
+#else
+#    error "DMA2D is only on the stm32f4 parts"
+#endif
+#include <assert.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "stm32_power.h"
+#include "log.h"
+#include "stm32_dma2d.h"
+
+/* Below this the setup costs more than the CPU just doing it */
+#define DMA2D_MIN_PIXELS 256
+
+/* The engine can't see CCM, so anything there is ours to do */
+#define CCMRAM_START 0x10000000
+#define CCMRAM_END   (CCMRAM_START + 64 * 1024)
+
+static SemaphoreHandle_t _dma2d_mutex;
+static StaticSemaphore_t _dma2d_mutex_buf;
+
+void hw_gfx_init(void)
+{
+    _dma2d_mutex = xSemaphoreCreateMutexStatic(&_dma2d_mutex_buf);
+}
+
+static uint8_t _is_reachable(const uint8_t *buf, uint16_t stride, uint16_t height)
+{
+    uint32_t start = (uint32_t)buf;
+    uint32_t end = start + stride * height;
+
+    return end <= CCMRAM_START || start >= CCMRAM_END;
+}
+
+static void _dma2d_start(void)
+{
+    DMA2D_ClearFlag(DMA2D_FLAG_TC | DMA2D_FLAG_TE | DMA2D_FLAG_CE);
+    DMA2D_StartTransfer();
+}
+
+static void _dma2d_wait(void)
+{
+    while (DMA2D_GetFlagStatus(DMA2D_FLAG_TC) == RESET)
+        assert(DMA2D_GetFlagStatus(DMA2D_FLAG_TE | DMA2D_FLAG_CE) == RESET && "DMA2D transfer error");
+    DMA2D_ClearFlag(DMA2D_FLAG_TC);
+}
+
+/*
+ * Fill a width x height rect at dst with color.
+ * Returns 0 if the caller should do it in software instead.
+ */
+uint8_t hw_gfx_fill(uint8_t *dst, uint16_t dst_stride, uint16_t width, uint16_t height, uint8_t color)
+{
+    DMA2D_InitTypeDef init;
+
+    if (!_dma2d_mutex || width * height < DMA2D_MIN_PIXELS || (dst_stride & 1))
+        return 0;
+    if (!_is_reachable(dst, dst_stride, height))
+        return 0;
+
+    uint8_t lead = (uint32_t)dst & 1;
+    uint16_t pairs = (width - lead) / 2;
+    uint8_t trail = (width - lead) & 1;
+
+    if (!pairs)
+        return 0;
+
+    uint16_t pair_color = color | (color << 8);
+
+    xSemaphoreTake(_dma2d_mutex, portMAX_DELAY);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2D);
+
+    DMA2D_StructInit(&init);
+    init.DMA2D_Mode = DMA2D_R2M;
+    init.DMA2D_CMode = DMA2D_RGB565;
+    init.DMA2D_OutputBlue = pair_color & 0x1F;
+    init.DMA2D_OutputGreen = (pair_color >> 5) & 0x3F;
+    init.DMA2D_OutputRed = pair_color >> 11;
+    init.DMA2D_OutputMemoryAdd = (uint32_t)(dst + lead);
+    init.DMA2D_OutputOffset = (dst_stride - pairs * 2) / 2;
+    init.DMA2D_NumberOfLine = height;
+    init.DMA2D_PixelPerLine = pairs;
+    DMA2D_Init(&init);
+    _dma2d_start();
+
+    /* edges while we wait. The engine never touches these bytes */
+    for (uint16_t y = 0; y < height; y++)
+    {
+        uint8_t *row = dst + y * dst_stride;
+        if (lead)
+            row[0] = color;
+        if (trail)
+            row[width - 1] = color;
+    }
+
+    _dma2d_wait();
+
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2D);
+    xSemaphoreGive(_dma2d_mutex);
+
+    return 1;
+}
+
+/*
+ * Copy a width x height block of 8 bit pixels from src to dst.
+ * Source and destination must share byte alignment so we can
+ * pair the pixels up. Returns 0 if the caller should do it in software.
+ */
+uint8_t hw_gfx_copy(uint8_t *dst, uint16_t dst_stride, const uint8_t *src, uint16_t src_stride, uint16_t width, uint16_t height)
+{
+    DMA2D_InitTypeDef init;
+    DMA2D_FG_InitTypeDef fg;
+
+    if (!_dma2d_mutex || width * height < DMA2D_MIN_PIXELS)
+        return 0;
+    if ((dst_stride & 1) || (src_stride & 1) || (((uint32_t)dst ^ (uint32_t)src) & 1))
+        return 0;
+    if (!_is_reachable(dst, dst_stride, height) || !_is_reachable(src, src_stride, height))
+        return 0;
+
+    uint8_t lead = (uint32_t)dst & 1;
+    uint16_t pairs = (width - lead) / 2;
+    uint8_t trail = (width - lead) & 1;
+
+    if (!pairs)
+        return 0;
+
+    xSemaphoreTake(_dma2d_mutex, portMAX_DELAY);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2D);
+
+    DMA2D_StructInit(&init);
+    init.DMA2D_Mode = DMA2D_M2M;
+    init.DMA2D_CMode = DMA2D_RGB565;
+    init.DMA2D_OutputMemoryAdd = (uint32_t)(dst + lead);
+    init.DMA2D_OutputOffset = (dst_stride - pairs * 2) / 2;
+    init.DMA2D_NumberOfLine = height;
+    init.DMA2D_PixelPerLine = pairs;
+    DMA2D_Init(&init);
+
+    DMA2D_FG_StructInit(&fg);
+    fg.DMA2D_FGMA = (uint32_t)(src + lead);
+    fg.DMA2D_FGO = (src_stride - pairs * 2) / 2;
+    fg.DMA2D_FGCM = CM_RGB565;
+    DMA2D_FGConfig(&fg);
+    _dma2d_start();
+
+    for (uint16_t y = 0; y < height; y++)
+    {
+        if (lead)
+            dst[y * dst_stride] = src[y * src_stride];
+        if (trail)
+            dst[y * dst_stride + width - 1] = src[y * src_stride + width - 1];
+    }
+
+    _dma2d_wait();
+
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2D);
+    xSemaphoreGive(_dma2d_mutex);
+
+    return 1;
+}
@@ -0,0 +1,16 @@
+/*
+ * stm32_dma2d.h
+ * API for the Chrom-ART (DMA2D) 2D accelerator
+ * RebbleOS
+ */
+
+#ifndef __STM32_DMA2D_H
+#define __STM32_DMA2D_H
+
+#include <stdint.h>
+
+void hw_gfx_init(void);
+uint8_t hw_gfx_fill(uint8_t *dst, uint16_t dst_stride, uint16_t width, uint16_t height, uint8_t color);
+uint8_t hw_gfx_copy(uint8_t *dst, uint16_t dst_stride, const uint8_t *src, uint16_t src_stride, uint16_t width, uint16_t height);
+
+#endif
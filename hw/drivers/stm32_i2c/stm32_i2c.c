@@ -24,6 +24,12 @@
 #include "stm32_rtc.h"
 #include "log.h"
 #include "stm32_i2c.h"
+#include "task.h"
+
+/* How long a task waits on a transfer before giving up on the bus */
+#define I2C_XFER_TIMEOUT pdMS_TO_TICKS(20)
+
+#define I2C_IT_ALL (I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN)
 
 static uint32_t _i2c_write_byte(const stm32_i2c_conf_t *i2c_conf, uint8_t byte);
 static uint32_t _i2c_read_byte(const stm32_i2c_conf_t *i2c_conf, uint8_t *buf);
@@ -31,6 +37,8 @@ static uint32_t _i2c_addr(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_
 static uint32_t _i2c_start(const stm32_i2c_conf_t *i2c_conf);
 static uint8_t _i2c_wait_for_flags(const stm32_i2c_conf_t *i2c_conf, uint32_t Flags);
 static uint8_t _i2c_wait_idle(const stm32_i2c_conf_t *i2c_conf);
+static uint8_t _i2c_use_irq(const stm32_i2c_conf_t *i2c_conf);
+static uint8_t _i2c_xfer(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, const uint8_t *tx, uint16_t tx_len, uint8_t *rx, uint16_t rx_len);
 
 void i2c_init(const stm32_i2c_conf_t *i2c_conf)
 {
@@ -78,6 +86,22 @@ void i2c_init(const stm32_i2c_conf_t *i2c_conf)
 
     stm32_power_release(STM32_POWER_APB1, i2c_conf->i2c_clock);
     stm32_power_release(STM32_POWER_AHB1, i2c_conf->gpio_clock);
+
+    if (i2c_conf->state)
+    {
+        NVIC_InitTypeDef nvic_init_struct;
+        
+        i2c_conf->state->mutex = xSemaphoreCreateMutexStatic(&i2c_conf->state->mutex_buf);
+        i2c_conf->state->done = xSemaphoreCreateBinaryStatic(&i2c_conf->state->done_buf);
+        
+        nvic_init_struct.NVIC_IRQChannel = i2c_conf->irq_ev;
+        nvic_init_struct.NVIC_IRQChannelPreemptionPriority = 6;  // must be > 5
+        nvic_init_struct.NVIC_IRQChannelSubPriority = 0;
+        nvic_init_struct.NVIC_IRQChannelCmd = ENABLE;
+        NVIC_Init(&nvic_init_struct);
+        nvic_init_struct.NVIC_IRQChannel = i2c_conf->irq_er;
+        NVIC_Init(&nvic_init_struct);
+    }
 }
 
 void i2c_deinit(const stm32_i2c_conf_t *i2c_conf)
@@ -110,6 +134,9 @@ uint8_t i2c_write_reg(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t re
     buf[0] = reg;
     buf[1] = data;
     
+    if (_i2c_use_irq(i2c_conf))
+        return _i2c_xfer(i2c_conf, addr, buf, 2, NULL, 0);
+    
     stm32_power_request(STM32_POWER_AHB1, i2c_conf->gpio_clock);
     stm32_power_request(STM32_POWER_APB1, i2c_conf->i2c_clock);
     
@@ -123,6 +150,9 @@ uint8_t i2c_write_reg(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t re
 
 uint8_t i2c_read_reg(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t cnt)
 {
+    if (_i2c_use_irq(i2c_conf))
+        return _i2c_xfer(i2c_conf, addr, &reg, 1, buf, cnt) ? cnt : 0;
+
     stm32_power_request(STM32_POWER_APB1, i2c_conf->i2c_clock);
     stm32_power_request(STM32_POWER_AHB1, i2c_conf->gpio_clock);
 
@@ -150,6 +180,9 @@ uint8_t i2c_read_reg(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t reg
 
 uint32_t i2c_write_bytes(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t *buf, uint16_t cnt)
 {
+    if (_i2c_use_irq(i2c_conf))
+        return _i2c_xfer(i2c_conf, addr, buf, cnt, NULL, 0) ? cnt : 0;
+    
     if (_i2c_start(i2c_conf))
         return 0;
     
@@ -178,6 +211,9 @@ uint32_t i2c_write_bytes(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t
 
 uint32_t i2c_read_bytes(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t *buf, uint16_t cnt)
 {
+    if (_i2c_use_irq(i2c_conf))
+        return _i2c_xfer(i2c_conf, addr, NULL, 0, buf, cnt) ? cnt : 0;
+    
     if (_i2c_start(i2c_conf))
         return 0;
   
@@ -353,3 +389,193 @@ static uint8_t _i2c_wait_idle(const stm32_i2c_conf_t *i2c_conf)
     return 0;
 }
 
+/*
+ * Interrupt driven transfers. A transfer is an optional write, then an
+ * optional read after a repeated start, and the ISRs walk it through a
+ * byte at a time while the calling task sleeps. Tasks queue up on the
+ * bus mutex in priority order.
+ *
+ * The reads follow the "method 2" sequences in the reference manual:
+ * the last two or three bytes are taken on BTF, with the clock
+ * stretched, so the NACK and STOP always land on the right byte however
+ * late the interrupt is.
+ */
+static uint8_t _i2c_use_irq(const stm32_i2c_conf_t *i2c_conf)
+{
+    return i2c_conf->state &&
+           xTaskGetSchedulerState() == taskSCHEDULER_RUNNING &&
+           !is_interrupt_set();
+}
+
+static uint8_t _i2c_xfer(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, const uint8_t *tx, uint16_t tx_len, uint8_t *rx, uint16_t rx_len)
+{
+    stm32_i2c_state_t *st = i2c_conf->state;
+    I2C_TypeDef *i2c = i2c_conf->i2c_x;
+    uint8_t ok;
+    
+    if (!tx_len && !rx_len)
+        return 0;
+    
+    xSemaphoreTake(st->mutex, portMAX_DELAY);
+    stm32_power_request(STM32_POWER_APB1, i2c_conf->i2c_clock);
+    stm32_power_request(STM32_POWER_AHB1, i2c_conf->gpio_clock);
+    
+    /* the last STOP may still be going out */
+    _i2c_wait_idle(i2c_conf);
+    
+    st->addr = addr;
+    st->tx = tx;
+    st->tx_len = tx_len;
+    st->rx = rx;
+    st->rx_len = rx_len;
+    st->reading = !tx_len;
+    st->error = 0;
+    xSemaphoreTake(st->done, 0);
+    
+    i2c->CR1 |= I2C_CR1_ACK;
+    i2c->CR1 &= ~I2C_CR1_POS;
+    i2c->CR2 |= I2C_IT_ALL;
+    i2c->CR1 |= I2C_CR1_START;
+    
+    ok = xSemaphoreTake(st->done, I2C_XFER_TIMEOUT) == pdTRUE;
+    if (!ok)
+    {
+        i2c->CR2 &= ~I2C_IT_ALL;
+        i2c->CR1 |= I2C_CR1_STOP;
+        DRV_LOG("I2C", APP_LOG_LEVEL_ERROR, "Timeout talking to %x", addr);
+    }
+    else if (st->error)
+    {
+        DRV_LOG("I2C", APP_LOG_LEVEL_ERROR, "Bus Error talking to %x", addr);
+        ok = 0;
+    }
+    
+    stm32_power_release_lazy(STM32_POWER_APB1, i2c_conf->i2c_clock);
+    stm32_power_release_lazy(STM32_POWER_AHB1, i2c_conf->gpio_clock);
+    xSemaphoreGive(st->mutex);
+    
+    return ok;
+}
+
+static void _i2c_xfer_done(const stm32_i2c_conf_t *i2c_conf, uint8_t error)
+{
+    BaseType_t woken = pdFALSE;
+    I2C_TypeDef *i2c = i2c_conf->i2c_x;
+    
+    i2c->CR2 &= ~I2C_IT_ALL;
+    i2c->CR1 |= I2C_CR1_ACK;
+    i2c->CR1 &= ~I2C_CR1_POS;
+    i2c_conf->state->error = error;
+    xSemaphoreGiveFromISR(i2c_conf->state->done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void stm32_i2c_ev_isr(const stm32_i2c_conf_t *i2c_conf)
+{
+    stm32_i2c_state_t *st = i2c_conf->state;
+    I2C_TypeDef *i2c = i2c_conf->i2c_x;
+    uint16_t sr1 = i2c->SR1;
+    
+    if (sr1 & I2C_SR1_SB)
+    {
+        i2c->DR = (st->addr << 1) | (st->reading ? I2C_Direction_Receiver : I2C_Direction_Transmitter);
+        return;
+    }
+    
+    if (sr1 & I2C_SR1_ADDR)
+    {
+        if (st->reading && st->rx_len == 1)
+        {
+            /* NACK it, and STOP once ADDR is cleared */
+            i2c->CR1 &= ~I2C_CR1_ACK;
+            (void)i2c->SR2;
+            i2c->CR1 |= I2C_CR1_STOP;
+            return;
+        }
+        if (st->reading && st->rx_len == 2)
+        {
+            /* NACK the second, then both come in on BTF */
+            i2c->CR1 &= ~I2C_CR1_ACK;
+            i2c->CR1 |= I2C_CR1_POS;
+            (void)i2c->SR2;
+            i2c->CR2 &= ~I2C_CR2_ITBUFEN;
+            return;
+        }
+        (void)i2c->SR2;
+        if (st->reading && st->rx_len == 3)
+            i2c->CR2 &= ~I2C_CR2_ITBUFEN;
+        return;
+    }
+    
+    if (!st->reading)
+    {
+        if ((sr1 & I2C_SR1_TXE) && st->tx_len)
+        {
+            i2c->DR = *st->tx++;
+            /* the last one is out when BTF says so */
+            if (!--st->tx_len)
+                i2c->CR2 &= ~I2C_CR2_ITBUFEN;
+            return;
+        }
+        if (sr1 & I2C_SR1_BTF)
+        {
+            if (st->rx_len)
+            {
+                st->reading = 1;
+                i2c->CR2 |= I2C_CR2_ITBUFEN;
+                i2c->CR1 |= I2C_CR1_START;
+                return;
+            }
+            i2c->CR1 |= I2C_CR1_STOP;
+            _i2c_xfer_done(i2c_conf, 0);
+        }
+        return;
+    }
+    
+    if (st->rx_len == 1)
+    {
+        if (sr1 & I2C_SR1_RXNE)
+        {
+            *st->rx++ = i2c->DR;
+            st->rx_len = 0;
+            _i2c_xfer_done(i2c_conf, 0);
+        }
+    }
+    else if (st->rx_len == 2)
+    {
+        /* last two in DR and the shifter, clock held */
+        if (sr1 & I2C_SR1_BTF)
+        {
+            i2c->CR1 |= I2C_CR1_STOP;
+            *st->rx++ = i2c->DR;
+            *st->rx++ = i2c->DR;
+            st->rx_len = 0;
+            _i2c_xfer_done(i2c_conf, 0);
+        }
+    }
+    else if (st->rx_len == 3)
+    {
+        /* NACK goes on the last, as we take the third from last */
+        if (sr1 & I2C_SR1_BTF)
+        {
+            i2c->CR1 &= ~I2C_CR1_ACK;
+            *st->rx++ = i2c->DR;
+            st->rx_len--;
+        }
+    }
+    else if (sr1 & I2C_SR1_RXNE)
+    {
+        *st->rx++ = i2c->DR;
+        if (--st->rx_len == 3)
+            i2c->CR2 &= ~I2C_CR2_ITBUFEN;
+    }
+}
+
+void stm32_i2c_er_isr(const stm32_i2c_conf_t *i2c_conf)
+{
+    I2C_TypeDef *i2c = i2c_conf->i2c_x;
+    
+    i2c->SR1 &= ~(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR);
+    i2c->CR1 |= I2C_CR1_STOP;
+    _i2c_xfer_done(i2c_conf, 1);
+}
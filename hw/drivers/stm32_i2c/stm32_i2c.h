@@ -6,8 +6,33 @@
  * Author: Barry Carter <barry.carter@gmail.com>
  */
 
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+/**
+ * @brief state of a bus driven from its interrupts. Owned by the driver,
+ * the platform only provides the storage
+ */
+typedef struct stm32_i2c_state
+{
+    SemaphoreHandle_t mutex;
+    StaticSemaphore_t mutex_buf;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buf;
+    uint8_t addr;
+    const uint8_t *tx;
+    uint16_t tx_len;
+    uint8_t *rx;
+    uint16_t rx_len;
+    volatile uint8_t reading;
+    volatile uint8_t error;
+} stm32_i2c_state_t;
+
 /**
  * @brief structure defining the settings for an I2C connection
+ * Give it a state and the two IRQs, and route the IRQ handlers to
+ * @ref stm32_i2c_ev_isr and @ref stm32_i2c_er_isr, and transfers from
+ * tasks sleep while the bus works. Without, they poll as before
  */
 typedef struct
 {
@@ -20,6 +45,9 @@ typedef struct
     uint16_t gpio_pin_sda;
     uint8_t gpio_pinsource_scl;
     uint8_t gpio_pinsource_sda;
+    IRQn_Type irq_ev;
+    IRQn_Type irq_er;
+    stm32_i2c_state_t *state;
 } stm32_i2c_conf_t;
 
 /**
@@ -77,3 +105,15 @@ uint8_t i2c_read_reg(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t reg
  * @return number of read bytes
  */
 uint32_t i2c_read_bytes(const stm32_i2c_conf_t *i2c_conf, uint8_t addr, uint8_t *buf, uint16_t cnt);
+
+/**
+ * @brief I2C event interrupt. Call from the bus's I2Cx_EV_IRQHandler
+ * @param i2c_conf @ref stm_i2c_conf_t struct
+ */
+void stm32_i2c_ev_isr(const stm32_i2c_conf_t *i2c_conf);
+
+/**
+ * @brief I2C error interrupt. Call from the bus's I2Cx_ER_IRQHandler
+ * @param i2c_conf @ref stm_i2c_conf_t struct
+ */
+void stm32_i2c_er_isr(const stm32_i2c_conf_t *i2c_conf);
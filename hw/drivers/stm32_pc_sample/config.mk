@@ -0,0 +1,3 @@
+CFLAGS_driver_stm32_pc_sample = -Ihw/drivers/stm32_pc_sample
+
+SRCS_driver_stm32_pc_sample = hw/drivers/stm32_pc_sample/stm32_pc_sample.c
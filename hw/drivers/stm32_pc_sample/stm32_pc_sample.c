@@ -0,0 +1,120 @@
+/* stm32_pc_sample.c
+ * Where the CPU was, a few thousand times a second, for the profiler
+ * RebbleOS
+ *
+ * TIM5 interrupts at the rate asked for, and the handler reads the PC
+ * that was stacked on the way in, off whichever stack it went on. It runs
+ * above configMAX_SYSCALL_INTERRUPT_PRIORITY, so it sees inside critical
+ * sections and the handlers that the kernel masks, which is where a lot
+ * of the time goes; the price is that nothing it calls may touch the
+ * kernel.
+ *
+ * The timer stops in STOP mode along with everything else, so time asleep
+ * isn't sampled; only time awake is shared out.
+ */
+#if defined(STM32F4XX)
+#    include "stm32f4xx.h"
+#    include "stm32f4xx_tim.h"
+#elif defined(STM32F2XX)
+#    include "stm32f2xx.h"
+#    include "stm32f2xx_tim.h"
+#    include "stm32f2xx_rcc.h"
+#    include "misc.h"
+#else
+#    error "I have no idea what kind of stm32 this is; sorry"
+#endif
+#include <stddef.h>
+#include "stm32_power.h"
+#include "stm32_pc_sample.h"
+
+#ifdef PC_PROFILE
+
+#define PC_SAMPLE_TIM       TIM5
+#define PC_SAMPLE_TIM_IRQ   TIM5_IRQn
+#define PC_SAMPLE_TIM_CLOCK RCC_APB1Periph_TIM5
+/* above the kernel (5), under the faults */
+#define PC_SAMPLE_IRQ_PRI   2
+
+static volatile hw_pc_sample_callback _callback;
+
+void hw_pc_sample_start(uint32_t hz, hw_pc_sample_callback callback)
+{
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+    RCC_ClocksTypeDef clocks;
+
+    /* APB1 timers run at twice PCLK1 whenever APB1 is divided down */
+    RCC_GetClocksFreq(&clocks);
+    uint32_t tim_hz = clocks.PCLK1_Frequency == clocks.HCLK_Frequency ?
+                      clocks.PCLK1_Frequency : clocks.PCLK1_Frequency * 2;
+
+    _callback = callback;
+    stm32_power_request(STM32_POWER_APB1, PC_SAMPLE_TIM_CLOCK);
+
+    /* TIM5 is 32 bits wide, so no prescaler is needed for any rate */
+    TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+    TIM_TimeBaseStructure.TIM_Prescaler = 0;
+    TIM_TimeBaseStructure.TIM_Period = tim_hz / hz - 1;
+    TIM_TimeBaseInit(PC_SAMPLE_TIM, &TIM_TimeBaseStructure);
+    TIM_ClearITPendingBit(PC_SAMPLE_TIM, TIM_IT_Update);
+    TIM_ITConfig(PC_SAMPLE_TIM, TIM_IT_Update, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = PC_SAMPLE_TIM_IRQ;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = PC_SAMPLE_IRQ_PRI;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    TIM_Cmd(PC_SAMPLE_TIM, ENABLE);
+}
+
+/* No sample is taken after this returns */
+void hw_pc_sample_stop(void)
+{
+    NVIC_DisableIRQ(PC_SAMPLE_TIM_IRQ);
+    TIM_Cmd(PC_SAMPLE_TIM, DISABLE);
+    TIM_ITConfig(PC_SAMPLE_TIM, TIM_IT_Update, DISABLE);
+    TIM_ClearITPendingBit(PC_SAMPLE_TIM, TIM_IT_Update);
+    stm32_power_release(STM32_POWER_APB1, PC_SAMPLE_TIM_CLOCK);
+    _callback = NULL;
+}
+
+/*
+ * frame is the exception frame the core stacked, r0-r3, r12, lr, pc,
+ * xpsr. EXC_RETURN bit 3 is clear when we return to handler mode, that
+ * is, when another handler was interrupted
+ */
+__attribute__((used)) static void _pc_sample(uint32_t *frame, uint32_t exc_return)
+{
+    hw_pc_sample_callback callback = _callback;
+
+    TIM_ClearITPendingBit(PC_SAMPLE_TIM, TIM_IT_Update);
+    if (callback)
+        callback(frame[6], !(exc_return & 0x8));
+}
+
+/* Tasks run on the PSP, handlers and the code before the scheduler on
+ * the MSP; EXC_RETURN bit 2 says which had the frame */
+__attribute__((naked)) void TIM5_IRQHandler(void)
+{
+    __asm volatile(
+        "tst lr, #4\n"
+        "ite eq\n"
+        "mrseq r0, msp\n"
+        "mrsne r0, psp\n"
+        "mov r1, lr\n"
+        "b _pc_sample\n"
+    );
+}
+
+#else
+
+void hw_pc_sample_start(uint32_t hz, hw_pc_sample_callback callback)
+{
+}
+
+void hw_pc_sample_stop(void)
+{
+}
+
+#endif
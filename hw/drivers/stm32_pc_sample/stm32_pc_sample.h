@@ -0,0 +1,20 @@
+/*
+ * stm32_pc_sample.h
+ * Where the CPU was, a few thousand times a second, for the profiler
+ * RebbleOS
+ */
+
+#ifndef __STM32_PC_SAMPLE_H
+#define __STM32_PC_SAMPLE_H
+
+#include <stdint.h>
+
+/* pc is what was interrupted; in_isr if that was another handler rather
+ * than a task. Called above the kernel's priority, so no FreeRTOS calls
+ * but the ones that only read a variable */
+typedef void (*hw_pc_sample_callback)(uint32_t pc, uint8_t in_isr);
+
+void hw_pc_sample_start(uint32_t hz, hw_pc_sample_callback callback);
+void hw_pc_sample_stop(void);
+
+#endif
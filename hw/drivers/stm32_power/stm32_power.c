@@ -29,6 +29,46 @@
  * call into this API from an interrupt service routine.  Later, we may
  * switch back to a mutex, as necessary.
  *
+ * Drivers on hot paths (flash reads, display frames) can release with
+ * stm32_power_release_lazy instead.  The count drops as usual, but the
+ * clock stays on for STM32_POWER_LAZY_TICKS after it hits zero, and is
+ * only gated from the tick hook if nobody asked for it again meanwhile. 
+ * Back to back small transfers then don't pay for an RCC round trip
+ * each.  Either way, RCC is only touched when a count goes to or from
+ * zero.
+ *
+ * With tickless idle on, the idle task sleeps through stm32_power_sleep.
+ * It can see from the counts here whether anything but GPIOs has a clock
+ * held. If nothing does, and the sleep is long enough to be worth it, the
+ * F4 goes all the way down to STOP mode and is woken by the RTC. Anything
+ * in flight (a display frame's DMA, the Bluetooth UART, a debug UART left
+ * on) holds its clock, so it keeps us in an ordinary WFI sleep with the
+ * SysTick stretched instead. The F2 has no RTC subsecond register to tell
+ * us how long an early wake slept for, so it only ever does the latter.
+ *
+ * Each clock's time on is added up as it goes, in core cycles, along with
+ * how many times it was asked for; stm32_power_residency reads them out.
+ * On is on in RCC, so a lazily released clock counts until it is gated.
+ * A clock held through STOP counts nothing while the core is stopped,
+ * which is fair, as it isn't ticking either. Clocks that were turned on
+ * behind our back (SystemInit, the bootloader) aren't seen at all. The
+ * cycle counter wraps every 40s or so, so whatever is still on is folded
+ * in every second from the tick hook and before each sleep.
+ *
+ * The CPU clock is asked for the same way. SystemInit leaves HCLK at the
+ * PLL's full rate; with nothing asking for it, the idle task halves it on
+ * its way to sleep, and whoever next calls stm32_power_cpu_request or
+ * stm32_power_cpu_boost puts it back before carrying on. The frame
+ * renderer, flash reads and Bluetooth traffic ask; everything else runs at
+ * whichever speed it finds. Only HCLK moves: the APB dividers are halved
+ * in the same write, so PCLK1 and PCLK2 never change and neither does any
+ * SPI, USART or I2C divider set up against them. The timers are all on
+ * APB1 and count at twice PCLK1 either way. The FMC and FSMC count their
+ * NOR timings in HCLK cycles, which only get longer, and the flash wait
+ * states set for full speed are more than enough at half. Cycle counts
+ * that span a step are turned into time at the clock at the end, so they
+ * read short or long by up to half.
+ *
  * XXX: Which STM32F4xx are Time series? STM32F446xx has what looks like
  * "0th-level clock gating" on AHB1 that we might be able to save a little
  * more power with.
@@ -48,16 +88,117 @@
 
 #include "stdio.h"
 #include "stm32_power.h"
+#include "stm32_rtc.h"
+#include "stm32_delay.h"
 #include "debug.h"
 
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include "task.h"
 
-#define MK_STORAGE(n, b) static uint8_t _power_state_##n[b] = {0};
+typedef struct stm32_power_account {
+    uint64_t cycles;
+    uint32_t requests;
+    uint32_t since;     /* cycle count when it was last turned on, or folded */
+} stm32_power_account_t;
+
+#define MK_STORAGE(n, b) \
+    static uint8_t _power_state_##n[b] = {0}; \
+    static stm32_power_account_t _power_account_##n[b];
 STM32_POWER_EXPANDO(MK_STORAGE)
 #undef MK_STORAGE
 
+/* fold the clocks that are on into their totals this often, well inside
+ * a wrap of the cycle counter */
+#define STM32_POWER_FOLD_TICKS pdMS_TO_TICKS(1000)
+static TickType_t _power_fold_tick;
+
+/* names for the clocks we use, for the residency report */
+static const struct {
+    stm32_power_register_t reg;
+    uint32_t domain;
+    const char *name;
+} _power_names[] = {
+    { STM32_POWER_AHB1, RCC_AHB1Periph_DMA1, "DMA1" },
+    { STM32_POWER_AHB1, RCC_AHB1Periph_DMA2, "DMA2" },
+    { STM32_POWER_AHB1, RCC_AHB1Periph_CRC, "CRC" },
+#ifdef RCC_AHB1Periph_DMA2D
+    { STM32_POWER_AHB1, RCC_AHB1Periph_DMA2D, "DMA2D" },
+#endif
+#ifdef RCC_AHB3Periph_FMC
+    { STM32_POWER_AHB3, RCC_AHB3Periph_FMC, "FMC" },
+#else
+    { STM32_POWER_AHB3, RCC_AHB3Periph_FSMC, "FSMC" },
+#endif
+    { STM32_POWER_APB1, RCC_APB1Periph_SPI2, "SPI2" },
+    { STM32_POWER_APB1, RCC_APB1Periph_USART2, "USART2" },
+    { STM32_POWER_APB1, RCC_APB1Periph_USART3, "USART3" },
+#ifdef RCC_APB1Periph_UART8
+    { STM32_POWER_APB1, RCC_APB1Periph_UART8, "UART8" },
+#endif
+    { STM32_POWER_APB1, RCC_APB1Periph_I2C1, "I2C1" },
+    { STM32_POWER_APB1, RCC_APB1Periph_I2C2, "I2C2" },
+    { STM32_POWER_APB1, RCC_APB1Periph_PWR, "PWR" },
+    { STM32_POWER_APB2, RCC_APB2Periph_USART1, "USART1" },
+    { STM32_POWER_APB2, RCC_APB2Periph_SPI1, "SPI1" },
+#ifdef RCC_APB2Periph_SPI6
+    { STM32_POWER_APB2, RCC_APB2Periph_SPI6, "SPI6" },
+#endif
+    { STM32_POWER_APB2, RCC_APB2Periph_ADC1, "ADC1" },
+    { STM32_POWER_APB2, RCC_APB2Periph_SYSCFG, "SYSCFG" },
+};
+
+/* how long a lazily released clock stays on with nobody using it */
+#define STM32_POWER_LAZY_TICKS pdMS_TO_TICKS(20)
+
+/* clocks at count zero that are still on, waiting on the deadline */
+static uint32_t _power_lazy[STM32_POWER_MAX];
+static uint8_t _power_lazy_pending;
+static TickType_t _power_lazy_deadline;
+
+#if defined(STM32F4XX)
+#    define STM32_POWER_STOP
+#endif
+
+#ifdef STM32_POWER_STOP
+/* below this, restarting the PLL costs more than STOP saves */
+#define STM32_POWER_STOP_MIN_TICKS pdMS_TO_TICKS(10)
+
+/* clocks that can be left on through STOP: the GPIOs hold their pins
+ * and raise EXTI wakeups either way, and PWR and SYSCFG are just config */
+static const uint32_t _power_stop_safe[STM32_POWER_MAX] = {
+    [STM32_POWER_AHB1] = RCC_AHB1Periph_GPIOA | RCC_AHB1Periph_GPIOB | RCC_AHB1Periph_GPIOC |
+                         RCC_AHB1Periph_GPIOD | RCC_AHB1Periph_GPIOE | RCC_AHB1Periph_GPIOF |
+                         RCC_AHB1Periph_GPIOG | RCC_AHB1Periph_GPIOH | RCC_AHB1Periph_GPIOI |
+                         RCC_AHB1Periph_GPIOJ | RCC_AHB1Periph_GPIOK,
+    [STM32_POWER_APB1] = RCC_APB1Periph_PWR,
+    [STM32_POWER_APB2] = RCC_APB2Periph_SYSCFG,
+};
+
+/* how many clocks outside of those are held */
+static uint16_t _power_stop_blockers;
+#endif
+
+/* HCLK, PCLK2 and PCLK1 at full speed as SystemInit sets them up, and at
+ * half, with PCLK1 and PCLK2 where they were */
+#define STM32_POWER_CPU_CFGR_MASK (RCC_CFGR_HPRE | RCC_CFGR_PPRE2 | RCC_CFGR_PPRE1)
+#define STM32_POWER_CPU_CFGR_FAST (RCC_CFGR_HPRE_DIV1 | RCC_CFGR_PPRE2_DIV2 | RCC_CFGR_PPRE1_DIV4)
+#define STM32_POWER_CPU_CFGR_SLOW (RCC_CFGR_HPRE_DIV2 | RCC_CFGR_PPRE2_DIV1 | RCC_CFGR_PPRE1_DIV2)
+
+/* how long the CPU clock stays up after the last release, so a run of
+ * frames or reads doesn't step down and up between each */
+#define STM32_POWER_CPU_HOLD_TICKS pdMS_TO_TICKS(50)
+
+/* 0 if the clocks weren't as we expected at init, and we leave them be */
+static uint8_t _power_cpu_ok;
+static uint32_t _power_cpu_fast_hz;
+static uint8_t _power_cpu_slow;
+static uint8_t _power_cpu_count;
+static TickType_t _power_cpu_deadline;
+
+/* the port's, to put SysTick and its tickless sums right for a new clock */
+extern void vPortSetupTimerInterrupt(void);
+
 #ifdef STM32_POWER_USE_MUTEX
 static StaticSemaphore_t stm32_power_mutex_mem;
 static SemaphoreHandle_t stm32_power_mutex;
@@ -67,11 +208,16 @@ void stm32_power_init() {
 #ifdef STM32_POWER_USE_MUTEX
     stm32_power_mutex = xSemaphoreCreateMutexStatic(&stm32_power_mutex_mem);
 #endif
+    _power_cpu_ok = (RCC->CFGR & STM32_POWER_CPU_CFGR_MASK) == STM32_POWER_CPU_CFGR_FAST;
+    _power_cpu_fast_hz = SystemCoreClock;
+    if (!_power_cpu_ok)
+        printf("stm32_power: clocks not as SystemInit left them, CPU clock stays put");
 }
 
-void stm32_power_incr(stm32_power_register_t reg, uint32_t domain, int incr) {
+static void _stm32_power_incr(stm32_power_register_t reg, uint32_t domain, int incr, uint8_t lazy) {
     int bits;
     uint8_t *statep;
+    stm32_power_account_t *accountp;
     void (*clkcmd)(uint32_t periph, FunctionalState state);
     
 #ifdef STM32_POWER_USE_MUTEX
@@ -93,13 +239,15 @@ void stm32_power_incr(stm32_power_register_t reg, uint32_t domain, int incr) {
 #endif
 
     switch (reg) {
-#define MK_CASE(n, b) case STM32_POWER_##n: statep = _power_state_##n; bits = b; clkcmd = RCC_##n##PeriphClockCmd; break;
+#define MK_CASE(n, b) case STM32_POWER_##n: statep = _power_state_##n; accountp = _power_account_##n; bits = b; clkcmd = RCC_##n##PeriphClockCmd; break;
     STM32_POWER_EXPANDO(MK_CASE)
 #undef MK_CASE
     default:
         assert(!"bad reg for stm32_power_incr");
     }
     
+    uint32_t now = hw_cycle_count();
+    
     assert(incr == 1 || incr == -1);
     for (int i = 0; i < 32; i++) {
         if (!(domain & (1 << i)))
@@ -110,8 +258,37 @@ void stm32_power_incr(stm32_power_register_t reg, uint32_t domain, int incr) {
         assert(!((incr == -1) && (statep[i] == 0x0)) && "stm32_power_incr underflow");
         
         statep[i] += incr;
+        if (incr == 1)
+            accountp[i].requests++;
         
-        clkcmd(1 << i, statep[i] ? ENABLE : DISABLE);
+#ifdef STM32_POWER_STOP
+        if (!(_power_stop_safe[reg] & (1 << i))) {
+            if (incr == 1 && statep[i] == 1)
+                _power_stop_blockers++;
+            else if (incr == -1 && statep[i] == 0)
+                _power_stop_blockers--;
+        }
+#endif
+
+        if (incr == 1 && statep[i] == 1) {
+            /* never went off, so there is nothing to turn on */
+            if (_power_lazy[reg] & (1 << i)) {
+                _power_lazy[reg] &= ~(1 << i);
+            } else {
+                clkcmd(1 << i, ENABLE);
+                accountp[i].since = now;
+            }
+        } else if (incr == -1 && statep[i] == 0) {
+            if (lazy) {
+                _power_lazy[reg] |= 1 << i;
+                _power_lazy_pending = 1;
+                _power_lazy_deadline = xTaskGetTickCountFromISR() + STM32_POWER_LAZY_TICKS;
+            } else {
+                _power_lazy[reg] &= ~(1 << i);
+                clkcmd(1 << i, DISABLE);
+                accountp[i].cycles += now - accountp[i].since;
+            }
+        }
     }
 
 //    clkcmd(domain, ENABLE);
@@ -129,3 +306,289 @@ void stm32_power_incr(stm32_power_register_t reg, uint32_t domain, int incr) {
     taskEXIT_CRITICAL_FROM_ISR(critical_state);
 #endif
 }
+
+void stm32_power_incr(stm32_power_register_t reg, uint32_t domain, int incr) {
+    _stm32_power_incr(reg, domain, incr, 0);
+}
+
+void stm32_power_release_lazy(stm32_power_register_t reg, uint32_t domain) {
+    _stm32_power_incr(reg, domain, -1, 1);
+}
+
+/* Add up the time on of the clocks in mask, which are going off now or
+ * are staying on, and start them over from now. In a critical section */
+static void _stm32_power_account(stm32_power_account_t *accountp, uint32_t mask, uint32_t now) {
+    for (int i = 0; mask; i++, mask >>= 1) {
+        if (mask & 1) {
+            accountp[i].cycles += now - accountp[i].since;
+            accountp[i].since = now;
+        }
+    }
+}
+
+static void _stm32_power_gate_lazy() {
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    uint32_t now = hw_cycle_count();
+    
+#define MK_GATE(n, b) \
+    if (_power_lazy[STM32_POWER_##n]) { \
+        RCC_##n##PeriphClockCmd(_power_lazy[STM32_POWER_##n], DISABLE); \
+        _stm32_power_account(_power_account_##n, _power_lazy[STM32_POWER_##n], now); \
+        _power_lazy[STM32_POWER_##n] = 0; \
+    }
+    STM32_POWER_EXPANDO(MK_GATE)
+#undef MK_GATE
+    _power_lazy_pending = 0;
+    
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+}
+
+/* Bring every clock that is on up to date. In a critical section */
+static void _stm32_power_fold() {
+    uint32_t now = hw_cycle_count();
+    
+#define MK_FOLD(n, b) { \
+        uint32_t on = _power_lazy[STM32_POWER_##n]; \
+        for (int i = 0; i < b; i++) \
+            if (_power_state_##n[i]) \
+                on |= 1u << i; \
+        _stm32_power_account(_power_account_##n, on, now); \
+    }
+    STM32_POWER_EXPANDO(MK_FOLD)
+#undef MK_FOLD
+    _power_fold_tick = xTaskGetTickCountFromISR();
+}
+
+static void _stm32_power_fold_due() {
+    if (xTaskGetTickCountFromISR() - _power_fold_tick < STM32_POWER_FOLD_TICKS)
+        return;
+    
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    _stm32_power_fold();
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+}
+
+/*
+ * How long one clock has been on, and how many times it was requested,
+ * since boot or the last reset. The name is ours for it if we have one,
+ * or NULL. 0 if the register has no such bit
+ */
+uint8_t stm32_power_residency(stm32_power_register_t reg, uint8_t bit, uint64_t *cycles, uint32_t *requests, const char **name) {
+    stm32_power_account_t *accountp;
+    int bits;
+    
+    switch (reg) {
+#define MK_CASE(n, b) case STM32_POWER_##n: accountp = _power_account_##n; bits = b; break;
+    STM32_POWER_EXPANDO(MK_CASE)
+#undef MK_CASE
+    default:
+        return 0;
+    }
+    if (bit >= bits)
+        return 0;
+    
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    _stm32_power_fold();
+    *cycles = accountp[bit].cycles;
+    *requests = accountp[bit].requests;
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+    
+    *name = NULL;
+    for (int i = 0; i < sizeof(_power_names) / sizeof(_power_names[0]); i++)
+        if (_power_names[i].reg == reg && _power_names[i].domain == (1u << bit))
+            *name = _power_names[i].name;
+    
+    return 1;
+}
+
+/* Start every count over from now */
+void stm32_power_residency_reset() {
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    _stm32_power_fold();
+#define MK_RESET(n, b) \
+    for (int i = 0; i < b; i++) { \
+        _power_account_##n[i].cycles = 0; \
+        _power_account_##n[i].requests = 0; \
+    }
+    STM32_POWER_EXPANDO(MK_RESET)
+#undef MK_RESET
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+}
+
+/* Step HCLK to full or half speed. The tick in progress runs out at the
+ * old rate. In a critical section */
+static void _stm32_power_cpu_set(uint8_t slow) {
+    RCC->CFGR = (RCC->CFGR & ~STM32_POWER_CPU_CFGR_MASK) |
+                (slow ? STM32_POWER_CPU_CFGR_SLOW : STM32_POWER_CPU_CFGR_FAST);
+    SystemCoreClock = slow ? _power_cpu_fast_hz / 2 : _power_cpu_fast_hz;
+    _power_cpu_slow = slow;
+    
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+        vPortSetupTimerInterrupt();
+}
+
+/* Keep the CPU clock up until at least ticks from now. In a critical section */
+static void _stm32_power_cpu_hold(TickType_t ticks) {
+    TickType_t until = xTaskGetTickCountFromISR() + ticks;
+    
+    if ((int32_t)(until - _power_cpu_deadline) > 0)
+        _power_cpu_deadline = until;
+}
+
+/*
+ * Ask for the CPU clock at full speed until the matching release. Task
+ * context only: an ISR could get in while the idle task has SysTick
+ * stopped, and stepping the clock then would upset its sums
+ */
+void stm32_power_cpu_request() {
+    assert(!is_interrupt_set() && "stm32_power_cpu_request from an ISR");
+    
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    assert(_power_cpu_count != 0xFF && "stm32_power_cpu_request overflow");
+    _power_cpu_count++;
+    if (_power_cpu_slow)
+        _stm32_power_cpu_set(0);
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+}
+
+/* The clock stays up for STM32_POWER_CPU_HOLD_TICKS after the last one */
+void stm32_power_cpu_release() {
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    assert(_power_cpu_count && "stm32_power_cpu_release underflow");
+    _power_cpu_count--;
+    if (!_power_cpu_count)
+        _stm32_power_cpu_hold(STM32_POWER_CPU_HOLD_TICKS);
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+}
+
+/* Full speed for at least ms from now, with nothing to release. Task
+ * context only, as stm32_power_cpu_request */
+void stm32_power_cpu_boost(uint32_t ms) {
+    assert(!is_interrupt_set() && "stm32_power_cpu_boost from an ISR");
+    
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    _stm32_power_cpu_hold(pdMS_TO_TICKS(ms));
+    if (_power_cpu_slow)
+        _stm32_power_cpu_set(0);
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+}
+
+/* 1 if HCLK is at half speed */
+uint8_t stm32_power_cpu_is_slow() {
+    return _power_cpu_slow;
+}
+
+/* From the idle task: step down if nobody has wanted full speed for a while */
+static void _stm32_power_cpu_idle() {
+    if (!_power_cpu_ok || _power_cpu_slow || _power_cpu_count)
+        return;
+    if ((int32_t)(xTaskGetTickCountFromISR() - _power_cpu_deadline) < 0)
+        return;
+    
+    uint32_t critical_state = taskENTER_CRITICAL_FROM_ISR();
+    if (!_power_cpu_count)
+        _stm32_power_cpu_set(1);
+    taskEXIT_CRITICAL_FROM_ISR(critical_state);
+}
+
+/* From the tick hook: gate whatever stayed unused past its deadline */
+void stm32_power_tick() {
+    _stm32_power_fold_due();
+    if (!_power_lazy_pending)
+        return;
+    if ((int32_t)(xTaskGetTickCountFromISR() - _power_lazy_deadline) < 0)
+        return;
+    
+    _stm32_power_gate_lazy();
+}
+
+#if configUSE_TICKLESS_IDLE == 1
+
+/* the port's own SysTick sleep; portmacro.h only declares it if we don't
+ * take over portSUPPRESS_TICKS_AND_SLEEP */
+extern void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime);
+
+#ifdef STM32_POWER_STOP
+/* STOP leaves us running off the HSI. The PLL keeps its configuration, so
+ * bring back its source and switch over to it as SystemInit left things */
+static void _stm32_power_clocks_restore() {
+    if (RCC->PLLCFGR & RCC_PLLCFGR_PLLSRC_HSE) {
+        RCC_HSEConfig(RCC_HSE_ON);
+        while (RCC_GetFlagStatus(RCC_FLAG_HSERDY) == RESET)
+            ;
+    }
+    RCC_PLLCmd(ENABLE);
+    while (RCC_GetFlagStatus(RCC_FLAG_PLLRDY) == RESET)
+        ;
+    RCC_SYSCLKConfig(RCC_SYSCLKSource_PLLCLK);
+    while (RCC_GetSYSCLKSource() != 0x08)
+        ;
+}
+
+/* Sleep in STOP until the next task is due or something interrupts us,
+ * then wind the kernel's clock forward by however long that was. With
+ * interrupts masked a pending one still ends the WFI; it is serviced once
+ * we've put the clocks and the tick back */
+static void _stm32_power_stop(TickType_t idle) {
+    __asm volatile("cpsid i");
+    __asm volatile("dsb");
+    __asm volatile("isb");
+    
+    /* something got in between deciding and getting here */
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep || _power_stop_blockers) {
+        __asm volatile("cpsie i");
+        return;
+    }
+    
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    
+    /* wake a tick early; the tick we restart with covers the last one */
+    uint32_t ms = (idle - 1) * portTICK_PERIOD_MS;
+    uint32_t start = rtc_get_ms_of_day();
+    rtc_wakeup_start(ms);
+    
+    stm32_power_request(STM32_POWER_APB1, RCC_APB1Periph_PWR);
+    PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+    _stm32_power_clocks_restore();
+    stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_PWR);
+    
+    uint32_t slept;
+    if (rtc_wakeup_stop()) {
+        slept = ms;
+    } else {
+        int32_t d = rtc_get_ms_of_day() - start;
+        if (d < 0)
+            d += 24 * 60 * 60 * 1000;
+        slept = d;
+    }
+    
+    TickType_t ticks = pdMS_TO_TICKS(slept);
+    if (ticks > idle - 1)
+        ticks = idle - 1;
+    
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    vTaskStepTick(ticks);
+    
+    __asm volatile("cpsie i");
+}
+#endif
+
+/* portSUPPRESS_TICKS_AND_SLEEP, from the idle task. Nothing is running,
+ * so lazily released clocks won't be wanted again before we wake */
+void stm32_power_sleep(uint32_t idle) {
+    _stm32_power_fold_due();
+    if (_power_lazy_pending)
+        _stm32_power_gate_lazy();
+    _stm32_power_cpu_idle();
+    
+#ifdef STM32_POWER_STOP
+    if (idle >= STM32_POWER_STOP_MIN_TICKS && !_power_stop_blockers) {
+        _stm32_power_stop(idle);
+        return;
+    }
+#endif
+    vPortSuppressTicksAndSleep(idle);
+}
+
+#endif
@@ -47,6 +47,15 @@ typedef enum stm32_power_register {
 
 extern void stm32_power_init();
 extern void stm32_power_incr(stm32_power_register_t reg, uint32_t domain, int incr);
+extern void stm32_power_release_lazy(stm32_power_register_t reg, uint32_t domain);
+extern void stm32_power_tick();
+extern void stm32_power_sleep(uint32_t idle_ticks);
+extern uint8_t stm32_power_residency(stm32_power_register_t reg, uint8_t bit, uint64_t *cycles, uint32_t *requests, const char **name);
+extern void stm32_power_residency_reset();
+extern void stm32_power_cpu_request();
+extern void stm32_power_cpu_release();
+extern void stm32_power_cpu_boost(uint32_t ms);
+extern uint8_t stm32_power_cpu_is_slow();
 
 static inline void stm32_power_request(stm32_power_register_t reg, uint32_t domain) {
     stm32_power_incr(reg, domain, 1);
@@ -25,6 +25,7 @@
 #include "stm32_power.h"
 #include "stm32_rtc.h"
 #include "log.h"
+#include "sched_trace.h"
 #include <stdlib.h>
 #include <time.h>
 
@@ -61,8 +62,9 @@ void rtc_init(void)
     NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStruct);
 
-    // Configure the RTC WakeUp Clock source: CK_SPRE (1Hz)
-    RTC_WakeUpClockConfig(RTC_WakeUpClock_CK_SPRE_16bits);
+    // Configure the RTC WakeUp Clock source: RTCCLK/16, for tickless idle
+    RTC_WakeUpCmd(DISABLE);
+    RTC_WakeUpClockConfig(RTC_WakeUpClock_RTCCLK_Div16);
     RTC_SetWakeUpCounter(0x0);
 
     // Enable the RTC Wakeup Interrupt
@@ -71,8 +73,7 @@ void rtc_init(void)
     RTC_ClearITPendingBit(RTC_IT_WUT);
     EXTI_ClearITPendingBit(EXTI_Line22);
 
-    // Enable Wakeup Counter
-    RTC_WakeUpCmd(ENABLE);
+    // The counter only runs while we sleep; see rtc_wakeup_start
 
     stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_SYSCFG);
 }
@@ -130,11 +131,14 @@ void rtc_config(void)
     stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_PWR);
 }
 
+/* The shadow registers are stale after STOP, so this waits for them. The
+ * OS keeps its own clock off the ticks and only comes here now and again */
 struct tm *hw_get_time(void)
 {
     RTC_TimeTypeDef RTC_TimeStructure;
     RTC_DateTypeDef RTC_DateStructure;
 
+    RTC_WaitForSynchro();
     RTC_GetTime(RTC_Format_BIN, &RTC_TimeStructure);
     RTC_GetDate(RTC_Format_BIN, &RTC_DateStructure);
     time_now.tm_year = RTC_DateStructure.RTC_Year + 2000 - 1900; // since year 1990
@@ -164,29 +168,92 @@ void hw_set_alarm(struct tm alarm)
 //     RTC_ClearFlag(RTC_FLAG_ALRAF);
 }
 
+/* Backup access was left on by rtc_config */
 void hw_set_date_time(struct tm date_time)
 {
-//     RTC_DateStructure.RTC_Year = 0x13;
-//     RTC_DateStructure.RTC_Month = RTC_Month_January;
-//     RTC_DateStructure.RTC_Date = 0x11;
-//     RTC_DateStructure.RTC_WeekDay = RTC_Weekday_Saturday;
-//     RTC_SetDate(RTC_Format_BCD, &RTC_DateStructure);
-//
-//     RTC_TimeStructure.RTC_H12     = RTC_H12_AM;
-//     RTC_TimeStructure.RTC_Hours   = 0x05;
-//     RTC_TimeStructure.RTC_Minutes = 0x20;
-//     RTC_TimeStructure.RTC_Seconds = 0x00;
-//
-//     RTC_SetTime(RTC_Format_BCD, &RTC_TimeStructure);
+    RTC_TimeTypeDef RTC_TimeStructure;
+    RTC_DateTypeDef RTC_DateStructure;
+
+    RTC_DateStructure.RTC_Year = date_time.tm_year + 1900 - 2000;
+    RTC_DateStructure.RTC_Month = date_time.tm_mon + 1;
+    RTC_DateStructure.RTC_Date = date_time.tm_mday;
+    /* Monday is 1 to the RTC, and Sunday 7 */
+    RTC_DateStructure.RTC_WeekDay = date_time.tm_wday ? date_time.tm_wday : RTC_Weekday_Sunday;
+
+    RTC_TimeStructure.RTC_H12 = RTC_H12_AM;
+    RTC_TimeStructure.RTC_Hours = date_time.tm_hour;
+    RTC_TimeStructure.RTC_Minutes = date_time.tm_min;
+    RTC_TimeStructure.RTC_Seconds = date_time.tm_sec;
+
+    RTC_SetDate(RTC_Format_BIN, &RTC_DateStructure);
+    RTC_SetTime(RTC_Format_BIN, &RTC_TimeStructure);
+}
+
+
+/* Tickless idle. The wakeup timer counts RTCCLK/16 (2048Hz off the LSE),
+ * so it can wake us from STOP, where the SysTick doesn't run, up to 32s
+ * out. Call with interrupts off */
+#define RTC_WAKEUP_HZ (32768 / 16)
+
+void rtc_wakeup_start(uint32_t ms)
+{
+    uint32_t count = ms * RTC_WAKEUP_HZ / 1000;
+
+    if (count < 1)
+        count = 1;
+    if (count > 0x10000)
+        count = 0x10000;
+
+    RTC_WakeUpCmd(DISABLE);
+    RTC_SetWakeUpCounter(count - 1);
+    RTC_ClearITPendingBit(RTC_IT_WUT);
+    EXTI_ClearITPendingBit(EXTI_Line22);
+    RTC_WakeUpCmd(ENABLE);
 }
 
+/* Stop the wakeup timer. Returns whether it was what woke us */
+uint8_t rtc_wakeup_stop(void)
+{
+    uint8_t fired = RTC_GetFlagStatus(RTC_FLAG_WUTF) == SET;
+
+    RTC_WakeUpCmd(DISABLE);
+    RTC_ClearITPendingBit(RTC_IT_WUT);
+    EXTI_ClearITPendingBit(EXTI_Line22);
+
+    return fired;
+}
+
+#if defined(STM32F4XX)
+/* Milliseconds into the day by the RTC, to the 1/256s the subsecond
+ * register counts in (the synchronous prescaler is 0xFF). Only the F4
+ * has a subsecond register. The shadow registers are stale after STOP,
+ * so wait for them to catch up first */
+uint32_t rtc_get_ms_of_day(void)
+{
+    RTC_TimeTypeDef RTC_TimeStructure;
+    RTC_DateTypeDef RTC_DateStructure;
+
+    RTC_WaitForSynchro();
+
+    /* reading these in this order locks the calendar until the date is read */
+    uint32_t ss = RTC_GetSubSecond();
+    RTC_GetTime(RTC_Format_BIN, &RTC_TimeStructure);
+    RTC_GetDate(RTC_Format_BIN, &RTC_DateStructure);
+
+    uint32_t sec = RTC_TimeStructure.RTC_Hours * 3600 + RTC_TimeStructure.RTC_Minutes * 60 + RTC_TimeStructure.RTC_Seconds;
+
+    return sec * 1000 + (0xFF - ss) * 1000 / 256;
+}
+#endif
 
 void RTC_WKUP_IRQHandler(void)
 {
+    traceISR_ENTER();
     if(RTC_GetITStatus(RTC_IT_WUT) != RESET)
     {
         RTC_ClearITPendingBit(RTC_IT_WUT);
 //         DRV_LOG("RTC", APP_LOG_LEVEL_DEBUG, "RTC WAKE IRQ");
         EXTI_ClearITPendingBit(EXTI_Line22);
     }
+    traceISR_EXIT();
 }
@@ -23,6 +23,12 @@
 void rtc_init(void);
 void rtc_config(void);
 struct tm *hw_get_time(void);
+void hw_set_date_time(struct tm date_time);
+void rtc_wakeup_start(uint32_t ms);
+uint8_t rtc_wakeup_stop(void);
+#if defined(STM32F4XX)
+uint32_t rtc_get_ms_of_day(void);
+#endif
 
 #endif
 
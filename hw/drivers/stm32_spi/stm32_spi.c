@@ -24,6 +24,9 @@
 #include "log.h"
 #include "stm32_spi.h"
 #include "platform.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 static void _spi_init(stm32_spi_config_t *spi);
 static uint8_t _stm32_spi_send_recv_dma(stm32_spi_t *spi, uint8_t *outdata, size_t outlen, uint8_t *indata, size_t inlen, uint8_t async, uint8_t single_byte);
 uint8_t stm32_spi_poll_wait(stm32_spi_t *spi, uint16_t timeout);
@@ -230,10 +233,10 @@ static uint8_t _stm32_spi_send_recv_dma(stm32_spi_t *spi, uint8_t *outdata, size
     if (!async)
     {
         uint8_t pw = stm32_spi_poll_wait(spi, SPI_TIMEOUT);
-        stm32_power_release(spi->config->spi_periph_bus, spi->config->spi_clock);
-        stm32_power_release(spi->config->spi_periph_bus, spi->config->spi_clock);
-        stm32_power_release(STM32_POWER_AHB1, spi->dma->dma_clock);
-        stm32_power_release(STM32_POWER_AHB1, spi->dma->dma_clock);
+        stm32_power_release_lazy(spi->config->spi_periph_bus, spi->config->spi_clock);
+        stm32_power_release_lazy(spi->config->spi_periph_bus, spi->config->spi_clock);
+        stm32_power_release_lazy(STM32_POWER_AHB1, spi->dma->dma_clock);
+        stm32_power_release_lazy(STM32_POWER_AHB1, spi->dma->dma_clock);
         return pw;
     }
     return 0;
@@ -275,14 +278,23 @@ uint8_t stm32_spi_poll_wait(stm32_spi_t *spi, uint16_t timeout)
 /*
  * IRQ Handler for RX of data complete
  */
+static void _txn_isr(stm32_spi_t *spi);
+
 void stm32_spi_rx_isr(stm32_spi_t *spi, dma_callback callback)
 {
+    /* a transaction's phase, all in */
+    if (spi->txn_head)
+    {
+        _txn_isr(spi);
+        return;
+    }
+
     stm32_dma_rx_disable(spi->dma);
 
     /* Trigger the recipient interrupt handler */
     if (callback)
         callback();
-    stm32_power_release(spi->config->spi_periph_bus, spi->config->spi_clock);
+    stm32_power_release_lazy(spi->config->spi_periph_bus, spi->config->spi_clock);
 }
 
 /*
@@ -296,7 +308,204 @@ void stm32_spi_tx_isr(stm32_spi_t *spi, dma_callback callback)
     if (callback)
         callback();
     
-    stm32_power_release(spi->config->spi_periph_bus, spi->config->spi_clock);
+    stm32_power_release_lazy(spi->config->spi_periph_bus, spi->config->spi_clock);
+}
+
+/*
+ * Transactions. Queued per bus, and run one after another from the RX
+ * DMA's completion, so any number of clients can share it without
+ * waiting on each other, or polling a byte at a time. Every byte in is
+ * a byte out, so a phase is done when the RX is, and with it the last
+ * byte on the wire. The bus needs its RX IRQ handler for this.
+ * The bus clock is held from the first on the queue to the last
+ */
+
+/* an NDTR's worth */
+#define TXN_DMA_MAX 0xFFFF
+
+static void _txn_start(stm32_spi_t *spi);
+
+/* One phase: TX from out (or the one byte of it), RX into in, or nowhere */
+static void _txn_phase(stm32_spi_t *spi, const uint8_t *out, uint8_t single_byte, uint8_t *in, size_t len)
+{
+    stm32_dma_rx_disable(spi->dma);
+    stm32_dma_tx_disable(spi->dma);
+    SPI_I2S_DMACmd(spi->config->spi, SPI_I2S_DMAReq_Tx | SPI_I2S_DMAReq_Rx, DISABLE);
+
+    stm32_dma_tx_init(spi->dma, (void *)&spi->config->spi->DR, (uint8_t *)out, len, single_byte);
+    /* done on the RX side */
+    DMA_ITConfig(spi->dma->dma_tx_stream, DMA_IT_TC, DISABLE);
+    /* anything left in DR by a TX only write would come in first */
+    (void)spi->config->spi->DR;
+    (void)spi->config->spi->SR;
+    if (in)
+        stm32_dma_rx_init(spi->dma, (void *)&spi->config->spi->DR, in, len);
+    else
+        stm32_dma_rx_init_discard(spi->dma, (void *)&spi->config->spi->DR, len);
+
+    SPI_I2S_DMACmd(spi->config->spi, SPI_I2S_DMAReq_Tx | SPI_I2S_DMAReq_Rx, ENABLE);
+    stm32_dma_rx_begin(spi->dma);
+    stm32_dma_tx_begin(spi->dma);
+}
+
+/* The next stretch of the data, or 0 if there's none left */
+static uint8_t _txn_data(stm32_spi_t *spi, stm32_spi_txn_t *txn)
+{
+    size_t n = txn->len - txn->at;
+
+    if (!n)
+        return 0;
+    if (n > TXN_DMA_MAX)
+        n = TXN_DMA_MAX;
+
+    _txn_phase(spi, txn->tx ? txn->tx + txn->at : &txn->dummy, !txn->tx,
+               txn->rx ? txn->rx + txn->at : NULL, n);
+    return 1;
+}
+
+static void _txn_start(stm32_spi_t *spi)
+{
+    stm32_spi_txn_t *txn = spi->txn_head;
+
+    txn->at = 0;
+    txn->in_cmd = txn->cmd_len != 0;
+    txn->select(1);
+
+    if (txn->in_cmd)
+        _txn_phase(spi, txn->cmd, 0, NULL, txn->cmd_len);
+    else
+        _txn_data(spi, txn);
+}
+
+/* A phase is all in; on to the next, or the next transaction */
+static void _txn_isr(stm32_spi_t *spi)
+{
+    stm32_spi_txn_t *txn = spi->txn_head;
+    stm32_spi_txn_t *next;
+    uint32_t primask;
+
+    stm32_dma_rx_disable(spi->dma);
+    stm32_dma_tx_disable(spi->dma);
+    /* the TX's, it has no interrupt of its own to let go in */
+    stm32_power_release(STM32_POWER_AHB1, spi->dma->dma_clock);
+
+    if (txn->in_cmd)
+        txn->in_cmd = 0;
+    else
+        txn->at += txn->len - txn->at > TXN_DMA_MAX ? TXN_DMA_MAX : txn->len - txn->at;
+    if (_txn_data(spi, txn))
+        return;
+
+    txn->select(0);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    next = txn->next;
+    spi->txn_head = next;
+    __set_PRIMASK(primask);
+
+    txn->done = 1;
+    /* anything it queues goes behind next, or starts itself */
+    if (txn->callback)
+        txn->callback(txn);
+
+    if (next)
+    {
+        _txn_start(spi);
+        return;
+    }
+    SPI_I2S_DMACmd(spi->config->spi, SPI_I2S_DMAReq_Tx | SPI_I2S_DMAReq_Rx, DISABLE);
+    stm32_power_release_lazy(spi->config->spi_periph_bus, spi->config->spi_clock);
+}
+
+/*
+ * Put a transaction on the bus's queue. It starts now if the bus is free,
+ * or after those ahead of it, and calls back from the ISR once it's done.
+ * From anywhere, ISRs included
+ */
+void stm32_spi_txn_queue(stm32_spi_t *spi, stm32_spi_txn_t *txn)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint8_t idle;
+
+    assert((txn->cmd_len || txn->len) && "empty SPI transaction");
+    txn->next = NULL;
+    txn->done = 0;
+
+    __disable_irq();
+    idle = !spi->txn_head;
+    if (idle)
+        spi->txn_head = txn;
+    else
+        spi->txn_tail->next = txn;
+    spi->txn_tail = txn;
+    __set_PRIMASK(primask);
+
+    /* nothing is in flight to start it for us */
+    if (idle)
+    {
+        stm32_power_request(spi->config->spi_periph_bus, spi->config->spi_clock);
+        SPI_Cmd(spi->config->spi, ENABLE);
+        _txn_start(spi);
+    }
+}
+
+/* By hand, for a bus without DMA, or a caller that can't sleep */
+static void _txn_poll(stm32_spi_t *spi, stm32_spi_txn_t *txn)
+{
+    stm32_power_request(spi->config->spi_periph_bus, spi->config->spi_clock);
+    SPI_Cmd(spi->config->spi, ENABLE);
+
+    txn->select(1);
+    for (uint8_t i = 0; i < txn->cmd_len; i++)
+        stm32_spi_write_read(spi, txn->cmd[i]);
+    for (size_t i = 0; i < txn->len; i++)
+    {
+        uint8_t c = stm32_spi_write_read(spi, txn->tx ? txn->tx[i] : txn->dummy);
+        if (txn->rx)
+            txn->rx[i] = c;
+    }
+    txn->select(0);
+    txn->done = 1;
+
+    stm32_power_release_lazy(spi->config->spi_periph_bus, spi->config->spi_clock);
+}
+
+static void _txn_wake(stm32_spi_txn_t *txn)
+{
+    BaseType_t woken = pdFALSE;
+
+    xSemaphoreGiveFromISR((SemaphoreHandle_t)txn->priv, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/* Only from a task that can sleep: not an ISR, nor a critical section */
+static uint8_t _can_sleep(void)
+{
+    return !__get_IPSR() && !__get_PRIMASK() && !__get_BASEPRI() &&
+           xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+/*
+ * Run a transaction and wait for it, asleep, so the CPU is everyone
+ * else's meanwhile. The callback and priv are ours. Before the scheduler
+ * is up, when nothing else can be on the bus, it's done by hand instead
+ */
+void stm32_spi_txn_run(stm32_spi_t *spi, stm32_spi_txn_t *txn)
+{
+    StaticSemaphore_t done_buf;
+
+    if (!spi->dma || !_can_sleep())
+    {
+        assert(!spi->txn_head && "SPI transaction by hand on a busy bus");
+        _txn_poll(spi, txn);
+        return;
+    }
+
+    txn->priv = xSemaphoreCreateBinaryStatic(&done_buf);
+    txn->callback = _txn_wake;
+    stm32_spi_txn_queue(spi, txn);
+    xSemaphoreTake((SemaphoreHandle_t)txn->priv, portMAX_DELAY);
 }
 
 /* Write a single charaction to the TX line unidirectionally. TX ONLY! */
@@ -316,7 +525,7 @@ uint8_t stm32_spi_write_read(stm32_spi_t *spi, unsigned char c)
 {
     while (!(spi->config->spi->SR & SPI_SR_TXE))
         ;
-    SPI1->DR = c;
+    spi->config->spi->DR = c;
     while (!(spi->config->spi->SR & SPI_SR_RXNE))
         ;
     return spi->config->spi->DR;
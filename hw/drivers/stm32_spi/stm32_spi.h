@@ -44,9 +44,42 @@ const typedef struct {
 
 
 
+/* command, address and dummy bytes, the most a transaction has before its data */
+#define STM32_SPI_TXN_CMD_MAX 6
+
+typedef struct stm32_spi_txn stm32_spi_txn_t;
+typedef void (*stm32_spi_txn_callback)(stm32_spi_txn_t *txn);
+
+/*
+ * One transaction on a bus: select, the command phase, the data phase and
+ * deselect. Both phases go by DMA, queued behind whatever else is on the
+ * bus. Either phase can be empty. It has to stay put, and out of CCM RAM,
+ * until it is done
+ */
+struct stm32_spi_txn {
+    void (*select)(uint8_t enabled);
+    uint8_t cmd[STM32_SPI_TXN_CMD_MAX];
+    uint8_t cmd_len;
+    const uint8_t *tx;      /* the data out, or NULL for dummy, over and over */
+    uint8_t *rx;            /* where the data in goes, or NULL */
+    size_t len;
+    uint8_t dummy;
+    /* from the ISR, deselected. The next on the bus is started after */
+    stm32_spi_txn_callback callback;
+    void *priv;
+    /* the driver's */
+    stm32_spi_txn_t *next;
+    size_t at;
+    uint8_t in_cmd;
+    volatile uint8_t done;
+};
+
 typedef struct {
     const stm32_spi_config_t *config;
     const stm32_dma_t *dma;
+    /* the transaction queue, the head is the one on the bus */
+    stm32_spi_txn_t *txn_head;
+    stm32_spi_txn_t *txn_tail;
 } stm32_spi_t;
 
 
@@ -77,5 +110,8 @@ uint8_t stm32_spi_poll_wait(stm32_spi_t *spi, uint16_t timeout);
 void stm32_spi_rx_isr(stm32_spi_t *spi, dma_callback callback);
 void stm32_spi_tx_isr(stm32_spi_t *spi, dma_callback callback);
 
+void stm32_spi_txn_queue(stm32_spi_t *spi, stm32_spi_txn_t *txn);
+void stm32_spi_txn_run(stm32_spi_t *spi, stm32_spi_txn_t *txn);
+
 void stm32_spi_write(stm32_spi_t *spi, unsigned char c);
 uint8_t stm32_spi_write_read(stm32_spi_t *spi, unsigned char c);
@@ -58,7 +58,8 @@ static void _usart_init(stm32_usart_t *usart)
                                (1 << u->gpio_pin_rx_num);
     GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AF;
     GPIO_InitStruct.GPIO_Speed = GPIO_Speed_100MHz;
-    GPIO_InitStruct.GPIO_OType = GPIO_OType_PP;
+    /* half duplex has the one pin, and whoever isn't talking lets go */
+    GPIO_InitStruct.GPIO_OType = u->half_duplex ? GPIO_OType_OD : GPIO_OType_PP;
     GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_UP;
     GPIO_Init(usart->config->gpio_ptr, &GPIO_InitStruct);
     
@@ -75,6 +76,12 @@ static void _usart_init(stm32_usart_t *usart)
     USART_DeInit(u->usart);
     USART_StructInit(&USART_InitStruct);
 
+    /* past PCLK/16 the USART has to sample at 8x, which takes it to PCLK/8 */
+    RCC_ClocksTypeDef clocks;
+    RCC_GetClocksFreq(&clocks);
+    uint32_t pclk = u->usart_periph_bus == STM32_POWER_APB2 ? clocks.PCLK2_Frequency : clocks.PCLK1_Frequency;
+    USART_OverSampling8Cmd(u->usart, usart->baud > pclk / 16 ? ENABLE : DISABLE);
+
     USART_InitStruct.USART_BaudRate = usart->baud;
     USART_InitStruct.USART_WordLength = USART_WordLength_8b;
     USART_InitStruct.USART_StopBits = USART_StopBits_1;
@@ -98,7 +105,15 @@ static void _usart_init(stm32_usart_t *usart)
     }
     
     USART_Init(u->usart, &USART_InitStruct);
+    USART_HalfDuplexCmd(u->usart, u->half_duplex ? ENABLE : DISABLE);
     
+    /* the deinit took a circular RX's requests off, put them back */
+    if (usart->rx_circular)
+    {
+        USART_ITConfig(u->usart, USART_IT_IDLE, ENABLE);
+        USART_DMACmd(u->usart, USART_DMAReq_Rx, ENABLE);
+    }
+
     /* USART is ready to go */
     USART_Cmd(u->usart, ENABLE);
     
@@ -156,6 +171,71 @@ void stm32_usart_recv_dma(stm32_usart_t *usart, uint32_t *data, size_t len)
     stm32_dma_rx_begin(usart->dma);
 }
 
+/*
+ * Receive into buf, round and round, for good. Nothing waits to be
+ * asked for again: the DMA never stops, and the owner keeps up with it
+ * by stm32_usart_rx_circular_pos from the callback it gave
+ * STM32_USART_MK_RX_CIRCULAR_IRQ_HANDLERS. Called again, it starts
+ * again from the top of buf. The clocks are held all the while
+ */
+void stm32_usart_recv_circular(stm32_usart_t *usart, uint8_t *buf, size_t len)
+{
+    const stm32_usart_config_t *u = usart->config;
+    NVIC_InitTypeDef nvic_init_struct;
+
+    if (!usart->rx_circular)
+    {
+        stm32_power_request(u->usart_periph_bus, u->usart_clock);
+        stm32_power_request(STM32_POWER_AHB1, u->gpio_clock);
+        stm32_power_request(STM32_POWER_AHB1, usart->dma->dma_clock);
+    }
+
+    USART_DMACmd(u->usart, USART_DMAReq_Rx, DISABLE);
+    stm32_dma_rx_disable(usart->dma);
+    usart->rx_circular = buf;
+    usart->rx_circular_len = len;
+    stm32_dma_rx_init_circular(usart->dma, (void *)&u->usart->DR, buf, len);
+
+    /* the line going idle says a short packet is all there is */
+    nvic_init_struct.NVIC_IRQChannel = u->usart_irq;
+    nvic_init_struct.NVIC_IRQChannelPreemptionPriority = usart->dma->dma_irq_rx_pri;
+    nvic_init_struct.NVIC_IRQChannelSubPriority = 0;
+    nvic_init_struct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic_init_struct);
+    USART_ITConfig(u->usart, USART_IT_IDLE, ENABLE);
+
+    USART_Cmd(u->usart, ENABLE);
+    USART_DMACmd(u->usart, USART_DMAReq_Rx, ENABLE);
+    stm32_dma_rx_begin(usart->dma);
+}
+
+/* how far into the buffer the DMA has written */
+size_t stm32_usart_rx_circular_pos(stm32_usart_t *usart)
+{
+    return stm32_dma_rx_pos(usart->dma, usart->rx_circular_len);
+}
+
+/*
+ * Stop a circular RX, and let go of the clocks it held
+ */
+void stm32_usart_stop_circular(stm32_usart_t *usart)
+{
+    const stm32_usart_config_t *u = usart->config;
+
+    if (!usart->rx_circular)
+        return;
+
+    USART_ITConfig(u->usart, USART_IT_IDLE, DISABLE);
+    USART_DMACmd(u->usart, USART_DMAReq_Rx, DISABLE);
+    stm32_dma_rx_disable(usart->dma);
+    NVIC_DisableIRQ(u->usart_irq);
+    usart->rx_circular = NULL;
+
+    stm32_power_release(STM32_POWER_AHB1, usart->dma->dma_clock);
+    stm32_power_release(STM32_POWER_AHB1, u->gpio_clock);
+    stm32_power_release(u->usart_periph_bus, u->usart_clock);
+}
+
 /* 
  * Set or change the baud rate of the USART
  * This is safe to be done any time there is no transaction in progress
@@ -182,6 +262,22 @@ void stm32_usart_rx_isr(stm32_usart_t *usart, dma_callback callback)
     callback();
 }
 
+/*
+ * IRQ Handler for the line going idle. 1 if it did
+ */
+uint8_t stm32_usart_idle_isr(stm32_usart_t *usart)
+{
+    USART_TypeDef *u = usart->config->usart;
+
+    if (USART_GetITStatus(u, USART_IT_IDLE) == RESET)
+        return 0;
+
+    /* cleared by reading SR then DR. The DMA has had the data already */
+    (void)u->SR;
+    (void)u->DR;
+    return 1;
+}
+
 /*
  * IRQ Handler for TX of data complete
  */
@@ -248,3 +344,158 @@ size_t stm32_usart_read(stm32_usart_t *usart, uint8_t *buf, size_t len)
     
     return i;
 }
+
+/*
+ * TX through a ring, drained by DMA. A write is only a copy into the
+ * ring, and the DMA sends what's there a run at a time, starting the next
+ * from its completion, so a busy log costs the writer next to nothing and
+ * doesn't change the timing it's logging. Writers are the caller's to
+ * keep to one at a time, as for stm32_usart_write.
+ *
+ * A writer that finds the ring full, or that can't let the DMA's
+ * interrupt in (an ISR, a fault, interrupts off, before the scheduler),
+ * finishes the runs itself by polling, so nothing is lost and a panic
+ * still gets its last words out. Only usart->dma's TX side is used.
+ */
+void stm32_usart_tx_ring(stm32_usart_t *usart, uint8_t *buf, size_t len)
+{
+    NVIC_InitTypeDef nvic_init_struct;
+
+    usart->tx_head = usart->tx_tail = usart->tx_dma_len = 0;
+    usart->tx_ring_len = len;
+    usart->tx_ring = buf;
+
+    nvic_init_struct.NVIC_IRQChannel = usart->dma->dma_irq_tx_channel;
+    nvic_init_struct.NVIC_IRQChannelPreemptionPriority = usart->dma->dma_irq_tx_pri;
+    nvic_init_struct.NVIC_IRQChannelSubPriority = 0;
+    nvic_init_struct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic_init_struct);
+}
+
+/* The next run out of the ring, if the DMA is free. Interrupts off */
+static void _tx_kick(stm32_usart_t *usart)
+{
+    size_t head = usart->tx_head;
+    size_t tail = usart->tx_tail;
+
+    if (usart->tx_dma_len || head == tail)
+        return;
+
+    /* up to the head, or the end of the ring and round next time */
+    usart->tx_dma_len = (head > tail ? head : usart->tx_ring_len) - tail;
+
+    /* released in _tx_done */
+    stm32_power_request(usart->config->usart_periph_bus, usart->config->usart_clock);
+    stm32_power_request(STM32_POWER_AHB1, usart->config->gpio_clock);
+
+    stm32_dma_tx_disable(usart->dma);
+    USART_DMACmd(usart->config->usart, USART_DMAReq_Tx, DISABLE);
+    stm32_dma_tx_init(usart->dma, (void *)&usart->config->usart->DR, usart->tx_ring + tail, usart->tx_dma_len, 0);
+    USART_DMACmd(usart->config->usart, USART_DMAReq_Tx, ENABLE);
+    stm32_dma_tx_begin(usart->dma);
+}
+
+/* A run is out. Interrupts off */
+static void _tx_done(stm32_usart_t *usart)
+{
+    USART_DMACmd(usart->config->usart, USART_DMAReq_Tx, DISABLE);
+    usart->tx_tail = (usart->tx_tail + usart->tx_dma_len) % usart->tx_ring_len;
+    usart->tx_dma_len = 0;
+
+    stm32_power_release(STM32_POWER_AHB1, usart->dma->dma_clock);
+    stm32_power_release(usart->config->usart_periph_bus, usart->config->usart_clock);
+    stm32_power_release(STM32_POWER_AHB1, usart->config->gpio_clock);
+
+    _tx_kick(usart);
+}
+
+/*
+ * The DMA's interrupt, and the writer's poll when that can't come. Either
+ * way, only the one of them gets to see the run finish
+ */
+void stm32_usart_tx_ring_isr(stm32_usart_t *usart)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (usart->tx_dma_len && stm32_dma_tx_isr(usart->dma))
+        _tx_done(usart);
+    __set_PRIMASK(primask);
+}
+
+static void _tx_start(stm32_usart_t *usart)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    _tx_kick(usart);
+    __set_PRIMASK(primask);
+}
+
+/* can the DMA's interrupt get in, to keep the ring going without us? */
+static uint8_t _tx_irq_ok(void)
+{
+    return !__get_IPSR() && !__get_PRIMASK() && !__get_BASEPRI();
+}
+
+/*
+ * Into the ring as it is, no \r added, and straight back. Without a ring
+ * yet, it goes out by hand
+ */
+size_t stm32_usart_write_async(stm32_usart_t *usart, const uint8_t *buf, size_t len)
+{
+    USART_TypeDef *u = usart->config->usart;
+    size_t i;
+
+    if (!usart->tx_ring)
+    {
+        stm32_power_request(usart->config->usart_periph_bus, usart->config->usart_clock);
+        stm32_power_request(STM32_POWER_AHB1, usart->config->gpio_clock);
+        for (i = 0; i < len; i++)
+        {
+            while (!(u->SR & USART_SR_TC));
+            USART_SendData(u, buf[i]);
+        }
+        stm32_power_release(usart->config->usart_periph_bus, usart->config->usart_clock);
+        stm32_power_release(STM32_POWER_AHB1, usart->config->gpio_clock);
+        return len;
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        size_t next = (usart->tx_head + 1) % usart->tx_ring_len;
+
+        /* full. Send what there is, and wait for room */
+        while (next == usart->tx_tail)
+        {
+            _tx_start(usart);
+            stm32_usart_tx_ring_isr(usart);
+        }
+        usart->tx_ring[usart->tx_head] = buf[i];
+        __DMB();
+        usart->tx_head = next;
+    }
+    _tx_start(usart);
+
+    if (!_tx_irq_ok())
+        stm32_usart_tx_flush(usart);
+
+    return len;
+}
+
+/* Wait, polling, until everything in the ring is on the wire */
+void stm32_usart_tx_flush(stm32_usart_t *usart)
+{
+    if (!usart->tx_ring)
+        return;
+
+    while (usart->tx_head != usart->tx_tail)
+    {
+        _tx_start(usart);
+        stm32_usart_tx_ring_isr(usart);
+    }
+
+    stm32_power_request(usart->config->usart_periph_bus, usart->config->usart_clock);
+    while (!(usart->config->usart->SR & USART_SR_TC));
+    stm32_power_release(usart->config->usart_periph_bus, usart->config->usart_clock);
+}
@@ -34,23 +34,42 @@ const typedef struct {
     uint32_t gpio_clock;
     uint32_t usart_clock;
     uint32_t af;
+    uint8_t usart_irq;  /* only for stm32_usart_recv_circular */
+    uint8_t half_duplex;  /* one wire, on the TX pin, open drain */
 } stm32_usart_config_t;
 
 typedef struct {
     const stm32_usart_config_t *config;
     const stm32_dma_t *dma;
     uint32_t baud;
+    uint8_t *rx_circular;  /* the buffer, while a circular RX runs */
+    size_t rx_circular_len;
+    /* the TX ring, see stm32_usart_tx_ring */
+    uint8_t *tx_ring;
+    size_t tx_ring_len;
+    volatile size_t tx_head;
+    volatile size_t tx_tail;
+    volatile size_t tx_dma_len;
 } stm32_usart_t;
     
 void stm32_usart_init_device(stm32_usart_t *usart);
 void stm32_usart_set_baud(stm32_usart_t *usart, uint32_t baud);
 size_t stm32_usart_write(stm32_usart_t *usart, const uint8_t *buf, size_t len);
 size_t stm32_usart_read(stm32_usart_t *usart, uint8_t *buf, size_t len);
+void stm32_usart_tx_ring(stm32_usart_t *usart, uint8_t *buf, size_t len);
+size_t stm32_usart_write_async(stm32_usart_t *usart, const uint8_t *buf, size_t len);
+void stm32_usart_tx_flush(stm32_usart_t *usart);
+void stm32_usart_tx_ring_isr(stm32_usart_t *usart);
 void stm32_usart_send_dma(stm32_usart_t *usart, uint32_t *data, size_t len);
 void stm32_usart_recv_dma(stm32_usart_t *usart, uint32_t *data, size_t len);
 
+void stm32_usart_recv_circular(stm32_usart_t *usart, uint8_t *buf, size_t len);
+size_t stm32_usart_rx_circular_pos(stm32_usart_t *usart);
+void stm32_usart_stop_circular(stm32_usart_t *usart);
+
 void stm32_usart_tx_isr(stm32_usart_t *usart, dma_callback callback);
 void stm32_usart_rx_isr(stm32_usart_t *usart, dma_callback callback);
+uint8_t stm32_usart_idle_isr(stm32_usart_t *usart);
 
 static inline void _stm32_usart_tx_isr(void);
 static inline void _stm32_usart_rx_isr(void);
@@ -68,3 +87,30 @@ static inline void _stm32_usart_rx_isr(void);
         stm32_usart_rx_isr(usart, callback); \
     }
 
+/* A circular RX. The callback is called, in the ISR, at each half of the
+ * buffer and whenever the line goes quiet, to go and see what has come */
+#define STM32_USART_MK_RX_CIRCULAR_IRQ_HANDLERS(usart, dma_channel, stream, usart_n, callback) \
+    void DMA ## dma_channel ## _Stream ## stream ## _IRQHandler(void) \
+    { \
+        traceISR_ENTER(); \
+        stm32_dma_rx_circular_isr((usart)->dma); \
+        callback(); \
+        traceISR_EXIT(); \
+    } \
+    \
+    void USART ## usart_n ## _IRQHandler(void) \
+    { \
+        traceISR_ENTER(); \
+        if (stm32_usart_idle_isr(usart)) \
+            callback(); \
+        traceISR_EXIT(); \
+    }
+
+/* The TX DMA's interrupt, for a USART with a TX ring */
+#define STM32_USART_MK_TX_RING_IRQ_HANDLER(usart, dma_channel, stream) \
+    void DMA ## dma_channel ## _Stream ## stream ## _IRQHandler(void) \
+    { \
+        traceISR_ENTER(); \
+        stm32_usart_tx_ring_isr(usart); \
+        traceISR_EXIT(); \
+    }
@@ -15,6 +15,7 @@
 #include "log.h"
 #include "stm32_power.h"
 #include "stm32_buttons_platform.h"
+#include "stm32_dma.h"
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include "task.h"
@@ -45,6 +46,8 @@ void platform_init_late()
     // it needs a gentle reminder
     NVIC_PriorityGroupConfig(NVIC_PriorityGroup_4);
 
+    hw_dma_init();
+
     // ginge: the below may only apply to non-snowy
     // joshua - Yesterday at 8:42 PM
     // I recommend setting RTCbackup[0] 0x20000 every time you boot
@@ -22,7 +22,6 @@ void platform_init_late(void);
 
 // internal
 void init_USART3(void);
-void init_USART8(void);
 
 
 // implementation
@@ -11,3 +11,16 @@ uint8_t hw_bluetooth_init() {
 
 void bt_device_request_tx() {
 }
+
+void hw_bluetooth_sleep(uint8_t sleep) {
+}
+
+void bt_device_request_tx_iov() {
+}
+
+void bt_device_link_boost(uint32_t ms) {
+}
+
+void bt_device_link_params(bt_link_params_t *params) {
+    memset(params, 0, sizeof(bt_link_params_t));
+}
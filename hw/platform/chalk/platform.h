@@ -10,12 +10,16 @@
 #include "platform_config.h"
 #include "chalk.h"
 #include "stm32_backlight.h"
+#include "stm32_dma2d.h"
+#include "stm32_crc.h"
 #include "snowy_power.h"
 #include "snowy_vibrate.h"
 #include "snowy_display.h"
 #include "stm32_buttons.h"
 #include "stm32_rtc.h"
 #include "snowy_ambient.h"
+#include "snowy_accel.h"
+#include "snowy_smartstrap.h"
 #include "snowy_ext_flash.h"
 
 #include "debug.h"
@@ -11,6 +11,9 @@
 #define DISPLAY_ROWS 180
 #define DISPLAY_COLS 180
 
+//We are a round device. Only a circle of the display is behind the glass
+#define PBL_ROUND
+
 extern unsigned char _binary_Resources_chalk_fpga_bin_size;
 extern unsigned char _binary_Resources_chalk_fpga_bin_start;
 #define DISPLAY_FPGA_ADDR &_binary_Resources_chalk_fpga_bin_start
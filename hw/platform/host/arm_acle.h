@@ -0,0 +1,18 @@
+#pragma once
+/* arm_acle.h
+ * The few DSP intrinsics rwatch uses, in plain C for the host build
+ * RebbleOS
+ */
+#include <stdint.h>
+
+/* lo * lo - hi * hi, of the signed halfwords */
+static inline int32_t __smusd(uint32_t a, uint32_t b)
+{
+    return (int16_t)a * (int16_t)b - (int16_t)(a >> 16) * (int16_t)(b >> 16);
+}
+
+/* lo * hi + hi * lo, of the signed halfwords */
+static inline int32_t __smuadx(uint32_t a, uint32_t b)
+{
+    return (int16_t)a * (int16_t)(b >> 16) + (int16_t)(a >> 16) * (int16_t)b;
+}
@@ -0,0 +1,47 @@
+# The graphics stack built natively, against the fake display, flash,
+# clock and buttons in host.c, to benchmark on the desk. Not a watch, so it
+# isn't in PLATFORMS: `make gbench` builds rwatch/ui/test/graphics_bench.c
+# and runs it over snowy's resources. Pass it options with GBENCHFLAGS.
+#
+# `make fsbench` builds rcore/test/fs_bench.c, the filesystem and resources
+# over a whole flash image, and runs it over snowy's QEMU SPI image, or
+# FSBENCHIMAGE, a dump off a watch say. Pass it options with FSBENCHFLAGS.
+
+HOSTCC ?= cc
+# The firmware assumes 32 bit pointers throughout. On Debian, gcc-multilib
+HOSTARCH ?= -m32
+
+CFLAGS_host = $(HOSTARCH) -O2 -g -std=gnu99 -Wall -ffunction-sections -fdata-sections
+CFLAGS_host += -Wno-unused-variable -Wno-unused-function -Wno-builtin-declaration-mismatch
+# ours first, so our portmacro.h and platform.h are the ones found
+CFLAGS_host += -Ihw/platform/host
+CFLAGS_host += $(CFLAGS_driver_stm32_buttons)
+CFLAGS_host += $(filter-out -IFreeRTOS/portable/%,$(filter -I% -D%,$(CFLAGS_all)))
+CFLAGS_host += -I$(BUILD)/snowy/res
+CFLAGS_host += -DREBBLE_PLATFORM=host -DREBBLE_PLATFORM_HOST
+
+LDFLAGS_host = $(HOSTARCH) -Wl,--gc-sections
+
+SRCS_host = $(filter lib/neographics/%,$(SRCS_all))
+SRCS_host += lib/minilib/qalloc.c
+SRCS_host += lib/pbl_strftime/src/strftime.c
+SRCS_host += rcore/resource.c
+SRCS_host += rcore/appmanager_app_timer.c
+SRCS_host += rwatch/ngfxwrap.c
+SRCS_host += rwatch/math_sin.c
+SRCS_host += rwatch/clock_format.c
+SRCS_host += rwatch/packbits.c
+SRCS_host += $(filter rwatch/graphics/% rwatch/ui/layer/% rwatch/ui/animation/%,$(SRCS_all))
+SRCS_host += rwatch/ui/window.c
+SRCS_host += rwatch/ui/action_menu.c
+SRCS_host += hw/platform/host/host.c
+
+SRCS_gbench = $(SRCS_host)
+SRCS_gbench += hw/platform/host/host_pack.c
+SRCS_gbench += rwatch/ui/test/graphics_bench.c
+
+SRCS_fsbench = $(SRCS_host)
+SRCS_fsbench += rcore/fs.c
+SRCS_fsbench += rcore/appmanager_app.c
+SRCS_fsbench += hw/platform/host/host_flash.c
+SRCS_fsbench += rcore/test/fs_bench.c
@@ -0,0 +1,419 @@
+/* host.c
+ * The hardware, and the bits of rcore around it, as the graphics stack
+ * sees them, for running it on the desk
+ * RebbleOS
+ *
+ * There is one thread, the app's, and no scheduler. The display is a
+ * buffer. Flash is whatever host_flash_load reads in: the system resource
+ * pack alone, see host_pack.c, or a whole flash image, see host_flash.c.
+ * Time only moves when host_advance says so, and app timers fire from
+ * there, as the runloop would fire them. Buttons are pressed with
+ * host_button_click. The app heap is a qalloc arena the size of the
+ * watch's, so what runs out of memory there runs out here too.
+ *
+ * Anything else the stack calls lands in a stub below; gc-sections drops
+ * what is never called.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include "rebbleos.h"
+#include "librebble.h"
+#include "overlay_manager.h"
+#include "ngfxwrap.h"
+#include "gpath_cache.h"
+#include "tick_timer_service.h"
+#include "power.h"
+
+/* the real thing from here on */
+#undef malloc
+#undef calloc
+#undef free
+
+uint32_t SystemCoreClock = 100000000;
+volatile uint8_t log_level = APP_LOG_LEVEL_WARNING;
+
+static bool _flash_loaded;
+static TickType_t _ticks;
+
+static uint8_t _fb[MAX_FRAMEBUFFER_SIZE] __attribute__((aligned(4)));
+
+static App _app = { .type = APP_TYPE_SYSTEM, .is_internal = true, .name = "bench" };
+static uint8_t _heap[MEMORY_SIZE_APP_HEAP] __attribute__((aligned(8)));
+static app_running_thread _thread = {
+    .thread_type = AppThreadMainApp,
+    .app = &_app,
+    .status = AppThreadRunloop,
+    .thread_name = "app",
+};
+
+static ClickHandler _click[NUM_BUTTONS];
+static void *_click_context[NUM_BUTTONS];
+
+/*
+ * Read the flash, and bring up what the app thread would find up. Again
+ * between runs, for a fresh app
+ */
+void host_init(const char *flash)
+{
+    if (!_flash_loaded)
+    {
+        host_flash_load(flash);
+        _flash_loaded = true;
+
+        resource_init();
+        fonts_init();
+    }
+
+    _thread.arena = qinit(_heap, MEMORY_SIZE_APP_HEAP);
+    _thread.timer_head = NULL;
+    fonts_resetcache();
+    gpath_cache_reset();
+    resource_bitmap_cache_reset();
+    memset(_click, 0, sizeof(_click));
+    memset(_click_context, 0, sizeof(_click_context));
+    rwatch_neographics_init(&_thread);
+}
+
+/* Move the clock on, and fire what came due on the way */
+void host_advance(uint32_t ms)
+{
+    TickType_t until = _ticks + pdMS_TO_TICKS(ms);
+
+    while (_thread.timer_head && _thread.timer_head->when <= until)
+    {
+        if (_thread.timer_head->when > _ticks)
+            _ticks = _thread.timer_head->when;
+        appmanager_timer_expired(&_thread);
+    }
+    _ticks = until;
+}
+
+void host_button_click(hw_button_t button)
+{
+    if (_click[button])
+        _click[button](NULL, _click_context[button]);
+}
+
+/* FreeRTOS. Just what the stack calls */
+
+TickType_t xTaskGetTickCount(void)
+{
+    return _ticks;
+}
+
+uint32_t hw_cycle_count(void)
+{
+    return 0;
+}
+
+QueueHandle_t xQueueCreateMutexStatic(const uint8_t ucQueueType, StaticQueue_t *pxStaticQueue)
+{
+    return (QueueHandle_t)pxStaticQueue;
+}
+
+QueueHandle_t xQueueCreateMutex(const uint8_t ucQueueType)
+{
+    static StaticQueue_t mutex;
+    return (QueueHandle_t)&mutex;
+}
+
+BaseType_t xQueueGenericReceive(QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait, const BaseType_t xJustPeek)
+{
+    return pdTRUE;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait, const BaseType_t xCopyPosition)
+{
+    return pdTRUE;
+}
+
+/* As the STM32's CRC unit does it, see Utilities/stm32_crc.py */
+uint32_t rcore_crc32(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i += 4)
+    {
+        uint32_t word = 0;
+        size_t n = len - i < 4 ? len - i : 4;
+
+        if (n == 4)
+            memcpy(&word, p + i, 4);
+        else
+            /* a short tail is padded at the front, then reversed */
+            for (size_t j = 0; j < n; j++)
+                word |= (uint32_t)p[i + n - 1 - j] << (8 * j);
+
+        crc ^= word;
+        for (int b = 0; b < 32; b++)
+            crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+    }
+
+    return crc;
+}
+
+void panic(const char *s)
+{
+    fprintf(stderr, "panic: %s\n", s);
+    abort();
+}
+
+void log_printf_to_ar(const char *layer, const char *module, uint8_t level, const char *filename, uint32_t line_no, const char *fmt, ...)
+{
+    va_list ar;
+
+    va_start(ar, fmt);
+    fprintf(stderr, "[%s][%s:%lu] ", layer, filename, line_no);
+    vfprintf(stderr, fmt, ar);
+    fprintf(stderr, "\n");
+    va_end(ar);
+}
+
+/* Memory. The app heap is the app's arena; the rest comes from libc */
+
+void *app_calloc(size_t count, size_t size)
+{
+    void *x = qalloc(_thread.arena, count * size);
+    if (x)
+        memset(x, 0, count * size);
+    return x;
+}
+
+void *app_malloc(size_t size)
+{
+    return app_calloc(1, size);
+}
+
+void *app_pool_calloc(size_t size)
+{
+    return app_calloc(1, size);
+}
+
+void *app_realloc(void *mem, size_t new_size)
+{
+    return qrealloc(_thread.arena, mem, new_size);
+}
+
+void app_free(void *mem)
+{
+    qfree(_thread.arena, mem);
+}
+
+uint32_t app_heap_bytes_free(void)
+{
+    return qfreebytes(_thread.arena);
+}
+
+void *system_calloc(size_t count, size_t size)
+{
+    return calloc(count, size);
+}
+
+void *system_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void system_free(void *mem)
+{
+    free(mem);
+}
+
+void *pvPortMalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void vPortFree(void *mem)
+{
+    free(mem);
+}
+
+/* The app manager, with one app in it, ours */
+
+app_running_thread *appmanager_get_current_thread(void)
+{
+    return &_thread;
+}
+
+App *appmanager_get_current_app(void)
+{
+    return &_app;
+}
+
+AppThreadType appmanager_get_thread_type(void)
+{
+    return AppThreadMainApp;
+}
+
+bool appmanager_is_thread_app(void)
+{
+    return true;
+}
+
+bool appmanager_is_thread_overlay(void)
+{
+    return false;
+}
+
+bool appmanager_is_thread_system(void)
+{
+    return false;
+}
+
+bool appmanager_is_app_shutting_down(void)
+{
+    return false;
+}
+
+/* the harness draws every frame anyway */
+void appmanager_app_draw_request(uint8_t force)
+{
+}
+
+/* and there are no overlays */
+
+bool overlay_window_accepts_keypress(void)
+{
+    return false;
+}
+
+void overlay_window_stack_push_window(Window *window, bool animated)
+{
+}
+
+bool overlay_window_stack_contains_window(Window *window)
+{
+    return false;
+}
+
+void overlay_window_destroy_window(Window *window)
+{
+}
+
+bool overlay_window_stack_remove(OverlayWindow *overlay_window, bool animated)
+{
+    return false;
+}
+
+uint8_t overlay_window_count(void)
+{
+    return 0;
+}
+
+/* Nothing is ever in the way */
+
+GRect unobstructed_area_get(void)
+{
+    return GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+}
+
+void unobstructed_area_release(Layer *layer)
+{
+}
+
+/* The display */
+
+uint8_t *display_get_buffer(void)
+{
+    return _fb;
+}
+
+uint8_t *hw_display_get_buffer(void)
+{
+    return _fb;
+}
+
+bool display_is_buffer_locked(void)
+{
+    return false;
+}
+
+bool display_buffer_lock_take(uint32_t timeout)
+{
+    return true;
+}
+
+bool display_buffer_lock_give(void)
+{
+    return true;
+}
+
+/* frames go out the moment they are asked for */
+bool display_is_busy(void)
+{
+    return false;
+}
+
+void display_draw(void)
+{
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+}
+
+/* A full battery, so nothing is slowed down */
+
+bool power_is_saving(void)
+{
+    return false;
+}
+
+/* Time stands still but for the harness, at ten past ten as the ads have it */
+
+static struct tm _tm = { .tm_hour = 10, .tm_min = 9, .tm_sec = 30, .tm_mday = 15, .tm_mon = 9, .tm_year = 126 };
+
+struct tm *rebble_time_get_tm(void)
+{
+    time_t t = mktime(&_tm) + _ticks / configTICK_RATE_HZ;
+    static struct tm now;
+
+    localtime_r(&t, &now);
+    return &now;
+}
+
+void tick_listener_subscribe(TickListener *listener)
+{
+}
+
+void tick_listener_unsubscribe(TickListener *listener)
+{
+}
+
+/* Buttons. Single clicks only, which is what the scenes press */
+
+void button_single_click_subscribe(ButtonId button_id, ClickHandler handler)
+{
+    _click[button_id] = handler;
+}
+
+void button_single_repeating_click_subscribe(ButtonId button_id, uint16_t repeat_interval_ms, ClickHandler handler)
+{
+    _click[button_id] = handler;
+}
+
+void button_multi_click_subscribe(ButtonId button_id, uint8_t min_clicks, uint8_t max_clicks, uint16_t timeout, bool last_click_only, ClickHandler handler)
+{
+}
+
+void button_long_click_subscribe(ButtonId button_id, uint16_t delay_ms, ClickHandler down_handler, ClickHandler up_handler)
+{
+}
+
+void button_raw_click_subscribe(ButtonId button_id, ClickHandler down_handler, ClickHandler up_handler, void *context)
+{
+    if (context != NULL)
+        _click_context[button_id] = context;
+}
+
+void button_set_click_context(ButtonId button_id, void *context)
+{
+    _click_context[button_id] = context;
+}
+
+bool click_recognizer_is_repeating(ClickRecognizerRef recognizer)
+{
+    return false;
+}
@@ -0,0 +1,146 @@
+/* host_flash.c
+ * Flash for the fs bench: a whole flash image, and the reads off it counted
+ * RebbleOS
+ *
+ * The image is a QEMU SPI image or a dump off a watch, read into memory at
+ * address 0, so the resource pack and the filesystem are where snowy has
+ * them. Writes and erases land on the copy in memory; the file is never
+ * touched. Every read is counted in flash_stats as flash.c counts them, a
+ * strided read as one per stride, so the counts are the watch's.
+ */
+#include <stdio.h>
+#include "rebbleos.h"
+#include "flash.h"
+
+#undef malloc
+
+#define HOST_FLASH_SIZE (REGION_CRASH_START + REGION_CRASH_SIZE)
+
+static uint8_t *_flash;
+static FlashStats _stats;
+
+void host_flash_load(const char *image)
+{
+    FILE *f = fopen(image, "rb");
+    size_t size;
+
+    if (!f)
+    {
+        perror(image);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > HOST_FLASH_SIZE)
+        size = HOST_FLASH_SIZE;
+
+    /* a short image is erased flash past its end */
+    _flash = malloc(HOST_FLASH_SIZE);
+    memset(_flash, 0xff, HOST_FLASH_SIZE);
+    if (fread(_flash, 1, size, f) != size)
+    {
+        perror(image);
+        exit(1);
+    }
+    fclose(f);
+}
+
+static bool _in_flash(uint32_t address, size_t num_bytes)
+{
+    return address < HOST_FLASH_SIZE && num_bytes <= HOST_FLASH_SIZE - address;
+}
+
+void flash_read_bytes(uint32_t address, uint8_t *buffer, size_t num_bytes)
+{
+    _stats.reads++;
+    _stats.bytes += num_bytes;
+
+    memset(buffer, 0xff, num_bytes);
+    if (_in_flash(address, num_bytes))
+        memcpy(buffer, _flash + address, num_bytes);
+}
+
+void flash_read_bytes_strided(uint32_t address, uint32_t stride, uint16_t count, uint8_t *buffer, size_t num_bytes)
+{
+    for (uint16_t i = 0; i < count; i++)
+        flash_read_bytes(address + i * stride, buffer + i * num_bytes, num_bytes);
+}
+
+/* as NOR flash does it, bits only go from 1 to 0 */
+void flash_write_bytes(uint32_t address, const uint8_t *buffer, size_t num_bytes)
+{
+    if (!_in_flash(address, num_bytes))
+        return;
+    for (size_t i = 0; i < num_bytes; i++)
+        _flash[address + i] &= buffer[i];
+}
+
+void flash_erase(uint32_t address, size_t num_bytes)
+{
+    if (_in_flash(address, num_bytes))
+        memset(_flash + address, 0xff, num_bytes);
+}
+
+/* No read, on the watch or here */
+const void *flash_map(uint32_t address, size_t num_bytes)
+{
+    if (!_in_flash(address, num_bytes))
+        return NULL;
+    return _flash + address;
+}
+
+bool flash_unmap(const void *ptr)
+{
+    return (const uint8_t *)ptr >= _flash && (const uint8_t *)ptr < _flash + HOST_FLASH_SIZE;
+}
+
+void flash_stats(FlashStats *stats)
+{
+    *stats = _stats;
+}
+
+/* The fs GC thread is never started, as the bench only reads */
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t ulStackDepth,
+                               void * const pvParameters, UBaseType_t uxPriority, StackType_t * const puxStackBuffer,
+                               StaticTask_t * const pxTaskBuffer)
+{
+    return (TaskHandle_t)pxTaskBuffer;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction, uint32_t *pulPreviousNotificationValue)
+{
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    return 0;
+}
+
+/* The apps built in, listed in the manifest but never run */
+
+void systemapp_main(void)
+{
+}
+
+void simple_main(void)
+{
+}
+
+void nivz_main(void)
+{
+}
+
+void test_main(void)
+{
+}
+
+void notif_main(void)
+{
+}
+
+void testapp_main(void)
+{
+}
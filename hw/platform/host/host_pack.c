@@ -0,0 +1,71 @@
+/* host_pack.c
+ * Flash for the graphics bench: the system resource pack and nothing else
+ * RebbleOS
+ *
+ * The pack is read into memory where the watch would have it. There is no
+ * filesystem, and so no app resources.
+ */
+#include <stdio.h>
+#include "rebbleos.h"
+
+#undef malloc
+
+static uint8_t *_pack;
+static size_t _pack_size;
+
+void host_flash_load(const char *pbpack)
+{
+    FILE *f = fopen(pbpack, "rb");
+    if (!f)
+    {
+        perror(pbpack);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    _pack_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    _pack = malloc(_pack_size);
+    if (fread(_pack, 1, _pack_size, f) != _pack_size)
+    {
+        perror(pbpack);
+        exit(1);
+    }
+    fclose(f);
+}
+
+void flash_read_bytes(uint32_t address, uint8_t *buffer, size_t num_bytes)
+{
+    memset(buffer, 0xff, num_bytes);
+    if (address >= REGION_RES_START && address - REGION_RES_START < _pack_size)
+    {
+        size_t ofs = address - REGION_RES_START;
+        memcpy(buffer, _pack + ofs, num_bytes < _pack_size - ofs ? num_bytes : _pack_size - ofs);
+    }
+}
+
+const void *flash_map(uint32_t address, size_t num_bytes)
+{
+    if (address < REGION_RES_START || address - REGION_RES_START + num_bytes > _pack_size)
+        return NULL;
+    return _pack + address - REGION_RES_START;
+}
+
+bool flash_unmap(const void *ptr)
+{
+    return (const uint8_t *)ptr >= _pack && (const uint8_t *)ptr < _pack + _pack_size;
+}
+
+void fs_open(struct fd *fd, const struct file *file)
+{
+    memset(fd, 0, sizeof(*fd));
+}
+
+int fs_read(struct fd *fd, void *p, size_t n)
+{
+    return 0;
+}
+
+long fs_seek(struct fd *fd, long ofs, enum seek whence)
+{
+    return 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+/* platform.h
+ * Includes for the host build: the graphics stack on the desk, see host.c
+ * RebbleOS
+ */
+#include "platform_config.h"
+#include "stm32_buttons.h"
+#include "debug.h"
+
+#define MAX_FRAMEBUFFER_SIZE DISPLAY_ROWS * DISPLAY_COLS
+
+#define WATCHDOG_RESET_MS 500
+
+uint8_t *hw_display_get_buffer(void);
+
+/* as snowy's, for gyro.h. There's no accelerometer */
+typedef struct hw_accel_sample {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} hw_accel_sample_t;
+
+/* for the harness, in host.c */
+void host_init(const char *flash);
+void host_advance(uint32_t ms);
+void host_button_click(hw_button_t button);
+
+/* and from whichever of host_pack.c or host_flash.c is linked in */
+void host_flash_load(const char *path);
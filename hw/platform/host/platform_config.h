@@ -0,0 +1,56 @@
+#pragma once
+/* platform_config.h
+ * Configuration for the host build. It draws as snowy does, and reads
+ * snowy's resource pack and filesystem
+ * RebbleOS
+ */
+
+#define RTOS_HEAP_SIZE 30 * 1024
+
+/* Size of the app + stack + heap of the running app. 
+   IN BYTES
+ */ 
+#define MEMORY_SIZE_APP           90000
+#define MEMORY_SIZE_WORKER        10500
+#define MEMORY_SIZE_OVERLAY       18000
+#define MEMORY_SIZE_FONT_CACHE    24000
+#define MEMORY_SIZE_GLYPH_CACHE   8000
+#define MEMORY_SIZE_RES_BITMAP_CACHE 8000
+
+/* Size of the stack in WORDS */
+#define MEMORY_SIZE_APP_STACK     3000
+#define MEMORY_SIZE_WORKER_STACK  250
+#define MEMORY_SIZE_OVERLAY_STACK 350
+
+#define MEMORY_SIZE_APP_HEAP      MEMORY_SIZE_APP - (MEMORY_SIZE_APP_STACK * 4)
+#define MEMORY_SIZE_WORKER_HEAP   MEMORY_SIZE_WORKER - (MEMORY_SIZE_WORKER_STACK * 4)
+#define MEMORY_SIZE_OVERLAY_HEAP  MEMORY_SIZE_OVERLAY - (MEMORY_SIZE_OVERLAY_STACK * 4)
+
+/* the pack is read into memory at this address, as the QEMU SPI image has it */
+#define REGION_RES_START        0x380000
+#define REGION_RES_SIZE         0x7D000
+
+#define REGION_APP_RES_START    0xB3A000
+#define REGION_APP_RES_SIZE     0x7D000
+
+#define APP_RES_START           0x1000
+#define RES_START               0x200C
+
+/* and the filesystem too, for the fs bench's whole images */
+#define REGION_FS_START         0x400000
+#define REGION_FS_PAGE_SIZE     0x2000
+#define REGION_FS_N_PAGES       ((REGION_CRASH_START - REGION_FS_START) / REGION_FS_PAGE_SIZE)
+#define REGION_FS_ERASE_SIZE    0x20000
+
+#define REGION_CRASH_START      0xFE0000
+#define REGION_CRASH_SIZE       0x20000
+
+/* one heap, no banks */
+#define CCRAM
+#define HOT_RAMFUNC
+#define HOT_DATA
+
+#define DISPLAY_ROWS 168
+#define DISPLAY_COLS 144
+
+#define PBL_RECT
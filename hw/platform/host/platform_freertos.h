@@ -0,0 +1,7 @@
+#ifndef _PLATFORM_FREERTOS_H
+#define _PLATFORM_FREERTOS_H
+
+/* nothing runs the scheduler on the host, the clock is for show */
+extern uint32_t SystemCoreClock;
+
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+/* stm32_usart.h
+ * rbl_bluetooth.h wants the type. The host build has no UARTs
+ * RebbleOS
+ */
+typedef struct stm32_usart_t stm32_usart_t;
@@ -25,3 +25,5 @@ extern unsigned char _binary_Resources_snowy_fpga_bin_start;
 #define BLUETOOTH_MODULE_NAME_LENGTH 0x0d
 #define BLUETOOTH_MODULE_LE_NAME     'P', 'e', 'b', 'b', 'l', 'e', ' ', 'T', 'i', 'm', 'e', 'L', 'E'
 #define BLUETOOTH_MODULE_GAP_NAME    "Pebble Time RblOs"
+/* the HCI UART once the chip is up. APB2 is 50MHz, this is it /16 exactly */
+#define BLUETOOTH_MODULE_UART_BAUD   3125000
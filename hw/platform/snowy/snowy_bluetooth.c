@@ -31,6 +31,7 @@ static const stm32_usart_config_t _usart1_config = {
     .gpio_clock           = RCC_AHB1Periph_GPIOA,
     .usart_clock          = RCC_APB2Periph_USART1,
     .af                   = GPIO_AF_USART1,
+    .usart_irq            = USART1_IRQn,
 };
 
 /* dma tx: dma stream 7 chan 4, rx: stream 2 chan 4. 
@@ -56,7 +57,7 @@ static const stm32_bluetooth_config_t stm32_cc256x_config = {
 /* IRQ handlers
  * TX: DMA 2 stream 7.
  * RX: DMA 2 stream 2. */
-STM32_CC256X_MK_IRQ_HANDLERS(&_usart1, 2, 7, 2)
+STM32_CC256X_MK_IRQ_HANDLERS(&_usart1, 2, 7, 2, 1)
 
 uint8_t hw_bluetooth_init(void)
 {
@@ -108,6 +109,14 @@ void hw_bluetooth_disable_cts_irq(void)
     stm32_cc256x_disable_cts_irq();
 }
 
+/*
+ * eHCILL says the link may sleep, or must wake
+ */
+void hw_bluetooth_sleep(uint8_t sleep)
+{
+    stm32_cc256x_sleep(sleep);
+}
+
 stm32_usart_t *hw_bluetooth_get_usart(void)
 {
     return &_usart1;
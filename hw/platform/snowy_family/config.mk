@@ -7,6 +7,10 @@ CFLAGS_snowy_family += $(CFLAGS_driver_stm32_buttons)
 CFLAGS_snowy_family += $(CFLAGS_driver_stm32_power)
 CFLAGS_snowy_family += $(CFLAGS_driver_stm32_rtc)
 CFLAGS_snowy_family += $(CFLAGS_driver_stm32_backlight)
+CFLAGS_snowy_family += $(CFLAGS_driver_stm32_dma2d)
+CFLAGS_snowy_family += $(CFLAGS_driver_stm32_crc)
+CFLAGS_snowy_family += $(CFLAGS_driver_stm32_delay)
+CFLAGS_snowy_family += $(CFLAGS_driver_stm32_pc_sample)
 CFLAGS_snowy_family += -Ihw/platform/snowy_family
 
 SRCS_snowy_family = $(SRCS_stm32f4xx)
@@ -18,14 +22,30 @@ SRCS_snowy_family += $(SRCS_driver_stm32_buttons)
 SRCS_snowy_family += $(SRCS_driver_stm32_power)
 SRCS_snowy_family += $(SRCS_driver_stm32_rtc)
 SRCS_snowy_family += $(SRCS_driver_stm32_backlight)
+SRCS_snowy_family += $(SRCS_driver_stm32_dma2d)
+SRCS_snowy_family += $(SRCS_driver_stm32_crc)
+SRCS_snowy_family += $(SRCS_driver_stm32_delay)
+SRCS_snowy_family += $(SRCS_driver_stm32_pc_sample)
 SRCS_snowy_family += hw/platform/snowy_family/snowy_display.c
 SRCS_snowy_family += hw/platform/snowy_family/snowy_power.c
 SRCS_snowy_family += hw/platform/snowy_family/snowy_scanlines.c
 SRCS_snowy_family += hw/platform/snowy_family/snowy_vibrate.c
 SRCS_snowy_family += hw/platform/snowy_family/snowy_ambient.c
+SRCS_snowy_family += hw/platform/snowy_family/snowy_accel.c
+SRCS_snowy_family += hw/platform/snowy_family/snowy_smartstrap.c
+SRCS_snowy_family += hw/platform/snowy_family/snowy_adc.c
 SRCS_snowy_family += hw/platform/snowy_family/snowy_ext_flash.c
 SRCS_snowy_family += hw/platform/snowy_family/snowy_common.c
 
 LDFLAGS_snowy_family = $(LDFLAGS_stm32f4xx)
+
+# How much may be kept off the flash wait states, in bytes: HOT_RAMFUNC
+# code in SRAM, and HOT_DATA in CCM (see platform_config_common.h). The
+# link fails if either outgrows it; space.sh says how much is used
+HOT_TEXT_snowy_family = 8192
+HOT_DATA_snowy_family = 1024
+CFLAGS_snowy_family += -DHOT_PLACEMENT
+LDFLAGS_snowy_family += -Wl,--defsym,_hot_text_max=$(HOT_TEXT_snowy_family)
+LDFLAGS_snowy_family += -Wl,--defsym,_hot_data_max=$(HOT_DATA_snowy_family)
 LIBS_snowy_family = $(LIBS_stm32f4xx)
 
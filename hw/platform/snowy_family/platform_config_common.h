@@ -9,6 +9,9 @@
 #define MEMORY_SIZE_APP           90000
 #define MEMORY_SIZE_WORKER        10500
 #define MEMORY_SIZE_OVERLAY       18000
+#define MEMORY_SIZE_FONT_CACHE    24000
+#define MEMORY_SIZE_GLYPH_CACHE   8000
+#define MEMORY_SIZE_RES_BITMAP_CACHE 8000
 
 /* Size of the stack in WORDS */
 #define MEMORY_SIZE_APP_STACK     3000
@@ -33,7 +36,14 @@
 
 #define REGION_FS_START         0x400000
 #define REGION_FS_PAGE_SIZE     0x2000
-#define REGION_FS_N_PAGES       ((0x1000000 - REGION_FS_START) / REGION_FS_PAGE_SIZE)
+#define REGION_FS_N_PAGES       ((REGION_CRASH_START - REGION_FS_START) / REGION_FS_PAGE_SIZE)
+/* the S29VS erases 128K sectors (32K at the boot end) */
+#define REGION_FS_ERASE_SIZE    0x20000
+
+/* The last crash, see crash_dump.c. A sector to itself, off the end of
+ * the filesystem */
+#define REGION_CRASH_START      0xFE0000
+#define REGION_CRASH_SIZE       0x20000
 
 #define REGION_APP_RES_START    0xB3A000
 #define REGION_APP_RES_SIZE     0x7D000
@@ -60,5 +70,18 @@
  */
 #define CCRAM __attribute__((section(".ccmram")))
 
+/* For what is on the path of every frame or tick. HOT_RAMFUNC runs a
+ * function from SRAM, off the flash wait states; HOT_DATA keeps an object
+ * in CCM, where DMA to SRAM can't hold the CPU up (so nothing DMA
+ * touches). Both are copied in at reset. How much of each there may be is
+ * in config.mk */
+#ifdef HOT_PLACEMENT
+#define HOT_RAMFUNC __attribute__((section(".ramfunc"), noinline))
+#define HOT_DATA __attribute__((section(".ccmram.hot")))
+#else
+#define HOT_RAMFUNC
+#define HOT_DATA
+#endif
+
 //Snowy uses OC1 for backlight
 #define BL_TIM_CH 1
@@ -0,0 +1,71 @@
+/* snowy_accel.c
+ * Accelerometer for Pebble Time (snowy) and Round (chalk)
+ * RebbleOS
+ *
+ * The contract rcore/gyro.c drives: the sensor samples into its own FIFO
+ * at the rate it is started at, and calls the ISR once the FIFO holds
+ * watermark samples (or as near as the FIFO goes). hw_accel_read then
+ * empties it in one burst on the bus. Nothing wakes the MCU in between.
+ *
+ * Taps and flicks are the sensor's to spot, not ours: its tap and motion
+ * detectors, once enabled, raise the ISR with HW_ACCEL_EVENT_TAP through
+ * EXTI, FIFO or no FIFO, and hw_accel_tap_read says which axis and which
+ * way and clears it.
+ *
+ * There is no driver for the part on these boards yet, so there is no
+ * sensor: hw_accel_init says so, and the service tells apps it has
+ * nothing, as it did before.
+ */
+
+#include "snowy_accel.h"
+
+uint8_t hw_accel_init(void)
+{
+    return 0;
+}
+
+void hw_accel_set_isr(hw_accel_isr_t isr)
+{
+}
+
+/*
+ * Start sampling at hz into the FIFO, interrupting at watermark samples.
+ * Returns the watermark the FIFO took
+ */
+uint16_t hw_accel_start(uint16_t hz, uint16_t watermark)
+{
+    return 0;
+}
+
+void hw_accel_stop(void)
+{
+}
+
+/*
+ * Up to max samples out of the FIFO, oldest first, in one transfer
+ */
+uint16_t hw_accel_read(hw_accel_sample_t *buf, uint16_t max)
+{
+    return 0;
+}
+
+/*
+ * A single sample, with the FIFO stopped
+ */
+uint8_t hw_accel_peek(hw_accel_sample_t *sample)
+{
+    return 0;
+}
+
+void hw_accel_tap_enable(uint8_t enabled)
+{
+}
+
+/*
+ * The tap the ISR was for: axis 0 to 2 for x to z, direction 1 or -1.
+ * 0 if there wasn't one
+ */
+uint8_t hw_accel_tap_read(uint8_t *axis, int8_t *direction)
+{
+    return 0;
+}
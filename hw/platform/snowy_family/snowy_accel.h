@@ -0,0 +1,28 @@
+#pragma once
+/* snowy_accel.h
+ * Accelerometer for Pebble Time (snowy) and Round (chalk)
+ * RebbleOS
+ */
+
+#include <stdint.h>
+
+/* one sample, in mG */
+typedef struct hw_accel_sample {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} hw_accel_sample_t;
+
+/* what the sensor interrupted for */
+#define HW_ACCEL_EVENT_FIFO 1  /* the FIFO is at or past its watermark */
+#define HW_ACCEL_EVENT_TAP  2  /* its tap or motion detector went off */
+typedef void (*hw_accel_isr_t)(uint8_t events);
+
+uint8_t hw_accel_init(void);
+void hw_accel_set_isr(hw_accel_isr_t isr);
+uint16_t hw_accel_start(uint16_t hz, uint16_t watermark);
+void hw_accel_stop(void);
+uint16_t hw_accel_read(hw_accel_sample_t *buf, uint16_t max);
+uint8_t hw_accel_peek(hw_accel_sample_t *sample);
+void hw_accel_tap_enable(uint8_t enabled);
+uint8_t hw_accel_tap_read(uint8_t *axis, int8_t *direction);
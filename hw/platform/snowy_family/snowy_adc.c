@@ -0,0 +1,250 @@
+/* snowy_adc.c
+ * One ADC scan, by DMA, for everything on ADC1
+ * RebbleOS
+ *
+ * The battery and the ambient light sensor used to each set ADC1 up
+ * their own way and spin on single conversions. Now one scan converts
+ * every input a few times over, the DMA drops the lot into a buffer, and
+ * the completion interrupt averages them. Readers only ever look at the
+ * last averages.
+ *
+ * Scans are started by whoever wants fresher numbers, rather than free
+ * running off a timer: the ADC, DMA and GPIO clocks are only held while
+ * one is going, and the ambient sensor only powered for it.
+ *
+ * ADC1 is on DMA2 stream 4 channel 0 (stream 0 is the flash's).
+ */
+
+#include "stm32f4xx.h"
+#include "stm32f4xx_adc.h"
+#include "stm32f4xx_dma.h"
+#include "stm32_power.h"
+#include "stm32_dma.h"
+#include "snowy_adc.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* conversions of each input per scan, averaged */
+#define ADC_OVERSAMPLE      4
+#define ADC_CONVERSIONS     (HW_ADC_INPUTS * ADC_OVERSAMPLE)
+
+#define ADC_DMA_STREAM      DMA2_Stream4
+#define ADC_DMA_IRQ         DMA2_Stream4_IRQn
+#define ADC_DMA_FLAGS       STM32_DMA_MK_FLAGS(4)
+
+/* powers the ambient sensor, which is read on PA2 */
+#define ADC_AMBIENT_EN_PIN  GPIO_Pin_3
+
+/* In scan order. The ambient sensor is last, so it has had the others'
+ * conversions (~40us each) to settle after being switched on */
+static const uint8_t _channels[HW_ADC_INPUTS] = {
+    [HW_ADC_VREF]    = ADC_Channel_Vrefint,
+    [HW_ADC_BATTERY] = ADC_Channel_1,
+    [HW_ADC_AMBIENT] = ADC_Channel_2,
+};
+
+static uint16_t _samples[ADC_CONVERSIONS];
+static volatile uint16_t _values[HW_ADC_INPUTS];
+static volatile uint32_t _scans;
+static volatile uint8_t _busy;
+static volatile uint8_t _again;
+static uint8_t _initialised;
+
+static void _scan_start(void);
+
+/*
+ * Both the power and the ambient drivers need this, whichever is first
+ * sets it up
+ */
+void hw_adc_init(void)
+{
+    ADC_InitTypeDef ADC_InitStructure;
+    ADC_CommonInitTypeDef ADC_CommonInitStructure;
+    GPIO_InitTypeDef GPIO_InitStructure;
+    DMA_InitTypeDef DMA_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    if (_initialised)
+        return;
+    _initialised = 1;
+
+    stm32_power_request(STM32_POWER_APB2, RCC_APB2Periph_ADC1);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_OUT;
+    GPIO_InitStructure.GPIO_Pin = ADC_AMBIENT_EN_PIN;
+    GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_DOWN;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_2MHz;
+    GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+    GPIO_Init(GPIOA, &GPIO_InitStructure);
+    GPIO_ResetBits(GPIOA, ADC_AMBIENT_EN_PIN);
+
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AN;
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1 | GPIO_Pin_2;
+    GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+    GPIO_Init(GPIOA, &GPIO_InitStructure);
+
+    /* weird quirk after bootloader, so de-init and re-init */
+    ADC_DeInit();
+    ADC_CommonStructInit(&ADC_CommonInitStructure);
+    ADC_CommonInitStructure.ADC_Mode = ADC_Mode_Independent;
+    ADC_CommonInitStructure.ADC_Prescaler = ADC_Prescaler_Div8;
+    ADC_CommonInitStructure.ADC_DMAAccessMode = ADC_DMAAccessMode_Disabled;
+    ADC_CommonInitStructure.ADC_TwoSamplingDelay = ADC_TwoSamplingDelay_5Cycles;
+    ADC_CommonInit(&ADC_CommonInitStructure);
+
+    ADC_StructInit(&ADC_InitStructure);
+    ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+    ADC_InitStructure.ADC_Resolution = ADC_Resolution_12b;
+    ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;
+    ADC_InitStructure.ADC_ExternalTrigConv = 0;
+    ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_None;
+    ADC_InitStructure.ADC_NbrOfConversion = ADC_CONVERSIONS;
+    ADC_InitStructure.ADC_ScanConvMode = ENABLE;
+    ADC_Init(ADC1, &ADC_InitStructure);
+
+    /* vref wants 10us of sampling, the others are high impedance */
+    for (uint8_t i = 0; i < ADC_CONVERSIONS; i++)
+        ADC_RegularChannelConfig(ADC1, _channels[i / ADC_OVERSAMPLE], i + 1, ADC_SampleTime_480Cycles);
+
+    ADC_TempSensorVrefintCmd(ENABLE);
+    /* one pass of the sequence per scan, then the DMA stops asking */
+    ADC_DMARequestAfterLastTransferCmd(ADC1, DISABLE);
+    ADC_DMACmd(ADC1, ENABLE);
+    ADC_Cmd(ADC1, ENABLE);
+
+    DMA_DeInit(ADC_DMA_STREAM);
+    DMA_StructInit(&DMA_InitStructure);
+    DMA_InitStructure.DMA_Channel = DMA_Channel_0;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&ADC1->DR;
+    DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)_samples;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+    DMA_InitStructure.DMA_BufferSize = ADC_CONVERSIONS;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+    DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_Init(ADC_DMA_STREAM, &DMA_InitStructure);
+    DMA_ITConfig(ADC_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = ADC_DMA_IRQ;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 6;  // must be > 5
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_ADC1);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+}
+
+/*
+ * Returns what hw_adc_scans() will have reached once there is a reading
+ * started after this call. If a scan is going already, that is the one
+ * after it, which is queued up here
+ */
+uint32_t hw_adc_scan(void)
+{
+    uint32_t want;
+    uint8_t start = 0;
+
+    taskENTER_CRITICAL();
+    if (_busy)
+    {
+        _again = 1;
+        want = _scans + 2;
+    }
+    else
+    {
+        _busy = start = 1;
+        want = _scans + 1;
+    }
+    taskEXIT_CRITICAL();
+
+    if (start)
+    {
+        stm32_power_request(STM32_POWER_APB2, RCC_APB2Periph_ADC1);
+        stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
+        stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+        _scan_start();
+    }
+
+    return want;
+}
+
+/* With the clocks held */
+static void _scan_start(void)
+{
+    GPIO_SetBits(GPIOA, ADC_AMBIENT_EN_PIN);
+
+    DMA_ClearFlag(ADC_DMA_STREAM, ADC_DMA_FLAGS);
+    ADC_DMA_STREAM->M0AR = (uint32_t)_samples;
+    ADC_DMA_STREAM->NDTR = ADC_CONVERSIONS;
+    DMA_Cmd(ADC_DMA_STREAM, ENABLE);
+
+    /* after the last transfer the ADC won't ask again until DMA is
+     * turned off and on, which is also what clears any overrun */
+    ADC_ClearFlag(ADC1, ADC_FLAG_OVR);
+    ADC_DMACmd(ADC1, DISABLE);
+    ADC_DMACmd(ADC1, ENABLE);
+    ADC_SoftwareStartConv(ADC1);
+}
+
+uint16_t hw_adc_get(hw_adc_input_t input)
+{
+    return _values[input];
+}
+
+uint32_t hw_adc_scans(void)
+{
+    return _scans;
+}
+
+static void _adc_dma_isr(void)
+{
+    uint8_t ok = DMA_GetITStatus(ADC_DMA_STREAM, DMA_IT_TCIF4) == SET;
+
+    if (!ok && DMA_GetITStatus(ADC_DMA_STREAM, DMA_IT_TEIF4) != SET)
+        return;
+
+    DMA_ClearFlag(ADC_DMA_STREAM, ADC_DMA_FLAGS);
+    DMA_Cmd(ADC_DMA_STREAM, DISABLE);
+
+    /* a failed scan keeps the last good numbers, and still counts so that
+     * no one waits on it forever */
+    if (ok)
+    {
+        for (uint8_t i = 0; i < HW_ADC_INPUTS; i++)
+        {
+            uint32_t sum = 0;
+            for (uint8_t n = 0; n < ADC_OVERSAMPLE; n++)
+                sum += _samples[i * ADC_OVERSAMPLE + n];
+            _values[i] = sum / ADC_OVERSAMPLE;
+        }
+    }
+    _scans++;
+
+    if (_again)
+    {
+        _again = 0;
+        _scan_start();
+        return;
+    }
+
+    GPIO_ResetBits(GPIOA, ADC_AMBIENT_EN_PIN);
+    stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_ADC1);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    _busy = 0;
+}
+
+void DMA2_Stream4_IRQHandler(void)
+{
+    traceISR_ENTER();
+    _adc_dma_isr();
+    traceISR_EXIT();
+}
@@ -0,0 +1,35 @@
+#pragma once
+/* snowy_adc.h
+ * One ADC scan, by DMA, for everything on ADC1
+ * RebbleOS
+ */
+
+#include <stdint.h>
+
+typedef enum {
+    HW_ADC_VREF,     /* the core's 1.2V reference, to scale the others */
+    HW_ADC_BATTERY,  /* the PMIC's MON pin, if it is turned on */
+    HW_ADC_AMBIENT,
+    HW_ADC_INPUTS
+} hw_adc_input_t;
+
+void hw_adc_init(void);
+
+/**
+ * @brief Start a scan of every input, and return at once. If one is
+ * already going, another follows it. Any thread
+ * @return the hw_adc_scans() count at which there is a reading taken
+ * wholly after this call
+ */
+uint32_t hw_adc_scan(void);
+
+/**
+ * @brief The input's average from the last finished scan. Never waits.
+ * 0 until a scan has finished
+ */
+uint16_t hw_adc_get(hw_adc_input_t input);
+
+/**
+ * @brief How many scans have finished
+ */
+uint32_t hw_adc_scans(void);
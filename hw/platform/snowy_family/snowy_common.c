@@ -19,13 +19,10 @@
 #include "semphr.h"
 #include "task.h"
 #include "snowy_vibrate.h"
-
-// ENABLE this if you want smartstrap debugging output. For now if you do this qemu might not work
-#define DEBUG_UART_SMARTSTRAP
+#include "snowy_smartstrap.h"
+#include "crash_dump.h"
 
 void init_USART3(void);
-void init_USART8(void);
-void ss_debug_write(const unsigned char *p, size_t len);
 
 
 /* Configs */
@@ -49,67 +46,51 @@ static const stm32_usart_config_t _usart3_config = {
     .af                   = GPIO_AF_USART3,
 };
 
+/* TX only, for the ring. USART3_TX is DMA1 stream 3 channel 4 */
+static const stm32_dma_t _usart3_dma = {
+    .dma_clock            = RCC_AHB1Periph_DMA1,
+    .dma_tx_stream        = DMA1_Stream3,
+    .dma_rx_stream        = DMA1_Stream3,
+    .dma_tx_channel       = DMA_Channel_4,
+    .dma_rx_channel       = DMA_Channel_4,
+    .dma_irq_tx_pri       = 13,
+    .dma_irq_rx_pri       = 13,
+    .dma_irq_tx_channel   = DMA1_Stream3_IRQn,
+    .dma_irq_rx_channel   = DMA1_Stream3_IRQn,
+    .dma_tx_channel_flags = STM32_DMA_MK_FLAGS(3),
+    .dma_rx_channel_flags = STM32_DMA_MK_FLAGS(3),
+    .dma_tx_irq_flag      = DMA_IT_TCIF3,
+    .dma_rx_irq_flag      = DMA_IT_TCIF3,
+};
+
 static stm32_usart_t _usart3 = {
     &_usart3_config,
-    NULL, /* no dma */
+    &_usart3_dma,
     230400
 };
 
+/* Log output is copied in here and goes out by DMA. Not CCRAM */
+#define DEBUG_TX_RING_SIZE 1024
+static uint8_t _usart3_ring[DEBUG_TX_RING_SIZE];
+
+STM32_USART_MK_TX_RING_IRQ_HANDLER(&_usart3, 1, 3)
+
 /* 
  * Begin device init 
  */
 void debug_init()
 {
     init_USART3(); // general debugging
-#ifdef DEBUG_UART_SMARTSTRAP
-    init_USART8(); // smartstrap debugging
-#endif
+    stm32_usart_tx_ring(&_usart3, _usart3_ring, sizeof(_usart3_ring));
+    hw_smartstrap_debug_init(); // smartstrap debugging, if the port is for that
     DRV_LOG("debug", APP_LOG_LEVEL_INFO, "Usart 3/8 Init");
 }
 
 /* note that locking needs to be handled by external entity here */
 void debug_write(const unsigned char *p, size_t len)
 {
-    int i;
-    
-    stm32_power_request(STM32_POWER_APB1, RCC_APB1Periph_USART3);
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOC);
-    
-    for (i = 0; i < len; i++) {
-        while (!(USART3->SR & USART_SR_TC));
-        USART3->DR = p[i];
-    }
-    
-    stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_USART3);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOC);
-
-#ifdef DEBUG_UART_SMARTSTRAP
+    stm32_usart_write_async(&_usart3, p, len);
     ss_debug_write(p, len);
-#endif
-}
-
-/* note that locking needs to be handled by external entity here */
-void ss_debug_write(const unsigned char *p, size_t len)
-{
-#ifdef DEBUG_UART_SMARTSTRAP
-    int i;
-    UBaseType_t saved_int_status;
-
-    stm32_power_request(STM32_POWER_APB1, RCC_APB1Periph_UART8);
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
-    
-    RCC_APB1PeriphClockCmd(RCC_APB1Periph_UART8, ENABLE);
-    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOE, ENABLE);
-
-    
-    for (i = 0; i < len; i++) {
-        while (!(UART8->SR & USART_SR_TC));
-        USART_SendData(UART8, p[i]);
-    }
-    
-    stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_UART8);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
-#endif
 }
 
 void log_clock_enable(void)
@@ -132,40 +113,6 @@ void init_USART3(void)
     stm32_usart_init_device(&_usart3);
 }
 
-/*
- * Smartstrap port UART8 configured on GPIOE1
- */
-void init_USART8(void)
-{
-    GPIO_InitTypeDef GPIO_InitStruct;
-    USART_InitTypeDef USART_InitStruct;
-
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
-    stm32_power_request(STM32_POWER_APB1, RCC_APB1Periph_UART8);
-
-    GPIO_InitStruct.GPIO_Pin = /*GPIO_Pin_0 |*/ GPIO_Pin_1;
-    GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AF;
-    GPIO_InitStruct.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_InitStruct.GPIO_OType = GPIO_OType_PP;
-    GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_UP;
-    GPIO_Init(GPIOE, &GPIO_InitStruct);
-
-    //GPIO_PinAFConfig(GPIOE, GPIO_PinSource0, GPIO_AF_UART8);
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource1, GPIO_AF_UART8);
-
-    USART_InitStruct.USART_BaudRate = 230400;
-    USART_InitStruct.USART_WordLength = USART_WordLength_8b;
-    USART_InitStruct.USART_StopBits = USART_StopBits_1;
-    USART_InitStruct.USART_Parity = USART_Parity_No;
-    USART_InitStruct.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
-    USART_InitStruct.USART_Mode = USART_Mode_Tx /* | USART_Mode_Rx */;
-    USART_Init(UART8, &USART_InitStruct);
-    USART_Cmd(UART8, ENABLE);
-
-    stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_UART8);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
-}
-
 /* backlight */
 
 #include "stm32_backlight_platform.h"
@@ -201,41 +148,60 @@ static void  MemMang_Handler()
     while(1);
 }
 
-void HardFault_Handler()
+/* The stack the fault happened on goes to the C half in r0, with the
+ * frame the exception pushed on top, and EXC_RETURN in r1 */
+#define FAULT_HANDLER(name) \
+    __attribute__((naked)) void name##_Handler() \
+    { \
+        asm volatile ( \
+            "TST   LR, #4\n\t" \
+            "ITE   EQ\n\t" \
+            "MRSEQ R0, MSP\n\t" \
+            "MRSNE R0, PSP\n\t" \
+            "MOV   R1, LR\n\t" \
+            "LDR   R2, =" #name "_Handler_C\n\t" \
+            "BX    R2" \
+        ); \
+    }
+
+static void _fault_regs(uint32_t *sp)
+{
+    printf("   R0: %08lx, R1: %08lx, R2: %08lx, R3: %08lx\n", sp[0], sp[1], sp[2], sp[3]);
+    printf("  R12: %08lx, LR: %08lx, PC: %08lx, SP: %08lx\n", sp[4], sp[5], sp[6], (uint32_t) sp);
+}
+
+/* Each writes a crash record and resets, once boot is far enough along */
+__attribute__((used)) void HardFault_Handler_C(uint32_t *sp, uint32_t exc_return)
 {
     printf("*** HARD FAULT ***\n");
+    _fault_regs(sp);
+    crash_dump_capture(CrashDumpHardFault, sp, exc_return, 0, 0, NULL);
     while(1);
 }
 
-void BusFault_Handler()
+__attribute__((used)) void BusFault_Handler_C(uint32_t *sp, uint32_t exc_return)
 {
     printf("*** BUS FAULT ***\n");
+    _fault_regs(sp);
+    crash_dump_capture(CrashDumpBusFault, sp, exc_return, 0, 0, NULL);
     while(1);
 }
 
-void UsageFault_Handler_C(uint32_t *sp)
+__attribute__((used)) void UsageFault_Handler_C(uint32_t *sp, uint32_t exc_return)
 {
     uint16_t ufsr = *(uint16_t *)0xE000ED2A;
     
     printf("*** USAGE FAULT ***\n");
-    printf("   R0: %08lx, R1: %08lx, R2: %08lx, R3: %08lx\n", sp[0], sp[1], sp[2], sp[3]);
-    printf("  R12: %08lx, LR: %08lx, PC: %08lx, SP: %08lx\n", sp[4], sp[5], sp[6], (uint32_t) sp);
+    _fault_regs(sp);
     printf("  UFSR: %04x\n", ufsr);
     
     if (ufsr & 1) {
         printf("    *PC == %04x\n", *(uint16_t *)sp[6]);
     }
+    crash_dump_capture(CrashDumpUsageFault, sp, exc_return, 0, 0, NULL);
     while(1);
 }
 
-__attribute__((naked)) void UsageFault_Handler()
-{
-    asm volatile (
-        "TST   LR, #4\n\t"
-        "ITE   EQ\n\t"
-        "MRSEQ R0, MSP\n\t"
-        "MRSNE R0, PSP\n\t"
-        "LDR   R1, =UsageFault_Handler_C\n\t"
-        "BX    R1"
-    );
-}
+FAULT_HANDLER(HardFault)
+FAULT_HANDLER(BusFault)
+FAULT_HANDLER(UsageFault)
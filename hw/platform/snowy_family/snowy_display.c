@@ -33,6 +33,7 @@
 #include "stdio.h"
 #include "string.h"
 #include "display.h"
+#include "frame_profile.h"
 #include "log.h"
 #include "vibrate.h"
 #include "snowy_display.h"
@@ -53,20 +54,64 @@
 /* in full fat mode */
 #define DISPLAY_CTYPE_FRAME       0x05
 
+/* what the FPGA's bootloader image can draw with DISPLAY_CTYPE_SCENE */
+#define DISPLAY_SCENE_BLACK       0x00
+#define DISPLAY_SCENE_SPLASH      0x01
+
+/* Uncomment to only clock out the damaged scanlines of a frame.
+ * The FPGA image has to honour the scanline window sent as a
+ * parameter after the frame command. Without it, a region draw
+ * degrades to a full frame.
+ */
+// #define DISPLAY_PARTIAL_FRAME
+
+
+/* Uncomment to convert the whole frame up front into a second buffer in
+ * main SRAM and send it to the FPGA as a single DMA transfer, rather than
+ * converting and sending a scanline per DMA completion interrupt.
+ * Costs another MAX_FRAMEBUFFER_SIZE bytes of DMA capable SRAM.
+ */
+// #define DISPLAY_DMA_FULL_FRAME
 
 /* NOTE this is pinned to CCRAM on supported devices.
  * This does mean we can't (not that we could) dma from CCRAM to the SPI.
  * It's an unsupported hardware config for stm32 at least
  */
-static uint8_t _frame_buffer[DISPLAY_ROWS * DISPLAY_COLS] CCRAM;
-static uint8_t _column_buffer[DISPLAY_ROWS];
+static uint8_t _frame_buffer[DISPLAY_ROWS * DISPLAY_COLS] CCRAM __attribute__((aligned(4)));
+#ifdef DISPLAY_DMA_FULL_FRAME
+/* Frame in FPGA native (scanline) order. Must NOT be CCRAM */
+static uint8_t _native_frame_buffer[MAX_FRAMEBUFFER_SIZE] __attribute__((aligned(4)));
+#else
+/* Converted columns, ping-pong. One goes out while the next is converted
+ * into the other, so a completion only has to start the next send.
+ * Not the DMA's double buffer mode: that flips straight on to the other
+ * buffer after the last column, and at this SPI clock there isn't time to
+ * stop it before it does */
+static uint8_t _column_buffer[2][DISPLAY_ROWS] __attribute__((aligned(4)));
+static uint8_t _column_sending;
+#endif
 static uint8_t _display_ready;
-
-void _snowy_display_start_frame(uint8_t xoffset, uint8_t yoffset);
+static uint8_t _pins_ready;
+
+/* The FPGA image goes out by DMA in chunks of this, as that's all a
+ * stream can count. If the FPGA doesn't come up after, we reset it and
+ * send the image again a byte at a time */
+#define FPGA_DMA_CHUNK 0x8000
+/* set while the FPGA image is going out, so TX completions aren't frames */
+static uint8_t _fpga_uploading;
+static volatile uint8_t _fpga_chunk_done;
+
+/* The scanline window of the frame currently being sent.
+ * On snowy a scanline is a column, on chalk it is a row */
+static uint8_t _first_scanline;
+static uint8_t _last_scanline;
+static uint8_t _scanline_index;
+
+void _snowy_display_start_frame(uint8_t first_scanline, uint8_t last_scanline);
 uint8_t _snowy_display_wait_FPGA_ready(void);
 void _snowy_display_splash(uint8_t scene);
 void _snowy_display_full_init(void);
-void _snowy_display_program_FPGA(void);
+void _snowy_display_program_FPGA(uint8_t use_dma);
 void _snowy_display_send_frame(void);
 void _snowy_display_cs(uint8_t enabled);
 uint8_t _snowy_display_FPGA_reset(uint8_t mode);
@@ -146,14 +191,17 @@ static stm32_spi_t _spi6 = {
 
 
 /* SPI6     DMA2    DMA Stream 5    DMA Channel 1   DMA Stream 6    DMA Channel 0 */
+/* every column ends here and chains the next, so it and the chain are HOT_RAMFUNC */
+HOT_RAMFUNC void DMA2_Stream5_IRQHandler(void);
 STM32_SPI_MK_TX_IRQ_HANDLER(&_spi6, 2, 5, _spi_tx_done)
 
 /*
  * Initialise the hardware. This means all GPIOs and SPI for the display
  */
-void hw_display_init(void)
+static void _snowy_display_init_pins(void)
 {
-    _display_ready = 0;
+    if (_pins_ready)
+        return;
 
     /* init interupt pin, cs and reset */
     stm32_power_request(STM32_POWER_APB2, RCC_APB2Periph_SYSCFG);
@@ -186,16 +234,45 @@ void hw_display_init(void)
         
     /* start SPI hardware */
     stm32_spi_init_device(&_spi6);
-    
-    /* Boot the display  */
-    hw_display_start();
 
     stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_SYSCFG);
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOG);
 
+    _pins_ready = 1;
+}
+
+/*
+ * Initialise the hardware. This means all GPIOs and SPI for the display
+ */
+void hw_display_init(void)
+{
+    _display_ready = 0;
+
+    _snowy_display_init_pins();
+    
+    /* Boot the display  */
+    hw_display_start();
+
     return;
 }
 
+/*
+ * Put the splash up, as early in boot as can be. The FPGA boots its own
+ * bootloader image when reset the other way, and that draws the splash
+ * on a two byte command: no image to upload and no frame to send. It is
+ * up in a few ms, where the full init is a FPGA upload behind the module
+ * chain.
+ *
+ * The glass holds what was last drawn until it is sent something else.
+ * The full init sends nothing, so the splash stays through it and on
+ * until the first frame replaces it
+ */
+void hw_display_splash(void)
+{
+    _snowy_display_init_pins();
+    _snowy_display_splash(DISPLAY_SCENE_SPLASH);
+}
+
 /*
  * We use the Done INTn for the display. This is asserted
  * after every successful command write. I.t. 0x5 to star a frame 
@@ -248,8 +325,13 @@ static void _snowy_display_release_clocks()
 /*
  * DMA2 handler for SPI6
  */
-static void _spi_tx_done(void)
+static HOT_RAMFUNC void _spi_tx_done(void)
 {
+    if (_fpga_uploading)
+    {
+        _fpga_chunk_done = 1;
+        return;
+    }
     display_done_isr(0);
 }
 
@@ -289,16 +371,28 @@ void _snowy_display_cs(uint8_t enabled)
     else
         GPIO_ResetBits(display.port_display, display.pin_cs);
 
-    stm32_power_release(STM32_POWER_AHB1, display.clock_display);
+    stm32_power_release_lazy(STM32_POWER_AHB1, display.clock_display);
 }
 
 /*
- * Given a column index, start the conversion of the display data and dma it
+ * Send the given column, already converted, and convert the one after it
+ * while it goes
  */
-void _snowy_display_next_column(uint8_t col_index)
+HOT_RAMFUNC void _snowy_display_next_column(uint8_t col_index)
 {   
-    scanline_convert(_column_buffer, _frame_buffer, col_index);
-    stm32_spi_send_dma(&_spi6, _column_buffer, DISPLAY_ROWS);
+#ifdef DISPLAY_DMA_FULL_FRAME
+    assert(!"Column by column sends are not used with DISPLAY_DMA_FULL_FRAME");
+#else
+    _column_sending ^= 1;
+    stm32_spi_send_dma(&_spi6, _column_buffer[_column_sending], DISPLAY_ROWS);
+
+    if (col_index < _last_scanline)
+    {
+        FRAME_PROFILE_START(t);
+        scanline_convert(_column_buffer[_column_sending ^ 1], _frame_buffer, col_index + 1);
+        FRAME_PROFILE_STOP(FrameProfileScanline, t);
+    }
+#endif
 }
 
 /*
@@ -366,7 +460,7 @@ void _snowy_display_reset(uint8_t enabled)
     else
         GPIO_ResetBits(display.port_display, display.pin_reset);
 
-    stm32_power_release(STM32_POWER_AHB1, display.clock_display);
+    stm32_power_release_lazy(STM32_POWER_AHB1, display.clock_display);
 }
 
 /* SPI Command related */
@@ -392,14 +486,28 @@ void _snowy_display_SPI_end(void)
 /*
  * Start to send a frame to the display driver
  * If it says yes, then we can then tell someone to fill the buffer
+ * Only scanlines first_scanline..last_scanline inclusive are sent
  */
-void _snowy_display_start_frame(uint8_t xoffset, uint8_t yoffset)
+void _snowy_display_start_frame(uint8_t first_scanline, uint8_t last_scanline)
 {
+#ifndef DISPLAY_PARTIAL_FRAME
+    first_scanline = 0;
+    last_scanline = DISPLAY_COLS - 1;
+#endif
+    _first_scanline = first_scanline;
+    _last_scanline = last_scanline;
+    _scanline_index = first_scanline;
+
     _snowy_display_request_clocks();
     
     _snowy_display_cs(1);
     delay_us(10);
     stm32_spi_write(&_spi6, DISPLAY_CTYPE_FRAME); // Frame Begin
+#ifdef DISPLAY_PARTIAL_FRAME
+    stm32_spi_write(&_spi6, DISPLAY_CTYPE_PARAM);
+    stm32_spi_write(&_spi6, first_scanline);
+    stm32_spi_write(&_spi6, last_scanline - first_scanline + 1);
+#endif
     _snowy_display_cs(0);
     delay_us(25);
 
@@ -415,13 +523,35 @@ void _snowy_display_start_frame(uint8_t xoffset, uint8_t yoffset)
  */
 void _snowy_display_send_frame()
 {
+#ifdef DISPLAY_DMA_FULL_FRAME
+    uint8_t *start = &_native_frame_buffer[_first_scanline * DISPLAY_ROWS];
+    
+    /* convert everything while the FPGA digests the frame command */
+    FRAME_PROFILE_START(t);
+    scanline_convert_range(_native_frame_buffer, _frame_buffer, _first_scanline, _last_scanline);
+    FRAME_PROFILE_STOP(FrameProfileScanline, t);
+    
+    /* the ISR will see this as the last scanline and finish up */
+    _scanline_index = _last_scanline;
+    
+    _snowy_display_cs(1);
+    delay_us(40);
+    stm32_spi_send_dma(&_spi6, start, (_last_scanline - _first_scanline + 1) * DISPLAY_ROWS);
+#else
+    /* the first column is converted up front, and goes out of buffer 0 */
+    FRAME_PROFILE_START(t);
+    scanline_convert(_column_buffer[0], _frame_buffer, _first_scanline);
+    FRAME_PROFILE_STOP(FrameProfileScanline, t);
+    _column_sending = 1;
+
     _snowy_display_cs(1);
     delay_us(40);
     /* send over DMA
      * we are only going to send one single column at a time
      * the dma engine completion will trigger the next lot of data to go
      */
-    _snowy_display_next_column(0);
+    _snowy_display_next_column(_first_scanline);
+#endif
     /* we return immediately and let the system take care of the rest */
 }
 
@@ -441,11 +571,12 @@ void _snowy_display_send_frame_slow()
     _snowy_display_cs(1);
     
     /* send via standard SPI */
+    uint8_t scanline[DISPLAY_ROWS];
     for(uint8_t x = 0; x < DISPLAY_COLS; x++)
     {
-        scanline_convert(_column_buffer, _frame_buffer, x);
+        scanline_convert(scanline, _frame_buffer, x);
         for (uint8_t j = 0; j < DISPLAY_ROWS; j++)
-            stm32_spi_write(&_spi6, _column_buffer[j]);
+            stm32_spi_write(&_spi6, scanline[j]);
     }   
     
     _snowy_display_cs(0);
@@ -485,6 +616,38 @@ uint8_t _snowy_display_wait_FPGA_ready(void)
     return 1;
 }
 
+/*
+ * Have the bootloader image draw one of its scenes
+ */
+void _snowy_display_drawscene(uint8_t scene)
+{
+    _snowy_display_request_clocks();
+
+    _snowy_display_SPI_start();
+    stm32_spi_write(&_spi6, DISPLAY_CTYPE_SCENE);
+    stm32_spi_write(&_spi6, scene);
+    _snowy_display_SPI_end();
+
+    _snowy_display_release_clocks();
+}
+
+/*
+ * Boot the FPGA into its bootloader image and draw a scene with it. The
+ * glass goes on once the scene is drawn, so the old contents never show
+ */
+void _snowy_display_splash(uint8_t scene)
+{
+    if (!_snowy_display_FPGA_reset(1) || !_snowy_display_wait_FPGA_ready())
+    {
+        DRV_LOG("Display", APP_LOG_LEVEL_ERROR, "No splash, the FPGA didn't boot");
+        return;
+    }
+
+    _snowy_display_drawscene(scene);
+    delay_large(20);
+    hw_display_on();
+}
+
 /*
  * Reset the FPGA and send the display engine into full frame mode
  * This will allow raw frame dumps to work
@@ -502,41 +665,87 @@ void _snowy_display_full_init(void)
         assert(!"FGPA Init FAILED!!");
     }
     
-    _snowy_display_program_FPGA();
+    _snowy_display_program_FPGA(1);
+    
+    if (!_snowy_display_wait_FPGA_ready())
+    {
+        DRV_LOG("Display", APP_LOG_LEVEL_ERROR, "FPGA didn't take the DMA upload. Retrying slowly");
+        if (!_snowy_display_FPGA_reset(0))
+        {
+            _snowy_display_release_clocks();
+            assert(!"FGPA Init FAILED!!");
+        }
+        _snowy_display_program_FPGA(0);
+    }
     
     if (_snowy_display_wait_FPGA_ready())
     {
         DRV_LOG("Display", APP_LOG_LEVEL_INFO, "Display is ready");
     }
-/*    
-    // get the splashscreen resource handle and read it directly into the framebuffer
-    ResHandle resource_handle = resource_get_handle_system(SPLASH_RESOURCE_ID);
-    hw_flash_read_bytes(REGION_RES_START + RES_START + resource_handle.offset, display.frame_buffer, resource_handle.size);
-    // send raw splashscreen image to display
-    _snowy_display_send_frame_slow();
-*/
-
-    /* enable interrupts now we have the splash up
-     * Interrupt handler is in with bluetooth :/
-     */
+    /* the splash from hw_display_splash is still on the glass, and stays
+     * until the first frame */
+
+    /* Interrupt handler is in with bluetooth :/ */
     _snowy_display_init_intn();   
     _snowy_display_release_clocks();
 }
 
+/*
+ * Send the FPGA image over DMA. Returns 0 if a chunk never completed
+ */
+static uint8_t _snowy_display_program_FPGA_dma(unsigned char *fpga_blob, uint32_t size)
+{
+    uint8_t ok = 1;
+
+    _fpga_uploading = 1;
+    for (uint32_t offset = 0; offset < size && ok; offset += FPGA_DMA_CHUNK)
+    {
+        uint32_t len = size - offset < FPGA_DMA_CHUNK ? size - offset : FPGA_DMA_CHUNK;
+        uint16_t timeout = 0;
+
+        _fpga_chunk_done = 0;
+        stm32_spi_send_dma(&_spi6, fpga_blob + offset, len);
+
+        while (!_fpga_chunk_done)
+        {
+            if (++timeout > 1000)
+            {
+                /* the IRQ never came, so neither did its clock release */
+                stm32_dma_tx_disable(_spi6.dma);
+                stm32_power_release(_spi6_config.spi_periph_bus, _spi6_config.spi_clock);
+                ok = 0;
+                break;
+            }
+            delay_us(100);
+        }
+    }
+
+    /* the last byte is still shifting out when the stream finishes */
+    while (SPI_I2S_GetFlagStatus(_spi6_config.spi, SPI_I2S_FLAG_BSY) == SET)
+        ;
+    _fpga_uploading = 0;
+
+    return ok;
+}
+
 /*
  * Get the source for the display's FPGA, and download it to the device
  */
-void _snowy_display_program_FPGA(void)
+void _snowy_display_program_FPGA(uint8_t use_dma)
 {
     unsigned char *fpga_blob = DISPLAY_FPGA_ADDR;
+    uint32_t size = (uint32_t)DISPLAY_FPGA_SIZE;
 
     _snowy_display_request_clocks();
     _snowy_display_cs(1);
     
-    /* Do this with good ol manual SPI for reliability */
-    for (uint32_t i = 0; i < (uint32_t)DISPLAY_FPGA_SIZE; i++)
+    if (!use_dma || !_snowy_display_program_FPGA_dma(fpga_blob, size))
     {
-        stm32_spi_write(&_spi6, *(fpga_blob + i));
+        /* good ol manual SPI for reliability */
+        for (uint32_t i = 0; i < size; i++)
+        {
+            stm32_spi_write(&_spi6, *(fpga_blob + i));
+        }
     }
     
     _snowy_display_cs(0);
@@ -568,7 +777,20 @@ void hw_display_on()
  */
 void hw_display_start_frame(uint8_t xoffset, uint8_t yoffset)
 {
-    _snowy_display_start_frame(xoffset, yoffset);
+    _snowy_display_start_frame(0, DISPLAY_COLS - 1);
+}
+
+/*
+ * Start a frame render of only the scanlines covering the given region
+ */
+void hw_display_start_frame_region(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+{
+#if defined(REBBLE_PLATFORM_CHALK)
+    /* chalk is converted a row at a time */
+    _snowy_display_start_frame(y, y + height - 1);
+#else
+    _snowy_display_start_frame(x, x + width - 1);
+#endif
 }
 
 uint8_t *hw_display_get_buffer(void)
@@ -581,19 +803,17 @@ uint8_t hw_display_is_ready()
     return _display_ready;
 }
 
-uint8_t hw_display_process_isr(void)
+HOT_RAMFUNC uint8_t hw_display_process_isr(void)
 {
-    static uint16_t col_index = 0;
-
-    if (col_index < DISPLAY_COLS - 1)
+    if (_scanline_index < _last_scanline)
     {
-        ++col_index;
+        ++_scanline_index;
         /* ask for convert and display the next column */
-        _snowy_display_next_column(col_index);
+        _snowy_display_next_column(_scanline_index);
         return 0;
     }
     /* if we are finished sending each column, then reset and stop */
-    col_index = 0;    
+    _scanline_index = 0;    
     
     /* done. We are still in control of the SPI select, so lets let go */
     _snowy_display_cs(0);
@@ -622,16 +842,3 @@ void hw_display_start(void)
     _snowy_display_full_init();
 }
 
-
-/* Util. Moveme. Nukeme. */ 
-
-void delay_us(uint16_t us)
-{
-    for(int i = 0; i < 22 * us; i++)
-            ;;
-}
-
-void delay_large(uint16_t ms)
-{
-    delay_us(1000 * ms);
-}
@@ -12,6 +12,7 @@
 #define MAX_FRAMEBUFFER_SIZE DISPLAY_ROWS * DISPLAY_COLS
 
 void hw_display_init(void);
+void hw_display_splash(void);
 void hw_display_reset(void);
 void hw_display_start(void);
 uint8_t hw_display_is_ready();
@@ -20,10 +21,11 @@ uint8_t hw_display_process_isr(void);
 
 void hw_display_on();
 void hw_display_start_frame(uint8_t xoffset, uint8_t yoffset);
+void hw_display_start_frame_region(uint8_t x, uint8_t y, uint8_t width, uint8_t height);
 
 // TODO: move to scanline
 void scanline_convert(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t column_index);
+void scanline_convert_range(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t first, uint8_t last);
 
-void delay_us(uint16_t us);
-void delay_large(uint16_t ms);
+#include "stm32_delay.h"
 
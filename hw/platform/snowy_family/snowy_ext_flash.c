@@ -1,308 +1,660 @@
-/* snowy_ext_flash.c
- * FMC NOR flash implementation for Pebble Time (snowy)
- * RebbleOS
- *
- * Author: Barry Carter <barry.carter@gmail.com>
- */
-
-#include "stm32f4xx.h"
-#include "stdio.h"
-#include "string.h"
-#include "stm32f4xx_gpio.h"
-#include "stm32f4xx_fsmc.h"
-#include "platform.h"
-#include "stm32_power.h"
-#include "log.h"
-#include "appmanager.h"
-#include "flash.h"
-
-
-// base region
-
-
-void _nor_gpio_config(void);
-void _nor_enter_read_mode(uint32_t address);
-void _nor_reset_region(uint32_t address);
-void _nor_reset_state(void);
-void _nor_clock_request(void);
-void _nor_clock_release(void);
-int _flash_test(void);
-
-static void _nor_write16(uint32_t address, uint16_t data);
-
-/*
- * Initialise the flash hardware. 
- * it's NOR flash, using a multiplexed io
- */
-void hw_flash_init(void)
-{
-    FMC_NORSRAMInitTypeDef fmc_nor_init_struct;
-    FMC_NORSRAMTimingInitTypeDef p;
-    
-    DRV_LOG("Flash", APP_LOG_LEVEL_DEBUG, "Init");
-    
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
-    
-    _nor_gpio_config();
-   
-    // pull reset high while we setup the device
-    // We the device in reset while we configure to stop glitching
-    GPIO_SetBits(GPIOD, GPIO_Pin_4);
-
-    // settled on these
-    p.FMC_AddressSetupTime = 4;
-    p.FMC_AddressHoldTime = 3;
-    p.FMC_DataSetupTime = 7;
-    p.FMC_BusTurnAroundDuration = 1;  // could be 3
-    p.FMC_CLKDivision = 1;
-    p.FMC_DataLatency = 0;
-    p.FMC_AccessMode = FMC_AccessMode_A;
-    
-    /*p.FMC_AddressSetupTime = 1;
-    p.FMC_AddressHoldTime = 1;
-    p.FMC_DataSetupTime = 3;
-    p.FMC_BusTurnAroundDuration = 1;  // could be 3
-    p.FMC_CLKDivision = 15;
-    p.FMC_DataLatency = 15;
-    p.FMC_AccessMode = FMC_AccessMode_A;*/
-    //p.FMC_AccessMode = FMC_AccessMode_B; could be this
-
-    fmc_nor_init_struct.FMC_Bank = FMC_Bank1_NORSRAM1;
-    fmc_nor_init_struct.FMC_DataAddressMux = FMC_DataAddressMux_Enable;
-    fmc_nor_init_struct.FMC_MemoryType = FMC_MemoryType_NOR;
-    fmc_nor_init_struct.FMC_MemoryDataWidth = FMC_NORSRAM_MemoryDataWidth_16b;
-    
-    fmc_nor_init_struct.FMC_BurstAccessMode = FMC_BurstAccessMode_Disable;
-    fmc_nor_init_struct.FMC_AsynchronousWait = FMC_AsynchronousWait_Disable;
-    fmc_nor_init_struct.FMC_WaitSignalPolarity = FMC_WaitSignalPolarity_Low;
-    fmc_nor_init_struct.FMC_WrapMode = FMC_WrapMode_Disable;
-    fmc_nor_init_struct.FMC_WaitSignalActive = FMC_WaitSignalActive_BeforeWaitState;
-    
-    fmc_nor_init_struct.FMC_WriteOperation = FMC_WriteOperation_Enable; // known good from bl
-    fmc_nor_init_struct.FMC_WaitSignal = FMC_WaitSignal_Enable; // known good from bl
-    
-    fmc_nor_init_struct.FMC_ExtendedMode = FMC_ExtendedMode_Disable;
-    fmc_nor_init_struct.FMC_WriteBurst = FMC_WriteBurst_Disable;
-    
-    fmc_nor_init_struct.FMC_ReadWriteTimingStruct = &p;
-    fmc_nor_init_struct.FMC_WriteTimingStruct = &p;
-
-    FMC_NORSRAMDeInit(FMC_Bank1_NORSRAM1);
-    FMC_NORSRAMInit(&fmc_nor_init_struct);
-    
-    // release the flash chip
-    GPIO_ResetBits(GPIOD, GPIO_Pin_4);
-    delay_us(10);
-    GPIO_SetBits(GPIOD, GPIO_Pin_4);
-    delay_us(30);
-    stm32_power_request(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
-
-    FMC_NORSRAMCmd(FMC_Bank1_NORSRAM1, ENABLE); // Start disabled?. We'll turn it on when we need it
-    
-    //  let the flash initialise from the reset
-    if (!_flash_test())
-    {
-        DRV_LOG("Flash", APP_LOG_LEVEL_ERROR, "Flash version check failed");
-        // we carry on here, as it seems to work. TODO find unlock?
-        //assert(!err);
-    }
-
-    stm32_power_release(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);    
-}
-
-void hw_flash_deinit(void)
-{
-}
-
-void _nor_gpio_config(void)
-{
-    GPIO_InitTypeDef gpio_init_struct;
-
-    /* We have the following known config on Snowy
-     * S29VS128R flash controller
-     * Using multiplexing mode which uses 
-     * DA[15:0]
-     * A[23:16] (might be 25:16)
-     * D[15:0]
-     * Also using B7 FMC mode
-     * Ports D and E are almost entirely for FMC
-     */
-
-    // Common config
-    gpio_init_struct.GPIO_Mode = GPIO_Mode_AF;
-    gpio_init_struct.GPIO_Speed = GPIO_Speed_100MHz;
-    gpio_init_struct.GPIO_OType = GPIO_OType_PP;
-    gpio_init_struct.GPIO_PuPd  = GPIO_PuPd_UP; 
-    
-
-    // Deal with B7  NADV
-    GPIO_PinAFConfig(GPIOB, GPIO_PinSource7, GPIO_AF_FMC);
-    gpio_init_struct.GPIO_Pin = GPIO_Pin_7;  
-    GPIO_Init(GPIOB, &gpio_init_struct);
-
-    // GPIOs on port D
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource0, GPIO_AF_FMC);   // DA2
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource1, GPIO_AF_FMC);   // DA3
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource3, GPIO_AF_FMC);   // CLK
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource4, GPIO_AF_FMC);   // NOE
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource5, GPIO_AF_FMC);   // NWE
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource6, GPIO_AF_FMC);   // NWAIT
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource7, GPIO_AF_FMC);   // NE1
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource8, GPIO_AF_FMC);   // DA13
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource9, GPIO_AF_FMC);   // DA14
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource10, GPIO_AF_FMC);  // DA15
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource11, GPIO_AF_FMC);  // A16
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource12, GPIO_AF_FMC);  // A17
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource13, GPIO_AF_FMC);  // A18
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource14, GPIO_AF_FMC);  // DA0
-    GPIO_PinAFConfig(GPIOD, GPIO_PinSource15, GPIO_AF_FMC);  // DA1
-    
-    gpio_init_struct.GPIO_Pin = GPIO_Pin_0  | GPIO_Pin_1  | GPIO_Pin_3  | GPIO_Pin_4  | 
-                                GPIO_Pin_5  | GPIO_Pin_6  | GPIO_Pin_7  | GPIO_Pin_8  |
-                                GPIO_Pin_9  | GPIO_Pin_10 | GPIO_Pin_11 | GPIO_Pin_12 |
-                                GPIO_Pin_13 | GPIO_Pin_14 | GPIO_Pin_15;
-    
-    GPIO_Init(GPIOD, &gpio_init_struct);
-    
-    // GPIO on port E
-    // NBL0/1 are not used for this NOR flash
-    //GPIO_PinAFConfig(GPIOE, GPIO_PinSource0, GPIO_AF_FMC);   // NBL0
-    //GPIO_PinAFConfig(GPIOE, GPIO_PinSource1, GPIO_AF_FMC);   // NBL1
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource2, GPIO_AF_FMC);   // A23
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource3, GPIO_AF_FMC);   // A19
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource4, GPIO_AF_FMC);   // A20
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource5, GPIO_AF_FMC);   // A21
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource6, GPIO_AF_FMC);   // A22
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource7, GPIO_AF_FMC);   // DA4
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource8, GPIO_AF_FMC);   // DA5
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource9, GPIO_AF_FMC);   // DA6
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource10, GPIO_AF_FMC);  // DA7
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource11, GPIO_AF_FMC);  // DA8
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource12, GPIO_AF_FMC);  // DA9
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource13, GPIO_AF_FMC);  // DA10
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource14, GPIO_AF_FMC);  // DA11
-    GPIO_PinAFConfig(GPIOE, GPIO_PinSource15, GPIO_AF_FMC);  // DA12
-    
-    gpio_init_struct.GPIO_Pin = GPIO_Pin_2  | GPIO_Pin_3  | 
-                                GPIO_Pin_4  | GPIO_Pin_5  | GPIO_Pin_6  | GPIO_Pin_7  | 
-                                GPIO_Pin_8  | GPIO_Pin_9  | GPIO_Pin_10 | GPIO_Pin_11 | 
-                                GPIO_Pin_12 | GPIO_Pin_13 | GPIO_Pin_14 | GPIO_Pin_15;
-
-    GPIO_Init(GPIOE, &gpio_init_struct);
-}
-
-void _nor_clock_request(void)
-{  
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
-    stm32_power_request(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
-}
-
-void _nor_clock_release(void)
-{
-    stm32_power_release(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);   
-}
-
-/*
- * Issue a CFI command to the region we are reading to reset
- * the flash state machine for this region back to default
- */
-inline void _nor_reset_region(uint32_t address)
-{
-    _nor_write16(address, 0xF0);
-}
-
-/*
- * Issue a CFI command to reset the whole flash, resetting the state machine
- */
-inline void _nor_reset_state(void)
-{
-    _nor_write16(0, 0xF0);
-}
-
-/*
- * Call for a test. Unlocks the CFI ID region and reads the QRY section
- * NOTE: seems wonky on real hardware. works in emu!
- */
-int _flash_test(void)
-{
-    return 1;
-    uint16_t nr, nr1, nr2;
-    uint8_t result;
-    _nor_clock_request();
-
-    _nor_reset_state();
-    // Write CFI command to enter ID region
-    _nor_write16(0xAAA, 0x98);
-    // 0x20-0x24 are the "Query header QRY"
-    nr = hw_flash_read16(0x20);
-    nr1 = hw_flash_read16(0x22);
-    nr2 = hw_flash_read16(0x24);
-
-    DRV_LOG("Flash", APP_LOG_LEVEL_DEBUG, "READR NR %d NR1 %d NR2 %d\n", nr, nr1, nr2);
-    
-    if ( nr != 81 || nr1 != 82 )
-        result = 0;
-    else
-        result = (unsigned int)nr2 - 89 <= 0;
-    
-    // Quit CFI ID mode
-    _nor_reset_region(0xAAA);
-    
-    _nor_clock_release();
-    return result;
-}
-
-/*
- * Issue a CFI region write request and reset the flash state
- * XXX we really should be unlocking the region properly using CFI
- * http://www.cypress.com/file/218866/download Section 8.1
- * This allows us to hard lock pages in flash so they are not writeable. 
- */
-void _nor_enter_write_mode(uint32_t address)
-{
-    // CFI start write unlock
-    _nor_write16(0xAAA, 0xAA);
-    _nor_write16(0x554, 0x55);
-    // unlock the address
-    _nor_reset_region(address);
-}
-
-static void _nor_write16(uint32_t address, uint16_t data)
-{
-    _nor_clock_request();
-     (*(__IO uint16_t *)(Bank1_NOR_ADDR + address) = (data));
-    _nor_clock_release();
-}
-
-uint16_t hw_flash_read16(uint32_t address)
-{
-    uint16_t rv;
-    
-    _nor_clock_request();
-    rv = *(__IO uint16_t *)(Bank1_NOR_ADDR + address);
-    _nor_clock_release();
-    
-    return rv;
-}
-
-void hw_flash_read_bytes(uint32_t address, uint8_t *buffer, size_t length)
-{
-    _nor_clock_request();
-    for(size_t i = 0; i < length; i++)
-    {
-        buffer[i] = *(__IO uint8_t *)((Bank1_NOR_ADDR + address + i));
-    }
-    _nor_clock_release();
-    flash_operation_complete(0);
-}
-
+/* snowy_ext_flash.c
+ * FMC NOR flash implementation for Pebble Time (snowy)
+ * RebbleOS
+ *
+ * Author: Barry Carter <barry.carter@gmail.com>
+ */
+
+#include "stm32f4xx.h"
+#include "stdio.h"
+#include "string.h"
+#include "stm32f4xx_gpio.h"
+#include "stm32f4xx_fsmc.h"
+#include "stm32f4xx_dma.h"
+#include "platform.h"
+#include "stm32_power.h"
+#include "stm32_dma.h"
+#include "log.h"
+#include "appmanager.h"
+#include "flash.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+
+// base region
+
+
+void _nor_gpio_config(void);
+void _nor_enter_read_mode(uint32_t address);
+void _nor_reset_region(uint32_t address);
+void _nor_reset_state(void);
+void _nor_clock_request(void);
+void _nor_clock_release(void);
+int _flash_test(void);
+
+static void _nor_write16(uint32_t address, uint16_t data);
+static void _nor_dma_init(void);
+static void _nor_fmc_init(uint8_t sync);
+
+/* Synchronous burst reads from the NOR. Checked at boot against an
+ * asynchronous read, and dropped if they don't match. Comment out to
+ * stay asynchronous */
+#define NOR_SYNC_BURST
+
+#ifdef NOR_SYNC_BURST
+static void _nor_sync_enable(void);
+
+/* configuration register, see the S29VS-R datasheet */
+#define NOR_CR_ASYNC        (1 << 15)
+#define NOR_CR_LATENCY(n)   ((((n) - 2) & 0xF) << 11)
+#define NOR_CR_RDY_HIGH     (1 << 10)
+#define NOR_CR_BURST_CONT   0
+/* wait states the NOR wants before data, good to 66MHz. FMC_CLK is
+ * HCLK / (NOR_SYNC_CLKDIV + 1), so 56-60MHz */
+#define NOR_SYNC_LATENCY    5
+#define NOR_SYNC_CLKDIV     2
+#define NOR_CR_SYNC         (NOR_CR_LATENCY(NOR_SYNC_LATENCY) | NOR_CR_RDY_HIGH | NOR_CR_BURST_CONT)
+/* the stretch the burst check reads back */
+#define NOR_TEST_ADDR       REGION_FS_START
+#define NOR_TEST_LEN        4096
+#endif
+
+/* Reads this long and up go over DMA2, memory to memory, so the CPU
+ * isn't stalled for every FMC cycle. CCM RAM isn't on the DMA's bus,
+ * so reads landing there are always copied by hand */
+#define NOR_DMA_THRESHOLD   64
+#define NOR_DMA_STREAM      DMA2_Stream0
+#define NOR_DMA_IRQ         DMA2_Stream0_IRQn
+#define NOR_DMA_FLAGS       STM32_DMA_MK_FLAGS(0)
+#define NOR_DMA_MAX         (0xFFFF * 2) /* NDTR counts half words */
+#define CCMRAM_START        0x10000000
+#define CCMRAM_END          0x10010000
+
+/* what the DMA is doing, so an error can be mopped up by hand */
+static uint8_t *_dma_buffer;
+static const uint8_t *_dma_src;
+static size_t _dma_length;
+
+/*
+ * Initialise the flash hardware. 
+ * it's NOR flash, using a multiplexed io
+ */
+void hw_flash_init(void)
+{
+    DRV_LOG("Flash", APP_LOG_LEVEL_DEBUG, "Init");
+    
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
+    
+    _nor_gpio_config();
+   
+    // pull reset high while we setup the device
+    // We the device in reset while we configure to stop glitching
+    GPIO_SetBits(GPIOD, GPIO_Pin_4);
+
+    _nor_fmc_init(0);
+    
+    // release the flash chip
+    GPIO_ResetBits(GPIOD, GPIO_Pin_4);
+    delay_us(10);
+    GPIO_SetBits(GPIOD, GPIO_Pin_4);
+    delay_us(30);
+    stm32_power_request(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
+
+    FMC_NORSRAMCmd(FMC_Bank1_NORSRAM1, ENABLE); // Start disabled?. We'll turn it on when we need it
+    _nor_dma_init();
+    
+    //  let the flash initialise from the reset
+    if (!_flash_test())
+    {
+        DRV_LOG("Flash", APP_LOG_LEVEL_ERROR, "Flash version check failed");
+        // we carry on here, as it seems to work. TODO find unlock?
+        //assert(!err);
+    }
+#ifdef NOR_SYNC_BURST
+    _nor_sync_enable();
+#endif
+
+    stm32_power_release(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);    
+}
+
+void hw_flash_deinit(void)
+{
+}
+
+/*
+ * Set the FMC up for the NOR, either asynchronous (mode A), or
+ * synchronous bursts clocked off FMC_CLK
+ */
+static void _nor_fmc_init(uint8_t sync)
+{
+    FMC_NORSRAMInitTypeDef fmc_nor_init_struct;
+    FMC_NORSRAMTimingInitTypeDef p;
+    
+    // settled on these
+    p.FMC_AddressSetupTime = 4;
+    p.FMC_AddressHoldTime = 3;
+    p.FMC_DataSetupTime = 7;
+    p.FMC_BusTurnAroundDuration = 1;  // could be 3
+    p.FMC_CLKDivision = sync ? NOR_SYNC_CLKDIV : 1;
+    p.FMC_DataLatency = sync ? NOR_SYNC_LATENCY - 2 : 0;  // the FMC counts from 2
+    p.FMC_AccessMode = FMC_AccessMode_A;
+    
+    /*p.FMC_AddressSetupTime = 1;
+    p.FMC_AddressHoldTime = 1;
+    p.FMC_DataSetupTime = 3;
+    p.FMC_BusTurnAroundDuration = 1;  // could be 3
+    p.FMC_CLKDivision = 15;
+    p.FMC_DataLatency = 15;
+    p.FMC_AccessMode = FMC_AccessMode_A;*/
+    //p.FMC_AccessMode = FMC_AccessMode_B; could be this
+
+    fmc_nor_init_struct.FMC_Bank = FMC_Bank1_NORSRAM1;
+    fmc_nor_init_struct.FMC_DataAddressMux = FMC_DataAddressMux_Enable;
+    fmc_nor_init_struct.FMC_MemoryType = FMC_MemoryType_NOR;
+    fmc_nor_init_struct.FMC_MemoryDataWidth = FMC_NORSRAM_MemoryDataWidth_16b;
+    
+    fmc_nor_init_struct.FMC_BurstAccessMode = sync ? FMC_BurstAccessMode_Enable : FMC_BurstAccessMode_Disable;
+    fmc_nor_init_struct.FMC_AsynchronousWait = FMC_AsynchronousWait_Disable;
+    fmc_nor_init_struct.FMC_WaitSignalPolarity = FMC_WaitSignalPolarity_Low;
+    fmc_nor_init_struct.FMC_WrapMode = FMC_WrapMode_Disable;
+    fmc_nor_init_struct.FMC_WaitSignalActive = FMC_WaitSignalActive_BeforeWaitState;
+    
+    fmc_nor_init_struct.FMC_WriteOperation = FMC_WriteOperation_Enable; // known good from bl
+    fmc_nor_init_struct.FMC_WaitSignal = FMC_WaitSignal_Enable; // known good from bl
+    
+    fmc_nor_init_struct.FMC_ExtendedMode = FMC_ExtendedMode_Disable;
+    fmc_nor_init_struct.FMC_WriteBurst = FMC_WriteBurst_Disable;
+    
+    fmc_nor_init_struct.FMC_ReadWriteTimingStruct = &p;
+    fmc_nor_init_struct.FMC_WriteTimingStruct = &p;
+
+    FMC_NORSRAMDeInit(FMC_Bank1_NORSRAM1);
+    FMC_NORSRAMInit(&fmc_nor_init_struct);
+}
+
+#ifdef NOR_SYNC_BURST
+/*
+ * Write the NOR's configuration register
+ */
+static void _nor_write_cr(uint16_t cr)
+{
+    _nor_write16(0xAAA, 0xAA);
+    _nor_write16(0x554, 0x55);
+    _nor_write16(0xAAA, 0xD0);
+    _nor_write16(0x000, cr);
+}
+
+/* hash a stretch of flash, read the way memcpy and the DMA do */
+static uint32_t _nor_test_sum(void)
+{
+    uint32_t h = 2166136261u;
+    uint32_t chunk[16];
+    
+    for (uint32_t a = 0; a < NOR_TEST_LEN; a += sizeof(chunk))
+    {
+        memcpy(chunk, (const void *)(Bank1_NOR_ADDR + NOR_TEST_ADDR + a), sizeof(chunk));
+        for (uint8_t i = 0; i < 16; i++)
+            h = (h ^ chunk[i]) * 16777619u;
+    }
+    
+    return h;
+}
+
+/*
+ * Move the NOR and FMC over to synchronous bursts, and keep it only if
+ * what we read back is what we read before
+ */
+static void _nor_sync_enable(void)
+{
+    uint32_t expect = _nor_test_sum();
+    
+    _nor_write_cr(NOR_CR_SYNC);
+    _nor_fmc_init(1);
+    FMC_NORSRAMCmd(FMC_Bank1_NORSRAM1, ENABLE);
+    
+    if (_nor_test_sum() == expect)
+    {
+        DRV_LOG("Flash", APP_LOG_LEVEL_INFO, "synchronous burst reads");
+        return;
+    }
+    
+    _nor_write_cr(NOR_CR_ASYNC);
+    _nor_fmc_init(0);
+    FMC_NORSRAMCmd(FMC_Bank1_NORSRAM1, ENABLE);
+    _nor_reset_state();
+    
+    if (_nor_test_sum() == expect)
+        DRV_LOG("Flash", APP_LOG_LEVEL_ERROR, "burst read check failed, staying asynchronous");
+    else
+        DRV_LOG("Flash", APP_LOG_LEVEL_ERROR, "burst read check failed, and asynchronous reads are off too!");
+}
+#endif
+
+void _nor_gpio_config(void)
+{
+    GPIO_InitTypeDef gpio_init_struct;
+
+    /* We have the following known config on Snowy
+     * S29VS128R flash controller
+     * Using multiplexing mode which uses 
+     * DA[15:0]
+     * A[23:16] (might be 25:16)
+     * D[15:0]
+     * Also using B7 FMC mode
+     * Ports D and E are almost entirely for FMC
+     */
+
+    // Common config
+    gpio_init_struct.GPIO_Mode = GPIO_Mode_AF;
+    gpio_init_struct.GPIO_Speed = GPIO_Speed_100MHz;
+    gpio_init_struct.GPIO_OType = GPIO_OType_PP;
+    gpio_init_struct.GPIO_PuPd  = GPIO_PuPd_UP; 
+    
+
+    // Deal with B7  NADV
+    GPIO_PinAFConfig(GPIOB, GPIO_PinSource7, GPIO_AF_FMC);
+    gpio_init_struct.GPIO_Pin = GPIO_Pin_7;  
+    GPIO_Init(GPIOB, &gpio_init_struct);
+
+    // GPIOs on port D
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource0, GPIO_AF_FMC);   // DA2
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource1, GPIO_AF_FMC);   // DA3
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource3, GPIO_AF_FMC);   // CLK
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource4, GPIO_AF_FMC);   // NOE
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource5, GPIO_AF_FMC);   // NWE
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource6, GPIO_AF_FMC);   // NWAIT
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource7, GPIO_AF_FMC);   // NE1
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource8, GPIO_AF_FMC);   // DA13
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource9, GPIO_AF_FMC);   // DA14
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource10, GPIO_AF_FMC);  // DA15
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource11, GPIO_AF_FMC);  // A16
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource12, GPIO_AF_FMC);  // A17
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource13, GPIO_AF_FMC);  // A18
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource14, GPIO_AF_FMC);  // DA0
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource15, GPIO_AF_FMC);  // DA1
+    
+    gpio_init_struct.GPIO_Pin = GPIO_Pin_0  | GPIO_Pin_1  | GPIO_Pin_3  | GPIO_Pin_4  | 
+                                GPIO_Pin_5  | GPIO_Pin_6  | GPIO_Pin_7  | GPIO_Pin_8  |
+                                GPIO_Pin_9  | GPIO_Pin_10 | GPIO_Pin_11 | GPIO_Pin_12 |
+                                GPIO_Pin_13 | GPIO_Pin_14 | GPIO_Pin_15;
+    
+    GPIO_Init(GPIOD, &gpio_init_struct);
+    
+    // GPIO on port E
+    // NBL0/1 are not used for this NOR flash
+    //GPIO_PinAFConfig(GPIOE, GPIO_PinSource0, GPIO_AF_FMC);   // NBL0
+    //GPIO_PinAFConfig(GPIOE, GPIO_PinSource1, GPIO_AF_FMC);   // NBL1
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource2, GPIO_AF_FMC);   // A23
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource3, GPIO_AF_FMC);   // A19
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource4, GPIO_AF_FMC);   // A20
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource5, GPIO_AF_FMC);   // A21
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource6, GPIO_AF_FMC);   // A22
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource7, GPIO_AF_FMC);   // DA4
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource8, GPIO_AF_FMC);   // DA5
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource9, GPIO_AF_FMC);   // DA6
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource10, GPIO_AF_FMC);  // DA7
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource11, GPIO_AF_FMC);  // DA8
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource12, GPIO_AF_FMC);  // DA9
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource13, GPIO_AF_FMC);  // DA10
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource14, GPIO_AF_FMC);  // DA11
+    GPIO_PinAFConfig(GPIOE, GPIO_PinSource15, GPIO_AF_FMC);  // DA12
+    
+    gpio_init_struct.GPIO_Pin = GPIO_Pin_2  | GPIO_Pin_3  | 
+                                GPIO_Pin_4  | GPIO_Pin_5  | GPIO_Pin_6  | GPIO_Pin_7  | 
+                                GPIO_Pin_8  | GPIO_Pin_9  | GPIO_Pin_10 | GPIO_Pin_11 | 
+                                GPIO_Pin_12 | GPIO_Pin_13 | GPIO_Pin_14 | GPIO_Pin_15;
+
+    GPIO_Init(GPIOE, &gpio_init_struct);
+}
+
+void _nor_clock_request(void)
+{  
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
+    stm32_power_request(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
+}
+
+void _nor_clock_release(void)
+{
+    stm32_power_release_lazy(STM32_POWER_AHB3, RCC_AHB3Periph_FMC);
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);   
+}
+
+/*
+ * Issue a CFI command to the region we are reading to reset
+ * the flash state machine for this region back to default
+ */
+inline void _nor_reset_region(uint32_t address)
+{
+    _nor_write16(address, 0xF0);
+}
+
+/*
+ * Issue a CFI command to reset the whole flash, resetting the state machine
+ */
+inline void _nor_reset_state(void)
+{
+    _nor_write16(0, 0xF0);
+}
+
+/*
+ * Call for a test. Unlocks the CFI ID region and reads the QRY section
+ * NOTE: seems wonky on real hardware. works in emu!
+ */
+int _flash_test(void)
+{
+    return 1;
+    uint16_t nr, nr1, nr2;
+    uint8_t result;
+    _nor_clock_request();
+
+    _nor_reset_state();
+    // Write CFI command to enter ID region
+    _nor_write16(0xAAA, 0x98);
+    // 0x20-0x24 are the "Query header QRY"
+    nr = hw_flash_read16(0x20);
+    nr1 = hw_flash_read16(0x22);
+    nr2 = hw_flash_read16(0x24);
+
+    DRV_LOG("Flash", APP_LOG_LEVEL_DEBUG, "READR NR %d NR1 %d NR2 %d\n", nr, nr1, nr2);
+    
+    if ( nr != 81 || nr1 != 82 )
+        result = 0;
+    else
+        result = (unsigned int)nr2 - 89 <= 0;
+    
+    // Quit CFI ID mode
+    _nor_reset_region(0xAAA);
+    
+    _nor_clock_release();
+    return result;
+}
+
+/*
+ * Issue a CFI region write request and reset the flash state
+ * XXX we really should be unlocking the region properly using CFI
+ * http://www.cypress.com/file/218866/download Section 8.1
+ * This allows us to hard lock pages in flash so they are not writeable. 
+ */
+void _nor_enter_write_mode(uint32_t address)
+{
+    // CFI start write unlock
+    _nor_write16(0xAAA, 0xAA);
+    _nor_write16(0x554, 0x55);
+    // unlock the address
+    _nor_reset_region(address);
+}
+
+static void _nor_write16(uint32_t address, uint16_t data)
+{
+    _nor_clock_request();
+     (*(__IO uint16_t *)(Bank1_NOR_ADDR + address) = (data));
+    _nor_clock_release();
+}
+
+uint16_t hw_flash_read16(uint32_t address)
+{
+    uint16_t rv;
+    
+    _nor_clock_request();
+    rv = *(__IO uint16_t *)(Bank1_NOR_ADDR + address);
+    _nor_clock_release();
+    
+    return rv;
+}
+
+/*
+ * The NOR sits in read array mode, mapped at Bank1_NOR_ADDR, so this is just
+ * a copy. Short ones memcpy, which reads it a word at a time rather than a
+ * bus cycle a byte. Long ones go to the DMA, which completes in the ISR
+ */
+void hw_flash_read_bytes(uint32_t address, uint8_t *buffer, size_t length)
+{
+    const uint8_t *src = (const uint8_t *)(Bank1_NOR_ADDR + address);
+    
+    _nor_clock_request();
+    
+    if (length < NOR_DMA_THRESHOLD ||
+        ((uint32_t)buffer >= CCMRAM_START && (uint32_t)buffer < CCMRAM_END))
+    {
+        memcpy(buffer, src, length);
+        _nor_clock_release();
+        flash_operation_complete(0);
+        return;
+    }
+    
+    /* the DMA reads the NOR a half word at a time, so trim the odd
+     * bytes off either end, and anything past what one go can do */
+    if ((uint32_t)src & 1)
+    {
+        *buffer++ = *src++;
+        length--;
+    }
+    if (length > NOR_DMA_MAX)
+    {
+        memcpy(buffer + NOR_DMA_MAX, src + NOR_DMA_MAX, length - NOR_DMA_MAX);
+        length = NOR_DMA_MAX;
+    }
+    if (length & 1)
+    {
+        buffer[length - 1] = src[length - 1];
+        length--;
+    }
+    
+    _dma_buffer = buffer;
+    _dma_src = src;
+    _dma_length = length;
+    
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    while (NOR_DMA_STREAM->CR & DMA_SxCR_EN);
+    DMA_ClearFlag(NOR_DMA_STREAM, NOR_DMA_FLAGS);
+    
+    /* memory to memory uses the peripheral side as the source */
+    NOR_DMA_STREAM->PAR = (uint32_t)src;
+    NOR_DMA_STREAM->M0AR = (uint32_t)buffer;
+    NOR_DMA_STREAM->NDTR = length / 2;
+    DMA_Cmd(NOR_DMA_STREAM, ENABLE);
+    /* clocks are given back in DMA2_Stream0_IRQHandler */
+}
+
+/*
+ * Reads straight out of the NOR for as long as the mapping is held. The
+ * FMC is kept clocked until it's given back. Only good for a bank we
+ * aren't programming, as that bank drops out of read array mode
+ */
+const void *hw_flash_map(uint32_t address, size_t length)
+{
+    _nor_clock_request();
+    return (const void *)(Bank1_NOR_ADDR + address);
+}
+
+bool hw_flash_unmap(const void *ptr)
+{
+    /* FMC bank 1 is 256MB, the NOR sits at the bottom of it */
+    if ((uint32_t)ptr < Bank1_NOR_ADDR || (uint32_t)ptr >= Bank1_NOR_ADDR + 0x10000000)
+        return false;
+    
+    _nor_clock_release();
+    return true;
+}
+
+/* where the unlock cycles go for the bank holding address. Only the
+ * low bits are decoded as the command address, the rest pick the bank */
+#define NOR_UNLOCK1(a)      (((a) & ~0xFFF) | 0xAAA)
+#define NOR_UNLOCK2(a)      (((a) & ~0xFFF) | 0x554)
+#define NOR_DQ6_TOGGLE      0x40
+/* smallest sector, in the boot end. Main sectors are 128K */
+#define NOR_MIN_SECTOR      0x8000
+
+/*
+ * DQ6 toggles on every read while an embedded program or erase is
+ * running, and settles once it's done. Erases take hundreds of ms, so
+ * those sleep between looks
+ */
+static void _nor_wait_ready(uint32_t address, uint8_t sleep)
+{
+    uint16_t a = hw_flash_read16(address);
+    uint16_t b;
+    
+    while (((b = hw_flash_read16(address)) ^ a) & NOR_DQ6_TOGGLE)
+    {
+        a = b;
+        if (sleep)
+            vTaskDelay(1);
+    }
+}
+
+static void _nor_program16(uint32_t address, uint16_t data)
+{
+    _nor_write16(NOR_UNLOCK1(address), 0xAA);
+    _nor_write16(NOR_UNLOCK2(address), 0x55);
+    _nor_write16(NOR_UNLOCK1(address), 0xA0);
+    _nor_write16(address, data);
+    _nor_wait_ready(address, 0);
+}
+
+static uint8_t _nor_is_blank(uint32_t address, size_t length)
+{
+    const uint32_t *p = (const uint32_t *)(Bank1_NOR_ADDR + address);
+    
+    for (size_t i = 0; i < length / 4; i++)
+        if (p[i] != 0xFFFFFFFF)
+            return 0;
+    return 1;
+}
+
+/*
+ * Program bytes into the NOR a half word at a time. Bits only go to 0,
+ * and a byte on its own leaves the other half of its word as it was.
+ * Blocks until it's done; the bank reads back status while it's busy
+ */
+void hw_flash_write_bytes(uint32_t address, const uint8_t *buffer, size_t length)
+{
+    _nor_clock_request();
+    
+    while (length)
+    {
+        uint16_t v;
+        size_t n = 2;
+        
+        if (address & 1)
+        {
+            v = 0x00FF | (buffer[0] << 8);
+            n = 1;
+        }
+        else if (length == 1)
+        {
+            v = 0xFF00 | buffer[0];
+            n = 1;
+        }
+        else
+            v = buffer[0] | (buffer[1] << 8);
+        
+        /* all ones doesn't change anything */
+        if (v != 0xFFFF)
+            _nor_program16(address & ~1, v);
+        
+        address += n;
+        buffer += n;
+        length -= n;
+    }
+    
+    _nor_clock_release();
+}
+
+/*
+ * Erase every sector in the span back to 0xFF. The span is expected to be
+ * on sector boundaries. We don't know which end the small boot sectors
+ * are at, so go in boot sector steps, and erase wherever isn't blank
+ * yet. That's one erase per 128K sector, and none for one already clean
+ */
+void hw_flash_erase(uint32_t address, size_t length)
+{
+    uint32_t end = address + length;
+    
+    _nor_clock_request();
+    
+    for (; address < end; address += NOR_MIN_SECTOR)
+    {
+        if (_nor_is_blank(address, NOR_MIN_SECTOR))
+            continue;
+        
+        _nor_write16(NOR_UNLOCK1(address), 0xAA);
+        _nor_write16(NOR_UNLOCK2(address), 0x55);
+        _nor_write16(NOR_UNLOCK1(address), 0x80);
+        _nor_write16(NOR_UNLOCK1(address), 0xAA);
+        _nor_write16(NOR_UNLOCK2(address), 0x55);
+        _nor_write16(address, 0x30);
+        _nor_wait_ready(address, 1);
+    }
+    
+    _nor_clock_release();
+}
+
+static void _nor_dma_init(void)
+{
+    DMA_InitTypeDef dma_init_struct;
+    NVIC_InitTypeDef nvic_init_struct;
+    
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    
+    DMA_DeInit(NOR_DMA_STREAM);
+    DMA_StructInit(&dma_init_struct);
+    dma_init_struct.DMA_Channel = DMA_Channel_0;
+    dma_init_struct.DMA_DIR = DMA_DIR_MemoryToMemory;
+    dma_init_struct.DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+    dma_init_struct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    /* half words off the bus, packed down to bytes so the buffer
+     * needn't be aligned */
+    dma_init_struct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    dma_init_struct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    dma_init_struct.DMA_Mode = DMA_Mode_Normal;
+    dma_init_struct.DMA_Priority = DMA_Priority_Medium;
+    dma_init_struct.DMA_FIFOMode = DMA_FIFOMode_Enable;
+    dma_init_struct.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+    dma_init_struct.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+    dma_init_struct.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+    DMA_Init(NOR_DMA_STREAM, &dma_init_struct);
+    DMA_ITConfig(NOR_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+    
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    
+    nvic_init_struct.NVIC_IRQChannel = NOR_DMA_IRQ;
+    nvic_init_struct.NVIC_IRQChannelPreemptionPriority = 6;  // must be > 5
+    nvic_init_struct.NVIC_IRQChannelSubPriority = 0;
+    nvic_init_struct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic_init_struct);
+}
+
+static void _nor_dma_isr(void)
+{
+    if (DMA_GetITStatus(NOR_DMA_STREAM, DMA_IT_TEIF0))
+    {
+        /* shouldn't happen, but the caller still wants their data */
+        DMA_Cmd(NOR_DMA_STREAM, DISABLE);
+        memcpy(_dma_buffer, _dma_src, _dma_length);
+    }
+    else if (!DMA_GetITStatus(NOR_DMA_STREAM, DMA_IT_TCIF0))
+        return;
+    
+    DMA_ClearFlag(NOR_DMA_STREAM, NOR_DMA_FLAGS);
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    _nor_clock_release();
+    flash_operation_complete_isr(0);
+}
+
+void DMA2_Stream0_IRQHandler(void)
+{
+    traceISR_ENTER();
+    _nor_dma_isr();
+    traceISR_EXIT();
+}
+
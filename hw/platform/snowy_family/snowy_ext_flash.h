@@ -7,9 +7,14 @@
  */
 
 #include "stm32f4xx.h"
+#include <stdbool.h>
 
 void hw_flash_init(void);
 void hw_flash_deinit(void);
 uint16_t hw_flash_read16(uint32_t address);
 void hw_flash_read_bytes(uint32_t address, uint8_t *buffer, size_t length);
+void hw_flash_write_bytes(uint32_t address, const uint8_t *buffer, size_t length);
+void hw_flash_erase(uint32_t address, size_t length);
+const void *hw_flash_map(uint32_t address, size_t length);
+bool hw_flash_unmap(const void *ptr);
 
@@ -27,6 +27,8 @@
 /* MAX14690 register definitions */
 #define REG_STATUS_A     0x02
 #define REG_STATUS_B     0x03
+#define REG_INT_A        0x05
+#define REG_INT_B        0x06
 #define REG_BUCK2_CFG    0x0F
 #define REG_BUCK2_VSET   0x10
 #define REG_MON_CFG      0x19
@@ -37,9 +39,12 @@ typedef struct {
     uint16_t pin_intn;   // power interrupt
 } max14690_t;
 
+typedef void (*hw_power_isr_t)(void);
+
 void hw_power_init(void);
 uint16_t hw_power_get_bat_mv(void);
 uint8_t hw_power_get_chg_status(void);
+void hw_power_set_isr(hw_power_isr_t isr);
 
 /**
  * @brief command the max14690 to stay enabled after powerup mode
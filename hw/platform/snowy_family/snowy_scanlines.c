@@ -10,6 +10,22 @@
 #include "string.h"
 #include "display.h"
 #include "snowy_display.h"
+#include "platform_config.h"
+
+/* Every frame goes through here a column or row at a time from the SPI
+ * ISR, so the converters are HOT_RAMFUNC */
+
+/* Comment out to use the byte at a time converters.
+ * The SIMD converters work on four pixels a word at a time using the M4's
+ * packed byte instructions. Output is identical.
+ */
+#define SCANLINE_SIMD
+
+/* Each output byte takes bits from a pair of pixels. The 0x2A bits
+ * (r1 g1 b1) make up the LSB plane, 0x15 (r0 g0 b0) the MSB plane.
+ * Replicated per byte lane so a word does four at once */
+#define SCANLINE_LSB_MASK 0x2A2A2A2A
+#define SCANLINE_MSB_MASK 0x15151515
 
 /*
  * Bulk convert the buffer from its native format for a sigle column
@@ -19,11 +35,87 @@
  * (y0: xxxxxxx
  *  y1: xxxxxxx)
  * In LSB / MSB format
+ *
+ * On a round display only the part of the row behind the glass is
+ * converted. The bytes either side keep whatever an earlier row left in
+ * them; the FPGA still gets the whole row, but nobody can see those.
  */
-void _scanline_convert_row(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t row_index)
+#ifdef SCANLINE_SIMD
+/*
+ * SIMD version of the row converter. 4 pixels (2 output pairs) per load.
+ * UXTB16 splits the word into the even (r1) and odd (r0) pixels of each
+ * pair as two halfword lanes, then the masking is done on both lanes at once.
+ */
+HOT_RAMFUNC void _scanline_convert_row(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t row_index)
+{
+    uint16_t x0 = 0, x1 = DISPLAY_COLS;
+#ifdef PBL_ROUND
+    /* the glass, out to whole words */
+    x0 = display_spans[row_index].x0 & ~3;
+    x1 = (display_spans[row_index].x1 + 3) & ~3;
+#endif
+    const uint32_t *src = (const uint32_t *)&frame_buffer[row_index * DISPLAY_COLS + x0];
+    uint16_t *out_lsb = (uint16_t *)&out_buffer[x0 / 2];
+    uint16_t *out_msb = (uint16_t *)&out_buffer[DISPLAY_COLS / 2 + x0 / 2];
+    
+    for (uint16_t xi = x0; xi < x1; xi += 4)
+    {
+        uint32_t px = *src++;
+        uint32_t r1 = __UXTB16(px);
+        uint32_t r0 = __UXTB16(__ROR(px, 8));
+        
+        uint32_t lsb = ((r0 & SCANLINE_LSB_MASK) >> 1) | (r1 & SCANLINE_LSB_MASK);
+        uint32_t msb = (r0 & SCANLINE_MSB_MASK) | ((r1 & SCANLINE_MSB_MASK) << 1);
+        
+        /* pull byte lane 2 down next to lane 0 */
+        *out_lsb++ = (uint16_t)(lsb | (lsb >> 8));
+        *out_msb++ = (uint16_t)(msb | (msb >> 8));
+    }
+}
+
+/*
+ * Convert 4 adjacent columns at once. One word from each row of a pair
+ * gives the same byte of 4 columns, so the masking runs on all 4 lanes.
+ * column_index must be word aligned in the framebuffer.
+ * Output columns are DISPLAY_ROWS bytes apart.
+ */
+static HOT_RAMFUNC void _scanline_convert_column4(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t column_index)
+{
+    const uint16_t halfrows = DISPLAY_ROWS / 2;
+    const uint32_t *src = (const uint32_t *)&frame_buffer[column_index];
+    uint8_t *out = out_buffer + halfrows - 1;
+    
+    for (uint16_t yi = 0; yi < DISPLAY_ROWS; yi += 2)
+    {
+        uint32_t r0 = src[0];
+        uint32_t r1 = src[DISPLAY_COLS / 4];
+        
+        uint32_t lsb = ((r0 & SCANLINE_LSB_MASK) >> 1) | (r1 & SCANLINE_LSB_MASK);
+        uint32_t msb = (r0 & SCANLINE_MSB_MASK) | ((r1 & SCANLINE_MSB_MASK) << 1);
+        
+        out[0]                              = lsb;
+        out[halfrows]                       = msb;
+        out[DISPLAY_ROWS]                   = lsb >> 8;
+        out[DISPLAY_ROWS + halfrows]        = msb >> 8;
+        out[2 * DISPLAY_ROWS]               = lsb >> 16;
+        out[2 * DISPLAY_ROWS + halfrows]    = msb >> 16;
+        out[3 * DISPLAY_ROWS]               = lsb >> 24;
+        out[3 * DISPLAY_ROWS + halfrows]    = msb >> 24;
+        
+        src += DISPLAY_COLS / 2;
+        out--;
+    }
+}
+#else
+HOT_RAMFUNC void _scanline_convert_row(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t row_index)
 {
     uint8_t r0_fullbyte, r1_fullbyte, lsb, msb;
     uint32_t row_offset = row_index * DISPLAY_COLS;
+    uint16_t x0 = 0, x1 = DISPLAY_COLS;
+#ifdef PBL_ROUND
+    x0 = display_spans[row_index].x0 & ~1;
+    x1 = display_spans[row_index].x1;
+#endif
 
     // For each column in the row, grab two consecutive bytes
     // Each pair of bytes is then or'd to form a pair of formatted values
@@ -31,7 +123,7 @@ void _scanline_convert_row(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t r
     // They are then pushed into the row buffer. 
     // LSB block filling the first half, MSB the second half
     // [LSB0 LSB1..... | half | MSB0 MSB1.....]
-    for (uint16_t xi = 0; xi < DISPLAY_COLS; xi+=2)
+    for (uint16_t xi = x0; xi < x1; xi+=2)
     {
         r1_fullbyte = frame_buffer[row_offset + xi];
         r0_fullbyte = frame_buffer[row_offset + xi + 1];
@@ -43,8 +135,9 @@ void _scanline_convert_row(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t r
         out_buffer[(xi/2) + DISPLAY_COLS / 2] = msb;
     }
 }
+#endif
 
-void _scanline_convert_column(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t column_index)
+HOT_RAMFUNC void _scanline_convert_column(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t column_index)
 {
     int i = 0;
     uint16_t pos_half_lsb = 0;
@@ -82,7 +175,7 @@ void _scanline_convert_column(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_
     }
 }
 
-void scanline_convert(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t index)
+HOT_RAMFUNC void scanline_convert(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t index)
 {
 #if defined(REBBLE_PLATFORM_CHALK)
     _scanline_convert_row(out_buffer, frame_buffer, index);
@@ -92,3 +185,25 @@ void scanline_convert(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t index)
     assert(!"I don't know how to drive this platform!");
 #endif
 }
+
+/*
+ * Convert scanlines first..last inclusive in one go. Scanline i is
+ * written to out_buffer + i * DISPLAY_ROWS, so out_buffer must be a
+ * whole native frame.
+ */
+HOT_RAMFUNC void scanline_convert_range(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t first, uint8_t last)
+{
+    uint16_t i = first;
+    
+#if defined(SCANLINE_SIMD) && defined(REBBLE_PLATFORM_SNOWY)
+    /* leading columns up to a word boundary */
+    for (; i <= last && (i & 3); i++)
+        scanline_convert(&out_buffer[i * DISPLAY_ROWS], frame_buffer, i);
+    
+    for (; i + 3 <= last; i += 4)
+        _scanline_convert_column4(&out_buffer[i * DISPLAY_ROWS], frame_buffer, i);
+#endif
+
+    for (; i <= last; i++)
+        scanline_convert(&out_buffer[i * DISPLAY_ROWS], frame_buffer, i);
+}
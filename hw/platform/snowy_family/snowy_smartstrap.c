@@ -0,0 +1,142 @@
+/* snowy_smartstrap.c
+ * The smartstrap port on Pebble Time (snowy) and Round (chalk)
+ * RebbleOS
+ *
+ * UART8, half duplex on the one data pin, PE1, that the strap and the
+ * watch take turns to pull down. Whatever is on the wire, ours included,
+ * comes in by a circular DMA (DMA1 stream 6 channel 5) that never stops
+ * while the port is up, and goes out through a TX ring drained by DMA1
+ * stream 0 channel 5. Neither costs an interrupt a byte: the owner is
+ * called at each half of the RX buffer and when the line goes quiet, and
+ * takes all that has come at once.
+ *
+ * With DEBUG_UART_SMARTSTRAP the port is a copy of the log instead, TX
+ * only, and there is no smartstrap.
+ */
+
+#include "stm32f4xx.h"
+#include "stm32f4xx_usart.h"
+#include "log.h"
+#include "stm32_power.h"
+#include "stm32_usart.h"
+#include "snowy_smartstrap.h"
+
+// ENABLE this if you want smartstrap debugging output. For now if you do this qemu might not work
+//#define DEBUG_UART_SMARTSTRAP
+
+static const stm32_usart_config_t _uart8_config = {
+    .usart                = UART8,
+    .flow_control_enabled = FLOW_CONTROL_DISABLED,
+    .usart_periph_bus     = STM32_POWER_APB1,
+    .gpio_pin_tx_num      = 1,
+    .gpio_pin_rx_num      = 1,
+    .gpio_ptr             = GPIOE,
+    .gpio_clock           = RCC_AHB1Periph_GPIOE,
+    .usart_clock          = RCC_APB1Periph_UART8,
+    .af                   = GPIO_AF_UART8,
+    .usart_irq            = UART8_IRQn,
+    .half_duplex          = 1,
+};
+
+/* dma tx: dma1 stream 0 chan 5, rx: stream 6 chan 5 */
+static const stm32_dma_t _uart8_dma = STM32_DMA_MK_INIT(RCC_AHB1Periph_DMA1, 1, 0, 6, 5, 5, 13, 12);
+
+static stm32_usart_t _uart8 = {
+    &_uart8_config,
+    &_uart8_dma,
+    230400
+};
+
+/* Not CCRAM, the DMA reads it */
+static uint8_t _uart8_ring[1024];
+static hw_smartstrap_isr_t _isr;
+
+STM32_USART_MK_TX_RING_IRQ_HANDLER(&_uart8, 1, 0)
+
+/* UART8 isn't a USART, so STM32_USART_MK_RX_CIRCULAR_IRQ_HANDLERS can't name these */
+void DMA1_Stream6_IRQHandler(void)
+{
+    traceISR_ENTER();
+    stm32_dma_rx_circular_isr(&_uart8_dma);
+    if (_isr)
+        _isr();
+    traceISR_EXIT();
+}
+
+void UART8_IRQHandler(void)
+{
+    traceISR_ENTER();
+    if (stm32_usart_idle_isr(&_uart8) && _isr)
+        _isr();
+    traceISR_EXIT();
+}
+
+/*
+ * 1 if there is a port for a strap
+ */
+uint8_t hw_smartstrap_init(void)
+{
+#ifdef DEBUG_UART_SMARTSTRAP
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/*
+ * Bring the port up at 9600, the rate every strap starts at, and receive
+ * into rx_buf for good. isr is called to go and look at what has come
+ */
+void hw_smartstrap_start(uint8_t *rx_buf, size_t len, hw_smartstrap_isr_t isr)
+{
+    _isr = isr;
+    _uart8.baud = 9600;
+    stm32_usart_init_device(&_uart8);
+    stm32_usart_tx_ring(&_uart8, _uart8_ring, sizeof(_uart8_ring));
+    stm32_usart_recv_circular(&_uart8, rx_buf, len);
+}
+
+void hw_smartstrap_stop(void)
+{
+    stm32_usart_tx_flush(&_uart8);
+    stm32_usart_stop_circular(&_uart8);
+    _isr = NULL;
+}
+
+/* how far into rx_buf the DMA has got */
+size_t hw_smartstrap_rx_pos(void)
+{
+    return stm32_usart_rx_circular_pos(&_uart8);
+}
+
+/* Into the TX ring and straight back */
+void hw_smartstrap_write(const uint8_t *buf, size_t len)
+{
+    stm32_usart_write_async(&_uart8, buf, len);
+}
+
+/* Once what was written is out, change rate. The RX carries on */
+void hw_smartstrap_set_baud(uint32_t baud)
+{
+    stm32_usart_tx_flush(&_uart8);
+    stm32_usart_set_baud(&_uart8, baud);
+}
+
+/*
+ * The log's copy on the strap port, TX only, when it is one
+ */
+void hw_smartstrap_debug_init(void)
+{
+#ifdef DEBUG_UART_SMARTSTRAP
+    stm32_usart_init_device(&_uart8);
+    stm32_usart_tx_ring(&_uart8, _uart8_ring, sizeof(_uart8_ring));
+#endif
+}
+
+/* note that locking needs to be handled by external entity here */
+void ss_debug_write(const unsigned char *p, size_t len)
+{
+#ifdef DEBUG_UART_SMARTSTRAP
+    stm32_usart_write_async(&_uart8, p, len);
+#endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+/* snowy_smartstrap.h
+ * The smartstrap port on Pebble Time (snowy) and Round (chalk)
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* something has come, or the line went quiet. In the ISR */
+typedef void (*hw_smartstrap_isr_t)(void);
+
+uint8_t hw_smartstrap_init(void);
+void hw_smartstrap_start(uint8_t *rx_buf, size_t len, hw_smartstrap_isr_t isr);
+void hw_smartstrap_stop(void);
+size_t hw_smartstrap_rx_pos(void);
+void hw_smartstrap_write(const uint8_t *buf, size_t len);
+void hw_smartstrap_set_baud(uint32_t baud);
+
+void hw_smartstrap_debug_init(void);
+void ss_debug_write(const unsigned char *p, size_t len);
@@ -12,9 +12,36 @@
 #include "snowy_vibrate.h"
 #include <stm32f4xx_spi.h>
 #include <stm32f4xx_gpio.h>
+#include <stm32f4xx_tim.h>
+#include "FreeRTOS.h" /* traceISR_ENTER */
+
+/*
+ * Patterns are played out of TIM7's update interrupt. The timer is
+ * loaded with each step's length in turn, and the motor switched as it
+ * wraps, so steps keep to the timer's clock whatever the scheduler is
+ * doing and no thread wakes up until it's over. The motor is only on
+ * or off: a step's frequency is taken as off for 0, on for anything else.
+ *
+ * TIM7 and the motor's GPIO are held for as long as a pattern plays,
+ * which keeps us out of STOP mode, where the timer would stop too.
+ */
+#define VIBRATE_TIM             TIM7
+#define VIBRATE_TIM_IRQ         TIM7_IRQn
+#define VIBRATE_TIM_CLOCK       RCC_APB1Periph_TIM7
+/* the timer counts half milliseconds, so one load is at most ~32s */
+#define VIBRATE_TICKS_PER_MS    2
+#define VIBRATE_TIM_MAX_MS      (0xFFFF / VIBRATE_TICKS_PER_MS)
 
 extern const vibrate_t hw_vibrate_config;
 
+static const VibratePatternPair_t *_steps;
+static uint8_t _count;
+static uint8_t _index;
+static uint32_t _remaining_ms;
+static volatile uint8_t _playing;
+
+static void _tim_init(void);
+
 void hw_vibrate_init(void)
 {
     stm32_power_request(STM32_POWER_AHB1, hw_vibrate_config.clock);
@@ -30,6 +57,8 @@ void hw_vibrate_init(void)
     GPIO_Init(hw_vibrate_config.port, &GPIO_InitStructure_Vibr);
     
     stm32_power_release(STM32_POWER_AHB1, hw_vibrate_config.clock);
+    
+    _tim_init();
 }
 
 
@@ -44,3 +73,130 @@ void hw_vibrate_enable(uint8_t enabled)
     
     stm32_power_release(STM32_POWER_AHB1, hw_vibrate_config.clock);
 }
+
+static void _tim_init(void)
+{
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+    RCC_ClocksTypeDef clocks;
+    
+    /* APB1 timers run at twice PCLK1 whenever APB1 is divided down */
+    RCC_GetClocksFreq(&clocks);
+    uint32_t tim_hz = clocks.PCLK1_Frequency == clocks.HCLK_Frequency ?
+                      clocks.PCLK1_Frequency : clocks.PCLK1_Frequency * 2;
+    
+    stm32_power_request(STM32_POWER_APB1, VIBRATE_TIM_CLOCK);
+    
+    TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+    TIM_TimeBaseStructure.TIM_Prescaler = tim_hz / (1000 * VIBRATE_TICKS_PER_MS) - 1;
+    TIM_TimeBaseStructure.TIM_Period = 0xFFFF;
+    TIM_TimeBaseInit(VIBRATE_TIM, &TIM_TimeBaseStructure);
+    /* the prescaler is loaded by that update; only the count wrapping
+     * should interrupt from here on */
+    TIM_UpdateRequestConfig(VIBRATE_TIM, TIM_UpdateSource_Regular);
+    /* no preload, so a new length written in the ISR is the one
+     * counting now */
+    TIM_ARRPreloadConfig(VIBRATE_TIM, DISABLE);
+    TIM_ClearITPendingBit(VIBRATE_TIM, TIM_IT_Update);
+    TIM_ITConfig(VIBRATE_TIM, TIM_IT_Update, ENABLE);
+    
+    stm32_power_release(STM32_POWER_APB1, VIBRATE_TIM_CLOCK);
+    
+    NVIC_InitStructure.NVIC_IRQChannel = VIBRATE_TIM_IRQ;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 6;  // must be > 5
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+static void _motor(uint8_t on)
+{
+    if (on)
+        GPIO_SetBits(hw_vibrate_config.port, hw_vibrate_config.pin);
+    else
+        GPIO_ResetBits(hw_vibrate_config.port, hw_vibrate_config.pin);
+}
+
+/* Load the timer with the next stretch of the current step */
+static void _arm(void)
+{
+    uint32_t ms = _remaining_ms > VIBRATE_TIM_MAX_MS ? VIBRATE_TIM_MAX_MS : _remaining_ms;
+    
+    _remaining_ms -= ms;
+    VIBRATE_TIM->ARR = ms * VIBRATE_TICKS_PER_MS - 1;
+}
+
+/* Motor off, timer off, clocks back. Timer interrupt masked or in it */
+static void _finish(void)
+{
+    TIM_Cmd(VIBRATE_TIM, DISABLE);
+    _motor(0);
+    _playing = 0;
+    stm32_power_release(STM32_POWER_APB1, VIBRATE_TIM_CLOCK);
+    stm32_power_release(STM32_POWER_AHB1, hw_vibrate_config.clock);
+}
+
+/* On to the next step with a length, or finish. 0 if that was the end */
+static uint8_t _step(void)
+{
+    while (_index < _count && !_steps[_index].duration_ms)
+        _index++;
+    
+    if (_index >= _count)
+    {
+        _finish();
+        return 0;
+    }
+    
+    _motor(_steps[_index].frequency != 0);
+    _remaining_ms = _steps[_index].duration_ms;
+    _index++;
+    _arm();
+    
+    return 1;
+}
+
+void hw_vibrate_play(const VibratePatternPair_t *steps, uint8_t count)
+{
+    hw_vibrate_stop();
+    
+    stm32_power_request(STM32_POWER_AHB1, hw_vibrate_config.clock);
+    stm32_power_request(STM32_POWER_APB1, VIBRATE_TIM_CLOCK);
+    
+    NVIC_DisableIRQ(VIBRATE_TIM_IRQ);
+    _steps = steps;
+    _count = count;
+    _index = 0;
+    _playing = 1;
+    VIBRATE_TIM->CNT = 0;
+    if (_step())
+    {
+        TIM_ClearITPendingBit(VIBRATE_TIM, TIM_IT_Update);
+        TIM_Cmd(VIBRATE_TIM, ENABLE);
+    }
+    NVIC_EnableIRQ(VIBRATE_TIM_IRQ);
+}
+
+void hw_vibrate_stop(void)
+{
+    NVIC_DisableIRQ(VIBRATE_TIM_IRQ);
+    if (_playing)
+        _finish();
+    NVIC_EnableIRQ(VIBRATE_TIM_IRQ);
+}
+
+/* A step, or a stretch of one, is up. The counter has already started
+ * on the next from 0, we only have to tell it how far to go */
+void TIM7_IRQHandler(void)
+{
+    traceISR_ENTER();
+    if (TIM_GetITStatus(VIBRATE_TIM, TIM_IT_Update) != RESET)
+    {
+        TIM_ClearITPendingBit(VIBRATE_TIM, TIM_IT_Update);
+        if (_remaining_ms)
+            _arm();
+        else
+            _step();
+    }
+    traceISR_EXIT();
+}
@@ -7,6 +7,7 @@
  */
 
 #include "stm32f4xx.h"
+#include "vibrate.h"
 
 typedef struct {
     uint16_t pin;
@@ -17,3 +18,11 @@ typedef struct {
 
 void hw_vibrate_init(void);
 void hw_vibrate_enable(uint8_t enabled);
+
+/**
+ * @brief Play count steps of a pattern off a hardware timer, and return at
+ * once. Whatever was playing stops. The steps are read as they come up,
+ * so must stay put until it is done. Not from an ISR
+ */
+void hw_vibrate_play(const VibratePatternPair_t *steps, uint8_t count);
+void hw_vibrate_stop(void);
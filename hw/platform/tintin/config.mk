@@ -4,7 +4,10 @@ CFLAGS_tintin += $(CFLAGS_driver_stm32_power)
 CFLAGS_tintin += $(CFLAGS_driver_stm32_rtc)
 CFLAGS_tintin += $(CFLAGS_driver_stm32_backlight)
 CFLAGS_tintin += $(CFLAGS_driver_stm32_dma)
+CFLAGS_tintin += $(CFLAGS_driver_stm32_crc)
 CFLAGS_tintin += $(CFLAGS_driver_stm32_spi)
+CFLAGS_tintin += $(CFLAGS_driver_stm32_delay)
+CFLAGS_tintin += $(CFLAGS_driver_stm32_pc_sample)
 CFLAGS_tintin += $(CFLAGS_driver_stm32_usart)
 CFLAGS_tintin += $(CFLAGS_bt)
 CFLAGS_tintin += $(CFLAGS_driver_stm32_bluetooth_cc256x)
@@ -18,7 +21,10 @@ SRCS_tintin += $(SRCS_driver_stm32_rtc)
 SRCS_tintin += $(SRCS_driver_stm32_backlight)
 SRCS_tintin += $(SRCS_driver_stm32_usart)
 SRCS_tintin += $(SRCS_driver_stm32_dma)
+SRCS_tintin += $(SRCS_driver_stm32_crc)
 SRCS_tintin += $(SRCS_driver_stm32_spi)
+SRCS_tintin += $(SRCS_driver_stm32_delay)
+SRCS_tintin += $(SRCS_driver_stm32_pc_sample)
 SRCS_tintin += $(SRCS_bt)
 SRCS_tintin += $(SRCS_driver_stm32_bluetooth_cc256x)
 
@@ -26,9 +32,15 @@ SRCS_tintin += hw/platform/tintin/tintin.c
 SRCS_tintin += hw/platform/tintin/tintin_display.c
 SRCS_tintin += hw/platform/tintin/tintin_bluetooth.c
 SRCS_tintin += hw/platform/tintin/tintin_flash.c
-SRCS_tintin += hw/platform/tintin/tintin_asm.s
 
 LDFLAGS_tintin = $(LDFLAGS_stm32f2xx)
+
+# How much HOT_RAMFUNC code may go in SRAM, in bytes (see platform.h).
+# RAM is tight here, and the display code marks nothing, so this is the
+# timer list and the display's done ISR
+HOT_TEXT_tintin = 1536
+CFLAGS_tintin += -DHOT_PLACEMENT
+LDFLAGS_tintin += -Wl,--defsym,_hot_text_max=$(HOT_TEXT_tintin)
 LIBS_tintin = $(LIBS_stm32f2xx)
 
 QEMUFLAGS_tintin = -machine pebble-bb2 -cpu cortex-m3
@@ -5,6 +5,7 @@
 #include "stm32_buttons.h"
 #include "stm32_rtc.h"
 #include "stm32_backlight.h"
+#include "stm32_crc.h"
 #define DISPLAY_ROWS 168
 #define DISPLAY_COLS 144
 
@@ -20,6 +21,12 @@
 #define REGION_FS_START         0x2c0000
 #define REGION_FS_PAGE_SIZE     0x1000
 #define REGION_FS_N_PAGES       ((0x3E0000 - REGION_FS_START) / REGION_FS_PAGE_SIZE)
+/* a subsector erase is one fs page */
+#define REGION_FS_ERASE_SIZE    0x1000
+
+/* The last crash, see crash_dump.c. Just past the filesystem */
+#define REGION_CRASH_START      0x3E0000
+#define REGION_CRASH_SIZE       0x2000
 
 #define REGION_APP_RES_START    0xB3A000
 #define REGION_APP_RES_SIZE     0x7D000
@@ -60,4 +67,13 @@
 
 #define CCRAM
 
+/* HOT_RAMFUNC runs a function from SRAM, off the flash wait states. There
+ * is no CCM, so HOT_DATA stays where it would be */
+#ifdef HOT_PLACEMENT
+#define HOT_RAMFUNC __attribute__((section(".ramfunc"), noinline))
+#else
+#define HOT_RAMFUNC
+#endif
+#define HOT_DATA
+
 #endif
@@ -13,6 +13,8 @@
 #define MEMORY_SIZE_APP           40000
 #define MEMORY_SIZE_WORKER        10000
 #define MEMORY_SIZE_OVERLAY       16000
+#define MEMORY_SIZE_FONT_CACHE    12000
+#define MEMORY_SIZE_RES_BITMAP_CACHE 3000
 
 /* Size of the stack in WORDS */
 #define MEMORY_SIZE_APP_STACK     4000
@@ -32,3 +34,6 @@
 #define BLUETOOTH_MODULE_NAME_LENGTH 0x09
 #define BLUETOOTH_MODULE_LE_NAME     'P', 'e', 'b', 'b', 'l', 'e', ' ', 'L', 'E'
 #define BLUETOOTH_MODULE_GAP_NAME    "Pebble RblOs"
+/* the HCI UART once the chip is up. The CC256x's most, and APB2's 32MHz
+ * /8 exactly */
+#define BLUETOOTH_MODULE_UART_BAUD   4000000
@@ -25,6 +25,7 @@
 #include "stm32_spi.h"
 #include "stm32_cc256x.h"
 #include "btstack_rebble.h"
+#include "crash_dump.h"
 
 // extern void *strcpy(char *a2, const char *a1);
 
@@ -48,12 +49,35 @@ static const stm32_usart_config_t _u3_config = {
     .af                   = GPIO_AF_USART3,
 };
 
+/* TX only, for the ring. USART3_TX is DMA1 stream 3 channel 4; the
+ * display's SPI2 names stream 3 for its RX, but only ever sends */
+static const stm32_dma_t _u3_dma = {
+    .dma_clock            = RCC_AHB1Periph_DMA1,
+    .dma_tx_stream        = DMA1_Stream3,
+    .dma_rx_stream        = DMA1_Stream3,
+    .dma_tx_channel       = DMA_Channel_4,
+    .dma_rx_channel       = DMA_Channel_4,
+    .dma_irq_tx_pri       = 13,
+    .dma_irq_rx_pri       = 13,
+    .dma_irq_tx_channel   = DMA1_Stream3_IRQn,
+    .dma_irq_rx_channel   = DMA1_Stream3_IRQn,
+    .dma_tx_channel_flags = STM32_DMA_MK_FLAGS(3),
+    .dma_rx_channel_flags = STM32_DMA_MK_FLAGS(3),
+    .dma_tx_irq_flag      = DMA_IT_TCIF3,
+    .dma_rx_irq_flag      = DMA_IT_TCIF3,
+};
+
 static stm32_usart_t _usart3 = {
     &_u3_config,
-    NULL,
+    &_u3_dma,
     230400
 };
 
+/* log output is copied in here and goes out by DMA */
+static uint8_t _usart3_ring[1024];
+
+STM32_USART_MK_TX_RING_IRQ_HANDLER(&_usart3, 1, 3)
+
 
 void debug_init() {
     _init_USART3();
@@ -62,12 +86,10 @@ void debug_init() {
 
 /* note that locking needs to be handled by external entity here */
 void debug_write(const unsigned char *p, size_t len) {
-    int i;
-
     if (!_debug_initialized)
         return;
 
-    stm32_usart_write(&_usart3, p, len);
+    stm32_usart_write_async(&_usart3, p, len);
 }
 
 /*
@@ -78,6 +100,7 @@ static inline void _init_USART3(void)
     /* leave the usart clock on */
     stm32_power_request(_usart3.config->usart_periph_bus, _usart3.config->usart_clock);
     stm32_usart_init_device(&_usart3);    
+    stm32_usart_tx_ring(&_usart3, _usart3_ring, sizeof(_usart3_ring));
 }
 
 /*** platform ***/
@@ -91,6 +114,7 @@ void platform_init() {
 
 void platform_init_late() {
     printf("tintin: late init\n");
+    hw_dma_init();
     RCC_ClocksTypeDef RCC_Clocks;
     RCC_GetClocksFreq(&RCC_Clocks);
     printf("c     : %lu", SystemCoreClock);
@@ -144,6 +168,59 @@ uint16_t hw_ambient_get() {
     return 0;
 }
 
+/*** accelerometer. Not driven yet, see snowy_accel.c for what it should do ***/
+
+uint8_t hw_accel_init(void) {
+    return 0;
+}
+
+void hw_accel_set_isr(hw_accel_isr_t isr) {
+}
+
+uint16_t hw_accel_start(uint16_t hz, uint16_t watermark) {
+    return 0;
+}
+
+void hw_accel_stop(void) {
+}
+
+uint16_t hw_accel_read(hw_accel_sample_t *buf, uint16_t max) {
+    return 0;
+}
+
+uint8_t hw_accel_peek(hw_accel_sample_t *sample) {
+    return 0;
+}
+
+void hw_accel_tap_enable(uint8_t enabled) {
+}
+
+uint8_t hw_accel_tap_read(uint8_t *axis, int8_t *direction) {
+    return 0;
+}
+
+/* smartstrap */
+
+uint8_t hw_smartstrap_init(void) {
+    return 0;
+}
+
+void hw_smartstrap_start(uint8_t *rx_buf, size_t len, hw_smartstrap_isr_t isr) {
+}
+
+void hw_smartstrap_stop(void) {
+}
+
+size_t hw_smartstrap_rx_pos(void) {
+    return 0;
+}
+
+void hw_smartstrap_write(const uint8_t *buf, size_t len) {
+}
+
+void hw_smartstrap_set_baud(uint32_t baud) {
+}
+
 
 /* buttons */
 
@@ -175,6 +252,19 @@ stm32_backlight_config_t platform_backlight = {
 };
 
 
+/* 2d acceleration. No DMA2D on the f2, so graphics does it all in software */
+
+void hw_gfx_init(void) {
+}
+
+uint8_t hw_gfx_fill(uint8_t *dst, uint16_t dst_stride, uint16_t width, uint16_t height, uint8_t color) {
+    return 0;
+}
+
+uint8_t hw_gfx_copy(uint8_t *dst, uint16_t dst_stride, const uint8_t *src, uint16_t src_stride, uint16_t width, uint16_t height) {
+    return 0;
+}
+
 /* vibrate */
 
 void hw_vibrate_init() {
@@ -183,6 +273,12 @@ void hw_vibrate_init() {
 void hw_vibrate_enable(uint8_t enabled) {
 }
 
+void hw_vibrate_play(const VibratePatternPair_t *steps, uint8_t count) {
+}
+
+void hw_vibrate_stop(void) {
+}
+
 
 
 void ss_debug_write(const unsigned char *p, size_t len)
@@ -209,43 +305,64 @@ uint8_t hw_power_get_chg_status(void)
 {
 }
 
-void HardFault_Handler(uint32_t *sp)
+void hw_power_set_isr(hw_power_isr_t isr)
+{
+}
+
+/* The stack the fault happened on goes to the C half in r0, with the
+ * frame the exception pushed on top, and EXC_RETURN in r1 */
+#define FAULT_HANDLER(name) \
+    __attribute__((naked)) void name##_Handler() \
+    { \
+        asm volatile ( \
+            "TST   LR, #4\n\t" \
+            "ITE   EQ\n\t" \
+            "MRSEQ R0, MSP\n\t" \
+            "MRSNE R0, PSP\n\t" \
+            "MOV   R1, LR\n\t" \
+            "LDR   R2, =" #name "_Handler_C\n\t" \
+            "BX    R2" \
+        ); \
+    }
+
+static void _fault_regs(uint32_t *sp)
 {
-    printf("*** HARD FAULT ***\n");
     printf("   R0: %08lx, R1: %08lx, R2: %08lx, R3: %08lx\n", sp[0], sp[1], sp[2], sp[3]);
     printf("  R12: %08lx, LR: %08lx, PC: %08lx, SP: %08lx\n", sp[4], sp[5], sp[6], (uint32_t) sp);
+}
+
+/* Each writes a crash record and resets, once boot is far enough along */
+__attribute__((used)) void HardFault_Handler_C(uint32_t *sp, uint32_t exc_return)
+{
+    printf("*** HARD FAULT ***\n");
+    _fault_regs(sp);
+    crash_dump_capture(CrashDumpHardFault, sp, exc_return, 0, 0, NULL);
     while(1);
 }
 
-void BusFault_Handler()
+__attribute__((used)) void BusFault_Handler_C(uint32_t *sp, uint32_t exc_return)
 {
     printf("*** BUS FAULT ***\n");
+    _fault_regs(sp);
+    crash_dump_capture(CrashDumpBusFault, sp, exc_return, 0, 0, NULL);
     while(1);
 }
 
-void UsageFault_Handler_C(uint32_t *sp)
+__attribute__((used)) void UsageFault_Handler_C(uint32_t *sp, uint32_t exc_return)
 {
     uint16_t ufsr = *(uint16_t *)0xE000ED2A;
     
     printf("*** USAGE FAULT ***\n");
-    printf("   R0: %08lx, R1: %08lx, R2: %08lx, R3: %08lx\n", sp[0], sp[1], sp[2], sp[3]);
-    printf("  R12: %08lx, LR: %08lx, PC: %08lx, SP: %08lx\n", sp[4], sp[5], sp[6], (uint32_t) sp);
+    _fault_regs(sp);
     printf("  UFSR: %04x\n", ufsr);
     
     if (ufsr & 1) {
         printf("    *PC == %04x\n", *(uint16_t *)sp[6]);
     }
+    crash_dump_capture(CrashDumpUsageFault, sp, exc_return, 0, 0, NULL);
     while(1);
 }
 
-__attribute__((naked)) void UsageFault_Handler()
-{
-    asm volatile (
-        "TST   LR, #4\n\t"
-        "ITE   EQ\n\t"
-        "MRSEQ R0, MSP\n\t"
-        "MRSNE R0, PSP\n\t"
-        "LDR   R1, =UsageFault_Handler_C\n\t"
-        "BX    R1"
-    );
-}
+FAULT_HANDLER(HardFault)
+FAULT_HANDLER(BusFault)
+FAULT_HANDLER(UsageFault)
@@ -7,6 +7,7 @@
 #include "stm32f2xx.h"
 #include "appmanager.h"
 #include "flash.h"
+#include "vibrate.h"
 #include "stm32_usart.h"
 
 extern int printf ( const char* , ... );
@@ -19,16 +20,54 @@ void platform_init_late();
 void hw_ambient_init();
 uint16_t hw_ambient_get();
 
-void delay_us(uint32_t us);
+/* one sample, in mG */
+typedef struct hw_accel_sample {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} hw_accel_sample_t;
+
+#define HW_ACCEL_EVENT_FIFO 1
+#define HW_ACCEL_EVENT_TAP  2
+typedef void (*hw_accel_isr_t)(uint8_t events);
+uint8_t hw_accel_init(void);
+void hw_accel_set_isr(hw_accel_isr_t isr);
+uint16_t hw_accel_start(uint16_t hz, uint16_t watermark);
+void hw_accel_stop(void);
+uint16_t hw_accel_read(hw_accel_sample_t *buf, uint16_t max);
+uint8_t hw_accel_peek(hw_accel_sample_t *sample);
+void hw_accel_tap_enable(uint8_t enabled);
+uint8_t hw_accel_tap_read(uint8_t *axis, int8_t *direction);
+
+/* no smartstrap port */
+typedef void (*hw_smartstrap_isr_t)(void);
+uint8_t hw_smartstrap_init(void);
+void hw_smartstrap_start(uint8_t *rx_buf, size_t len, hw_smartstrap_isr_t isr);
+void hw_smartstrap_stop(void);
+size_t hw_smartstrap_rx_pos(void);
+void hw_smartstrap_write(const uint8_t *buf, size_t len);
+void hw_smartstrap_set_baud(uint32_t baud);
+
+#include "stm32_delay.h"
+
+/* 144 pixels, padded to a multiple of 32 bits */
+#define DISPLAY_ROW_BYTES 20
+#define MAX_FRAMEBUFFER_SIZE (168 * DISPLAY_ROW_BYTES)
 
 void hw_display_init();
+void hw_display_splash(void);
 void hw_display_reset();
 void hw_display_start();
 void hw_display_start_frame(uint8_t xoffset, uint8_t yoffset);
+void hw_display_start_frame_region(uint8_t x, uint8_t y, uint8_t width, uint8_t height);
 uint8_t hw_display_get_state();
 uint8_t *hw_display_get_buffer(void);
 uint8_t hw_display_process_isr(void);
 
+void hw_gfx_init(void);
+uint8_t hw_gfx_fill(uint8_t *dst, uint16_t dst_stride, uint16_t width, uint16_t height, uint8_t color);
+uint8_t hw_gfx_copy(uint8_t *dst, uint16_t dst_stride, const uint8_t *src, uint16_t src_stride, uint16_t width, uint16_t height);
+
 #define WATCHDOG_RESET_MS 500
 void hw_watchdog_init();
 void hw_watchdog_reset();
@@ -37,16 +76,29 @@ void rtc_init();
 void rtc_config();
 void hw_get_time_str(char *buf);
 struct tm *hw_get_time(void);
+void hw_set_date_time(struct tm date_time);
 void rtc_set_timer_interval(TimeUnits tick_units);
 void rtc_disable_timer_interval(void);
 
 void hw_vibrate_init();
 void hw_vibrate_enable(uint8_t enabled);
+void hw_vibrate_play(const VibratePatternPair_t *steps, uint8_t count);
+void hw_vibrate_stop(void);
+
+typedef void (*hw_power_isr_t)(void);
+void hw_power_init();
+uint16_t hw_power_get_bat_mv(void);
+uint8_t hw_power_get_chg_status(void);
+void hw_power_set_isr(hw_power_isr_t isr);
 
 void ss_debug_write(const unsigned char *p, size_t len);
 
 void hw_flash_init(void);
 void hw_flash_read_bytes(uint32_t addr, uint8_t *buf, size_t len);
+void hw_flash_write_bytes(uint32_t addr, const uint8_t *buf, size_t len);
+void hw_flash_erase(uint32_t addr, size_t len);
+const void *hw_flash_map(uint32_t addr, size_t len);
+bool hw_flash_unmap(const void *ptr);
 #define REGION_FPGA_START       0x0
 #define REGION_FPGA_SIZE        0x0
 
@@ -23,12 +23,8 @@
 /* comment out of you don't want DMA */
 #define DMA_ENABLED
 
-/* How many rows do we want to send at once 
- * NOTE: This is going to use more buffer ram the biggger you go
- * also make sure its divisible by 168 lest you be doomed to 
- * sending too many bytes and having to fix it.
- */
-#define _DMA_ROW_COUNT 8
+/* Each line goes out as its address, 18 bytes of pixels and a trailer */
+#define _LINE_BYTES 20
 
 static const stm32_spi_config_t _spi2_config = {
     .spi                  = SPI2,
@@ -71,7 +67,6 @@ static stm32_spi_t _spi2 = {
 #endif
 };
 
-static void _send_next(uint32_t row);
 static void _spi_tx_done(void);
 
 /* TX ISR for DMA */
@@ -84,8 +79,30 @@ STM32_SPI_MK_TX_IRQ_HANDLER(&_spi2, 1, 4, _spi_tx_done)
 
 /* display */
 
-static uint8_t _display_fb[168][20];
-static void _hw_display_start_frame_dma(uint8_t x, uint8_t y);
+/* word aligned, for blit_bw */
+static uint8_t _display_fb[168][DISPLAY_ROW_BYTES] __attribute__((aligned(4)));
+static void _hw_display_start_frame_dma(uint8_t y, uint8_t height);
+
+#ifdef DMA_ENABLED
+/* The framebuffer as the panel wants it, kept between frames so we
+ * can tell which lines changed. The panel takes lines in any order and
+ * any number, so a frame only sends the lines that changed */
+static uint8_t _display_lines[168][_LINE_BYTES];
+static bool _display_lines_valid;
+
+/* Changed lines are packed together here so they go in one DMA.
+ * Past this many we send the whole changed span out of _display_lines */
+#define _PACKED_LINES 48
+static uint8_t _display_packed[_PACKED_LINES][_LINE_BYTES];
+/* whether the last frame sent anything, and so has a transfer to finish */
+static bool _display_sending;
+#endif
+
+/* There's nothing cheaper than a frame to put up here, and the panel is
+ * quick to init, so the first frame is the first thing on it */
+void hw_display_splash(void)
+{
+}
 
 void hw_display_init() {
     DRV_LOG("Display", APP_LOG_LEVEL_INFO, "tintin: hw_display_init");
@@ -114,6 +131,13 @@ void hw_display_init() {
 
     /* Set up the SPI controller, SPI2. */
     stm32_spi_init_device(&_spi2);
+
+#ifdef DMA_ENABLED
+    for (int i = 0; i < 168; i++) {
+        _display_lines[i][0] = __RBIT(__REV(168 - i));
+        _display_lines[i][_LINE_BYTES - 1] = 0;
+    }
+#endif
     
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOC);
@@ -129,7 +153,7 @@ void hw_display_start() {
 
 void hw_display_start_frame(uint8_t x, uint8_t y) {
 #ifdef DMA_ENABLED
-    _hw_display_start_frame_dma(x, y);
+    _hw_display_start_frame_dma(0, 168);
     return;
 #else
     stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
@@ -149,42 +173,94 @@ void hw_display_start_frame(uint8_t x, uint8_t y) {
     delay_us(7);
     GPIO_WriteBit(GPIOB, 1 << DISPLAY_CS, 0);
 
-    stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
+    stm32_power_release_lazy(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
 
     display_done_isr(0);
 #endif
 }
 
-static void _hw_display_start_frame_dma(uint8_t x, uint8_t y) {
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
-    stm32_power_request(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
-
-//     DRV_LOG("Display", APP_LOG_LEVEL_DEBUG, "tintin: Display Yeeehaw (DMA) %d %d", x, y);
-    GPIO_WriteBit(GPIOB, 1 << DISPLAY_CS, 1);
-    delay_us(10);
-    stm32_spi_write(&_spi2, DISPLAY_FRAME_START);
-    
-    /* Start the transfer */
-    _send_next(0);
+/*
+ * The Sharp panel is addressed by line, so only the rows of the region
+ * are looked at. Columns still go out whole
+ */
+void hw_display_start_frame_region(uint8_t x, uint8_t y, uint8_t width, uint8_t height) {
+#ifdef DMA_ENABLED
+    if (y >= 168)
+        height = 0;
+    else if (height > 168 - y)
+        height = 168 - y;
+    _hw_display_start_frame_dma(y, height);
+#else
+    hw_display_start_frame(0, 0);
+#endif
 }
 
-static void _send_next(uint32_t row)
+#ifdef DMA_ENABLED
+/*
+ * Convert rows y to y + height into _display_lines, packing the ones
+ * that changed into _display_packed while they fit.
+ * Returns how many changed, and the span they cover
+ */
+static uint8_t _lines_update(uint8_t y, uint8_t height, uint8_t *first, uint8_t *last)
 {
-    static uint8_t row_buf[20 * _DMA_ROW_COUNT];
-    uint16_t len = 20 * _DMA_ROW_COUNT;
-    
-    for (int i = 0; i < _DMA_ROW_COUNT; i++)
+    uint8_t changed = 0;
+
+    for (int i = y; i < y + height; i++)
     {
-        uint32_t rp = i * 20;
-        row_buf[rp] = __RBIT(__REV(168 - row - i));
+        uint8_t *line = _display_lines[i];
+        bool row_changed = !_display_lines_valid;
+
         for (int j = 0; j < 18; j++) {
-            row_buf[rp + j + 1] = _display_fb[row + i][17-j];
+            uint8_t b = _display_fb[i][17-j];
+            if (line[j + 1] != b) {
+                line[j + 1] = b;
+                row_changed = true;
+            }
         }
-        row_buf[rp + 19] = 0;
+
+        if (!row_changed)
+            continue;
+        if (!changed)
+            *first = i;
+        *last = i;
+        if (changed < _PACKED_LINES)
+            memcpy(_display_packed[changed], line, _LINE_BYTES);
+        changed++;
     }
 
-    stm32_spi_send_dma(&_spi2, row_buf, len);
+    /* only a full frame leaves every line known */
+    if (y == 0 && height == 168)
+        _display_lines_valid = true;
+
+    return changed;
+}
+#endif
+
+static void _hw_display_start_frame_dma(uint8_t y, uint8_t height) {
+#ifdef DMA_ENABLED
+    uint8_t first, last;
+    uint8_t changed = _lines_update(y, height, &first, &last);
+
+    _display_sending = changed > 0;
+    if (!_display_sending) {
+        /* the panel already shows this */
+        display_done_isr(0);
+        return;
+    }
+
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
+    stm32_power_request(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
+
+    GPIO_WriteBit(GPIOB, 1 << DISPLAY_CS, 1);
+    delay_us(10);
+    stm32_spi_write(&_spi2, DISPLAY_FRAME_START);
+
+    if (changed <= _PACKED_LINES)
+        stm32_spi_send_dma(&_spi2, _display_packed[0], changed * _LINE_BYTES);
+    else
+        stm32_spi_send_dma(&_spi2, _display_lines[first], (last - first + 1) * _LINE_BYTES);
+#endif
 }
 
 uint8_t *hw_display_get_buffer(void) {
@@ -202,23 +278,18 @@ static void _spi_tx_done(void)
 
 uint8_t hw_display_process_isr(void)
 {
-    static uint8_t row_index = 0;
-    
-    if (row_index < 168 - _DMA_ROW_COUNT)
-    {
-        row_index += _DMA_ROW_COUNT;
-        _send_next(row_index);
-        return 0;
-    }
-    row_index = 0;
+#ifdef DMA_ENABLED
+    if (!_display_sending)
+        return 1;
+    _display_sending = false;
 
-    /* if we are finished sending each column, then reset and stop */
+    /* the whole frame went in one go, so finish it off */
     stm32_spi_write(&_spi2, 0);
     delay_us(7);
     GPIO_WriteBit(GPIOB, 1 << DISPLAY_CS, 0);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
-    stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
-    
+    stm32_power_release_lazy(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
+    stm32_power_release_lazy(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
+#endif
+
     return 1;
 }
-
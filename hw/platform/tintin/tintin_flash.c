@@ -20,8 +20,6 @@
 #include "stm32_power.h"
 #include "stm32_spi.h"
 
-static void _spi_flash_rx_done(void);
-static void _spi_flash_tx_done(void) ;
 static const stm32_spi_config_t _spi1_config = {
     .spi                  = SPI1,
     .spi_periph_bus       = STM32_POWER_APB2,
@@ -70,14 +68,19 @@ static stm32_spi_t _spi1 = {
     &_spi1_dma, /* dma */
 };
 
-/* Macros to create the IRQ Handlers. TX does no work here */
-STM32_SPI_MK_TX_IRQ_HANDLER(&_spi1, 2, 5, _spi_flash_tx_done)
-STM32_SPI_MK_RX_IRQ_HANDLER(&_spi1, 2, 0, _spi_flash_rx_done)
+/* Macros to create the IRQ Handlers. Everything goes as transactions,
+ * which the RX side runs */
+STM32_SPI_MK_TX_IRQ_HANDLER(&_spi1, 2, 5, NULL)
+STM32_SPI_MK_RX_IRQ_HANDLER(&_spi1, 2, 0, NULL)
 
 static uint16_t _part_id(uint8_t *buf);
-static uint8_t _dma_enabled;
+static void _hw_flash_read_done(stm32_spi_txn_t *txn);
 
 #define JEDEC_READ 0x03
+#define JEDEC_FAST_READ 0x0B
+#define JEDEC_PP 0x02
+#define JEDEC_WREN 0x06
+#define JEDEC_SSE 0x20
 #define JEDEC_RDSR 0x05
 #define JEDEC_IDCODE 0x9F
 #define JEDEC_DUMMY 0xA9
@@ -86,11 +89,18 @@ static uint8_t _dma_enabled;
 
 #define JEDEC_RDSR_BUSY 0x01
 
+#define JEDEC_PAGE_SIZE 256
+#define JEDEC_SUBSECTOR_SIZE 0x1000
+
 #define JEDEC_IDCODE_MICRON_N25Q032A11 0x20BB16 /* bianca / qemu / ev2_5 */
 #define JEDEC_IDCODE_MICRON_N25Q064A11 0x20BB17 /* v1_5 */
 
+/* Read with FAST_READ, which is good past the 54MHz READ tops out at,
+ * for one dummy byte after the address. Comment out for plain READ */
+#define FLASH_FAST_READ
+
 
-static void _hw_flash_enable(int i) {
+static void _hw_flash_enable(uint8_t i) {
     stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
 
     GPIO_WriteBit(GPIOA, 1 << 4, !i);
@@ -99,12 +109,25 @@ static void _hw_flash_enable(int i) {
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
 }
 
-static void _hw_flash_wfidle() {
-    _hw_flash_enable(1);
-    stm32_spi_write_read(&_spi1, JEDEC_RDSR);
-    while (stm32_spi_write_read(&_spi1, JEDEC_DUMMY) & JEDEC_RDSR_BUSY)
-        ;
-    _hw_flash_enable(0);
+/* RDSR until the part is done, asleep between if it'll be a while */
+static void _hw_flash_wfidle(uint8_t sleep) {
+    uint8_t sr;
+    stm32_spi_txn_t txn = {
+        .select  = _hw_flash_enable,
+        .cmd     = { JEDEC_RDSR },
+        .cmd_len = 1,
+        .rx      = &sr,
+        .len     = 1,
+        .dummy   = JEDEC_DUMMY,
+    };
+    
+    for (;;) {
+        stm32_spi_txn_run(&_spi1, &txn);
+        if (!(sr & JEDEC_RDSR_BUSY))
+            break;
+        if (sleep)
+            vTaskDelay(1);
+    }
 }
 
 void hw_flash_init(void) {
@@ -134,7 +157,7 @@ void hw_flash_init(void) {
     _hw_flash_enable(0);
     delay_us(100);
     
-    _hw_flash_wfidle();
+    _hw_flash_wfidle(0);
      
     uint8_t outdata[4] = { JEDEC_IDCODE, JEDEC_DUMMY, JEDEC_DUMMY, JEDEC_DUMMY };
     uint8_t indata[4];
@@ -159,15 +182,19 @@ void hw_flash_init(void) {
     delay_us(100);
     _hw_flash_enable(1);
     delay_us(10);
-    _dma_enabled = !stm32_spi_send_recv_dma(&_spi1, outdata, 4, indata, 4);
+    uint8_t dma_enabled = !stm32_spi_send_recv_dma(&_spi1, outdata, 4, indata, 4);
     
     uint32_t tpid = _part_id(&indata[1]);
     _hw_flash_enable(0);
 
     /* fallback check to see if the values are the same */
-    _dma_enabled = (tpid == part_id);
+    dma_enabled = (tpid == part_id);
 
-    DRV_LOG("Flash", APP_LOG_LEVEL_INFO, "tintin flash: DMA %s", _dma_enabled ? "ENABLED" : "BROKEN");
+    /* without it, transactions are done by hand */
+    if (!dma_enabled)
+        _spi1.dma = NULL;
+
+    DRV_LOG("Flash", APP_LOG_LEVEL_INFO, "tintin flash: DMA %s", dma_enabled ? "ENABLED" : "BROKEN");
     stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_SPI1);
 }
 
@@ -188,54 +215,114 @@ static uint16_t _part_id(uint8_t *buf) {
     return part_id;
 }
 
+static stm32_spi_txn_t _read_txn = {
+    .select   = _hw_flash_enable,
+    .dummy    = JEDEC_DUMMY,
+    .callback = _hw_flash_read_done,
+};
+
+/*
+ * Writes and erases wait for the part to go idle before they return, so
+ * it's never busy here and there's no waiting for it. The command and the
+ * data go as one transaction, which finishes in _hw_flash_read_done
+ */
 void hw_flash_read_bytes(uint32_t addr, uint8_t *buf, size_t len) {
     assert(addr < 0x1000000 && "address too large for JEDEC_READ command");
     
-    stm32_power_request(STM32_POWER_APB2, RCC_APB2Periph_SPI1);
-    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
-    SPI_Cmd(SPI1, ENABLE);
-
-    memset(buf, 0, len);
+    uint8_t *cmd = _read_txn.cmd;
     
-    _hw_flash_wfidle();    
-
-    delay_us(10);
-    _hw_flash_enable(1);
-    delay_us(10);
-    stm32_spi_write_read(&_spi1, JEDEC_READ);
-    stm32_spi_write_read(&_spi1, (addr >> 16) & 0xFF);
-    stm32_spi_write_read(&_spi1, (addr >>  8) & 0xFF);
-    stm32_spi_write_read(&_spi1, (addr >>  0) & 0xFF);
-    delay_us(2);
-    
-    if (_dma_enabled) {
-        stm32_spi_recv_dma_async(&_spi1, buf, JEDEC_DUMMY, len);
+#ifdef FLASH_FAST_READ
+    cmd[0] = JEDEC_FAST_READ;
+    cmd[4] = JEDEC_DUMMY;
+    _read_txn.cmd_len = 5;
+#else
+    cmd[0] = JEDEC_READ;
+    _read_txn.cmd_len = 4;
+#endif
+    cmd[1] = (addr >> 16) & 0xFF;
+    cmd[2] = (addr >>  8) & 0xFF;
+    cmd[3] = (addr >>  0) & 0xFF;
+    _read_txn.rx = buf;
+    _read_txn.len = len;
+    
+    if (_spi1.dma) {
+        stm32_spi_txn_queue(&_spi1, &_read_txn);
         return;
     }
-    else {
-        for (int i = 0; i < len; i++) {
-            buf[i] = stm32_spi_write_read(&_spi1, JEDEC_DUMMY);
-        }
-    }
-    delay_us(10);
-    _hw_flash_enable(0);
-
+    
+    stm32_spi_txn_run(&_spi1, &_read_txn);
     flash_operation_complete(0);
-
-    stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_SPI1);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
 }
 
-static void _spi_flash_tx_done(void) 
-{
-    stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_SPI1);
-    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOA);
-    _hw_flash_enable(0);
+static void _hw_flash_read_done(stm32_spi_txn_t *txn) {
     flash_operation_complete_isr(0);
 }
 
-static void _spi_flash_rx_done(void) 
-{
+/*
+ * Write enable, then a command and address, and any data to go with it.
+ * The enable is queued ahead, so there's only the one wait. With
+ * interrupts off, as for a crash dump, nothing would take the queue on,
+ * so both go by hand
+ */
+static void _hw_flash_write_cmd(uint8_t cmd, uint32_t addr, const uint8_t *buf, size_t len) {
+    stm32_spi_txn_t wren = {
+        .select  = _hw_flash_enable,
+        .cmd     = { JEDEC_WREN },
+        .cmd_len = 1,
+    };
+    stm32_spi_txn_t txn = {
+        .select  = _hw_flash_enable,
+        .cmd     = { cmd, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, (addr >> 0) & 0xFF },
+        .cmd_len = 4,
+        .tx      = buf,
+        .len     = len,
+    };
     
+    if (_spi1.dma && !__get_PRIMASK())
+        stm32_spi_txn_queue(&_spi1, &wren);
+    else
+        stm32_spi_txn_run(&_spi1, &wren);
+    stm32_spi_txn_run(&_spi1, &txn);
 }
 
+/*
+ * Page program, a page at a time, as it can't cross one. Blocks until
+ * done; it's the part that's slow, not the bus
+ */
+void hw_flash_write_bytes(uint32_t addr, const uint8_t *buf, size_t len) {
+    assert(addr < 0x1000000 && "address too large for JEDEC_PP command");
+    
+    while (len) {
+        size_t n = JEDEC_PAGE_SIZE - (addr & (JEDEC_PAGE_SIZE - 1));
+        
+        if (n > len)
+            n = len;
+        
+        _hw_flash_write_cmd(JEDEC_PP, addr, buf, n);
+        _hw_flash_wfidle(0);
+        
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+/* erase 4K subsectors over the span, which should be on their boundaries */
+void hw_flash_erase(uint32_t addr, size_t len) {
+    uint32_t end = addr + len;
+    
+    /* lets everyone else run while an erase goes */
+    for (; addr < end; addr += JEDEC_SUBSECTOR_SIZE) {
+        _hw_flash_write_cmd(JEDEC_SSE, addr, NULL, 0);
+        _hw_flash_wfidle(1);
+    }
+}
+
+/* The SPI flash can't be mapped, everything has to be read */
+const void *hw_flash_map(uint32_t addr, size_t len) {
+    return NULL;
+}
+
+bool hw_flash_unmap(const void *ptr) {
+    return false;
+}
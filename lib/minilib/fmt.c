@@ -1,7 +1,11 @@
 /* fmt.c
- * Flags 0
- * Widths l, ll
- * Conversions d, o, u, x, c, s, p, %
+ * Flags 0, -
+ * Widths and precisions, either as * too
+ * Lengths l, ll
+ * Conversions d, i, o, u, x, X, c, s, p, %
+ *
+ * Numbers are converted without 64 bit division unless they need it:
+ * decimals two digits at a time from a table, hex and octal by shifting.
  *
  * Author: Elizabeth Fong-Jones <elly@leptoquark.net>
  * Public domain; optionally see LICENSE
@@ -17,18 +21,39 @@ enum {
 	ST_WIDTH    = 0x00000008,
 	ST_NEGATIVE = 0x00000010,
 	ST_PREC     = 0x00000020,
+	ST_LEFT     = 0x00000040,
+	ST_UPPER    = 0x00000080,
 };
 
-#define PACKWID(c,w)	((c)->state |= (w << 20))
+#define PACKWID(c,w)	((c)->state |= ((w) & 0xFFF) << 20)
 #define WID(c)		(((c)->state >> 20) & 0xFFF)
-#define PACKPREC(c,w)	((c)->state |= (w << 12))
+#define PACKPREC(c,w)	((c)->state |= ((w) & 0xFF) << 12)
 #define PREC(c)		(((c)->state >> 12) & 0xFF)
 
+static const char _digits[] = "0123456789abcdef";
+static const char _udigits[] = "0123456789ABCDEF";
+static const char _pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
 static void _out(struct fmtctx *ctx, char c) {
 	ctx->num_written++;
 	ctx->out(ctx->priv, c);
 }
 
+static void _pad(struct fmtctx *ctx, char c, int n) {
+	while (n-- > 0)
+		_out(ctx, c);
+}
+
 static int _isdigit(char c) {
 	return c >= '0' && c <= '9';
 }
@@ -43,68 +68,150 @@ static unsigned int _atou(const char **p) {
 	return v;
 }
 
+/* Decimal digits of v, written backwards ending at n. Returns the first */
+static char *_utoa10(char *n, unsigned long v) {
+	while (v >= 100) {
+		unsigned int r = (v % 100) * 2;
+		v /= 100;
+		*--n = _pairs[r + 1];
+		*--n = _pairs[r];
+	}
+	if (v >= 10) {
+		*--n = _pairs[v * 2 + 1];
+		*--n = _pairs[v * 2];
+	} else
+		*--n = '0' + v;
+	return n;
+}
+
 static void _utoa(struct fmtctx *ctx, unsigned int base, unsigned long long arg) {
-	static const char digits[] = "0123456789abcdef";
-	char buf[23];	/* 64 bits = 22 octal digits, leading '-' */
-	char *n = buf + sizeof(buf) - 1;
-	char *o = n;
-
-	if (!arg) {
-		*n = digits[0];
-		n--;
+	const char *digits = ctx->state & ST_UPPER ? _udigits : _digits;
+	char buf[23];	/* 64 bits = 22 octal digits */
+	char *end = buf + sizeof(buf);
+	char *n = end;
+	int len, zeros = 0, pad;
+
+	if (base == 10) {
+		/* the top half goes the slow way, and only if there is one */
+		if (arg >> 32) {
+			unsigned long long hi = arg / 1000000000;
+			unsigned long lo = arg - hi * 1000000000;
+			char *m = _utoa10(n, lo);
+			while (m > n - 9)
+				*--m = '0';
+			n = m;
+			arg = hi;
+			while (arg >> 32) {
+				*--n = '0' + arg % 10;
+				arg /= 10;
+			}
+			if (arg)
+				n = _utoa10(n, (unsigned long)arg);
+		} else
+			n = _utoa10(n, (unsigned long)arg);
+	} else {
+		unsigned int shift = base == 16 ? 4 : 3;
+		do {
+			*--n = digits[arg & (base - 1)];
+			arg >>= shift;
+		} while (arg);
 	}
-	while (arg) {
-		*n = digits[arg % base];
-		n--;
-		arg /= base;
+
+	len = end - n;
+	if (ctx->state & ST_PREC) {
+		/* at least that many digits; none at all for a 0 with none */
+		if (PREC(ctx) > (unsigned)len)
+			zeros = PREC(ctx) - len;
+		else if (!PREC(ctx) && len == 1 && *n == '0')
+			len = 0;
 	}
-	if (ctx->state & ST_ZEROPAD)
-		while ((unsigned)(o - n) < WID(ctx) && n > buf)
-			*n-- = '0';
+
+	pad = WID(ctx) - len - zeros - !!(ctx->state & ST_NEGATIVE);
+	if ((ctx->state & (ST_ZEROPAD | ST_LEFT | ST_PREC)) == ST_ZEROPAD && pad > 0) {
+		zeros += pad;
+		pad = 0;
+	}
+
+	if (!(ctx->state & ST_LEFT))
+		_pad(ctx, ' ', pad);
 	if (ctx->state & ST_NEGATIVE)
-		*n-- = '-';
-	n++;
-	while (n < buf + sizeof(buf))
+		_out(ctx, '-');
+	_pad(ctx, '0', zeros);
+	while (len--)
 		_out(ctx, *n++);
+	if (ctx->state & ST_LEFT)
+		_pad(ctx, ' ', pad);
 }
 
 static void _fmts(struct fmtctx *ctx, char c, va_list *va) {
 	const char *s = va_arg(*va, const char *);
-	unsigned int n = PREC(ctx);
+	unsigned int n = 0;
 	(void)c;
-	while ((!(ctx->state & ST_PREC) || n) && *s) {
-		_out(ctx, *s++);
-		n--;
-	}
+
+	if (!s)
+		s = "(null)";
+	while ((!(ctx->state & ST_PREC) || n < PREC(ctx)) && s[n])
+		n++;
+
+	if (!(ctx->state & ST_LEFT))
+		_pad(ctx, ' ', (int)WID(ctx) - (int)n);
+	for (unsigned int i = 0; i < n; i++)
+		_out(ctx, s[i]);
+	if (ctx->state & ST_LEFT)
+		_pad(ctx, ' ', (int)WID(ctx) - (int)n);
 }
 
 static void _fmtp(struct fmtctx *ctx, char c, va_list *va) {
 	void *p = va_arg(*va, void *);
 	(void)c;
-	ctx->state |= ST_ZEROPAD;
+	ctx->state = (ctx->state & ~(ST_LEFT | ST_PREC | (0xFFF << 20))) | ST_ZEROPAD;
 	PACKWID(ctx, sizeof(void*) * 2);
 	_utoa(ctx, 16, (unsigned long)p);
 }
 
 static void _fmtd(struct fmtctx *ctx, char c, va_list *va) {
-	int n = va_arg(*va, int);
+	long long n;
+	unsigned long long u;
 	(void)c;
+
+	if (ctx->state & ST_LONGER)
+		n = va_arg(*va, long long);
+	else if (ctx->state & ST_LONG)
+		n = va_arg(*va, long);
+	else
+		n = va_arg(*va, int);
+
+	u = n;
 	if (n < 0) {
 		ctx->state |= ST_NEGATIVE;
-		n = -n;
+		u = -u;
 	}
-	_utoa(ctx, 10, n);
+	_utoa(ctx, 10, u);
 }
 
 static void _fmtu(struct fmtctx *ctx, char c, va_list *va) {
-	unsigned int n = va_arg(*va, unsigned int);
+	unsigned long long n;
+
+	if (ctx->state & ST_LONGER)
+		n = va_arg(*va, unsigned long long);
+	else if (ctx->state & ST_LONG)
+		n = va_arg(*va, unsigned long);
+	else
+		n = va_arg(*va, unsigned int);
+
+	if (c == 'X')
+		ctx->state |= ST_UPPER;
 	_utoa(ctx, c == 'u' ? 10 : (c == 'o' ? 8 : 16), n);
 }
 
 static void _fmtc(struct fmtctx *ctx, char c, va_list *va) {
 	char n = va_arg(*va, int);
 	(void)c;
+	if (!(ctx->state & ST_LEFT))
+		_pad(ctx, ' ', (int)WID(ctx) - 1);
 	_out(ctx, n);
+	if (ctx->state & ST_LEFT)
+		_pad(ctx, ' ', (int)WID(ctx) - 1);
 }
 
 static void _fmtpct(struct fmtctx *ctx, char c, va_list *va) {
@@ -120,16 +227,22 @@ struct {
 	{ 's', _fmts },
 	{ 'p', _fmtp },
 	{ 'd', _fmtd },
+	{ 'i', _fmtd },
 	{ 'u', _fmtu },
 	{ 'o', _fmtu },
 	{ 'x', _fmtu },
+	{ 'X', _fmtu },
 	{ 'c', _fmtc },
 	{ '%', _fmtpct },
 	{ '\0', 0 }
 };
 
-int fmt(struct fmtctx *ctx, va_list args) {
+int fmt(struct fmtctx *ctx, va_list ap) {
 	int i;
+	va_list args;
+
+	/* a copy of our own, as &ap isn't a va_list * where it is an array */
+	va_copy(args, ap);
 	ctx->num_written = ctx->state = 0;
 	while (*ctx->str) {
 		if (*ctx->str != '%') {
@@ -139,14 +252,28 @@ int fmt(struct fmtctx *ctx, va_list args) {
 
 		ctx->str++;
 		ctx->state = 0;
-		if (*ctx->str == '0') {
-			ctx->state |= ST_ZEROPAD;
+		for (;;) {
+			if (*ctx->str == '0')
+				ctx->state |= ST_ZEROPAD;
+			else if (*ctx->str == '-')
+				ctx->state |= ST_LEFT;
+			else
+				break;
 			ctx->str++;
 		}
 
 		if (_isdigit(*ctx->str)) {
 			PACKWID(ctx, _atou(&ctx->str));
 			ctx->state |= ST_WIDTH;
+		} else if (*ctx->str == '*') {
+			int w = va_arg(args, int);
+			ctx->str++;
+			if (w < 0) {
+				ctx->state |= ST_LEFT;
+				w = -w;
+			}
+			PACKWID(ctx, w);
+			ctx->state |= ST_WIDTH;
 		}
 
 		if (*ctx->str == '.') {
@@ -162,15 +289,21 @@ int fmt(struct fmtctx *ctx, va_list args) {
 
 		if (*ctx->str == 'l') {
 			ctx->str++;
-			ctx->state |= (*ctx->str == 'l' ? ST_LONGER : ST_LONG);
+			if (*ctx->str == 'l') {
+				ctx->str++;
+				ctx->state |= ST_LONGER;
+			} else
+				ctx->state |= ST_LONG;
 		}
 
 		for (i = 0; fmts[i].f; i++)
 			if (fmts[i].f == *ctx->str)
 				fmts[i].func(ctx, *ctx->str, &args);
 
-		ctx->str++;
+		if (*ctx->str)
+			ctx->str++;
 	}
+	va_end(args);
 	return ctx->num_written;
 }
 
@@ -210,10 +343,10 @@ int vsfmt(char *buf, unsigned int len, const char *ifmt, va_list ap) {
 int sfmt(char *buf, unsigned int len, const char *ifmt, ...) {
 	va_list ap;
 	int n;
-	
+
 	va_start(ap, ifmt);
 	n = vsfmt(buf, len, ifmt, ap);
 	va_end(ap);
-	
+
 	return n;
 }
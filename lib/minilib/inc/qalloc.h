@@ -8,15 +8,44 @@
 #ifndef QALLOC_H
 #define QALLOC_H
 
+/* Keep free blocks on size class lists instead of walking the heap for
+ * every alloc. See qalloc_seg.c */
+// #define QALLOC_SEGREGATED
+
+/* allocations of up to 16, 32 .. 1024 bytes, then anything bigger */
+#define QSTATS_BUCKETS 8
+
 typedef struct _qarena_t {
 	unsigned int size;
+	uint32_t used;
+	uint32_t peak;
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t sizes[QSTATS_BUCKETS];
 	/* ... */
 } qarena_t;
 
+typedef struct qstats {
+	uint32_t size;
+	uint32_t used;
+	uint32_t peak;
+	uint32_t largest_free;
+	uint32_t free_blocks;
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t sizes[QSTATS_BUCKETS];
+} qstats_t;
+
+/* a block of the heap, in address order: where its payload is, the whole
+ * block's size, header and all, and whether it's free */
+typedef void (*qwalk_fn)(void *ptr, uint32_t size, int is_free, void *ctx);
+
 extern qarena_t *qinit(void *start, unsigned size);
 extern void *qalloc(qarena_t *arena, unsigned size);
 extern void *qrealloc(qarena_t *arena, void *ptr, unsigned size);
 extern void qfree(qarena_t *arena, void *ptr);
 uint32_t qusedbytes(qarena_t *arena);
 extern uint32_t qfreebytes(qarena_t *arena);
+extern void qstats(qarena_t *arena, qstats_t *stats);
+extern void qwalk(qarena_t *arena, qwalk_fn fn, void *ctx);
 #endif /* !QALLOC_H */
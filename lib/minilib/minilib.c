@@ -9,48 +9,101 @@
 
 #include "minilib.h"
 
+/* Word at a time, whatever the alignment. The Cortex-M3 and M4 take single
+ * unaligned loads, but at a cost, so the destination is aligned first and
+ * the source is read a word at a time from where it lies, merged by
+ * shifts if it doesn't line up. The bodies are unrolled by hand, as a
+ * debug build doesn't; a release builds these at -O2 regardless. Little
+ * endian only.
+ *
+ * gcc is told to leave the loops alone, or it would turn them back into
+ * calls to the very functions they are in.
+ */
+#define MINILIB_MEMFN __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+typedef unsigned int __attribute__((__may_alias__)) word_t;
+
+/* Copies and fills this big are offered to the hardware first (see
+ * stm32_dma.c), which takes them if it can do them without us. By
+ * default nothing does */
+#define MEM_OFFLOAD_MIN 4096
+
+__attribute__((weak)) int _memcpy_offload(void *dest, const void *src, int bytes)
+{
+	return 0;
+}
+
+__attribute__((weak)) int _memset_offload(void *dest, int data, int bytes)
+{
+	return 0;
+}
+
 /* We have both _memcpy and memcpy, because gcc might be able to do better in lwip.
  * For small things, gcc inlines its memcpy, but for large things, we call out
  * to this memcpy.
  */
-void _memcpy_fast(void *dest, const void *src, int bytes)
+MINILIB_MEMFN void _memcpy_fast(void *dest, const void *src, int bytes)
 {
-	/* I hate everyone */
-	/* Since we otherwise compile with -O0, we might as well manually speed this up a bit. */
-	
-	char *cdest = dest;
-	const char *csrc = src;
-	int *idest;
-	const int *isrc;
-	int nwords;
+	unsigned char *cdest = dest;
+	const unsigned char *csrc = src;
+	word_t *idest;
+	const word_t *isrc;
 	
-	/* Align to src (picked arbitrarily; might as well align to something) */
-	while (bytes && ((unsigned int)csrc & 3))
+	while (bytes && ((unsigned int)cdest & 3))
 	{
 		*(cdest++) = *(csrc++);
 		bytes--;
 	}
 	
-	idest = (int *)cdest;
-	isrc = (const int *)csrc;
-	
-	nwords = bytes / 4;
-	bytes -= bytes & ~3;
-	if (nwords != 0)
-		switch(nwords % 8)	/* They see me Duff'sin'.  They hatin'. */
-			do {
-		case  0:	nwords--; *(idest++) = *(isrc++);
-		case  7:	nwords--; *(idest++) = *(isrc++);
-		case  6:	nwords--; *(idest++) = *(isrc++);
-		case  5:	nwords--; *(idest++) = *(isrc++);
-		case  4:	nwords--; *(idest++) = *(isrc++);
-		case  3:	nwords--; *(idest++) = *(isrc++);
-		case  2:	nwords--; *(idest++) = *(isrc++);
-		case  1:	nwords--; *(idest++) = *(isrc++);
-			} while (nwords);
-	
-	cdest = (char *)idest;
-	csrc = (const char *)isrc;
+	idest = (word_t *)cdest;
+	
+	if (((unsigned int)csrc & 3) == 0)
+	{
+		isrc = (const word_t *)csrc;
+		for (; bytes >= 32; bytes -= 32)
+		{
+			idest[0] = isrc[0]; idest[1] = isrc[1];
+			idest[2] = isrc[2]; idest[3] = isrc[3];
+			idest[4] = isrc[4]; idest[5] = isrc[5];
+			idest[6] = isrc[6]; idest[7] = isrc[7];
+			idest += 8;
+			isrc += 8;
+		}
+		for (; bytes >= 4; bytes -= 4)
+			*(idest++) = *(isrc++);
+		csrc = (const unsigned char *)isrc;
+	}
+	else if (bytes >= 8)
+	{
+		/* Read the aligned words around the source, and stitch each
+		 * destination word from two of them. The last read is never past
+		 * the word holding the last byte we copy.
+		 */
+		unsigned int ofs = (unsigned int)csrc & 3;
+		unsigned int rs = ofs * 8, ls = 32 - rs;
+		unsigned int lo, hi;
+		
+		isrc = (const word_t *)(csrc - ofs);
+		lo = *(isrc++);
+		for (; bytes >= 20; bytes -= 16)
+		{
+			hi = isrc[0]; idest[0] = (lo >> rs) | (hi << ls);
+			lo = isrc[1]; idest[1] = (hi >> rs) | (lo << ls);
+			hi = isrc[2]; idest[2] = (lo >> rs) | (hi << ls);
+			lo = isrc[3]; idest[3] = (hi >> rs) | (lo << ls);
+			idest += 4;
+			isrc += 4;
+		}
+		for (; bytes >= 8; bytes -= 4)
+		{
+			hi = *(isrc++);
+			*(idest++) = (lo >> rs) | (hi << ls);
+			lo = hi;
+		}
+		csrc = (const unsigned char *)isrc - 4 + ofs;
+	}
+	
+	cdest = (unsigned char *)idest;
 	while (bytes)	/* Clean up the remainder */
 	{
 		*(cdest++) = *(csrc++);
@@ -58,7 +111,7 @@ void _memcpy_fast(void *dest, const void *src, int bytes)
 	}
 }
 
-void _memcpy_slow(void *dest, const void *src, int bytes)
+MINILIB_MEMFN void _memcpy_slow(void *dest, const void *src, int bytes)
 {
 	unsigned char *cdest = dest;
 	const unsigned char *csrc = src;
@@ -69,16 +122,39 @@ void _memcpy_slow(void *dest, const void *src, int bytes)
 
 void *memcpy(void *dest, const void *src, int bytes)
 {
-	if (((unsigned int)dest & 3) == ((unsigned int)src & 3))
-		_memcpy_fast(dest, src, bytes);
-	else
+	if (bytes < 8)
 		_memcpy_slow(dest, src, bytes);
+	else if (bytes < MEM_OFFLOAD_MIN || !_memcpy_offload(dest, src, bytes))
+		_memcpy_fast(dest, src, bytes);
 	return dest;
 }
 
-void *memset(void *dest, int data, int bytes)
+MINILIB_MEMFN void *memset(void *dest, int data, int bytes)
 {
 	unsigned char *cdest = dest;
+	word_t *idest;
+	unsigned int w = (unsigned char)data * 0x01010101u;
+	
+	if (bytes >= MEM_OFFLOAD_MIN && _memset_offload(dest, data, bytes))
+		return dest;
+	
+	while (bytes && ((unsigned int)cdest & 3))
+	{
+		*(cdest++) = (unsigned char)data;
+		bytes--;
+	}
+	
+	idest = (word_t *)cdest;
+	for (; bytes >= 32; bytes -= 32)
+	{
+		idest[0] = w; idest[1] = w; idest[2] = w; idest[3] = w;
+		idest[4] = w; idest[5] = w; idest[6] = w; idest[7] = w;
+		idest += 8;
+	}
+	for (; bytes >= 4; bytes -= 4)
+		*(idest++) = w;
+	
+	cdest = (unsigned char *)idest;
 	while (bytes--)
 		*(cdest++) = (unsigned char)data;
 	return dest;
@@ -95,28 +171,83 @@ void *memchr(const void *buf, int c, int maxlen)
 	return 0;
 }
 
-void *memmove(void *dest, const void *src, int bytes)
+MINILIB_MEMFN void *memmove(void *dest, const void *src, int bytes)
 {
-	char *cdest = dest;
-	const char *csrc = src;
-	if ((cdest > csrc) && (cdest <= (csrc + bytes)))
+	unsigned char *cdest = dest;
+	const unsigned char *csrc = src;
+	
+	if (cdest >= csrc + bytes || cdest + bytes <= csrc)
+		return memcpy(dest, src, bytes);
+	
+	/* forwards is safe whenever we write behind where we read */
+	if (cdest <= csrc)
+	{
+		_memcpy_fast(dest, src, bytes);
+		return dest;
+	}
+	
+	/* do it backwards! a word at a time, if they line up */
+	cdest += bytes;
+	csrc += bytes;
+	if (((unsigned int)cdest & 3) == ((unsigned int)csrc & 3))
 	{
-		/* do it backwards! */
-		cdest += bytes;
-		csrc += bytes;
-		while (bytes--)
+		word_t *idest;
+		const word_t *isrc;
+		
+		while (bytes && ((unsigned int)cdest & 3))
+		{
 			*(--cdest) = *(--csrc);
-	} else
-		memcpy(dest, src, bytes);
+			bytes--;
+		}
+		idest = (word_t *)cdest;
+		isrc = (const word_t *)csrc;
+		for (; bytes >= 16; bytes -= 16)
+		{
+			idest -= 4;
+			isrc -= 4;
+			idest[3] = isrc[3]; idest[2] = isrc[2];
+			idest[1] = isrc[1]; idest[0] = isrc[0];
+		}
+		for (; bytes >= 4; bytes -= 4)
+			*(--idest) = *(--isrc);
+		cdest = (unsigned char *)idest;
+		csrc = (const unsigned char *)isrc;
+	}
+	while (bytes--)
+		*(--cdest) = *(--csrc);
 	
 	return dest;
 }
 
+/* A word at a time while they match, then the byte that differs */
 int memcmp (const char *a2, const char *a1, int bytes) {
+	const unsigned char *c2 = (const unsigned char *)a2;
+	const unsigned char *c1 = (const unsigned char *)a1;
+	
+	if (((unsigned int)c2 & 3) == ((unsigned int)c1 & 3))
+	{
+		while (bytes && ((unsigned int)c2 & 3))
+		{
+			if (*c2 != *c1)
+				return *c2 - *c1;
+			c2++;
+			c1++;
+			bytes--;
+		}
+		while (bytes >= 4 && *(const word_t *)c2 == *(const word_t *)c1)
+		{
+			c2 += 4;
+			c1 += 4;
+			bytes -= 4;
+		}
+	}
+	
 	while (bytes--)
 	{
-		if (*(a2++) != *(a1++))
-			return 1;
+		if (*c2 != *c1)
+			return *c2 - *c1;
+		c2++;
+		c1++;
 	}
 	return 0;
 }
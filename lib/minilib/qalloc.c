@@ -9,14 +9,20 @@
 #include <qalloc.h>
 #include <debug.h>
 
-/* XXX: when we have debug/release builds, we should have this only in debug builds */
+#ifndef QALLOC_SEGREGATED
+
+/* cookies around each block, checked on free; a release goes without */
+#ifndef REBBLE_RELEASE
 #define HEAP_INTEGRITY
+#endif
 //#define HEAP_PARANOID
 
 #define MINBSZ	4
 
 #define SZFLAG_SZ (~3)
 #define SZFLAG_FFREE 1
+/* the block before this one is free, and its size is in our previous word */
+#define SZFLAG_FPREVFREE 2
 
 
 typedef struct qblock {
@@ -38,9 +44,15 @@ typedef struct qblock {
 #define BLK_ISFREE(blk)	((blk)->szflag & SZFLAG_FFREE)
 #define BLK_FREE(blk)	((blk)->szflag |= SZFLAG_FFREE)
 #define BLK_ALLOC(blk)	((blk)->szflag &= ~SZFLAG_FFREE)
+#define BLK_PREVFREE(blk)	((blk)->szflag & SZFLAG_FPREVFREE)
 #define BLK_PAYLOAD(p)	(void*)((char*)(p) + sizeof(qblock_t))
+#define BLK_FOOTER(blk)	(((unsigned long *)BLK_NEXT(blk))[-1])
+#define BLK_PREV(blk)	((qblock_t *)((char *)(blk) - ((unsigned long *)(blk))[-1]))
 #define BLK_COOKIE(arena, blk) ((unsigned)(arena) >> 4 ^ (unsigned)(blk))
 #define BLK_ALSIZE(size) ALIGN(size) + sizeof(qblock_t);
+/* a free block needs room for its footer too */
+#define BLK_MINFREE	(sizeof(qblock_t) + sizeof(unsigned long))
+#define BLK_PARANOID_SZ(blk)	(BLK_SZ(blk) - BLK_MINFREE)
 
 static void _cookie_set(qarena_t *arena, qblock_t *blk) {
 #ifdef HEAP_INTEGRITY
@@ -55,21 +67,52 @@ static void _cookie_unset(qarena_t *arena, qblock_t *blk) {
 #endif
 }
 
-static void qjoin(qarena_t *arena);
 static void qcheck(qarena_t *arena, qblock_t *blk);
-static void _qsplit(qarena_t *arena, qblock_t *blk, unsigned size);
+static qblock_t *_qsplit(qarena_t *arena, qblock_t *blk, unsigned size);
+static void _qrelease(qarena_t *arena, qblock_t *blk);
+
+/* Free blocks keep their size in their last word, and the block after
+ * them knows, so a free can merge with both its neighbours on the spot */
+static void _qmark_free(qarena_t *arena, qblock_t *blk) {
+	qblock_t *end = BLK((char *)arena + arena->size);
+
+	BLK_FREE(blk);
+	_cookie_unset(arena, blk);
+	BLK_FOOTER(blk) = BLK_SZ(blk);
+#ifdef HEAP_PARANOID
+	memset(BLK_PAYLOAD(blk), 0xAA, BLK_PARANOID_SZ(blk));
+#endif
+	if (BLK_NEXT(blk) < end)
+		BLK_NEXT(blk)->szflag |= SZFLAG_FPREVFREE;
+}
+
+static void _qstat_alloc(qarena_t *arena, unsigned size) {
+	unsigned b = 0;
+	while (b < QSTATS_BUCKETS - 1 && size > (16u << b))
+		b++;
+	arena->sizes[b]++;
+	arena->allocs++;
+	if (arena->used > arena->peak)
+		arena->peak = arena->used;
+}
+
+static void _qmark_used(qarena_t *arena, qblock_t *blk) {
+	qblock_t *end = BLK((char *)arena + arena->size);
+
+	BLK_ALLOC(blk);
+	_cookie_set(arena, blk);
+	if (BLK_NEXT(blk) < end)
+		BLK_NEXT(blk)->szflag &= ~SZFLAG_FPREVFREE;
+}
 
 qarena_t *qinit(void *start, unsigned size) {
 	qarena_t *arena = start;
+	memset(arena, 0, sizeof(qarena_t));
 	arena->size = size;
 	
 	qblock_t *blk = BLK(arena + 1); // start = &arena[1], so arena[0] is left alone.
-	blk->szflag = size - sizeof(*arena);
-		_cookie_unset(arena, blk);
-#ifdef HEAP_PARANOID
-	memset(BLK_PAYLOAD(blk), 0xAA, BLK_SZ(blk) - sizeof(qblock_t));
-#endif
-	BLK_FREE(blk);
+	blk->szflag = (size - sizeof(*arena)) & SZFLAG_SZ;
+	_qmark_free(arena, blk);
 	
 	return arena;
 }
@@ -77,12 +120,14 @@ qarena_t *qinit(void *start, unsigned size) {
 void *qalloc(qarena_t *arena, unsigned size) {
 	qblock_t *blk = BLK(arena+1);
 	qblock_t *end = BLK((char *)arena + arena->size);
-	void *n = NULL;
+	unsigned want = size;
 	
 	if (size == 0)
 		return NULL;
 
 	size = BLK_ALSIZE(size);
+	if (size < BLK_MINFREE)
+		size = BLK_MINFREE;
 	
 	while (blk && blk < end) {
 		qcheck(arena, blk);
@@ -92,59 +137,68 @@ void *qalloc(qarena_t *arena, unsigned size) {
 		 * constructed at the end.  */
 		if (!BLK_ISFREE(blk) ||
 			((BLK_SZ(blk) != size) &&
-			 (BLK_SZ(blk) < size + sizeof(qblock_t)))) {
+			 (BLK_SZ(blk) < size + BLK_MINFREE))) {
 			blk = BLK_NEXT(blk);
 			continue;
 		}
 
-		if (BLK_SZ(blk) > size) {
-			_qsplit(arena, blk, size);
-		}
+		if (BLK_SZ(blk) > size)
+			_qrelease(arena, _qsplit(arena, blk, size));
 
-		_cookie_set(arena, blk);
-		BLK_ALLOC(blk);
+		_qmark_used(arena, blk);
+		arena->used += BLK_SZ(blk);
+		_qstat_alloc(arena, want);
 		
 		return BLK_PAYLOAD(blk);
 	}
 	return NULL;
 }
 
-/* init a new block, carving the remaining space into a new free */
-static void _qsplit(qarena_t *arena, qblock_t *blk, unsigned size) {
+/* cut blk down to size, returning the rest as a new block for the caller */
+static qblock_t *_qsplit(qarena_t *arena, qblock_t *blk, unsigned size) {
 	qblock_t *newblk = (qblock_t *)((char*)blk + size);
 	newblk->szflag = BLK_SZ(blk) - size;
-	blk->szflag = size;
-	_cookie_unset(arena, newblk);
-	BLK_FREE(newblk);
+	blk->szflag = size | (blk->szflag & ~SZFLAG_SZ);
+	return newblk;
 }
 
 void *qrealloc(qarena_t *arena, void *ptr, unsigned size) {
 	if (size == 0)
 		return NULL;
 	
-	size = BLK_ALSIZE(size);
-	
 	if (!ptr)
 		return qalloc(arena, size);
 	
 	qblock_t *blk = BLK_FROMPAYLOAD(ptr);
+	qblock_t *end = BLK((char *)arena + arena->size);
+	unsigned need = BLK_ALSIZE(size);
+	if (need < BLK_MINFREE)
+		need = BLK_MINFREE;
+	qcheck(arena, blk);
 	
 	/* is the new size smaller? */
-	if (size < BLK_SZ(blk)) {
-		_qsplit(arena, blk, size);
-		_cookie_unset(arena, blk);
-		qjoin(arena);
-		return BLK_PAYLOAD(blk);
+	if (need <= BLK_SZ(blk)) {
+		if (BLK_SZ(blk) >= need + BLK_MINFREE) {
+			arena->used -= BLK_SZ(blk) - need;
+			_qrelease(arena, _qsplit(arena, blk, need));
+		}
+		return ptr;
 	}
 	
 	/* is there room after */
 	qblock_t *nblk = BLK_NEXT(blk);
-	uint32_t reqsize = size - BLK_SZ(blk);
-	if (BLK_SZ(nblk) >= reqsize) {
+	if (nblk < end && BLK_ISFREE(nblk) && BLK_SZ(blk) + BLK_SZ(nblk) >= need) {
 		/* there is a free block after. Lets take what we need */
-		_qsplit(arena, nblk, reqsize);
-		blk->szflag = size;
-		return BLK_PAYLOAD(blk);
+		qcheck(arena, nblk);
+		unsigned old = BLK_SZ(blk);
+		blk->szflag += BLK_SZ(nblk);
+		_qmark_used(arena, blk);
+		if (BLK_SZ(blk) >= need + BLK_MINFREE)
+			_qrelease(arena, _qsplit(arena, blk, need));
+		arena->used += BLK_SZ(blk) - old;
+		if (arena->used > arena->peak)
+			arena->peak = arena->used;
+		return ptr;
 	}
 
 	/* There is no room after. Try malloc */
@@ -152,25 +206,49 @@ void *qrealloc(qarena_t *arena, void *ptr, unsigned size) {
 	if (!newm)
 		return NULL;
 	
-	memcpy(newm, BLK_PAYLOAD(blk), BLK_SZ(blk));
-	qfree(arena, BLK_PAYLOAD(blk));
-	qjoin(arena);
+	memcpy(newm, ptr, BLK_SZ(blk) - sizeof(qblock_t));
+	qfree(arena, ptr);
 	
 	return newm;
 }
 
 uint32_t qusedbytes(qarena_t *arena) {
+	return arena->used;
+}
+
+/* Walk the heap for the free space. This can race an alloc on another
+ * thread, so it only trusts sizes that stay inside the arena */
+void qstats(qarena_t *arena, qstats_t *stats) {
 	qblock_t *blk = BLK(arena+1);
 	qblock_t *end = BLK((char *)arena + arena->size);
-	uint32_t cnt = 0;
 	
-	while (blk && blk < end) {
-		if (!BLK_ISFREE(blk)) {
-			cnt += BLK_SZ(blk);
+	memset(stats, 0, sizeof(qstats_t));
+	stats->size = arena->size;
+	stats->used = arena->used;
+	stats->peak = arena->peak;
+	stats->allocs = arena->allocs;
+	stats->frees = arena->frees;
+	memcpy(stats->sizes, arena->sizes, sizeof(stats->sizes));
+	
+	while (blk < end && BLK_SZ(blk) >= sizeof(qblock_t) && BLK_NEXT(blk) <= end) {
+		if (BLK_ISFREE(blk)) {
+			stats->free_blocks++;
+			if (BLK_SZ(blk) > stats->largest_free)
+				stats->largest_free = BLK_SZ(blk);
 		}
 		blk = BLK_NEXT(blk);
 	}
-	return cnt;
+}
+
+/* Every block, in order. Races like qstats, and stops at the same sizes */
+void qwalk(qarena_t *arena, qwalk_fn fn, void *ctx) {
+	qblock_t *blk = BLK(arena+1);
+	qblock_t *end = BLK((char *)arena + arena->size);
+
+	while (blk < end && BLK_SZ(blk) >= sizeof(qblock_t) && BLK_NEXT(blk) <= end) {
+		fn(BLK_PAYLOAD(blk), BLK_SZ(blk), BLK_ISFREE(blk) != 0, ctx);
+		blk = BLK_NEXT(blk);
+	}
 }
 
 uint32_t qfreebytes(qarena_t *arena) {
@@ -188,31 +266,29 @@ void qfree(qarena_t *arena, void *ptr) {
 	if (BLK_ISFREE(blk))
 		panic("qfree: double free");	/* XXX: this "panic" needs to not panic if we are in an app */
 #endif
-#ifdef HEAP_PARANOID
-	memset(BLK_PAYLOAD(blk), 0xAA, BLK_SZ(blk) - sizeof(qblock_t));
-#endif
 
-	BLK_FREE(blk);
-	_cookie_unset(arena, blk);
-	qjoin(arena);
+	arena->used -= BLK_SZ(blk);
+	arena->frees++;
+	_qrelease(arena, blk);
 }
 
-static void qjoin(qarena_t *arena) {
-	qblock_t *blk = BLK(arena+1);
-	qblock_t *end = (qblock_t *)((char *)arena + arena->size);
+/* free blk, merging it with whichever of its neighbours are free */
+static void _qrelease(qarena_t *arena, qblock_t *blk) {
+	qblock_t *end = BLK((char *)arena + arena->size);
+	qblock_t *nblk = BLK_NEXT(blk);
 	
-	while (blk && blk < end) {
-		qcheck(arena, blk);
-		if (BLK_NEXT(blk) < end && BLK_ISFREE(blk) && BLK_ISFREE(BLK_NEXT(blk))) {
-			qblock_t *nblk = BLK_NEXT(blk);
-			blk->szflag += BLK_SZ(nblk);
-#ifdef HEAP_PARANOID
-			memset(nblk, 0xAA, sizeof(qblock_t));
-#endif
-		} else {
-			blk = BLK_NEXT(blk);
-		}
+	if (nblk < end && BLK_ISFREE(nblk)) {
+		qcheck(arena, nblk);
+		blk->szflag += BLK_SZ(nblk);
+	}
+	if (BLK_PREVFREE(blk)) {
+		qblock_t *pblk = BLK_PREV(blk);
+		qcheck(arena, pblk);
+		pblk->szflag += BLK_SZ(blk);
+		blk = pblk;
 	}
+	
+	_qmark_free(arena, blk);
 }
 
 static void qcheck(qarena_t *arena, qblock_t *blk) {
@@ -234,7 +310,7 @@ static void qcheck(qarena_t *arena, qblock_t *blk) {
 		unsigned i;
 		uint8_t *p = BLK_PAYLOAD(blk);
 		
-		for (i = 0; i < BLK_SZ(blk) - sizeof(qblock_t); i++)
+		for (i = 0; i < BLK_PARANOID_SZ(blk); i++)
 			if (p[i] != 0xAA) {
 				printf("%08x %08x %08x %02x\n", p, i, &p[i], p[i]);
 				panic("qcheck: paranoia pays off -- heap corruption deep inside free block");
@@ -242,3 +318,5 @@ static void qcheck(qarena_t *arena, qblock_t *blk) {
 	}
 #endif
 }
+
+#endif
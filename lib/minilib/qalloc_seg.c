@@ -0,0 +1,426 @@
+/* qalloc_seg.c
+ * Fixed-heap allocator, segregated free lists
+ *
+ * Same interface as qalloc.c, picked with QALLOC_SEGREGATED in qalloc.h.
+ *
+ * Free blocks sit on lists by size class, two level like TLSF: a power of
+ * two, then 4 steps inside it. A bitmap of which lists have anything on
+ * them gets us a block that fits in a couple of bit scans, so allocating
+ * and freeing cost the same however full the heap is.
+ *
+ * Blocks carry the same header (and cookies) as qalloc.c. A free block
+ * also keeps its list links after the header and its size in its last
+ * word, and the block after it is flagged, so freeing can merge with
+ * both neighbours without walking the heap.
+ */
+
+#include <minilib.h>
+#include <qalloc.h>
+#include <debug.h>
+
+#ifdef QALLOC_SEGREGATED
+
+/* as in qalloc.c, only in debug builds */
+#ifndef REBBLE_RELEASE
+#define HEAP_INTEGRITY
+#endif
+
+#define SZFLAG_SZ (~3)
+#define SZFLAG_FFREE 1
+/* the block before this one is free, and its size is in our previous word */
+#define SZFLAG_FPREVFREE 2
+
+typedef struct qblock {
+#ifdef HEAP_INTEGRITY
+	unsigned long cookie0;
+#endif
+	unsigned long szflag;
+#ifdef HEAP_INTEGRITY
+	unsigned long cookie1;
+#endif
+} qblock_t;
+
+/* what a free block has after its header */
+typedef struct qlinks {
+	qblock_t *next;
+	qblock_t *prev;
+} qlinks_t;
+
+/* size classes. Smallest is 1 << FL_MIN */
+#define SL_BITS   2
+#define SL_COUNT  (1 << SL_BITS)
+#define FL_MIN    4
+#define FL_COUNT  14
+
+typedef struct qseg_arena {
+	qarena_t arena;
+	uint32_t fl_bitmap;
+	uint8_t sl_bitmap[FL_COUNT];
+	qblock_t *free[FL_COUNT][SL_COUNT];
+} qseg_arena_t;
+
+#define ALIGN(s)	((s + 3) & ~3)
+
+#define BLK(blk)		((qblock_t *)(blk))
+#define BLK_FROMPAYLOAD(p)	(qblock_t *)((char*)(p) - sizeof(qblock_t))
+#define BLK_SZ(blk)	((blk)->szflag & SZFLAG_SZ)
+#define BLK_NEXT(blk)	((qblock_t *)((char*)(blk) + BLK_SZ(blk)))
+#define BLK_ISFREE(blk)	((blk)->szflag & SZFLAG_FFREE)
+#define BLK_PREVFREE(blk)	((blk)->szflag & SZFLAG_FPREVFREE)
+#define BLK_PAYLOAD(p)	(void*)((char*)(p) + sizeof(qblock_t))
+#define BLK_LINKS(blk)	((qlinks_t *)BLK_PAYLOAD(blk))
+#define BLK_FOOTER(blk)	(((unsigned long *)BLK_NEXT(blk))[-1])
+#define BLK_PREV(blk)	((qblock_t *)((char *)(blk) - ((unsigned long *)(blk))[-1]))
+#define BLK_COOKIE(arena, blk) ((unsigned)(arena) >> 4 ^ (unsigned)(blk))
+/* room for the header, the links and the footer once it's freed */
+#define BLK_MIN		(sizeof(qblock_t) + sizeof(qlinks_t) + sizeof(unsigned long))
+
+#define SEG(arena)	((qseg_arena_t *)(arena))
+#define ARENA_FIRST(arena)	BLK((char *)(arena) + ALIGN(sizeof(qseg_arena_t)))
+#define ARENA_END(arena)	BLK((char *)(arena) + ((arena)->size & ~3))
+
+static void _cookie_set(qarena_t *arena, qblock_t *blk) {
+#ifdef HEAP_INTEGRITY
+	blk->cookie0 = ~BLK_COOKIE(arena, blk);
+	blk->cookie1 = BLK_COOKIE(arena, blk);
+#endif
+}
+static void _cookie_unset(qarena_t *arena, qblock_t *blk) {
+#ifdef HEAP_INTEGRITY
+	blk->cookie0 = BLK_COOKIE(arena, blk);
+	blk->cookie1 = ~BLK_COOKIE(arena, blk);
+#endif
+}
+
+static void qcheck(qarena_t *arena, qblock_t *blk) {
+#ifdef HEAP_INTEGRITY
+	if (BLK_ISFREE(blk)) {
+		if (blk->cookie0 != BLK_COOKIE(arena, blk))
+			panic("qcheck: cookie0 corrupt on free blk");
+		if (blk->cookie1 != ~BLK_COOKIE(arena, blk))
+			panic("qcheck: cookie1 corrupt on free blk");
+	} else {
+		if (blk->cookie0 != ~BLK_COOKIE(arena, blk))
+			panic("qcheck: cookie0 corrupt on alloc blk");
+		if (blk->cookie1 != BLK_COOKIE(arena, blk))
+			panic("qcheck: cookie1 corrupt on alloc blk");
+	}
+#endif
+}
+
+static unsigned _fls(unsigned v) {
+	return 31 - __builtin_clz(v);
+}
+
+/* The list a block of size belongs on */
+static void _mapping_insert(unsigned size, int *fl, int *sl) {
+	int f = _fls(size);
+
+	*sl = (size >> (f - SL_BITS)) & (SL_COUNT - 1);
+	*fl = f - FL_MIN;
+	if (*fl >= FL_COUNT) {
+		*fl = FL_COUNT - 1;
+		*sl = SL_COUNT - 1;
+	}
+}
+
+/* The first list whose every block is at least size. At the top class
+ * that can't be promised, so the caller still has to look */
+static void _mapping_search(unsigned size, int *fl, int *sl) {
+	size += (1 << (_fls(size) - SL_BITS)) - 1;
+	_mapping_insert(size, fl, sl);
+}
+
+static void _list_insert(qarena_t *arena, qblock_t *blk) {
+	qseg_arena_t *seg = SEG(arena);
+	int fl, sl;
+
+	_mapping_insert(BLK_SZ(blk), &fl, &sl);
+	qblock_t *head = seg->free[fl][sl];
+
+	BLK_LINKS(blk)->next = head;
+	BLK_LINKS(blk)->prev = NULL;
+	if (head)
+		BLK_LINKS(head)->prev = blk;
+	seg->free[fl][sl] = blk;
+	seg->fl_bitmap |= 1 << fl;
+	seg->sl_bitmap[fl] |= 1 << sl;
+}
+
+static void _list_remove(qarena_t *arena, qblock_t *blk) {
+	qseg_arena_t *seg = SEG(arena);
+	qlinks_t *l = BLK_LINKS(blk);
+	int fl, sl;
+
+	_mapping_insert(BLK_SZ(blk), &fl, &sl);
+
+	if (l->next)
+		BLK_LINKS(l->next)->prev = l->prev;
+	if (l->prev)
+		BLK_LINKS(l->prev)->next = l->next;
+	else {
+		seg->free[fl][sl] = l->next;
+		if (!l->next) {
+			seg->sl_bitmap[fl] &= ~(1 << sl);
+			if (!seg->sl_bitmap[fl])
+				seg->fl_bitmap &= ~(1 << fl);
+		}
+	}
+}
+
+/* First block on list that's at least size */
+static qblock_t *_list_fit(qblock_t *blk, unsigned size) {
+	while (blk && BLK_SZ(blk) < size)
+		blk = BLK_LINKS(blk)->next;
+	return blk;
+}
+
+/* Find a free block of at least size and take it off its list */
+static qblock_t *_find_free(qarena_t *arena, unsigned size) {
+	qseg_arena_t *seg = SEG(arena);
+	qblock_t *blk = NULL;
+	int fl, sl;
+
+	_mapping_search(size, &fl, &sl);
+
+	uint32_t sl_map = seg->sl_bitmap[fl] & (~0U << sl);
+	if (!sl_map && fl + 1 < FL_COUNT) {
+		uint32_t fl_map = seg->fl_bitmap & (~0U << (fl + 1));
+		if (fl_map) {
+			fl = __builtin_ctz(fl_map);
+			sl_map = seg->sl_bitmap[fl];
+		}
+	}
+	if (sl_map && fl < FL_COUNT - 1)
+		blk = seg->free[fl][__builtin_ctz(sl_map)];
+
+	/* It might still be on the list size itself goes on, or in the top
+	 * class, which takes everything too big for the rest. Neither is
+	 * sure to fit, so look through them */
+	if (!blk) {
+		_mapping_insert(size, &fl, &sl);
+		blk = _list_fit(seg->free[fl][sl], size);
+		for (sl = 0; sl < SL_COUNT && !blk; sl++)
+			blk = _list_fit(seg->free[FL_COUNT - 1][sl], size);
+	}
+	if (!blk)
+		return NULL;
+
+	qcheck(arena, blk);
+	_list_remove(arena, blk);
+	return blk;
+}
+
+/* Mark blk free, with the footer and the next block's flag to match */
+static void _make_free(qarena_t *arena, qblock_t *blk, unsigned size) {
+	blk->szflag = size | SZFLAG_FFREE | (blk->szflag & SZFLAG_FPREVFREE);
+	_cookie_unset(arena, blk);
+	BLK_FOOTER(blk) = size;
+
+	qblock_t *next = BLK_NEXT(blk);
+	if (next < ARENA_END(arena))
+		next->szflag |= SZFLAG_FPREVFREE;
+}
+
+/* Merge free blk with any free neighbours and put it on its list */
+static void _release(qarena_t *arena, qblock_t *blk) {
+	unsigned size = BLK_SZ(blk);
+	qblock_t *next = BLK_NEXT(blk);
+
+	if (next < ARENA_END(arena) && BLK_ISFREE(next)) {
+		qcheck(arena, next);
+		_list_remove(arena, next);
+		size += BLK_SZ(next);
+	}
+	if (BLK_PREVFREE(blk)) {
+		qblock_t *prev = BLK_PREV(blk);
+		qcheck(arena, prev);
+		_list_remove(arena, prev);
+		size += BLK_SZ(prev);
+		blk = prev;
+	}
+
+	_make_free(arena, blk, size);
+	_list_insert(arena, blk);
+}
+
+/* Cut blk down to size, freeing what's left if that's worth a block */
+static void _trim(qarena_t *arena, qblock_t *blk, unsigned size) {
+	unsigned rest = BLK_SZ(blk) - size;
+	if (rest < BLK_MIN)
+		return;
+
+	blk->szflag = size | (blk->szflag & ~SZFLAG_SZ);
+	qblock_t *tail = BLK_NEXT(blk);
+	tail->szflag = rest;
+	arena->used -= rest;
+	_release(arena, tail);
+}
+
+static void _stat_alloc(qarena_t *arena, unsigned size) {
+	unsigned b = 0;
+	while (b < QSTATS_BUCKETS - 1 && size > (16u << b))
+		b++;
+	arena->sizes[b]++;
+	arena->allocs++;
+	if (arena->used > arena->peak)
+		arena->peak = arena->used;
+}
+
+static unsigned _block_size(unsigned size) {
+	size = ALIGN(size) + sizeof(qblock_t);
+	return size < BLK_MIN ? BLK_MIN : size;
+}
+
+qarena_t *qinit(void *start, unsigned size) {
+	qarena_t *arena = start;
+	qseg_arena_t *seg = start;
+
+
+	memset(seg, 0, sizeof(qseg_arena_t));
+	arena->size = size;
+
+	qblock_t *blk = ARENA_FIRST(arena);
+	unsigned heap = (char *)ARENA_END(arena) - (char *)blk;
+	if ((char *)ARENA_END(arena) < (char *)blk || heap < BLK_MIN)
+		return arena;
+
+	blk->szflag = 0;
+	_make_free(arena, blk, heap);
+	_list_insert(arena, blk);
+
+	return arena;
+}
+
+void *qalloc(qarena_t *arena, unsigned size) {
+	unsigned want = size;
+
+	if (size == 0)
+		return NULL;
+
+	size = _block_size(size);
+	qblock_t *blk = _find_free(arena, size);
+	if (!blk)
+		return NULL;
+
+	/* the block we take isn't free any more, nor is the one before ours */
+	qblock_t *next = BLK_NEXT(blk);
+	if (next < ARENA_END(arena))
+		next->szflag &= ~SZFLAG_FPREVFREE;
+	blk->szflag &= ~SZFLAG_FFREE;
+	_cookie_set(arena, blk);
+	arena->used += BLK_SZ(blk);
+
+	_trim(arena, blk, size);
+	_stat_alloc(arena, want);
+
+	return BLK_PAYLOAD(blk);
+}
+
+void *qrealloc(qarena_t *arena, void *ptr, unsigned size) {
+	if (size == 0)
+		return NULL;
+
+	if (!ptr)
+		return qalloc(arena, size);
+
+	qblock_t *blk = BLK_FROMPAYLOAD(ptr);
+	unsigned need = _block_size(size);
+	qcheck(arena, blk);
+
+	if (need <= BLK_SZ(blk)) {
+		_trim(arena, blk, need);
+		return ptr;
+	}
+
+	/* is there room after */
+	qblock_t *next = BLK_NEXT(blk);
+	if (next < ARENA_END(arena) && BLK_ISFREE(next) &&
+	    BLK_SZ(blk) + BLK_SZ(next) >= need) {
+		qcheck(arena, next);
+		_list_remove(arena, next);
+		arena->used += BLK_SZ(next);
+		blk->szflag += BLK_SZ(next);
+
+		qblock_t *after = BLK_NEXT(blk);
+		if (after < ARENA_END(arena))
+			after->szflag &= ~SZFLAG_FPREVFREE;
+
+		_trim(arena, blk, need);
+		if (arena->used > arena->peak)
+			arena->peak = arena->used;
+		return ptr;
+	}
+
+	/* There is no room after. Try malloc */
+	void *newm = qalloc(arena, size);
+	if (!newm)
+		return NULL;
+
+	memcpy(newm, ptr, BLK_SZ(blk) - sizeof(qblock_t));
+	qfree(arena, ptr);
+
+	return newm;
+}
+
+uint32_t qusedbytes(qarena_t *arena) {
+	return arena->used;
+}
+
+uint32_t qfreebytes(qarena_t *arena) {
+	return arena->size - qusedbytes(arena);
+}
+
+/* Walk the heap for the free space. This can race an alloc on another
+ * thread, so it only trusts sizes that stay inside the arena */
+void qstats(qarena_t *arena, qstats_t *stats) {
+	qblock_t *blk = ARENA_FIRST(arena);
+	qblock_t *end = ARENA_END(arena);
+
+	memset(stats, 0, sizeof(qstats_t));
+	stats->size = arena->size;
+	stats->used = arena->used;
+	stats->peak = arena->peak;
+	stats->allocs = arena->allocs;
+	stats->frees = arena->frees;
+	memcpy(stats->sizes, arena->sizes, sizeof(stats->sizes));
+
+	while (blk < end && BLK_SZ(blk) >= sizeof(qblock_t) && BLK_NEXT(blk) <= end) {
+		if (BLK_ISFREE(blk)) {
+			stats->free_blocks++;
+			if (BLK_SZ(blk) > stats->largest_free)
+				stats->largest_free = BLK_SZ(blk);
+		}
+		blk = BLK_NEXT(blk);
+	}
+}
+
+/* Every block, in order. Races like qstats, and stops at the same sizes */
+void qwalk(qarena_t *arena, qwalk_fn fn, void *ctx) {
+	qblock_t *blk = ARENA_FIRST(arena);
+	qblock_t *end = ARENA_END(arena);
+
+	while (blk < end && BLK_SZ(blk) >= sizeof(qblock_t) && BLK_NEXT(blk) <= end) {
+		fn(BLK_PAYLOAD(blk), BLK_SZ(blk), BLK_ISFREE(blk) != 0, ctx);
+		blk = BLK_NEXT(blk);
+	}
+}
+
+void qfree(qarena_t *arena, void *ptr) {
+	if (!ptr)
+		return;
+
+	qblock_t *blk = BLK_FROMPAYLOAD(ptr);
+
+#ifdef HEAP_INTEGRITY
+	qcheck(arena, blk);
+	if (BLK_ISFREE(blk))
+		panic("qfree: double free");	/* XXX: this "panic" needs to not panic if we are in an app */
+#endif
+
+	arena->used -= BLK_SZ(blk);
+	arena->frees++;
+	_release(arena, blk);
+}
+
+#endif
@@ -2,7 +2,7 @@
 #include "png.h"
 
 
-void png_to_gbitmap(GBitmap *bitmap, uint8_t *raw_buffer, size_t png_size)
+static void _png_to_gbitmap(GBitmap *bitmap, upng_t *upng)
 {
     /* Set up the bitmap, assuming we will fail. */
     bitmap->palette = NULL;
@@ -18,8 +18,6 @@ void png_to_gbitmap(GBitmap *bitmap, uint8_t *raw_buffer, size_t png_size)
     bitmap->free_data_on_destroy = true;
     bitmap->free_palette_on_destroy = true;
 
-    upng_t *upng = upng_new_from_bytes(raw_buffer, png_size, &(bitmap->addr));
-    
     if (upng == NULL)
     {
         SYS_LOG("png", APP_LOG_LEVEL_ERROR, "UPNG malloc error");
@@ -43,8 +41,21 @@ void png_to_gbitmap(GBitmap *bitmap, uint8_t *raw_buffer, size_t png_size)
     }
 
 
+    if (upng_get_format(upng) == UPNG_RGB8 || upng_get_format(upng) == UPNG_RGBA8)
+    {
+        /* truecolour is already GColor8 out of the decoder */
+        unsigned int width = upng_get_width(upng);
+        unsigned int height = upng_get_height(upng);
+
+        bitmap->bounds.size.w = width;
+        bitmap->bounds.size.h = height;
+        bitmap->raw_bitmap_size.w = width;
+        bitmap->raw_bitmap_size.h = height;
+        bitmap->row_size_bytes = width;
+        bitmap->addr = (uint8_t *)upng_get_buffer(upng);
+    }
     /* XXX: this leaks the buffer if we don't take this codepath */
-    if (upng_get_format(upng) >= UPNG_INDEXED1 || upng_get_format(upng) <= UPNG_INDEXED8)
+    else if (upng_get_format(upng) >= UPNG_INDEXED1 || upng_get_format(upng) <= UPNG_INDEXED8)
     {
         //Decode paletized image to raw rgb values
         unsigned int width = upng_get_width(upng);
@@ -167,3 +178,17 @@ freepng:
     upng_free(upng);
     upng = NULL;
 }
+
+void png_to_gbitmap(GBitmap *bitmap, uint8_t *raw_buffer, size_t png_size)
+{
+    _png_to_gbitmap(bitmap, upng_new_from_bytes(raw_buffer, png_size, &(bitmap->addr)));
+}
+
+/*
+ * Decode a png that we can't or won't hold in memory. read is handed small
+ * ranges of it as the decode goes, and only the pixels end up on the heap
+ */
+void png_to_gbitmap_streamed(GBitmap *bitmap, upng_read_fn read, void *ctx, size_t png_size)
+{
+    _png_to_gbitmap(bitmap, upng_new_from_reader(read, ctx, png_size));
+}
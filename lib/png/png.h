@@ -3,7 +3,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <pebble.h>
+#include "upng.h"
 
 
 void png_to_gbitmap(GBitmap *bitmap, uint8_t *raw_buffer, size_t png_size);
-
+void png_to_gbitmap_streamed(GBitmap *bitmap, upng_read_fn read, void *ctx, size_t png_size);
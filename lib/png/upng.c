@@ -96,8 +96,26 @@ typedef struct upng_source {
         unsigned char*	buffer;
         unsigned long			size;
         char					owning;
+        upng_read_fn	read;	/* if set, buffer is NULL and we pull bytes through this */
+        void*			read_ctx;
 } upng_source;
 
+/* How much of the IDAT stream we hold at once when reading through a callback */
+#define UPNG_WINDOW_SIZE 256
+
+/* Where we are in the IDAT stream. Offsets into the stream skip the chunk
+ * headers, so the inflater sees one run of compressed bytes */
+typedef struct upng_idat {
+        unsigned long	first_offset;	/* file offset of the first IDAT chunk */
+        unsigned long	chunk_offset;	/* file offset of the current chunk's data */
+        unsigned long	chunk_start;	/* stream offset of the current chunk's data */
+        unsigned long	chunk_length;
+        const unsigned char* window;
+        unsigned long	window_start;
+        unsigned long	window_length;
+        unsigned char	window_buffer[UPNG_WINDOW_SIZE];
+} upng_idat;
+
 typedef struct upng_text {
 char* keyword;
 char* text;
@@ -131,6 +149,7 @@ struct upng_t {
 
         upng_state		state;
         upng_source		source;
+        upng_idat		idat;
 };
 
 #ifndef TINFL
@@ -211,19 +230,95 @@ static const uint16_t FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
 };
 #endif
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+/* read len bytes of the PNG at offset, from memory or through the callback */
+static int upng_read(upng_t* upng, unsigned long offset, unsigned char *out, unsigned long len)
+{
+        if (offset + len > upng->source.size)
+                return 0;
+
+        if (upng->source.read)
+                return upng->source.read(upng->source.read_ctx, offset, out, len) == len;
+
+        memcpy(out, upng->source.buffer + offset, len);
+        return 1;
+}
+
+/* go back to the start of the IDAT stream */
+static void upng_idat_rewind(upng_t* upng)
+{
+        upng_idat *idat = &upng->idat;
+        unsigned char head[8];
+
+        idat->chunk_offset = idat->first_offset + 8;
+        idat->chunk_start = 0;
+        idat->chunk_length = upng_read(upng, idat->first_offset, head, 8) ? upng_chunk_length(head) : 0;
+        idat->window_start = 0;
+        idat->window_length = 0;
+}
+
+/* move the window onto stream byte i, stepping over chunk boundaries */
+static unsigned char upng_idat_fill(upng_t* upng, unsigned long i)
+{
+        upng_idat *idat = &upng->idat;
+        unsigned char head[8];
+
+        if (i < idat->chunk_start)
+                upng_idat_rewind(upng);
+
+        while (i >= idat->chunk_start + idat->chunk_length) {
+                unsigned long next = idat->chunk_offset + idat->chunk_length + 4;
+
+                /* off the end of the data. The inflater's bounds checks catch
+                 * this. IDAT chunks have to be consecutive, upng_decode checks */
+                if (!upng_read(upng, next, head, 8) || upng_chunk_type(head) != CHUNK_IDAT)
+                        return 0;
+
+                idat->chunk_offset = next + 8;
+                idat->chunk_start += idat->chunk_length;
+                idat->chunk_length = upng_chunk_length(head);
+        }
+
+        unsigned long skip = i - idat->chunk_start;
+        unsigned long length = idat->chunk_length - skip;
+
+        if (upng->source.read) {
+                if (length > UPNG_WINDOW_SIZE)
+                        length = UPNG_WINDOW_SIZE;
+                if (!upng_read(upng, idat->chunk_offset + skip, idat->window_buffer, length))
+                        return 0;
+                idat->window = idat->window_buffer;
+        } else {
+                idat->window = upng->source.buffer + idat->chunk_offset + skip;
+        }
+
+        idat->window_start = i;
+        idat->window_length = length;
+        return idat->window[0];
+}
+
+static inline unsigned char upng_idat_byte(upng_t* upng, unsigned long i)
+{
+        unsigned long at = i - upng->idat.window_start;
+
+        if (at < upng->idat.window_length)
+                return upng->idat.window[at];
+
+        return upng_idat_fill(upng, i);
+}
+
+static unsigned char read_bit(unsigned long *bitpointer, upng_t *upng)
 {
-        unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
+        unsigned char result = (unsigned char)((upng_idat_byte(upng, (*bitpointer) >> 3) >> ((*bitpointer) & 0x7)) & 1);
         (*bitpointer)++;
         return result;
 }
 
 #ifndef TINFL
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+static unsigned read_bits(unsigned long *bitpointer, upng_t *upng, unsigned long nbits)
 {
         unsigned result = 0, i;
         for (i = 0; i < nbits; i++)
-                result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
+                result |= ((unsigned)read_bit(bitpointer, upng)) << i;
         return result;
 }
 
@@ -240,8 +335,8 @@ static void huffman_tree_init(huffman_tree* tree, uint16_t* buffer, uint16_t num
 static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const uint16_t *bitlen)
 {
         uint16_t* tree1d = app_malloc(sizeof(uint16_t) * MAX_SYMBOLS);
-uint16_t blcount[MAX_BIT_LENGTH];
-uint16_t nextcode[MAX_BIT_LENGTH];
+uint16_t blcount[MAX_BIT_LENGTH + 1];
+uint16_t nextcode[MAX_BIT_LENGTH + 1];
         //unsigned* blcount = app_malloc(sizeof(unsigned) * MAX_BIT_LENGTH);
         //unsigned* nextcode = app_malloc(sizeof(unsigned) * MAX_BIT_LENGTH);
 if (!tree1d) {
@@ -254,8 +349,8 @@ if (!tree1d) {
         uint16_t treepos = 0;	/*position in the tree (1 of the numcodes columns) */
 
         /* initialize local vectors */
-        memset(blcount, 0, sizeof(uint16_t) * MAX_BIT_LENGTH);
-        memset(nextcode, 0, sizeof(uint16_t) * MAX_BIT_LENGTH);
+        memset(blcount, 0, sizeof(blcount));
+        memset(nextcode, 0, sizeof(nextcode));
 
         /*step 1: count number of instances of each code length */
         for (bits = 0; bits < tree->numcodes; bits++) {
@@ -314,7 +409,7 @@ if (!tree1d) {
         //free(nextcode);
 }
 
-static uint16_t huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+static uint16_t huffman_decode_symbol(upng_t *upng, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
 {
         uint16_t treepos = 0, ct;
         unsigned char bit;
@@ -325,7 +420,7 @@ static uint16_t huffman_decode_symbol(upng_t *upng, const unsigned char *in, uns
                         return 0;
                 }
 
-                bit = read_bit(bp, in);
+                bit = read_bit(bp, upng);
 
                 ct = codetree->tree2d[(treepos << 1) | bit];
                 if (ct < codetree->numcodes) {
@@ -341,7 +436,7 @@ static uint16_t huffman_decode_symbol(upng_t *upng, const unsigned char *in, uns
 }
 
 /* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, unsigned long *bp, unsigned long inlength)
 {
 
         //unsigned* codelengthcode = (unsigned*)app_malloc(sizeof(unsigned) * NUM_CODE_LENGTH_CODES);
@@ -369,13 +464,13 @@ uint16_t n, hlit, hdist, hclen, i;
         memset(bitlenD, 0, sizeof(uint16_t) * NUM_DISTANCE_SYMBOLS);
 
         /*the bit pointer is or will go past the memory */
-        hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-        hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-        hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+        hlit = read_bits(bp, upng, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+        hdist = read_bits(bp, upng, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+        hclen = read_bits(bp, upng, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
         for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
                 if (i < hclen) {
-                        codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
+                        codelengthcode[CLCL[i]] = read_bits(bp, upng, 3);
                 } else {
                         codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
                 }
@@ -393,7 +488,7 @@ uint16_t n, hlit, hdist, hclen, i;
         /*now we can use this tree to read the lengths for the tree that this function will return */
         i = 0;
         while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-                uint16_t code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+                uint16_t code = huffman_decode_symbol(upng, bp, codelengthcodetree, inlength);
                 if (upng->error != UPNG_EOK) {
                         break;
                 }
@@ -414,7 +509,7 @@ uint16_t n, hlit, hdist, hclen, i;
                                 break;
                         }
                         /*error, bit pointer jumps past memory */
-                        replength += read_bits(bp, in, 2);
+                        replength += read_bits(bp, upng, 2);
 
                         if ((i - 1) < hlit) {
                                 value = bitlen[i - 1];
@@ -445,7 +540,7 @@ uint16_t n, hlit, hdist, hclen, i;
                         }
 
                         /*error, bit pointer jumps past memory */
-                        replength += read_bits(bp, in, 3);
+                        replength += read_bits(bp, upng, 3);
 
                         /*repeat this value in the next lengths */
                         for (n = 0; n < replength; n++) {
@@ -470,7 +565,7 @@ uint16_t n, hlit, hdist, hclen, i;
                                 break;
                         }
 
-                        replength += read_bits(bp, in, 7);
+                        replength += read_bits(bp, upng, 7);
 
                         /*repeat this value in the next lengths */
                         for (n = 0; n < replength; n++) {
@@ -510,7 +605,7 @@ uint16_t n, hlit, hdist, hclen, i;
 }
 
 /*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, uint16_t btype)
+static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, unsigned long *bp, unsigned long *pos, unsigned long inlength, uint16_t btype)
 {
 //Converted to malloc, was overflowing 2k stack on Pebble
         uint16_t* codetree_buffer = (uint16_t*)app_malloc(sizeof(uint16_t) * DEFLATE_CODE_BUFFER_SIZE);
@@ -541,12 +636,12 @@ if (codetree_buffer == NULL) {
     huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
                 huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
     
-    get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+    get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, bp, inlength);
         }
 
 
         while (done == 0) {
-                uint16_t code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
+                uint16_t code = huffman_decode_symbol(upng, bp, &codetree, inlength);
                 if (upng->error != UPNG_EOK) {
                         return;
                 }
@@ -577,10 +672,10 @@ if (codetree_buffer == NULL) {
                                 SET_ERROR(upng, UPNG_EMALFORMED);
                                 return;
                         }
-                        length += read_bits(bp, in, numextrabits);
+                        length += read_bits(bp, upng, numextrabits);
 
                         /*part 3: get distance code */
-                        codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
+                        codeD = huffman_decode_symbol(upng, bp, &codetreeD, inlength);
                         if (upng->error != UPNG_EOK) {
                                 return;
                         }
@@ -602,7 +697,7 @@ if (codetree_buffer == NULL) {
                                 return;
                         }
 
-                        distance += read_bits(bp, in, numextrabitsD);
+                        distance += read_bits(bp, upng, numextrabitsD);
 
                         /*part 5: fill in all the out[n] values based on the length and dist */
                         start = (*pos);
@@ -630,7 +725,7 @@ return;
 }
 #endif //ifdef TINFL
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, unsigned long *bp, unsigned long *pos, unsigned long inlength)
 {
         unsigned long p;
         uint16_t len, nlen, n;
@@ -647,9 +742,9 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
                 return;
         }
 
-        len = in[p] + 256 * in[p + 1];
+        len = upng_idat_byte(upng, p) + 256 * upng_idat_byte(upng, p + 1);
         p += 2;
-        nlen = in[p] + 256 * in[p + 1];
+        nlen = upng_idat_byte(upng, p) + 256 * upng_idat_byte(upng, p + 1);
         p += 2;
 
         /* check if 16-bit nlen is really the one's complement of len */
@@ -658,7 +753,7 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
                 return;
         }
 
-        if ((*pos) + len >= outsize) {
+        if ((*pos) + len > outsize) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return;
         }
@@ -670,16 +765,16 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
         }
 
         for (n = 0; n < len; n++) {
-                out[(*pos)++] = in[p++];
+                out[(*pos)++] = upng_idat_byte(upng, p++);
         }
 
         (*bp) = p * 8;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
-static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
+static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, unsigned long insize, unsigned long inpos)
 {
-        unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
+        unsigned long bp = inpos * 8;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
         unsigned long pos = 0;	/*byte position in the out buffer */
 
         uint16_t done = 0;
@@ -694,18 +789,18 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
                 }
 
                 /* read block control bits */
-                done = read_bit(&bp, &in[inpos]);
-                btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
+                done = read_bit(&bp, upng);
+                btype = read_bit(&bp, upng) | (read_bit(&bp, upng) << 1);
 
                 /* process control type appropriateyly */
                 if (btype == 3) {
                         SET_ERROR(upng, UPNG_EMALFORMED);
                         return upng->error;
                 } else if (btype == 0) {
-                        inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+                        inflate_uncompressed(upng, out, outsize, &bp, &pos, insize);	/*no compression */
                 } else {
 #ifndef TINFL			
-    inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+    inflate_huffman(upng, out, outsize, &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
 #else
     tinfl_decompressor inflator;
     tinfl_init(&inflator);
@@ -723,14 +818,19 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
         return upng->error;
 }
 
-static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long insize)
+static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize, unsigned long insize)
 {
+        unsigned char in[2];
+
         /* we require two bytes for the zlib data header */
         if (insize < 2) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
+        in[0] = upng_idat_byte(upng, 0);
+        in[1] = upng_idat_byte(upng, 1);
+
         /* 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way */
         if ((in[0] * 256 + in[1]) % 31 != 0) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
@@ -750,7 +850,7 @@ static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long out
         }
 
         /* create output buffer */
-        uz_inflate_data(upng, out, outsize, in, insize, 2);
+        uz_inflate_data(upng, out, outsize, insize, 2);
 
         return upng->error;
 }
@@ -833,6 +933,24 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
         }
 }
 
+/*
+ * Truecolour pixels to GColor8, a byte each, top two bits of every channel
+ * the way GColorFromRGBA does it. Two bits a channel is only a mask and a
+ * shift, so there is nothing for a table to save. out may be in, or below it
+ */
+static void quantise_scanline(unsigned char *out, const unsigned char *in, unsigned w, unsigned components)
+{
+        unsigned x;
+
+        if (components == 4) {
+                for (x = 0; x < w; x++, in += 4)
+                        out[x] = (in[3] & 0xC0) | ((in[0] & 0xC0) >> 2) | ((in[1] & 0xC0) >> 4) | (in[2] >> 6);
+        } else {
+                for (x = 0; x < w; x++, in += 3)
+                        out[x] = 0xC0 | ((in[0] & 0xC0) >> 2) | ((in[1] & 0xC0) >> 4) | (in[2] >> 6);
+        }
+}
+
 static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in, unsigned w, unsigned h, unsigned bpp)
 {
         /*
@@ -848,6 +966,10 @@ static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in,
 
         unsigned long bytewidth = (bpp + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
         unsigned long linebytes = (w * bpp + 7) / 8;
+        /* 8 bit truecolour is quantised a row behind the unfilter, which
+         * still needs the row before at full depth. It packs down to the
+         * front of out, behind everything still to be read */
+        int quantise = upng->format == UPNG_RGB8 || upng->format == UPNG_RGBA8;
 
         for (y = 0; y < h; y++) {
                 unsigned long outindex = linebytes * y;
@@ -859,8 +981,12 @@ static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in,
                         return;
                 }
 
+                if (quantise && prevline)
+                        quantise_scanline(&out[w * (y - 1)], prevline, w, bpp / 8);
                 prevline = &out[outindex];
         }
+        if (quantise && prevline)
+                quantise_scanline(&out[w * (h - 1)], prevline, w, bpp / 8);
 }
 
 static void remove_padding_bits(unsigned char *out, const unsigned char *in, unsigned long olinebits, unsigned long ilinebits, unsigned h)
@@ -994,6 +1120,8 @@ static void upng_free_source(upng_t* upng)
 /*read the information from the header and store it in the upng_Info. return value is error*/
 upng_error upng_header(upng_t* upng)
 {
+        unsigned char header[29];
+
         /* if we have an error state, bail now */
         if (upng->error != UPNG_EOK) {
                 return upng->error;
@@ -1011,23 +1139,28 @@ upng_error upng_header(upng_t* upng)
                 SET_ERROR(upng, UPNG_ENOTPNG);
                 return upng->error;
         }
+        if (!upng_read(upng, 0, header, sizeof(header))) {
+                SET_ERROR(upng, UPNG_ENOTFOUND);
+                return upng->error;
+        }
+
         /* check that PNG header matches expected value */
-        if (upng->source.buffer[0] != 137 || upng->source.buffer[1] != 80 || upng->source.buffer[2] != 78 || upng->source.buffer[3] != 71 || upng->source.buffer[4] != 13 || upng->source.buffer[5] != 10 || upng->source.buffer[6] != 26 || upng->source.buffer[7] != 10) {
+        if (header[0] != 137 || header[1] != 80 || header[2] != 78 || header[3] != 71 || header[4] != 13 || header[5] != 10 || header[6] != 26 || header[7] != 10) {
                 SET_ERROR(upng, UPNG_ENOTPNG);
                 return upng->error;
         }
 
         /* check that the first chunk is the IHDR chunk */
-        if (MAKE_DWORD_PTR(upng->source.buffer + 12) != CHUNK_IHDR) {
+        if (MAKE_DWORD_PTR(header + 12) != CHUNK_IHDR) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
         /* read the values given in the header */
-        upng->width = MAKE_DWORD_PTR(upng->source.buffer + 16);
-        upng->height = MAKE_DWORD_PTR(upng->source.buffer + 20);
-        upng->color_depth = upng->source.buffer[24];
-        upng->color_type = (upng_color)upng->source.buffer[25];
+        upng->width = MAKE_DWORD_PTR(header + 16);
+        upng->height = MAKE_DWORD_PTR(header + 20);
+        upng->color_depth = header[24];
+        upng->color_type = (upng_color)header[25];
 
         /* determine our color format */
         upng->format = determine_format(upng);
@@ -1037,19 +1170,19 @@ upng_error upng_header(upng_t* upng)
         }
 
         /* check that the compression method (byte 27) is 0 (only allowed value in spec) */
-        if (upng->source.buffer[26] != 0) {
+        if (header[26] != 0) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
         /* check that the compression method (byte 27) is 0 (only allowed value in spec) */
-        if (upng->source.buffer[27] != 0) {
+        if (header[27] != 0) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
         /* check that the compression method (byte 27) is 0 (spec allows 1, but uPNG does not support it) */
-        if (upng->source.buffer[28] != 0) {
+        if (header[28] != 0) {
                 SET_ERROR(upng, UPNG_EUNINTERLACED);
                 return upng->error;
         }
@@ -1061,10 +1194,10 @@ upng_error upng_header(upng_t* upng)
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
 upng_error upng_decode(upng_t* upng)
 {
-        const unsigned char *chunk;
-        unsigned char* compressed;
+        unsigned long offset;
         unsigned char* inflated;
-        unsigned long compressed_size = 0, compressed_index = 0;
+        unsigned long compressed_size = 0;
+        unsigned char idat_done = 0;
         unsigned long inflated_size;
         upng_error error;
 
@@ -1091,17 +1224,17 @@ upng_error upng_decode(upng_t* upng)
                 upng->size = 0;
         }
 
-        /* first byte of the first chunk after the header */
-        chunk = upng->source.buffer + 33;
-
         /* scan through the chunks, finding the size of all IDAT chunks, and also
-        * verify general well-formed-ness */
-        while (chunk < upng->source.buffer + upng->source.size) {
+        * verify general well-formed-ness. The IDAT data itself stays where it is,
+        * the inflater pulls it through upng_idat_byte as it goes */
+        offset = 33;
+        while (offset < upng->source.size) {
+                unsigned char chunk[8];
                 unsigned long length;
-                const unsigned char *data = chunk + 8;	/*the data in the chunk */
+                unsigned long data = offset + 8;	/*the data in the chunk */
 
                 /* make sure chunk header is not larger than the total compressed */
-                if ((unsigned long)(chunk - upng->source.buffer + 12) > upng->source.size) {
+                if (offset + 12 > upng->source.size || !upng_read(upng, offset, chunk, 8)) {
                         SET_ERROR(upng, UPNG_EMALFORMED);
                         return upng->error;
                 }
@@ -1114,19 +1247,33 @@ upng_error upng_decode(upng_t* upng)
                 }
 
                 /* make sure chunk header+paylaod is not larger than the total compressed */
-                if ((unsigned long)(chunk - upng->source.buffer + length + 12) > upng->source.size) {
+                if (offset + length + 12 > upng->source.size) {
                         SET_ERROR(upng, UPNG_EMALFORMED);
                         return upng->error;
                 }
 
                 /* parse chunks */
+                if (upng_chunk_type(chunk) != CHUNK_IDAT && upng->idat.first_offset) {
+                        idat_done = 1;
+                }
+
                 if (upng_chunk_type(chunk) == CHUNK_IDAT) {
+                        /* they have to come in one run, so we can walk them in order */
+                        if (idat_done) {
+                                SET_ERROR(upng, UPNG_EMALFORMED);
+                                return upng->error;
+                        }
+                        if (!upng->idat.first_offset)
+                                upng->idat.first_offset = offset;
                         compressed_size += length;
                 } else if (upng_chunk_type(chunk) == CHUNK_IEND) {
                         break;
                 } else if (upng_chunk_type(chunk) == CHUNK_OFFS) {
-                    upng->x_offset = MAKE_DWORD_PTR(data);
-                    upng->y_offset = MAKE_DWORD_PTR(data + 4);
+                    unsigned char offs[8];
+                    if (length >= 8 && upng_read(upng, data, offs, 8)) {
+                        upng->x_offset = MAKE_DWORD_PTR(offs);
+                        upng->y_offset = MAKE_DWORD_PTR(offs + 4);
+                    }
                 } else if (upng_chunk_type(chunk) == CHUNK_PLTE) {
                     upng->palette_entries = length / 3; //3 bytes per color entry
                     if(upng->palette) {
@@ -1134,7 +1281,11 @@ upng_error upng_decode(upng_t* upng)
                         upng->palette = NULL;
                     }
                     upng->palette = app_malloc(length);
-                    memcpy(upng->palette, data, length);
+                    if (!upng->palette) {
+                        SET_ERROR(upng, UPNG_ENOMEM);
+                        return upng->error;
+                    }
+                    upng_read(upng, data, (unsigned char *)upng->palette, length);
                 } else if (upng_chunk_type(chunk) == CHUNK_tRNS) {
                     upng->alpha_entries = length;
                     if(upng->alpha) {
@@ -1142,61 +1293,45 @@ upng_error upng_decode(upng_t* upng)
                         upng->alpha = NULL;
                     }
                     upng->alpha = app_malloc(length);
-                    memcpy(upng->alpha, data, length);
-                } else if (upng_chunk_type(chunk) == CHUNK_TEXT) {
-                    int keyword_length = (strlen((const char*)data) + 1);
-                    // Copy keyword located at start of data (includes null terminator)
-                    upng->text[upng->text_count].keyword = app_malloc(keyword_length);
-                    strcpy(upng->text[upng->text_count].keyword,(const char*)data);
-
-                    int text_length = length - keyword_length + 1;
-                    // Copy the text from data, starts after the null after keyword
-                    upng->text[upng->text_count].text = app_malloc(text_length);
-                    memcpy((char*)upng->text[upng->text_count].text,(const char*)(data + keyword_length), text_length - 1);//no null terminator
-                    //add missing null terminator
-                    upng->text[upng->text_count].text[text_length - 1] = '\0';
-                    
-                    upng->text_count++;
+                    if (!upng->alpha) {
+                        SET_ERROR(upng, UPNG_ENOMEM);
+                        return upng->error;
+                    }
+                    upng_read(upng, data, upng->alpha, length);
+                } else if (upng_chunk_type(chunk) == CHUNK_TEXT && upng->text_count < 10) {
+                    char *text = app_malloc(length + 1);
+                    if (text && upng_read(upng, data, (unsigned char *)text, length)) {
+                        text[length] = '\0';
+
+                        int keyword_length = (strlen(text) + 1);
+                        // Copy keyword located at start of data (includes null terminator)
+                        upng->text[upng->text_count].keyword = app_malloc(keyword_length);
+                        strcpy(upng->text[upng->text_count].keyword, text);
+
+                        int text_length = length - keyword_length + 1;
+                        // Copy the text from data, starts after the null after keyword
+                        upng->text[upng->text_count].text = app_malloc(text_length);
+                        memcpy((char*)upng->text[upng->text_count].text, text + keyword_length, text_length - 1);//no null terminator
+                        //add missing null terminator
+                        upng->text[upng->text_count].text[text_length - 1] = '\0';
+
+                        upng->text_count++;
+                    }
+                    if (text)
+                        app_free(text);
                 } else if (upng_chunk_critical(chunk)) {
                         SET_ERROR(upng, UPNG_EUNSUPPORTED);
                         return upng->error;
                 }
 
-                chunk += upng_chunk_length(chunk) + 12;
+                offset += length + 12;
         }
 
-        /* allocate enough space for the (compressed and filtered) image data */
-        compressed = (unsigned char*)app_malloc(compressed_size);
-        if (compressed == NULL) {
-                SET_ERROR(upng, UPNG_ENOMEM);
+        if (compressed_size == 0) {
+                SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
-
-        /* scan through the chunks again, this time copying the values into
-        * our compressed buffer.  there's no reason to validate anything a second time. */
-        chunk = upng->source.buffer + 33;
-        while (chunk < upng->source.buffer + upng->source.size) {
-                unsigned long length;
-                const unsigned char *data;	/*the data in the chunk */
-
-                length = upng_chunk_length(chunk);
-                data = chunk + 8;
-
-                /* parse chunks */
-                if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-                        memcpy(compressed + compressed_index, data, length);
-                        compressed_index += length;
-                } else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-                        break;
-                }
-
-                chunk += upng_chunk_length(chunk) + 12;
-        }
-
-// Pebble has only so much free ram, so free source buffer now that we are
-// done with it.
-app_free(upng->source.buffer);
-upng->source.buffer = NULL;
+        upng_idat_rewind(upng);
 
         /* allocate space to store inflated (but still filtered) data */
         //inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
@@ -1206,22 +1341,23 @@ int width_aligned_bytes = (upng->width * upng_get_bpp(upng) + 7) / 8;
         //inflated = (void*)0x1000a0d8;//(unsigned char*)app_malloc(inflated_size);
         inflated = (unsigned char*)app_malloc(inflated_size);
         if (inflated == NULL) {
-                app_free(compressed);
                 SET_ERROR(upng, UPNG_ENOMEM);
                 return upng->error;
         }
 
         /* decompress image data */
-        error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
+        error = uz_inflate(upng, inflated, inflated_size, compressed_size);
         if (error != UPNG_EOK) {
                 app_free(inflated);
-                app_free(compressed);
                 //free(inflated);
                 return upng->error;
         }
 
-        /* free the compressed compressed data */
-        app_free(compressed);
+// Pebble has only so much free ram, so free source buffer now that we are
+// done with it.
+if (upng->source.buffer)
+        app_free(upng->source.buffer);
+upng->source.buffer = NULL;
 
         /* allocate final image buffer */
         //upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
@@ -1243,6 +1379,16 @@ int width_aligned_bytes = (upng->width * upng_get_bpp(upng) + 7) / 8;
         //app_free(inflated);
 upng->buffer = inflated;
 
+        /* truecolour came out a byte a pixel; give the rest back */
+        if (upng->error == UPNG_EOK && (upng->format == UPNG_RGB8 || upng->format == UPNG_RGBA8)) {
+                unsigned char *shrunk;
+
+                upng->size = upng->width * upng->height;
+                shrunk = (unsigned char *)app_realloc(inflated, upng->size);
+                if (shrunk)
+                        upng->buffer = shrunk;
+        }
+
         if (upng->error != UPNG_EOK) {
                 app_free(upng->buffer);
                 upng->buffer = NULL;
@@ -1294,6 +1440,12 @@ static upng_t* upng_new(void)
         upng->source.buffer = NULL;
         upng->source.size = 0;
         upng->source.owning = 0;
+        upng->source.read = NULL;
+        upng->source.read_ctx = NULL;
+
+        upng->idat.first_offset = 0;
+        upng->idat.window_start = 0;
+        upng->idat.window_length = 0;
 
         return upng;
 }
@@ -1312,6 +1464,21 @@ upng_t* upng_new_from_bytes(unsigned char* raw_buffer, unsigned long size, uint8
         return upng;
 }
 
+/* Decode without holding the file. read is called for small ranges of it
+ * as the decode goes, size is the whole file */
+upng_t* upng_new_from_reader(upng_read_fn read, void *read_ctx, unsigned long size)
+{
+        upng_t* upng = upng_new();
+        if (upng == NULL) {
+                return NULL;
+        }
+
+        upng->source.size = size;
+        upng->source.read = read;
+        upng->source.read_ctx = read_ctx;
+        return upng;
+}
+
 #if 0
 upng_t* upng_new_from_file(const char *filename)
 {
@@ -67,7 +67,11 @@ typedef struct __attribute__((__packed__)) rgb {
   unsigned char b;
 } rgb;
 
+/* fetch len bytes at offset into out, returning how many were read */
+typedef unsigned long (*upng_read_fn)(void *ctx, unsigned long offset, unsigned char *out, unsigned long len);
+
 upng_t*		upng_new_from_bytes	(unsigned char* source_buffer, unsigned long source_size, unsigned char**buffer); //, unsigned char*output_buffer, unsigned long output_size);
+upng_t*		upng_new_from_reader	(upng_read_fn read, void *read_ctx, unsigned long size);
 //upng_t*		upng_new_from_file	(const char* path);
 void		upng_free			(upng_t* upng);
 
@@ -86,6 +90,7 @@ unsigned	upng_get_bitdepth	(const upng_t* upng);
 unsigned	upng_get_components	(const upng_t* upng);
 unsigned	upng_get_pixelsize	(const upng_t* upng);
 upng_format	upng_get_format		(const upng_t* upng);
+/* UPNG_RGB8 and UPNG_RGBA8 images decode straight to GColor8, a byte a pixel */
 
 //returns count of entries in palette
 int upng_get_palette(const upng_t* upng, rgb **palette);
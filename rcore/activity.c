@@ -0,0 +1,365 @@
+/* activity.c
+ * Steps and activity, counted from the accelerometer all the time
+ * RebbleOS
+ *
+ * The accelerometer runs slowly for this whenever there is one, and
+ * batches a couple of seconds at a time in its FIFO (see gyro.c). Each
+ * batch comes through here on the accel thread, which sits below the
+ * app, a fixed amount of integer arithmetic a sample: how long it takes
+ * is kept in the stats.
+ *
+ * A step is a peak in how hard the watch is being accelerated. Gravity
+ * is taken out with a slow running average of the magnitude, and what is
+ * left is smoothed. A step is counted when that rises through a
+ * threshold that follows how big the steps have been, no sooner than a
+ * quarter second after the last. Waving an arm about makes peaks too, so
+ * steps only count once a few have come in a row at a walking pace; the
+ * first of a run are held until then, and dropped if it stops short.
+ *
+ * Each minute is kept as its steps and how much movement there was, in a
+ * ring of the last few hours. The ring goes to flash every half hour of
+ * new minutes rather than every minute, so a reset loses up to that.
+ */
+
+#include "rebbleos.h"
+#include "activity.h"
+#include "fs.h"
+
+#define ACTIVITY_HZ    25
+/* samples in a batch; what the MCU wakes for */
+#define ACTIVITY_BATCH 50
+
+/* in samples at ACTIVITY_HZ */
+#define STEP_MIN_GAP   6    /* 240ms, faster than anyone runs */
+#define STEP_MAX_GAP   50   /* 2s, slower than anyone walks */
+/* steps in a row before any of them count */
+#define STEP_RUN       4
+/* the least peak a step can be, mG */
+#define STEP_MIN_MG    60
+
+#define ACTIVITY_SAVE_MINUTES 30
+#define ACTIVITY_FILE  "activity"
+#define ACTIVITY_MAGIC 0x41435431 /* ACT1 */
+
+typedef struct __attribute__((__packed__)) ActivityFileHeader {
+    uint32_t magic;
+    uint32_t newest_minute;
+    uint16_t count;
+    int16_t today;
+    uint32_t steps_today;
+} ActivityFileHeader;
+
+/* the filter, Q4 fixed point */
+static int32_t _base_q4;   /* gravity, near enough */
+static int32_t _lp_q4;     /* what's left, smoothed */
+static bool _primed;
+static bool _above;
+static int32_t _peak;
+static int32_t _amp = STEP_MIN_MG * 2;  /* running average of step peaks */
+static uint32_t _n;                     /* samples so far */
+static uint32_t _last_step;
+static uint8_t _run;
+static uint8_t _pending;
+
+/* the minute being counted */
+static uint32_t _minute;
+static uint16_t _minute_steps;
+static uint32_t _minute_movement;
+static uint16_t _minute_samples;
+
+/* under the mutex: the accel thread writes, anyone reads */
+static SemaphoreHandle_t _mutex;
+static StaticSemaphore_t _mutex_buf;
+static ActivityMinute _ring[ACTIVITY_MINUTES];
+static uint16_t _head;   /* oldest */
+static uint16_t _count;
+static uint32_t _newest_minute;
+static uint32_t _steps_today;
+static int16_t _today = -1;
+static uint16_t _unsaved;
+static ActivityStats _stats;
+
+static uint32_t _isqrt(uint32_t v)
+{
+    uint32_t r = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > v)
+        bit >>= 2;
+    while (bit)
+    {
+        if (v >= r + bit)
+        {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+            r >>= 1;
+        bit >>= 2;
+    }
+    return r;
+}
+
+static void _step(void)
+{
+    uint32_t gap = _n - _last_step;
+
+    if (gap < STEP_MIN_GAP)
+        return;
+    _last_step = _n;
+
+    if (gap > STEP_MAX_GAP)
+    {
+        _run = 0;
+        _pending = 0;
+    }
+
+    if (_run < STEP_RUN)
+    {
+        _run++;
+        _pending++;
+        if (_run < STEP_RUN)
+            return;
+        _minute_steps += _pending;
+        _pending = 0;
+        return;
+    }
+    _minute_steps++;
+}
+
+static void _sample(const hw_accel_sample_t *s)
+{
+    int32_t x = s->x, y = s->y, z = s->z;
+    int32_t mag = _isqrt((uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z));
+
+    if (!_primed)
+    {
+        _base_q4 = mag << 4;
+        _primed = true;
+    }
+    _base_q4 += ((mag << 4) - _base_q4) >> 5;
+    _lp_q4 += (((mag << 4) - _base_q4) - _lp_q4) >> 2;
+    int32_t v = _lp_q4 >> 4;
+
+    _minute_movement += v < 0 ? -v : v;
+    _minute_samples++;
+
+    int32_t thr = _amp / 2 > STEP_MIN_MG ? _amp / 2 : STEP_MIN_MG;
+    if (!_above && v > thr)
+    {
+        _above = true;
+        _peak = v;
+        _step();
+    }
+    else if (_above)
+    {
+        if (v > _peak)
+            _peak = v;
+        if (v < 0)
+        {
+            _above = false;
+            _amp += (_peak - _amp) >> 2;
+        }
+    }
+    _n++;
+}
+
+static void _save(void)
+{
+    ActivityFileHeader hdr = {
+        .magic = ACTIVITY_MAGIC,
+        .newest_minute = _newest_minute,
+        .count = _count,
+        .today = _today,
+        .steps_today = _steps_today,
+    };
+    struct fd fd;
+    uint16_t first = ACTIVITY_MINUTES - _head;
+
+    if (first > _count)
+        first = _count;
+
+    if (fs_creat(&fd, ACTIVITY_FILE, sizeof(hdr) + _count * sizeof(ActivityMinute)) < 0)
+        return;
+    if (fs_write(&fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+        fs_write(&fd, &_ring[_head], first * sizeof(ActivityMinute)) == first * sizeof(ActivityMinute) &&
+        fs_write(&fd, _ring, (_count - first) * sizeof(ActivityMinute)) == (_count - first) * sizeof(ActivityMinute) &&
+        fs_commit(&fd) == 0)
+    {
+        _unsaved = 0;
+        _stats.saves++;
+        return;
+    }
+    fs_delete(&fd.file);
+}
+
+static void _load(void)
+{
+    ActivityFileHeader hdr;
+    struct file file;
+    struct fd fd;
+
+    if (fs_find_file(&file, ACTIVITY_FILE) < 0)
+        return;
+    fs_open(&fd, &file);
+    if (fs_read(&fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != ACTIVITY_MAGIC ||
+        hdr.count > ACTIVITY_MINUTES)
+        return;
+    if (fs_read(&fd, _ring, hdr.count * sizeof(ActivityMinute)) != hdr.count * sizeof(ActivityMinute))
+        return;
+
+    _head = 0;
+    _count = hdr.count;
+    _newest_minute = hdr.newest_minute;
+    _today = hdr.today;
+    _steps_today = hdr.steps_today;
+}
+
+static void _push(ActivityMinute m)
+{
+    if (_count == ACTIVITY_MINUTES)
+    {
+        _head = (_head + 1) % ACTIVITY_MINUTES;
+        _count--;
+    }
+    _ring[(_head + _count) % ACTIVITY_MINUTES] = m;
+    _count++;
+}
+
+/*
+ * The minute is over; into the ring with it, and with nothing for any
+ * minutes the sensor wasn't giving us. With the mutex
+ */
+static void _close_minute(uint32_t now_minute)
+{
+    ActivityMinute m = {
+        .steps = _minute_steps > 255 ? 255 : _minute_steps,
+        .intensity = 0,
+    };
+    struct tm tm;
+
+    if (_minute_samples)
+    {
+        uint32_t avg = _minute_movement / _minute_samples / 4;
+        m.intensity = avg > 255 ? 255 : avg;
+    }
+
+    if (_count && _minute > _newest_minute + 1)
+    {
+        uint32_t gap = _minute - _newest_minute - 1;
+        ActivityMinute none = { 0, 0 };
+        for (uint32_t i = 0; i < gap && i < ACTIVITY_MINUTES; i++)
+            _push(none);
+    }
+    _push(m);
+    _newest_minute = _minute;
+
+    rcore_localtime(&tm, (time_t)_minute * 60);
+    if (tm.tm_yday != _today)
+    {
+        _today = tm.tm_yday;
+        _steps_today = 0;
+    }
+    _steps_today += _minute_steps;
+    /* and the one starting may be tomorrow */
+    rcore_localtime(&tm, (time_t)now_minute * 60);
+    if (tm.tm_yday != _today)
+    {
+        _today = tm.tm_yday;
+        _steps_today = 0;
+    }
+
+    _minute = now_minute;
+    _minute_steps = 0;
+    _minute_movement = 0;
+    _minute_samples = 0;
+
+    if (++_unsaved >= ACTIVITY_SAVE_MINUTES)
+        _save();
+}
+
+/*
+ * On the accel thread, with each batch
+ */
+static void _activity_sink(const hw_accel_sample_t *samples, uint16_t n, uint64_t newest_ms, uint16_t hz)
+{
+    uint32_t start = hw_cycle_count();
+    uint32_t minute = newest_ms / 60000;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (!_minute)
+        _minute = minute;
+    else if (minute != _minute)
+        _close_minute(minute);
+
+    for (uint16_t i = 0; i < n; i++)
+        _sample(&samples[i]);
+
+    uint32_t us = (hw_cycle_count() - start) / hw_cycles_per_us();
+    _stats.batches++;
+    _stats.samples += n;
+    _stats.total_us += us;
+    if (us > _stats.max_us)
+        _stats.max_us = us;
+    xSemaphoreGive(_mutex);
+}
+
+uint8_t activity_init(void)
+{
+    _mutex = xSemaphoreCreateMutexStatic(&_mutex_buf);
+    _load();
+    if (!rcore_accel_start(AccelUserActivity, ACTIVITY_HZ, ACTIVITY_BATCH, _activity_sink))
+        KERN_LOG("activ", APP_LOG_LEVEL_INFO, "No accelerometer, no steps");
+
+    return 0;
+}
+
+/*
+ * Since local midnight, up to now
+ */
+uint32_t activity_steps_today(void)
+{
+    uint32_t steps;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    steps = _steps_today + _minute_steps;
+    xSemaphoreGive(_mutex);
+
+    return steps;
+}
+
+/*
+ * Up to max of the newest minutes, oldest first. newest_minute is the
+ * last one's, in minutes since the epoch
+ */
+uint16_t activity_minutes(ActivityMinute *minutes, uint16_t max, uint32_t *newest_minute)
+{
+    uint16_t n;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    n = max < _count ? max : _count;
+    for (uint16_t i = 0; i < n; i++)
+        minutes[i] = _ring[(_head + _count - n + i) % ACTIVITY_MINUTES];
+    *newest_minute = _newest_minute;
+    xSemaphoreGive(_mutex);
+
+    return n;
+}
+
+void activity_stats(ActivityStats *stats)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    *stats = _stats;
+    xSemaphoreGive(_mutex);
+}
+
+void activity_dump(void)
+{
+    ActivityStats st;
+
+    activity_stats(&st);
+    SYS_LOG("activ", APP_LOG_LEVEL_INFO, "%lu steps today, %u minutes kept",
+            activity_steps_today(), _count);
+    SYS_LOG("activ", APP_LOG_LEVEL_INFO, "%lu batches, %lu samples, avg %lu us max %lu us a batch, %lu saves",
+            st.batches, st.samples, st.batches ? st.total_us / st.batches : 0, st.max_us, st.saves);
+}
@@ -0,0 +1,30 @@
+#pragma once
+/* activity.h
+ * Steps and activity, counted from the accelerometer all the time
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* minutes kept, oldest dropped first */
+#define ACTIVITY_MINUTES 360
+
+typedef struct __attribute__((__packed__)) ActivityMinute {
+    uint8_t steps;      /* up to 255 */
+    uint8_t intensity;  /* average movement, 4mG a count */
+} ActivityMinute;
+
+typedef struct ActivityStats {
+    uint32_t batches;
+    uint32_t samples;
+    uint32_t max_us;    /* the longest a batch took */
+    uint32_t total_us;
+    uint32_t saves;
+} ActivityStats;
+
+uint8_t activity_init(void);
+uint32_t activity_steps_today(void);
+uint16_t activity_minutes(ActivityMinute *minutes, uint16_t max, uint32_t *newest_minute);
+void activity_stats(ActivityStats *stats);
+void activity_dump(void);
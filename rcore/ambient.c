@@ -20,17 +20,13 @@ void rcore_ambient_init(void)
     _ambient_mutex = xSemaphoreCreateMutexStatic(&_ambient_mutex_buf);
 }
 
+/*
+ * The hardware averages a few samples and only powers the sensor while
+ * it does. This doesn't wait for it: what comes back was measured at
+ * the last call
+ */
 uint16_t rcore_ambient_get(void)
 {
-    // take multiple samples
-    // use a simple moving average filter to get the settle
-    
-    // disable the backlight biefly to get a good clean samples
-    // of the real world
-    
-    // XXX: only turn on the ambient light sensor every once in a while, to
-    // avoid burning battery by calling in a loop
-    
     uint16_t val;
     
     xSemaphoreTake(_ambient_mutex, portMAX_DELAY);
@@ -0,0 +1,628 @@
+/* api_func_list.h
+ * The SDK jump table apps call through, one slot to a line
+ * RebbleOS
+ *
+ * API_FUNC(slot, our function, SDK name) for what we have, and
+ * API_UNIMPL(slot, SDK name) for what we don't, which gets a stub that
+ * says so. The SDK's offset for a slot is four times it. Slots that
+ * aren't here are left NULL.
+ *
+ * No include guard: define both macros, include, undefine. See
+ * api_func_symbols.h and api_profile.c
+ */
+
+API_FUNC(0,   accel_data_service_subscribe,                      accel_data_service_subscribe__deprecated)
+API_FUNC(1,   accel_data_service_unsubscribe,                    accel_data_service_unsubscribe)
+API_FUNC(2,   accel_service_peek,                                accel_service_peek)
+API_FUNC(3,   accel_service_set_samples_per_update,              accel_service_set_samples_per_update)
+API_FUNC(4,   accel_service_set_sampling_rate,                   accel_service_set_sampling_rate)
+API_FUNC(5,   accel_tap_service_subscribe,                       accel_tap_service_subscribe)
+API_FUNC(6,   accel_tap_service_unsubscribe,                     accel_tap_service_unsubscribe)
+API_UNIMPL(7,   action_bar_layer_legacy2_add_to_window)
+API_UNIMPL(8,   action_bar_layer_legacy2_clear_icon)
+API_UNIMPL(9,   action_bar_layer_legacy2_create)
+API_UNIMPL(10,  action_bar_layer_legacy2_destroy)
+API_UNIMPL(11,  action_bar_layer_legacy2_get_layer)
+API_UNIMPL(12,  action_bar_layer_legacy2_remove_from_window)
+API_UNIMPL(13,  action_bar_layer_legacy2_set_background_color_2bit)
+API_UNIMPL(14,  action_bar_layer_legacy2_set_click_config_provider)
+API_UNIMPL(15,  action_bar_layer_legacy2_set_context)
+API_UNIMPL(16,  action_bar_layer_legacy2_set_icon)
+API_UNIMPL(17,  animation_legacy2_create)
+API_UNIMPL(18,  animation_legacy2_destroy)
+API_UNIMPL(19,  animation_legacy2_get_context)
+API_UNIMPL(20,  animation_legacy2_is_scheduled)
+API_UNIMPL(21,  animation_legacy2_schedule)
+API_UNIMPL(22,  animation_legacy2_set_curve)
+API_UNIMPL(23,  animation_legacy2_set_delay)
+API_UNIMPL(24,  animation_legacy2_set_duration)
+API_UNIMPL(25,  animation_legacy2_set_handlers)
+API_UNIMPL(26,  animation_legacy2_set_implementation)
+API_UNIMPL(27,  animation_legacy2_unschedule)
+API_UNIMPL(28,  animation_legacy2_unschedule_all)
+API_UNIMPL(29,  app_comm_get_sniff_interval)
+API_UNIMPL(30,  app_comm_set_sniff_interval)
+API_FUNC(31,  app_event_loop,                                    app_event_loop)
+API_FUNC(34,  app_log_trace,                                     app_log)
+API_FUNC(35,  app_message_deregister_callbacks,                  app_message_deregister_callbacks)
+API_FUNC(36,  app_message_open,                                  app_message_open)
+API_UNIMPL(43,  app_sync_deinit)
+API_UNIMPL(44,  app_sync_get)
+API_UNIMPL(45,  app_sync_init)
+API_UNIMPL(46,  app_sync_set)
+API_FUNC(47,  app_timer_cancel,                                  app_timer_cancel)
+API_FUNC(48,  app_timer_register,                                app_timer_register)
+API_FUNC(49,  app_timer_reschedule,                              app_timer_reschedule)
+API_FUNC(50,  atan2_lookup,                                      atan2_lookup)
+API_FUNC(51,  atoi,                                              atoi)
+API_UNIMPL(52,  atol)
+API_FUNC(53,  battery_state_service_peek,                        battery_state_service_peek)
+API_FUNC(54,  battery_state_service_subscribe,                   battery_state_service_subscribe)
+API_FUNC(55,  battery_state_service_unsubscribe,                 battery_state_service_unsubscribe)
+API_FUNC(56,  bitmap_layer_create,                               bitmap_layer_create)
+API_FUNC(57,  bitmap_layer_destroy,                              bitmap_layer_destroy)
+API_FUNC(58,  bitmap_layer_get_layer,                            bitmap_layer_get_layer)
+API_FUNC(59,  bitmap_layer_set_alignment,                        bitmap_layer_set_alignment)
+API_UNIMPL(60,  bitmap_layer_set_background_color_2bit)
+API_FUNC(61,  bitmap_layer_set_bitmap,                           bitmap_layer_set_bitmap)
+API_FUNC(62,  bitmap_layer_set_compositing_mode,                 bitmap_layer_set_compositing_mode)
+API_FUNC(63,  bluetooth_connection_service_peek,                 bluetooth_connection_service_peek)
+API_FUNC(64,  bluetooth_connection_service_subscribe,            bluetooth_connection_service_subscribe)
+API_FUNC(65,  bluetooth_connection_service_unsubscribe,          bluetooth_connection_service_unsubscribe)
+API_FUNC(66,  click_number_of_clicks_counted,                    click_number_of_clicks_counted)
+API_FUNC(67,  click_recognizer_get_button_id,                    click_recognizer_get_button_id)
+API_UNIMPL(68,  clock_copy_time_string)
+API_FUNC(69,  pbl_clock_is_24h_style,                            clock_is_24h_style)
+API_FUNC(70,  cos_lookup,                                        cos_lookup)
+API_FUNC(71,  data_logging_create,                               data_logging_create)
+API_FUNC(72,  data_logging_finish,                               data_logging_finish)
+API_FUNC(73,  data_logging_log,                                  data_logging_log)
+API_FUNC(74,  dict_calc_buffer_size,                             dict_calc_buffer_size)
+API_FUNC(75,  dict_calc_buffer_size_from_tuplets,                dict_calc_buffer_size_from_tuplets)
+API_FUNC(76,  dict_find,                                         dict_find)
+API_FUNC(77,  dict_merge,                                        dict_merge)
+API_FUNC(78,  dict_read_begin_from_buffer,                       dict_read_begin_from_buffer)
+API_FUNC(79,  dict_read_first,                                   dict_read_first)
+API_FUNC(80,  dict_read_next,                                    dict_read_next)
+API_FUNC(81,  dict_serialize_tuplets,                            dict_serialize_tuplets)
+API_UNIMPL(82,  dict_serialize_tuplets_to_buffer__deprecated)
+API_FUNC(83,  dict_serialize_tuplets_to_buffer_with_iter,        dict_serialize_tuplets_to_buffer_with_iter)
+API_FUNC(84,  dict_write_begin,                                  dict_write_begin)
+API_FUNC(85,  dict_write_cstring,                                dict_write_cstring)
+API_FUNC(86,  dict_write_data,                                   dict_write_data)
+API_FUNC(87,  dict_write_end,                                    dict_write_end)
+API_FUNC(88,  dict_write_int,                                    dict_write_int)
+API_FUNC(89,  dict_write_int16,                                  dict_write_int16)
+API_FUNC(90,  dict_write_int32,                                  dict_write_int32)
+API_FUNC(91,  dict_write_int8,                                   dict_write_int8)
+API_FUNC(92,  dict_write_tuplet,                                 dict_write_tuplet)
+API_FUNC(93,  dict_write_uint16,                                 dict_write_uint16)
+API_FUNC(94,  dict_write_uint32,                                 dict_write_uint32)
+API_FUNC(95,  dict_write_uint8,                                  dict_write_uint8)
+API_FUNC(96,  fonts_get_system_font,                             fonts_get_system_font)
+API_FUNC(97,  fonts_load_custom_font_proxy,                      fonts_load_custom_font)
+API_FUNC(98,  fonts_unload_custom_font,                          fonts_unload_custom_font)
+API_FUNC(99,  app_free,                                          free)
+API_FUNC(100, gbitmap_create_as_sub_bitmap,                      gbitmap_create_as_sub_bitmap)
+API_FUNC(101, gbitmap_create_with_data,                          gbitmap_create_with_data)
+API_FUNC(102, gbitmap_create_with_resource_proxy,                gbitmap_create_with_resource)
+API_FUNC(103, gbitmap_destroy,                                   gbitmap_destroy)
+API_UNIMPL(104, gmtime)
+API_FUNC(105, gpath_create_app,                                  gpath_create)
+API_FUNC(106, gpath_destroy_app,                                 gpath_destroy)
+API_UNIMPL(107, gpath_draw_filled_legacy)
+API_FUNC(108, gpath_draw_app,                                    gpath_draw_outline)
+API_FUNC(109, gpath_move_to_app,                                 gpath_move_to)
+API_FUNC(110, gpath_rotate_to_app,                               gpath_rotate_to)
+API_FUNC(111, n_gpoint_equal,                                    gpoint_equal)
+API_FUNC(112, n_graphics_context_set_compositing_mode,           graphics_context_set_compositing_mode)
+API_UNIMPL(113, graphics_context_set_fill_color_2bit)
+API_UNIMPL(114, graphics_context_set_stroke_color_2bit)
+API_UNIMPL(115, graphics_context_set_text_color_2bit)
+API_FUNC(116, graphics_draw_bitmap_in_rect,                      graphics_draw_bitmap_in_rect)
+API_FUNC(117, graphics_draw_circle,                              graphics_draw_circle)
+API_FUNC(118, graphics_draw_line,                                graphics_draw_line)
+API_FUNC(119, graphics_draw_pixel,                               graphics_draw_pixel)
+API_FUNC(120, graphics_draw_rect,                                graphics_draw_rect)
+API_UNIMPL(121, graphics_draw_round_rect)
+API_FUNC(122, graphics_fill_circle,                              graphics_fill_circle)
+API_FUNC(123, graphics_fill_rect,                                graphics_fill_rect)
+API_UNIMPL(125, graphics_text_layout_get_max_used_size)
+API_FUNC(126, grect_align,                                       grect_align)
+API_FUNC(127, n_grect_center_point,                              grect_center_point)
+API_FUNC(128, n_grect_clip,                                      grect_clip)
+API_FUNC(129, n_grect_contains_point,                            grect_contains_point)
+API_FUNC(130, n_grect_crop,                                      grect_crop)
+API_FUNC(131, n_grect_equal,                                     grect_equal)
+API_FUNC(132, n_grect_is_empty,                                  grect_is_empty)
+API_FUNC(133, grect_standardize,                                 grect_standardize)
+API_FUNC(134, n_gsize_equal,                                     gsize_equal)
+API_UNIMPL(135, inverter_layer_create)
+API_UNIMPL(136, inverter_layer_destroy)
+API_UNIMPL(137, inverter_layer_get_layer)
+API_FUNC(138, layer_add_child,                                   layer_add_child)
+API_FUNC(139, layer_create,                                      layer_create)
+API_FUNC(140, layer_create_with_data,                            layer_create_with_data)
+API_FUNC(141, layer_destroy,                                     layer_destroy)
+API_FUNC(142, layer_get_bounds,                                  layer_get_bounds)
+API_FUNC(145, layer_get_frame,                                   layer_get_frame)
+API_FUNC(146, layer_get_hidden,                                  layer_get_hidden)
+API_FUNC(147, layer_get_window,                                  layer_get_window)
+API_FUNC(148, layer_insert_above_sibling,                        layer_insert_above_sibling)
+API_FUNC(149, layer_insert_below_sibling,                        layer_insert_below_sibling)
+API_FUNC(150, layer_mark_dirty,                                  layer_mark_dirty)
+API_FUNC(151, layer_remove_child_layers,                         layer_remove_child_layers)
+API_FUNC(152, layer_remove_from_parent,                          layer_remove_from_parent)
+API_FUNC(153, layer_set_bounds,                                  layer_set_bounds)
+API_UNIMPL(154, layer_set_clips)
+API_FUNC(155, layer_set_frame,                                   layer_set_frame)
+API_FUNC(156, layer_set_hidden,                                  layer_set_hidden)
+API_FUNC(157, layer_set_update_proc,                             layer_set_update_proc)
+API_UNIMPL(158, light_enable)
+API_UNIMPL(159, light_enable_interaction)
+API_FUNC(160, rebble_time_get_tm,                                localtime__deprecated)
+API_FUNC(161, app_malloc,                                        malloc)
+API_FUNC(162, memcpy,                                            memcpy)
+API_FUNC(163, memmove,                                           memmove)
+API_FUNC(164, memset,                                            memset)
+API_FUNC(165, menu_cell_basic_draw,                              menu_cell_basic_draw)
+API_FUNC(166, menu_cell_basic_header_draw,                       menu_cell_basic_header_draw)
+API_FUNC(167, menu_cell_title_draw,                              menu_cell_title_draw)
+API_FUNC(168, menu_index_compare,                                menu_index_compare)
+API_UNIMPL(169, menu_layer_legacy2_create)
+API_FUNC(170, menu_layer_destroy,                                menu_layer_destroy)
+API_FUNC(171, menu_layer_get_layer,                              menu_layer_get_layer)
+API_FUNC(172, menu_layer_get_scroll_layer,                       menu_layer_get_scroll_layer)
+API_FUNC(173, menu_layer_get_selected_index,                     menu_layer_get_selected_index)
+API_FUNC(174, menu_layer_reload_data,                            menu_layer_reload_data)
+API_UNIMPL(175, menu_layer_legacy2_set_callbacks__deprecated)
+API_FUNC(176, menu_layer_set_click_config_onto_window,           menu_layer_set_click_config_onto_window)
+API_FUNC(177, menu_layer_set_selected_index,                     menu_layer_set_selected_index)
+API_FUNC(178, menu_layer_set_selected_next,                      menu_layer_set_selected_next)
+API_UNIMPL(179, number_window_create)
+API_UNIMPL(180, number_window_destroy)
+API_UNIMPL(181, number_window_get_value)
+API_UNIMPL(182, number_window_set_label)
+API_UNIMPL(183, number_window_set_max)
+API_UNIMPL(184, number_window_set_min)
+API_UNIMPL(185, number_window_set_step_size)
+API_UNIMPL(186, number_window_set_value)
+API_FUNC(187, persist_delete,                                    persist_delete)
+API_FUNC(188, persist_exists,                                    persist_exists)
+API_FUNC(189, persist_get_size,                                  persist_get_size)
+API_FUNC(190, persist_read_bool,                                 persist_read_bool)
+API_FUNC(191, persist_read_data__deprecated,                     persist_read_data__deprecated)
+API_FUNC(192, persist_read_int,                                  persist_read_int)
+API_FUNC(193, persist_read_string__deprecated,                   persist_read_string__deprecated)
+API_FUNC(194, persist_write_bool,                                persist_write_bool)
+API_FUNC(195, persist_write_data__deprecated,                    persist_write_data__deprecated)
+API_FUNC(196, persist_write_int,                                 persist_write_int)
+API_FUNC(197, persist_write_string,                              persist_write_string)
+API_UNIMPL(198, property_animation_legacy2_create)
+API_UNIMPL(199, property_animation_legacy2_create_layer_frame)
+API_UNIMPL(200, property_animation_legacy2_destroy)
+API_UNIMPL(201, property_animation_legacy2_update_gpoint)
+API_UNIMPL(202, property_animation_legacy2_update_grect)
+API_UNIMPL(203, property_animation_legacy2_update_int16)
+API_UNIMPL(204, psleep)
+API_FUNC(205, rand,                                              rand)
+API_FUNC(206, resource_get_handle,                               resource_get_handle)
+API_FUNC(207, resource_load,                                     resource_load)
+API_FUNC(208, resource_load_byte_range,                          resource_load_byte_range)
+API_FUNC(209, resource_size,                                     resource_size)
+API_UNIMPL(210, rot_bitmap_layer_create)
+API_UNIMPL(211, rot_bitmap_layer_destroy)
+API_UNIMPL(212, rot_bitmap_layer_increment_angle)
+API_UNIMPL(213, rot_bitmap_layer_set_angle)
+API_UNIMPL(214, rot_bitmap_layer_set_corner_clip_color_2bit)
+API_UNIMPL(215, rot_bitmap_set_compositing_mode)
+API_UNIMPL(216, rot_bitmap_set_src_ic)
+API_FUNC(217, scroll_layer_add_child,                            scroll_layer_add_child)
+API_FUNC(218, scroll_layer_create,                               scroll_layer_create)
+API_FUNC(219, scroll_layer_destroy,                              scroll_layer_destroy)
+API_FUNC(220, scroll_layer_get_content_offset,                   scroll_layer_get_content_offset)
+API_FUNC(221, scroll_layer_get_content_size,                     scroll_layer_get_content_size)
+API_FUNC(222, scroll_layer_get_layer,                            scroll_layer_get_layer)
+API_FUNC(223, scroll_layer_get_shadow_hidden,                    scroll_layer_get_shadow_hidden)
+API_FUNC(224, scroll_layer_scroll_down_click_handler,            scroll_layer_scroll_down_click_handler)
+API_FUNC(225, scroll_layer_scroll_up_click_handler,              scroll_layer_scroll_up_click_handler)
+API_FUNC(226, scroll_layer_set_callbacks,                        scroll_layer_set_callbacks)
+API_FUNC(227, scroll_layer_set_click_config_onto_window,         scroll_layer_set_click_config_onto_window)
+API_FUNC(228, scroll_layer_set_content_offset,                   scroll_layer_set_content_offset)
+API_FUNC(229, scroll_layer_set_content_size,                     scroll_layer_set_content_size)
+API_FUNC(230, scroll_layer_set_context,                          scroll_layer_set_context)
+API_FUNC(231, scroll_layer_set_frame,                            scroll_layer_set_frame)
+API_FUNC(232, scroll_layer_set_shadow_hidden,                    scroll_layer_set_shadow_hidden)
+API_FUNC(233, simple_menu_layer_create,                          simple_menu_layer_create)
+API_FUNC(234, simple_menu_layer_destroy,                         simple_menu_layer_destroy)
+API_FUNC(235, simple_menu_layer_get_layer,                       simple_menu_layer_get_layer)
+API_FUNC(236, simple_menu_layer_get_selected_index,              simple_menu_layer_get_selected_index)
+API_FUNC(237, simple_menu_layer_set_selected_index,              simple_menu_layer_set_selected_index)
+API_FUNC(238, sin_lookup,                                        sin_lookup)
+API_FUNC(239, snprintf,                                          snprintf)
+API_FUNC(240, srand,                                             srand)
+API_FUNC(241, strcat,                                            strcat)
+API_FUNC(242, strcmp,                                            strcmp)
+API_FUNC(243, strcpy,                                            strcpy)
+API_FUNC(244, strftime,                                          strftime)
+API_FUNC(245, strlen,                                            strlen)
+API_FUNC(246, strncat,                                           strncat)
+API_FUNC(247, strncmp,                                           strncmp)
+API_FUNC(248, strncpy,                                           strncpy)
+API_UNIMPL(249, text_layer_legacy2_create)
+API_UNIMPL(250, text_layer_legacy2_destroy)
+API_UNIMPL(251, text_layer_legacy2_get_content_size)
+API_UNIMPL(252, text_layer_legacy2_get_layer)
+API_UNIMPL(253, text_layer_legacy2_get_text)
+API_UNIMPL(254, text_layer_legacy2_set_background_color_2bit)
+API_UNIMPL(255, text_layer_legacy2_set_font)
+API_UNIMPL(256, text_layer_legacy2_set_overflow_mode)
+API_UNIMPL(257, text_layer_legacy2_set_size)
+API_UNIMPL(258, text_layer_legacy2_set_text)
+API_UNIMPL(259, text_layer_legacy2_set_text_alignment)
+API_UNIMPL(260, text_layer_legacy2_set_text_color_2bit)
+API_FUNC(262, tick_timer_service_subscribe,                      tick_timer_service_subscribe)
+API_FUNC(263, tick_timer_service_unsubscribe,                    tick_timer_service_unsubscribe)
+API_FUNC(264, pbl_time_deprecated,                               time__deprecated)
+API_FUNC(265, rcore_time_ms,                                     time_ms_deprecated)
+API_FUNC(266, vibes_cancel,                                      vibes_cancel)
+API_FUNC(267, vibes_double_pulse,                                vibes_double_pulse)
+API_FUNC(268, vibes_enqueue_custom_pattern,                      vibes_enqueue_custom_pattern)
+API_FUNC(269, vibes_long_pulse,                                  vibes_long_pulse)
+API_FUNC(270, vibes_short_pulse,                                 vibes_short_pulse)
+API_FUNC(271, window_create,                                     window_create)
+API_FUNC(272, window_destroy,                                    window_destroy)
+API_FUNC(273, window_get_click_config_provider,                  window_get_click_config_provider)
+API_FUNC(274, window_get_fullscreen,                             window_get_fullscreen)
+API_FUNC(275, window_get_root_layer,                             window_get_root_layer)
+API_FUNC(276, window_is_loaded,                                  window_is_loaded)
+API_UNIMPL(277, window_set_background_color_2bit)
+API_FUNC(278, window_set_click_config_provider,                  window_set_click_config_provider)
+API_FUNC(279, window_set_click_config_provider_with_context,     window_set_click_config_provider_with_context)
+API_FUNC(280, window_set_fullscreen,                             window_set_fullscreen)
+API_UNIMPL(281, window_set_status_bar_icon)
+API_FUNC(282, window_set_window_handlers,                        window_set_window_handlers)
+API_FUNC(283, window_stack_contains_window,                      window_stack_contains_window)
+API_FUNC(284, window_stack_get_top_window,                       window_stack_get_top_window)
+API_FUNC(285, window_stack_pop,                                  window_stack_pop)
+API_FUNC(286, window_stack_pop_all,                              window_stack_pop_all)
+API_FUNC(287, window_stack_push,                                 window_stack_push)
+API_FUNC(288, window_stack_remove,                               window_stack_remove)
+API_UNIMPL(289, app_focus_service_subscribe)
+API_UNIMPL(290, app_focus_service_unsubscribe)
+API_FUNC(291, window_get_user_data,                              window_get_user_data)
+API_FUNC(292, window_set_user_data,                              window_set_user_data)
+API_FUNC(293, app_message_get_context,                           app_message_get_context)
+API_FUNC(294, app_message_inbox_size_maximum,                    app_message_inbox_size_maximum)
+API_FUNC(295, app_message_outbox_begin,                          app_message_outbox_begin)
+API_FUNC(296, app_message_outbox_send,                           app_message_outbox_send)
+API_FUNC(297, app_message_outbox_size_maximum,                   app_message_outbox_size_maximum)
+API_FUNC(298, app_message_register_inbox_dropped,                app_message_register_inbox_dropped)
+API_FUNC(299, app_message_register_inbox_received,               app_message_register_inbox_received)
+API_FUNC(300, app_message_register_outbox_failed,                app_message_register_outbox_failed)
+API_FUNC(301, app_message_register_outbox_sent,                  app_message_register_outbox_sent)
+API_FUNC(302, app_message_set_context,                           app_message_set_context)
+API_FUNC(303, window_long_click_subscribe,                       window_long_click_subscribe)
+API_FUNC(304, window_multi_click_subscribe,                      window_multi_click_subscribe)
+API_FUNC(305, window_raw_click_subscribe,                        window_raw_click_subscribe)
+API_FUNC(306, window_set_click_context,                          window_set_click_context)
+API_FUNC(307, window_single_click_subscribe,                     window_single_click_subscribe)
+API_FUNC(308, window_single_repeating_click_subscribe,           window_single_repeating_click_subscribe)
+API_FUNC(309, graphics_draw_text,                                graphics_draw_text)
+API_FUNC(310, dict_serialize_tuplets_to_buffer,                  dict_serialize_tuplets_to_buffer)
+API_FUNC(311, persist_read_data,                                 persist_read_data)
+API_FUNC(312, persist_read_string,                               persist_read_string)
+API_FUNC(313, persist_write_data,                                persist_write_data)
+API_FUNC(314, dict_size,                                         dict_size)
+API_UNIMPL(315, graphics_text_layout_get_content_size)
+API_FUNC(316, simple_menu_layer_get_menu_layer,                  simple_menu_layer_get_menu_layer)
+API_FUNC(317, accel_data_service_subscribe,                      accel_data_service_subscribe)
+API_FUNC(318, app_calloc,                                        calloc)
+API_FUNC(319, bitmap_layer_get_bitmap,                           bitmap_layer_get_bitmap)
+API_UNIMPL(320, menu_layer_legacy2_set_callbacks)
+API_FUNC(321, window_get_click_config_context,                   window_get_click_config_context)
+API_UNIMPL(322, number_window_get_window)
+API_FUNC(323, app_realloc,                                       realloc)
+API_UNIMPL(324, gbitmap_create_blank_2bit)
+API_FUNC(325, click_recognizer_is_repeating,                     click_recognizer_is_repeating)
+API_FUNC(326, accel_raw_data_service_subscribe,                  accel_raw_data_service_subscribe)
+API_FUNC(327, app_worker_is_running,                             app_worker_is_running)
+API_FUNC(328, app_worker_kill,                                   app_worker_kill)
+API_FUNC(329, app_worker_launch,                                 app_worker_launch)
+API_FUNC(330, app_worker_message_subscribe,                      app_worker_message_subscribe)
+API_FUNC(331, app_worker_message_unsubscribe,                    app_worker_message_unsubscribe)
+API_FUNC(332, app_worker_send_message,                           app_worker_send_message)
+API_FUNC(333, worker_event_loop,                                 worker_event_loop)
+API_FUNC(334, worker_launch_app,                                 worker_launch_app)
+API_FUNC(335, app_heap_bytes_free,                               heap_bytes_free)
+API_FUNC(336, app_heap_bytes_used,                               heap_bytes_used)
+API_UNIMPL(337, compass_service_peek)
+API_UNIMPL(338, compass_service_set_heading_filter)
+API_UNIMPL(339, compass_service_subscribe)
+API_UNIMPL(340, compass_service_unsubscribe)
+API_UNIMPL(341, uuid_equal)
+API_UNIMPL(342, uuid_to_string)
+API_FUNC(343, gpath_fill_app,                                    gpath_draw_filled)
+API_UNIMPL(344, animation_legacy2_set_custom_curve)
+API_UNIMPL(345, watch_info_get_color)
+API_UNIMPL(346, watch_info_get_firmware_version)
+API_UNIMPL(347, watch_info_get_model)
+API_UNIMPL(348, graphics_capture_frame_buffer_2bit)
+API_FUNC(349, graphics_frame_buffer_is_captured,                 graphics_frame_buffer_is_captured)
+API_FUNC(350, graphics_release_frame_buffer,                     graphics_release_frame_buffer)
+API_FUNC(351, clock_to_timestamp,                                clock_to_timestamp)
+API_UNIMPL(352, launch_reason)
+API_UNIMPL(353, wakeup_cancel)
+API_UNIMPL(354, wakeup_cancel_all)
+API_UNIMPL(355, wakeup_get_launch_event)
+API_UNIMPL(356, wakeup_query)
+API_UNIMPL(357, wakeup_schedule)
+API_UNIMPL(358, wakeup_service_subscribe)
+API_UNIMPL(359, clock_is_timezone_set)
+API_UNIMPL(360, i18n_get_system_locale)
+API_UNIMPL(361, _localeconv_r)
+API_UNIMPL(362, setlocale)
+API_FUNC(363, mktime,                                            mktime)
+API_FUNC(364, gcolor_equal,                                      gcolor_equal)
+API_UNIMPL(365, __profiler_init)
+API_UNIMPL(366, __profiler_print_stats)
+API_UNIMPL(367, __profiler_start)
+API_UNIMPL(368, __profiler_stop)
+API_FUNC(370, bitmap_layer_set_background_color,                 bitmap_layer_set_background_color)
+API_FUNC(371, graphics_context_set_fill_color,                   graphics_context_set_fill_color)
+API_FUNC(372, graphics_context_set_stroke_color,                 graphics_context_set_stroke_color)
+API_FUNC(373, graphics_context_set_text_color,                   graphics_context_set_text_color)
+API_UNIMPL(374, rot_bitmap_layer_set_corner_clip_color)
+API_FUNC(377, window_set_background_color,                       window_set_background_color)
+API_UNIMPL(378, clock_get_timezone)
+API_FUNC(379, localtime,                                         localtime)
+API_FUNC(380, animation_create,                                  animation_create)
+API_FUNC(381, animation_destroy,                                 animation_destroy)
+API_FUNC(382, animation_get_context,                             animation_get_context)
+API_FUNC(383, animation_is_scheduled,                            animation_is_scheduled)
+API_FUNC(384, animation_schedule,                                animation_schedule)
+API_FUNC(385, animation_set_curve,                               animation_set_curve)
+API_FUNC(386, animation_set_custom_curve,                        animation_set_custom_curve)
+API_FUNC(387, animation_set_delay,                               animation_set_delay)
+API_FUNC(388, animation_set_duration,                            animation_set_duration)
+API_FUNC(389, animation_set_handlers,                            animation_set_handlers)
+API_FUNC(390, animation_set_implementation,                      animation_set_implementation)
+API_FUNC(391, animation_unschedule,                              animation_unschedule)
+API_FUNC(392, animation_unschedule_all,                          animation_unschedule_all)
+API_FUNC(393, gbitmap_create_blank,                              gbitmap_create_blank)
+API_FUNC(394, graphics_capture_frame_buffer,                     graphics_capture_frame_buffer)
+API_FUNC(395, graphics_capture_frame_buffer_format,              graphics_capture_frame_buffer_format)
+API_FUNC(396, property_animation_create,                         property_animation_create)
+API_FUNC(397, property_animation_create_layer_frame,             property_animation_create_layer_frame)
+API_FUNC(398, property_animation_destroy,                        property_animation_destroy)
+API_FUNC(399, property_animation_from,                           property_animation_from)
+API_FUNC(400, property_animation_get_animation,                  property_animation_get_animation)
+API_FUNC(401, property_animation_subject,                        property_animation_subject)
+API_FUNC(402, property_animation_to,                             property_animation_to)
+API_FUNC(403, property_animation_update_gpoint,                  property_animation_update_gpoint)
+API_FUNC(404, property_animation_update_grect,                   property_animation_update_grect)
+API_FUNC(405, property_animation_update_int16,                   property_animation_update_int16)
+API_FUNC(406, gbitmap_create_blank_with_palette,                 gbitmap_create_blank_with_palette)
+API_FUNC(407, gbitmap_get_bounds,                                gbitmap_get_bounds)
+API_FUNC(408, gbitmap_get_bytes_per_row,                         gbitmap_get_bytes_per_row)
+API_FUNC(409, gbitmap_get_data,                                  gbitmap_get_data)
+API_FUNC(410, gbitmap_get_format,                                gbitmap_get_format)
+API_FUNC(411, gbitmap_get_palette,                               gbitmap_get_palette)
+API_FUNC(412, gbitmap_set_bounds,                                gbitmap_set_bounds)
+API_FUNC(413, gbitmap_set_data,                                  gbitmap_set_data)
+API_FUNC(414, gbitmap_set_palette,                               gbitmap_set_palette)
+API_UNIMPL(415, gbitmap_sequence_create_with_resource)
+API_UNIMPL(416, gbitmap_sequence_destroy)
+API_UNIMPL(417, gbitmap_sequence_get_bitmap_size)
+API_UNIMPL(418, gbitmap_sequence_get_current_frame_idx)
+API_UNIMPL(419, gbitmap_sequence_get_total_num_frames)
+API_UNIMPL(420, gbitmap_sequence_update_bitmap_next_frame)
+API_FUNC(421, gbitmap_create_from_png_data,                      gbitmap_create_from_png_data)
+API_FUNC(422, animation_clone,                                   animation_clone)
+API_FUNC(423, animation_get_delay,                               animation_get_delay)
+API_FUNC(424, animation_get_duration,                            animation_get_duration)
+API_FUNC(425, animation_get_play_count,                          animation_get_play_count)
+API_FUNC(426, animation_get_elapsed,                             animation_get_elapsed)
+API_FUNC(427, animation_get_reverse,                             animation_get_reverse)
+API_FUNC(428, animation_sequence_create,                         animation_sequence_create)
+API_FUNC(429, animation_sequence_create_from_array,              animation_sequence_create_from_array)
+API_FUNC(430, animation_set_play_count,                          animation_set_play_count)
+API_FUNC(431, animation_set_elapsed,                             animation_set_elapsed)
+API_FUNC(432, animation_set_reverse,                             animation_set_reverse)
+API_FUNC(433, animation_spawn_create,                            animation_spawn_create)
+API_FUNC(434, animation_spawn_create_from_array,                 animation_spawn_create_from_array)
+API_FUNC(435, animation_get_curve,                               animation_get_curve)
+API_FUNC(436, animation_get_custom_curve,                        animation_get_custom_curve)
+API_FUNC(437, animation_get_implementation,                      animation_get_implementation)
+API_UNIMPL(438, launch_get_args)
+API_FUNC(439, menu_layer_create,                                 menu_layer_create)
+API_UNIMPL(441, gbitmap_sequence_get_play_count)
+API_UNIMPL(442, gbitmap_sequence_restart)
+API_UNIMPL(443, gbitmap_sequence_set_play_count)
+API_FUNC(444, graphics_context_set_antialiased,                  graphics_context_set_antialiased)
+API_FUNC(445, graphics_context_set_stroke_width,                 graphics_context_set_stroke_width)
+API_FUNC(446, action_bar_layer_add_to_window,                    action_bar_layer_add_to_window)
+API_FUNC(447, action_bar_layer_clear_icon,                       action_bar_layer_clear_icon)
+API_FUNC(448, action_bar_layer_create,                           action_bar_layer_create)
+API_FUNC(449, action_bar_layer_destroy,                          action_bar_layer_destroy)
+API_FUNC(450, action_bar_layer_get_layer,                        action_bar_layer_get_layer)
+API_FUNC(451, action_bar_layer_remove_from_window,               action_bar_layer_remove_from_window)
+API_FUNC(452, action_bar_layer_set_background_color,             action_bar_layer_set_background_color)
+API_FUNC(453, action_bar_layer_set_click_config_provider,        action_bar_layer_set_click_config_provider)
+API_FUNC(454, action_bar_layer_set_context,                      action_bar_layer_set_context)
+API_FUNC(455, action_bar_layer_set_icon,                         action_bar_layer_set_icon)
+API_FUNC(456, action_bar_layer_set_icon_animated,                action_bar_layer_set_icon_animated)
+API_UNIMPL(457, gbitmap_sequence_update_bitmap_by_elapsed)
+API_FUNC(458, gbitmap_create_palettized_from_1bit,               gbitmap_create_palettized_from_1bit)
+API_FUNC(459, menu_cell_layer_is_highlighted,                    menu_cell_layer_is_highlighted)
+API_UNIMPL(460, graphics_draw_rotated_bitmap)
+API_FUNC(461, action_bar_layer_set_icon_press_animation,         action_bar_layer_set_icon_press_animation)
+API_FUNC(462, text_layer_create,                                 text_layer_create)
+API_FUNC(463, text_layer_destroy,                                text_layer_destroy)
+API_FUNC(464, text_layer_get_content_size,                       text_layer_get_content_size)
+API_FUNC(465, text_layer_get_layer,                              text_layer_get_layer)
+API_FUNC(466, text_layer_get_text,                               text_layer_get_text)
+API_FUNC(467, text_layer_set_background_color,                   text_layer_set_background_color)
+API_FUNC(468, text_layer_set_font,                               text_layer_set_font)
+API_FUNC(469, text_layer_set_overflow_mode,                      text_layer_set_overflow_mode)
+API_FUNC(470, text_layer_set_size,                               text_layer_set_size)
+API_FUNC(471, text_layer_set_text,                               text_layer_set_text)
+API_FUNC(472, text_layer_set_text_alignment,                     text_layer_set_text_alignment)
+API_FUNC(473, text_layer_set_text_color,                         text_layer_set_text_color)
+API_FUNC(474, n_gdraw_command_draw,                              gdraw_command_draw)
+API_FUNC(475, n_gdraw_command_frame_draw,                        gdraw_command_frame_draw)
+API_FUNC(476, n_gdraw_command_frame_get_duration,                gdraw_command_frame_get_duration)
+API_FUNC(477, n_gdraw_command_frame_set_duration,                gdraw_command_frame_set_duration)
+API_FUNC(478, n_gdraw_command_get_fill_color,                    gdraw_command_get_fill_color)
+API_FUNC(479, n_gdraw_command_get_hidden,                        gdraw_command_get_hidden)
+API_FUNC(480, n_gdraw_command_get_num_points,                    gdraw_command_get_num_points)
+API_FUNC(481, n_gdraw_command_get_path_open,                     gdraw_command_get_path_open)
+API_FUNC(482, n_gdraw_command_get_point,                         gdraw_command_get_point)
+API_FUNC(483, n_gdraw_command_get_radius,                        gdraw_command_get_radius)
+API_FUNC(484, n_gdraw_command_get_stroke_color,                  gdraw_command_get_stroke_color)
+API_FUNC(485, n_gdraw_command_get_stroke_width,                  gdraw_command_get_stroke_width)
+API_FUNC(486, n_gdraw_command_get_type,                          gdraw_command_get_type)
+API_FUNC(487, n_gdraw_command_image_clone,                       gdraw_command_image_clone)
+API_FUNC(488, n_gdraw_command_image_create_with_resource,        gdraw_command_image_create_with_resource)
+API_FUNC(489, gdraw_command_image_destroy_app,                   gdraw_command_image_destroy)
+API_FUNC(490, gdraw_command_image_draw_app,                      gdraw_command_image_draw)
+API_FUNC(491, n_gdraw_command_image_get_bounds_size,             gdraw_command_image_get_bounds_size)
+API_FUNC(492, n_gdraw_command_image_get_command_list,            gdraw_command_image_get_command_list)
+API_FUNC(493, n_gdraw_command_image_set_bounds_size,             gdraw_command_image_set_bounds_size)
+API_FUNC(494, n_gdraw_command_list_draw,                         gdraw_command_list_draw)
+API_FUNC(495, n_gdraw_command_list_get_command,                  gdraw_command_list_get_command)
+API_FUNC(496, n_gdraw_command_list_get_num_commands,             gdraw_command_list_get_num_commands)
+API_FUNC(497, n_gdraw_command_list_iterate,                      gdraw_command_list_iterate)
+API_FUNC(498, n_gdraw_command_sequence_clone,                    gdraw_command_sequence_clone)
+API_FUNC(499, n_gdraw_command_sequence_create_with_resource,     gdraw_command_sequence_create_with_resource)
+API_FUNC(500, n_gdraw_command_sequence_destroy,                  gdraw_command_sequence_destroy)
+API_FUNC(501, n_gdraw_command_sequence_get_bounds_size,          gdraw_command_sequence_get_bounds_size)
+API_FUNC(502, n_gdraw_command_sequence_get_frame_by_elapsed,     gdraw_command_sequence_get_frame_by_elapsed)
+API_FUNC(503, n_gdraw_command_sequence_get_frame_by_index,       gdraw_command_sequence_get_frame_by_index)
+API_FUNC(504, n_gdraw_command_sequence_get_num_frames,           gdraw_command_sequence_get_num_frames)
+API_FUNC(505, n_gdraw_command_sequence_get_play_count,           gdraw_command_sequence_get_play_count)
+API_FUNC(506, n_gdraw_command_sequence_get_total_duration,       gdraw_command_sequence_get_total_duration)
+API_FUNC(507, n_gdraw_command_sequence_set_bounds_size,          gdraw_command_sequence_set_bounds_size)
+API_FUNC(508, n_gdraw_command_sequence_set_play_count,           gdraw_command_sequence_set_play_count)
+API_FUNC(509, n_gdraw_command_set_fill_color,                    gdraw_command_set_fill_color)
+API_FUNC(510, n_gdraw_command_set_hidden,                        gdraw_command_set_hidden)
+API_FUNC(511, n_gdraw_command_set_path_open,                     gdraw_command_set_path_open)
+API_FUNC(512, n_gdraw_command_set_point,                         gdraw_command_set_point)
+API_FUNC(513, n_gdraw_command_set_radius,                        gdraw_command_set_radius)
+API_FUNC(514, n_gdraw_command_set_stroke_color,                  gdraw_command_set_stroke_color)
+API_FUNC(515, n_gdraw_command_set_stroke_width,                  gdraw_command_set_stroke_width)
+API_FUNC(516, property_animation_create_bounds_origin,           property_animation_create_bounds_origin)
+API_FUNC(517, property_animation_update_uint32,                  property_animation_update_uint32)
+API_FUNC(518, gpath_draw_app,                                    gpath_draw_outline_open)
+API_FUNC(519, pbl_time_t_deprecated,                             time)
+API_FUNC(520, menu_layer_set_highlight_colors,                   menu_layer_set_highlight_colors)
+API_FUNC(521, menu_layer_set_normal_colors,                      menu_layer_set_normal_colors)
+API_FUNC(522, menu_layer_set_callbacks,                          menu_layer_set_callbacks)
+API_FUNC(523, menu_layer_pad_bottom_enable,                      menu_layer_pad_bottom_enable)
+API_FUNC(524, status_bar_layer_create,                           status_bar_layer_create)
+API_FUNC(525, status_bar_layer_destroy,                          status_bar_layer_destroy)
+API_FUNC(526, status_bar_layer_get_background_color,             status_bar_layer_get_background_color)
+API_FUNC(527, status_bar_layer_get_foreground_color,             status_bar_layer_get_foreground_color)
+API_FUNC(528, status_bar_layer_get_layer,                        status_bar_layer_get_layer)
+API_FUNC(529, status_bar_layer_set_colors,                       status_bar_layer_set_colors)
+API_FUNC(530, status_bar_layer_set_separator_mode,               status_bar_layer_set_separator_mode)
+API_FUNC(532, rcore_time_ms,                                     time_ms)
+API_UNIMPL(533, gcolor_legible_over)
+API_FUNC(534, property_animation_update_gcolor8,                 property_animation_update_gcolor8)
+API_UNIMPL(535, app_focus_service_subscribe_handlers)
+API_FUNC(536, action_menu_close,                                 action_menu_close)
+API_FUNC(537, action_menu_freeze,                                action_menu_freeze)
+API_FUNC(538, action_menu_get_context,                           action_menu_get_context)
+API_FUNC(539, action_menu_get_root_level,                        action_menu_get_root_level)
+API_FUNC(540, action_menu_hierarchy_destroy,                     action_menu_hierarchy_destroy)
+API_FUNC(541, action_menu_item_get_action_data,                  action_menu_item_get_action_data)
+API_FUNC(542, action_menu_item_get_label,                        action_menu_item_get_label)
+API_FUNC(543, action_menu_level_add_action,                      action_menu_level_add_action)
+API_FUNC(544, action_menu_level_add_child,                       action_menu_level_add_child)
+API_FUNC(545, action_menu_level_create,                          action_menu_level_create)
+API_FUNC(546, action_menu_level_set_display_mode,                action_menu_level_set_display_mode)
+API_FUNC(547, action_menu_open,                                  action_menu_open)
+API_UNIMPL(548, action_menu_set_result_window)
+API_FUNC(549, action_menu_unfreeze,                              action_menu_unfreeze)
+API_UNIMPL(550, dictation_session_create)
+API_UNIMPL(551, dictation_session_destroy)
+API_UNIMPL(552, dictation_session_enable_confirmation)
+API_UNIMPL(553, dictation_session_start)
+API_UNIMPL(554, dictation_session_stop)
+API_FUNC(555, smartstrap_attribute_begin_write,                  smartstrap_attribute_begin_write)
+API_FUNC(556, smartstrap_attribute_create,                       smartstrap_attribute_create)
+API_FUNC(557, smartstrap_attribute_destroy,                      smartstrap_attribute_destroy)
+API_FUNC(558, smartstrap_attribute_end_write,                    smartstrap_attribute_end_write)
+API_FUNC(559, smartstrap_attribute_get_attribute_id,             smartstrap_attribute_get_attribute_id)
+API_FUNC(560, smartstrap_attribute_get_service_id,               smartstrap_attribute_get_service_id)
+API_FUNC(561, smartstrap_attribute_read,                         smartstrap_attribute_read)
+API_FUNC(562, smartstrap_service_is_available,                   smartstrap_service_is_available)
+API_FUNC(563, smartstrap_set_timeout,                            smartstrap_set_timeout)
+API_FUNC(564, smartstrap_subscribe,                              smartstrap_subscribe)
+API_FUNC(565, smartstrap_unsubscribe,                            smartstrap_unsubscribe)
+API_FUNC(566, connection_service_peek_pebble_app_connection,     connection_service_peek_pebble_app_connection)
+API_FUNC(567, connection_service_peek_pebblekit_connection,      connection_service_peek_pebblekit_connection)
+API_FUNC(568, connection_service_subscribe,                      connection_service_subscribe)
+API_FUNC(569, connection_service_unsubscribe,                    connection_service_unsubscribe)
+API_UNIMPL(570, dictation_session_enable_error_dialogs)
+API_FUNC(571, gbitmap_get_data_row_info,                         gbitmap_get_data_row_info)
+API_FUNC(572, content_indicator_configure_direction,             content_indicator_configure_direction)
+API_FUNC(573, content_indicator_create,                          content_indicator_create)
+API_FUNC(574, content_indicator_destroy,                         content_indicator_destroy)
+API_FUNC(575, content_indicator_get_content_available,           content_indicator_get_content_available)
+API_FUNC(576, content_indicator_set_content_available,           content_indicator_set_content_available)
+API_FUNC(577, scroll_layer_get_content_indicator,                scroll_layer_get_content_indicator)
+API_FUNC(578, menu_layer_get_center_focused,                     menu_layer_get_center_focused)
+API_FUNC(579, menu_layer_set_center_focused,                     menu_layer_set_center_focused)
+API_FUNC(580, grect_inset,                                       grect_inset)
+API_UNIMPL(581, gpoint_from_polar)
+API_UNIMPL(582, graphics_draw_arc)
+API_UNIMPL(583, graphics_fill_radial)
+API_UNIMPL(584, grect_centered_from_polar)
+API_UNIMPL(585, graphics_text_attributes_create)
+API_UNIMPL(586, graphics_text_attributes_destroy)
+API_UNIMPL(587, graphics_text_attributes_enable_paging)
+API_UNIMPL(588, graphics_text_attributes_enable_screen_text_flow)
+API_UNIMPL(589, graphics_text_attributes_restore_default_paging)
+API_UNIMPL(590, graphics_text_attributes_restore_default_text_flow)
+API_UNIMPL(591, graphics_text_layout_get_content_size_with_attributes)
+API_FUNC(592, layer_convert_point_to_screen,                     layer_convert_point_to_screen)
+API_UNIMPL(593, layer_convert_rect_to_screen)
+API_FUNC(594, scroll_layer_get_paging,                           scroll_layer_get_paging)
+API_FUNC(595, scroll_layer_set_paging,                           scroll_layer_set_paging)
+API_UNIMPL(596, text_layer_enable_screen_text_flow_and_paging)
+API_FUNC(597, text_layer_restore_default_text_flow_and_paging,   text_layer_restore_default_text_flow_and_paging)
+API_FUNC(598, menu_layer_is_index_selected,                      menu_layer_is_index_selected)
+API_UNIMPL(599, health_service_activities_iterate)
+API_UNIMPL(600, health_service_any_activity_accessible)
+API_UNIMPL(601, health_service_events_subscribe)
+API_UNIMPL(602, health_service_events_unsubscribe)
+API_UNIMPL(603, health_service_get_minute_history)
+API_UNIMPL(604, health_service_metric_accessible)
+API_UNIMPL(605, health_service_peek_current_activities)
+API_UNIMPL(606, health_service_sum)
+API_UNIMPL(607, health_service_sum_today)
+API_UNIMPL(608, time_start_of_today)
+API_UNIMPL(609, health_service_metric_averaged_accessible)
+API_UNIMPL(610, health_service_sum_averaged)
+API_UNIMPL(611, health_service_get_measurement_system_for_display)
+API_UNIMPL(612, gdraw_command_frame_get_command_list)
+API_UNIMPL(613, unimpl613)
+API_UNIMPL(614, unimpl614)
+API_UNIMPL(615, unimpl615)
+API_UNIMPL(616, unimpl616)
+API_UNIMPL(617, unimpl617)
+API_UNIMPL(618, unimpl618)
+API_UNIMPL(619, unimpl619)
+API_UNIMPL(620, unimpl620)
+API_UNIMPL(621, unimpl621)
+API_FUNC(622, layer_get_unobstructed_bounds,                     layer_get_unobstructed_bounds)
+API_UNIMPL(623, unimpl623)
+API_UNIMPL(624, unimpl624)
+API_UNIMPL(625, unimpl625)
+API_UNIMPL(626, unimpl626)
+API_FUNC(627, rocky_event_loop_with_resource,                    rocky_event_loop_with_resource)
+API_UNIMPL(628, unimpl628)
+API_UNIMPL(629, unimpl629)
+API_UNIMPL(630, unimpl630)
+API_UNIMPL(631, unimpl631)
@@ -0,0 +1,183 @@
+/* api_profile.c
+ * Which SDK calls apps make, how often, and how long they take
+ * RebbleOS
+ *
+ * In an API_PROFILE build every slot of the jump table is a trampoline
+ * (see api_func_symbols.h). On the way in it counts the call, notes the
+ * cycle counter and the app's return address on a small stack of the
+ * thread's own, and has the call return to api_profile_return instead,
+ * which adds up the cycles and goes back to the app. The time is the
+ * whole of the call, callbacks into the app and all.
+ *
+ * When the app finishes, the slots it spent the most time in are logged
+ * with their calls and cycles, along with any it called most often.
+ */
+
+#include "rebbleos.h"
+#include "appmanager.h"
+#include "api_profile.h"
+
+/* one log line for repeat calls to unimplemented slots, at most this often */
+#define API_UNIMPL_LOG_MS 5000
+
+static uint32_t _unimpl_seen[(API_SLOTS + 31) / 32];
+static uint32_t _unimpl_repeats;
+static TickType_t _unimpl_tick;
+
+void api_unimplemented(uint16_t slot, const char *name)
+{
+    uint32_t bit = 1 << (slot % 32);
+    TickType_t now = xTaskGetTickCount();
+
+    if (slot < API_SLOTS && !(_unimpl_seen[slot / 32] & bit))
+    {
+        _unimpl_seen[slot / 32] |= bit;
+        SYS_LOG("API", APP_LOG_LEVEL_WARNING, "== Unimplemented: %s ==", name);
+        return;
+    }
+
+    _unimpl_repeats++;
+    if (now - _unimpl_tick < pdMS_TO_TICKS(API_UNIMPL_LOG_MS))
+        return;
+    SYS_LOG("API", APP_LOG_LEVEL_WARNING, "== Unimplemented: %lu more calls, last %s ==",
+            _unimpl_repeats, name);
+    _unimpl_repeats = 0;
+    _unimpl_tick = now;
+}
+
+#ifdef API_PROFILE
+
+/* deeper than this, calls are counted but not timed */
+#define API_PROFILE_DEPTH 16
+/* how many slots the dump names, by time and again by calls */
+#define API_PROFILE_TOP 12
+
+typedef struct ApiProfileFrame {
+    uint32_t lr;
+    uint32_t start;
+    uint16_t slot;
+} ApiProfileFrame;
+
+typedef struct ApiProfileStack {
+    uint8_t depth;
+    ApiProfileFrame frame[API_PROFILE_DEPTH];
+} ApiProfileStack;
+
+static const char *const _names[API_SLOTS] = {
+#define API_FUNC(n, fn, name) [n] = #name,
+#define API_UNIMPL(n, name) [n] = #name,
+#include "api_func_list.h"
+#undef API_FUNC
+#undef API_UNIMPL
+};
+
+/* only for debugging, so it can have CCRAM */
+static CCRAM uint32_t _calls[API_SLOTS];
+static CCRAM uint64_t _cycles[API_SLOTS];
+static ApiProfileStack _stacks[MAX_APP_THREADS];
+
+uint32_t api_profile_enter(uint32_t slot, uint32_t lr)
+{
+    ApiProfileStack *stack = &_stacks[appmanager_get_thread_type()];
+    ApiProfileFrame *frame;
+
+    _calls[slot]++;
+    if (stack->depth == API_PROFILE_DEPTH)
+        return lr;
+
+    frame = &stack->frame[stack->depth++];
+    frame->lr = lr;
+    frame->slot = slot;
+    frame->start = hw_cycle_count();
+    return (uint32_t)api_profile_return;
+}
+
+uint32_t api_profile_leave(void)
+{
+    uint32_t now = hw_cycle_count();
+    ApiProfileStack *stack = &_stacks[appmanager_get_thread_type()];
+    ApiProfileFrame *frame = &stack->frame[--stack->depth];
+
+    _cycles[frame->slot] += now - frame->start;
+    return frame->lr;
+}
+
+/* Where timed calls return to. r0 and r1 are the call's result */
+__attribute__((naked)) void api_profile_return(void)
+{
+    __asm volatile(
+        "push {r0, r1}\n"
+        "bl api_profile_leave\n"
+        "mov r12, r0\n"
+        "pop {r0, r1}\n"
+        "bx r12\n");
+}
+
+/* The top API_PROFILE_TOP slots by count, biggest first, into top */
+static uint8_t _top(uint16_t *top, bool by_cycles)
+{
+    uint8_t n = 0;
+
+    for (uint16_t slot = 0; slot < API_SLOTS; slot++)
+    {
+        uint64_t v = by_cycles ? _cycles[slot] : _calls[slot];
+        uint8_t i;
+
+        if (!_calls[slot])
+            continue;
+        for (i = n; i > 0; i--)
+        {
+            uint64_t w = by_cycles ? _cycles[top[i - 1]] : _calls[top[i - 1]];
+            if (w >= v)
+                break;
+            if (i < API_PROFILE_TOP)
+                top[i] = top[i - 1];
+        }
+        if (i < API_PROFILE_TOP)
+            top[i] = slot;
+        if (n < API_PROFILE_TOP)
+            n++;
+    }
+    return n;
+}
+
+static void _dump(void)
+{
+    uint16_t top[API_PROFILE_TOP];
+    uint32_t calls = 0;
+    uint8_t n;
+
+    for (uint16_t slot = 0; slot < API_SLOTS; slot++)
+        calls += _calls[slot];
+    if (!calls)
+        return;
+
+    SYS_LOG("apiprof", APP_LOG_LEVEL_INFO, "apiprofile %lu calls", calls);
+    n = _top(top, true);
+    for (uint8_t i = 0; i < n; i++)
+        SYS_LOG("apiprof", APP_LOG_LEVEL_INFO, "apitime %s %lu calls %lu kcycles",
+                _names[top[i]], _calls[top[i]], (uint32_t)(_cycles[top[i]] / 1000));
+    n = _top(top, false);
+    for (uint8_t i = 0; i < n; i++)
+        SYS_LOG("apiprof", APP_LOG_LEVEL_INFO, "apicalls %s %lu calls %lu kcycles",
+                _names[top[i]], _calls[top[i]], (uint32_t)(_cycles[top[i]] / 1000));
+}
+
+void api_profile_app_reset(void)
+{
+    _dump();
+    memset(_calls, 0, sizeof(_calls));
+    memset(_cycles, 0, sizeof(_cycles));
+    /* the worker may be in a call; ours has none open, or was killed in one */
+    _stacks[appmanager_get_thread_type()].depth = 0;
+    memset(_unimpl_seen, 0, sizeof(_unimpl_seen));
+}
+
+#else
+
+void api_profile_app_reset(void)
+{
+    memset(_unimpl_seen, 0, sizeof(_unimpl_seen));
+}
+
+#endif
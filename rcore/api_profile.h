@@ -0,0 +1,28 @@
+#pragma once
+/* api_profile.h
+ * Which SDK calls apps make, how often, and how long they take
+ * RebbleOS
+ *
+ * Built in with API_PROFILE=1 on the make line. Without it, only the
+ * logging of calls to what we haven't implemented is here
+ */
+
+#include <stdint.h>
+
+/* one past the highest slot in api_func_list.h */
+#define API_SLOTS 632
+
+/* An app called an unimplemented slot. Logged the first time for each,
+ * after that only a count now and then */
+void api_unimplemented(uint16_t slot, const char *name);
+
+/* The app is starting or has finished. Logs its profile, if there is one,
+ * and starts over */
+void api_profile_app_reset(void);
+
+#ifdef API_PROFILE
+/* From the trampolines. Return the address the call should return to */
+uint32_t api_profile_enter(uint32_t slot, uint32_t lr);
+uint32_t api_profile_leave(void);
+void api_profile_return(void);
+#endif
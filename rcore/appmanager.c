@@ -16,6 +16,7 @@
 #include "notification.h"
 #include "api_func_symbols.h"
 #include "qalloc.h"
+#include "watchdog.h"
 
 /* Configure Logging */
 #define MODULE_NAME "appman"
@@ -37,6 +38,21 @@ static StaticTask_t _app_thread_manager_task;
 static void _appmanager_thread_init(void *pvParameters);
 
 static void _running_app_loop(void);
+static bool _heap_share(app_running_thread *thread, ApplicationHeader *header);
+
+/* Check an app's CRC against its header as it's loaded, see
+ * appmanager_load_app. Comment out to load without checking */
+#define APP_CHECK_CRC
+#define APP_LOAD_CHUNK 4096
+
+/* The start of the app the launcher has highlighted, read while the user
+ * is still scrolling. See _appmanager_prefetch. Not CCRAM, flash DMAs
+ * into it */
+#define APP_PREFETCH_SIZE 2048
+static uint8_t _prefetch_buf[APP_PREFETCH_SIZE];
+static uint16_t _prefetch_startpage;
+static uint16_t _prefetch_len;
+static void _appmanager_prefetch(App *app);
 
 /* The manager thread needs only a small stack */
 #define APP_THREAD_MANAGER_STACK_SIZE 450
@@ -46,9 +62,11 @@ static StackType_t _app_thread_manager_stack[APP_THREAD_MANAGER_STACK_SIZE];  //
  * it's tempting to over engineer this and make it a node list
  * or at least add dynamicness to it. But honestly we have 3 threads
  * max at the moment, so if we get there, maybe */
-static uint8_t _heap_app[MEMORY_SIZE_APP_HEAP];
-static CCRAM uint8_t _heap_worker[MEMORY_SIZE_WORKER_HEAP];
-static CCRAM uint8_t _heap_overlay[MEMORY_SIZE_OVERLAY_HEAP];
+/* The app and worker heaps are one pool. The worker has the top of it,
+ * and while no worker wants it the app gets the lot (see _heap_share) */
+#define HEAP_POOL_SIZE (MEMORY_SIZE_APP_HEAP + MEMORY_SIZE_WORKER_HEAP)
+static uint8_t _heap_app[HEAP_POOL_SIZE] __attribute__((aligned(4)));
+static CCRAM uint8_t _heap_overlay[MEMORY_SIZE_OVERLAY_HEAP] __attribute__((aligned(4)));
 
 /* keep these stacks off CCRAM */
 static StackType_t _stack_app[MEMORY_SIZE_APP_STACK];
@@ -71,11 +89,12 @@ static app_running_thread _app_threads[MAX_APP_THREADS] = {
         .thread_type = AppThreadWorker,
         .thread_name = "Worker",
         .heap_size = MEMORY_SIZE_WORKER_HEAP,
-        .heap = _heap_worker,
+        .heap = _heap_app + (MEMORY_SIZE_APP_HEAP),
         .stack_size = MEMORY_SIZE_WORKER_STACK,
         .stack = _stack_worker,
-        /*.thread_entry = &appmanager_worker_main_entry */
-        .thread_priority = 8UL,
+        .thread_entry = &appmanager_worker_main_entry,
+        /* below everything, it only gets what the foreground leaves */
+        .thread_priority = 1UL,
     },
     {
         .thread_type = AppThreadOverlay,
@@ -89,14 +108,49 @@ static app_running_thread _app_threads[MAX_APP_THREADS] = {
 };
 
 
+/*
+ * Split the app/worker pool for a thread about to load. The main app gets
+ * all of it unless its header says it has a worker, or one is running.
+ * header is NULL for apps built into the firmware
+ */
+static bool _heap_share(app_running_thread *thread, ApplicationHeader *header)
+{
+    app_running_thread *app = &_app_threads[AppThreadMainApp];
+    app_running_thread *worker = &_app_threads[AppThreadWorker];
+
+    if (thread == worker)
+    {
+        if (app->status != AppThreadUnloaded && app->heap_size > MEMORY_SIZE_APP_HEAP)
+        {
+            LOG_ERROR("The app has the worker's heap");
+            return false;
+        }
+        return true;
+    }
+    if (thread != app)
+        return true;
+
+    bool has_worker = (header && (header->flags & APP_FLAG_HAS_WORKER)) ||
+                      worker->status != AppThreadUnloaded;
+    app->heap_size = has_worker ? MEMORY_SIZE_APP_HEAP : HEAP_POOL_SIZE;
+    LOG_DEBUG("App heap %d of %d", app->heap_size, HEAP_POOL_SIZE);
+
+    return true;
+}
+
 uint8_t appmanager_init(void)
 {
     appmanager_app_loader_init();
     appmanager_app_runloop_init();
+    appmanager_worker_init();
 
     _app_thread_queue = xQueueCreate(3, sizeof(struct AppMessage));
 
+#ifdef PERF_AUTORUN
+    appmanager_app_start("TestApp");
+#else
     appmanager_app_start("System");
+#endif
     
     _app_thread_manager_task_handle = xTaskCreateStatic(_app_management_thread, 
                                                         "App", 
@@ -243,7 +297,10 @@ static void _app_management_thread(void *parms)
                          * in reality this isn't a big issue. A concern maybe
                          */
                         LOG_INFO("Quitting...");
-                        appmanager_app_quit();
+                        if (_this_thread->thread_type == AppThreadWorker)
+                            appmanager_worker_quit();
+                        else
+                            appmanager_app_quit();
                         xQueueSendToBack(_app_thread_queue, &am, (TickType_t)100);
                         continue;
                     }
@@ -265,7 +322,7 @@ static void _app_management_thread(void *parms)
                     _this_thread->status = AppThreadLoading;
                         
                     /*  TODO reset clicks */
-                    tick_timer_service_unsubscribe();
+                    tick_timer_reset(_this_thread->thread_type);
                     
                     if (app_manager_get_apps_head() == NULL)
                     {
@@ -283,14 +340,26 @@ static void _app_management_thread(void *parms)
                         continue;
                     }
 
+                    if (_this_thread->thread_type == AppThreadWorker &&
+                        (app->is_internal || !app->worker_file.size))
+                    {
+                        LOG_ERROR("App %s has no worker", app_name);
+                        _this_thread->status = AppThreadUnloaded;
+                        continue;
+                    }
+
                     /* We have an app that's at least known. push on with loading it */
                     _this_thread->app = app;
                     _this_thread->timer_head = NULL;
+                    animation_clock_reset(_this_thread->thread_type);
+                    app_timer_reset(_this_thread->thread_type);
+                    resource_app_table_load(_this_thread->thread_type, app->is_internal ? NULL : &app->resource_file);
                     
                     /* At this point the existing task should be gone already
                      * If it isn't we kill it. Lets complain though, becuase it's
                      * broken if we are here */
                     if (_this_thread->task_handle != NULL) {
+                        rcore_watchdog_heartbeat_forget(_this_thread->task_handle);
                         vTaskDelete(_this_thread->task_handle);
                         _this_thread->task_handle = NULL;
                         LOG_ERROR("The previous task was still running. FIXME");
@@ -300,11 +369,22 @@ static void _app_management_thread(void *parms)
                     * and not system, we need to patch it */
                     if (!app->is_internal)
                     {
-                        appmanager_load_app(_this_thread, &header);
+                        if (!appmanager_load_app(_this_thread, &header))
+                        {
+                            _this_thread->app = NULL;
+                            _this_thread->status = AppThreadUnloaded;
+                            continue;
+                        }
                         total_app_size = header.virtual_size;
                     }
                     else
                     {
+                        if (!_heap_share(_this_thread, NULL))
+                        {
+                            _this_thread->app = NULL;
+                            _this_thread->status = AppThreadUnloaded;
+                            continue;
+                        }
                         total_app_size = 0;
                     }
                     
@@ -321,12 +401,19 @@ static void _app_management_thread(void *parms)
                     LOG_DEBUG("App finished cleanly");
                     
                     /* The task will die hard, but it did finish the runloop */
+                    rcore_watchdog_heartbeat_forget(_this_thread->task_handle);
                     vTaskDelete(_this_thread->task_handle);
                     _this_thread->task_handle = NULL;
                     _this_thread->shutdown_at_tick = 0;
                     _this_thread->app = NULL;
                     _this_thread->status = AppThreadUnloaded;
                     break;
+                case THREAD_MANAGER_APP_PREFETCH:
+                    /* scrolling past, or a launch is waiting. don't hold it up */
+                    if (uxQueueMessagesWaiting(_app_thread_queue))
+                        break;
+                    _appmanager_prefetch(appmanager_get_app((char *)am.data));
+                    break;
             }        
         }
         else
@@ -341,6 +428,7 @@ static void _app_management_thread(void *parms)
                 {
                     LOG_ERROR("!! Hard terminating app");
                     
+                    rcore_watchdog_heartbeat_forget(_this_thread->task_handle);
                     vTaskDelete(_this_thread->task_handle);
                     _this_thread->shutdown_at_tick = 0;
                     _this_thread->status = AppThreadUnloaded;
@@ -354,6 +442,100 @@ static void _app_management_thread(void *parms)
 }
 
 
+/*
+ * Read ahead for an app that is probably about to be launched: its
+ * resource table, the first bit of the binary, and the page chain of the
+ * rest, which the load would otherwise walk as it went. On the manager
+ * thread, same as the load, so the two never overlap
+ */
+static void _appmanager_prefetch(App *app)
+{
+    struct fd fd;
+    size_t n;
+    
+    if (!app || app->is_internal || !app->app_file.size)
+        return;
+    
+    resource_app_table_prefetch(&app->resource_file);
+    if (_prefetch_len && _prefetch_startpage == app->app_file.startpage)
+        return;
+    
+    _prefetch_len = 0;
+    fs_open(&fd, &app->app_file);
+    fs_seek(&fd, app->app_file.size - 1, FS_SEEK_SET);
+    fs_seek(&fd, 0, FS_SEEK_SET);
+    n = fs_read(&fd, _prefetch_buf, APP_PREFETCH_SIZE);
+    if (n < sizeof(ApplicationHeader) || strncmp((char *)_prefetch_buf, "PBLAPP", 6))
+        return;
+    
+    _prefetch_startpage = app->app_file.startpage;
+    _prefetch_len = n;
+}
+
+/* A worker is its own binary in the bundle, the rest run the app's */
+static struct file *_thread_file(app_running_thread *thread)
+{
+    if (thread->thread_type == AppThreadWorker)
+        return &thread->app->worker_file;
+    return &thread->app->app_file;
+}
+
+/* Hand what the prefetch read over to the load, if it's the same app and
+ * the header we just read still matches. Returns how much is in place */
+static uint32_t _appmanager_prefetch_take(app_running_thread *thread, ApplicationHeader *header, uint32_t total)
+{
+    uint32_t n = _prefetch_len;
+    
+    if (!n || _prefetch_startpage != _thread_file(thread)->startpage ||
+        memcmp(_prefetch_buf, header, sizeof(ApplicationHeader)))
+        return 0;
+    
+    _prefetch_len = 0;
+    if (n > total)
+        n = total;
+    memcpy(thread->heap, _prefetch_buf, n);
+    return n;
+}
+
+/* Table entries are read as possibly unaligned words; the table starts
+ * right after the binary, wherever that ends */
+typedef struct __attribute__((__packed__)) RelocEntry {
+    uint32_t ofs;
+} RelocEntry;
+
+/*
+ * Add the app's base to each word the table points at. Those hold
+ * offsets from the start of the image, as the SDK links at 0. It's all
+ * checked once up front, so no half relocated image on a bad table.
+ * Words are 4 aligned in every app we've seen; if not, bytewise it is
+ */
+static bool _appmanager_relocate(uint8_t *base, const uint8_t *table, uint32_t count, uint32_t size)
+{
+    const RelocEntry *ent = (const RelocEntry *)table;
+    uint32_t max = 0, align = 0;
+    
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t ofs = ent[i].ofs;
+        if (ofs > max)
+            max = ofs;
+        align |= ofs;
+    }
+    if (size < 4 || max > size - 4)
+        return false;
+    
+    if (align & 3)
+    {
+        for (uint32_t i = 0; i < count; i++)
+            write_32(base + ent[i].ofs, read_32(base + ent[i].ofs) + (int32_t)base);
+        return true;
+    }
+    
+    for (uint32_t i = 0; i < count; i++)
+        *(uint32_t *)(base + ent[i].ofs) += (uint32_t)base;
+    return true;
+}
+
 /*
     Heres what is going down. We are going to load the app from flash.
     The app is stored in flash and is a butchered ELF position independant
@@ -417,20 +599,73 @@ static void _app_management_thread(void *parms)
     * fork
         
     */
-void appmanager_load_app(app_running_thread *thread, ApplicationHeader *header)
+bool appmanager_load_app(app_running_thread *thread, ApplicationHeader *header)
 {   
     struct fd fd;
     
-    /* de-fluff */
-    memset(thread->heap, 0, thread->heap_size);
+    fs_open(&fd, _thread_file(thread));
+    if (fs_read(&fd, header, sizeof(ApplicationHeader)) != sizeof(ApplicationHeader))
+        return false;
 
-    fs_open(&fd, &thread->app->app_file);
-    fs_read(&fd, header, sizeof(ApplicationHeader));
+    /* sanity check the hell out of this to make sure it's a real app */
+    if (strncmp(header->header, "PBLAPP", 6))
+    {
+        KERN_LOG("app", APP_LOG_LEVEL_ERROR, "No PBLAPP header!");
+        return false;
+    }
+
+    if (!_heap_share(thread, header))
+        return false;
+
+    /* the reloc table is loaded over bss, but might run past it */
+    uint32_t need = header->app_size + header->reloc_entries_count * 4;
+    if (need < header->virtual_size)
+        need = header->virtual_size;
+    if (need > thread->heap_size)
+    {
+        LOG_ERROR("App needs %d bytes, there are %d", need, thread->heap_size);
+        return false;
+    }
 
     /* load the app from flash
      *  and any reloc entries too. */
-    fs_seek(&fd, 0, FS_SEEK_SET);
-    fs_read(&fd, thread->heap, header->app_size + (header->reloc_entries_count * 4));
+    uint32_t total = header->app_size + (header->reloc_entries_count * 4);
+    uint32_t staged = _appmanager_prefetch_take(thread, header, total);
+    fs_seek(&fd, staged, FS_SEEK_SET);
+#ifdef APP_CHECK_CRC
+    /* The CRC covers the binary after the header. Each chunk is fed in
+     * as it lands, and the unit gets on with it while we read the next */
+    uint32_t done = 0;
+
+    rcore_crc_begin();
+    while (done < total)
+    {
+        uint32_t n = total - done < APP_LOAD_CHUNK ? total - done : APP_LOAD_CHUNK;
+        if (staged)
+        {
+            /* already there, courtesy of the prefetch */
+            n = staged;
+            staged = 0;
+        }
+        else if (!(n = fs_read(&fd, thread->heap + done, n)))
+            break;
+
+        uint32_t from = done < sizeof(ApplicationHeader) ? sizeof(ApplicationHeader) : done;
+        uint32_t to = done + n < header->app_size ? done + n : header->app_size;
+        if (to > from)
+            rcore_crc_feed(thread->heap + from, to - from);
+        done += n;
+    }
+
+    uint32_t crc = rcore_crc_end();
+    if (done != total || crc != header->crc)
+    {
+        LOG_ERROR("App CRC 0x%x, header has 0x%x", crc, header->crc);
+        return false;
+    }
+#else
+    fs_read(&fd, thread->heap + staged, total - staged);
+#endif
     
     /* apps get loaded into heap like so
      * [App Header | App Binary | App Heap | App Stack]
@@ -453,31 +688,20 @@ void appmanager_load_app(app_running_thread *thread, ApplicationHeader *header)
      * To make it all work we:
      * address with relative offset = address of app bin + relative offset
      */    
-    if (header->reloc_entries_count > 0)
-    {                
-        /* go through all of the reloc entries and do the reloc dance */
-        for (uint32_t i = 0; i < header->reloc_entries_count; i++)
-        {
-            uint32_t reloc_idx = i * 4;
-            /* get the offset from app base to the register to relocate */
-            uint32_t reg_to_reloc = read_32(&reloc_table_addr[reloc_idx]);          
-            assert(reg_to_reloc < header->virtual_size && "Reloc entry beyond app bounds");
-            
-            /* Get the value from the register we are relocating.
-             * This will contain the offset from the app base to the data */
-            uint32_t rel_off = read_32(thread->heap + reg_to_reloc);
-            
-            /* Add the app base absolute memory register address to the offset
-             * Write this absolute value back into the register to relocate */
-            write_32(thread->heap + reg_to_reloc, (uint32_t)((uintptr_t)(thread->heap + rel_off)));
-        }
+    if (header->reloc_entries_count > 0 &&
+        !_appmanager_relocate(thread->heap, reloc_table_addr, header->reloc_entries_count, header->virtual_size))
+    {
+        LOG_ERROR("Reloc entry beyond app bounds");
+        return false;
     }
     
-    /* init bss to 0. We already zeros all of the heap, so only reset the reloc table */
+    /* init bss to 0, reloc table and all. The rest of the heap is the
+     * app's arena, which hands memory out zeroed anyway */
     uint32_t bss_size = header->virtual_size - header->app_size;
     
-    memset(thread->heap + header->app_size, 0, header->reloc_entries_count * 4);
-    memset(thread->stack, 0, thread->stack_size * 4);
+    memset(thread->heap + header->app_size, 0, bss_size);
+    /* The stack is left alone. xTaskCreateStatic paints it for the
+     * overflow check (configCHECK_FOR_STACK_OVERFLOW 2) anyway */
     
     /* load the address of our lookup table into the 
      * special register in the app. */
@@ -486,7 +710,11 @@ void appmanager_load_app(app_running_thread *thread, ApplicationHeader *header)
     assert(read_32(&thread->heap[header->sym_table_addr]) == (int32_t)sym && "PLT rewrite failed");
      
     /* Patch the app's entry point... make sure its THUMB bit set! */
-    thread->app->main = (AppMainHandler)((uint32_t)&thread->heap[header->offset] | 1);
+    AppMainHandler entry = (AppMainHandler)((uint32_t)&thread->heap[header->offset] | 1);
+    if (thread->thread_type == AppThreadWorker)
+        thread->app->worker_main = entry;
+    else
+        thread->app->main = entry;
     
     LOG_DEBUG("== App signature ==");
     LOG_DEBUG("Header  : %s",    header->header);
@@ -507,6 +735,8 @@ void appmanager_load_app(app_running_thread *thread, ApplicationHeader *header)
     LOG_DEBUG("VSize   : 0x%x",  header->virtual_size);
     LOG_DEBUG("Bss Size: %d",    bss_size);
     LOG_DEBUG("Heap    : 0x%x",  thread->heap + header->virtual_size);
+
+    return true;
 }
 
 /* 
@@ -528,6 +758,9 @@ void appmanager_execute_app(app_running_thread *thread, uint32_t total_app_size)
     
     /* heap is all uint8_t */
     thread->arena = qinit(heap_entry, heap_size);
+    thread->pools = NULL;
+    thread->persist = NULL;
+    app_message_app_reset(thread);
     
     /* Load the app in a vTask */
     xTaskCreateStatic(_appmanager_thread_init, 
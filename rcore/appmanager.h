@@ -24,7 +24,10 @@ typedef struct CoreTimer
 {
     TickType_t when; /* ticks when this should fire, in ticks since boot */
     void (*callback)(struct CoreTimer *); /* always called back on the app thread */
-    struct CoreTimer *next;
+    /* the thread's timers are a pairing heap. Owned by appmanager_app_timer.c */
+    struct CoreTimer *next;  /* next sibling */
+    struct CoreTimer *child; /* first child, due no earlier than us */
+    struct CoreTimer *prev;  /* parent if we are its first child, else the sibling before */
 } CoreTimer;
 
 typedef struct AppMessage
@@ -95,9 +98,13 @@ typedef struct App {
     bool is_internal; // is the app baked into flash
     struct file app_file;
     struct file resource_file; // the file where we are keeping the resources for this app
+    struct file worker_file; // the background worker's binary, size 0 if it has none
+    uint32_t id; // appdb's application_id, that its files are named after
+    uint32_t icon; // appdb's icon resource id, 0 for none
     char *name;
     ApplicationHeader *header;
     AppMainHandler main; // A shortcut to main
+    AppMainHandler worker_main; // and the worker's, once loaded
     list_node node; 
 } App;
 
@@ -113,6 +120,21 @@ typedef struct AppTypeHeader {
 #define APP_QUIT         1
 #define APP_TICK         2
 #define APP_DRAW         3
+#define APP_DISPLAY_DONE 4
+#define APP_WORKER_MESSAGE 5
+#define APP_SERVICE_EVENT  6
+
+/* what an APP_SERVICE_EVENT has waiting, see appmanager_post_service_event */
+#define APP_SERVICE_BATTERY    1
+#define APP_SERVICE_CONNECTION 2
+#define APP_SERVICE_APP_MESSAGE 4
+#define APP_SERVICE_ACCEL      8
+#define APP_SERVICE_ACCEL_TAP  16
+#define APP_SERVICE_SMARTSTRAP 32
+#define APP_SERVICE_UNOBSTRUCTED 64
+
+/* ApplicationHeader flags, as PebbleProcessInfoFlags */
+#define APP_FLAG_HAS_WORKER (1 << 4)
 
 #define APP_TYPE_SYSTEM  0
 #define APP_TYPE_FACE    1
@@ -145,6 +167,7 @@ typedef enum AppThreadType {
 
 #define THREAD_MANAGER_APP_LOAD       0
 #define THREAD_MANAGER_APP_QUIT_CLEAN 1
+#define THREAD_MANAGER_APP_PREFETCH   2
 
 /* This struct hold all information about the task that is executing
  * There are many runing apps, such as main app, worker or background.
@@ -163,8 +186,11 @@ typedef struct app_running_thread_t {
     size_t heap_size;
     StackType_t *stack;
     uint8_t *heap;
-    struct CoreTimer *timer_head;
+    struct CoreTimer *timer_head; /* root of the timer heap, soonest due */
     qarena_t *arena;
+    struct AppPools *pools;
+    struct PersistStore *persist;
+    struct AppMessageState *app_message;
     struct n_GContext *graphics_context;
 } app_running_thread;
 
@@ -180,7 +206,7 @@ bool appmanager_is_thread_system(void);
 bool appmanager_is_thread_worker(void);
 bool appmanager_is_thread_app(void);
 bool appmanager_is_thread_overlay(void);
-void appmanager_load_app(app_running_thread *thread, ApplicationHeader *header);
+bool appmanager_load_app(app_running_thread *thread, ApplicationHeader *header);
 void appmanager_execute_app(app_running_thread *thread, uint32_t total_app_size);
 app_running_thread *appmanager_get_thread(AppThreadType type);
 AppThreadType appmanager_get_thread_type(void);
@@ -191,9 +217,12 @@ void appmanager_app_main_entry(void);
 list_head *app_manager_get_apps_head();
 void appmanager_post_button_message(ButtonMessage *bmessage);
 void appmanager_post_draw_message(uint8_t force);
+void appmanager_app_draw_request(uint8_t force);
+void appmanager_post_service_event(uint8_t events);
 void appmanager_post_draw_display_message(uint8_t *draw_to_display);
 
 void appmanager_app_start(char *name);
+void appmanager_app_prefetch(char *name);
 void appmanager_app_quit(void);
 void appmanager_app_display_done(void);
 bool appmanager_is_app_shutting_down(void);
@@ -201,6 +230,13 @@ bool appmanager_is_app_shutting_down(void);
 void appmanager_post_generic_app_message(AppMessage *am, TickType_t timeout);
 void appmanager_timer_expired(app_running_thread *thread);
 TickType_t appmanager_timer_get_next_expiry(app_running_thread *thread);
+/* in appmanager_worker.c */
+void appmanager_worker_init(void);
+void appmanager_worker_main_entry(void);
+void appmanager_worker_quit(void);
+void appmanager_worker_app_deliver(void);
+void appmanager_worker_app_reset(void);
+
 /* in appmanager_app.c */
 App *appmanager_get_app(char *app_name);
 void appmanager_app_loader_init(void);
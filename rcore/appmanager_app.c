@@ -103,10 +103,29 @@ static App *_appmanager_create_app(char *name, uint8_t type, void *entry_point,
 }
 
 
+/* appdb entries read at a time */
+#define APPDB_BATCH 8
+
+/* appdb has the odd app in it more than once. They find the same file */
+static bool _appmanager_is_in_manifest(const struct file *app_file)
+{
+    App *app;
+
+    list_foreach(app, &_app_manifest_head, App, node)
+    {
+        if (!app->is_internal && app->app_file.startpage == app_file->startpage)
+            return true;
+    }
+
+    return false;
+}
+
 /*
  * Load the list of apps and faces from flash
  * The app manifest is a list of all known applications we found in flash
  * We load all entries from `appdb` file.
+ * Everything we list an app by is in appdb, so the app itself isn't
+ * opened until it's run. appmanager_load_app checks it's really an app.
  * TODO: appdb seems to have duplicates (in my case), maybe we should use `pmap`, but it was missing some entries for me
  */
 static void _appmanager_flash_load_app_manifest(void)
@@ -119,76 +138,84 @@ static void _appmanager_flash_load_app_manifest(void)
         return;
     }
 
-    char buffer[14];
-    struct appdb appdb;
+    char buffer[17];
+    char name[MAX_APP_STR_LEN + 1];
+    struct appdb *batch;
     struct fd fd;
     struct file app_file;
     struct file res_file;
-    struct fd app_fd;
-    ApplicationHeader header;
+    int count = file.size / sizeof(struct appdb);
+    int n = 0;
+
+    batch = calloc(APPDB_BATCH, sizeof(struct appdb));
+    if (batch == NULL)
+        return;
 
     fs_open(&fd, &file);
 
     /* skipping 8 bytes for appdb file header */
     fs_seek(&fd, 8, FS_SEEK_SET);
-    for (int i = 0; i < file.size / sizeof(struct appdb); ++i) {
-        if (fs_read(&fd, &appdb, sizeof(appdb)) != sizeof(appdb))
+    for (int i = 0; i < count; ++i) {
+        if (i % APPDB_BATCH == 0) {
+            n = count - i < APPDB_BATCH ? count - i : APPDB_BATCH;
+            n = fs_read(&fd, batch, n * sizeof(struct appdb)) / sizeof(struct appdb);
+        }
+        if (i % APPDB_BATCH >= n)
             break;
 
-        if (APPDB_IS_EOF(appdb))
+        struct appdb *appdb = &batch[i % APPDB_BATCH];
+
+        if (APPDB_IS_EOF(*appdb))
             break;
 
-        if (appdb.dbflags & APPDB_DBFLAGS_WRITTEN) {
+        if (appdb->dbflags & APPDB_DBFLAGS_WRITTEN) {
             KERN_LOG("app", APP_LOG_LEVEL_WARNING, "appdb: file that is not written before eof, at index %d", i);
             continue;
         }
         
-        if ((appdb.dbflags & APPDB_DBFLAGS_DEAD) == 0)
+        if ((appdb->dbflags & APPDB_DBFLAGS_DEAD) == 0)
             continue;
         
-        if ((appdb.dbflags & APPDB_DBFLAGS_OVERWRITING) == 0)
-            KERN_LOG("app", APP_LOG_LEVEL_WARNING, "appdb: file %08x is mid-overwrite; I feel nervous", appdb.application_id);
+        if ((appdb->dbflags & APPDB_DBFLAGS_OVERWRITING) == 0)
+            KERN_LOG("app", APP_LOG_LEVEL_WARNING, "appdb: file %08x is mid-overwrite; I feel nervous", appdb->application_id);
 
-        if (appdb.application_id == 0xFFFFFFFFu) {
+        if (appdb->application_id == 0xFFFFFFFFu) {
             KERN_LOG("app", APP_LOG_LEVEL_WARNING, "appdb: file is written, but has no contents?");
             break;
         }
         
-        snprintf(buffer, 14, "@%08lx/app", appdb.application_id);
+        snprintf(buffer, 14, "@%08lx/app", appdb->application_id);
         if (fs_find_file(&app_file, buffer) < 0)
             continue;
 
-        snprintf(buffer, 14, "@%08lx/res", appdb.application_id);
-        if (fs_find_file(&res_file, buffer) < 0)
+        if (_appmanager_is_in_manifest(&app_file))
             continue;
 
-        fs_open(&app_fd, &app_file);
-
-        if (fs_read(&app_fd, &header, sizeof(ApplicationHeader)) != sizeof(ApplicationHeader))
-            break;
-       
-        /* sanity check the hell out of this to make sure it's a real app */
-        if (strncmp(header.header, "PBLAPP", 6))
-        {
-            KERN_LOG("app", APP_LOG_LEVEL_ERROR, "No PBLAPP header!");
+        snprintf(buffer, 14, "@%08lx/res", appdb->application_id);
+        if (fs_find_file(&res_file, buffer) < 0)
             continue;
-        }
-        
+
+        memcpy(name, appdb->app_name, MAX_APP_STR_LEN);
+        name[MAX_APP_STR_LEN] = 0;
         
-        /* it's real... so far. Lets crc check to make sure
-            * TODO
-            * crc32....(header.header)
-            */
-        KERN_LOG("app", APP_LOG_LEVEL_INFO, "appdb: app \"%s\" found, flags %08x, icon %08x", header.name, appdb.flags, appdb.icon);
+        KERN_LOG("app", APP_LOG_LEVEL_INFO, "appdb: app \"%s\" found, flags %08x, icon %08x", name, appdb->flags, appdb->icon);
 
         /* main gets set later */
-        _appmanager_add_to_manifest(_appmanager_create_app(header.name,
-                                                            APP_TYPE_FACE,
-                                                            NULL,
-                                                            false,
-                                                            &app_file,
-                                                            &res_file));
+        App *app = _appmanager_create_app(name, APP_TYPE_FACE, NULL, false, &app_file, &res_file);
+        if (app == NULL)
+            break;
+        app->id = appdb->application_id;
+        app->icon = appdb->icon;
+
+        /* not many have one */
+        snprintf(buffer, sizeof(buffer), "@%08lx/worker", appdb->application_id);
+        if (fs_find_file(&app->worker_file, buffer) < 0)
+            memset(&app->worker_file, 0, sizeof(struct file));
+
+        _appmanager_add_to_manifest(app);
     }
+
+    free(batch);
 }
 
 /* 
@@ -23,6 +23,21 @@ void appmanager_app_start(char *name)
     appmanager_post_generic_thread_message(&am, 100);
 }
 
+/*
+ * Hint that an app is likely to be started soon, so the manager can
+ * read the start of it in the meantime. Never waits; if the manager is
+ * busy the hint is dropped
+ */
+void appmanager_app_prefetch(char *name)
+{
+    AppMessage am = (AppMessage) {
+        .command = THREAD_MANAGER_APP_PREFETCH,
+        .thread_id = AppThreadMainApp,
+        .data = name
+    };
+    appmanager_post_generic_thread_message(&am, 0);
+}
+
 void appmanager_app_quit(void)
 {
     AppMessage am = (AppMessage) {
@@ -47,11 +62,6 @@ void appmanager_post_draw_message(uint8_t force)
     if (_thread->status != AppThreadRunloop)
         return;
 
-    AppMessage am = (AppMessage) {
-        .command = APP_DRAW,
-        .data = (void*)(uint32_t)force
-    };
-
     Window *wind = window_stack_get_top_window();
     Window *owind = overlay_window_stack_get_top_window();
 
@@ -59,7 +69,7 @@ void appmanager_post_draw_message(uint8_t force)
             ((wind && wind->is_render_scheduled) ||
              (owind && owind->is_render_scheduled)))
     {
-        appmanager_post_generic_app_message(&am, 0);
+        appmanager_app_draw_request(force);
     }
 }
 
@@ -12,6 +12,17 @@
 #include "notification_manager.h"
 #include "timers.h"
 #include "ngfxwrap.h"
+#include "gpath_cache.h"
+#include "pdc_cache.h"
+#include "persist.h"
+#include "utils.h"
+#include "watchdog.h"
+#include "api_profile.h"
+#include "battery_state_service.h"
+#include "input_latency.h"
+#include "cpu_stats.h"
+#include "power.h"
+#include "stm32_power.h"
 
 /* Configure Logging */
 #define MODULE_NAME "apploop"
@@ -24,11 +35,116 @@ void app_select_single_click_handler(ClickRecognizerRef recognizer, void *contex
 void app_back_single_click_handler(ClickRecognizerRef recognizer, void *context);
 bool booted = false;
 
+/* Buttons, quits and frame completions. Draws only ever take one slot */
+#define APP_MESSAGE_QUEUE_LENGTH 8
+
 static xQueueHandle _app_message_queue;
+static StaticQueue_t _app_message_queue_buf;
+static uint8_t _app_message_queue_contents[APP_MESSAGE_QUEUE_LENGTH * sizeof(AppMessage)];
+
+/* Draw requests don't queue up. They set these, and only the first posts
+ * an APP_DRAW to wake the loop (see appmanager_app_draw_request). The
+ * loop takes them all in one go, so a burst of timers and animation
+ * steps costs one draw and one slot, and buttons don't get dropped */
+#define DRAW_REQUEST_PENDING 1
+#define DRAW_REQUEST_FORCE   2
+static volatile uint8_t _draw_request;
+
+/* The same for event services the app may be subscribed to. A charger
+ * that bounces, or a flapping link, costs one slot and one call */
+static volatile uint8_t _service_events;
+
+/* A frame of ours is still going out to the display. Draws that come in
+ * meanwhile are held until it is done, as the framebuffer is being read */
+static bool _frame_in_flight;
+static bool _draw_pending;
+static uint8_t _draw_pending_force;
+
+/* The frame governor. An app gets a frame at most this often; draws it
+ * asks for sooner are held for the rest of the interval, and go as one.
+ * While saving power (see power.h) it gets fewer */
+#define APP_FRAME_MS 33
+#define APP_FRAME_MS_SAVING 100
+/* A frame taking longer than this to render is over budget. This many of
+ * those in a row and the app gets named in the log */
+#define APP_FRAME_BUDGET_MS 20
+#define APP_FRAME_OVER_WARN 16
+
+static TickType_t _frame_tick; /* when the last frame went */
+static bool _frame_held;
+static uint16_t _frame_over;
+
+/* How long until the app may have another frame. 0 is now */
+static TickType_t _frame_wait(void)
+{
+    TickType_t interval = pdMS_TO_TICKS(power_is_saving() ? APP_FRAME_MS_SAVING : APP_FRAME_MS);
+    TickType_t since = xTaskGetTickCount() - _frame_tick;
+    return since >= interval ? 0 : interval - since;
+}
+
+/* How long a draw waits for the display lock before it gives up and asks
+ * again. Waiting, rather than only trying, is what lends our priority to
+ * whoever holds it, so they finish sooner */
+#define APP_DRAW_LOCK_DEADLINE pdMS_TO_TICKS(20)
+
+/* Busy this long without getting back to the queue and the app has hung.
+ * The watchdog is let go, and takes the watch down */
+#define APP_STALL_MS 10000
+
+/* Keep the last frame a watchface drew when it quits, and put it straight
+ * back up when the same face starts again. Something is on screen the
+ * moment we return, rather than once the face has built its windows and
+ * drawn. Costs a framebuffer worth of main SRAM. Comment out to save it */
+#define APP_FACE_SNAPSHOT
+/* older than this and the face likely shows something else by now */
+#define APP_FACE_SNAPSHOT_MAX_AGE pdMS_TO_TICKS(60 * 1000)
+
+#ifdef APP_FACE_SNAPSHOT
+static uint8_t _face_snapshot[MAX_FRAMEBUFFER_SIZE];
+static App *_face_snapshot_app;
+static TickType_t _face_snapshot_tick;
+
+static void _face_snapshot_take(App *app)
+{
+    _face_snapshot_app = NULL;
+    /* the overlay isn't the face's to keep */
+    if (app->type != APP_TYPE_FACE || overlay_window_count() > 0)
+        return;
+    
+    if (!display_buffer_lock_take(pdMS_TO_TICKS(100)))
+        return;
+    memcpy(_face_snapshot, display_get_buffer(), MAX_FRAMEBUFFER_SIZE);
+    display_buffer_lock_give();
+    
+    _face_snapshot_app = app;
+    _face_snapshot_tick = xTaskGetTickCount();
+}
+
+static void _face_snapshot_show(App *app)
+{
+    if (app != _face_snapshot_app)
+        return;
+    _face_snapshot_app = NULL;
+    
+    if (xTaskGetTickCount() - _face_snapshot_tick > APP_FACE_SNAPSHOT_MAX_AGE)
+        return;
+    
+    if (!display_buffer_lock_take(pdMS_TO_TICKS(100)))
+        return;
+    /* the last app's final frame may still be going out of this buffer */
+    while (display_is_busy())
+        vTaskDelay(1);
+    memcpy(display_get_buffer(), _face_snapshot, MAX_FRAMEBUFFER_SIZE);
+    display_draw();
+    display_buffer_lock_give();
+}
+#endif
 
 void appmanager_app_runloop_init(void)
 {
-    _app_message_queue = xQueueCreate(5, sizeof(struct AppMessage));
+    _app_message_queue = xQueueCreateStatic(APP_MESSAGE_QUEUE_LENGTH, sizeof(AppMessage),
+                                            _app_message_queue_contents, &_app_message_queue_buf);
+    app_message_init();
     timer_init();
 }
 
@@ -58,15 +174,40 @@ void appmanager_app_main_entry(void)
      * font cache does some free business on old pointers, corrupting the
      * heap before we even had a fighting chance!  */
     fonts_resetcache();
+    gpath_cache_reset();
+    pdc_cache_reset();
+    resource_bitmap_cache_reset();
     connection_service_unsubscribe();
+    accel_data_service_unsubscribe();
+    accel_tap_service_unsubscribe();
+    smartstrap_app_reset();
+    unobstructed_area_app_reset();
+    window_app_reset();
+    api_profile_app_reset();
+    appmanager_worker_app_reset();
 
     n_GContext *context = rwatch_neographics_get_global_context();
     /* not a memory leak. Context was erased on app load */
     rwatch_neographics_init(_this_thread);
     
+    persist_app_open(_this_thread);
+    
+#ifdef APP_FACE_SNAPSHOT
+    _face_snapshot_show(_this_thread->app);
+#endif
+    
     /* Call into the apps main runtime */
     _this_thread->app->main();
     _this_thread->status = AppThreadUnloading;
+    persist_app_close(_this_thread);
+    app_message_app_reset(_this_thread);
+    smartstrap_app_reset();
+    unobstructed_area_app_reset();
+    window_app_reset();
+    api_profile_app_reset();
+#ifdef APP_FACE_SNAPSHOT
+    _face_snapshot_take(_this_thread->app);
+#endif
     
     AppMessage am = {
         .thread_id = _this_thread->thread_type,
@@ -86,33 +227,204 @@ bool appmanager_is_app_shutting_down(void)
     return _this_thread->status == AppThreadUnloading;
 }
 
-void rocky_event_loop_with_resource(uint16_t resource_id)
+/* Runs in the display ISR */
+static void _frame_done_isr(void *context)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    AppMessage am = {
+        .command = APP_DISPLAY_DONE,
+    };
+    
+    /* if the queue is full, _draw notices the display went idle */
+    xQueueSendToBackFromISR(_app_message_queue, &am, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void _draw(uint8_t force_draw);
+
+/* Note a frame against the app, and name it if it keeps going over */
+static void _frame_account(uint32_t cycles)
+{
+    App *app = appmanager_get_current_thread()->app;
+    uint32_t us = cycles / hw_cycles_per_us();
+    bool over = us > APP_FRAME_BUDGET_MS * 1000;
+    
+    cpu_stats_app_frame(app->name, us, over, _frame_held);
+    _frame_held = false;
+    
+    if (!over)
+    {
+        _frame_over = 0;
+        return;
+    }
+    if (++_frame_over == APP_FRAME_OVER_WARN)
+        LOG_WARN("%s is over its %d ms render budget, last frame %lu ms", app->name,
+                 APP_FRAME_BUDGET_MS, us / 1000);
+}
+
+static void _frame_done(void)
 {
-    app_event_loop();
+    _frame_in_flight = false;
+    if (!_draw_pending)
+        return;
+    
+    _draw_pending = false;
+    _draw(_draw_pending_force);
 }
 
 static void _draw(uint8_t force_draw)
 {
+    if (_frame_in_flight && !display_is_busy())
+        _frame_in_flight = false;
+    
+    if (_frame_in_flight)
+    {
+        _draw_pending = true;
+        _draw_pending_force |= force_draw;
+        return;
+    }
+    _draw_pending_force = 0;
+    
+    /* Too soon. It stays asked for without taking a queue slot, and the
+     * loop wakes for it once the interval is up */
+    if (_frame_wait())
+    {
+        taskENTER_CRITICAL();
+        _draw_request |= DRAW_REQUEST_PENDING | (force_draw ? DRAW_REQUEST_FORCE : 0);
+        taskEXIT_CRITICAL();
+        _frame_held = true;
+        return;
+    }
+    
     /* Request a draw. This is mostly from an app invalidating something */
-    if (display_buffer_lock_take(0))
+    FRAME_PROFILE_START(t_lock);
+    if (!display_buffer_lock_take(APP_DRAW_LOCK_DEADLINE))
     {
-        if (force_draw)
-            window_dirty(true);
-        
-        bool force = window_draw();
-        
-        if (overlay_window_count() > 0)
-        {
-            overlay_window_draw(true);
-            force = true;
-        }
-        
-        if (force)
-        {
-            display_draw();
-        }
-        display_buffer_lock_give();
+        /* not dropped, it goes round again */
+        LOG_DEBUG("Display lock deadline missed");
+        appmanager_app_draw_request(force_draw);
+        return;
+    }
+    
+    if (force_draw)
+        window_dirty(true);
+    
+    /* render at full speed; the frame goes out over SPI, which doesn't care */
+    stm32_power_cpu_request();
+    uint32_t t_render = hw_cycle_count();
+    GRect damage = GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+    frame_profile_frame_begin();
+    FRAME_PROFILE_STOP(FrameProfileLockWait, t_lock);
+    overlay_window_app_draw_begin();
+    FRAME_PROFILE_START(t_window);
+    bool force = window_draw(&damage);
+    FRAME_PROFILE_STOP(FrameProfileWindowDraw, t_window);
+    
+    if (overlay_window_count() > 0)
+    {
+        overlay_window_app_draw_end();
+        FRAME_PROFILE_START(t_overlay);
+        overlay_window_draw(true);
+        FRAME_PROFILE_STOP(FrameProfileOverlayDraw, t_overlay);
+        force = true;
+        damage = rect_union(damage, overlay_window_get_drawn_rect());
+    }
+    
+    _frame_account(hw_cycle_count() - t_render);
+    stm32_power_cpu_release();
+    
+    if (force)
+    {
+        _frame_tick = xTaskGetTickCount();
+        if (display_draw_async(damage, _frame_done_isr, NULL))
+            _frame_in_flight = true;
+        else
+            /* someone else's frame is still going out. Wait for it */
+            display_draw_region(damage);
+    }
+    display_buffer_lock_give();
+}
+
+/*
+ * Ask the app to draw. Any thread. If the wake-up can't be posted the
+ * loop still finds the request, next time it comes round
+ */
+void appmanager_app_draw_request(uint8_t force)
+{
+    AppMessage am = {
+        .command = APP_DRAW,
+    };
+    uint8_t was;
+    
+    taskENTER_CRITICAL();
+    was = _draw_request;
+    _draw_request |= DRAW_REQUEST_PENDING | (force ? DRAW_REQUEST_FORCE : 0);
+    taskEXIT_CRITICAL();
+    
+    if (!(was & DRAW_REQUEST_PENDING))
+        xQueueSendToBack(_app_message_queue, &am, 0);
+}
+
+/*
+ * Tell the app an event service has something for it. Any thread. The
+ * handlers run on the app's own loop, with the state as of then
+ */
+void appmanager_post_service_event(uint8_t events)
+{
+    AppMessage am = {
+        .command = APP_SERVICE_EVENT,
+    };
+    uint8_t was;
+    
+    taskENTER_CRITICAL();
+    was = _service_events;
+    _service_events |= events;
+    taskEXIT_CRITICAL();
+    
+    if (!was)
+        xQueueSendToBack(_app_message_queue, &am, 0);
+}
+
+static void _service_event(void)
+{
+    uint8_t events;
+    
+    taskENTER_CRITICAL();
+    events = _service_events;
+    _service_events = 0;
+    taskEXIT_CRITICAL();
+    
+    if (events & APP_SERVICE_BATTERY)
+    {
+        /* power saving may have come or gone, which changes the ticks */
+        tick_timer_resync();
+        battery_state_service_deliver();
     }
+    if (events & APP_SERVICE_CONNECTION)
+        connection_service_deliver();
+    if (events & APP_SERVICE_APP_MESSAGE)
+        app_message_deliver();
+    if (events & APP_SERVICE_ACCEL)
+        accel_service_deliver();
+    if (events & APP_SERVICE_ACCEL_TAP)
+        accel_tap_service_deliver();
+    if (events & APP_SERVICE_SMARTSTRAP)
+        smartstrap_deliver();
+    if (events & APP_SERVICE_UNOBSTRUCTED)
+        unobstructed_area_deliver();
+}
+
+static void _draw_service(void)
+{
+    uint8_t req;
+    
+    taskENTER_CRITICAL();
+    req = _draw_request;
+    _draw_request = 0;
+    taskEXIT_CRITICAL();
+    
+    if (req & DRAW_REQUEST_PENDING)
+        _draw(req & DRAW_REQUEST_FORCE ? 1 : 0);
 }
 
 /*
@@ -158,6 +470,13 @@ void app_event_loop(void)
     /* clear the queue of any work from the previous app
     * ... such as an errant quit */
     xQueueReset(_app_message_queue);
+    _frame_in_flight = false;
+    _draw_pending = false;
+    _draw_request = 0;
+    _service_events = 0;
+    _frame_tick = xTaskGetTickCount() - pdMS_TO_TICKS(APP_FRAME_MS_SAVING);
+    _frame_held = false;
+    _frame_over = 0;
 
     if (!booted)
     {
@@ -168,6 +487,7 @@ void app_event_loop(void)
     }
 
     TickType_t next_timer;
+    uint8_t heartbeat = rcore_watchdog_heartbeat_register(APP_STALL_MS);
     _this_thread->status = AppThreadRunloop;
 
     next_timer = portMAX_DELAY;
@@ -185,8 +505,23 @@ void app_event_loop(void)
         if (next_timer < 0)
             next_timer = portMAX_DELAY;
 
+        /* whatever asked for a draw since last time, ahead of the queue */
+        if (!appmanager_is_app_shutting_down())
+            _draw_service();
+        
+        /* a draw the governor held back. Come round for it in time */
+        if (_draw_request & DRAW_REQUEST_PENDING)
+        {
+            TickType_t wait = _frame_wait();
+            if (wait < next_timer)
+                next_timer = wait;
+        }
+
         /* we are inside the apps main loop event handler now */
-        if (xQueueReceive(_app_message_queue, &data, next_timer))
+        rcore_watchdog_heartbeat_idle(heartbeat);
+        BaseType_t got = xQueueReceive(_app_message_queue, &data, next_timer);
+        rcore_watchdog_heartbeat_busy(heartbeat);
+        if (got)
         {
 
             /* We woke up for some kind of event that someone posted.  But what? */
@@ -202,7 +537,9 @@ void app_event_loop(void)
                 }
                 /* execute the button's callback */
                 ButtonMessage *message = (ButtonMessage *)data.data;
+                input_latency_hop(InputHopHandler);
                 ((ClickHandler)(message->callback))((ClickRecognizerRef)(message->clickref), message->context);
+                input_latency_hop(InputHopHandled);
             }
             /* Someone has requested the application close.
              * We will attempt graceful shutdown by unsubscribing timers
@@ -242,7 +579,31 @@ void app_event_loop(void)
                 if (appmanager_is_app_shutting_down())
                     continue;
 
-                _draw((uint32_t)data.data);
+                _draw_service();
+            }
+            /* Our last frame is out, so any draw held back can go */
+            else if (data.command == APP_DISPLAY_DONE)
+            {
+                if (appmanager_is_app_shutting_down())
+                    continue;
+
+                _frame_done();
+            }
+            /* Something from the worker is waiting for us */
+            else if (data.command == APP_WORKER_MESSAGE)
+            {
+                if (appmanager_is_app_shutting_down())
+                    continue;
+
+                appmanager_worker_app_deliver();
+            }
+            /* The battery or the connection changed */
+            else if (data.command == APP_SERVICE_EVENT)
+            {
+                if (appmanager_is_app_shutting_down())
+                    continue;
+
+                _service_event();
             }
         } else {
             if (appmanager_is_app_shutting_down())
@@ -250,6 +611,7 @@ void app_event_loop(void)
         }
         vTaskDelay(0);
     }
+    rcore_watchdog_heartbeat_forget(xTaskGetCurrentTaskHandle());
     LOG_INFO("App Signalled shutdown...");
     /* We fall out of the apps main_ now and into deinit and thread completion
      * We will hand back control to appmanager_app_main_entry above */
@@ -17,8 +17,82 @@ void timer_init(void)
 
 }
 
+/* Each thread's timers are kept in a pairing heap, rooted at timer_head.
+ * Adding is O(1), taking the soonest or cancelling any one of them is
+ * O(log n) amortised, which matters as animations and tick timers come
+ * back through here every frame. All the links live in the CoreTimer, so
+ * there is nothing to allocate and no limit on how many a thread has.
+ * For the same reason the heap code is HOT_RAMFUNC */
+
+/* Join two heaps, neither of which can have siblings */
+static HOT_RAMFUNC CoreTimer *_timer_meld(CoreTimer *a, CoreTimer *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (b->when < a->when) {
+        CoreTimer *t = a;
+        a = b;
+        b = t;
+    }
+
+    b->prev = a;
+    b->next = a->child;
+    if (a->child)
+        a->child->prev = b;
+    a->child = b;
+
+    return a;
+}
+
+/* Turn a list of siblings back into one heap. Two passes: meld them in
+ * pairs left to right, then fold the pairs together right to left. The
+ * first pass leaves the pairs stacked up backwards on next, so neither
+ * pass needs any more room than the timers themselves */
+static HOT_RAMFUNC CoreTimer *_timer_merge_pairs(CoreTimer *first)
+{
+    CoreTimer *stack = NULL;
+    CoreTimer *root = NULL;
+
+    while (first) {
+        CoreTimer *a = first;
+        CoreTimer *b = a->next;
+
+        first = b ? b->next : NULL;
+        a->next = a->prev = NULL;
+        if (b)
+            b->next = b->prev = NULL;
+
+        CoreTimer *pair = _timer_meld(a, b);
+        pair->next = stack;
+        stack = pair;
+    }
+
+    while (stack) {
+        CoreTimer *pair = stack;
+        stack = pair->next;
+        pair->next = NULL;
+        root = _timer_meld(root, pair);
+    }
+
+    return root;
+}
+
+/* Take the soonest timer off the thread's heap */
+static HOT_RAMFUNC CoreTimer *_timer_pop(app_running_thread *thread)
+{
+    CoreTimer *timer = thread->timer_head;
+
+    thread->timer_head = _timer_merge_pairs(timer->child);
+    timer->child = NULL;
+
+    return timer;
+}
+
 /* Timer util */
-TickType_t appmanager_timer_get_next_expiry(app_running_thread *thread)
+HOT_RAMFUNC TickType_t appmanager_timer_get_next_expiry(app_running_thread *thread)
 {
     TickType_t next_timer;
 
@@ -42,20 +116,17 @@ void appmanager_timer_expired(app_running_thread *thread)
      * then invoke -- otherwise someone else could insert themselves
      * at the head, and we would wrongfully dequeue them!  */
     assert(thread);
-    CoreTimer *timer = thread->timer_head;
-    assert(timer);
+    assert(thread->timer_head);
+    CoreTimer *timer = _timer_pop(thread);
 
     if (!timer->callback) {
         /* assert(!"BAD"); // actually this is pretty bad. I've seen this 
          * happen only once before when the app draw was happening while the
          * ovelay thread was coming up. The ov thread memory was memset to 0. */
         KERN_LOG("app", APP_LOG_LEVEL_ERROR, "Bad Callback!");
-        thread->timer_head = timer->next;
         return;
     }
 
-    thread->timer_head = timer->next;
-
     if (!appmanager_is_app_shutting_down())
         timer->callback(timer);
 }
@@ -65,37 +136,37 @@ void appmanager_timer_expired(app_running_thread *thread)
  * reasonable to do from the app thread: otherwise, you can race with the
  * check for the timer head.
  */
-void appmanager_timer_add(CoreTimer *timer)
+HOT_RAMFUNC void appmanager_timer_add(CoreTimer *timer)
 {
     app_running_thread *_this_thread = appmanager_get_current_thread();
-    CoreTimer **tnext = &_this_thread->timer_head;
-
-    /* until either the next pointer is null (i.e., we have hit the end of
-     * the list), or the thing that the next pointer points to is further in
-     * the future than we are (i.e., we want to insert before the thing that
-     * the next pointer points to)
-     */
-    while (*tnext && (timer->when > (*tnext)->when)) {
-        tnext = &((*tnext)->next);
-    }
 
-    timer->next = *tnext;
-    *tnext = timer;
+    timer->next = timer->child = timer->prev = NULL;
+    _this_thread->timer_head = _timer_meld(_this_thread->timer_head, timer);
 }
 
-void appmanager_timer_remove(CoreTimer *timer)
+HOT_RAMFUNC void appmanager_timer_remove(CoreTimer *timer)
 {
     app_running_thread *_this_thread = appmanager_get_current_thread();
-    CoreTimer **tnext = &_this_thread->timer_head;
 
-    while (*tnext) {
-        if (*tnext == timer) {
-            *tnext = timer->next;
-            return;
-        }
-        tnext = &(*tnext)->next;
+    if (timer == _this_thread->timer_head) {
+        _timer_pop(_this_thread);
+        return;
     }
 
-    assert(!"appmanager_timer_remove did not find timer in list");
+    /* everything but the root hangs off something */
+    assert(timer->prev && "appmanager_timer_remove did not find timer in heap");
+
+    /* cut it out along with everything under it */
+    if (timer->prev->child == timer)
+        timer->prev->child = timer->next;
+    else
+        timer->prev->next = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+
+    /* and put back everything that was under it */
+    CoreTimer *rest = _timer_merge_pairs(timer->child);
+    timer->child = NULL;
+    _this_thread->timer_head = _timer_meld(_this_thread->timer_head, rest);
 }
-
@@ -0,0 +1,302 @@
+/* appmanager_worker.c
+ * The runloop for background workers, and messages to and from them
+ * RebbleOS
+ *
+ * A worker is the second binary in an app's bundle. It runs in the worker
+ * thread, on the top of the app heap pool, at a priority below every other
+ * thread, so whatever it does only gets the CPU the foreground leaves.
+ * It carries on after its app quits, until it is killed or replaced by
+ * another app's worker.
+ *
+ * Messages to the worker go on its own queue. Messages to the app are
+ * held here and the app's loop is woken to collect them, so the app's
+ * queue items stay small.
+ */
+
+#include "rebbleos.h"
+#include "librebble.h"
+#include "appmanager.h"
+#include "rebble_util.h"
+
+/* Configure Logging */
+#define MODULE_NAME "worker"
+#define MODULE_TYPE "KERN"
+#define LOG_LEVEL RBL_LOG_LEVEL_DEBUG //RBL_LOG_LEVEL_ERROR
+
+#define WORKER_MESSAGE_QUEUE_LENGTH 8
+
+typedef struct WorkerMessage {
+    uint8_t command;
+    uint8_t type;
+    AppWorkerMessage data;
+} WorkerMessage;
+
+static xQueueHandle _worker_queue;
+static StaticQueue_t _worker_queue_buf;
+static uint8_t _worker_queue_contents[WORKER_MESSAGE_QUEUE_LENGTH * sizeof(WorkerMessage)];
+
+/* waiting for the app to come round and take them */
+static WorkerMessage _to_app[WORKER_MESSAGE_QUEUE_LENGTH];
+static uint8_t _to_app_head;
+static uint8_t _to_app_count;
+
+/* by AppThreadType, only the app and the worker have one */
+static AppWorkerMessageHandler _handler[AppThreadWorker + 1];
+
+void appmanager_worker_init(void)
+{
+    _worker_queue = xQueueCreateStatic(WORKER_MESSAGE_QUEUE_LENGTH, sizeof(WorkerMessage),
+                                       _worker_queue_contents, &_worker_queue_buf);
+}
+
+static void _worker_post(WorkerMessage *msg)
+{
+    app_running_thread *worker = appmanager_get_thread(AppThreadWorker);
+
+    if (worker->status != AppThreadRunloop)
+        return;
+    if (!xQueueSendToBack(_worker_queue, msg, 0))
+        LOG_ERROR("Worker queue full, message dropped");
+}
+
+/*
+ * Ask the worker to finish up. It gets the same grace as an app does
+ * before the manager kills it
+ */
+void appmanager_worker_quit(void)
+{
+    WorkerMessage msg = {
+        .command = APP_QUIT,
+    };
+    _worker_post(&msg);
+}
+
+/*
+ * The worker thread's entry. Runs the worker's main, and tells the
+ * manager once it has returned
+ */
+void appmanager_worker_main_entry(void)
+{
+    app_running_thread *_this_thread = appmanager_get_current_thread();
+
+    _this_thread->status = AppThreadLoaded;
+    _handler[AppThreadWorker] = NULL;
+    xQueueReset(_worker_queue);
+
+    _this_thread->app->worker_main();
+    _this_thread->status = AppThreadUnloading;
+    _handler[AppThreadWorker] = NULL;
+
+    AppMessage am = {
+        .thread_id = _this_thread->thread_type,
+        .command = THREAD_MANAGER_APP_QUIT_CLEAN,
+    };
+
+    appmanager_post_generic_thread_message(&am, 100);
+    LOG_DEBUG("Worker Finished.");
+
+    /* Block until we are killed */
+    vTaskDelay(portMAX_DELAY);
+}
+
+/*
+ * The worker's runloop. Timers and messages from the app, until told to quit
+ */
+void worker_event_loop(void)
+{
+    WorkerMessage msg;
+    app_running_thread *_this_thread = appmanager_get_current_thread();
+
+    if (_this_thread->thread_type != AppThreadWorker)
+    {
+        LOG_ERROR("Runloop: You are not a worker");
+        return;
+    }
+
+    LOG_INFO("Worker entered mainloop");
+    _this_thread->status = AppThreadRunloop;
+
+    for ( ;; )
+    {
+        TickType_t next_timer = appmanager_timer_get_next_expiry(_this_thread);
+
+        if (next_timer == 0)
+        {
+            appmanager_timer_expired(_this_thread);
+            next_timer = appmanager_timer_get_next_expiry(_this_thread);
+        }
+        if (next_timer < 0)
+            next_timer = portMAX_DELAY;
+
+        if (!xQueueReceive(_worker_queue, &msg, next_timer))
+            continue;
+
+        if (msg.command == APP_QUIT)
+        {
+            _this_thread->shutdown_at_tick = xTaskGetTickCount() + pdMS_TO_TICKS(5000);
+            _this_thread->status = AppThreadUnloading;
+            tick_timer_service_unsubscribe();
+            connection_service_unsubscribe();
+            LOG_INFO("Worker Quit");
+            break;
+        }
+
+        if (msg.command == APP_WORKER_MESSAGE && _handler[AppThreadWorker])
+            _handler[AppThreadWorker](msg.type, &msg.data);
+    }
+}
+
+/*
+ * On the app thread, when woken with APP_WORKER_MESSAGE. Takes everything
+ * waiting, so a wake that couldn't be posted is caught up on the next
+ */
+void appmanager_worker_app_deliver(void)
+{
+    WorkerMessage msg;
+
+    for ( ;; )
+    {
+        taskENTER_CRITICAL();
+        if (!_to_app_count)
+        {
+            taskEXIT_CRITICAL();
+            return;
+        }
+        msg = _to_app[_to_app_head];
+        _to_app_head = (_to_app_head + 1) % WORKER_MESSAGE_QUEUE_LENGTH;
+        _to_app_count--;
+        taskEXIT_CRITICAL();
+
+        if (_handler[AppThreadMainApp])
+            _handler[AppThreadMainApp](msg.type, &msg.data);
+    }
+}
+
+static void _app_post(WorkerMessage *msg)
+{
+    AppMessage am = {
+        .command = APP_WORKER_MESSAGE,
+    };
+
+    taskENTER_CRITICAL();
+    if (_to_app_count == WORKER_MESSAGE_QUEUE_LENGTH)
+    {
+        taskEXIT_CRITICAL();
+        LOG_ERROR("App isn't taking worker messages, dropped");
+        return;
+    }
+    _to_app[(_to_app_head + _to_app_count) % WORKER_MESSAGE_QUEUE_LENGTH] = *msg;
+    _to_app_count++;
+    taskEXIT_CRITICAL();
+
+    appmanager_post_generic_app_message(&am, 0);
+}
+
+/*
+ * The app's end of it. A new app doesn't get the last one's messages
+ */
+void appmanager_worker_app_reset(void)
+{
+    taskENTER_CRITICAL();
+    _to_app_count = 0;
+    _handler[AppThreadMainApp] = NULL;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * API
+ */
+
+AppWorkerResult app_worker_launch(void)
+{
+    app_running_thread *worker = appmanager_get_thread(AppThreadWorker);
+    App *app = appmanager_get_current_app();
+
+    if (app->is_internal || !app->worker_file.size)
+        return APP_WORKER_RESULT_NO_WORKER;
+    if (worker->app == app && worker->status != AppThreadUnloaded)
+        return APP_WORKER_RESULT_ALREADY_RUNNING;
+
+    /* someone else's worker makes way, the manager sees to that */
+    AppMessage am = {
+        .command = THREAD_MANAGER_APP_LOAD,
+        .thread_id = AppThreadWorker,
+        .data = app->name,
+    };
+    appmanager_post_generic_thread_message(&am, 100);
+
+    return APP_WORKER_RESULT_SUCCESS;
+}
+
+AppWorkerResult app_worker_kill(void)
+{
+    app_running_thread *worker = appmanager_get_thread(AppThreadWorker);
+
+    if (worker->status == AppThreadUnloaded)
+        return APP_WORKER_RESULT_NOT_RUNNING;
+    if (worker->app != appmanager_get_current_app())
+        return APP_WORKER_RESULT_DIFFERENT_APP;
+
+    appmanager_worker_quit();
+    return APP_WORKER_RESULT_SUCCESS;
+}
+
+bool app_worker_is_running(void)
+{
+    app_running_thread *worker = appmanager_get_thread(AppThreadWorker);
+
+    return worker->status != AppThreadUnloaded && worker->app == appmanager_get_current_app();
+}
+
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler)
+{
+    AppThreadType type = appmanager_get_thread_type();
+
+    if (type > AppThreadWorker)
+        return false;
+
+    MK_THUMB_CB(handler);
+    _handler[type] = handler;
+    return true;
+}
+
+bool app_worker_message_unsubscribe(void)
+{
+    AppThreadType type = appmanager_get_thread_type();
+
+    if (type > AppThreadWorker || !_handler[type])
+        return false;
+
+    _handler[type] = NULL;
+    return true;
+}
+
+/*
+ * From the app it goes to the worker, and from the worker to the app
+ */
+void app_worker_send_message(uint8_t type, AppWorkerMessage *data)
+{
+    WorkerMessage msg = {
+        .command = APP_WORKER_MESSAGE,
+        .type = type,
+        .data = *data,
+    };
+
+    if (appmanager_is_thread_app())
+        _worker_post(&msg);
+    else if (appmanager_is_thread_worker())
+        _app_post(&msg);
+}
+
+/*
+ * Bring our app up in the foreground
+ */
+void worker_launch_app(void)
+{
+    app_running_thread *_this_thread = appmanager_get_current_thread();
+
+    if (!appmanager_is_thread_worker())
+        return;
+
+    appmanager_app_start(_this_thread->app->name);
+}
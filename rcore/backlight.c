@@ -12,7 +12,10 @@
 #include "log.h" /* KERN_LOG */
 #include "backlight.h"
 #include "ambient.h"
+#include "gyro.h" /* rcore_accel_tap_subscribe */
+#include "rebbleos.h" /* rebbleos_get_settings */
 #include "rebble_memory.h"
+#include "power.h"
 
 static TaskHandle_t _backlight_task;
 static StaticTask_t _backlight_task_buf;
@@ -32,9 +35,26 @@ static uint8_t _backlight_queue_contents[BACKLIGHT_QUEUE_SIZE * sizeof(backlight
 static xQueueHandle _backlight_queue;
 static StaticQueue_t _backlight_queue_buf;
 
+/* how long the light takes to come on, and to go out */
+#define BACKLIGHT_FADE_IN_MS  100
+#define BACKLIGHT_FADE_OUT_MS 4000
+/* longest it stays on while the battery is low */
+#define BACKLIGHT_SAVING_MS 1500
+
 static uint16_t _backlight_brightness;
 static uint8_t _backlight_is_on;
 
+/*
+ * The sensor spotted a flick. On the accel thread
+ */
+static void _backlight_tap(uint8_t axis, int8_t direction)
+{
+    SystemSettings *settings = rebbleos_get_settings();
+
+    if (settings->backlight_motion)
+        rcore_backlight_on(settings->backlight_intensity, settings->backlight_on_time);
+}
+
 /*
  * Backlight is a go
  */
@@ -50,6 +70,7 @@ uint8_t rcore_backlight_init(void)
     _backlight_task = xTaskCreateStatic(_backlight_thread, "Bl", configMINIMAL_STACK_SIZE + 190, NULL, tskIDLE_PRIORITY + 2UL, _backlight_task_stack, &_backlight_task_buf);
 
     rcore_backlight_on(100, 3000);
+    rcore_accel_tap_subscribe(AccelUserBacklight, _backlight_tap);
     
     return 0;
 }
@@ -62,6 +83,9 @@ void rcore_backlight_on(uint16_t brightness_pct, uint16_t time)
 {
     backlight_message_t msg;
 
+    if (power_is_saving() && time > BACKLIGHT_SAVING_MS)
+        time = BACKLIGHT_SAVING_MS;
+
     //  send the queue the backlight on task
     msg.cmd = BACKLIGHT_ON;
     msg.val1 = brightness_pct;
@@ -80,14 +104,14 @@ static void _backlight_set_raw(uint16_t brightness)
     hw_backlight_set(brightness);
 }
 
-static void _backlight_set(uint16_t brightness_pct)
+static uint16_t _backlight_raw(uint16_t brightness_pct)
 {
     uint16_t brightness;
     
     brightness = 8499 / (100 / brightness_pct);
     //KERN_LOG("backl", APP_LOG_LEVEL_DEBUG, "Brightness %d", brightness);
 
-    _backlight_set_raw(brightness);
+    return brightness;
 }
 
 
@@ -116,73 +140,39 @@ static void _backlight_set_from_ambient(void)
 }
 
 /*
- * Will take care of dimmng and time light is on etc
+ * Turns the light on, and out again when it's time. The fades themselves
+ * are played by the hardware, so this only wakes for a press and for
+ * the light going out
  */
 static void _backlight_thread(void *pvParameters)
 {
     backlight_message_t message;
-    uint32_t wait = 0;  
-    TickType_t on_expiry_time = xTaskGetTickCount();
-    uint8_t backlight_status = BACKLIGHT_OFF;
-    uint16_t bri_scale = 100;
-    uint16_t bri_it = 50;
+    TickType_t wait = portMAX_DELAY;
 
     while(1)
     {
-        if (backlight_status == BACKLIGHT_FADE)
-        {
-            uint16_t newbri = (_backlight_brightness - bri_scale);
-            wait = 80;
-            _backlight_set_raw(newbri);
-
-            bri_it--;
-            
-            if (bri_it == 0)
-            {
-                backlight_status = BACKLIGHT_OFF;
-                _backlight_set_raw(0);
-            }
-        }
-        else if (backlight_status == BACKLIGHT_ON)
-        {
-            // set the queue reader to immediately return
-            wait = 500;
-            
-//             backlight_set_from_ambient();
-            _backlight_set(bri_scale);
-            
-            if (xTaskGetTickCount() > on_expiry_time)
-            {
-                backlight_status = BACKLIGHT_FADE;
-                bri_scale = _backlight_brightness / 50;
-                bri_it = 50; // number of steps
-            }
-        }
-        else
+        if (!xQueueReceive(_backlight_queue, &message, wait))
         {
-            // We are idle so we can sleep for a bit
-            wait = 1000;
+            /* on for long enough */
+            _backlight_brightness = 0;
+            hw_backlight_fade(0, BACKLIGHT_FADE_OUT_MS);
+            wait = portMAX_DELAY;
+            continue;
         }
         
-        if (xQueueReceive(_backlight_queue, &message, pdMS_TO_TICKS(wait)))
+        switch(message.cmd)
         {
-            switch(message.cmd)
-            {
-                case BACKLIGHT_FADE:
-                    break;
-                case BACKLIGHT_OFF:
-                    break;
-                case BACKLIGHT_ON:
-//                     KERN_LOG("backl", APP_LOG_LEVEL_DEBUG, "Backlight ON");
-                    backlight_status = BACKLIGHT_ON;
-                    // timestamp the tick counter so we can stay on for
-                    // the right amount of time
-                    bri_scale = message.val1;
-                    on_expiry_time = xTaskGetTickCount() + (message.val2 / portTICK_RATE_MS);
-                    _backlight_set(message.val1);
-                    break;
-                ;
-            }
+            case BACKLIGHT_FADE:
+                break;
+            case BACKLIGHT_OFF:
+                break;
+            case BACKLIGHT_ON:
+//                 KERN_LOG("backl", APP_LOG_LEVEL_DEBUG, "Backlight ON");
+                /* from wherever it is, so a press mid fade out turns it back up */
+                _backlight_brightness = _backlight_raw(message.val1);
+                hw_backlight_fade(_backlight_brightness, BACKLIGHT_FADE_IN_MS);
+                wait = pdMS_TO_TICKS(message.val2);
+                break;
         }
     }
 }
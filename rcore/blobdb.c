@@ -0,0 +1,876 @@
+/* blobdb.c
+ * BlobDB: keyed blobs from the phone, kept on flash with a sorted index
+ * RebbleOS
+ *
+ * Each database is one file of a fixed size, so a compaction can commit a
+ * whole new one and a reset never sees half of it. The file is a header,
+ * then an index of (hash, offset) sorted by hash, then the records it
+ * points at, then a log that new records are appended to until the file
+ * is full:
+ *
+ *   | header | index ... | records ... | log ... (erased) |
+ *
+ * A record is its header, the key and the value, padded to 4. Its state
+ * is written last, so one cut off by a reset is seen as such at boot.
+ *
+ * The log is indexed in RAM: the delta, sorted by hash, with the latest
+ * record for each key appended since the last compaction, deletes
+ * included. A lookup tries the delta, then binary searches the index on
+ * flash. That search starts from a fence, every stride'th hash of the
+ * index kept in RAM, so it is a handful of 8 byte reads however big the
+ * database is, plus one for the key of each match.
+ *
+ * When the delta or the log is full, the next write compacts: the index,
+ * the delta and whatever is being written are merged by hash into a new
+ * file, dropping deletes and whatever they replaced. A bulk insert goes
+ * straight to that, so a sync of any size is one pass over the database.
+ */
+
+#include "rebbleos.h"
+#include "endpoint.h"
+#include "fs.h"
+#include "blobdb.h"
+
+/* "BLDB" */
+#define BLOBDB_MAGIC        0x42444c42
+#define BLOBDB_VERSION      1
+/* log records the RAM index holds before the next write compacts */
+#define BLOBDB_DELTA_MAX    32
+/* index hashes kept in RAM, evenly spaced, to start a search from */
+#define BLOBDB_FENCES       32
+/* the most keys with one hash in a merge. With 32 bits it is 1 */
+#define BLOBDB_GROUP_MAX    8
+
+/* a record's state once all of it is down; erased until then */
+#define BLOBDB_REC_DONE     0x0000
+#define BLOBDB_REC_ERASED   0xFFFF
+#define BLOBDB_REC_DELETED  0x01
+
+/* in a delta entry's offset, for a delete */
+#define BLOBDB_GONE         0x80000000
+
+typedef struct __attribute__((__packed__)) BlobDbHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t index_count;   /* the index follows this header */
+    uint32_t records_at;
+    uint32_t log_at;
+} BlobDbHeader;
+
+typedef struct __attribute__((__packed__)) BlobDbEntry {
+    uint32_t hash;
+    uint32_t offset;        /* of the record, in the file */
+} BlobDbEntry;
+
+typedef struct __attribute__((__packed__)) BlobDbRecord {
+    uint16_t state;
+    uint8_t key_len;
+    uint8_t flags;
+    uint16_t value_len;
+} BlobDbRecord;
+
+typedef struct BlobDb {
+    BlobDbId id;
+    const char *name;
+    uint32_t capacity;
+
+    bool present;           /* else there's no file yet */
+    struct file file;
+    uint16_t count;         /* in the index */
+    uint32_t records_at;
+    uint32_t tail;          /* where the next record goes */
+
+    BlobDbEntry delta[BLOBDB_DELTA_MAX];
+    uint8_t ndelta;
+
+    uint32_t fence[BLOBDB_FENCES];
+    uint8_t nfences;
+    uint16_t stride;
+} BlobDb;
+
+/* One key of a merge, from wherever it was */
+typedef struct BlobDbCandidate {
+    const BlobDbItem *item; /* from the batch, or NULL for a record */
+    uint32_t offset;
+    uint8_t key_len;
+    uint16_t value_len;
+    bool deleted;
+    uint8_t key[BLOBDB_KEY_MAX];
+} BlobDbCandidate;
+
+/* Where a merge writes. A first pass doesn't, and counts what would go */
+typedef struct BlobDbOut {
+    bool write;
+    struct fd index;
+    struct fd records;
+    uint32_t records_at;
+    uint16_t count;
+    uint32_t bytes;
+} BlobDbOut;
+
+static BlobDb _dbs[] = {
+    { BlobDbTest,       "blobdb-test",      4 * 1024 },
+    { BlobDbPins,       "blobdb-pins",      32 * 1024 },
+    { BlobDbApps,       "blobdb-apps",      16 * 1024 },
+    { BlobDbReminders,  "blobdb-reminders", 8 * 1024 },
+    { BlobDbNotifPrefs, "blobdb-notifprefs", 8 * 1024 },
+};
+
+#define BLOBDB_COUNT (sizeof(_dbs) / sizeof(_dbs[0]))
+
+static SemaphoreHandle_t _blobdb_mutex;
+static StaticSemaphore_t _blobdb_mutex_buf;
+
+/* under the lock */
+static BlobDbCandidate _group[BLOBDB_GROUP_MAX];
+static uint8_t _copy_buf[64];
+
+static void _load(BlobDb *db);
+
+uint8_t blobdb_init(void)
+{
+    _blobdb_mutex = xSemaphoreCreateMutexStatic(&_blobdb_mutex_buf);
+
+    for (uint8_t i = 0; i < BLOBDB_COUNT; i++)
+        _load(&_dbs[i]);
+
+    return INIT_RESP_OK;
+}
+
+static BlobDb *_db(uint8_t id)
+{
+    for (uint8_t i = 0; i < BLOBDB_COUNT; i++)
+        if (_dbs[i].id == id)
+            return &_dbs[i];
+
+    return NULL;
+}
+
+/* FNV-1a */
+static uint32_t _hash(const uint8_t *key, uint8_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (uint8_t i = 0; i < len; i++)
+        h = (h ^ key[i]) * 16777619u;
+
+    return h;
+}
+
+static uint32_t _rec_size(uint8_t key_len, uint16_t value_len)
+{
+    return (sizeof(BlobDbRecord) + key_len + value_len + 3) & ~3;
+}
+
+static void _read_at(const struct file *file, uint32_t ofs, void *p, size_t n)
+{
+    struct fd fd;
+
+    fs_open(&fd, file);
+    fs_seek(&fd, ofs, FS_SEEK_SET);
+    fs_read(&fd, p, n);
+}
+
+static void _entry(BlobDb *db, uint16_t i, BlobDbEntry *e)
+{
+    _read_at(&db->file, sizeof(BlobDbHeader) + i * sizeof(BlobDbEntry), e, sizeof(*e));
+}
+
+static bool _key_is(BlobDb *db, uint32_t offset, const uint8_t *key, uint8_t len)
+{
+    BlobDbRecord rec;
+    uint8_t buf[BLOBDB_KEY_MAX];
+
+    _read_at(&db->file, offset, &rec, sizeof(rec));
+    if (rec.key_len != len)
+        return false;
+    _read_at(&db->file, offset + sizeof(rec), buf, len);
+
+    return memcmp(buf, key, len) == 0;
+}
+
+/* Lookups */
+
+/* The delta slot with key, or -1. *at is where it would go */
+static int _delta_find(BlobDb *db, uint32_t hash, const uint8_t *key, uint8_t len, uint8_t *at)
+{
+    uint8_t lo = 0, hi = db->ndelta;
+
+    while (lo < hi)
+    {
+        uint8_t mid = (lo + hi) / 2;
+        if (db->delta[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *at = lo;
+
+    for (uint8_t i = lo; i < db->ndelta && db->delta[i].hash == hash; i++)
+        if (_key_is(db, db->delta[i].offset & ~BLOBDB_GONE, key, len))
+            return i;
+
+    return -1;
+}
+
+/* The record for key in the index on flash, or 0 */
+static uint32_t _index_find(BlobDb *db, uint32_t hash, const uint8_t *key, uint8_t len)
+{
+    BlobDbEntry e;
+    uint8_t f = 0;
+    uint16_t lo, hi;
+
+    /* the first entry with this hash is after the last fence below it,
+     * and no later than the next */
+    while (f < db->nfences && db->fence[f] < hash)
+        f++;
+    lo = f ? (f - 1) * db->stride + 1 : 0;
+    hi = f < db->nfences ? f * db->stride : db->count;
+
+    while (lo < hi)
+    {
+        uint16_t mid = (lo + hi) / 2;
+        _entry(db, mid, &e);
+        if (e.hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < db->count; lo++)
+    {
+        _entry(db, lo, &e);
+        if (e.hash != hash)
+            break;
+        if (_key_is(db, e.offset, key, len))
+            return e.offset;
+    }
+
+    return 0;
+}
+
+/* The record for key, or 0 if there isn't one or it was deleted */
+static uint32_t _find(BlobDb *db, const uint8_t *key, uint8_t len)
+{
+    uint32_t hash = _hash(key, len);
+    uint8_t at;
+    int slot;
+
+    if (!db->present)
+        return 0;
+
+    slot = _delta_find(db, hash, key, len, &at);
+    if (slot >= 0)
+        return (db->delta[slot].offset & BLOBDB_GONE) ? 0 : db->delta[slot].offset;
+
+    return _index_find(db, hash, key, len);
+}
+
+/* Make offset the latest for key. false if the delta is full */
+static bool _delta_put(BlobDb *db, uint32_t hash, const uint8_t *key, uint8_t len, uint32_t offset)
+{
+    uint8_t at;
+    int slot = _delta_find(db, hash, key, len, &at);
+
+    if (slot >= 0)
+    {
+        db->delta[slot].offset = offset;
+        return true;
+    }
+    if (db->ndelta == BLOBDB_DELTA_MAX)
+        return false;
+
+    memmove(&db->delta[at + 1], &db->delta[at], (db->ndelta - at) * sizeof(BlobDbEntry));
+    db->delta[at].hash = hash;
+    db->delta[at].offset = offset;
+    db->ndelta++;
+
+    return true;
+}
+
+/* Loading */
+
+static void _load(BlobDb *db)
+{
+    BlobDbHeader hdr;
+    BlobDbRecord rec;
+    BlobDbEntry e;
+    struct fd fd;
+    uint8_t key[BLOBDB_KEY_MAX];
+
+    db->present = false;
+    db->count = 0;
+    db->ndelta = 0;
+    db->nfences = 0;
+
+    if (fs_find_file(&db->file, db->name) < 0)
+        return;
+
+    _read_at(&db->file, 0, &hdr, sizeof(hdr));
+    if (hdr.magic != BLOBDB_MAGIC || hdr.version != BLOBDB_VERSION ||
+        hdr.records_at != sizeof(hdr) + hdr.index_count * sizeof(BlobDbEntry) ||
+        hdr.log_at < hdr.records_at || hdr.log_at > db->file.size)
+    {
+        SYS_LOG("blobdb", APP_LOG_LEVEL_ERROR, "%s is no good, starting it again", db->name);
+        fs_delete(&db->file);
+        return;
+    }
+
+    db->present = true;
+    db->count = hdr.index_count;
+    db->records_at = hdr.records_at;
+    db->tail = hdr.log_at;
+
+    db->stride = (db->count + BLOBDB_FENCES - 1) / BLOBDB_FENCES;
+    if (!db->stride)
+        db->stride = 1;
+    fs_open(&fd, &db->file);
+    fs_seek(&fd, sizeof(hdr), FS_SEEK_SET);
+    for (uint16_t i = 0; i < db->count; i++)
+    {
+        fs_read(&fd, &e, sizeof(e));
+        if (i % db->stride == 0)
+            db->fence[db->nfences++] = e.hash;
+    }
+
+    /* and what has been appended since */
+    while (db->tail + sizeof(rec) <= db->file.size)
+    {
+        uint32_t size;
+
+        _read_at(&db->file, db->tail, &rec, sizeof(rec));
+        if (rec.state == BLOBDB_REC_ERASED && rec.key_len == 0xFF && rec.flags == 0xFF &&
+            rec.value_len == 0xFFFF)
+            break;
+
+        size = _rec_size(rec.key_len, rec.value_len);
+        if (rec.state != BLOBDB_REC_DONE || !rec.key_len || rec.key_len > BLOBDB_KEY_MAX ||
+            db->tail + size > db->file.size)
+        {
+            /* cut off by a reset. Nothing more goes on after it, so the
+             * next write compacts and leaves it behind */
+            SYS_LOG("blobdb", APP_LOG_LEVEL_WARNING, "%s has a torn record at %lu", db->name, db->tail);
+            db->tail = db->file.size;
+            break;
+        }
+
+        _read_at(&db->file, db->tail + sizeof(rec), key, rec.key_len);
+        /* can't be full: an append needs a free slot */
+        _delta_put(db, _hash(key, rec.key_len), key, rec.key_len,
+                   db->tail | ((rec.flags & BLOBDB_REC_DELETED) ? BLOBDB_GONE : 0));
+        db->tail += size;
+    }
+
+    SYS_LOG("blobdb", APP_LOG_LEVEL_INFO, "%s: %d indexed, %d in the log, %lu of %lu bytes",
+            db->name, db->count, db->ndelta, db->tail, db->file.size);
+}
+
+/* Writing */
+
+/* Put one record on the end of the log. false if it needs a compaction */
+static bool _append(BlobDb *db, const BlobDbItem *item)
+{
+    BlobDbRecord rec;
+    struct fd fd;
+    uint16_t done = BLOBDB_REC_DONE;
+    uint16_t value_len = item->value ? item->value_len : 0;
+    uint32_t size = _rec_size(item->key_len, value_len);
+    uint32_t at = db->tail;
+
+    if (!db->present || db->ndelta == BLOBDB_DELTA_MAX || at + size > db->file.size)
+        return false;
+
+    rec.state = BLOBDB_REC_ERASED;
+    rec.key_len = item->key_len;
+    rec.flags = item->value ? 0 : BLOBDB_REC_DELETED;
+    rec.value_len = value_len;
+
+    fs_open(&fd, &db->file);
+    fs_seek(&fd, at, FS_SEEK_SET);
+    fs_write(&fd, &rec, sizeof(rec));
+    fs_write(&fd, item->key, item->key_len);
+    if (value_len)
+        fs_write(&fd, item->value, value_len);
+    fs_seek(&fd, at, FS_SEEK_SET);
+    fs_write(&fd, &done, sizeof(done));
+
+    db->tail = at + size;
+    _delta_put(db, item->hash, item->key, item->key_len, at | (item->value ? 0 : BLOBDB_GONE));
+
+    return true;
+}
+
+/* Add a key to the group unless it's there already, from somewhere that
+ * wins over this */
+static bool _group_add(BlobDb *db, uint8_t *n, const BlobDbItem *item, uint32_t offset)
+{
+    BlobDbCandidate *c = &_group[*n];
+    BlobDbRecord rec;
+
+    if (*n == BLOBDB_GROUP_MAX)
+    {
+        SYS_LOG("blobdb", APP_LOG_LEVEL_ERROR, "%s: too many keys with one hash", db->name);
+        return false;
+    }
+
+    if (item)
+    {
+        c->key_len = item->key_len;
+        c->value_len = item->value ? item->value_len : 0;
+        c->deleted = !item->value;
+        memcpy(c->key, item->key, item->key_len);
+    }
+    else
+    {
+        _read_at(&db->file, offset, &rec, sizeof(rec));
+        c->key_len = rec.key_len;
+        c->value_len = rec.value_len;
+        c->deleted = rec.flags & BLOBDB_REC_DELETED;
+        _read_at(&db->file, offset + sizeof(rec), c->key, rec.key_len);
+    }
+    c->item = item;
+    c->offset = offset;
+
+    for (uint8_t i = 0; i < *n; i++)
+        if (_group[i].key_len == c->key_len && memcmp(_group[i].key, c->key, c->key_len) == 0)
+            return true;
+
+    (*n)++;
+    return true;
+}
+
+static void _emit(BlobDb *db, uint32_t hash, const BlobDbCandidate *c, BlobDbOut *out)
+{
+    uint32_t size = _rec_size(c->key_len, c->value_len);
+
+    if (out->write)
+    {
+        BlobDbEntry e = { hash, out->records_at + out->bytes };
+        BlobDbRecord rec = { BLOBDB_REC_DONE, c->key_len, 0, c->value_len };
+
+        fs_write(&out->index, &e, sizeof(e));
+        fs_write(&out->records, &rec, sizeof(rec));
+        fs_write(&out->records, c->key, c->key_len);
+        if (c->item)
+        {
+            fs_write(&out->records, c->item->value, c->value_len);
+        }
+        else
+        {
+            struct fd fd;
+            uint16_t left = c->value_len;
+
+            fs_open(&fd, &db->file);
+            fs_seek(&fd, c->offset + sizeof(rec) + c->key_len, FS_SEEK_SET);
+            while (left)
+            {
+                uint16_t n = left > sizeof(_copy_buf) ? sizeof(_copy_buf) : left;
+                fs_read(&fd, _copy_buf, n);
+                fs_write(&out->records, _copy_buf, n);
+                left -= n;
+            }
+        }
+        /* the padding stays erased */
+        fs_seek(&out->records, size - sizeof(rec) - c->key_len - c->value_len, FS_SEEK_CUR);
+    }
+
+    out->count++;
+    out->bytes += size;
+}
+
+/*
+ * Merge the index, the delta and items, sorted by hash, into out. For a
+ * key in more than one, items win over the delta and the delta over the
+ * index; in items, the last of it wins. Deletes go, and what they hid
+ */
+static bool _merge(BlobDb *db, const BlobDbItem *items, uint16_t nitems, BlobDbOut *out)
+{
+    struct fd ifd;
+    BlobDbEntry fe;
+    uint16_t fi = 0, bi = 0;
+    uint8_t di = 0;
+    uint16_t count = db->present ? db->count : 0;
+
+    out->count = 0;
+    out->bytes = 0;
+
+    if (count)
+    {
+        fs_open(&ifd, &db->file);
+        fs_seek(&ifd, sizeof(BlobDbHeader), FS_SEEK_SET);
+        fs_read(&ifd, &fe, sizeof(fe));
+    }
+
+    for (;;)
+    {
+        uint32_t hash = 0;
+        bool any = false;
+        uint16_t start;
+        uint8_t n = 0;
+
+        if (fi < count)
+        {
+            hash = fe.hash;
+            any = true;
+        }
+        if (di < db->ndelta && (!any || db->delta[di].hash < hash))
+        {
+            hash = db->delta[di].hash;
+            any = true;
+        }
+        if (bi < nitems && (!any || items[bi].hash < hash))
+        {
+            hash = items[bi].hash;
+            any = true;
+        }
+        if (!any)
+            break;
+
+        start = bi;
+        while (bi < nitems && items[bi].hash == hash)
+            bi++;
+        for (uint16_t i = bi; i-- > start; )
+            if (!_group_add(db, &n, &items[i], 0))
+                return false;
+
+        for (; di < db->ndelta && db->delta[di].hash == hash; di++)
+            if (!_group_add(db, &n, NULL, db->delta[di].offset & ~BLOBDB_GONE))
+                return false;
+
+        while (fi < count && fe.hash == hash)
+        {
+            if (!_group_add(db, &n, NULL, fe.offset))
+                return false;
+            if (++fi < count)
+                fs_read(&ifd, &fe, sizeof(fe));
+        }
+
+        for (uint8_t i = 0; i < n; i++)
+            if (!_group[i].deleted)
+                _emit(db, hash, &_group[i], out);
+    }
+
+    return true;
+}
+
+/* Write the database again with items merged in, and load it */
+static BlobDbStatus _compact(BlobDb *db, const BlobDbItem *items, uint16_t nitems)
+{
+    BlobDbHeader hdr;
+    BlobDbOut out;
+    struct fd fd;
+
+    /* once to size it */
+    out.write = false;
+    if (!_merge(db, items, nitems, &out))
+        return BlobDbGeneralFailure;
+
+    hdr.magic = BLOBDB_MAGIC;
+    hdr.version = BLOBDB_VERSION;
+    hdr.reserved = 0xFF;
+    hdr.index_count = out.count;
+    hdr.records_at = sizeof(hdr) + out.count * sizeof(BlobDbEntry);
+    hdr.log_at = hdr.records_at + out.bytes;
+    if (hdr.log_at > db->capacity)
+    {
+        SYS_LOG("blobdb", APP_LOG_LEVEL_ERROR, "%s full, %lu bytes", db->name, hdr.log_at);
+        return BlobDbDatabaseFull;
+    }
+
+    if (fs_creat(&fd, db->name, db->capacity) < 0)
+        return BlobDbGeneralFailure;
+
+    out.write = true;
+    out.index = fd;
+    fs_seek(&out.index, sizeof(hdr), FS_SEEK_SET);
+    out.records = fd;
+    fs_seek(&out.records, hdr.records_at, FS_SEEK_SET);
+    out.records_at = hdr.records_at;
+    _merge(db, items, nitems, &out);
+
+    /* the header last, so the file only has one once the rest is down */
+    fs_write(&fd, &hdr, sizeof(hdr));
+    if (fs_commit(&fd) < 0)
+    {
+        fs_delete(&fd.file);
+        return BlobDbGeneralFailure;
+    }
+
+    _load(db);
+    return BlobDbSuccess;
+}
+
+static BlobDbStatus _put(BlobDb *db, BlobDbItem *item)
+{
+    item->hash = _hash(item->key, item->key_len);
+    if (_append(db, item))
+        return BlobDbSuccess;
+
+    return _compact(db, item, 1);
+}
+
+/* Calls */
+
+BlobDbStatus blobdb_insert(BlobDbId id, const uint8_t *key, uint8_t key_len, const uint8_t *value, uint16_t value_len)
+{
+    BlobDb *db = _db(id);
+    BlobDbItem item = { key, key_len, value, value_len, 0 };
+    BlobDbStatus status;
+
+    if (!db)
+        return BlobDbInvalidDatabaseId;
+    if (!key_len || key_len > BLOBDB_KEY_MAX || !value)
+        return BlobDbInvalidData;
+
+    xSemaphoreTake(_blobdb_mutex, portMAX_DELAY);
+    status = _put(db, &item);
+    xSemaphoreGive(_blobdb_mutex);
+
+    return status;
+}
+
+/*
+ * Apply all of items in one compaction: one read of the database and one
+ * write, however many there are. items is sorted in place by hash
+ */
+BlobDbStatus blobdb_insert_bulk(BlobDbId id, BlobDbItem *items, uint16_t count)
+{
+    BlobDb *db = _db(id);
+    BlobDbStatus status;
+
+    if (!db)
+        return BlobDbInvalidDatabaseId;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (!items[i].key_len || items[i].key_len > BLOBDB_KEY_MAX)
+            return BlobDbInvalidData;
+        items[i].hash = _hash(items[i].key, items[i].key_len);
+    }
+
+    /* keeping their order otherwise, so the last of a key wins */
+    for (uint16_t i = 1; i < count; i++)
+    {
+        BlobDbItem it = items[i];
+        uint16_t j = i;
+
+        for (; j > 0 && items[j - 1].hash > it.hash; j--)
+            items[j] = items[j - 1];
+        items[j] = it;
+    }
+
+    xSemaphoreTake(_blobdb_mutex, portMAX_DELAY);
+    status = _compact(db, items, count);
+    xSemaphoreGive(_blobdb_mutex);
+
+    return status;
+}
+
+BlobDbStatus blobdb_delete(BlobDbId id, const uint8_t *key, uint8_t key_len)
+{
+    BlobDb *db = _db(id);
+    BlobDbItem item = { key, key_len, NULL, 0, 0 };
+    BlobDbStatus status;
+
+    if (!db)
+        return BlobDbInvalidDatabaseId;
+    if (!key_len || key_len > BLOBDB_KEY_MAX)
+        return BlobDbInvalidData;
+
+    xSemaphoreTake(_blobdb_mutex, portMAX_DELAY);
+    if (!_find(db, key, key_len))
+        status = BlobDbKeyDoesNotExist;
+    else
+        status = _put(db, &item);
+    xSemaphoreGive(_blobdb_mutex);
+
+    return status;
+}
+
+BlobDbStatus blobdb_clear(BlobDbId id)
+{
+    BlobDb *db = _db(id);
+
+    if (!db)
+        return BlobDbInvalidDatabaseId;
+
+    xSemaphoreTake(_blobdb_mutex, portMAX_DELAY);
+    if (db->present)
+        fs_delete(&db->file);
+    _load(db);
+    xSemaphoreGive(_blobdb_mutex);
+
+    return BlobDbSuccess;
+}
+
+static int _read_value(const struct file *file, uint32_t offset, void *value, uint16_t max)
+{
+    BlobDbRecord rec;
+
+    _read_at(file, offset, &rec, sizeof(rec));
+    _read_at(file, offset + sizeof(rec) + rec.key_len, value, rec.value_len < max ? rec.value_len : max);
+
+    return rec.value_len;
+}
+
+int blobdb_get(BlobDbId id, const uint8_t *key, uint8_t key_len, void *value, uint16_t max)
+{
+    BlobDb *db = _db(id);
+    uint32_t offset;
+    int len = -1;
+
+    if (!db || !key_len || key_len > BLOBDB_KEY_MAX)
+        return -1;
+
+    xSemaphoreTake(_blobdb_mutex, portMAX_DELAY);
+    offset = _find(db, key, key_len);
+    if (offset)
+        len = _read_value(&db->file, offset, value, max);
+    xSemaphoreGive(_blobdb_mutex);
+
+    return len;
+}
+
+/*
+ * Call callback for every key, in no order. It is called with the lock
+ * held: it can blobdb_read the ref it is given, but not change the
+ * database
+ */
+void blobdb_each(BlobDbId id, BlobDbEachCallback callback, void *context)
+{
+    BlobDb *db = _db(id);
+    BlobDbRecord rec;
+    BlobDbEntry e;
+    BlobDbRef ref;
+    struct fd fd;
+    uint8_t key[BLOBDB_KEY_MAX];
+    uint8_t at;
+
+    if (!db)
+        return;
+
+    xSemaphoreTake(_blobdb_mutex, portMAX_DELAY);
+    if (!db->present)
+        goto done;
+
+    ref.db = id;
+    for (uint8_t i = 0; i < db->ndelta; i++)
+    {
+        if (db->delta[i].offset & BLOBDB_GONE)
+            continue;
+        ref.offset = db->delta[i].offset;
+        _read_at(&db->file, ref.offset, &rec, sizeof(rec));
+        _read_at(&db->file, ref.offset + sizeof(rec), key, rec.key_len);
+        ref.value_len = rec.value_len;
+        if (!callback(key, rec.key_len, &ref, context))
+            goto done;
+    }
+
+    /* and those in the index the delta hasn't replaced */
+    fs_open(&fd, &db->file);
+    fs_seek(&fd, sizeof(BlobDbHeader), FS_SEEK_SET);
+    for (uint16_t i = 0; i < db->count; i++)
+    {
+        fs_read(&fd, &e, sizeof(e));
+        _read_at(&db->file, e.offset, &rec, sizeof(rec));
+        _read_at(&db->file, e.offset + sizeof(rec), key, rec.key_len);
+        if (_delta_find(db, e.hash, key, rec.key_len, &at) >= 0)
+            continue;
+        ref.offset = e.offset;
+        ref.value_len = rec.value_len;
+        if (!callback(key, rec.key_len, &ref, context))
+            goto done;
+    }
+
+done:
+    xSemaphoreGive(_blobdb_mutex);
+}
+
+/* From a blobdb_each callback only */
+int blobdb_read(const BlobDbRef *ref, void *value, uint16_t max)
+{
+    BlobDb *db = _db(ref->db);
+
+    if (!db)
+        return -1;
+
+    return _read_value(&db->file, ref->offset, value, max);
+}
+
+/* The endpoint */
+
+typedef struct __attribute__((__packed__)) BlobDbRequest {
+    uint8_t command;
+    uint16_t token;
+    uint8_t db;
+} BlobDbRequest;
+
+static void _reply(uint16_t token, BlobDbStatus status)
+{
+    uint8_t pkt[3];
+
+    pkt[0] = token;
+    pkt[1] = token >> 8;
+    pkt[2] = status;
+    bluetooth_send_packet(ENDPOINT_BLOBDB, pkt, sizeof(pkt));
+}
+
+void process_blobdb_packet(uint8_t *data, uint16_t len)
+{
+    BlobDbRequest *req = (BlobDbRequest *)data;
+    uint8_t *p = data + sizeof(*req);
+    uint8_t *end = data + len;
+    const uint8_t *key;
+    uint8_t key_len;
+    uint16_t value_len;
+    BlobDbStatus status;
+
+    if (len < sizeof(*req))
+        return;
+
+    if (!_db(req->db))
+    {
+        _reply(req->token, BlobDbInvalidDatabaseId);
+        return;
+    }
+
+    switch (req->command)
+    {
+    case BLOBDB_INSERT:
+    case BLOBDB_DELETE:
+        if (p + 1 > end)
+            goto invalid;
+        key_len = *p++;
+        key = p;
+        p += key_len;
+        if (p > end)
+            goto invalid;
+        if (req->command == BLOBDB_DELETE)
+        {
+            status = blobdb_delete(req->db, key, key_len);
+            break;
+        }
+        if (p + 2 > end)
+            goto invalid;
+        value_len = p[0] | (p[1] << 8);
+        p += 2;
+        if (p + value_len > end)
+            goto invalid;
+        status = blobdb_insert(req->db, key, key_len, p, value_len);
+        break;
+    case BLOBDB_CLEAR:
+        status = blobdb_clear(req->db);
+        break;
+    default:
+        status = BlobDbInvalidOperation;
+        break;
+    }
+
+    SYS_LOG("blobdb", APP_LOG_LEVEL_DEBUG, "db %d command %d: %d", req->db, req->command, status);
+    _reply(req->token, status);
+    return;
+
+invalid:
+    _reply(req->token, BlobDbInvalidData);
+}
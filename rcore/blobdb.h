@@ -0,0 +1,69 @@
+#pragma once
+/* blobdb.h
+ * BlobDB: keyed blobs from the phone, kept on flash with a sorted index
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* The databases, by the id the phone uses for them */
+typedef enum BlobDbId {
+    BlobDbTest          = 0x01,
+    BlobDbPins          = 0x02,
+    BlobDbApps          = 0x03,
+    BlobDbReminders     = 0x04,
+    BlobDbNotifPrefs    = 0x07,
+} BlobDbId;
+
+/* Requests on ENDPOINT_BLOBDB. Each starts with the command, a token and
+ * the database; numbers are little endian */
+#define BLOBDB_INSERT           0x01
+#define BLOBDB_DELETE           0x04
+#define BLOBDB_CLEAR            0x05
+
+/* the reply to each, after the token. Also what the calls below return */
+typedef enum BlobDbStatus {
+    BlobDbSuccess           = 0x01,
+    BlobDbGeneralFailure    = 0x02,
+    BlobDbInvalidOperation  = 0x03,
+    BlobDbInvalidDatabaseId = 0x04,
+    BlobDbInvalidData       = 0x05,
+    BlobDbKeyDoesNotExist   = 0x06,
+    BlobDbDatabaseFull      = 0x07,
+    BlobDbDataStale         = 0x08,
+} BlobDbStatus;
+
+/* longer keys are refused */
+#define BLOBDB_KEY_MAX          64
+
+/* One blob for blobdb_insert_bulk. value NULL deletes the key */
+typedef struct BlobDbItem {
+    const uint8_t *key;
+    uint8_t key_len;
+    const uint8_t *value;
+    uint16_t value_len;
+    uint32_t hash;          /* ours */
+} BlobDbItem;
+
+/* Where a blob is, for blobdb_read from a blobdb_each callback */
+typedef struct BlobDbRef {
+    BlobDbId db;
+    uint32_t offset;
+    uint16_t value_len;
+} BlobDbRef;
+
+/* return false to stop */
+typedef bool (*BlobDbEachCallback)(const uint8_t *key, uint8_t key_len, const BlobDbRef *ref, void *context);
+
+uint8_t blobdb_init(void);
+BlobDbStatus blobdb_insert(BlobDbId db, const uint8_t *key, uint8_t key_len, const uint8_t *value, uint16_t value_len);
+BlobDbStatus blobdb_insert_bulk(BlobDbId db, BlobDbItem *items, uint16_t count);
+BlobDbStatus blobdb_delete(BlobDbId db, const uint8_t *key, uint8_t key_len);
+BlobDbStatus blobdb_clear(BlobDbId db);
+/* the value's length, copying up to max of it; -1 if there is no such key */
+int blobdb_get(BlobDbId db, const uint8_t *key, uint8_t key_len, void *value, uint16_t max);
+void blobdb_each(BlobDbId db, BlobDbEachCallback callback, void *context);
+int blobdb_read(const BlobDbRef *ref, void *value, uint16_t max);
+void process_blobdb_packet(uint8_t *data, uint16_t len);
@@ -8,15 +8,21 @@
  * General flow:
  * 
  * TX
- * A packet is genreated and posted to the cmd thread
- * btstack_rebble takes a ref to this data,
- * and waits for a ready to send message fromt he bt stack.
- *  * NOTE the memory is not copied, it is sent with supplied buf
+ * A packet is genreated and posted to the cmd thread's TX ring, which
+ * has room for a few, so senders don't wait on each other's packets.
+ * The cmd thread sends them back to back: btstack_rebble takes a ref to
+ * this data, and waits for a ready to send message fromt he bt stack.
+ * Each packet then completes on its own, waking a bluetooth_send caller
+ * or calling a bluetooth_send_async callback.
+ *  * NOTE the memory is not copied, it is sent with supplied buf. A
+ *    packet may come in two pieces, a header and a payload, which are
+ *    only put together in the stack's own outgoing buffer
  * 
  * RX
- * An incoming packet is collected in btstack_rebble
- * once we have some data, we look over the buffer and check for packet header
- * If we have packets, we recombine them and process as required.
+ * Incoming data from btstack_rebble goes into the RX ring, on the stack's
+ * thread, and the cmd thread is kicked. It takes the frames out of the
+ * ring, reassembling any that came in pieces, and processes each whole
+ * one as required, so endpoints never run in the stack's callbacks.
  *  
  * NOTES:
  * we have locking and whatnot. Test it.
@@ -37,6 +43,10 @@
 #include "pebble_protocol.h"
 #include "stdarg.h"
 #include "connection_service.h"
+#include "boot_profile.h"
+#include "ring.h"
+#include "data_logging.h"
+#include "stm32_power.h"
 
 /* macro to swap bytes from big > little endian */
 #define SWAP_UINT16(x) (((x) >> 8) | ((x) << 8))
@@ -45,18 +55,27 @@
 #define STACK_SZ_CMD configMINIMAL_STACK_SIZE + 600
 #define STACK_SZ_BT 1800
 
+/* traffic either way keeps the CPU at full speed this long after, so a
+ * burst of frames isn't taken apart at half */
+#define BT_CPU_BOOST_MS 100
+
 /* Bit commands for the binary semaphore */
 #define TX_NOTIFY_COMPLETE 1
 
 extern int vsfmt(char *buf, unsigned int len, const char *ifmt, va_list ap);
 
 
-/* a packet to go on the queue to process a command */
+/* a packet to go on the queue to process a command. When it's done,
+ * either the callback is called or notify_task is woken */
 typedef struct rebble_bt_packet_t {
     uint8_t packet_type;
     size_t length;
     uint8_t *data;
+    uint8_t *head;
+    uint8_t head_length;
     tx_complete_callback callback;
+    TaskHandle_t notify_task;
+    uint32_t queued_at;  /* cycle count */
 } rebble_bt_packet;
 
 
@@ -70,8 +89,8 @@ static TaskHandle_t _bt_cmd_task;
 static StackType_t _bt_cmd_task_stack[STACK_SZ_CMD];
 static StaticTask_t _bt_cmd_task_buf;
 
-/* Processing Queue */
-#define _CMD_QUEUE_LENGTH 1
+/* Processing Queue. The TX ring: packets waiting their turn */
+#define _CMD_QUEUE_LENGTH 8
 #define _CMD_QUEUE_SIZE sizeof(rebble_bt_packet)
 static QueueHandle_t _bt_cmd_queue;
 static StaticQueue_t _bt_cmd_queue_ptr;
@@ -80,9 +99,6 @@ static uint8_t _bt_cmd_queue_buf[_CMD_QUEUE_LENGTH * _CMD_QUEUE_SIZE];
 static SemaphoreHandle_t _bt_tx_mutex;
 static StaticSemaphore_t _bt_tx_mutex_buf;
 
-/* When a TX is complete, this will hold the orig task */
-static TaskHandle_t _tx_task_to_notify = NULL;
-
 static bool _enabled;
 static bool _connected;
 
@@ -91,11 +107,23 @@ static bool _connected;
 #define PACKET_TYPE_RX 0
 #define PACKET_TYPE_TX 1
 
+/* RX: bytes from the stack, not yet looked at. A power of two */
+#define BT_RX_RING_SIZE 2048
+/* the biggest payload we reassemble. Bigger ones are skipped */
+#define BT_RX_MAX_PAYLOAD 2048
+
+static uint8_t _rx_ring_buf[BT_RX_RING_SIZE];
+static ring _rx_ring = RING_INIT(_rx_ring_buf);
+static uint8_t _rx_buf[BT_RX_MAX_PAYLOAD];
+static volatile bool _rx_kicked;
+static volatile bool _rx_reset;
+
 static void _bt_thread(void *pvParameters);
 static void _bt_cmd_thread(void *pvParameters);
-static bool _parse_packet(pbl_transport_packet *pkt, uint8_t *data, size_t len);
+static void _rx_drain(void);
 static void _process_packet(pbl_transport_packet *pkt);
-static uint8_t _bluetooth_tx(uint8_t *data, uint16_t len);
+static uint8_t _bluetooth_tx(uint8_t *head, uint8_t head_len, uint8_t *data, uint16_t len);
+static uint32_t _send_serial(uint8_t *head, uint8_t head_len, uint8_t *data, size_t len);
 
 // #define BT_LOG_ENABLED
 #ifdef BT_LOG_ENABLED
@@ -104,11 +132,66 @@ static uint8_t _bluetooth_tx(uint8_t *data, uint16_t len);
     #define BT_LOG NULL_LOG
 #endif
 
+/* counts and timings for the stats endpoint and the perf HUD. Taken
+ * in a critical section, by whoever is in here at the time */
+static BtStats _bt_stats;
+/* when the stack last said a TX was done, and when RX came in that the
+ * cmd thread hasn't been to yet */
+static volatile uint32_t _bt_tx_done_at;
+static volatile uint32_t _bt_rx_kick_at;
+
+static void _stats_time(BtTimeStats *st, uint32_t from, uint32_t to)
+{
+    uint32_t us = (to - from) / hw_cycles_per_us();
+
+    taskENTER_CRITICAL();
+    st->count++;
+    st->total_us += us;
+    if (us > st->max_us)
+        st->max_us = us;
+    taskEXIT_CRITICAL();
+}
+
+/* A whole frame one way or the other. Frames with no endpoint header
+ * (raw sends shorter than one) aren't counted */
+static void _stats_frame(uint16_t endpoint, uint16_t len, bool tx)
+{
+    uint8_t i;
+
+    taskENTER_CRITICAL();
+    for (i = 0; i < _bt_stats.endpoint_count && _bt_stats.endpoint[i].endpoint != endpoint; i++)
+        ;
+    if (i == BT_STATS_ENDPOINTS)
+    {
+        /* full up, the last one is everyone else */
+        i = BT_STATS_ENDPOINTS - 1;
+        _bt_stats.endpoint[i].endpoint = 0xFFFF;
+    }
+    else if (i == _bt_stats.endpoint_count)
+    {
+        _bt_stats.endpoint[i].endpoint = endpoint;
+        _bt_stats.endpoint_count++;
+    }
+
+    if (tx)
+    {
+        _bt_stats.endpoint[i].tx_packets++;
+        _bt_stats.endpoint[i].tx_bytes += len;
+    }
+    else
+    {
+        _bt_stats.endpoint[i].rx_packets++;
+        _bt_stats.endpoint[i].rx_bytes += len;
+    }
+    taskEXIT_CRITICAL();
+}
+
 /* Initialise the bluetooth module */
 uint8_t bluetooth_init(void)
 {
     _bt_cmd_queue = xQueueCreateStatic(_CMD_QUEUE_LENGTH, _CMD_QUEUE_SIZE, _bt_cmd_queue_buf, &_bt_cmd_queue_ptr);
     _bt_tx_mutex = xSemaphoreCreateMutexStatic(&_bt_tx_mutex_buf);
+    endpoint_init();
     _bt_task = xTaskCreateStatic(_bt_thread, 
                                      "BT", STACK_SZ_BT, NULL, 
                                      tskIDLE_PRIORITY + 3UL, 
@@ -126,35 +209,57 @@ uint8_t bluetooth_init(void)
 void bluetooth_init_complete(uint8_t state)
 {
     _enabled = (state != INIT_RESP_OK ? false : true);
-    os_module_init_complete(state);
+    /* the driver's init never returns, it's done when it says so */
+    boot_profile_step_end(BootProfileBluetooth);
+    if (_enabled)
+        boot_profile_event(BootProfileBluetoothReady);
+    os_module_init_complete(OsModuleBluetooth, state);
 }
 
 /*
  * Just send some raw data
- * returns bytes sent
+ * returns bytes sent, 0 if it timed out
  * DO NOT CALL FROM ISR
  */
 uint32_t bluetooth_send_serial_raw(uint8_t *data, size_t len)
 {
+    return _send_serial(NULL, 0, data, len);
+}
+
+/* The same, in two pieces */
+static uint32_t _send_serial(uint8_t *head, uint8_t head_len, uint8_t *data, size_t len)
+{
+    uint32_t sent = head_len + len;
+    uint8_t *frame = head_len ? head : data;
+    
+    stm32_power_cpu_boost(BT_CPU_BOOST_MS);
     xSemaphoreTake(_bt_tx_mutex, portMAX_DELAY);
 
-    bt_device_request_tx(data, len);
+    uint32_t start = hw_cycle_count();
+    bt_device_request_tx_iov(head, head_len, data, len);
     
     // block this thread until we are done
     if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(200)))
     {
         // clean unlock
-        BT_LOG("BT", APP_LOG_LEVEL_DEBUG, "Sent %d bytes", len);
+        BT_LOG("BT", APP_LOG_LEVEL_DEBUG, "Sent %d bytes", sent);
+        /* done when the stack said, not when we got round to it */
+        _stats_time(&_bt_stats.tx_send, start, _bt_tx_done_at);
+        _bt_stats.tx_bytes += sent;
+        if (sent >= 4)
+            _stats_frame((frame[2] << 8) | frame[3], sent - 4, true);
     }
     else
     {
         // timed out
         BT_LOG("BT", APP_LOG_LEVEL_ERROR, "Timed out sending!");
+        _bt_stats.tx_timeouts++;
+        sent = 0;
     }
     
     xSemaphoreGive(_bt_tx_mutex);
     
-    return len;
+    return sent;
 }
 
 /*
@@ -163,18 +268,34 @@ uint32_t bluetooth_send_serial_raw(uint8_t *data, size_t len)
 
 
 /*
- * Some data arrived from the stack
+ * Some data arrived from the stack. On the stack's thread, so it only
+ * goes in the RX ring here; the cmd thread picks packets out of it
  */
 void bluetooth_data_rx(uint8_t *data, size_t len)
 {
-    static pbl_transport_packet pkt;
-    uint8_t *buf_p;  /* pointer to the message in the buffer */
-    return;
-    if (!_parse_packet(&pkt, data, len))
-        return; // we are done, no point looking as we have no data left
+    rebble_bt_packet kick = {
+        .packet_type = PACKET_TYPE_RX,
+    };
+    uint32_t got = ring_write(&_rx_ring, data, len);
     
-    // seems legit
-    _process_packet(&pkt);
+    stm32_power_cpu_boost(BT_CPU_BOOST_MS);
+    _bt_stats.rx_bytes += len;
+    if (got < len)
+    {
+        _bt_stats.rx_lost_bytes += len - got;
+        /* the stream is broken from here, we'll be reading garbage
+         * lengths until the phone gives up and reconnects */
+        SYS_LOG("BT", APP_LOG_LEVEL_ERROR, "RX: ring full, %d bytes lost", len - got);
+    }
+    
+    /* If the queue is full of TX, the cmd thread looks at the ring after
+     * each of those anyway */
+    if (!_rx_kicked)
+    {
+        _bt_rx_kick_at = hw_cycle_count();
+        _rx_kicked = true;
+        xQueueSendToBack(_bt_cmd_queue, &kick, 0);
+    }
 }
 
 /*
@@ -184,6 +305,7 @@ void bluetooth_tx_complete_from_isr(void)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
+    _bt_tx_done_at = hw_cycle_count();
     // Notify the task that the transmission is complete.
     vTaskNotifyGiveFromISR(_bt_cmd_task, &xHigherPriorityTaskWoken);
 
@@ -200,65 +322,83 @@ void bluetooth_tx_complete_from_isr(void)
 
 
 /*
- * Parse a packet in the buffer. Will fill the given pbl_transport with
- * the parsed data
- * 
- * Returns false when done or on completion errors
+ * Take whatever whole packets are in the RX ring and hand them on.
+ * Frames come in any size of chunk: one may be split over several, and
+ * one chunk may hold several. Whatever is left of a frame waits in the
+ * reassembly buffer for the rest. cmd thread only
  */
-static bool _parse_packet(pbl_transport_packet *pkt, uint8_t *data, size_t len)
+static void _rx_drain(void)
 {
-    uint16_t pkt_length = (data[0] << 8) | (data[1] & 0xff);
-    uint16_t pkt_endpoint = (data[2] << 8) | (data[3] & 0xff);
-
-    /* done! (usually) */
-    if (pkt_length == 0)
-        return false;
-
-    /* Seems sensible */
-    if (pkt_length > 2048)
-    {
-        BT_LOG("BT", APP_LOG_LEVEL_ERROR, "RX: payload length %d. Seems suspect!", pkt_length);
-        return false;
-    }   
+    static uint8_t head[4];
+    static uint8_t head_got;
+    static uint16_t got;
+    static pbl_transport_packet pkt = { .data = _rx_buf };
+    const uint8_t *p;
+    uint32_t n;
+    /* the frames in this lot came in no earlier than this */
+    uint32_t since = _bt_rx_kick_at;
     
-    BT_LOG("BT", APP_LOG_LEVEL_INFO, "RX: GOOD packet. len %d end %d", pkt_length, pkt_endpoint);
-
-    /* it's a valid packet. fill out passed packet and finish up */
-    pkt->length = pkt_length;
-    pkt->endpoint = pkt_endpoint;
-    pkt->data = data + 4;
+    _rx_kicked = false;
     
-    BT_LOG("BT", APP_LOG_LEVEL_INFO, "RX: Done");
+    /* half a frame from the last connection is no use to the next */
+    if (_rx_reset)
+    {
+        _rx_reset = false;
+        head_got = 0;
+        ring_consume(&_rx_ring, ring_used(&_rx_ring));
+    }
+    
+    for ( ;; )
+    {
+        if (head_got < sizeof(head))
+        {
+            head_got += ring_read(&_rx_ring, head + head_got, sizeof(head) - head_got);
+            if (head_got < sizeof(head))
+                return;
+            
+            pkt.length = (head[0] << 8) | head[1];
+            pkt.endpoint = (head[2] << 8) | head[3];
+            got = 0;
+            if (pkt.length > BT_RX_MAX_PAYLOAD)
+                BT_LOG("BT", APP_LOG_LEVEL_ERROR, "RX: payload length %d. Skipping it", pkt.length);
+        }
         
-    return true;
+        if (pkt.length > BT_RX_MAX_PAYLOAD)
+        {
+            /* too big for us, but the length still says where the next one starts */
+            n = ring_peek(&_rx_ring, &p);
+            if (n > pkt.length - got)
+                n = pkt.length - got;
+            ring_consume(&_rx_ring, n);
+        }
+        else
+        {
+            n = ring_read(&_rx_ring, _rx_buf + got, pkt.length - got);
+        }
+        got += n;
+        
+        if (got < pkt.length)
+            return;
+        
+        head_got = 0;
+        if (pkt.length <= BT_RX_MAX_PAYLOAD)
+        {
+            BT_LOG("BT", APP_LOG_LEVEL_INFO, "RX: GOOD packet. len %d end %d", pkt.length, pkt.endpoint);
+            _stats_frame(pkt.endpoint, pkt.length, false);
+            _stats_time(&_bt_stats.rx_dispatch, since, hw_cycle_count());
+            _process_packet(&pkt);
+        }
+    }
 }
 
 /* 
- * Given a packet, process it and call the relevant function
+ * Given a packet, hand it to its endpoint. See endpoint.c for which
+ * run here and which are passed on, so RX isn't held up
  */
 static void _process_packet(pbl_transport_packet *pkt)
 {
-    /*
-     * We should be fast in this function!
-     * Work out which message needs to be processed, and escape from here fast
-     * This will likely be holding up RX otherwise.
-     */
     BT_LOG("BT", APP_LOG_LEVEL_INFO, "BT Got Data L:%d", pkt->length);
-        
-    // Endpoint Firmware Version
-    switch(pkt->endpoint) {
-        case ENDPOINT_FIRMWARE_VERSION:
-            process_version_packet(pkt->data);
-            break;
-        case ENDPOINT_SET_TIME:
-            process_set_time_packet(pkt->data);
-            break;
-        case ENDPOINT_PHONE_MSG:
-            process_notification_packet(pkt->data);
-            break;
-        default:
-            BT_LOG("BT", APP_LOG_LEVEL_INFO, "XXX Unimplemented Endpoint %d", pkt->endpoint);
-    }
+    endpoint_dispatch(pkt->endpoint, pkt->data, pkt->length);
 }
 
 
@@ -274,6 +414,7 @@ static void _process_packet(pbl_transport_packet *pkt)
 static void _bt_thread(void *pvParameters)
 {
     /* We are blocked here while bluetooth further delegates a runloop */
+    boot_profile_step_start(BootProfileBluetooth);
     hw_bluetooth_init();
 
     /* Delete ourself and die */
@@ -295,27 +436,38 @@ static void _bt_cmd_thread(void *pvParameters)
     for( ;; )
     {
         /* We are going to wait for a message. This is mostly going to be TX messages
-         * We have a queue size of one, which blocks and serialises all callers
+         * Whatever is in the ring goes out one after the other, without
+         * going back to the senders in between
          */
         if (xQueueReceive(_bt_cmd_queue, &pkt, portMAX_DELAY))
         {
-            if (pkt.packet_type == PACKET_TYPE_TX)
+            if (pkt.packet_type == PACKET_TYPE_RX)
             {
-//                 BT_LOG("BT", APP_LOG_LEVEL_INFO, "TX %d byte", pkt.length);
-                /* Do a blocking send. The thread will be asleep while the data is DMAed */
-                bluetooth_send_serial_raw(pkt.data, pkt.length);
+                _rx_drain();
+            }
+            else if (pkt.packet_type == PACKET_TYPE_TX)
+            {
+                bool sent = false;
                 
-                /* Use our semaphore to notify the calling thread that we are TX done */
-                if (!xTaskNotify(_tx_task_to_notify, TX_NOTIFY_COMPLETE, eSetBits))
-                {
-                    BT_LOG("BT", APP_LOG_LEVEL_ERROR, "TX Timed out after %dms", TX_TIMEOUT_MS);
-                    xTaskNotify(_tx_task_to_notify, TX_NOTIFY_COMPLETE, eSetBits);
-                    continue;
-                }
+                _stats_time(&_bt_stats.tx_queue, pkt.queued_at, hw_cycle_count());
+//                 BT_LOG("BT", APP_LOG_LEVEL_INFO, "TX %d byte", pkt.length);
+                /* Do a blocking send. The thread will be asleep while the data is DMAed.
+                 * Gone away since it was queued? Then it fails straight off,
+                 * rather than each waiting out the timeout */
+                if (_connected)
+                    sent = _send_serial(pkt.head, pkt.head_length, pkt.data, pkt.length) != 0;
                 
                 /* We might have been given a TX callback function to call */
-//                 if (pkt.callback != NULL)
-//                     pkt.callback();
+                if (pkt.callback != NULL)
+                    pkt.callback(pkt.data, pkt.length, sent);
+                
+                /* Or someone waiting. They know from our notification that we are TX done */
+                if (pkt.notify_task != NULL)
+                    xTaskNotify(pkt.notify_task, TX_NOTIFY_COMPLETE, eSetBits);
+                
+                /* RX that came in while the queue was too full to say so */
+                if (ring_used(&_rx_ring))
+                    _rx_drain();
             }
         }
         else
@@ -331,36 +483,54 @@ static void _bt_cmd_thread(void *pvParameters)
 
 
 /*
- * Send a Pebble packet right now
+ * Send a Pebble packet right now. The header goes down beside the
+ * payload, not in front of a copy of it
  */
 void bluetooth_send_packet(uint16_t endpoint, uint8_t *data, uint16_t len)
 {
-    uint8_t tx_buf[len + 4];
-    tx_buf[0] = ((uint8_t)(len >> 8));
-    tx_buf[1] = ((uint8_t)(len & 0xff));
-    tx_buf[2] = ((uint8_t)(endpoint >> 8));
-    tx_buf[3] = ((uint8_t)(endpoint & 0xff));
-
-    memcpy(&tx_buf[4], data, len);
-    bluetooth_send(tx_buf, len + 4);
+    uint8_t head[4];
+    head[0] = ((uint8_t)(len >> 8));
+    head[1] = ((uint8_t)(len & 0xff));
+    head[2] = ((uint8_t)(endpoint >> 8));
+    head[3] = ((uint8_t)(endpoint & 0xff));
+
+    if (!_enabled || !_connected)
+        return;
+
+    _bluetooth_tx(head, sizeof(head), data, len);
 }
 
-/* 
- * Request a TX through the outboud thread mechanism
- */
-void bluetooth_send_async(uint8_t *data, size_t len, tx_complete_callback cb)
+static bool _bluetooth_queue_tx(uint8_t *head, uint8_t head_len, uint8_t *data, size_t len,
+                                tx_complete_callback cb, TaskHandle_t notify_task)
 {
     if (!_enabled || !_connected)
-        return;
+        return false;
     
     rebble_bt_packet packet = {
         .length = len,
         .packet_type = PACKET_TYPE_TX,
         .data = data,
-        .callback = cb
+        .head = head,
+        .head_length = head_len,
+        .callback = cb,
+        .notify_task = notify_task,
+        .queued_at = hw_cycle_count(),
     };
 
+    /* only waits if the ring is full */
     xQueueSendToBack(_bt_cmd_queue, &packet, portMAX_DELAY);
+    
+    return true;
+}
+
+/* 
+ * Request a TX through the outboud thread mechanism, and return as soon
+ * as it is queued. data must stay put until cb is called. false if we
+ * aren't connected, and cb won't be
+ */
+bool bluetooth_send_async(uint8_t *data, size_t len, tx_complete_callback cb)
+{
+    return _bluetooth_queue_tx(NULL, 0, data, len, cb, NULL);
 }
     
 inline uint8_t bluetooth_send(uint8_t *data, size_t len)
@@ -368,19 +538,94 @@ inline uint8_t bluetooth_send(uint8_t *data, size_t len)
     if (!_enabled || !_connected)
         return len;
 
-    return _bluetooth_tx(data, len);
+    return _bluetooth_tx(NULL, 0, data, len);
 }
 
 void bluetooth_device_connected(void)
 {
     _connected = true;
     connection_service_update(true);
+    data_logging_connection_update(true);
 }
 
 void bluetooth_device_disconnected(void)
 {
+    rebble_bt_packet kick = {
+        .packet_type = PACKET_TYPE_RX,
+    };
+    
     _connected = false;
+    _rx_reset = true;
+    xQueueSendToBack(_bt_cmd_queue, &kick, 0);
     connection_service_update(false);
+    data_logging_connection_update(false);
+}
+
+void bluetooth_get_byte_counts(uint32_t *tx_bytes, uint32_t *rx_bytes)
+{
+    *tx_bytes = _bt_stats.tx_bytes;
+    *rx_bytes = _bt_stats.rx_bytes;
+}
+
+void bluetooth_get_stats(BtStats *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = _bt_stats;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Something big is going over, an install say: ask for the fast link
+ * until ms after the last call, then it relaxes back by itself
+ */
+void bluetooth_link_boost(uint32_t ms)
+{
+    if (!_enabled || !_connected)
+        return;
+
+    bt_device_link_boost(ms);
+}
+
+typedef struct __attribute__((__packed__)) BtStatsPacket {
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+    bt_link_params_t link;
+    BtStats stats;
+} BtStatsPacket;
+
+/* too big for the callers' stacks */
+static BtStatsPacket _pkt;
+
+static void _log_time(const char *what, BtTimeStats *st)
+{
+    SYS_LOG("BT", APP_LOG_LEVEL_INFO, "%s: %lu, avg %lu us max %lu us",
+            what, st->count, st->count ? st->total_us / st->count : 0, st->max_us);
+}
+
+/*
+ * Debug endpoint. Any packet gets the counts, the timings and the link
+ * as it stands, logged and sent back raw
+ */
+void process_bt_stats_packet(uint8_t *data, uint16_t len)
+{
+    BtStats *st = &_pkt.stats;
+
+    bluetooth_get_stats(st);
+    _pkt.tx_bytes = st->tx_bytes;
+    _pkt.rx_bytes = st->rx_bytes;
+    bt_device_link_params(&_pkt.link);
+    SYS_LOG("BT", APP_LOG_LEVEL_INFO, "tx %lu rx %lu bytes, %s link: interval %d latency %d timeout %d, ATT MTU %d, RFCOMM frame %d",
+            _pkt.tx_bytes, _pkt.rx_bytes, _pkt.link.fast ? "fast" : "idle", _pkt.link.interval,
+            _pkt.link.latency, _pkt.link.timeout, _pkt.link.att_mtu, _pkt.link.rfcomm_frame);
+    SYS_LOG("BT", APP_LOG_LEVEL_INFO, "%lu TX timeouts, %lu RX bytes lost", st->tx_timeouts, st->rx_lost_bytes);
+    _log_time("tx queued", &st->tx_queue);
+    _log_time("tx sent", &st->tx_send);
+    _log_time("rx dispatched", &st->rx_dispatch);
+    for (uint8_t i = 0; i < st->endpoint_count; i++)
+        SYS_LOG("BT", APP_LOG_LEVEL_INFO, "endpoint 0x%04x: tx %lu packets %lu bytes, rx %lu packets %lu bytes",
+                st->endpoint[i].endpoint, st->endpoint[i].tx_packets, st->endpoint[i].tx_bytes,
+                st->endpoint[i].rx_packets, st->endpoint[i].rx_bytes);
+    bluetooth_send_packet(ENDPOINT_BT_STATS, (uint8_t *)&_pkt, sizeof(_pkt));
 }
 
 bool bluetooth_is_device_connected(void)
@@ -388,36 +633,30 @@ bool bluetooth_is_device_connected(void)
     return _connected;
 }
 
-static uint8_t _bluetooth_tx(uint8_t *data, uint16_t len)
+static uint8_t _bluetooth_tx(uint8_t *head, uint8_t head_len, uint8_t *data, uint16_t len)
 {
-    BaseType_t result;
-    uint32_t notif_value;
+    uint32_t notif_value = 0;
     
-    /* Grab the callee's task handle so we can sleep on it */
-     _tx_task_to_notify = xTaskGetCurrentTaskHandle();
-     
-    /* This will block if there is something in progress already (queue size 1) */
-    bluetooth_send_async(data, len, NULL);
+    /* An endpoint answering from the cmd thread. Nobody else would send it */
+    if (xTaskGetCurrentTaskHandle() == _bt_cmd_task)
+        return _send_serial(head, head_len, data, len) ? len : 0;
     
-    /* We sleep block again waiting for TX complete */
-    result = xTaskNotifyWait(pdFALSE,    /* Don't clear bits on entry. */
-                         0xffffffff,        /* Clear all bits on exit. */
-                         &notif_value, /* Stores the notified value. */
-                         pdMS_TO_TICKS(TX_TIMEOUT_MS));
-
-    if(result == pdPASS)
-    {
-        if ((notif_value & TX_NOTIFY_COMPLETE) != 0)
-        {
-            BT_LOG("BT", APP_LOG_LEVEL_INFO, "TX Sent %d bytes", len);
-        }
-    }
-    else
-    {
-        BT_LOG("BT", APP_LOG_LEVEL_ERROR, "TX Timed out after %dms", TX_TIMEOUT_MS);
+    /* The callee's task handle goes with the packet, so we can sleep on it.
+     * This only blocks if the ring is full */
+    if (!_bluetooth_queue_tx(head, head_len, data, len, NULL, xTaskGetCurrentTaskHandle()))
         return 0;
-    }
-
+    
+    /* We sleep block again waiting for TX complete. Our data is likely on
+     * our stack, so we can't leave before the cmd thread is done with it,
+     * however long the packets ahead of us take. Each of those gives up
+     * by itself after a while */
+    while (!(notif_value & TX_NOTIFY_COMPLETE))
+        xTaskNotifyWait(pdFALSE,    /* Don't clear bits on entry. */
+                        0xffffffff,        /* Clear all bits on exit. */
+                        &notif_value, /* Stores the notified value. */
+                        portMAX_DELAY);
+
+    BT_LOG("BT", APP_LOG_LEVEL_INFO, "TX Sent %d bytes", len);
 
     return len;
 }
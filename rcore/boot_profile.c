@@ -0,0 +1,136 @@
+/* boot_profile.c
+ * Where boot's time goes
+ * RebbleOS
+ *
+ * Each boot module and the slow hardware steps under them are stamped on
+ * the cycle counter as they start and finish, along with a few moments
+ * that matter to whoever is waiting on the watch: the first frame out
+ * and Bluetooth being ready. The record is kept for as long as we are up,
+ * and can be logged or pulled over the debug endpoint at any time.
+ *
+ * Only the first of anything is kept. Bluetooth comes up again after
+ * every power cycle, and that isn't boot.
+ */
+
+#include "rebbleos.h"
+#include "boot_profile.h"
+#include "endpoint.h"
+
+static BootProfileRecord _boot;
+/* where the counter was at the start, everything is relative to it */
+static uint32_t _boot_base;
+
+/* 0 means never, so nothing can happen on the very first cycle */
+static uint32_t _boot_now(void)
+{
+    uint32_t now = hw_cycle_count() - _boot_base;
+
+    return now ? now : 1;
+}
+
+/*
+ * As early in main as the clocks allow
+ */
+void boot_profile_init(void)
+{
+    _boot_base = hw_cycle_count();
+}
+
+void boot_profile_step_start(BootProfileStep step)
+{
+    if (!_boot.step[step].start)
+        _boot.step[step].start = _boot_now();
+}
+
+void boot_profile_step_end(BootProfileStep step)
+{
+    if (!_boot.step[step].end)
+        _boot.step[step].end = _boot_now();
+}
+
+void boot_profile_module_start(OsModule module)
+{
+    if (!_boot.module[module].start)
+        _boot.module[module].start = _boot_now();
+}
+
+void boot_profile_module_end(OsModule module)
+{
+    if (!_boot.module[module].end)
+        _boot.module[module].end = _boot_now();
+}
+
+/* Safe from ISRs. Worst case two racing callers both write */
+void boot_profile_event(BootProfileEvent event)
+{
+    if (!_boot.event[event])
+        _boot.event[event] = _boot_now();
+}
+
+const BootProfileRecord *boot_profile_get(void)
+{
+    _boot.cycles_per_us = hw_cycles_per_us();
+    return &_boot;
+}
+
+static const char * const _step_names[BootProfileStepCount] = {
+    [BootProfilePlatform]  = "platform",
+    [BootProfileFlash]     = "flash",
+    [BootProfileDisplay]   = "display",
+    [BootProfileBluetooth] = "bluetooth",
+};
+
+static const char * const _event_names[BootProfileEventCount] = {
+    [BootProfileScheduler]      = "scheduler",
+    [BootProfileAllUp]          = "all up",
+    [BootProfileFirstFrame]     = "first frame",
+    [BootProfileBluetoothReady] = "bt ready",
+    [BootProfileSplash]         = "splash",
+    [BootProfileBluetoothPatched] = "bt patched",
+};
+
+static void _dump_span(const char *name, const BootProfileSpan *span, uint32_t per_us)
+{
+    if (!span->start)
+        return;
+
+    if (!span->end)
+    {
+        SYS_LOG("boot", APP_LOG_LEVEL_INFO, "%s: at %lu us, not done", name, span->start / per_us);
+        return;
+    }
+    SYS_LOG("boot", APP_LOG_LEVEL_INFO, "%s: at %lu us took %lu us", name,
+            span->start / per_us, (span->end - span->start) / per_us);
+}
+
+/*
+ * Log the record, in microseconds since reset
+ */
+void boot_profile_dump(void)
+{
+    const BootProfileRecord *rec = boot_profile_get();
+    uint32_t per_us = rec->cycles_per_us ? rec->cycles_per_us : 1;
+
+    if (!hw_cycle_count())
+    {
+        SYS_LOG("boot", APP_LOG_LEVEL_WARNING, "no cycle counter, nothing was timed");
+        return;
+    }
+
+    for (uint8_t i = 0; i < BootProfileStepCount; i++)
+        _dump_span(_step_names[i], &rec->step[i], per_us);
+    for (uint8_t i = 0; i < OsModuleMax; i++)
+        _dump_span(os_module_name(i), &rec->module[i], per_us);
+    for (uint8_t i = 0; i < BootProfileEventCount; i++)
+        if (rec->event[i])
+            SYS_LOG("boot", APP_LOG_LEVEL_INFO, "%s: at %lu us", _event_names[i], rec->event[i] / per_us);
+}
+
+/*
+ * Debug endpoint. Any packet gets the record logged and sent back raw
+ */
+void process_boot_profile_packet(uint8_t *data, uint16_t len)
+{
+    boot_profile_dump();
+    bluetooth_send_packet(ENDPOINT_BOOT_PROFILE, (uint8_t *)boot_profile_get(), sizeof(BootProfileRecord));
+}
@@ -0,0 +1,53 @@
+#pragma once
+/* boot_profile.h
+ * Where boot's time goes
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include "rebbleos.h"
+
+/* The hardware bring up steps, timed on top of the boot modules */
+typedef enum BootProfileStep {
+    BootProfilePlatform,
+    BootProfileFlash,
+    BootProfileDisplay,
+    BootProfileBluetooth,
+    BootProfileStepCount
+} BootProfileStep;
+
+/* One off moments after reset */
+typedef enum BootProfileEvent {
+    BootProfileScheduler,
+    BootProfileAllUp,
+    BootProfileFirstFrame,
+    BootProfileBluetoothReady,
+    BootProfileSplash,
+    BootProfileBluetoothPatched,
+    BootProfileEventCount
+} BootProfileEvent;
+
+/* Cycles since reset, 0 if it never happened. The cycle counter wraps
+ * after ~40s at 100MHz, far longer than a boot should take */
+typedef struct BootProfileSpan {
+    uint32_t start;
+    uint32_t end;
+} __attribute__((__packed__)) BootProfileSpan;
+
+typedef struct BootProfileRecord {
+    /* to turn the rest into time */
+    uint32_t cycles_per_us;
+    BootProfileSpan step[BootProfileStepCount];
+    BootProfileSpan module[OsModuleMax];
+    uint32_t event[BootProfileEventCount];
+} __attribute__((__packed__)) BootProfileRecord;
+
+void boot_profile_init(void);
+void boot_profile_step_start(BootProfileStep step);
+void boot_profile_step_end(BootProfileStep step);
+void boot_profile_module_start(OsModule module);
+void boot_profile_module_end(OsModule module);
+void boot_profile_event(BootProfileEvent event);
+const BootProfileRecord *boot_profile_get(void);
+void boot_profile_dump(void);
+void process_boot_profile_packet(uint8_t *data, uint16_t len);
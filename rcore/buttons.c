@@ -8,7 +8,6 @@
 /*
  * MODULE TODO
  * 
- * Button Multi click support
  * buttonholder -> clickrecognizer convert / typedef
  * Theres a couple of bytes of ram to be shaved
  * 
@@ -18,13 +17,10 @@
 #include "task.h"
 #include "queue.h"
 #include "buttons.h"
+#include "notification_manager.h"
+#include "input_latency.h"
 
 #define STACK_SIZE_BUTTON_THREAD    configMINIMAL_STACK_SIZE + 210
-#define STACK_SIZE_BUTTON_DEBOUNCE  configMINIMAL_STACK_SIZE + 210
-
-static TaskHandle_t _button_debounce_task;
-static StaticTask_t _button_debounce_task_buf;
-static StackType_t _button_debounce_task_stack[STACK_SIZE_BUTTON_DEBOUNCE];
 
 static TaskHandle_t _button_message_task;
 static StaticTask_t _button_message_task_buf;
@@ -37,11 +33,16 @@ static uint8_t _button_queue_contents[BUTTON_QUEUE_SIZE];
 
 static ButtonMessage _button_message;
 static uint8_t _last_press; // TODO
+/* edges are ignored until this tick, while the contacts settle */
+static volatile TickType_t _debounce_until;
+static volatile bool _debounce_pending;
 static void _button_message_thread(void *pvParameters);
-static void _button_debounce_thread(void *pvParameters);
+static void _button_debounce(void *arg);
 static void _button_update(ButtonId button_id, uint8_t press);
 static void _button_released(ButtonHolder *button);
-static uint8_t _button_check_time(void);
+static void _button_multi_clicked(ButtonHolder *button, TickType_t now);
+static void _button_multi_timeout(ButtonHolder *button);
+static TickType_t _button_check_time(void);
 static ButtonHolder *_button_holders[NUM_BUTTONS];
 
 void button_send_app_click(void *callback, void *recognizer, void *context);
@@ -74,8 +75,6 @@ uint8_t rcore_buttons_init(void)
                                              _button_message_task_stack, 
                                              &_button_message_task_buf);
     
-    _button_debounce_task = xTaskCreateStatic(_button_debounce_thread, "Debounce", STACK_SIZE_BUTTON_DEBOUNCE, NULL, tskIDLE_PRIORITY + 5UL, _button_debounce_task_stack, &_button_debounce_task_buf);
-    
     
    
 //     KERN_LOG("buttons", APP_LOG_LEVEL_INFO, "Button Task Created");
@@ -88,17 +87,15 @@ uint8_t rcore_buttons_init(void)
  */
 static void _button_isr(hw_button_t /* which is definitionally the same as a ButtonID */ button_id)
 {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    
     _last_press = button_id;
 
-    vTaskNotifyGiveFromISR(_button_debounce_task, &xHigherPriorityTaskWoken);
+    /* still bouncing, or already on its way */
+    if (_debounce_pending || (int32_t)(xTaskGetTickCountFromISR() - _debounce_until) < 0)
+        return;
 
-    /* If xHigherPriorityTaskWoken is now set to pdTRUE then a context switch
-    should be performed to ensure the interrupt returns directly to the highest
-    priority task.  The macro used for this purpose is dependent on the port in
-    use and may be called portEND_SWITCHING_ISR(). */
-    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    _debounce_pending = defer_from_isr(_button_debounce, NULL);
+    if (_debounce_pending)
+        input_latency_edge();
 }
 
 /*
@@ -139,10 +136,18 @@ static void _button_update(ButtonId button_id, uint8_t press)
         if (button->click_config.raw.down_handler)
         {
             button_send_app_click(button->click_config.raw.down_handler,
-                NULL, // TODO
+                button,
                 button->click_config.context);
         }
+        // a press that doesn't carry on a multi click starts counting again
+        if (button->state != BUTTON_STATE_MULTI)
+            button->clicks = 0;
         button->state = BUTTON_STATE_PRESSED;
+
+#ifdef PERF_HUD
+        if (_button_pressed(BUTTON_ID_UP) && _button_pressed(BUTTON_ID_DOWN))
+            perf_hud_toggle();
+#endif
     }
     else
     {
@@ -159,16 +164,19 @@ static void _button_released(ButtonHolder *button)
 {
     uint32_t now = xTaskGetTickCount();
     uint32_t delta_ms = portTICK_PERIOD_MS * (now - button->press_time);
+    bool multi = button->click_config.multi_click.handler != NULL;
     
     // we are releasing and it has a click handler
     // if we have long click, we are below the trigger threshold
-    if (button->click_config.click.handler ||
+    // with a multi click, a single click waits to see if another follows
+    if (!multi && (button->click_config.click.handler ||
         (button->click_config.click.handler && 
         button->click_config.long_click.handler &&
-        delta_ms < button->click_config.long_click.delay_ms))
+        delta_ms < button->click_config.long_click.delay_ms)))
     {
+        button->clicks = 1;
         button_send_app_click(button->click_config.click.handler,
-                NULL, // TODO
+                button,
                 button->click_config.context);
     }
     
@@ -178,7 +186,7 @@ static void _button_released(ButtonHolder *button)
     {
         // only trigger the release if we are over the repeat time
         button_send_app_click(button->click_config.long_click.release_handler,
-                NULL, // TODO
+                button,
                 button->click_config.context);
     }
     
@@ -187,84 +195,173 @@ static void _button_released(ButtonHolder *button)
     {
         //button->click_config.raw.up_handler(NULL, NULL);
         button_send_app_click(button->click_config.raw.up_handler,
-                NULL, // TODO
+                button,
                 button->click_config.context);
     }
     
     button->press_time = 0;
     button->repeat_time = 0;
-    button->state = BUTTON_STATE_RELEASED;
+
+    // held long or repeating isn't a click, and ends any multi click
+    if (multi && button->state == BUTTON_STATE_PRESSED)
+        _button_multi_clicked(button, now);
+    else
+        button->state = BUTTON_STATE_RELEASED;
+}
+
+static void _button_send_multi(ButtonHolder *button)
+{
+    if (button->click_config.multi_click.handler)
+        button_send_app_click(button->click_config.multi_click.handler,
+                button,
+                button->click_config.context);
+}
+
+/*
+ * Count a click of a multi click. Either it's as many as the handler
+ * wants, or the timeout starts for the next one. Every count from min
+ * on goes to the handler as it happens, unless it only wants the last
+ */
+static void _button_multi_clicked(ButtonHolder *button, TickType_t now)
+{
+    ClickConfig *config = &button->click_config;
+
+    button->clicks++;
+    if (!config->multi_click.last_click_only && button->clicks >= config->multi_click.min)
+        _button_send_multi(button);
+
+    if (button->clicks >= config->multi_click.max)
+    {
+        if (config->multi_click.last_click_only)
+            _button_send_multi(button);
+        button->state = BUTTON_STATE_MULTI_DONE;
+        return;
+    }
+
+    button->multi_time = now;
+    button->state = BUTTON_STATE_MULTI;
+}
+
+/*
+ * No more clicks came. Enough of them is the multi click, if it was
+ * waiting for the last; one on its own was only ever a single click
+ */
+static void _button_multi_timeout(ButtonHolder *button)
+{
+    ClickConfig *config = &button->click_config;
+
+    button->state = BUTTON_STATE_MULTI_DONE;
+    if (button->clicks >= config->multi_click.min)
+    {
+        if (config->multi_click.last_click_only)
+            _button_send_multi(button);
+    }
+    else if (button->clicks == 1 && config->click.handler)
+    {
+        button_send_app_click(config->click.handler,
+                button,
+                config->context);
+    }
+}
+
+/* The ticks from now that a deadline falls due, given it fires once we
+ * are strictly past it. Never more than wait */
+static TickType_t _button_due(TickType_t deadline, TickType_t now, TickType_t wait)
+{
+    int32_t left = (int32_t)(deadline - now) + 1;
+
+    if (left < 0)
+        left = 0;
+
+    return (TickType_t)left < wait ? (TickType_t)left : wait;
 }
 
 /*
  * Each button has a timestamp for when it last performed an action
  * If the button is set to, say, repeat, then we look for timed out
  * buttons and trigger the relevant action.
+ * Returns how long until the next of those is due, so the thread
+ * sleeps straight through to it; portMAX_DELAY if nothing is
  */
-static uint8_t _button_check_time(void)
+static TickType_t _button_check_time(void)
 {
     uint32_t now = xTaskGetTickCount();
     ButtonHolder *button;
-    uint8_t pressed, any_pressed = 0;    
+    TickType_t wait = portMAX_DELAY;
 
     for (uint8_t i = 0; i < NUM_BUTTONS; i++)
     {
         button = _button_holders[i];
-        pressed = _button_pressed(i);
-                
-        if (!pressed)
+
+        // let go, and the next click of a multi click is due by the timeout
+        if (button->state == BUTTON_STATE_MULTI)
         {
+            TickType_t deadline = button->multi_time + (button->click_config.multi_click.timeout / portTICK_PERIOD_MS);
+
+            if (now > deadline)
+                _button_multi_timeout(button);
+            else
+                wait = _button_due(deadline, now, wait);
             continue;
         }
-        else
-        {
-            any_pressed = 1;
-        }
+                
+        if (!_button_pressed(i))
+            continue;
         
         // button is still pressed
         // we have a click and a repeat
         if (button->click_config.click.handler && button->repeat_time > 0 && 
             button->click_config.click.repeat_interval_ms > 0)
         {
+            TickType_t deadline = button->repeat_time + (button->click_config.click.repeat_interval_ms / portTICK_PERIOD_MS);
+
             // and the time of the last repeat was < now
-            if (now > button->repeat_time + (button->click_config.click.repeat_interval_ms / portTICK_PERIOD_MS))
+            if (now > deadline)
             {
                 button->state = BUTTON_STATE_REPEATING;
                 button_send_app_click(button->click_config.click.handler,
-                        NULL, // TODO
+                        button,
                         button->click_config.context);
                 
                 // reset the time
                 button->repeat_time = now;
+                deadline = now + (button->click_config.click.repeat_interval_ms / portTICK_PERIOD_MS);
             }
+            wait = _button_due(deadline, now, wait);
         }
         
         // button pressed, and we just blasted past the long press time
         if (button->click_config.long_click.handler && button->press_time > 0 && 
             button->click_config.long_click.delay_ms > 0)
         {
-            if (now > button->press_time + (button->click_config.long_click.delay_ms / portTICK_PERIOD_MS))
+            TickType_t deadline = button->press_time + (button->click_config.long_click.delay_ms / portTICK_PERIOD_MS);
+
+            if (now > deadline)
             {
                 button->state = BUTTON_STATE_LONG;
                 button_send_app_click(button->click_config.long_click.handler,
-                        NULL, // TODO
+                        button,
                         button->click_config.context);
                 
                 // stop further processing
                 button->press_time = 0;
                 button->repeat_time = 0;
             }
+            else
+            {
+                wait = _button_due(deadline, now, wait);
+            }
         }
     }
     
-    return any_pressed;
+    return wait;
 }
 
 /*
  * Take the incoming button presses from the debounced input, and process them
- * also take care of looping around the button press checker
- * The main loop will only halt into a permanent sleep once
- * all buttons are released. Until that time, it will loop in n ms intervals
+ * Between presses and releases, we only wake up when a long press or a
+ * repeat is due. Releases arrive on the queue like presses do, so
+ * holding a button with neither set up sleeps until it is let go
  */
 static void _button_message_thread(void *pvParameters)
 {
@@ -276,39 +373,30 @@ static void _button_message_thread(void *pvParameters)
     {
         if (xQueueReceive(_button_queue, &data, time_increment))
         {           
+            input_latency_hop(InputHopButton);
             _button_update(data, _button_pressed(data));
+            input_latency_settled();
         }
 
         time_increment = _button_check_time();
-
-        if (time_increment == 0)
-            time_increment = portMAX_DELAY;
-        else
-            time_increment = pdMS_TO_TICKS(10);
     }
 }
 
 /*
- * Debounce the button
+ * Debounce the button. On the defer thread, from the first edge. Edges
+ * for a little while after are the contacts bouncing, and the ISR drops
+ * them. The message thread reads the button's level itself, so it is
+ * the level once settled that counts, not which edge we saw
  */
-static void _button_debounce_thread(void *pvParameters)
+static void _button_debounce(void *arg)
 {
-    for( ;; )
-    {
-        // sleep forever waiting for something on the interrupts to wake us
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    _debounce_until = xTaskGetTickCount() + butDEBOUNCE_DELAY;
+    _debounce_pending = false;
+    input_latency_hop(InputHopDebounce);
 
-        // tell the main worker we have something
-        xQueueSendToBack(_button_queue, &_last_press, (TickType_t)100);
-
-        // because we are using a notification on the task, any further triggers while
-        // the buttons are bouncing are ignored while we are sleeping
-        // so lets go ahead and have a nap                           
-        vTaskDelay(butDEBOUNCE_DELAY);
-        
-        // one last cleardown of our notification just to be sure
-        ulTaskNotifyTake(pdTRUE, 0);
-    }
+    // tell the main worker we have something. Not waiting, the defer
+    // thread is shared and the message thread empties this quickly
+    xQueueSendToBack(_button_queue, &_last_press, 0);
 }
 
 
@@ -318,12 +406,13 @@ static void _button_debounce_thread(void *pvParameters)
 void button_send_app_click(void *callback, void *recognizer, void *context)
 {   
     _button_message.callback = callback;
-    _button_message.clickref = recognizer; // TODO
+    _button_message.clickref = recognizer;
     _button_message.context  = context;
 
     rcore_backlight_on(100, 3000);
     
     appmanager_post_button_message(&_button_message);
+    input_latency_hop(InputHopPosted);
 }
 
 
@@ -364,7 +453,14 @@ void button_multi_click_subscribe(ButtonId button_id, uint8_t min_clicks, uint8_
     if (button_id >= NUM_BUTTONS)
         return;
     
-//     ButtonHolder *holder = _button_holders[button_id]; // get the button
+    ButtonHolder *holder = _button_holders[button_id]; // get the button
+    // as the SDK has it, 0 is 2 clicks, a max of 0 is min and no timeout is 300ms
+    holder->click_config.multi_click.min = min_clicks ? min_clicks : 2;
+    holder->click_config.multi_click.max = max_clicks > holder->click_config.multi_click.min ?
+                                           max_clicks : holder->click_config.multi_click.min;
+    holder->click_config.multi_click.timeout = timeout ? timeout : BUTTON_MULTI_CLICK_TIMEOUT_MS;
+    holder->click_config.multi_click.last_click_only = last_click_only;
+    holder->click_config.multi_click.handler = handler;
 }
 
 void button_long_click_subscribe(ButtonId button_id, uint16_t delay_ms, ClickHandler down_handler, ClickHandler up_handler)
@@ -407,3 +503,20 @@ void button_set_click_context(ButtonId button_id, void *context)
     _button_holders[button_id]->click_config.context = context;
 }
 
+/*
+ * The recognizer a click handler is given is the button's holder
+ */
+uint8_t click_number_of_clicks_counted(ClickRecognizerRef recognizer)
+{
+    return recognizer ? ((ButtonHolder *)recognizer)->clicks : 0;
+}
+
+ButtonId click_recognizer_get_button_id(ClickRecognizerRef recognizer)
+{
+    return recognizer ? ((ButtonHolder *)recognizer)->button_id : 0;
+}
+
+bool click_recognizer_is_repeating(ClickRecognizerRef recognizer)
+{
+    return recognizer && ((ButtonHolder *)recognizer)->state == BUTTON_STATE_REPEATING;
+}
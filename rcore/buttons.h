@@ -20,11 +20,17 @@
 #define BUTTON_STATE_MULTI      4
 #define BUTTON_STATE_MULTI_DONE 5
 
+/* the SDK's default gap between the clicks of a multi click */
+#define BUTTON_MULTI_CLICK_TIMEOUT_MS   300
+
+/* what a click handler is given as its ClickRecognizerRef */
 typedef struct ButtonHolder {
     uint8_t button_id;
     ClickConfig click_config;
     TickType_t repeat_time;
     TickType_t press_time;
+    TickType_t multi_time; /* the last release of a multi click, the timeout runs from it */
+    uint8_t clicks; /* in the multi click going, or the last one */
     uint8_t state;
 } ButtonHolder;
 
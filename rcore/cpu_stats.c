@@ -0,0 +1,271 @@
+/* cpu_stats.c
+ * Who is eating the CPU
+ * RebbleOS
+ *
+ * FreeRTOS keeps each task's run time in core cycles (see
+ * FreeRTOSConfig.h), and the switch in trace hook counts how many times
+ * each task has been switched in. Every time the watchdog's stack sampler
+ * walks the tasks, the same walk is handed to us and we take the
+ * difference from the last one: that window's cycles and switches per
+ * task, and its share of the window's wall time. What's left over is
+ * time spent asleep.
+ *
+ * The counters are 32 bits of cycles, so they wrap about every 40s of a
+ * task's CPU time. The window is much shorter than that, and unsigned
+ * differences don't mind one wrap.
+ *
+ * The app and worker threads are a new task for every app, so their
+ * cycles are also added up against whichever app was in them. The last
+ * part window of an app that quits is lost. The app's runloop adds each
+ * frame it draws, how long that took and whether it was held back.
+ */
+
+#include "rebbleos.h"
+#include "cpu_stats.h"
+#include "endpoint.h"
+
+/* warn about any app taking more than this of a window */
+#define CPU_STATS_APP_WARN_PERMILLE 500
+
+typedef struct CpuTask {
+    UBaseType_t number;
+    uint32_t cycles;
+    uint32_t switches;
+} CpuTask;
+
+/* the counters as of the last window, by task number */
+static CpuTask _last[CPU_STATS_MAX];
+static uint8_t _last_count;
+static TickType_t _last_tick;
+
+static CpuStats _stats[CPU_STATS_MAX];
+static uint8_t _stats_count;
+static uint32_t _window_ms;
+
+static CpuAppStats _apps[CPU_STATS_APPS];
+static TickType_t _apps_seen[CPU_STATS_APPS];
+static uint8_t _apps_count;
+
+static const CpuTask *_last_find(UBaseType_t number)
+{
+    for (uint8_t i = 0; i < _last_count; i++)
+        if (_last[i].number == number)
+            return &_last[i];
+
+    return NULL;
+}
+
+static CpuAppStats *_app_find(const char *name, TickType_t now)
+{
+    uint8_t slot = 0;
+
+    for (uint8_t i = 0; i < _apps_count; i++)
+    {
+        if (!strncmp(_apps[i].name, name, CPU_STATS_APP_NAME))
+        {
+            _apps_seen[i] = now;
+            return &_apps[i];
+        }
+        if (_apps_seen[i] < _apps_seen[slot])
+            slot = i;
+    }
+
+    /* full up, the one run longest ago makes way */
+    if (_apps_count < CPU_STATS_APPS)
+        slot = _apps_count++;
+
+    memset(&_apps[slot], 0, sizeof(CpuAppStats));
+    strncpy(_apps[slot].name, name, CPU_STATS_APP_NAME);
+    _apps_seen[slot] = now;
+
+    return &_apps[slot];
+}
+
+static void _app_account(AppThreadType type, TaskStatus_t *ts, uint32_t cycles,
+                         uint16_t permille, uint32_t window_ms, TickType_t now)
+{
+    app_running_thread *thread = appmanager_get_thread(type);
+
+    if (!thread || !thread->app || thread->task_handle != ts->xHandle)
+        return;
+
+    /* the app's runloop adds its frames in here too */
+    taskENTER_CRITICAL();
+    CpuAppStats *app = _app_find(thread->app->name, now);
+    app->cpu_ms += cycles / (hw_cycles_per_us() * 1000);
+    app->run_ms += window_ms;
+    if (permille > app->peak_permille)
+        app->peak_permille = permille;
+    taskEXIT_CRITICAL();
+
+    if (permille > CPU_STATS_APP_WARN_PERMILLE)
+        SYS_LOG("cpu", APP_LOG_LEVEL_WARNING, "%s is using %d.%d%% CPU", thread->app->name,
+                permille / 10, permille % 10);
+}
+
+/*
+ * A walk of the tasks from uxTaskGetSystemState. Closes off the window
+ * since the last one
+ */
+void cpu_stats_sample(TaskStatus_t *tasks, UBaseType_t count)
+{
+    /* off the watchdog thread's small stack */
+    static CpuTask now[CPU_STATS_MAX];
+    TickType_t tick = xTaskGetTickCount();
+    uint32_t window_ms = (tick - _last_tick) * portTICK_PERIOD_MS;
+    uint64_t wall = (uint64_t)window_ms * 1000 * hw_cycles_per_us();
+
+    /* an emulator without a cycle counter. nothing to count */
+    if (!hw_cycle_count())
+        return;
+
+    if (count > CPU_STATS_MAX)
+        count = CPU_STATS_MAX;
+
+    taskENTER_CRITICAL();
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        TaskStatus_t *ts = &tasks[i];
+        CpuStats *st = &_stats[i];
+
+        now[i].number = ts->xTaskNumber;
+        now[i].cycles = ts->ulRunTimeCounter;
+        now[i].switches = (uint32_t)pvTaskGetThreadLocalStoragePointer(ts->xHandle, CPU_STATS_TLS_SWITCHES);
+
+        /* a task that's new since last time has all of its counters */
+        const CpuTask *last = _last_find(ts->xTaskNumber);
+        strncpy(st->name, ts->pcTaskName, configMAX_TASK_NAME_LEN);
+        st->cycles = now[i].cycles - (last ? last->cycles : 0);
+        st->switches = now[i].switches - (last ? last->switches : 0);
+        st->permille = wall ? (uint16_t)(((uint64_t)st->cycles * 1000) / wall) : 0;
+    }
+    _stats_count = _last_tick ? count : 0;
+    _window_ms = window_ms;
+    taskEXIT_CRITICAL();
+
+    /* the very first walk is only the starting point */
+    if (_last_tick)
+    {
+        for (UBaseType_t i = 0; i < count; i++)
+        {
+            _app_account(AppThreadMainApp, &tasks[i], _stats[i].cycles, _stats[i].permille, window_ms, tick);
+            _app_account(AppThreadWorker, &tasks[i], _stats[i].cycles, _stats[i].permille, window_ms, tick);
+        }
+    }
+
+    memcpy(_last, now, count * sizeof(CpuTask));
+    _last_count = count;
+    _last_tick = tick;
+}
+
+/*
+ * A frame an app drew. From the app's runloop. over is that it ran past
+ * the render budget, held that the frame rate cap made it wait first
+ */
+void cpu_stats_app_frame(const char *name, uint32_t render_us, bool over, bool held)
+{
+    uint32_t ms = render_us / 1000;
+
+    taskENTER_CRITICAL();
+    CpuAppStats *app = _app_find(name, xTaskGetTickCount());
+    app->frames++;
+    app->frames_over += over;
+    app->frames_held += held;
+    if (ms > app->frame_max_ms)
+        app->frame_max_ms = ms > UINT16_MAX ? UINT16_MAX : ms;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Copy out each task's share of the last window, returns how many.
+ * window_ms is how long that was, and may be NULL
+ */
+uint8_t cpu_stats_get(CpuStats *stats, uint8_t max, uint32_t *window_ms)
+{
+    taskENTER_CRITICAL();
+    uint8_t count = _stats_count < max ? _stats_count : max;
+    memcpy(stats, _stats, count * sizeof(CpuStats));
+    if (window_ms)
+        *window_ms = _window_ms;
+    taskEXIT_CRITICAL();
+
+    return count;
+}
+
+/*
+ * Copy out what each app we remember has used, returns how many
+ */
+uint8_t cpu_stats_apps(CpuAppStats *stats, uint8_t max)
+{
+    taskENTER_CRITICAL();
+    uint8_t count = _apps_count < max ? _apps_count : max;
+    memcpy(stats, _apps, count * sizeof(CpuAppStats));
+    taskEXIT_CRITICAL();
+
+    return count;
+}
+
+typedef struct __attribute__((__packed__)) CpuStatsPacket {
+    uint32_t window_ms;
+    uint8_t task_count;
+    CpuStats task[CPU_STATS_MAX];
+    uint8_t app_count;
+    CpuAppStats app[CPU_STATS_APPS];
+} CpuStatsPacket;
+
+/* too big for the callers' stacks */
+static CpuStatsPacket _pkt;
+
+static void _cpu_stats_get(CpuStatsPacket *pkt)
+{
+    memset(pkt, 0, sizeof(CpuStatsPacket));
+    pkt->task_count = cpu_stats_get(pkt->task, CPU_STATS_MAX, &pkt->window_ms);
+    pkt->app_count = cpu_stats_apps(pkt->app, CPU_STATS_APPS);
+}
+
+/*
+ * Log the last window and the per app totals
+ */
+void cpu_stats_dump(void)
+{
+    uint16_t busy = 0;
+
+    _cpu_stats_get(&_pkt);
+    SYS_LOG("cpu", APP_LOG_LEVEL_INFO, "last %lu ms", _pkt.window_ms);
+    for (uint8_t i = 0; i < _pkt.task_count; i++)
+    {
+        CpuStats *st = &_pkt.task[i];
+        SYS_LOG("cpu", APP_LOG_LEVEL_INFO, "%.*s: %d.%d%% %lu cycles %lu switches",
+                configMAX_TASK_NAME_LEN, st->name, st->permille / 10, st->permille % 10,
+                st->cycles, st->switches);
+        busy += st->permille;
+    }
+    if (busy < 1000)
+        SYS_LOG("cpu", APP_LOG_LEVEL_INFO, "asleep: %d.%d%%", (1000 - busy) / 10, (1000 - busy) % 10);
+
+    for (uint8_t i = 0; i < _pkt.app_count; i++)
+    {
+        CpuAppStats *app = &_pkt.app[i];
+        SYS_LOG("cpu", APP_LOG_LEVEL_INFO, "app %.*s: %lu ms CPU in %lu ms, peak %d.%d%%",
+                CPU_STATS_APP_NAME, app->name, app->cpu_ms, app->run_ms,
+                app->peak_permille / 10, app->peak_permille % 10);
+        SYS_LOG("cpu", APP_LOG_LEVEL_INFO, "app %.*s: %lu frames, %lu over budget, %lu held, worst %d ms",
+                CPU_STATS_APP_NAME, app->name, app->frames, app->frames_over,
+                app->frames_held, app->frame_max_ms);
+    }
+
+    DeferStats defer;
+    defer_stats(&defer);
+    SYS_LOG("cpu", APP_LOG_LEVEL_INFO, "deferred: %lu run, %lu dropped, ISR to handler avg %lu max %lu cycles",
+            defer.count, defer.dropped, defer.avg_cycles, defer.max_cycles);
+}
+
+/*
+ * Debug endpoint. Any packet gets the stats logged and sent back raw
+ */
+void process_cpu_stats_packet(uint8_t *data, uint16_t len)
+{
+    cpu_stats_dump();
+    _cpu_stats_get(&_pkt);
+    bluetooth_send_packet(ENDPOINT_CPU_STATS, (uint8_t *)&_pkt, sizeof(_pkt));
+}
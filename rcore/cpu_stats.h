@@ -0,0 +1,44 @@
+#pragma once
+/* cpu_stats.h
+ * Who is eating the CPU
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "watchdog.h"
+
+/* most tasks accounted for, the same walk as the stack sampler */
+#define CPU_STATS_MAX STACK_STATS_MAX
+/* most apps remembered, the least recently run is dropped for a new one */
+#define CPU_STATS_APPS 8
+#define CPU_STATS_APP_NAME 16
+
+/* One task over the last sample window */
+typedef struct __attribute__((__packed__)) CpuStats {
+    char name[configMAX_TASK_NAME_LEN]; /* not terminated if it fills the field */
+    uint16_t permille; /* of the window's wall time */
+    uint32_t cycles;
+    uint32_t switches;
+} CpuStats;
+
+/* One app, over every window it was running in */
+typedef struct __attribute__((__packed__)) CpuAppStats {
+    char name[CPU_STATS_APP_NAME]; /* not terminated if it fills the field */
+    uint32_t cpu_ms;
+    uint32_t run_ms;
+    uint16_t peak_permille;
+    uint32_t frames;
+    uint32_t frames_over; /* took longer than the render budget */
+    uint32_t frames_held; /* made to wait by the frame rate cap */
+    uint16_t frame_max_ms;
+} CpuAppStats;
+
+void cpu_stats_sample(TaskStatus_t *tasks, UBaseType_t count);
+uint8_t cpu_stats_get(CpuStats *stats, uint8_t max, uint32_t *window_ms);
+uint8_t cpu_stats_apps(CpuAppStats *stats, uint8_t max);
+void cpu_stats_app_frame(const char *name, uint32_t render_us, bool over, bool held);
+void cpu_stats_dump(void);
+void process_cpu_stats_packet(uint8_t *data, uint16_t len);
@@ -0,0 +1,413 @@
+/* crash_dump.c
+ * A small record of a crash, kept in flash across the reset
+ * RebbleOS
+ *
+ * panic and the fault handlers come here with interrupts off. What the
+ * crash looked like -- the registers, the stack it happened on, where
+ * every other task was switched out, the heaps, the newest scheduler
+ * trace and log ring -- is programmed straight into REGION_CRASH, and the
+ * watch resets. Nothing is formatted or copied first, each section goes
+ * from where it lies.
+ *
+ * The region is erased ahead of time, at boot or once a record has been
+ * fetched, so a capture only programs, and never waits on an erase. It
+ * is bounded in size, CRASH_DUMP_MAX, and in time, CRASH_DUMP_BUDGET_MS:
+ * the sections go most useful first, and what the budget doesn't reach
+ * is left out. Each section's header, and the record's, go down after
+ * what they describe, so a record that was cut short says how far it got,
+ * and one that never got its header is thrown away at boot.
+ *
+ * A record that is there at boot is kept until the phone fetches it on
+ * ENDPOINT_CRASH_DUMP and asks for it to be cleared. A second crash
+ * before then leaves the first record alone. Utilities/crashdump.py reads
+ * what was fetched.
+ */
+
+#include "rebbleos.h"
+#include "endpoint.h"
+#include "crash_dump.h"
+
+#define CRASH_DUMP_CHUNK        256
+#define CRASH_DUMP_PACKET       512
+/* a task's frame as the port switches it out: r4-r11 and EXC_RETURN,
+ * s16-s31 if it was using the FPU, then what the exception pushed */
+#define CRASH_DUMP_SWITCH_WORDS 9
+#define CRASH_DUMP_FP_WORDS     16
+
+typedef enum CrashDumpState {
+    CrashDumpStateInit,     /* not looked at yet */
+    CrashDumpStateReady,    /* erased, for a crash to go in */
+    CrashDumpStateFull,     /* a record is there, to be fetched */
+    CrashDumpStateBusy,     /* being captured, or erased */
+} CrashDumpState;
+
+extern char _estack[];
+
+static volatile uint8_t _state;
+static uint32_t _length;
+
+/* all static, panic's stack is small */
+static uint32_t _at;
+static uint32_t _start;
+static uint32_t _budget;
+static CrashDumpHeader _hdr;
+static CrashDumpRegisters _regs;
+static CrashDumpHeapSummary _heap;
+static CrashDumpTask _task;
+static TaskStatus_t _tasks[CRASH_DUMP_TASKS];
+
+/* The end of the RAM that address is in, or address if it isn't */
+static uint32_t _ram_end(uint32_t address)
+{
+    if (address >= SRAM_BASE && address < (uint32_t)_estack)
+        return (uint32_t)_estack;
+#ifdef CCMDATARAM_BASE
+    if (address >= CCMDATARAM_BASE && address < CCMDATARAM_BASE + 0x10000)
+        return CCMDATARAM_BASE + 0x10000;
+#endif
+    return address;
+}
+
+static bool _over(void)
+{
+    return hw_cycle_count() - _start > _budget;
+}
+
+/* Program what there is room and time for. Returns how much that was */
+static uint32_t _put(const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+    const uint32_t end = REGION_CRASH_START + CRASH_DUMP_MAX;
+    uint32_t done = 0;
+
+    while (done < len && _at < end && !_over())
+    {
+        uint32_t n = len - done;
+
+        if (n > CRASH_DUMP_CHUNK)
+            n = CRASH_DUMP_CHUNK;
+        if (n > end - _at)
+            n = end - _at;
+
+        hw_flash_write_bytes(_at, p + done, n);
+        _at += n;
+        done += n;
+    }
+    return done;
+}
+
+/* Room for the section's header; it goes down once the length is known */
+static uint32_t _section_begin(void)
+{
+    uint32_t at = _at;
+
+    _at += sizeof(CrashDumpSection);
+    return at;
+}
+
+static void _section_end(uint32_t at, CrashDumpSectionType type, bool whole)
+{
+    CrashDumpSection section = {
+        .type = type,
+        .len = _at - at - sizeof(CrashDumpSection),
+    };
+
+    if (_at > REGION_CRASH_START + CRASH_DUMP_MAX)
+    {
+        _at = at;
+        return;
+    }
+
+    hw_flash_write_bytes(at, (const uint8_t *)&section, sizeof(section));
+    _at = (_at + 3) & ~3;
+    if (whole)
+        _hdr.sections |= 1 << type;
+}
+
+static void _section(CrashDumpSectionType type, const void *data, uint32_t len)
+{
+    uint32_t at = _section_begin();
+
+    _section_end(at, type, _put(data, len) == len);
+}
+
+/* Two stretches of a ring, as one section */
+static void _section_spans(CrashDumpSectionType type, const void *lead, uint32_t lead_len,
+                           const CrashDumpSpan span[2])
+{
+    uint32_t at;
+    bool whole;
+
+    if (!span[0].len && !span[1].len)
+        return;
+
+    at = _section_begin();
+    whole = _put(lead, lead_len) == lead_len &&
+            _put(span[0].data, span[0].len) == span[0].len &&
+            _put(span[1].data, span[1].len) == span[1].len;
+    _section_end(at, type, whole);
+}
+
+/*
+ * Every task, and where each was switched out. The running task's frame
+ * is the crash's own, in the registers
+ */
+static void _section_tasks(void)
+{
+    UBaseType_t n = uxTaskGetSystemState(_tasks, CRASH_DUMP_TASKS, NULL);
+    uint32_t at = _section_begin();
+    bool whole = true;
+
+    for (UBaseType_t i = 0; i < n && whole; i++)
+    {
+        TaskStatus_t *t = &_tasks[i];
+        /* the first thing in the TCB is where its stack got to */
+        uint32_t *top = *(uint32_t **)t->xHandle;
+
+        memset(&_task, 0, sizeof(_task));
+        memcpy(_task.name, t->pcTaskName, configMAX_TASK_NAME_LEN);
+        _task.number = t->xTaskNumber;
+        _task.state = t->eCurrentState;
+        _task.priority = t->uxCurrentPriority;
+        _task.stack_free = t->usStackHighWaterMark * sizeof(StackType_t);
+        _task.sp = (uint32_t)top;
+
+        if (t->eCurrentState != eRunning &&
+            (uint32_t)top >= (uint32_t)t->pxStackBase &&
+            _ram_end((uint32_t)top) >= (uint32_t)(top + CRASH_DUMP_SWITCH_WORDS + CRASH_DUMP_FP_WORDS + 8))
+        {
+            uint32_t *frame = top + CRASH_DUMP_SWITCH_WORDS;
+
+            if (!(top[CRASH_DUMP_SWITCH_WORDS - 1] & 0x10))
+                frame += CRASH_DUMP_FP_WORDS;
+            _task.lr = frame[5];
+            _task.pc = frame[6];
+        }
+
+        whole = _put(&_task, sizeof(_task)) == sizeof(_task);
+    }
+    _section_end(at, CrashDumpTasks, whole);
+}
+
+static void _section_heap(void)
+{
+    memset(&_heap, 0, sizeof(_heap));
+    _heap.system_free = xPortGetFreeHeapSize();
+    _heap.system_min_free = xPortGetMinimumEverFreeHeapSize();
+
+    /* the counters, not a walk; a walk could be what crashed */
+    for (uint8_t i = 0; i < MAX_APP_THREADS; i++)
+    {
+        qarena_t *arena = appmanager_get_thread(i)->arena;
+        if (!arena)
+            continue;
+        _heap.thread[i].size = arena->size;
+        _heap.thread[i].used = arena->used;
+        _heap.thread[i].peak = arena->peak;
+    }
+    _section(CrashDumpHeap, &_heap, sizeof(_heap));
+}
+
+void crash_dump_capture(CrashDumpReason reason, const uint32_t *frame, uint32_t exc_return,
+                        uint32_t sp, uint32_t pc, const char *message)
+{
+    bool running = xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+    CrashDumpSpan span[2];
+    uint32_t stack_end;
+    uint32_t cycles_per_us;
+
+    __disable_irq();
+
+    /* before boot got this far, there is nothing to keep it in; stay put
+     * with the message on the serial, as ever */
+    if (_state == CrashDumpStateInit)
+        return;
+    /* the first crash is the one that counts, or this is a crash in the
+     * capture itself */
+    if (_state != CrashDumpStateReady)
+        NVIC_SystemReset();
+    _state = CrashDumpStateBusy;
+
+    cycles_per_us = hw_cycles_per_us();
+    _start = hw_cycle_count();
+    _budget = CRASH_DUMP_BUDGET_MS * 1000 * cycles_per_us;
+    _at = REGION_CRASH_START + sizeof(CrashDumpHeader);
+
+    memset(&_hdr, 0, sizeof(_hdr));
+    _hdr.magic = CRASH_DUMP_MAGIC;
+    _hdr.version = CRASH_DUMP_VERSION;
+    _hdr.reason = reason;
+    _hdr.tick = xTaskGetTickCount();
+
+    memset(&_regs, 0, sizeof(_regs));
+    if (frame)
+    {
+        memcpy(_regs.r, frame, sizeof(_regs.r));
+        _regs.r12 = frame[4];
+        _regs.lr = frame[5];
+        _regs.pc = frame[6];
+        _regs.xpsr = frame[7];
+        /* where the stack was before the exception pushed its frame */
+        sp = (uint32_t)frame + ((exc_return & 0x10) ? 8 : 26) * 4 + ((frame[7] >> 9) & 1) * 4;
+    }
+    else
+        _regs.pc = pc;
+    _regs.sp = sp;
+    _regs.exc_return = exc_return;
+    _regs.cfsr = SCB->CFSR;
+    _regs.hfsr = SCB->HFSR;
+    _regs.mmfar = SCB->MMFAR;
+    _regs.bfar = SCB->BFAR;
+    if (running)
+        memcpy(_regs.task, pcTaskGetName(NULL), configMAX_TASK_NAME_LEN);
+    if (message)
+        strncpy(_regs.message, message, CRASH_DUMP_MESSAGE - 1);
+    _section(CrashDumpRegs, &_regs, sizeof(_regs));
+
+    /* the frame, if there was one, and on up */
+    if (frame)
+        sp = (uint32_t)frame;
+    stack_end = _ram_end(sp);
+    if (stack_end > sp)
+    {
+        span[0].data = (const void *)sp;
+        span[0].len = stack_end - sp < CRASH_DUMP_STACK ? stack_end - sp : CRASH_DUMP_STACK;
+        span[1].len = 0;
+        _section_spans(CrashDumpStack, &sp, sizeof(sp), span);
+    }
+
+    if (running)
+        _section_tasks();
+    _section_heap();
+
+    sched_trace_crash_spans(span, CRASH_DUMP_TRACE * sizeof(SchedTraceRecord));
+    _section_spans(CrashDumpTrace, &cycles_per_us, sizeof(cycles_per_us), span);
+
+    log_crash_spans(span, CRASH_DUMP_LOG);
+    _section_spans(CrashDumpLog, NULL, 0, span);
+
+    /* and last, what makes it a record */
+    _hdr.length = _at - REGION_CRASH_START;
+    _hdr.capture_us = (hw_cycle_count() - _start) / cycles_per_us;
+    hw_flash_write_bytes(REGION_CRASH_START, (const uint8_t *)&_hdr, sizeof(_hdr));
+
+    NVIC_SystemReset();
+}
+
+/* Erase whatever is in the region, unless it is clean already */
+static void _clear(void)
+{
+    uint8_t buf[32];
+    bool blank = true;
+
+    _state = CrashDumpStateBusy;
+    for (uint32_t ofs = 0; ofs < CRASH_DUMP_MAX && blank; ofs += sizeof(buf))
+    {
+        flash_read_bytes(REGION_CRASH_START + ofs, buf, sizeof(buf));
+        for (uint8_t i = 0; i < sizeof(buf); i++)
+            if (buf[i] != 0xFF)
+                blank = false;
+    }
+    if (!blank)
+        flash_erase(REGION_CRASH_START, REGION_CRASH_SIZE);
+
+    _length = 0;
+    _state = CrashDumpStateReady;
+}
+
+/*
+ * At boot, with flash up. Say what crashed last time, if a record is
+ * there, and keep it for the phone; otherwise have the region ready
+ */
+uint8_t crash_dump_init(void)
+{
+    struct __attribute__((__packed__)) {
+        CrashDumpHeader hdr;
+        CrashDumpSection section;
+        CrashDumpRegisters regs;
+    } rec;
+
+    flash_read_bytes(REGION_CRASH_START, (uint8_t *)&rec, sizeof(rec));
+    if (rec.hdr.magic != CRASH_DUMP_MAGIC || rec.hdr.version != CRASH_DUMP_VERSION ||
+        rec.hdr.length > CRASH_DUMP_MAX)
+    {
+        _clear();
+        return INIT_RESP_OK;
+    }
+
+    _length = rec.hdr.length;
+    _state = CrashDumpStateFull;
+
+    if (!(rec.hdr.sections & (1 << CrashDumpRegs)))
+    {
+        SYS_LOG("crash", APP_LOG_LEVEL_ERROR, "crash record, reason %d, %lu bytes, no registers",
+                rec.hdr.reason, rec.hdr.length);
+        return INIT_RESP_OK;
+    }
+    rec.regs.message[CRASH_DUMP_MESSAGE - 1] = 0;
+    SYS_LOG("crash", APP_LOG_LEVEL_ERROR, "crash record, reason %d in %.*s at tick %lu: pc %08lx lr %08lx %s",
+            rec.hdr.reason, configMAX_TASK_NAME_LEN, rec.regs.task, rec.hdr.tick,
+            rec.regs.pc, rec.regs.lr, rec.regs.message);
+    SYS_LOG("crash", APP_LOG_LEVEL_ERROR, "crash record, %lu bytes, sections %02x, taken in %lu us",
+            rec.hdr.length, rec.hdr.sections, rec.hdr.capture_us);
+
+    return INIT_RESP_OK;
+}
+
+static void _reply(uint8_t result, uint32_t length)
+{
+    uint8_t pkt[5];
+
+    pkt[0] = result;
+    pkt[1] = length >> 24;
+    pkt[2] = length >> 16;
+    pkt[3] = length >> 8;
+    pkt[4] = length;
+    bluetooth_send_packet(ENDPOINT_CRASH_DUMP, pkt, sizeof(pkt));
+}
+
+/*
+ * Debug endpoint. A fetch gets the reply header, then the record as it
+ * is in flash. A clear erases it, ready for the next one
+ */
+void process_crash_dump_packet(uint8_t *data, uint16_t len)
+{
+    uint8_t *buf;
+
+    if (!len || data[0] > CRASH_DUMP_CLEAR)
+    {
+        _reply(CRASH_DUMP_MALFORMED, 0);
+        return;
+    }
+
+    if (data[0] == CRASH_DUMP_CLEAR)
+    {
+        if (_state == CrashDumpStateFull)
+            _clear();
+        _reply(CRASH_DUMP_OK, 0);
+        return;
+    }
+
+    if (_state != CrashDumpStateFull)
+    {
+        _reply(CRASH_DUMP_NONE, 0);
+        return;
+    }
+
+    buf = system_malloc(CRASH_DUMP_PACKET);
+    if (!buf)
+    {
+        _reply(CRASH_DUMP_OUT_OF_MEMORY, 0);
+        return;
+    }
+
+    _reply(CRASH_DUMP_OK, _length);
+    for (uint32_t ofs = 0; ofs < _length; ofs += CRASH_DUMP_PACKET)
+    {
+        uint32_t n = _length - ofs > CRASH_DUMP_PACKET ? CRASH_DUMP_PACKET : _length - ofs;
+
+        flash_read_bytes(REGION_CRASH_START + ofs, buf, n);
+        bluetooth_send_packet(ENDPOINT_CRASH_DUMP, buf, n);
+    }
+    system_free(buf);
+}
@@ -0,0 +1,135 @@
+#pragma once
+/* crash_dump.h
+ * A small record of a crash, kept in flash across the reset
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "appmanager.h"
+
+/* "CRSH", once the whole record is down */
+#define CRASH_DUMP_MAGIC        0x48535243
+#define CRASH_DUMP_VERSION      1
+
+/* the most the record can come to, header and all. The region is the
+ * erase size, which is more */
+#define CRASH_DUMP_MAX          0x2000
+/* the capture gives up on whatever is left after this long */
+#define CRASH_DUMP_BUDGET_MS    50
+
+/* what is kept of each thing, from the newest back */
+#define CRASH_DUMP_STACK        512   /* bytes up from where it crashed */
+#define CRASH_DUMP_TASKS        24
+#define CRASH_DUMP_LOG          2048  /* bytes of the log ring */
+#define CRASH_DUMP_TRACE        64    /* sched_trace records */
+#define CRASH_DUMP_MESSAGE      64
+
+typedef enum CrashDumpReason {
+    CrashDumpPanic,
+    CrashDumpHardFault,
+    CrashDumpBusFault,
+    CrashDumpUsageFault,
+    CrashDumpMemFault,
+} CrashDumpReason;
+
+/* the sections, in the order they are taken */
+typedef enum CrashDumpSectionType {
+    CrashDumpRegs,      /* CrashDumpRegisters */
+    CrashDumpStack,     /* the address of the first word, then the words */
+    CrashDumpTasks,     /* CrashDumpTask each */
+    CrashDumpHeap,      /* CrashDumpHeapSummary */
+    CrashDumpTrace,     /* cycles per us, then SchedTraceRecords, oldest first */
+    CrashDumpLog,       /* log ring bytes, oldest first, maybe cut off mid record */
+    CrashDumpSectionCount
+} CrashDumpSectionType;
+
+/* At the start of the region, written last */
+typedef struct __attribute__((__packed__)) CrashDumpHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reason;
+    uint8_t sections;       /* bit per section type that made it in, whole */
+    uint8_t reserved;
+    uint32_t length;        /* of the record, this and all */
+    uint32_t tick;          /* when it crashed */
+    uint32_t capture_us;    /* how long the capture took */
+} CrashDumpHeader;
+
+/* Ahead of each section; len is what follows, before padding to 4 */
+typedef struct __attribute__((__packed__)) CrashDumpSection {
+    uint16_t type;
+    uint16_t len;
+} CrashDumpSection;
+
+/* r0-r3, r12, lr, pc and xpsr are the exception frame's; r4-r11 aren't
+ * kept. A panic has no frame: pc is where panic was called from, and the
+ * rest are 0 */
+typedef struct __attribute__((__packed__)) CrashDumpRegisters {
+    uint32_t r[4];
+    uint32_t r12;
+    uint32_t sp;
+    uint32_t lr;
+    uint32_t pc;
+    uint32_t xpsr;
+    uint32_t exc_return;
+    uint32_t cfsr;
+    uint32_t hfsr;
+    uint32_t mmfar;
+    uint32_t bfar;
+    char task[configMAX_TASK_NAME_LEN];  /* not terminated if it fills the field */
+    char message[CRASH_DUMP_MESSAGE];    /* panic's, terminated */
+} CrashDumpRegisters;
+
+/* Where a task that wasn't running was switched out: the pc and lr off
+ * the frame on its stack */
+typedef struct __attribute__((__packed__)) CrashDumpTask {
+    char name[configMAX_TASK_NAME_LEN];  /* not terminated if it fills the field */
+    uint8_t number;
+    uint8_t state;          /* eTaskState */
+    uint8_t priority;
+    uint8_t reserved;
+    uint16_t stack_free;    /* bytes, the least it has had */
+    uint32_t sp;
+    uint32_t pc;
+    uint32_t lr;
+} CrashDumpTask;
+
+typedef struct __attribute__((__packed__)) CrashDumpHeapSummary {
+    uint32_t system_free;
+    uint32_t system_min_free;
+    struct __attribute__((__packed__)) {
+        uint32_t size;      /* 0 for a thread that isn't running */
+        uint32_t used;
+        uint32_t peak;
+    } thread[MAX_APP_THREADS];
+} CrashDumpHeapSummary;
+
+/* A stretch of memory to go in the record */
+typedef struct CrashDumpSpan {
+    const void *data;
+    uint32_t len;
+} CrashDumpSpan;
+
+/* Requests on ENDPOINT_CRASH_DUMP */
+#define CRASH_DUMP_FETCH        0x00
+#define CRASH_DUMP_CLEAR        0x01
+
+/* the result at the start of the reply to a fetch, then the length, big
+ * endian. The record follows in packets */
+#define CRASH_DUMP_OK           0
+#define CRASH_DUMP_NONE         1
+#define CRASH_DUMP_MALFORMED    2
+#define CRASH_DUMP_OUT_OF_MEMORY 3
+
+uint8_t crash_dump_init(void);
+/* Take the record, then reset. From panic or a fault handler, which
+ * carry on as before if it returns: that is before crash_dump_init. frame
+ * is the exception frame, or NULL from panic, which gives sp and pc */
+void crash_dump_capture(CrashDumpReason reason, const uint32_t *frame, uint32_t exc_return,
+                        uint32_t sp, uint32_t pc, const char *message);
+void process_crash_dump_packet(uint8_t *data, uint16_t len);
+
+/* The newest max bytes of each; two spans, for where the ring wraps */
+void log_crash_spans(CrashDumpSpan span[2], uint32_t max);
+void sched_trace_crash_spans(CrashDumpSpan span[2], uint32_t max);
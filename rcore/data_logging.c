@@ -0,0 +1,630 @@
+/* data_logging.c
+ * Data logging: app records, spooled to flash and sent to the phone in batches
+ * RebbleOS
+ *
+ * An app opens a session with a tag and an item size, and logs items into
+ * it. Items from every session go into one staging chunk in RAM as
+ * blocks: a header saying whose they are, then as many items as came in a
+ * row for that session. When the chunk is full it goes to flash as a file
+ * of its own, dls00 to dls31, and the next is started. If the filesystem
+ * won't take it, a couple are kept in RAM instead, so a full flash still
+ * holds on to the last of the logging.
+ *
+ * Nothing goes to the phone a record at a time. The uploader thread wakes
+ * when a chunk is spooled or a session finished, and every
+ * DLS_UPLOAD_PERIOD for whatever is staged, and does nothing unless the
+ * phone is there. Then it asks for the fast link and sends each block as
+ * one SEND_DATA, waiting on the ACK before the next. A block's header is
+ * as long as SEND_DATA's, so the packet is filled in over it and sent from
+ * where the chunk was read, with no copy. A chunk is deleted once the
+ * phone has all of it; a NACK or a timeout leaves the rest to the next
+ * pass, which starts at the block this one stopped at.
+ *
+ * The phone's end of the protocol has no compression, so there is none
+ * here. The saving is in a few big packets on a fast link, rather than a
+ * trickle of small ones keeping the radio up.
+ *
+ * Sessions are in RAM only. Chunks left over from before a reboot have no
+ * session to be sent as, so they are thrown away at boot.
+ */
+
+#include "rebbleos.h"
+#include "endpoint.h"
+#include "fs.h"
+#include "data_logging.h"
+
+#define DLS_MAX_SESSIONS    8
+#define DLS_CHUNK_SIZE      2048
+#define DLS_MAX_CHUNKS      32
+/* chunks kept in RAM when the flash won't have them */
+#define DLS_RAM_CHUNKS      2
+/* the most data in one SEND_DATA */
+#define DLS_BLOCK_MAX       1024
+#define DLS_UPLOAD_PERIOD   pdMS_TO_TICKS(15 * 60 * 1000)
+#define DLS_ACK_TIMEOUT     pdMS_TO_TICKS(10000)
+#define DLS_LINK_BOOST_MS   5000
+
+#define STACK_SZ_DLS        (configMINIMAL_STACK_SIZE + 200)
+
+/* watch to phone */
+#define DLS_OPEN_SESSION            0x01
+#define DLS_SEND_DATA               0x02
+#define DLS_CLOSE_SESSION           0x03
+#define DLS_SEND_ENABLE_RESPONSE    0x0a
+/* phone to watch */
+#define DLS_REPORT_SESSIONS         0x84
+#define DLS_ACK                     0x85
+#define DLS_NACK                    0x86
+#define DLS_EMPTY_SESSION           0x88
+#define DLS_GET_SEND_ENABLE         0x89
+#define DLS_SET_SEND_ENABLE         0x8b
+
+/* what the uploader is woken with */
+#define DLS_NOTIFY_KICK     (1 << 0)
+#define DLS_NOTIFY_FLUSH    (1 << 1)
+#define DLS_NOTIFY_ACK      (1 << 2)
+#define DLS_NOTIFY_NACK     (1 << 3)
+
+typedef struct __attribute__((__packed__)) DlsOpenSession {
+    uint8_t command;
+    uint8_t session;
+    Uuid uuid;
+    uint32_t timestamp;
+    uint32_t tag;
+    uint8_t type;
+    uint16_t item_size;
+} DlsOpenSession;
+
+typedef struct __attribute__((__packed__)) DlsSendData {
+    uint8_t command;
+    uint8_t session;
+    uint32_t items_left;
+    uint32_t crc;
+} DlsSendData;
+
+/* a block's header while it waits. As long as a DlsSendData, which goes
+ * over it on the way out */
+typedef struct __attribute__((__packed__)) DlsBlock {
+    uint8_t session;
+    uint8_t pad;
+    uint16_t len;
+    uint8_t rsvd[sizeof(DlsSendData) - 4];
+} DlsBlock;
+
+struct DataLoggingSession {
+    bool used;
+    bool finished;
+    uint8_t id;
+    uint8_t type;
+    uint16_t item_size;
+    uint32_t tag;
+    Uuid uuid;
+    uint32_t created;
+    uint32_t pending;     /* items logged and not yet ACKed */
+    uint32_t opened_link; /* the _link the phone last heard of it on. 0 if never */
+};
+
+typedef struct DlsChunk {
+    uint16_t len;
+    uint16_t sent;  /* as far as the phone has ACKed */
+    uint8_t *ram;   /* NULL if it's on flash */
+} DlsChunk;
+
+static struct DataLoggingSession _sessions[DLS_MAX_SESSIONS];
+static uint8_t _next_id;
+
+static DlsChunk _chunks[DLS_MAX_CHUNKS];
+static uint32_t _chunk_head;  /* chunks ever spooled */
+static uint32_t _chunk_tail;  /* chunks ever sent */
+static uint8_t _ram_chunks;
+
+static uint8_t _stage[DLS_CHUNK_SIZE];
+static uint16_t _stage_len;
+static int16_t _stage_block = -1; /* the last block in it */
+
+static volatile uint32_t _link = 1; /* one more each connection */
+static volatile bool _send_enabled = true;
+static volatile uint8_t _acked_session;
+
+static SemaphoreHandle_t _dls_mutex;
+static StaticSemaphore_t _dls_mutex_buf;
+
+static TaskHandle_t _dls_task;
+static StackType_t _dls_task_stack[STACK_SZ_DLS];
+static StaticTask_t _dls_task_buf;
+
+static void _dls_thread(void *pvParameters);
+
+static void _chunk_name(char *name, size_t len, uint32_t n)
+{
+    snprintf(name, len, "dls%02lu", n % DLS_MAX_CHUNKS);
+}
+
+uint8_t data_logging_init(void)
+{
+    struct file file;
+    char name[8];
+
+    _dls_mutex = xSemaphoreCreateMutexStatic(&_dls_mutex_buf);
+
+    for (uint32_t i = 0; i < DLS_MAX_CHUNKS; i++)
+    {
+        _chunk_name(name, sizeof(name), i);
+        if (fs_find_file(&file, name) == 0)
+            fs_delete(&file);
+    }
+
+    _dls_task = xTaskCreateStatic(_dls_thread, "DLog", STACK_SZ_DLS, NULL,
+                                  tskIDLE_PRIORITY + 2UL,
+                                  _dls_task_stack, &_dls_task_buf);
+
+    return INIT_RESP_OK;
+}
+
+static void _kick(uint32_t bits)
+{
+    if (_dls_task)
+        xTaskNotify(_dls_task, bits, eSetBits);
+}
+
+void data_logging_connection_update(bool connected)
+{
+    if (!connected)
+        return;
+
+    /* a new link, and every session has to be opened on it again. What
+     * is staged goes with the rest */
+    _link++;
+    _kick(DLS_NOTIFY_FLUSH);
+}
+
+static struct DataLoggingSession *_session_by_id(uint8_t id)
+{
+    for (uint8_t i = 0; i < DLS_MAX_SESSIONS; i++)
+        if (_sessions[i].used && _sessions[i].id == id)
+            return &_sessions[i];
+
+    return NULL;
+}
+
+static bool _session_valid(struct DataLoggingSession *s)
+{
+    return s >= _sessions && s < _sessions + DLS_MAX_SESSIONS && s->used;
+}
+
+/* Spooling */
+
+static bool _chunk_write(const char *name)
+{
+    struct fd fd;
+
+    if (fs_creat(&fd, name, _stage_len) < 0)
+        return false;
+
+    if (fs_write(&fd, _stage, _stage_len) == _stage_len && fs_commit(&fd) == 0)
+        return true;
+
+    fs_delete(&fd.file);
+    return false;
+}
+
+/*
+ * Queue up the staging chunk, on flash if it will go. false if there's
+ * nowhere for it, and it stays staged. With the lock
+ */
+static bool _stage_spool(void)
+{
+    DlsChunk *c;
+    char name[8];
+
+    if (!_stage_len)
+        return true;
+    if (_chunk_head - _chunk_tail == DLS_MAX_CHUNKS)
+        return false;
+
+    c = &_chunks[_chunk_head % DLS_MAX_CHUNKS];
+    c->ram = NULL;
+    _chunk_name(name, sizeof(name), _chunk_head);
+    if (!_chunk_write(name))
+    {
+        if (_ram_chunks == DLS_RAM_CHUNKS || !(c->ram = system_malloc(_stage_len)))
+        {
+            SYS_LOG("dlog", APP_LOG_LEVEL_ERROR, "no room to spool %d bytes", _stage_len);
+            return false;
+        }
+        memcpy(c->ram, _stage, _stage_len);
+        _ram_chunks++;
+    }
+
+    c->len = _stage_len;
+    c->sent = 0;
+    _chunk_head++;
+    _stage_len = 0;
+    _stage_block = -1;
+    _kick(DLS_NOTIFY_KICK);
+
+    return true;
+}
+
+/* Sending, all on the uploader thread */
+
+static bool _send_wait(uint8_t id, uint8_t *data, uint16_t len)
+{
+    TickType_t start, waited;
+    uint32_t bits;
+
+    /* any ACK from before is stale */
+    xTaskNotifyWait(DLS_NOTIFY_ACK | DLS_NOTIFY_NACK, 0, NULL, 0);
+
+    bluetooth_link_boost(DLS_LINK_BOOST_MS);
+    bluetooth_send_packet(ENDPOINT_DATA_LOGGING, data, len);
+
+    start = xTaskGetTickCount();
+    while ((waited = xTaskGetTickCount() - start) < DLS_ACK_TIMEOUT)
+    {
+        if (!xTaskNotifyWait(0, DLS_NOTIFY_ACK | DLS_NOTIFY_NACK, &bits, DLS_ACK_TIMEOUT - waited))
+            break;
+        if ((bits & (DLS_NOTIFY_ACK | DLS_NOTIFY_NACK)) && _acked_session == id)
+            return bits & DLS_NOTIFY_ACK;
+    }
+
+    SYS_LOG("dlog", APP_LOG_LEVEL_WARNING, "session %d: no ACK", id);
+    return false;
+}
+
+static bool _send_open(struct DataLoggingSession *s)
+{
+    DlsOpenSession pkt = {
+        .command = DLS_OPEN_SESSION,
+        .session = s->id,
+        .timestamp = s->created,
+        .tag = s->tag,
+        .type = s->type,
+        .item_size = s->item_size,
+    };
+
+    memcpy(&pkt.uuid, &s->uuid, sizeof(Uuid));
+    if (!_send_wait(s->id, (uint8_t *)&pkt, sizeof(pkt)))
+        return false;
+
+    s->opened_link = _link;
+    return true;
+}
+
+/* One block, from where it was read, its header turned into SEND_DATA's */
+static bool _send_block(uint8_t *p)
+{
+    DlsBlock blk = *(DlsBlock *)p;
+    DlsSendData *hdr = (DlsSendData *)p;
+    struct DataLoggingSession *s = _session_by_id(blk.session);
+    uint32_t items;
+
+    if (!s)
+        return true;
+    if (s->opened_link != _link && !_send_open(s))
+        return false;
+
+    items = blk.len / s->item_size;
+    hdr->command = DLS_SEND_DATA;
+    hdr->session = s->id;
+    hdr->items_left = s->pending - items;
+    hdr->crc = rcore_crc32(p + sizeof(DlsSendData), blk.len);
+
+    if (!_send_wait(s->id, p, sizeof(DlsSendData) + blk.len))
+    {
+        /* a RAM chunk is read from where it is, so put it back as it was */
+        *(DlsBlock *)p = blk;
+        return false;
+    }
+
+    xSemaphoreTake(_dls_mutex, portMAX_DELAY);
+    s->pending -= items;
+    xSemaphoreGive(_dls_mutex);
+
+    return true;
+}
+
+static void _chunk_pop(DlsChunk *c, struct file *file)
+{
+    xSemaphoreTake(_dls_mutex, portMAX_DELAY);
+    if (c->ram)
+    {
+        system_free(c->ram);
+        c->ram = NULL;
+        _ram_chunks--;
+    }
+    else if (file)
+    {
+        fs_delete(file);
+    }
+    _chunk_tail++;
+    xSemaphoreGive(_dls_mutex);
+}
+
+/* Finished sessions with nothing left to send are closed and let go */
+static void _close_finished(void)
+{
+    struct DataLoggingSession *s;
+    uint8_t pkt[2];
+
+    for (uint8_t i = 0; i < DLS_MAX_SESSIONS; i++)
+    {
+        s = &_sessions[i];
+        if (!s->used || !s->finished || s->pending)
+            continue;
+
+        if (s->opened_link)
+        {
+            pkt[0] = DLS_CLOSE_SESSION;
+            pkt[1] = s->id;
+            bluetooth_send_packet(ENDPOINT_DATA_LOGGING, pkt, sizeof(pkt));
+        }
+
+        xSemaphoreTake(_dls_mutex, portMAX_DELAY);
+        s->used = false;
+        xSemaphoreGive(_dls_mutex);
+    }
+}
+
+/*
+ * Everything queued to the phone, oldest first. Chunks are only ever added
+ * at the head, so the tail is ours to read without the lock
+ */
+static void _upload(bool flush)
+{
+    uint8_t *buf = NULL;
+    uint8_t *p;
+    DlsChunk *c;
+    struct file file;
+    struct fd fd;
+    char name[8];
+
+    if (flush)
+    {
+        xSemaphoreTake(_dls_mutex, portMAX_DELAY);
+        _stage_spool();
+        xSemaphoreGive(_dls_mutex);
+    }
+
+    while (_chunk_tail != _chunk_head)
+    {
+        c = &_chunks[_chunk_tail % DLS_MAX_CHUNKS];
+        p = c->ram;
+        if (!p)
+        {
+            if (!buf && !(buf = system_malloc(DLS_CHUNK_SIZE)))
+                break;
+
+            _chunk_name(name, sizeof(name), _chunk_tail);
+            if (fs_find_file(&file, name) < 0)
+            {
+                SYS_LOG("dlog", APP_LOG_LEVEL_ERROR, "%s has gone", name);
+                _chunk_pop(c, NULL);
+                continue;
+            }
+            fs_open(&fd, &file);
+            fs_read(&fd, buf, c->len);
+            p = buf;
+        }
+
+        while (c->sent < c->len)
+        {
+            uint16_t size = sizeof(DlsBlock) + ((DlsBlock *)(p + c->sent))->len;
+
+            if (!_send_block(p + c->sent))
+                goto out;
+            c->sent += size;
+        }
+
+        _chunk_pop(c, &file);
+    }
+
+    _close_finished();
+out:
+    system_free(buf);
+}
+
+static void _dls_thread(void *pvParameters)
+{
+    uint32_t bits;
+
+    for( ;; )
+    {
+        /* nothing new for a while: what is staged goes anyway */
+        if (!xTaskNotifyWait(0, DLS_NOTIFY_KICK | DLS_NOTIFY_FLUSH, &bits, DLS_UPLOAD_PERIOD))
+            bits = DLS_NOTIFY_FLUSH;
+
+        if (!bluetooth_is_device_connected() || !_send_enabled)
+            continue;
+
+        _upload(bits & DLS_NOTIFY_FLUSH);
+    }
+}
+
+/*
+ * From the phone, on the BT cmd thread
+ */
+void process_data_logging_packet(uint8_t *data, uint16_t len)
+{
+    struct DataLoggingSession *s;
+    uint8_t pkt[2];
+
+    if (!len || !_dls_task)
+        return;
+
+    switch (data[0])
+    {
+        case DLS_ACK:
+        case DLS_NACK:
+            if (len < 2)
+                return;
+            _acked_session = data[1];
+            _kick(data[0] == DLS_ACK ? DLS_NOTIFY_ACK : DLS_NOTIFY_NACK);
+            break;
+        case DLS_REPORT_SESSIONS:
+            /* the ones it has open. Any of ours not there is opened again */
+            for (uint8_t i = 0; i < DLS_MAX_SESSIONS; i++)
+            {
+                s = &_sessions[i];
+                if (s->used && !memchr(data + 1, s->id, len - 1))
+                    s->opened_link = 0;
+            }
+            _kick(DLS_NOTIFY_KICK);
+            break;
+        case DLS_EMPTY_SESSION:
+            _kick(DLS_NOTIFY_FLUSH);
+            break;
+        case DLS_GET_SEND_ENABLE:
+            pkt[0] = DLS_SEND_ENABLE_RESPONSE;
+            pkt[1] = _send_enabled;
+            bluetooth_send_packet(ENDPOINT_DATA_LOGGING, pkt, sizeof(pkt));
+            break;
+        case DLS_SET_SEND_ENABLE:
+            if (len < 2)
+                return;
+            _send_enabled = data[1];
+            if (_send_enabled)
+                _kick(DLS_NOTIFY_KICK);
+            break;
+        default:
+            SYS_LOG("dlog", APP_LOG_LEVEL_DEBUG, "command 0x%x?", data[0]);
+    }
+}
+
+/* API */
+
+static void _app_uuid(Uuid *uuid)
+{
+    app_running_thread *thread = appmanager_get_current_thread();
+
+    memset(uuid, 0, sizeof(Uuid));
+    /* ours have no UUID, a loaded one starts with its header */
+    if (thread && thread->app && !thread->app->is_internal)
+        memcpy(uuid, &((ApplicationHeader *)thread->heap)->uuid, sizeof(Uuid));
+}
+
+DataLoggingSessionRef data_logging_create(uint32_t tag, DataLoggingItemType item_type,
+                                          uint16_t item_length, bool resume)
+{
+    struct DataLoggingSession *s = NULL;
+    Uuid uuid;
+    time_t now;
+
+    if (!item_length || item_length > DLS_BLOCK_MAX)
+        return NULL;
+    if (item_type != DATA_LOGGING_BYTE_ARRAY &&
+        item_length != 1 && item_length != 2 && item_length != 4)
+        return NULL;
+
+    _app_uuid(&uuid);
+    rcore_time_ms(&now, NULL);
+
+    xSemaphoreTake(_dls_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; resume && !s && i < DLS_MAX_SESSIONS; i++)
+    {
+        struct DataLoggingSession *r = &_sessions[i];
+        if (r->used && !r->finished && r->tag == tag && r->type == item_type &&
+            r->item_size == item_length && !memcmp(&r->uuid, &uuid, sizeof(Uuid)))
+            s = r;
+    }
+
+    for (uint8_t i = 0; !s && i < DLS_MAX_SESSIONS; i++)
+    {
+        if (_sessions[i].used)
+            continue;
+
+        s = &_sessions[i];
+        memset(s, 0, sizeof(*s));
+        do
+            s->id = _next_id++;
+        while (_session_by_id(s->id));
+        s->used = true;
+        s->tag = tag;
+        s->type = item_type;
+        s->item_size = item_length;
+        s->created = now;
+        memcpy(&s->uuid, &uuid, sizeof(Uuid));
+    }
+    xSemaphoreGive(_dls_mutex);
+
+    if (!s)
+        SYS_LOG("dlog", APP_LOG_LEVEL_ERROR, "no free sessions for tag %lu", tag);
+
+    return s;
+}
+
+void data_logging_finish(DataLoggingSessionRef s)
+{
+    if (!_session_valid(s))
+        return;
+
+    xSemaphoreTake(_dls_mutex, portMAX_DELAY);
+    s->finished = true;
+    /* the phone never heard of it, and has nothing coming */
+    if (!s->pending && !s->opened_link)
+        s->used = false;
+    xSemaphoreGive(_dls_mutex);
+
+    _kick(DLS_NOTIFY_FLUSH);
+}
+
+/*
+ * Into the staging chunk, spooling it as it fills. If the queue is full,
+ * what went in before it filled stays logged
+ */
+DataLoggingResult data_logging_log(DataLoggingSessionRef s, const void *data, uint32_t num_items)
+{
+    DataLoggingResult rv = DATA_LOGGING_SUCCESS;
+    const uint8_t *p = data;
+    uint32_t len, n;
+    DlsBlock *blk;
+
+    if (!_session_valid(s) || !data)
+        return DATA_LOGGING_INVALID_PARAMS;
+
+    xSemaphoreTake(_dls_mutex, portMAX_DELAY);
+    if (s->finished)
+    {
+        xSemaphoreGive(_dls_mutex);
+        return DATA_LOGGING_CLOSED;
+    }
+
+    len = num_items * s->item_size;
+    while (len)
+    {
+        blk = _stage_block >= 0 ? (DlsBlock *)&_stage[_stage_block] : NULL;
+
+        /* a new block, and a new chunk for it if this one is full */
+        if (!blk || blk->session != s->id || blk->len + s->item_size > DLS_BLOCK_MAX ||
+            _stage_len + s->item_size > DLS_CHUNK_SIZE)
+        {
+            if (_stage_len + sizeof(DlsBlock) + s->item_size > DLS_CHUNK_SIZE && !_stage_spool())
+            {
+                rv = DATA_LOGGING_FULL;
+                break;
+            }
+            _stage_block = _stage_len;
+            blk = (DlsBlock *)&_stage[_stage_block];
+            blk->session = s->id;
+            blk->len = 0;
+            _stage_len += sizeof(DlsBlock);
+        }
+
+        n = len;
+        if (n > DLS_BLOCK_MAX - blk->len)
+            n = DLS_BLOCK_MAX - blk->len;
+        if (n > DLS_CHUNK_SIZE - _stage_len)
+            n = DLS_CHUNK_SIZE - _stage_len;
+        n -= n % s->item_size;
+
+        memcpy(&_stage[_stage_len], p, n);
+        blk->len += n;
+        _stage_len += n;
+        s->pending += n / s->item_size;
+        p += n;
+        len -= n;
+    }
+    xSemaphoreGive(_dls_mutex);
+
+    return rv;
+}
@@ -0,0 +1,37 @@
+#pragma once
+/* data_logging.h
+ * Data logging: app records, spooled to flash and sent to the phone in batches
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    DATA_LOGGING_BYTE_ARRAY = 0,
+    DATA_LOGGING_UINT = 2,
+    DATA_LOGGING_INT = 3,
+} DataLoggingItemType;
+
+typedef enum {
+    DATA_LOGGING_SUCCESS = 0,
+    DATA_LOGGING_BUSY,
+    DATA_LOGGING_FULL,
+    DATA_LOGGING_NOT_FOUND,
+    DATA_LOGGING_CLOSED,
+    DATA_LOGGING_INVALID_PARAMS,
+    DATA_LOGGING_INTERNAL_ERR,
+} DataLoggingResult;
+
+typedef struct DataLoggingSession *DataLoggingSessionRef;
+
+DataLoggingSessionRef data_logging_create(uint32_t tag, DataLoggingItemType item_type,
+                                          uint16_t item_length, bool resume);
+void data_logging_finish(DataLoggingSessionRef logging_session);
+DataLoggingResult data_logging_log(DataLoggingSessionRef logging_session, const void *data,
+                                   uint32_t num_items);
+
+uint8_t data_logging_init(void);
+/* the link came or went. Any thread */
+void data_logging_connection_update(bool connected);
+void process_data_logging_packet(uint8_t *data, uint16_t len);
@@ -8,27 +8,36 @@
 #include <stdio.h>
 #include "debug.h"
 #include "platform.h"
+#include "crash_dump.h"
 
-#define PANIC_STACK_SIZE (224 / 2)
+/* in words, with room for the crash dump's trip through the kernel */
+#define PANIC_STACK_SIZE 256
 
 static StackType_t _panic_stack[PANIC_STACK_SIZE] CCRAM;
 
-__attribute__((__noreturn__)) static void _panic(const char *s) {
+/* only panic's asm calls this, so keep it. sp is panic's own, just under its
+ * caller's frame, and pc where it was called from */
+__attribute__((__noreturn__, used)) static void _panic(const char *s, uint32_t sp, uint32_t pc) {
     portDISABLE_INTERRUPTS();
     puts("*** PANIC ***");
     puts(s);
+    /* once boot is far enough along, this resets */
+    crash_dump_capture(CrashDumpPanic, NULL, 0, sp, pc, s);
     while (1)
         ;
-    /* XXX: do something smarter here, like turn IRQs off and stop poking the watchdog */
 }
 
  __attribute__((__noreturn__))void panic(const char *s) {
     asm volatile(
+        "mov r1, sp\n"
+        "mov r2, %[pc]\n"
         "mov sp, %[stacktop]\n"
         "mov r0, %[s]\n"
         "b _panic" :
         :
         [stacktop]"r" (_panic_stack + PANIC_STACK_SIZE),
-        [s]"r" (s) );
+        [s]"r" (s),
+        [pc]"r" (__builtin_return_address(0)) :
+        "r0", "r1", "r2" );
     __builtin_unreachable();
 }
@@ -0,0 +1,112 @@
+/* defer.c
+ * Work handed off from interrupts to one shared thread
+ * RebbleOS
+ *
+ * An ISR that has more to do than wake whoever is waiting on it posts a
+ * function and an argument here, and the defer thread runs it soon after,
+ * above every other thread. That saves a driver keeping a thread and a
+ * stack of its own just to sit on one notification.
+ *
+ * Handlers share the thread, so they must not block or sleep. Anything
+ * that wants to wait for time to pass keeps a deadline instead.
+ *
+ * ISRs nest, so any of them can be posting while another is. A post
+ * masks interrupts for the few instructions it takes to claim a slot.
+ */
+
+#include "rebbleos.h"
+#include "defer.h"
+
+/* a power of two */
+#define DEFER_ENTRIES 16
+#define DEFER_STACK_SIZE (configMINIMAL_STACK_SIZE + 100)
+
+typedef struct DeferItem {
+    DeferFunc func;
+    void *arg;
+    uint32_t posted; /* cycle count */
+} DeferItem;
+
+static DeferItem _items[DEFER_ENTRIES];
+static volatile uint32_t _head; /* next to post, ISRs only */
+static volatile uint32_t _tail; /* next to run, the thread only */
+
+static TaskHandle_t _defer_task;
+static StaticTask_t _defer_task_buf;
+static StackType_t _defer_task_stack[DEFER_STACK_SIZE];
+static void _defer_thread(void *pvParameters);
+
+static uint32_t _stat_count;
+static uint32_t _stat_dropped;
+static uint32_t _stat_total;
+static uint32_t _stat_max;
+
+void defer_init(void)
+{
+    /* above the overlay: what is waiting on these is user visible */
+    _defer_task = xTaskCreateStatic(_defer_thread, "Defer", DEFER_STACK_SIZE, NULL,
+                                    configMAX_PRIORITIES - 1, _defer_task_stack, &_defer_task_buf);
+}
+
+/*
+ * From an ISR. false if the ring was full and func won't be run
+ */
+bool defer_from_isr(DeferFunc func, void *arg)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    if (_head - _tail == DEFER_ENTRIES)
+    {
+        _stat_dropped++;
+        portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+        return false;
+    }
+
+    DeferItem *item = &_items[_head & (DEFER_ENTRIES - 1)];
+    item->func = func;
+    item->arg = arg;
+    item->posted = hw_cycle_count();
+    _head++;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    vTaskNotifyGiveFromISR(_defer_task, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+
+    return true;
+}
+
+static void _defer_thread(void *pvParameters)
+{
+    for ( ;; )
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* everything posted until now, and whatever lands while we are at it */
+        while (_tail != _head)
+        {
+            DeferItem item = _items[_tail & (DEFER_ENTRIES - 1)];
+            _tail++;
+
+            /* the counter stops in STOP mode, so this can read short, never long */
+            uint32_t latency = hw_cycle_count() - item.posted;
+            _stat_count++;
+            _stat_total += latency;
+            if (latency > _stat_max)
+                _stat_max = latency;
+
+            item.func(item.arg);
+        }
+    }
+}
+
+void defer_stats(DeferStats *stats)
+{
+    taskENTER_CRITICAL();
+    stats->count = _stat_count;
+    stats->dropped = _stat_dropped;
+    stats->avg_cycles = _stat_count ? _stat_total / _stat_count : 0;
+    stats->max_cycles = _stat_max;
+    _stat_count = _stat_dropped = _stat_total = _stat_max = 0;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,22 @@
+#pragma once
+/* defer.h
+ * Work handed off from interrupts to one shared thread
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*DeferFunc)(void *arg);
+
+/* ISR to handler, on the cycle counter. Reset by each read */
+typedef struct DeferStats {
+    uint32_t count;
+    uint32_t dropped;
+    uint32_t avg_cycles;
+    uint32_t max_cycles;
+} DeferStats;
+
+void defer_init(void);
+bool defer_from_isr(DeferFunc func, void *arg);
+void defer_stats(DeferStats *stats);
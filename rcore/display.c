@@ -13,47 +13,149 @@
  *   The draw is run in the caller's thread context.
  *   This is a blocking process until a complete frame is drawn.
  *   This must be run in the scheduler, not before.
+ *
+ *   With DISPLAY_DOUBLE_BUFFER, apps draw into a back buffer instead.
+ *   display_draw waits for the previous frame to finish, copies the back
+ *   buffer over the driver's buffer and returns. The ISR chain then
+ *   pushes the frame out while the app carries on with the next one.
+ *
+ *   display_draw_async starts a frame and returns straight away. The ISR
+ *   chains the rest of the frame and calls back when it is out. Nobody
+ *   may touch the framebuffer until then.
+ *
+ *   On round displays, display_spans has the part of each row behind
+ *   the glass. The fast drawing paths and the scanline converter skip
+ *   the rest.
  *  
  */
  
 #include "rebbleos.h"
 #include "appmanager.h"
+#include "boot_profile.h"
+#include "input_latency.h"
+
+/* Uncomment to draw into a back buffer and send frames asynchronously.
+ * Costs a second framebuffer worth of main SRAM */
+// #define DISPLAY_DOUBLE_BUFFER
 
 /* Semaphore to start drawing */
 static SemaphoreHandle_t _display_start_sem;
 static StaticSemaphore_t _display_start_sem_buf;
 
-static void _display_start_frame(uint8_t offset_x, uint8_t offset_y);
+static void _display_start_frame(uint8_t offset_x, uint8_t offset_y, uint8_t width, uint8_t height);
 static void _display_cmd(uint8_t cmd, char *data);
 
 /* A mutex to use for locking buffers */
 static StaticSemaphore_t _draw_mutex_buf;
 static SemaphoreHandle_t _draw_mutex;
 
+#ifdef DISPLAY_DOUBLE_BUFFER
+/* What everyone draws into. Copied to the hardware buffer on draw */
+static uint8_t _back_buffer[MAX_FRAMEBUFFER_SIZE] __attribute__((aligned(4)));
+#endif
+
+/* Given when the hardware has finished with the front buffer */
+static SemaphoreHandle_t _display_done_sem;
+static StaticSemaphore_t _display_done_sem_buf;
+
+/* Set while a frame goes out with nobody waiting on it */
+static volatile bool _display_async;
+static DisplayDoneCallback _display_done_callback;
+static void *_display_done_context;
+
+#ifdef FRAME_PROFILE
+static uint32_t _display_frame_started;
+#endif
+
 /*
  * Start the display driver and tasks
  */
+#ifdef PBL_ROUND
+/* every converted row looks here */
+DisplaySpan display_spans[DISPLAY_ROWS] HOT_DATA;
+
+/*
+ * A pixel is behind the glass if any of it is inside the circle the width
+ * of the display. Worked in half pixels so the centre is on a pixel edge
+ */
+static void _display_spans_init(void)
+{
+    const int32_t d = DISPLAY_COLS;
+    int32_t s = 0;
+
+    for (int16_t y = 0; y < DISPLAY_ROWS / 2; y++)
+    {
+        /* from the centre to the nearest edge of the row. The rows grow
+         * towards the middle, so s only goes up */
+        int32_t dy = DISPLAY_ROWS - 2 * y - 2;
+        while ((s + 1) * (s + 1) <= d * d - dy * dy)
+            s++;
+
+        DisplaySpan span = {
+            .x0 = s >= d - 1 ? 0 : (d - s - 1) / 2,
+            .x1 = (d + s) / 2 + 1 > d ? d : (d + s) / 2 + 1,
+        };
+        display_spans[y] = span;
+        display_spans[DISPLAY_ROWS - 1 - y] = span;
+    }
+}
+#endif
+
 uint8_t display_init(void)
 {
+#ifdef PBL_ROUND
+    _display_spans_init();
+#endif
+
     _display_start_sem = xSemaphoreCreateBinaryStatic(&_display_start_sem_buf);
     _draw_mutex        = xSemaphoreCreateMutexStatic(&_draw_mutex_buf);
+    _display_done_sem  = xSemaphoreCreateBinaryStatic(&_display_done_sem_buf);
+    /* nothing is being sent yet */
+    xSemaphoreGive(_display_done_sem);
     
+    boot_profile_step_start(BootProfileDisplay);
     hw_display_init();
-    os_module_init_complete(0);
+    boot_profile_step_end(BootProfileDisplay);
+    hw_gfx_init();
     
-    return INIT_RESP_ASYNC_WAIT;
+    return INIT_RESP_OK;
 }
 
 /*
  * Called after the render of each row/col
  * We then set a semaphore for the display thread to wake on
  */
-void display_done_isr(uint8_t cmd)
+HOT_RAMFUNC void display_done_isr(uint8_t cmd)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     
-    /* Notify the task that the transmission is complete. */
-    xSemaphoreGiveFromISR(_display_start_sem, &xHigherPriorityTaskWoken);
+#ifndef DISPLAY_DOUBLE_BUFFER
+    if (!_display_async)
+    {
+        /* Notify the task that the transmission is complete. */
+        xSemaphoreGiveFromISR(_display_start_sem, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        return;
+    }
+#endif
+
+    /* Nobody is sat waiting on each row/col, so chain the next one
+     * from here and only wake drawers once the frame is out */
+    if (hw_display_process_isr())
+    {
+        DisplayDoneCallback callback = _display_done_callback;
+        
+#ifdef FRAME_PROFILE
+        frame_profile_add(FrameProfileDisplayWait, hw_cycle_count() - _display_frame_started);
+#endif
+        boot_profile_event(BootProfileFirstFrame);
+        input_latency_frame_done();
+        _display_async = false;
+        _display_done_callback = NULL;
+        xSemaphoreGiveFromISR(_display_done_sem, &xHigherPriorityTaskWoken);
+        if (callback)
+            callback(_display_done_context);
+    }
     
     portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
@@ -69,11 +171,20 @@ void display_reset(uint8_t enabled)
 }
 
 /*
- * Begin rendering a frame from the framebuffer into the display
+ * Begin rendering a frame from the framebuffer into the display.
+ * Only the given window of the framebuffer is guaranteed to be sent,
+ * the hardware is free to round it up to whatever it can address
  */
-static void _display_start_frame(uint8_t xoffset, uint8_t yoffset)
+static void _display_start_frame(uint8_t xoffset, uint8_t yoffset, uint8_t width, uint8_t height)
 {
-    hw_display_start_frame(xoffset, yoffset);
+#ifdef FRAME_PROFILE
+    _display_frame_started = hw_cycle_count();
+#endif
+    input_latency_frame_start();
+    if (xoffset == 0 && yoffset == 0 && width == DISPLAY_COLS && height == DISPLAY_ROWS)
+        hw_display_start_frame(0, 0);
+    else
+        hw_display_start_frame_region(xoffset, yoffset, width, height);
 }
 
 /*
@@ -81,7 +192,11 @@ static void _display_start_frame(uint8_t xoffset, uint8_t yoffset)
  */
 uint8_t *display_get_buffer(void)
 {
+#ifdef DISPLAY_DOUBLE_BUFFER
+    return _back_buffer;
+#else
     return hw_display_get_buffer();
+#endif
 }
 
 /*
@@ -91,9 +206,52 @@ uint8_t *display_get_buffer(void)
  * To be called from an rtos thread only
  */
 void display_draw(void)
+{
+    display_draw_region(n_GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS));
+}
+
+/* Clip region to the display. Returns false if none of it is on screen */
+static bool _display_clip(n_GRect region, n_GRect *clipped)
+{
+    int16_t x0 = region.origin.x < 0 ? 0 : region.origin.x;
+    int16_t y0 = region.origin.y < 0 ? 0 : region.origin.y;
+    int16_t x1 = region.origin.x + region.size.w;
+    int16_t y1 = region.origin.y + region.size.h;
+    
+    if (x1 > DISPLAY_COLS) x1 = DISPLAY_COLS;
+    if (y1 > DISPLAY_ROWS) y1 = DISPLAY_ROWS;
+    
+    if (x1 <= x0 || y1 <= y0)
+        return false;
+    
+    *clipped = n_GRect(x0, y0, x1 - x0, y1 - y0);
+    return true;
+}
+
+/*
+ * As display_draw, but only pushes the damaged region of the framebuffer
+ * The region is in screen coordinates and gets clipped to the display
+ */
+void display_draw_region(n_GRect region)
 {
     uint8_t done = 0;
-    _display_start_frame(0, 0);
+    n_GRect r;
+    
+    /* nothing on screen to send */
+    if (!_display_clip(region, &r))
+        return;
+    
+    /* Only block if the last frame is still going out */
+    xSemaphoreTake(_display_done_sem, portMAX_DELAY);
+    
+#ifdef DISPLAY_DOUBLE_BUFFER
+    memcpy(hw_display_get_buffer(), _back_buffer, MAX_FRAMEBUFFER_SIZE);
+    _display_async = true;
+    _display_start_frame(r.origin.x, r.origin.y, r.size.w, r.size.h);
+    return;
+#endif
+
+    _display_start_frame(r.origin.x, r.origin.y, r.size.w, r.size.h);
 
     /* A frame is requested. Sit and await frame draw completion */
     while(!done)
@@ -103,6 +261,49 @@ void display_draw(void)
         xSemaphoreTake(_display_start_sem, portMAX_DELAY);
         done = hw_display_process_isr();
     }
+#ifdef FRAME_PROFILE
+    frame_profile_add(FrameProfileDisplayWait, hw_cycle_count() - _display_frame_started);
+#endif
+    boot_profile_event(BootProfileFirstFrame);
+    input_latency_frame_done();
+    
+    xSemaphoreGive(_display_done_sem);
+}
+
+/*
+ * Start pushing region out and return without waiting.
+ * callback is run from the ISR once the frame is out, so keep it short.
+ * Returns false, with nothing sent and no callback coming, if none of
+ * region is on screen or the last frame is still going
+ */
+bool display_draw_async(n_GRect region, DisplayDoneCallback callback, void *context)
+{
+    n_GRect r;
+    
+    if (!_display_clip(region, &r))
+        return false;
+    
+    if (!xSemaphoreTake(_display_done_sem, 0))
+        return false;
+    
+#ifdef DISPLAY_DOUBLE_BUFFER
+    memcpy(hw_display_get_buffer(), _back_buffer, MAX_FRAMEBUFFER_SIZE);
+#endif
+    
+    _display_done_callback = callback;
+    _display_done_context = context;
+    _display_async = true;
+    _display_start_frame(r.origin.x, r.origin.y, r.size.w, r.size.h);
+    
+    return true;
+}
+
+/*
+ * Is a frame still going out?
+ */
+bool display_is_busy(void)
+{
+    return _display_async;
 }
 
 inline bool display_buffer_lock_take(uint32_t timeout)
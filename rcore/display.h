@@ -8,14 +8,31 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "rect.h"
+
+typedef void (*DisplayDoneCallback)(void *context);
 
 uint8_t display_init(void);
 void display_done_isr(uint8_t cmd);
 void display_reset(uint8_t enabled);
 void display_draw(void);
+void display_draw_region(n_GRect region);
+bool display_draw_async(n_GRect region, DisplayDoneCallback callback, void *context);
+bool display_is_busy(void);
 uint8_t *display_get_buffer(void);
 
 bool display_buffer_lock_give(void);
 bool display_buffer_lock_take(uint32_t timeout);
 
 bool display_is_buffer_locked(void);
+
+#ifdef PBL_ROUND
+/* The pixels of a row that are behind the glass, x0 up to but not x1 */
+typedef struct DisplaySpan {
+    uint8_t x0;
+    uint8_t x1;
+} DisplaySpan;
+
+/* One per row, filled in by display_init */
+extern DisplaySpan display_spans[];
+#endif
@@ -6,42 +6,391 @@
  */
 
 #include "rebbleos.h"
+#include "boot_profile.h"
 #include "platform.h"
 #include "flash.h"
 #include "fs.h"
+#include "stm32_power.h"
 
 extern void hw_flash_init(void);
 extern void hw_flash_read_bytes(uint32_t, uint8_t*, size_t);
+extern void hw_flash_write_bytes(uint32_t, const uint8_t*, size_t);
+extern void hw_flash_erase(uint32_t, size_t);
+extern const void *hw_flash_map(uint32_t, size_t);
+extern bool hw_flash_unmap(const void *);
 
 static SemaphoreHandle_t _flash_mutex;
 static StaticSemaphore_t _flash_mutex_buf;
 static SemaphoreHandle_t _flash_wait_semaphore;
 static StaticSemaphore_t _flash_wait_semaphore_buf;
 
+/* flash_read_async requests, a queue for each priority, and a thread
+ * that works through them highest first */
+#define FLASH_QUEUE_LENGTH 8
+#define FLASH_MERGE_MAX    4
+#define FLASH_TASK_STACK   (configMINIMAL_STACK_SIZE + 200)
+
+typedef struct flash_request {
+    uint32_t address;
+    uint8_t *buffer;
+    size_t num_bytes;
+    flash_read_callback callback;
+    void *context;
+} flash_request;
+
+static QueueHandle_t _flash_queue[FlashPriorityCount];
+static StaticQueue_t _flash_queue_buf[FlashPriorityCount];
+static uint8_t _flash_queue_contents[FlashPriorityCount][FLASH_QUEUE_LENGTH * sizeof(flash_request)];
+/* one count per queued request */
+static SemaphoreHandle_t _flash_request_sem;
+static StaticSemaphore_t _flash_request_sem_buf;
+static TaskHandle_t _flash_task;
+static StaticTask_t _flash_task_buf;
+static StackType_t _flash_task_stack[FLASH_TASK_STACK];
+
+static void _flash_thread(void *pvParameters);
+
+/* read counts, kept under the flash mutex */
+static FlashStats _flash_stats;
+
+#ifdef FLASH_CACHE
+/* A little set associative cache of flash lines, for the small reads
+ * of headers and tables the fs and resources do over and over. Bigger
+ * reads go round it */
+#define FLASH_CACHE_LINE    64
+#define FLASH_CACHE_SETS    16
+#define FLASH_CACHE_WAYS    2
+#define FLASH_CACHE_MAX     (FLASH_CACHE_LINE * 2)
+#define FLASH_CACHE_INVALID 0xFFFFFFFF
+
+typedef struct flash_cache_set {
+    uint32_t line[FLASH_CACHE_WAYS]; /* flash address of each way */
+    uint8_t next; /* way to evict */
+    uint8_t data[FLASH_CACHE_WAYS][FLASH_CACHE_LINE];
+} flash_cache_set;
+
+static flash_cache_set _flash_cache[FLASH_CACHE_SETS] CCRAM;
+static uint32_t _flash_cache_hits;
+static uint32_t _flash_cache_misses;
+
+static void _flash_read(uint32_t address, uint8_t *buffer, size_t num_bytes);
+
+/* with the flash mutex held */
+static void _flash_cache_read(uint32_t address, uint8_t *buffer, size_t num_bytes)
+{
+    while (num_bytes)
+    {
+        uint32_t line = address & ~(FLASH_CACHE_LINE - 1);
+        uint32_t ofs = address - line;
+        size_t n = FLASH_CACHE_LINE - ofs;
+        flash_cache_set *set = &_flash_cache[(line / FLASH_CACHE_LINE) & (FLASH_CACHE_SETS - 1)];
+        uint8_t way;
+        
+        if (n > num_bytes)
+            n = num_bytes;
+        
+        for (way = 0; way < FLASH_CACHE_WAYS && set->line[way] != line; way++)
+            ;
+        
+        if (way == FLASH_CACHE_WAYS)
+        {
+            way = set->next;
+            _flash_read(line, set->data[way], FLASH_CACHE_LINE);
+            set->line[way] = line;
+            _flash_cache_misses++;
+        }
+        else
+            _flash_cache_hits++;
+        
+        set->next = (way + 1) % FLASH_CACHE_WAYS;
+        memcpy(buffer, &set->data[way][ofs], n);
+        
+        address += n;
+        buffer += n;
+        num_bytes -= n;
+    }
+}
+
+/* with the flash mutex held */
+static void _flash_cache_drop(uint32_t address, size_t num_bytes)
+{
+    for (uint8_t i = 0; i < FLASH_CACHE_SETS; i++)
+        for (uint8_t w = 0; w < FLASH_CACHE_WAYS; w++)
+            if (_flash_cache[i].line[w] + FLASH_CACHE_LINE > address &&
+                _flash_cache[i].line[w] < address + num_bytes)
+                _flash_cache[i].line[w] = FLASH_CACHE_INVALID;
+}
+
+/*
+ * Drop anything cached from this span. Writes and erases do this
+ * themselves; this is for anyone changing flash behind our back
+ */
+void flash_cache_invalidate(uint32_t address, size_t num_bytes)
+{
+    xSemaphoreTake(_flash_mutex, portMAX_DELAY);
+    _flash_cache_drop(address, num_bytes);
+    xSemaphoreGive(_flash_mutex);
+}
+
+void flash_cache_stats(uint32_t *hits, uint32_t *misses)
+{
+    *hits = _flash_cache_hits;
+    *misses = _flash_cache_misses;
+}
+#endif
+
 uint8_t flash_init()
 {
     // initialise device specific flash
+    boot_profile_step_start(BootProfileFlash);
     hw_flash_init();
+    boot_profile_step_end(BootProfileFlash);
+    
+#ifdef FLASH_CACHE
+    for (uint8_t i = 0; i < FLASH_CACHE_SETS; i++)
+    {
+        for (uint8_t w = 0; w < FLASH_CACHE_WAYS; w++)
+            _flash_cache[i].line[w] = FLASH_CACHE_INVALID;
+        _flash_cache[i].next = 0;
+    }
+#endif
     
     _flash_mutex = xSemaphoreCreateMutexStatic(&_flash_mutex_buf);
     _flash_wait_semaphore = xSemaphoreCreateBinaryStatic(&_flash_wait_semaphore_buf);
+    for (uint8_t i = 0; i < FlashPriorityCount; i++)
+        _flash_queue[i] = xQueueCreateStatic(FLASH_QUEUE_LENGTH, sizeof(flash_request), _flash_queue_contents[i], &_flash_queue_buf[i]);
+    _flash_request_sem = xSemaphoreCreateCountingStatic(FlashPriorityCount * FLASH_QUEUE_LENGTH, 0, &_flash_request_sem_buf);
+    _flash_task = xTaskCreateStatic(_flash_thread, "Flash", FLASH_TASK_STACK, NULL, tskIDLE_PRIORITY + 5UL, _flash_task_stack, &_flash_task_buf);
     fs_init();
     
     return 0;
 }
 
+/* one hw read, with the flash mutex held */
+static void _flash_read(uint32_t address, uint8_t *buffer, size_t num_bytes)
+{
+    hw_flash_read_bytes(address, buffer, num_bytes);
+    
+    /* sit the caller being this wait lock semaphore */
+    if (!xSemaphoreTake(_flash_wait_semaphore, pdMS_TO_TICKS(200)))
+        panic("Got stuck behind a wait lock in flash.c");
+}
+
+/* Take the mutex for a read, and note how long that took. Returns the
+ * cycle count the read started at. The CPU is at full speed until the
+ * unlock, as the FMC is clocked off it */
+static uint32_t _flash_read_lock(uint32_t *wait_us)
+{
+    uint32_t start = hw_cycle_count();
+    
+    stm32_power_cpu_request();
+    xSemaphoreTake(_flash_mutex, portMAX_DELAY);
+    *wait_us = (hw_cycle_count() - start) / hw_cycles_per_us();
+    return start;
+}
+
+static FlashTaskStats *_flash_task_stats(void)
+{
+    const char *name = xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED ? "boot" : pcTaskGetName(NULL);
+    uint8_t i;
+    
+    for (i = 0; i < _flash_stats.task_count; i++)
+        if (!strncmp(_flash_stats.task[i].name, name, configMAX_TASK_NAME_LEN))
+            return &_flash_stats.task[i];
+    
+    /* full up, and the last one is everyone else */
+    if (i == FLASH_STATS_TASKS)
+        return &_flash_stats.task[FLASH_STATS_TASKS - 1];
+    
+    strncpy(_flash_stats.task[i].name, name, configMAX_TASK_NAME_LEN);
+    _flash_stats.task_count++;
+    return &_flash_stats.task[i];
+}
+
+/* Count a read and give the mutex back */
+static void _flash_read_unlock(uint32_t start, uint32_t wait_us, size_t num_bytes)
+{
+    uint32_t us = (hw_cycle_count() - start) / hw_cycles_per_us();
+    uint8_t b = 0;
+    FlashTaskStats *task = _flash_task_stats();
+    
+    while (b < FLASH_STATS_LATENCY_BUCKETS - 1 && us >= (FLASH_STATS_LATENCY_MIN_US << b))
+        b++;
+    
+    _flash_stats.reads++;
+    _flash_stats.bytes += num_bytes;
+    _flash_stats.latency[b]++;
+    _flash_stats.wait_us += wait_us;
+    if (wait_us > _flash_stats.wait_max_us)
+        _flash_stats.wait_max_us = wait_us;
+    task->reads++;
+    task->bytes += num_bytes;
+    task->wait_us += wait_us;
+    
+    xSemaphoreGive(_flash_mutex);
+    stm32_power_cpu_release();
+}
+
 /*
  * Read a given number of bytes SAFELY from the flash chip
  * DO NOT use from an ISR
  */
 void flash_read_bytes(uint32_t address, uint8_t *buffer, size_t num_bytes)
+{
+    uint32_t wait_us;
+    uint32_t start = _flash_read_lock(&wait_us);
+    
+#ifdef FLASH_CACHE
+    if (num_bytes <= FLASH_CACHE_MAX)
+        _flash_cache_read(address, buffer, num_bytes);
+    else
+#endif
+        _flash_read(address, buffer, num_bytes);
+    _flash_read_unlock(start, wait_us, num_bytes);
+}
+
+/*
+ * Read num_bytes from each of count places stride apart into buffer,
+ * back to back, taking the lock once. For scanning page headers
+ */
+void flash_read_bytes_strided(uint32_t address, uint32_t stride, uint16_t count, uint8_t *buffer, size_t num_bytes)
+{
+    uint32_t wait_us;
+    uint32_t start = _flash_read_lock(&wait_us);
+    
+    for (uint16_t i = 0; i < count; i++)
+        _flash_read(address + i * stride, buffer + i * num_bytes, num_bytes);
+    _flash_read_unlock(start, wait_us, count * num_bytes);
+}
+
+/*
+ * Copy out the read counts since boot
+ */
+void flash_stats(FlashStats *stats)
 {
     xSemaphoreTake(_flash_mutex, portMAX_DELAY);
-    hw_flash_read_bytes(address, buffer, num_bytes);
+    *stats = _flash_stats;
+    xSemaphoreGive(_flash_mutex);
+#ifdef FLASH_CACHE
+    stats->cache_hits = _flash_cache_hits;
+    stats->cache_misses = _flash_cache_misses;
+#endif
+}
+
+/*
+ * Program bytes into erased flash. Bits only go from 1 to 0, so writing
+ * over something already written ANDs it in; that's how the fs flips
+ * its flags. Blocks until the part is done
+ */
+void flash_write_bytes(uint32_t address, const uint8_t *buffer, size_t num_bytes)
+{
+    xSemaphoreTake(_flash_mutex, portMAX_DELAY);
+    hw_flash_write_bytes(address, buffer, num_bytes);
+#ifdef FLASH_CACHE
+    _flash_cache_drop(address, num_bytes);
+#endif
+    xSemaphoreGive(_flash_mutex);
+}
+
+/*
+ * Erase back to 0xFF. address and num_bytes have to be on the part's
+ * erase boundaries. This takes a good fraction of a second, and every
+ * other flash user waits for it
+ */
+void flash_erase(uint32_t address, size_t num_bytes)
+{
+    xSemaphoreTake(_flash_mutex, portMAX_DELAY);
+    hw_flash_erase(address, num_bytes);
+#ifdef FLASH_CACHE
+    _flash_cache_drop(address, num_bytes);
+#endif
+    xSemaphoreGive(_flash_mutex);
+}
+
+/*
+ * A pointer straight at the flash, for a caller that only reads it.
+ * NULL where the flash isn't memory mapped; read it the usual way then.
+ * The flash stays powered up until the pointer is given to flash_unmap
+ */
+const void *flash_map(uint32_t address, size_t num_bytes)
+{
+    return hw_flash_map(address, num_bytes);
+}
+
+/* false if ptr didn't come from flash_map */
+bool flash_unmap(const void *ptr)
+{
+    return hw_flash_unmap(ptr);
+}
+
+/*
+ * Queue a read, and have cb called on the flash thread once buffer is
+ * filled. Keep the callback short; post back to your own thread for
+ * anything real. False if that priority's queue is full
+ */
+bool flash_read_async(uint32_t address, uint8_t *buffer, size_t num_bytes, flash_read_callback cb, void *context, FlashPriority priority)
+{
+    flash_request req = {
+        .address = address,
+        .buffer = buffer,
+        .num_bytes = num_bytes,
+        .callback = cb,
+        .context = context,
+    };
     
-    /* sit the caller being this wait lock semaphore */
-    if (!xSemaphoreTake(_flash_wait_semaphore, pdMS_TO_TICKS(200)))
-        panic("Got stuck behind a wait lock in flash.c");
+    assert(priority < FlashPriorityCount);
+    if (!xQueueSendToBack(_flash_queue[priority], &req, 0))
+        return false;
+    
+    xSemaphoreGive(_flash_request_sem);
+    return true;
+}
+
+/* take the next request, and any after it in the same queue that pick
+ * up where it leaves off, in flash and in memory */
+static uint8_t _flash_next_requests(flash_request *reqs)
+{
+    for (uint8_t p = 0; p < FlashPriorityCount; p++)
+    {
+        if (!xQueueReceive(_flash_queue[p], &reqs[0], 0))
+            continue;
+        
+        uint8_t n = 1;
+        while (n < FLASH_MERGE_MAX && xQueuePeek(_flash_queue[p], &reqs[n], 0) &&
+               reqs[n].address == reqs[n - 1].address + reqs[n - 1].num_bytes &&
+               reqs[n].buffer == reqs[n - 1].buffer + reqs[n - 1].num_bytes)
+        {
+            xQueueReceive(_flash_queue[p], &reqs[n], 0);
+            xSemaphoreTake(_flash_request_sem, 0);
+            n++;
+        }
+        return n;
+    }
+    
+    return 0;
+}
+
+static void _flash_thread(void *pvParameters)
+{
+    flash_request reqs[FLASH_MERGE_MAX];
+    
+    while (1)
+    {
+        xSemaphoreTake(_flash_request_sem, portMAX_DELAY);
+        
+        uint8_t n = _flash_next_requests(reqs);
+        if (!n)
+            continue;
+        
+        size_t total = 0;
+        for (uint8_t i = 0; i < n; i++)
+            total += reqs[i].num_bytes;
+        flash_read_bytes(reqs[0].address, reqs[0].buffer, total);
+        
+        for (uint8_t i = 0; i < n; i++)
+            if (reqs[i].callback)
+                reqs[i].callback(reqs[i].buffer, reqs[i].num_bytes, reqs[i].context);
+    }
 }
 
 void flash_dump(void)
@@ -64,7 +413,6 @@ inline void flash_operation_complete(uint8_t cmd)
 {
     /* Notify the task that the transmission is complete. */
     xSemaphoreGive(_flash_wait_semaphore);
-    xSemaphoreGive(_flash_mutex);
 }
 
 void flash_operation_complete_isr(uint8_t cmd)
@@ -9,6 +9,9 @@
 /* flash regions have moved to platform.h / platform_config.h */
 #include "appmanager.h"
 
+/* cache small flash reads, see flash.c. Comment out to read straight through */
+#define FLASH_CACHE
+
 #define RES_COUNT           0x00
 #define RES_CRC             0x04
 #define RES_TABLE_START     0x0C
@@ -25,9 +28,58 @@ typedef struct ResourceHeader {
     uint32_t unknownoffset;
 } __attribute__((__packed__)) ResourceHeader;
  
+/* flash_read_bytes latency buckets: the first is under 32us, each one
+ * after twice the last, and the last everything longer */
+#define FLASH_STATS_LATENCY_BUCKETS 8
+#define FLASH_STATS_LATENCY_MIN_US  32
+/* most callers told apart, by task name. The rest go in the last */
+#define FLASH_STATS_TASKS 8
+
+typedef struct __attribute__((__packed__)) FlashTaskStats {
+    char name[configMAX_TASK_NAME_LEN]; /* not terminated if it fills the field */
+    uint32_t reads;
+    uint32_t bytes;
+    uint32_t wait_us;
+} FlashTaskStats;
+
+/* Reads since boot, flash_read_bytes and the strided reads alike. The
+ * latency is as the caller saw it, waiting for the mutex and all */
+typedef struct __attribute__((__packed__)) FlashStats {
+    uint32_t reads;
+    uint32_t bytes;
+    uint32_t latency[FLASH_STATS_LATENCY_BUCKETS];
+    uint32_t wait_us;       /* for the mutex, all told */
+    uint32_t wait_max_us;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint8_t task_count;
+    FlashTaskStats task[FLASH_STATS_TASKS];
+} FlashStats;
+
+typedef void (*flash_read_callback)(uint8_t *buffer, size_t num_bytes, void *context);
+
+/* flash_read_async priorities, most urgent first */
+typedef enum FlashPriority {
+    FlashPriorityUI,            /* the foreground app is waiting on it */
+    FlashPriorityNormal,
+    FlashPriorityBackground,    /* installs and other bulk traffic */
+    FlashPriorityCount,
+} FlashPriority;
+
 uint8_t flash_init(void);
 void flash_test(uint16_t resource_id);
 void flash_read_bytes(uint32_t address, uint8_t *buffer, size_t num_bytes);
+void flash_write_bytes(uint32_t address, const uint8_t *buffer, size_t num_bytes);
+void flash_erase(uint32_t address, size_t num_bytes);
+bool flash_read_async(uint32_t address, uint8_t *buffer, size_t num_bytes, flash_read_callback cb, void *context, FlashPriority priority);
+const void *flash_map(uint32_t address, size_t num_bytes);
+bool flash_unmap(const void *ptr);
+void flash_read_bytes_strided(uint32_t address, uint32_t stride, uint16_t count, uint8_t *buffer, size_t num_bytes);
+#ifdef FLASH_CACHE
+void flash_cache_invalidate(uint32_t address, size_t num_bytes);
+void flash_cache_stats(uint32_t *hits, uint32_t *misses);
+#endif
+void flash_stats(FlashStats *stats);
 void flash_dump(void);
 void flash_operation_complete(uint8_t cmd);
 void flash_operation_complete_isr(uint8_t cmd);
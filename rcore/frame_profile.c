@@ -0,0 +1,186 @@
+/* frame_profile.c
+ * Where a frame's time goes
+ * RebbleOS
+ *
+ * The render path marks its phases with FRAME_PROFILE_START/STOP, and the
+ * cycles are added to the frame being drawn. Parts of a frame land after
+ * the app thread is done with it (the display going out, scanlines being
+ * converted in the ISR), so a frame is only closed off into the ring when
+ * the next one begins.
+ *
+ * Phases nest: the layer walk is inside the window draw, and update_procs
+ * inside the layer walk. A frame's total is the outermost phases only.
+ */
+
+#include "rebbleos.h"
+#include "frame_profile.h"
+#include "endpoint.h"
+
+#define FRAME_PROFILE_FRAMES 32
+
+typedef struct FrameProfileFrame {
+    uint32_t cycles[FrameProfilePhaseCount];
+} FrameProfileFrame;
+
+#ifdef FRAME_PROFILE
+
+static FrameProfileFrame _frames[FRAME_PROFILE_FRAMES];
+static uint16_t _frame_head;
+static uint16_t _frame_count;
+static FrameProfileFrame _current;
+static bool _current_open;
+/* every frame begun, for working out a frame rate */
+static uint32_t _frames_total;
+
+static uint32_t _frame_total(const FrameProfileFrame *frame)
+{
+    return frame->cycles[FrameProfileWindowDraw] +
+           frame->cycles[FrameProfileOverlayDraw] +
+           frame->cycles[FrameProfileDisplayWait] +
+           frame->cycles[FrameProfileLockWait];
+}
+
+/*
+ * The app is about to draw. Whatever the last frame collected is final now
+ */
+void frame_profile_frame_begin(void)
+{
+    taskENTER_CRITICAL();
+    if (_current_open)
+    {
+        _frames[_frame_head] = _current;
+        _frame_head = (_frame_head + 1) % FRAME_PROFILE_FRAMES;
+        if (_frame_count < FRAME_PROFILE_FRAMES)
+            _frame_count++;
+    }
+    memset(&_current, 0, sizeof(_current));
+    _current_open = true;
+    _frames_total++;
+    taskEXIT_CRITICAL();
+}
+
+/* Safe from ISRs. A word add is as atomic as we need for a profile */
+void frame_profile_add(FrameProfilePhase phase, uint32_t cycles)
+{
+    _current.cycles[phase] += cycles;
+}
+
+uint32_t frame_profile_frame_count(void)
+{
+    return _frames_total;
+}
+
+/* A phase of the last frame to be closed off */
+uint32_t frame_profile_last(FrameProfilePhase phase)
+{
+    if (!_frame_count)
+        return 0;
+
+    return _frames[(_frame_head + FRAME_PROFILE_FRAMES - 1) % FRAME_PROFILE_FRAMES].cycles[phase];
+}
+
+void frame_profile_get_stats(FrameProfileStats *stats)
+{
+    memset(stats, 0, sizeof(FrameProfileStats));
+
+    taskENTER_CRITICAL();
+    stats->frames = _frame_count;
+    for (uint16_t p = 0; p < FrameProfilePhaseCount; p++)
+    {
+        uint32_t sum = 0;
+        stats->min[p] = UINT32_MAX;
+        for (uint16_t i = 0; i < _frame_count; i++)
+        {
+            uint32_t c = _frames[i].cycles[p];
+            sum += c;
+            if (c < stats->min[p])
+                stats->min[p] = c;
+            if (c > stats->max[p])
+                stats->max[p] = c;
+        }
+        stats->avg[p] = _frame_count ? sum / _frame_count : 0;
+        if (!_frame_count)
+            stats->min[p] = 0;
+    }
+
+    /* insertion into a short sorted list */
+    for (uint16_t i = 0; i < _frame_count; i++)
+    {
+        uint32_t total = _frame_total(&_frames[i]);
+        for (uint16_t w = 0; w < FRAME_PROFILE_WORST; w++)
+        {
+            if (total <= stats->worst[w])
+                continue;
+            memmove(&stats->worst[w + 1], &stats->worst[w],
+                    (FRAME_PROFILE_WORST - w - 1) * sizeof(uint32_t));
+            stats->worst[w] = total;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+#else
+
+void frame_profile_frame_begin(void)
+{
+}
+
+void frame_profile_add(FrameProfilePhase phase, uint32_t cycles)
+{
+}
+
+void frame_profile_get_stats(FrameProfileStats *stats)
+{
+    memset(stats, 0, sizeof(FrameProfileStats));
+}
+
+uint32_t frame_profile_frame_count(void)
+{
+    return 0;
+}
+
+uint32_t frame_profile_last(FrameProfilePhase phase)
+{
+    return 0;
+}
+
+#endif
+
+static const char * const _phase_names[FrameProfilePhaseCount] = {
+    [FrameProfileWindowDraw]  = "window_draw",
+    [FrameProfileLayerWalk]   = "layer_walk",
+    [FrameProfileUpdateProc]  = "update_proc",
+    [FrameProfileOverlayDraw] = "overlay_draw",
+    [FrameProfileScanline]    = "scanline",
+    [FrameProfileDisplayWait] = "display",
+    [FrameProfileLockWait]    = "lock_wait",
+};
+
+/*
+ * Log the stats, in cycles
+ */
+void frame_profile_dump(void)
+{
+    FrameProfileStats stats;
+
+    frame_profile_get_stats(&stats);
+    SYS_LOG("fprof", APP_LOG_LEVEL_INFO, "%d frames", stats.frames);
+    for (uint16_t p = 0; p < FrameProfilePhaseCount; p++)
+        SYS_LOG("fprof", APP_LOG_LEVEL_INFO, "%s min %lu avg %lu max %lu", _phase_names[p],
+                stats.min[p], stats.avg[p], stats.max[p]);
+    for (uint16_t w = 0; w < FRAME_PROFILE_WORST; w++)
+        SYS_LOG("fprof", APP_LOG_LEVEL_INFO, "worst %d: %lu", w, stats.worst[w]);
+}
+
+/*
+ * Debug endpoint. Any packet gets the stats logged and sent back raw
+ */
+void process_frame_profile_packet(uint8_t *data, uint16_t len)
+{
+    FrameProfileStats stats;
+
+    frame_profile_dump();
+    frame_profile_get_stats(&stats);
+    bluetooth_send_packet(ENDPOINT_FRAME_PROFILE, (uint8_t *)&stats, sizeof(stats));
+}
@@ -0,0 +1,60 @@
+#pragma once
+/* frame_profile.h
+ * Where a frame's time goes
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include "platform.h"
+
+/* Uncomment to time the render phases of each frame on the cycle counter.
+ * Off, the markers below compile away to nothing */
+// #define FRAME_PROFILE
+
+/* Uncomment for an overlay of live frame stats, toggled by pressing
+ * up and down together. It reads the profile, so turns that on too */
+// #define PERF_HUD
+
+#if defined(PERF_HUD) && !defined(FRAME_PROFILE)
+#  define FRAME_PROFILE
+#endif
+
+typedef enum FrameProfilePhase {
+    FrameProfileWindowDraw,
+    FrameProfileLayerWalk,
+    FrameProfileUpdateProc,
+    FrameProfileOverlayDraw,
+    FrameProfileScanline,
+    FrameProfileDisplayWait,
+    FrameProfileLockWait,
+    FrameProfilePhaseCount
+} FrameProfilePhase;
+
+/* How many of the worst frames the stats keep */
+#define FRAME_PROFILE_WORST 4
+
+/* Per phase, in cycles, over the frames still in the ring */
+typedef struct FrameProfileStats {
+    uint16_t frames;
+    uint32_t min[FrameProfilePhaseCount];
+    uint32_t avg[FrameProfilePhaseCount];
+    uint32_t max[FrameProfilePhaseCount];
+    /* frame totals, worst first */
+    uint32_t worst[FRAME_PROFILE_WORST];
+} __attribute__((__packed__)) FrameProfileStats;
+
+void frame_profile_frame_begin(void);
+void frame_profile_add(FrameProfilePhase phase, uint32_t cycles);
+void frame_profile_get_stats(FrameProfileStats *stats);
+uint32_t frame_profile_frame_count(void);
+uint32_t frame_profile_last(FrameProfilePhase phase);
+void frame_profile_dump(void);
+void process_frame_profile_packet(uint8_t *data, uint16_t len);
+
+#ifdef FRAME_PROFILE
+#  define FRAME_PROFILE_START(t)      uint32_t t = hw_cycle_count()
+#  define FRAME_PROFILE_STOP(phase, t) frame_profile_add(phase, hw_cycle_count() - t)
+#else
+#  define FRAME_PROFILE_START(t)
+#  define FRAME_PROFILE_STOP(phase, t)
+#endif
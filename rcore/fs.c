@@ -1,5 +1,5 @@
 /* fs.c
- * PebbleFS read-only routines
+ * PebbleFS routines
  * RebbleOS
  */
 #include <stdint.h>
@@ -8,6 +8,9 @@
 #include "log.h"
 #include "fs.h"
 #include "flash.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
 
 
 /* XXX: should filesystem bits and bobs get split out somewhere else? 
@@ -86,8 +89,19 @@ static void _fs_read_page_ofs(int pg, size_t ofs, void *p, size_t n) {
     flash_read_bytes(REGION_FS_START + pg * REGION_FS_PAGE_SIZE + ofs, (uint8_t *)p, n);
 }
 
+static void _fs_write_page_ofs(int pg, size_t ofs, const void *p, size_t n) {
+    flash_write_bytes(REGION_FS_START + pg * REGION_FS_PAGE_SIZE + ofs, (const uint8_t *)p, n);
+}
+
+/* only ever clears bits; that's all a header field can do once written */
+static void _fs_write_u16(int pg, size_t ofs, uint16_t v) {
+    _fs_write_page_ofs(pg, ofs, &v, sizeof(v));
+}
+
 static uint8_t _fs_valid = 1;
 
+/* Unallocated is free to be written, Invalid is dead or dirty and waiting
+ * for the GC to erase it */
 enum page_state {
     PageStateUnallocated = 0,
     PageStateFileStart = 1,
@@ -109,6 +123,405 @@ static enum page_state _fs_get_page_state(uint16_t pg)
     return (_fs_page_flags[pg >> 2] >> (6  - 2 * (pg & 3))) & 3;
 }
 
+/* Index of file names to their start page, filled in by fs_init, so a
+ * lookup is one header read rather than one per file. Open addressing;
+ * the hash is only a hint, every hit is checked against the header. If
+ * there are more files than slots, misses fall back to the page scan */
+#define FS_INDEX_SIZE 512 /* power of 2 */
+#define FS_INDEX_EMPTY 0xFFFF
+#define FS_INDEX_DELETED 0xFFFE /* keeps the probe going past it */
+
+struct fs_index_ent {
+    uint16_t hash;
+    uint16_t page;
+};
+
+static struct fs_index_ent _fs_index[FS_INDEX_SIZE] CCRAM;
+static uint16_t _fs_index_count;
+
+static uint16_t _fs_name_hash(const char *name)
+{
+    /* FNV-1a, folded */
+    uint32_t h = 2166136261u;
+    while (*name)
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    return (h >> 16) ^ h;
+}
+
+static void _fs_index_add(uint16_t pg, const char *name)
+{
+    uint16_t hash = _fs_name_hash(name);
+    
+    if (_fs_index_count == FS_INDEX_SIZE)
+        return;
+    
+    uint16_t i = hash & (FS_INDEX_SIZE - 1);
+    while (_fs_index[i].page != FS_INDEX_EMPTY && _fs_index[i].page != FS_INDEX_DELETED)
+        i = (i + 1) & (FS_INDEX_SIZE - 1);
+    
+    if (_fs_index[i].page == FS_INDEX_EMPTY)
+        _fs_index_count++;
+    _fs_index[i].hash = hash;
+    _fs_index[i].page = pg;
+}
+
+static void _fs_index_remove(uint16_t pg)
+{
+    for (uint16_t i = 0; i < FS_INDEX_SIZE; i++)
+        if (_fs_index[i].page == pg)
+            _fs_index[i].page = FS_INDEX_DELETED;
+}
+
+/* The last few files we've seeked around in keep their page chain, so
+ * moving around one doesn't mean following next_page from the start
+ * every time. Chains are filled in as they get walked. fds are
+ * short lived, so this is shared and keyed on the start page */
+#define FS_CHAIN_CACHE 4
+#define FS_CHAIN_PAGES 64
+
+struct fs_chain {
+    uint16_t startpage;
+    uint16_t npages; /* how much of pages[] we know */
+    uint32_t last_used;
+    uint16_t pages[FS_CHAIN_PAGES];
+};
+
+static struct fs_chain _fs_chains[FS_CHAIN_CACHE] CCRAM;
+static uint32_t _fs_chain_clock;
+static SemaphoreHandle_t _fs_chain_mutex;
+static StaticSemaphore_t _fs_chain_mutex_buf;
+
+/* call with the mutex held */
+static struct fs_chain *_fs_chain_get(uint16_t startpage)
+{
+    struct fs_chain *ch = &_fs_chains[0];
+    
+    for (uint8_t i = 0; i < FS_CHAIN_CACHE; i++)
+    {
+        if (_fs_chains[i].startpage == startpage)
+        {
+            ch = &_fs_chains[i];
+            goto found;
+        }
+        if (_fs_chains[i].last_used < ch->last_used)
+            ch = &_fs_chains[i];
+    }
+    
+    ch->startpage = startpage;
+    ch->pages[0] = startpage;
+    ch->npages = 1;
+found:
+    ch->last_used = ++_fs_chain_clock;
+    return ch;
+}
+
+/* for when a start page stops being the file it was */
+static void _fs_chain_forget(uint16_t startpage)
+{
+    xSemaphoreTake(_fs_chain_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < FS_CHAIN_CACHE; i++)
+    {
+        if (_fs_chains[i].startpage != startpage)
+            continue;
+        _fs_chains[i].startpage = 0xFFFF;
+        _fs_chains[i].last_used = 0;
+    }
+    xSemaphoreGive(_fs_chain_mutex);
+}
+
+static FsStats _fs_stats;
+
+/* Which page the idx'th page of a file is on. The flash reads happen
+ * without the lock; a chain only ever has one answer, so we just check
+ * nobody recycled the slot before writing down what we found. Each page
+ * header read goes on walks */
+static uint16_t _fs_chain_page(const struct file *file, uint16_t idx, uint32_t *walks)
+{
+    struct fs_chain *ch;
+    uint16_t have, pg;
+    
+    xSemaphoreTake(_fs_chain_mutex, portMAX_DELAY);
+    ch = _fs_chain_get(file->startpage);
+    have = (idx < ch->npages) ? idx : ch->npages - 1;
+    pg = ch->pages[have];
+    xSemaphoreGive(_fs_chain_mutex);
+    
+    while (have < idx)
+    {
+        struct page_hdr hdr;
+        
+        _fs_read_page_ofs(pg, 0, &hdr, sizeof(hdr));
+        pg = hdr.next_page; /* XXX check this */
+        have++;
+        (*walks)++;
+        
+        if (have >= FS_CHAIN_PAGES)
+            continue;
+        
+        xSemaphoreTake(_fs_chain_mutex, portMAX_DELAY);
+        if (ch->startpage == file->startpage && ch->npages == have)
+            ch->pages[ch->npages++] = pg;
+        xSemaphoreGive(_fs_chain_mutex);
+    }
+    
+    return pg;
+}
+
+/* Writing never goes back over anything. Pages are handed out from a
+ * cursor that goes round the whole region, headers flip their flags by
+ * clearing bits, and a deleted file's pages sit Invalid until the GC
+ * erases the block they're in. _fs_write_mutex covers the page states,
+ * the index and the cursor for anyone changing them; readers go without */
+#define FS_PAGES_PER_BLOCK  (REGION_FS_ERASE_SIZE / REGION_FS_PAGE_SIZE)
+#define FS_N_BLOCKS         (REGION_FS_N_PAGES / FS_PAGES_PER_BLOCK)
+/* the GC wakes when free pages drop under low water, and erases until
+ * they're back over high */
+#define FS_GC_LOW_WATER     (FS_PAGES_PER_BLOCK > 8 ? FS_PAGES_PER_BLOCK * 2 : 16)
+#define FS_GC_HIGH_WATER    (FS_GC_LOW_WATER * 2)
+#define FS_GC_STACK         (configMINIMAL_STACK_SIZE + 100)
+
+#define HDR_EMPTY_IN_USE    ((uint8_t)~(HDR_EMPTY_ALLOCATED | HDR_EMPTY_MOREBLOCKS))
+#define HDR_STATUS_START    ((uint8_t)~(HDR_STATUS_VALID | HDR_STATUS_FILE_START))
+#define HDR_STATUS_CONT     ((uint8_t)~(HDR_STATUS_VALID | HDR_STATUS_FILE_CONT))
+
+static uint16_t _fs_alloc_cursor;
+static uint16_t _fs_free_pages;
+static uint8_t _fs_orphans_checked;
+static uint8_t _fs_reached[(REGION_FS_N_PAGES + 7) / 8] CCRAM;
+static SemaphoreHandle_t _fs_write_mutex;
+static StaticSemaphore_t _fs_write_mutex_buf;
+static TaskHandle_t _fs_gc_task;
+static StaticTask_t _fs_gc_task_buf;
+static StackType_t _fs_gc_task_stack[FS_GC_STACK];
+
+static void _fs_gc_kick(void)
+{
+    if (_fs_gc_task && _fs_free_pages < FS_GC_LOW_WATER)
+        xTaskNotifyGive(_fs_gc_task);
+}
+
+/* a free page should be blank but for the version and wear counter */
+static uint8_t _fs_page_is_clean(const struct page_hdr *hdr)
+{
+    const uint8_t *p = (const uint8_t *)hdr;
+    
+    for (size_t i = offsetof(struct page_hdr, empty); i < sizeof(*hdr); i++)
+    {
+        if (i == offsetof(struct page_hdr, wear_level_counter))
+            i += sizeof(hdr->wear_level_counter);
+        if (p[i] != 0xFF)
+            return 0;
+    }
+    return hdr->v_0x5001 == 0x5001 || hdr->v_0x5001 == 0xFFFF;
+}
+
+/* Erase the block with the most dead pages and nothing live in it. Each
+ * page gets its header straight back with the wear counter one up, so
+ * the count lives through the erase. Write mutex held. 0 if there was
+ * nothing to get back */
+static void _fs_find_orphans(void);
+
+static int _fs_gc_block(void)
+{
+    int best = -1;
+    uint16_t best_dead = 0;
+    
+    if (!_fs_orphans_checked)
+        _fs_find_orphans();
+    
+    for (uint16_t b = 0; b < FS_N_BLOCKS; b++)
+    {
+        uint16_t dead = 0;
+        
+        for (uint16_t pg = b * FS_PAGES_PER_BLOCK; pg < (b + 1) * FS_PAGES_PER_BLOCK; pg++)
+        {
+            enum page_state state = _fs_get_page_state(pg);
+            
+            if (state == PageStateFileStart || state == PageStateFileCont)
+            {
+                dead = 0;
+                break;
+            }
+            if (state == PageStateInvalid)
+                dead++;
+        }
+        
+        if (dead > best_dead)
+        {
+            best = b;
+            best_dead = dead;
+        }
+    }
+    
+    if (best < 0)
+        return 0;
+    
+    uint16_t first = best * FS_PAGES_PER_BLOCK;
+    struct page_hdr hdr;
+    uint32_t wear = 0;
+    
+    for (uint16_t pg = first; pg < first + FS_PAGES_PER_BLOCK; pg++)
+    {
+        _fs_read_page_ofs(pg, 0, &hdr, sizeof(hdr));
+        if (hdr.v_0x5001 == 0x5001 && hdr.wear_level_counter != 0xFFFFFFFF && hdr.wear_level_counter > wear)
+            wear = hdr.wear_level_counter;
+    }
+    
+    KERN_LOG("flash", APP_LOG_LEVEL_DEBUG, "gc: erasing pages %d-%d, %d dead, wear %d", first, first + FS_PAGES_PER_BLOCK - 1, best_dead, wear);
+    flash_erase(REGION_FS_START + first * REGION_FS_PAGE_SIZE, REGION_FS_ERASE_SIZE);
+    
+    memset(&hdr, 0xFF, sizeof(hdr));
+    hdr.v_0x5001 = 0x5001;
+    hdr.wear_level_counter = wear + 1;
+    for (uint16_t pg = first; pg < first + FS_PAGES_PER_BLOCK; pg++)
+    {
+        _fs_write_page_ofs(pg, 0, &hdr, offsetof(struct page_hdr, rsvd_1));
+        _fs_set_page_state(pg, PageStateUnallocated);
+    }
+    _fs_free_pages += best_dead;
+    
+    return 1;
+}
+
+/* Next clean page on from the cursor, and its wear count. A page that's
+ * free by its flags but not blank (power went mid header) is written off
+ * for the GC. If we run out, the GC goes now rather than in the
+ * background. Write mutex held. FS_INDEX_EMPTY if we're full */
+static uint16_t _fs_page_get(uint32_t *wear)
+{
+    struct page_hdr hdr;
+    
+    do {
+        for (uint16_t n = 0; n < REGION_FS_N_PAGES && _fs_free_pages; n++)
+        {
+            uint16_t pg = _fs_alloc_cursor;
+            
+            _fs_alloc_cursor = (_fs_alloc_cursor + 1) % REGION_FS_N_PAGES;
+            if (_fs_get_page_state(pg) != PageStateUnallocated)
+                continue;
+            
+            _fs_free_pages--;
+            _fs_read_page_ofs(pg, 0, &hdr, sizeof(hdr));
+            if (!_fs_page_is_clean(&hdr))
+            {
+                _fs_set_page_state(pg, PageStateInvalid);
+                continue;
+            }
+            
+            *wear = (hdr.v_0x5001 == 0xFFFF) ? 0 : hdr.wear_level_counter;
+            _fs_gc_kick();
+            return pg;
+        }
+    } while (_fs_gc_block());
+    
+    return FS_INDEX_EMPTY;
+}
+
+/* Mark a file's pages dead, the start page first so that a delete cut
+ * short can be finished from it, and say it's done last. Only follows
+ * the chain through pages that could be part of it. Write mutex held */
+static void _fs_delete_chain(uint16_t startpage)
+{
+    uint8_t dead = (uint8_t)~HDR_STATUS_DEAD;
+    uint16_t pg = startpage;
+    struct page_hdr hdr;
+    
+    _fs_write_page_ofs(startpage, offsetof(struct page_hdr, status), &dead, 1);
+    _fs_set_page_state(startpage, PageStateInvalid);
+    _fs_chain_forget(startpage);
+    
+    for (uint16_t n = 0; n < REGION_FS_N_PAGES; n++)
+    {
+        _fs_read_page_ofs(pg, 0, &hdr, sizeof(hdr));
+        pg = hdr.next_page;
+        if (pg >= REGION_FS_N_PAGES || pg == startpage)
+            break;
+        
+        enum page_state state = _fs_get_page_state(pg);
+        if (state == PageStateFileCont)
+        {
+            _fs_write_page_ofs(pg, offsetof(struct page_hdr, status), &dead, 1);
+            _fs_set_page_state(pg, PageStateInvalid);
+        }
+        else if (state != PageStateInvalid)
+            break;
+    }
+    
+    _fs_write_u16(startpage, offsetof(struct file_hdr, st_delete_complete), 0);
+}
+
+static void _fs_delete_file(uint16_t startpage)
+{
+    _fs_index_remove(startpage);
+    _fs_delete_chain(startpage);
+}
+
+/* A create or delete that was cut short can leave continuation pages that
+ * no start page leads to, but look live. Once a boot, before the first
+ * erase, walk every live chain and write off what's left. Write mutex
+ * held */
+static void _fs_find_orphans(void)
+{
+    struct page_hdr hdr;
+    uint16_t orphans = 0;
+    
+    memset(_fs_reached, 0, sizeof(_fs_reached));
+    for (uint16_t start = 0; start < REGION_FS_N_PAGES; start++)
+    {
+        if (_fs_get_page_state(start) != PageStateFileStart)
+            continue;
+        
+        uint16_t pg = start;
+        for (uint16_t n = 0; n < REGION_FS_N_PAGES; n++)
+        {
+            _fs_reached[pg >> 3] |= 1 << (pg & 7);
+            _fs_read_page_ofs(pg, 0, &hdr, sizeof(hdr));
+            pg = hdr.next_page;
+            if (pg >= REGION_FS_N_PAGES || (_fs_reached[pg >> 3] & (1 << (pg & 7))))
+                break;
+        }
+    }
+    
+    for (uint16_t pg = 0; pg < REGION_FS_N_PAGES; pg++)
+    {
+        if (_fs_get_page_state(pg) == PageStateFileCont && !(_fs_reached[pg >> 3] & (1 << (pg & 7))))
+        {
+            _fs_set_page_state(pg, PageStateInvalid);
+            orphans++;
+        }
+    }
+    
+    if (orphans)
+        KERN_LOG("flash", APP_LOG_LEVEL_INFO, "gc: %d orphaned pages", orphans);
+    _fs_orphans_checked = 1;
+}
+
+static void _fs_gc_thread(void *pvParameters)
+{
+    int more;
+    
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        /* let go between erases, so a writer can get in */
+        do {
+            xSemaphoreTake(_fs_write_mutex, portMAX_DELAY);
+            more = _fs_free_pages < FS_GC_HIGH_WATER && _fs_gc_block();
+            xSemaphoreGive(_fs_write_mutex);
+        } while (more);
+    }
+}
+
+/* all fs_init needs to see of most pages, read in batches */
+struct page_hdr_prefix {
+    uint16_t v_0x5001;
+    uint8_t  empty;
+    uint8_t  status;
+};
+
+#define FS_SCAN_BATCH 64
+
 void fs_init()
 {
     /* Do a basic integrity check to see if there's any cleanup that needs
@@ -120,7 +533,17 @@ void fs_init()
     
     KERN_LOG("flash", APP_LOG_LEVEL_INFO, "doing basic filesystem check");
     _fs_valid = 1;
+    _fs_orphans_checked = 0;
     memset(&_fs_page_flags, 0, sizeof(_fs_page_flags));
+    memset(&_fs_index, 0xFF, sizeof(_fs_index));
+    _fs_index_count = 0;
+    memset(&_fs_chains, 0xFF, sizeof(_fs_chains));
+    for (uint8_t i = 0; i < FS_CHAIN_CACHE; i++)
+        _fs_chains[i].last_used = 0;
+    if (!_fs_chain_mutex)
+        _fs_chain_mutex = xSemaphoreCreateMutexStatic(&_fs_chain_mutex_buf);
+    if (!_fs_write_mutex)
+        _fs_write_mutex = xSemaphoreCreateMutexStatic(&_fs_write_mutex_buf);
 
     /* Make sure that at least the first page has the header of the right
      * version.  There might be pages with missing headers later, and we can
@@ -137,52 +560,70 @@ void fs_init()
      * the right order", and aren't half-dead.
      */
     int lastpg = -1;
+    int lastalloc = -1;
+    uint16_t cleanup = 0;
     uint8_t saw_blank_page = 0;
     uint8_t saw_page_in_outer_space = 0;
+    struct page_hdr_prefix scan[FS_SCAN_BATCH];
     for (pg = 0; pg < REGION_FS_N_PAGES; pg++)
     {
-        _fs_read_file_hdr(pg, &buffer);
-        if (hdr->v_0x5001 == 0xFFFF) {
+        struct page_hdr_prefix *pre = &scan[pg % FS_SCAN_BATCH];
+        
+        if (pg % FS_SCAN_BATCH == 0)
+        {
+            uint16_t n = (REGION_FS_N_PAGES - pg < FS_SCAN_BATCH) ? REGION_FS_N_PAGES - pg : FS_SCAN_BATCH;
+            flash_read_bytes_strided(REGION_FS_START + pg * REGION_FS_PAGE_SIZE, REGION_FS_PAGE_SIZE, n,
+                                     (uint8_t *)scan, sizeof(struct page_hdr_prefix));
+        }
+        
+        if (pre->v_0x5001 == 0xFFFF) {
             if (!saw_blank_page)
                 KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "this filesystem has a blank page in it... hmm...");
             saw_blank_page = 1;
             continue;
         }
-        if (hdr->v_0x5001 != 0x5001) {
-            KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "page %d has bad header version 0x%04x; I give up", pg, hdr->v_0x5001);
+        if (pre->v_0x5001 != 0x5001) {
+            KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "page %d has bad header version 0x%04x; I give up", pg, pre->v_0x5001);
             _fs_valid = 0;
             return;
         }
-        if (hdr->status == 0xFE && lastpg != -1) {
+        if (pre->status == 0xFE && lastpg != -1) {
             lastpg = pg;
         }
-        if ((lastpg != -1) && FLASHFLAG(hdr->empty, HDR_EMPTY_ALLOCATED)) {
+        if ((lastpg != -1) && FLASHFLAG(pre->empty, HDR_EMPTY_ALLOCATED)) {
             if (!saw_page_in_outer_space)
                 KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "page %d is marked as allocated, but page %d had the last page marker... hmm...", pg, lastpg);
             saw_page_in_outer_space = 1;
         }
         
         /* The rest of the checks only apply to an allocated page. */
-        if (!FLASHFLAG(hdr->empty, HDR_EMPTY_ALLOCATED))
+        if (!FLASHFLAG(pre->empty, HDR_EMPTY_ALLOCATED))
             continue;
 
-        if (FLASHFLAG(hdr->status, HDR_STATUS_FILE_CONT))
+        /* dead, or not anything we know, until we find otherwise */
+        lastalloc = pg;
+        _fs_set_page_state(pg, PageStateInvalid);
+
+        if (FLASHFLAG(pre->status, HDR_STATUS_FILE_CONT) && !FLASHFLAG(pre->status, HDR_STATUS_DEAD))
             _fs_set_page_state(pg, PageStateFileCont);
 
-        if (!FLASHFLAG(hdr->status, HDR_STATUS_FILE_START))
+        if (!FLASHFLAG(pre->status, HDR_STATUS_FILE_START))
             continue;
 
-        if (!FLASHFLAG(hdr->status, HDR_STATUS_DEAD) && hdr->st_create_complete) {
-            KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "page %d creation not complete; I can't deal with this; go boot PebbleOS to clean up first", pg);
-            _fs_valid = 0;
-            return;
-        }
-        if (FLASHFLAG(hdr->status, HDR_STATUS_DEAD) && hdr->st_delete_complete) {
-            KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "page %d deletion not complete; I can't deal with this; go boot PebbleOS to clean up first", pg);
-            _fs_valid = 0;
-            return;
+        /* only file starts need the whole header */
+        _fs_read_file_hdr(pg, &buffer);
+
+        if ((!FLASHFLAG(hdr->status, HDR_STATUS_DEAD) && (hdr->st_create_complete || hdr->st_tmp_file)) ||
+            (FLASHFLAG(hdr->status, HDR_STATUS_DEAD) && hdr->st_delete_complete)) {
+            /* finished off once we know where everything is */
+            _fs_set_page_state(pg, PageStateFileStart);
+            cleanup++;
+            continue;
         }
 
+        if (FLASHFLAG(hdr->status, HDR_STATUS_DEAD))
+            continue;
+
         if (hdr->filename_len > MAX_FILENAME_LEN)
             KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "page %d has unexpectedly long file name: %d; it may cause further errors", pg, hdr->filename_len);
 
@@ -191,14 +632,41 @@ void fs_init()
             _fs_valid = 0;
             return;
         }
-
-        if (FLASHFLAG(hdr->status, HDR_STATUS_DEAD))
-            continue;
         
         _fs_set_page_state(pg, PageStateFileStart);
+        _fs_index_add(pg, buffer.name);
     }
     
     KERN_LOG("flash", APP_LOG_LEVEL_INFO, "checked %d pages, and it's good enough to read, at least", pg);
+    if (_fs_index_count == FS_INDEX_SIZE)
+        KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "more than %d files, lookups will be slow", FS_INDEX_SIZE);
+    
+    /* Creates that didn't finish, temp files nobody committed, and deletes
+     * that didn't finish all end the same way */
+    for (pg = 0; cleanup && pg < REGION_FS_N_PAGES; pg++)
+    {
+        if (_fs_get_page_state(pg) != PageStateFileStart)
+            continue;
+        
+        _fs_read_file_hdr(pg, &buffer);
+        if (FLASHFLAG(hdr->status, HDR_STATUS_DEAD) ? hdr->st_delete_complete : (hdr->st_create_complete || hdr->st_tmp_file))
+        {
+            KERN_LOG("flash", APP_LOG_LEVEL_INFO, "page %d: finishing off an interrupted write or delete of %s", pg, buffer.name);
+            _fs_delete_chain(pg);
+            cleanup--;
+        }
+    }
+    
+    _fs_free_pages = 0;
+    for (pg = 0; pg < REGION_FS_N_PAGES; pg++)
+        if (_fs_get_page_state(pg) == PageStateUnallocated)
+            _fs_free_pages++;
+    _fs_alloc_cursor = (lastalloc + 1) % REGION_FS_N_PAGES;
+    KERN_LOG("flash", APP_LOG_LEVEL_INFO, "%d pages free", _fs_free_pages);
+    
+    if (!_fs_gc_task)
+        _fs_gc_task = xTaskCreateStatic(_fs_gc_thread, "FS GC", FS_GC_STACK, NULL, tskIDLE_PRIORITY + 1UL, _fs_gc_task_stack, &_fs_gc_task_buf);
+    _fs_gc_kick();
     
     /* test it out some ... */
     struct file file;
@@ -217,6 +685,13 @@ void fs_init()
     
 }
 
+static void _fs_file_from_hdr(struct file *file, uint16_t pg, struct file_hdr *hdr)
+{
+    file->startpage = pg;
+    file->size = hdr->file_size;
+    file->startpofs = sizeof(struct file_hdr) + hdr->filename_len;
+}
+
 int fs_find_file(struct file *file, const char *name)
 {
     /* no need to say it -- they already heard it at init time ... */
@@ -225,16 +700,40 @@ int fs_find_file(struct file *file, const char *name)
 
     struct file_hdr_with_name buffer;
     struct file_hdr *hdr = &buffer.hdr;
+    uint16_t hash = _fs_name_hash(name);
+    uint16_t i = hash & (FS_INDEX_SIZE - 1);
+    
+    _fs_stats.finds++;
+
+    for (uint16_t n = 0; n < FS_INDEX_SIZE && _fs_index[i].page != FS_INDEX_EMPTY; n++, i = (i + 1) & (FS_INDEX_SIZE - 1))
+    {
+        uint16_t pg = _fs_index[i].page;
+        
+        if (_fs_index[i].hash != hash || pg >= REGION_FS_N_PAGES || _fs_get_page_state(pg) != PageStateFileStart)
+            continue;
+        
+        _fs_read_file_hdr(pg, &buffer);
+        _fs_stats.find_headers++;
+        if (!strcmp(name, buffer.name)) {
+            _fs_file_from_hdr(file, pg, hdr);
+            return 0;
+        }
+    }
+    
+    /* the index has everything, unless it filled up */
+    if (_fs_index_count < FS_INDEX_SIZE)
+        return -1;
+
+    _fs_stats.find_scans++;
 
     for (uint16_t pg = 0; pg < REGION_FS_N_PAGES; pg++)
     {
         if (_fs_get_page_state(pg) == PageStateFileStart)
         {
             _fs_read_file_hdr(pg, &buffer);
+            _fs_stats.find_headers++;
             if (!strcmp(name, buffer.name)) {
-                file->startpage = pg;
-                file->size = hdr->file_size;
-                file->startpofs = sizeof(struct file_hdr) + hdr->filename_len;
+                _fs_file_from_hdr(file, pg, hdr);
                 return 0;
             }
         }
@@ -249,6 +748,7 @@ void fs_open(struct fd *fd, const struct file *file)
     
     fd->curpage = fd->file.startpage;
     fd->curpofs = fd->file.startpofs;
+    fd->curpidx = 0;
     
     fd->offset  = 0;
 }
@@ -277,11 +777,8 @@ int fs_read(struct fd *fd, void *p, size_t bytes)
         
         if (fd->curpofs == REGION_FS_PAGE_SIZE)
         {
-            struct page_hdr hdr;
-            
-            _fs_read_page_ofs(fd->curpage, 0, &hdr, sizeof(hdr));
-            fd->curpage = hdr.next_page; /* XXX check this */
-            fd->curpofs = sizeof(hdr);
+            fd->curpage = _fs_chain_page(&fd->file, ++fd->curpidx, &_fs_stats.read_walks);
+            fd->curpofs = sizeof(struct page_hdr);
         }
     }
     
@@ -291,6 +788,8 @@ int fs_read(struct fd *fd, void *p, size_t bytes)
 long fs_seek(struct fd *fd, long ofs, enum seek whence)
 {
     size_t newoffset;
+    
+    _fs_stats.seeks++;
     switch (whence)
     {
     case FS_SEEK_SET: newoffset = ofs; break;
@@ -301,34 +800,216 @@ long fs_seek(struct fd *fd, long ofs, enum seek whence)
     if (newoffset > fd->file.size)
         newoffset = fd->file.size;
     
-    if (newoffset < fd->offset)
+    /* The first page has the file header in it, the rest only a page
+     * header. Landing exactly on the end of a page puts us at the start
+     * of the next, same as a read would */
+    size_t first = REGION_FS_PAGE_SIZE - fd->file.startpofs;
+    size_t per = REGION_FS_PAGE_SIZE - sizeof(struct page_hdr);
+    uint16_t idx;
+    
+    if (newoffset < first)
+    {
+        idx = 0;
+        fd->curpofs = fd->file.startpofs + newoffset;
+    }
+    else
+    {
+        idx = 1 + (newoffset - first) / per;
+        fd->curpofs = sizeof(struct page_hdr) + (newoffset - first) % per;
+    }
+    
+    if (idx != fd->curpidx)
+    {
+        fd->curpage = _fs_chain_page(&fd->file, idx, &_fs_stats.seek_walks);
+        fd->curpidx = idx;
+    }
+    fd->offset = newoffset;
+    
+    return fd->offset;
+}
+
+/*
+ * Make a new file of size bytes, and open fd on it for fs_write. It's a
+ * temp file, that nobody can find, until fs_commit. All its pages are
+ * taken now, so it can't run out of room half way through writing
+ */
+int fs_creat(struct fd *fd, const char *name, size_t size)
+{
+    struct file_hdr_with_name buffer;
+    struct file_hdr *hdr = &buffer.hdr;
+    struct page_hdr phdr;
+    struct file file;
+    size_t namelen = strlen(name);
+    size_t first = REGION_FS_PAGE_SIZE - sizeof(struct file_hdr) - namelen;
+    size_t per = REGION_FS_PAGE_SIZE - sizeof(struct page_hdr);
+    uint16_t npages = 1;
+    uint16_t start, pg, prev;
+    uint32_t wear;
+    
+    if (!_fs_valid || namelen > MAX_FILENAME_LEN)
+        return -1;
+    
+    if (size > first)
+        npages += (size - first + per - 1) / per;
+    
+    xSemaphoreTake(_fs_write_mutex, portMAX_DELAY);
+    
+    start = _fs_page_get(&wear);
+    if (start == FS_INDEX_EMPTY)
+        goto full;
+    
+    memset(&buffer, 0xFF, sizeof(buffer));
+    hdr->v_0x5001 = 0x5001;
+    hdr->empty = HDR_EMPTY_IN_USE;
+    hdr->status = HDR_STATUS_START;
+    hdr->wear_level_counter = wear;
+    hdr->file_size = size;
+    hdr->flag_2 = (uint8_t)~HDR_FLAG_2_HAS_FILENAME;
+    hdr->filename_len = namelen;
+    memcpy(buffer.name, name, namelen);
+    _fs_write_page_ofs(start, 0, &buffer, sizeof(struct file_hdr) + namelen);
+    _fs_set_page_state(start, PageStateFileStart);
+    _fs_chain_forget(start);
+    
+    /* each page is written before the one before points at it */
+    prev = start;
+    for (uint16_t i = 1; i < npages; i++)
     {
-        fd->curpage = fd->file.startpage;
-        fd->curpofs = fd->file.startpofs;
-        fd->offset = 0;
+        pg = _fs_page_get(&wear);
+        if (pg == FS_INDEX_EMPTY)
+        {
+            _fs_delete_chain(start);
+            goto full;
+        }
+        
+        memset(&phdr, 0xFF, sizeof(phdr));
+        phdr.v_0x5001 = 0x5001;
+        phdr.empty = HDR_EMPTY_IN_USE;
+        phdr.status = HDR_STATUS_CONT;
+        phdr.wear_level_counter = wear;
+        _fs_write_page_ofs(pg, 0, &phdr, sizeof(phdr));
+        _fs_set_page_state(pg, PageStateFileCont);
+        
+        _fs_write_u16(prev, offsetof(struct page_hdr, next_page), pg);
+        prev = pg;
     }
     
-    size_t delta = newoffset - fd->offset;
-    while (delta)
+    _fs_write_u16(start, offsetof(struct file_hdr, st_create_complete), 0);
+    xSemaphoreGive(_fs_write_mutex);
+    
+    file.startpage = start;
+    file.startpofs = sizeof(struct file_hdr) + namelen;
+    file.size = size;
+    fs_open(fd, &file);
+    
+    return 0;
+
+full:
+    xSemaphoreGive(_fs_write_mutex);
+    KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "no room for %s, %d bytes", name, size);
+    return -1;
+}
+
+/*
+ * Write at fd's offset, and move it on. Flash is written once between
+ * erases, so this fills a file from fs_creat in, front to back, in as
+ * many appends as suits; it can't go back over what's there, or past the
+ * size it was made with. To change a file, write a new one and commit it
+ */
+int fs_write(struct fd *fd, const void *p, size_t bytes)
+{
+    const uint8_t *b = p;
+    size_t bytesrem;
+    
+    if (bytes > (fd->file.size - fd->offset))
+        bytes = fd->file.size - fd->offset;
+    bytesrem = bytes;
+
+    while (bytesrem)
     {
-        size_t n = delta;
+        size_t n = bytesrem;
         
         if (n > (REGION_FS_PAGE_SIZE - fd->curpofs))
             n = REGION_FS_PAGE_SIZE - fd->curpofs;
         
+        _fs_write_page_ofs(fd->curpage, fd->curpofs, b, n);
+        
         fd->curpofs += n;
         fd->offset += n;
-        delta -= n;
+        bytesrem -= n;
+        b += n;
         
         if (fd->curpofs == REGION_FS_PAGE_SIZE)
         {
-            struct page_hdr hdr;
-            
-            _fs_read_page_ofs(fd->curpage, 0, &hdr, sizeof(hdr));
-            fd->curpage = hdr.next_page; /* XXX check this */
-            fd->curpofs = sizeof(hdr);
+            fd->curpage = _fs_chain_page(&fd->file, ++fd->curpidx, &_fs_stats.read_walks);
+            fd->curpofs = sizeof(struct page_hdr);
         }
     }
     
-    return fd->offset;
+    return bytes;
+}
+
+/*
+ * Make a file from fs_creat the one that goes by its name, deleting
+ * whatever did before. The old one goes first: losing power in between
+ * leaves no file of that name rather than two, and fs_init throws the
+ * still-temp new one away
+ */
+int fs_commit(struct fd *fd)
+{
+    struct file_hdr_with_name buffer;
+    struct file old;
+    uint16_t start = fd->file.startpage;
+    
+    if (!_fs_valid || start >= REGION_FS_N_PAGES || _fs_get_page_state(start) != PageStateFileStart)
+        return -1;
+    
+    xSemaphoreTake(_fs_write_mutex, portMAX_DELAY);
+    _fs_read_file_hdr(start, &buffer);
+    
+    if (fs_find_file(&old, buffer.name) == 0 && old.startpage != start)
+        _fs_delete_file(old.startpage);
+    
+    _fs_write_u16(start, offsetof(struct file_hdr, st_tmp_file), 0);
+    _fs_index_add(start, buffer.name);
+    xSemaphoreGive(_fs_write_mutex);
+    
+    _fs_gc_kick();
+    return 0;
+}
+
+/*
+ * Delete a file. Its pages are left to the GC. Anyone still reading it
+ * gets what was there until the block is erased, so close it first
+ */
+int fs_delete(const struct file *file)
+{
+    uint16_t start = file->startpage;
+    
+    if (!_fs_valid || start >= REGION_FS_N_PAGES)
+        return -1;
+    
+    xSemaphoreTake(_fs_write_mutex, portMAX_DELAY);
+    if (_fs_get_page_state(start) != PageStateFileStart)
+    {
+        xSemaphoreGive(_fs_write_mutex);
+        return -1;
+    }
+    _fs_delete_file(start);
+    xSemaphoreGive(_fs_write_mutex);
+    
+    _fs_gc_kick();
+    return 0;
+}
+
+/* pages free to write, without waiting on an erase */
+uint16_t fs_free_pages(void)
+{
+    return _fs_free_pages;
+}
+
+/* lookup and seek counts since boot */
+void fs_stats(FsStats *stats)
+{
+    *stats = _fs_stats;
 }
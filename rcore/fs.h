@@ -19,6 +19,7 @@ struct fd {
     
     uint16_t curpage;
     uint16_t curpofs;
+    uint16_t curpidx; /* which page of the file curpage is */
     
     size_t offset;
 };
@@ -29,9 +30,27 @@ enum seek {
     FS_SEEK_END
 };
 
+/* Counts since boot. The fields are bumped without a lock, so they can
+ * be a little out when two threads race, which is fine for what they
+ * are for. All words, so no packing needed to send it */
+typedef struct FsStats {
+    uint32_t finds;
+    uint32_t find_headers;  /* file headers read to check a name */
+    uint32_t find_scans;    /* finds that had to go through every page */
+    uint32_t seeks;
+    uint32_t seek_walks;    /* page headers followed to get where a seek went */
+    uint32_t read_walks;    /* and by reads and writes, page to page */
+} FsStats;
+
 void fs_init();
 int fs_find_file(struct file *file, const char *name);
 void fs_open(struct fd *fd, const struct file *file);
 int fs_read(struct fd *fd, void *p, size_t n);
 long fs_seek(struct fd *fd, long ofs, enum seek whence);
+int fs_creat(struct fd *fd, const char *name, size_t size);
+int fs_write(struct fd *fd, const void *p, size_t n);
+int fs_commit(struct fd *fd);
+int fs_delete(const struct file *file);
+uint16_t fs_free_pages(void);
+void fs_stats(FsStats *stats);
 
@@ -1,8 +1,296 @@
 /* gyro.c
- * routines for [...]
+ * Accelerometer samples, batched in the sensor's FIFO
  * RebbleOS
  *
  * Author: Barry Carter <barry.carter@gmail.com>
+ *
+ * The sensor samples on its own clock into its FIFO, and only interrupts
+ * once the FIFO has a batch in it. The accel thread then empties the
+ * FIFO in bursts on the bus and hands each burst to whoever is using it.
+ * Between batches nothing here runs, so the MCU sleeps through however
+ * many samples make a batch rather than waking for each.
+ *
+ * Taps and flicks are spotted by the sensor itself, which interrupts only
+ * when it sees one, so they cost nothing until they happen; the accel
+ * thread asks the sensor which it was and tells the tap users.
+ *
+ * Users ask for a rate and a batch. The sensor runs at the fastest rate
+ * asked for, and batches as often as the most impatient user wants one;
+ * slower users have every so many samples dropped to bring them down to
+ * their own rate.
  */
 
 #include "rebbleos.h"
+#include "gyro.h"
+
+#define ACCEL_STACK_SIZE (configMINIMAL_STACK_SIZE + 200)
+/* samples taken off the bus at a time */
+#define ACCEL_BURST 32
+
+typedef struct AccelUserState {
+    uint16_t hz;     /* 0 if not running */
+    uint16_t batch;
+    uint16_t phase;  /* for dropping down to hz */
+    AccelSink sink;
+    AccelTapSink tap;
+} AccelUserState;
+
+static TaskHandle_t _accel_task;
+static StaticTask_t _accel_task_buf;
+static StackType_t _accel_task_stack[ACCEL_STACK_SIZE];
+static void _accel_thread(void *pvParameters);
+
+static SemaphoreHandle_t _accel_mutex;
+static StaticSemaphore_t _accel_mutex_buf;
+
+static bool _present;
+/* under the mutex */
+static AccelUserState _users[AccelUserMax];
+static uint16_t _hz;  /* the sensor's, 0 if stopped */
+static hw_accel_sample_t _last;
+
+static hw_accel_sample_t _burst[ACCEL_BURST];
+static hw_accel_sample_t _user_burst[ACCEL_BURST];
+
+static uint64_t _now_ms(void)
+{
+    time_t t;
+    uint16_t ms;
+
+    rcore_time_ms(&t, &ms);
+    return (uint64_t)t * 1000 + ms;
+}
+
+/*
+ * From the sensor's interrupt, HW_ACCEL_EVENT_ bits for what it was
+ */
+static void _accel_isr(uint8_t events)
+{
+    BaseType_t woken = pdFALSE;
+
+    xTaskNotifyFromISR(_accel_task, events, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+uint8_t rcore_accel_init(void)
+{
+    _accel_mutex = xSemaphoreCreateMutexStatic(&_accel_mutex_buf);
+    _present = hw_accel_init();
+    if (!_present)
+    {
+        KERN_LOG("accel", APP_LOG_LEVEL_INFO, "No accelerometer");
+        return 0;
+    }
+
+    _accel_task = xTaskCreateStatic(_accel_thread, "Accel", ACCEL_STACK_SIZE, NULL,
+                                    tskIDLE_PRIORITY + 4UL, _accel_task_stack, &_accel_task_buf);
+    hw_accel_set_isr(_accel_isr);
+
+    return 0;
+}
+
+/*
+ * Run the sensor for everyone using it: at the fastest rate, with a
+ * watermark as soon as the first user's batch is due. With the mutex
+ */
+static void _accel_reconfigure(void)
+{
+    uint16_t hz = 0;
+    uint32_t batch_ms = UINT32_MAX;
+
+    for (int i = 0; i < AccelUserMax; i++)
+    {
+        if (!_users[i].hz)
+            continue;
+        if (_users[i].hz > hz)
+            hz = _users[i].hz;
+        uint32_t ms = (uint32_t)_users[i].batch * 1000 / _users[i].hz;
+        if (ms < batch_ms)
+            batch_ms = ms;
+        _users[i].phase = 0;
+    }
+
+    if (!hz)
+    {
+        if (_hz)
+            hw_accel_stop();
+        _hz = 0;
+        return;
+    }
+
+    uint32_t watermark = batch_ms * hz / 1000;
+    _hz = hz;
+    hw_accel_start(hz, watermark ? watermark : 1);
+}
+
+/*
+ * Start giving user batch samples at a time at hz, through sink. The
+ * sensor's FIFO may hold fewer than that, and then the sink is called
+ * more often; it is called with whatever came off the bus, so it keeps
+ * its own count. false without a sensor
+ */
+bool rcore_accel_start(AccelUser user, uint16_t hz, uint16_t batch, AccelSink sink)
+{
+    if (!_present || !hz)
+        return false;
+
+    xSemaphoreTake(_accel_mutex, portMAX_DELAY);
+    _users[user].hz = hz;
+    _users[user].batch = batch ? batch : 1;
+    _users[user].sink = sink;
+    _accel_reconfigure();
+    xSemaphoreGive(_accel_mutex);
+
+    return true;
+}
+
+void rcore_accel_stop(AccelUser user)
+{
+    if (!_present)
+        return;
+
+    xSemaphoreTake(_accel_mutex, portMAX_DELAY);
+    _users[user].hz = 0;
+    _users[user].sink = NULL;
+    _accel_reconfigure();
+    xSemaphoreGive(_accel_mutex);
+}
+
+/*
+ * One sample. While the FIFO is running, the newest drained, rather than
+ * take one out from under a batch
+ */
+bool rcore_accel_peek(hw_accel_sample_t *sample)
+{
+    bool ok = false;
+
+    if (!_present)
+        return false;
+
+    xSemaphoreTake(_accel_mutex, portMAX_DELAY);
+    if (!_hz)
+        ok = hw_accel_peek(sample);
+    else
+    {
+        *sample = _last;
+        ok = true;
+    }
+    xSemaphoreGive(_accel_mutex);
+
+    return ok;
+}
+
+/*
+ * Have the sensor look out for taps for user, or stop if sink is NULL.
+ * The detector runs while anyone wants it. false without a sensor
+ */
+bool rcore_accel_tap_subscribe(AccelUser user, AccelTapSink sink)
+{
+    bool any = false;
+
+    if (!_present)
+        return false;
+
+    xSemaphoreTake(_accel_mutex, portMAX_DELAY);
+    _users[user].tap = sink;
+    for (int i = 0; i < AccelUserMax; i++)
+        any |= _users[i].tap != NULL;
+    hw_accel_tap_enable(any);
+    xSemaphoreGive(_accel_mutex);
+
+    return true;
+}
+
+/*
+ * The sensor saw a tap. Ask it which, and pass it on
+ */
+static void _accel_tap(void)
+{
+    uint8_t axis;
+    int8_t direction;
+
+    xSemaphoreTake(_accel_mutex, portMAX_DELAY);
+    if (hw_accel_tap_read(&axis, &direction))
+    {
+        for (int i = 0; i < AccelUserMax; i++)
+            if (_users[i].tap)
+                _users[i].tap(axis, direction);
+    }
+    xSemaphoreGive(_accel_mutex);
+}
+
+/*
+ * A burst at the sensor's rate, to each user at theirs
+ */
+static void _accel_hand_out(uint16_t n, uint64_t newest_ms)
+{
+    for (int u = 0; u < AccelUserMax; u++)
+    {
+        AccelUserState *us = &_users[u];
+        const hw_accel_sample_t *out = _burst;
+        uint16_t m = n;
+
+        if (!us->hz || !us->sink)
+            continue;
+
+        if (us->hz != _hz)
+        {
+            m = 0;
+            for (uint16_t i = 0; i < n; i++)
+            {
+                us->phase += us->hz;
+                if (us->phase >= _hz)
+                {
+                    us->phase -= _hz;
+                    _user_burst[m++] = _burst[i];
+                }
+            }
+            out = _user_burst;
+        }
+
+        if (m)
+            us->sink(out, m, newest_ms, us->hz);
+    }
+}
+
+/*
+ * Empty the FIFO, a burst at a time. All of a drain is stamped when it
+ * started: the bus empties the FIFO far faster than the sensor fills it
+ */
+static void _accel_drain(void)
+{
+    uint16_t n;
+    uint64_t now = _now_ms();
+
+    xSemaphoreTake(_accel_mutex, portMAX_DELAY);
+    if (!_hz)
+    {
+        xSemaphoreGive(_accel_mutex);
+        return;
+    }
+
+    do
+    {
+        n = hw_accel_read(_burst, ACCEL_BURST);
+        if (n)
+        {
+            _last = _burst[n - 1];
+            _accel_hand_out(n, now);
+        }
+    } while (n == ACCEL_BURST);
+    xSemaphoreGive(_accel_mutex);
+}
+
+static void _accel_thread(void *pvParameters)
+{
+    uint32_t events;
+
+    for (;;)
+    {
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+        if (events & HW_ACCEL_EVENT_TAP)
+            _accel_tap();
+        if (events & HW_ACCEL_EVENT_FIFO)
+            _accel_drain();
+    }
+}
@@ -1,6 +1,34 @@
+#pragma once
 /* gyro.h
- * routines for [...]
+ * Accelerometer samples, batched in the sensor's FIFO
  * RebbleOS
  *
  * Author: Barry Carter <barry.carter@gmail.com>
  */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "platform.h"
+
+/* Who wants samples. Each gets them at its own rate and batch, however
+ * the sensor is running for the others */
+typedef enum AccelUser {
+    AccelUserApp,
+    AccelUserActivity,
+    AccelUserBacklight,
+    AccelUserMax
+} AccelUser;
+
+/* A burst of samples, oldest first, at the user's rate. newest_ms is when
+ * the last of them was sampled. On the accel thread */
+typedef void (*AccelSink)(const hw_accel_sample_t *samples, uint16_t n, uint64_t newest_ms, uint16_t hz);
+
+/* A tap or flick, axis 0 to 2 for x to z, direction 1 or -1. On the
+ * accel thread */
+typedef void (*AccelTapSink)(uint8_t axis, int8_t direction);
+
+uint8_t rcore_accel_init(void);
+bool rcore_accel_start(AccelUser user, uint16_t hz, uint16_t batch, AccelSink sink);
+void rcore_accel_stop(AccelUser user);
+bool rcore_accel_peek(hw_accel_sample_t *sample);
+bool rcore_accel_tap_subscribe(AccelUser user, AccelTapSink sink);
@@ -0,0 +1,177 @@
+/* input_latency.c
+ * How long a button takes to do something
+ * RebbleOS
+ *
+ * A button edge goes from the ISR to the defer thread to debounce, to
+ * the button thread, onto the app's queue as a click, through the app's
+ * handler, and out in the next frame. Each hop is stamped on the cycle
+ * counter as the edge passes it, and kept as an average and worst from
+ * the edge. Two histograms: edge to handler, what the app sees, and edge
+ * to photon, what the user does.
+ *
+ * Only one edge is followed at a time, and a new one starts over. Edges
+ * that post no click (a press with only a click handler, which fires on
+ * release) are let go once the button thread is done with them. Repeats
+ * and long presses come off timers, not edges, and aren't followed. The
+ * photon is the first frame started after the handler returned, whether
+ * or not the handler is why it was drawn; a handler that draws nothing
+ * gets the next thing that does, so to_photon is an upper bound.
+ */
+
+#include "rebbleos.h"
+#include "input_latency.h"
+#include "endpoint.h"
+
+/* an edge nobody has finished with after this long is forgotten */
+#define INPUT_LATENCY_STALE_MS 2000
+
+static uint32_t _at[InputHopCount];
+static uint16_t _reached; /* hops this edge has got to, a bit each */
+
+static uint32_t _count[InputHopCount];
+static uint64_t _total_us[InputHopCount];
+static uint32_t _max_us[InputHopCount];
+static uint32_t _to_handler[INPUT_LATENCY_BUCKETS];
+static uint32_t _to_photon[INPUT_LATENCY_BUCKETS];
+
+static void _bucket(uint32_t *hist, uint32_t us)
+{
+    uint8_t b = 0;
+
+    while (b < INPUT_LATENCY_BUCKETS - 1 && us >= (INPUT_LATENCY_MIN_MS * 1000) << b)
+        b++;
+    hist[b]++;
+}
+
+/* With interrupts masked. The hop before has to have been reached */
+static void _hop(InputLatencyHop hop, uint32_t now)
+{
+    if (!(_reached & (1 << InputHopEdge)) || (_reached & (1 << hop)))
+        return;
+
+    uint32_t us = (now - _at[InputHopEdge]) / hw_cycles_per_us();
+    if (us > INPUT_LATENCY_STALE_MS * 1000)
+    {
+        _reached = 0;
+        return;
+    }
+
+    _at[hop] = now;
+    _reached |= 1 << hop;
+    _count[hop]++;
+    _total_us[hop] += us;
+    if (us > _max_us[hop])
+        _max_us[hop] = us;
+
+    if (hop == InputHopHandler)
+        _bucket(_to_handler, us);
+    else if (hop == InputHopPhoton)
+    {
+        _bucket(_to_photon, us);
+        _reached = 0;
+    }
+}
+
+/* From the button ISR, for an edge that is going to be debounced */
+void input_latency_edge(void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    _at[InputHopEdge] = hw_cycle_count();
+    _reached = 1 << InputHopEdge;
+    _count[InputHopEdge]++;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/* The edge being followed got this far, if it is being followed */
+void input_latency_hop(InputLatencyHop hop)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    _hop(hop, hw_cycle_count());
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/* The button thread is done with the edge. If it posted nothing there
+ * is nothing more to follow */
+void input_latency_settled(void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    if (!(_reached & (1 << InputHopPosted)))
+        _reached = 0;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/* A frame is starting out. The first after the handler is ours */
+void input_latency_frame_start(void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    if (_reached & (1 << InputHopHandled))
+        _hop(InputHopFrame, hw_cycle_count());
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/* The frame is out, from the display ISR or the drawing thread */
+void input_latency_frame_done(void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    if (_reached & (1 << InputHopFrame))
+        _hop(InputHopPhoton, hw_cycle_count());
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+void input_latency_get_stats(InputLatencyStats *stats)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    for (int i = 0; i < InputHopCount; i++)
+    {
+        stats->count[i] = _count[i];
+        stats->avg_us[i] = _count[i] && i != InputHopEdge ? _total_us[i] / _count[i] : 0;
+        stats->max_us[i] = _max_us[i];
+    }
+    memcpy(stats->to_handler, _to_handler, sizeof(_to_handler));
+    memcpy(stats->to_photon, _to_photon, sizeof(_to_photon));
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+static const char *const _hop_names[InputHopCount] = {
+    [InputHopEdge]     = "edge",
+    [InputHopDebounce] = "debounced",
+    [InputHopButton]   = "button thread",
+    [InputHopPosted]   = "posted",
+    [InputHopHandler]  = "handler",
+    [InputHopHandled]  = "handled",
+    [InputHopFrame]    = "frame",
+    [InputHopPhoton]   = "photon",
+};
+
+static InputLatencyStats _stats;
+
+/*
+ * Log each hop, and the two histograms
+ */
+void input_latency_dump(void)
+{
+    input_latency_get_stats(&_stats);
+
+    SYS_LOG("input", APP_LOG_LEVEL_INFO, "%lu edges", _stats.count[InputHopEdge]);
+    for (int i = InputHopEdge + 1; i < InputHopCount; i++)
+        SYS_LOG("input", APP_LOG_LEVEL_INFO, "%s: %lu, avg %lu us max %lu us after the edge",
+                _hop_names[i], _stats.count[i], _stats.avg_us[i], _stats.max_us[i]);
+
+    SYS_LOG("input", APP_LOG_LEVEL_INFO, "to handler, under %dms and on up by twos: %lu %lu %lu %lu %lu %lu %lu %lu",
+            INPUT_LATENCY_MIN_MS,
+            _stats.to_handler[0], _stats.to_handler[1], _stats.to_handler[2], _stats.to_handler[3],
+            _stats.to_handler[4], _stats.to_handler[5], _stats.to_handler[6], _stats.to_handler[7]);
+    SYS_LOG("input", APP_LOG_LEVEL_INFO, "to photon, under %dms and on up by twos: %lu %lu %lu %lu %lu %lu %lu %lu",
+            INPUT_LATENCY_MIN_MS,
+            _stats.to_photon[0], _stats.to_photon[1], _stats.to_photon[2], _stats.to_photon[3],
+            _stats.to_photon[4], _stats.to_photon[5], _stats.to_photon[6], _stats.to_photon[7]);
+}
+
+/*
+ * Debug endpoint. Any packet gets the stats logged and sent back raw
+ */
+void process_input_latency_packet(uint8_t *data, uint16_t len)
+{
+    input_latency_dump();
+    bluetooth_send_packet(ENDPOINT_INPUT_LATENCY, (uint8_t *)&_stats, sizeof(_stats));
+}
@@ -0,0 +1,42 @@
+#pragma once
+/* input_latency.h
+ * How long a button takes to do something
+ * RebbleOS
+ */
+
+#include <stdint.h>
+
+/* The hops an edge takes, in order. Each is timed from the edge */
+typedef enum InputLatencyHop {
+    InputHopEdge,       /* the button ISR saw it */
+    InputHopDebounce,   /* settled, on the defer thread */
+    InputHopButton,     /* the button thread took it */
+    InputHopPosted,     /* a click went on the app's (or overlay's) queue */
+    InputHopHandler,    /* the handler was called */
+    InputHopHandled,    /* and returned */
+    InputHopFrame,      /* the next frame started out to the display */
+    InputHopPhoton,     /* and was all out */
+    InputHopCount
+} InputLatencyHop;
+
+/* histogram buckets: under 8ms, each after twice the last, the last
+ * everything longer */
+#define INPUT_LATENCY_BUCKETS 8
+#define INPUT_LATENCY_MIN_MS  8
+
+typedef struct __attribute__((__packed__)) InputLatencyStats {
+    uint32_t count[InputHopCount];
+    uint32_t avg_us[InputHopCount];
+    uint32_t max_us[InputHopCount];
+    uint32_t to_handler[INPUT_LATENCY_BUCKETS];
+    uint32_t to_photon[INPUT_LATENCY_BUCKETS];
+} InputLatencyStats;
+
+void input_latency_edge(void);
+void input_latency_hop(InputLatencyHop hop);
+void input_latency_settled(void);
+void input_latency_frame_start(void);
+void input_latency_frame_done(void);
+void input_latency_get_stats(InputLatencyStats *stats);
+void input_latency_dump(void);
+void process_input_latency_packet(uint8_t *data, uint16_t len);
@@ -7,12 +7,52 @@
 
 #include "rebbleos.h"
 #include "stm32_power.h"
+#include "ring.h"
+#include "crash_dump.h"
 
-extern int vsfmt(char *buf, unsigned int len, const char *ifmt, va_list ap);
+/*
+ * Logging never waits. log_printf captures each line as a record (see
+ * log_binary.c): the format string and file by address, the arguments as
+ * they are, and strings copied in. That goes into a ring, with interrupts
+ * masked for just the copy, since tasks and ISRs all write to it. The log
+ * thread, near the bottom of the priorities, takes the records out and
+ * formats them, or sends them on as they are in binary mode.
+ *
+ * A line that doesn't fit in the ring is counted, and the count logged
+ * when there is room again. Before the scheduler runs, there is no one to
+ * wait for, and lines go out there and then.
+ */
+
+#define LOG_RING_SIZE   4096 /* a power of two */
+#define LOG_MSG_LEN     128
+#define STACK_SZ_LOG    (configMINIMAL_STACK_SIZE + 300)
+
+volatile uint8_t log_level = APP_LOG_LEVEL_DEBUG_VERBOSE;
 
-static SemaphoreHandle_t _log_mutex = NULL;
-static StaticSemaphore_t _log_mutex_buf;
-static void _log_pad_string(const char *in_str, char *padded_str, uint16_t pad_len);
+static uint8_t _log_ring_buf[LOG_RING_SIZE];
+static ring _log_ring = RING_INIT(_log_ring_buf);
+static volatile uint32_t _log_dropped;
+
+static TaskHandle_t _log_task;
+static StackType_t _log_task_stack[STACK_SZ_LOG];
+static StaticTask_t _log_task_buf;
+
+static void _log_thread(void *pvParameters);
+
+void log_init(void)
+{
+    _log_task = xTaskCreateStatic(_log_thread, "Log", STACK_SZ_LOG, NULL,
+                                  tskIDLE_PRIORITY + 1UL,
+                                  _log_task_stack, &_log_task_buf);
+}
+
+/*
+ * The most verbose level that is logged, of what was compiled in
+ */
+void log_set_level(uint8_t level)
+{
+    log_level = level;
+}
 
 /*
  * Print log output (like APP_LOG:   INFO filename.c message)
@@ -20,6 +60,11 @@ static void _log_pad_string(const char *in_str, char *padded_str, uint16_t pad_l
 void app_log_trace(uint8_t level, const char *filename, uint32_t line_no, const char *fmt, ...)
 {
     va_list ar;
+
+    /* apps have their own APP_LOG, which comes straight here */
+    if (level > log_level)
+        return;
+
     va_start(ar, fmt);
     log_printf("APP", "APP", level, filename, line_no, fmt, ar);
     va_end(ar);
@@ -33,119 +78,175 @@ void log_printf_to_ar(const char *layer, const char *module, uint8_t level, cons
     va_end(ar);
 }
 
-// NOTE Probably shouldn't use from an ISR or it'll likely lock
+/* the end of a long name says more than its start */
+static const char *_log_tail(const char *s, size_t n)
+{
+    size_t len = strlen(s);
 
-void log_printf(const char *layer, const char *module, uint8_t level, const char *filename, uint32_t line_no, const char *fmt, va_list ar)
+    return len > n ? s + len - n : s;
+}
+
+static void _log_text(const LogRecord *r, int8_t thread_type)
 {
-    uint8_t interrupt_set = 0;
-    static BaseType_t xHigherPriorityTaskWoken;
-    char buf[128];
-    char tbuf[16];
-    
-    // XXX: this means that log_printf *must* be called first from a non-threaded context, for this check is not thread-safe!
-    // XXX: verify this here.
-    if (_log_mutex == NULL)
-        _log_mutex = xSemaphoreCreateMutexStatic(&_log_mutex_buf);
-    
-    if(is_interrupt_set())
-    {
-        xHigherPriorityTaskWoken = pdFALSE;
-        xSemaphoreTakeFromISR(_log_mutex, &xHigherPriorityTaskWoken);
-        interrupt_set = 1;
-    }
-    else
-    {
-        xSemaphoreTake(_log_mutex, portMAX_DELAY);
-    }
+    char buf[LOG_MSG_LEN];
+    char line[8];
+    char level;
+    int n;
 
-    log_clock_enable();
- 
-    
-#define INT_LEN 6
-#define LEVEL_LEN 3
-#define LAYER_LEN 8
-#define MODULE_LEN 8
-#define FILENM_LEN 15
-#define LINENO_LEN 5
- 
-    snprintf(buf, (INT_LEN / 2) + 1, "[%d]", interrupt_set);
-    app_running_thread *thread = appmanager_get_current_thread();
-    snprintf(buf + INT_LEN / 2, (INT_LEN / 2) + 1, "[%d]", thread ? thread->thread_type : -1);
-    
-    // This is pretty cheesy. We print the sections in chunks back to back
-    // This is becuase there is no %8d equiv in fmt.c so we hacky it up ourself
-    switch(level)
+    switch(r->level)
     {
         case APP_LOG_LEVEL_ERROR:
-            snprintf(buf + INT_LEN, LEVEL_LEN + 1, "[E]");
+            level = 'E';
             break;
         case APP_LOG_LEVEL_WARNING:
-            snprintf(buf + INT_LEN, LEVEL_LEN + 1, "[W]");
+            level = 'W';
             break;
         case APP_LOG_LEVEL_INFO:
-            snprintf(buf + INT_LEN, LEVEL_LEN + 1, "[I]");
+            level = 'I';
             break;
         case APP_LOG_LEVEL_DEBUG:
-            snprintf(buf + INT_LEN, LEVEL_LEN + 1, "[D]");
+            level = 'D';
             break;
         case APP_LOG_LEVEL_DEBUG_VERBOSE:
-            snprintf(buf + INT_LEN, LEVEL_LEN + 1, "[V]");
+            level = 'V';
             break;
         default:
-            snprintf(buf + INT_LEN, LEVEL_LEN + 1, "[?]");
+            level = '?';
     }
-       
-    _log_pad_string(layer, tbuf, LAYER_LEN - 2);
-    snprintf(buf + INT_LEN + LEVEL_LEN, LAYER_LEN + 1, "[%s]", tbuf);
-    
-    _log_pad_string(module, tbuf, MODULE_LEN - 2);
-    snprintf(buf + INT_LEN + LEVEL_LEN + LAYER_LEN, MODULE_LEN + 1, "[%s]", tbuf);
 
-    _log_pad_string(filename, tbuf, FILENM_LEN - 2);
-    snprintf(buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN, FILENM_LEN + 2, "[%s", tbuf);
+    /* columns: layer and module 6, file 13 and line 5 */
+    snprintf(line, sizeof(line), ":%d", (int)r->line);
+    n = snprintf(buf, sizeof(buf), "[%d][%d][%c][%-6s][%-6s][%-13s%-5.5s] ",
+                 r->isr, thread_type, level, _log_tail(r->layer, 6), _log_tail(r->module, 6),
+                 _log_tail(r->filename, 13), line);
+    if (n > LOG_MSG_LEN - 1)
+        n = LOG_MSG_LEN - 1;
 
-    snprintf(tbuf, LINENO_LEN + 2, ":%d", (int)line_no);
-    _log_pad_string(tbuf, buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN + FILENM_LEN - 1, LINENO_LEN + 1);
-    snprintf(buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN + FILENM_LEN + LINENO_LEN - 1, 3, "] ");
+    log_binary_format(buf + n, LOG_MSG_LEN - n, r);
 
-    vsfmt(buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN + FILENM_LEN + LINENO_LEN + 1, 128, fmt, ar);
+    printf("%s\n", buf);
+}
 
-    printf(buf);
-    printf("\n");
-    
-    log_clock_disable();
-    
-    if (interrupt_set)
+/* One captured line out, as text or as it is */
+static void _log_out(const uint8_t *entry)
+{
+    const uint8_t *rec = entry + 1;
+    uint8_t binary = log_binary_mode();
+    LogRecord r;
+
+    log_clock_enable();
+
+    if (binary)
+        log_binary_send(rec, rec[1] + 3);
+
+    /* the UART carries records or text, not both */
+    if (!(binary & LOG_BINARY_UART))
     {
-        xSemaphoreGiveFromISR(_log_mutex, &xHigherPriorityTaskWoken);
-        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+        log_binary_parse(rec, &r);
+        _log_text(&r, (int8_t)entry[0]);
     }
-    else 
+
+    log_clock_disable();
+}
+
+/* The next whole entry out of the ring. The log thread's, or whoever
+ * has the scheduler stopped */
+static bool _log_take(uint8_t *entry)
+{
+    /* the thread type, then the sync and length of the record */
+    if (ring_used(&_log_ring) < 3)
+        return false;
+    ring_read(&_log_ring, entry, 3);
+    ring_read(&_log_ring, entry + 3, entry[2] + 1);
+    return true;
+}
+
+static void _log_thread(void *pvParameters)
+{
+    uint8_t entry[LOG_BIN_MAX + 1];
+    uint32_t dropped = 0;
+
+    for( ;; )
     {
-        xSemaphoreGive(_log_mutex);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (_log_take(entry))
+            _log_out(entry);
+
+        if (_log_dropped != dropped)
+        {
+            SYS_LOG("log", APP_LOG_LEVEL_WARNING, "%lu lines dropped", _log_dropped - dropped);
+            dropped = _log_dropped;
+        }
     }
 }
 
+void log_flush(void)
+{
+    uint8_t entry[LOG_BIN_MAX + 1];
+
+    vTaskSuspendAll();
+    while (_log_take(entry))
+        _log_out(entry);
+    xTaskResumeAll();
+}
 
-static void _log_pad_string(const char *in_str, char *padded_str, uint16_t pad_len)
+void log_printf(const char *layer, const char *module, uint8_t level, const char *filename, uint32_t line_no, const char *fmt, va_list ar)
 {
-    int len = strlen(in_str);
-    padded_str[0] = 0;
-    
-    if (len > pad_len)
+    uint8_t entry[LOG_BIN_MAX + 1];
+    bool isr = is_interrupt_set();
+    app_running_thread *thread = appmanager_get_current_thread();
+    uint16_t len;
+
+    entry[0] = thread ? thread->thread_type : -1;
+    len = 1 + log_binary_record(entry + 1, layer, module, level, filename, line_no, isr, fmt, ar);
+
+    if (!_log_task || xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
     {
-        // truncate left
-        snprintf(padded_str, len, in_str + len - pad_len);
+        _log_out(entry);
+        return;
+    }
+
+    if (isr)
+    {
+        UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+        if (ring_free(&_log_ring) >= len)
+            ring_write(&_log_ring, entry, len);
+        else
+            _log_dropped++;
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+        vTaskNotifyGiveFromISR(_log_task, NULL);
     }
     else
     {
-        strcat(padded_str, in_str);
-        // pad
-        uint16_t i;
-        for (i = len; i < pad_len; i++)
-        {
-            padded_str[i] = ' ';
-        }
-        padded_str[i] = 0;
+        taskENTER_CRITICAL();
+        if (ring_free(&_log_ring) >= len)
+            ring_write(&_log_ring, entry, len);
+        else
+            _log_dropped++;
+        taskEXIT_CRITICAL();
+        xTaskNotifyGive(_log_task);
     }
 }
+
+/*
+ * For crash_dump. The ring's bytes are still there after the log thread
+ * has taken them, so the newest lines go in whether they made it out or
+ * not; the oldest may be cut off mid record
+ */
+void log_crash_spans(CrashDumpSpan span[2], uint32_t max)
+{
+    uint32_t head = _log_ring.head;
+    uint32_t n = head < max ? head : max;
+    uint32_t first, run;
+
+    if (n > _log_ring.size)
+        n = _log_ring.size;
+    first = (head - n) & (_log_ring.size - 1);
+    run = _log_ring.size - first < n ? _log_ring.size - first : n;
+
+    span[0].data = _log_ring.buf + first;
+    span[0].len = run;
+    span[1].data = _log_ring.buf;
+    span[1].len = n - run;
+}
@@ -7,16 +7,36 @@
  */
 
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Lines above LOG_COMPILE_LEVEL are compiled out, format strings and
+ * all; the build sets it, see config.mk. A module can go lower still for
+ * itself, after its includes:
+ *   #undef LOG_MODULE_LEVEL
+ *   #define LOG_MODULE_LEVEL APP_LOG_LEVEL_WARNING
+ * What is left is checked against log_level, which can be changed at run
+ * time, before anything is captured */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL APP_LOG_LEVEL_DEBUG_VERBOSE
+#endif
+#define LOG_MODULE_LEVEL APP_LOG_LEVEL_DEBUG_VERBOSE
+
+extern volatile uint8_t log_level;
+
+#define LOG_ENABLED(lvl_) \
+            ((lvl_) <= LOG_COMPILE_LEVEL && (lvl_) <= LOG_MODULE_LEVEL && (lvl_) <= log_level)
+#define _LOG_IF(lvl_, call_) (LOG_ENABLED(lvl_) ? (call_) : (void)0)
 
 #define NULL_LOG(module_, lvl_, fmt_, ...) {;}
 #define SYS_LOG(module_, lvl_, fmt_, ...) \
-            log_printf_to_ar(module_, "SYS", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__)
+            _LOG_IF(lvl_, log_printf_to_ar(module_, "SYS", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__))
 #define KERN_LOG(module_, lvl_, fmt_, ...) \
-            log_printf_to_ar(module_, "KERN", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__)
+            _LOG_IF(lvl_, log_printf_to_ar(module_, "KERN", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__))
 #define DRV_LOG(module_, lvl_, fmt_, ...) \
-            log_printf_to_ar(module_, "DRIVER", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__)
+            _LOG_IF(lvl_, log_printf_to_ar(module_, "DRIVER", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__))
 #define APP_LOG(module_, lvl_, fmt_, ...) \
-            log_printf_to_ar(module_, "APP", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__)
+            _LOG_IF(lvl_, log_printf_to_ar(module_, "APP", lvl_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__))
 
 
 #define _LOG_NONE  0
@@ -33,7 +53,7 @@
 #define RBL_LOG_LEVEL_NONE _LOG_NONE
 
 #define __LOG_AR(name_, type_, log_type_, fmt_, ...) \
-        log_printf_to_ar(name_, type_, log_type_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__)
+        _LOG_IF(log_type_, log_printf_to_ar(name_, type_, log_type_, __FILE__, __LINE__, fmt_, ##__VA_ARGS__))
 
 #define LOG_INFO(fmt_, ...) \
         if (LOG_LEVEL & _LOG_INFO) \
@@ -61,3 +81,39 @@ void app_log_trace(uint8_t level, const char *filename, uint32_t f, const char *
 
 void log_printf(const char *layer, const char *module, uint8_t level, const char *filename, uint32_t line_no, const char *fmt, va_list ar);
 void log_printf_to_ar(const char *layer, const char *module, uint8_t level, const char *filename, uint32_t line_no, const char *fmt, ...);
+
+/* Binary log modes, see log_binary.c. With UART set, the UART carries
+ * records in place of text */
+#define LOG_BINARY_UART 1
+#define LOG_BINARY_BT   2
+
+/* the longest a record can be */
+#define LOG_BIN_MAX     160
+
+/* A record, taken apart */
+typedef struct LogRecord {
+    uint8_t level;
+    bool isr;
+    uint32_t time;
+    uint16_t line;
+    const char *fmt;
+    const char *filename;
+    const char *layer;
+    const char *module;
+    const uint8_t *args;
+    const uint8_t *end;
+} LogRecord;
+
+void log_init(void);
+/* everything captured so far, out now. For when the log thread never
+ * will run again */
+void log_flush(void);
+
+uint8_t log_binary_mode(void);
+uint16_t log_binary_record(uint8_t *rec, const char *layer, const char *module, uint8_t level,
+                           const char *filename, uint32_t line_no, bool isr, const char *fmt, va_list ar);
+void log_binary_send(const uint8_t *rec, uint16_t len);
+void log_binary_parse(const uint8_t *rec, LogRecord *r);
+void log_binary_format(char *buf, uint16_t len, const LogRecord *r);
+void process_log_stream_packet(uint8_t *data, uint16_t len);
+void log_set_level(uint8_t level);
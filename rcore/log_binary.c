@@ -0,0 +1,505 @@
+/* log_binary.c
+ * Logs as compact records for a host to expand, over the UART and BT
+ * RebbleOS
+ *
+ * A text line is a hundred bytes or so, put together by vsfmt and sent a
+ * byte at a time. A record has the addresses of its format string, file
+ * and module in the firmware image, the line, the time, the task and the
+ * raw arguments, and nothing on the watch formats anything.
+ * Utilities/logdecode.py looks the strings up in the ELF and prints each
+ * line as the text log would have.
+ *
+ * A string that isn't in the image, such as an app's or a %s argument,
+ * goes in the record itself. An app's format string has what room there
+ * is, a %s argument LOG_BIN_ARG_MAX, and names LOG_BIN_STR_MAX; a file
+ * name keeps its end, as the text log does.
+ *
+ * A record, little endian:
+ *   sync   LOG_BIN_SYNC
+ *   len    of what follows, up to the check
+ *   flags  level in bits 0-2, set bit 3 for an ISR, bit 4 for a name
+ *   inl    bits 0-3 for whether fmt, file, module and layer are inline
+ *   task   the FreeRTOS task number, 0 for an ISR
+ *   time   ticks since boot, 4 bytes
+ *   line   2 bytes
+ *   name   with bit 4, the task's name and a 0
+ *   fmt, file, module, layer: a 4 byte address, or a string and a 0
+ *   args   4 bytes each, but a %s is a string and a 0
+ *   check  the low byte of the sum of everything from len on
+ * Anything between records is plain text, and is passed through.
+ *
+ * Each task's first record after binary is turned on has its name, so
+ * the decoder can put a name to the number from then on.
+ *
+ * Every log line is captured as a record (see log.c), binary mode or not;
+ * the log thread formats the text from it, or sends it on as it is.
+ *
+ * Over BT, records go into a ring, and the BLog thread sends them on
+ * ENDPOINT_LOG_STREAM in batches: once LOG_BIN_BATCH bytes are waiting, or
+ * LOG_BIN_FLUSH after the last send. While the phone is away the ring
+ * fills, and what doesn't fit is counted and dropped.
+ */
+
+#include "rebbleos.h"
+#include "endpoint.h"
+#include "ring.h"
+#include "watchdog.h"
+
+#define LOG_BIN_SYNC        0x1e
+#define LOG_BIN_STR_MAX     32
+#define LOG_BIN_ARG_MAX     64
+#define LOG_BIN_SPEC_MAX    16
+
+/* a power of two */
+#define LOG_BIN_RING_SIZE   2048
+#define LOG_BIN_BATCH       512
+#define LOG_BIN_PACKET      1024
+#define LOG_BIN_FLUSH       pdMS_TO_TICKS(1000)
+
+#define STACK_SZ_BLOG       (configMINIMAL_STACK_SIZE + 100)
+
+#define LOG_BIN_FLAG_ISR    (1 << 3)
+#define LOG_BIN_FLAG_NAME   (1 << 4)
+
+/* the end of the image's read only data, from the linker script */
+extern const char _erodata[];
+extern int sfmt(char *buf, unsigned int len, const char *ifmt, ...);
+
+static volatile uint8_t _log_mode;
+static uint32_t _dropped;
+
+static uint8_t _ring_buf[LOG_BIN_RING_SIZE];
+static ring _ring = RING_INIT(_ring_buf);
+
+static TaskHandle_t _blog_task;
+static StackType_t _blog_task_stack[STACK_SZ_BLOG];
+static StaticTask_t _blog_task_buf;
+
+uint8_t log_binary_mode(void)
+{
+    return _log_mode;
+}
+
+static bool _in_image(const char *s)
+{
+    return (uintptr_t)s >= FLASH_BASE && s < _erodata;
+}
+
+static uint8_t *_put_u32(uint8_t *p, const uint8_t *end, uint32_t v)
+{
+    if (p + 4 > end)
+        return p;
+
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+static uint8_t *_put_str(uint8_t *p, const uint8_t *end, const char *s, uint16_t max)
+{
+    if (p >= end)
+        return p;
+
+    if (!s)
+        s = "(null)";
+    for (uint16_t n = 0; *s && n < max && p < end - 1; n++)
+        *p++ = *s++;
+    *p++ = 0;
+
+    return p;
+}
+
+/* the string's address if the ELF has it, or the string */
+static uint8_t *_put_ref(uint8_t *p, const uint8_t *end, const char *s, uint16_t max,
+                         uint8_t bit, uint8_t *inl)
+{
+    if (_in_image(s))
+        return _put_u32(p, end, (uint32_t)s);
+
+    *inl |= bit;
+    return _put_str(p, end, s, max);
+}
+
+/*
+ * Tasks are numbered by the kernel as they are made, but it only lets us
+ * have the number it keeps for tracing, which is ours to set. It is set
+ * from the kernel's on a task's first record, and the name goes along
+ */
+static uint8_t *_put_task(uint8_t *p, const uint8_t *end, uint8_t *task, uint8_t *flags)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    TaskStatus_t status;
+
+    *task = uxTaskGetTaskNumber(self);
+    if (*task)
+        return p;
+
+    vTaskGetInfo(self, &status, pdFALSE, eRunning);
+    vTaskSetTaskNumber(self, status.xTaskNumber);
+    *task = status.xTaskNumber;
+    *flags |= LOG_BIN_FLAG_NAME;
+
+    return _put_str(p, end, status.pcTaskName, LOG_BIN_STR_MAX);
+}
+
+/*
+ * Past the flags, width, precision and length of a conversion, to its
+ * letter. stars is how many * arguments come before its own, and longer
+ * that its own is a long long
+ */
+static const char *_spec(const char *f, uint8_t *stars, bool *longer)
+{
+    *stars = 0;
+    *longer = false;
+
+    while (*f == '0' || *f == '-')
+        f++;
+    if (*f == '*')
+    {
+        (*stars)++;
+        f++;
+    }
+    while (*f >= '0' && *f <= '9')
+        f++;
+    if (*f == '.')
+    {
+        f++;
+        if (*f == '*')
+        {
+            (*stars)++;
+            f++;
+        }
+        while (*f >= '0' && *f <= '9')
+            f++;
+    }
+    if (*f == 'l')
+    {
+        f++;
+        if (*f == 'l')
+        {
+            *longer = true;
+            f++;
+        }
+    }
+    return f;
+}
+
+/*
+ * The arguments, taken as vsfmt would take them: one word each, two for
+ * a long long, and one for each *. Whatever won't fit is left off
+ */
+static uint8_t *_put_args(uint8_t *p, const uint8_t *end, const char *f, va_list ar)
+{
+    for ( ; *f; f++)
+    {
+        uint8_t stars;
+        bool longer;
+
+        if (*f != '%')
+            continue;
+
+        f = _spec(f + 1, &stars, &longer);
+        while (stars--)
+            p = _put_u32(p, end, va_arg(ar, unsigned int));
+
+        switch (*f)
+        {
+            case 0:
+                return p;
+            case 's':
+                p = _put_str(p, end, va_arg(ar, const char *), LOG_BIN_ARG_MAX);
+                break;
+            case 'p':
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            case 'c':
+                if (longer)
+                {
+                    unsigned long long v = va_arg(ar, unsigned long long);
+                    p = _put_u32(p, end, (uint32_t)v);
+                    p = _put_u32(p, end, (uint32_t)(v >> 32));
+                }
+                else
+                    p = _put_u32(p, end, va_arg(ar, unsigned int));
+                break;
+        }
+    }
+
+    return p;
+}
+
+/*
+ * Build the record for one log line into rec, which is LOG_BIN_MAX long.
+ * Returns its length. As for log_printf, layer is the module's name and
+ * module is its layer, SYS or KERN and so on
+ */
+uint16_t log_binary_record(uint8_t *rec, const char *layer, const char *module, uint8_t level,
+                           const char *filename, uint32_t line_no, bool isr, const char *fmt, va_list ar)
+{
+    const uint8_t *end = rec + LOG_BIN_MAX - 1; /* the check goes after */
+    uint8_t *p = rec + 5;
+    uint8_t check = 0;
+    uint32_t now = xTaskGetTickCount();
+    uint16_t line = line_no;
+    size_t flen;
+
+    /* the end of a long file name says more than its start */
+    if (!_in_image(filename) && (flen = strlen(filename)) > LOG_BIN_STR_MAX)
+        filename += flen - LOG_BIN_STR_MAX;
+
+    rec[0] = LOG_BIN_SYNC;
+    rec[2] = (level & 7) | (isr ? LOG_BIN_FLAG_ISR : 0);
+    rec[3] = 0;
+    rec[4] = 0;
+    memcpy(p, &now, 4);
+    p += 4;
+    memcpy(p, &line, 2);
+    p += 2;
+    if (!isr && xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+        p = _put_task(p, end, &rec[4], &rec[2]);
+    p = _put_ref(p, end, fmt, LOG_BIN_MAX, 1 << 0, &rec[3]);
+    p = _put_ref(p, end, filename, LOG_BIN_STR_MAX, 1 << 1, &rec[3]);
+    p = _put_ref(p, end, layer, LOG_BIN_STR_MAX, 1 << 2, &rec[3]);
+    p = _put_ref(p, end, module, LOG_BIN_STR_MAX, 1 << 3, &rec[3]);
+    p = _put_args(p, end, fmt, ar);
+
+    rec[1] = p - rec - 2;
+    for (uint8_t *c = rec + 1; c < p; c++)
+        check += *c;
+    *p++ = check;
+
+    return p - rec;
+}
+
+/*
+ * A record, to wherever the mode says. Only from the log thread, or
+ * before the scheduler, so there is only ever one of us on the ring
+ */
+void log_binary_send(const uint8_t *rec, uint16_t len)
+{
+    uint8_t mode = _log_mode;
+
+    if (mode & LOG_BINARY_UART)
+        debug_write(rec, len);
+
+    if (mode & LOG_BINARY_BT)
+    {
+        /* all of it or none, so the stream stays whole */
+        if (ring_free(&_ring) < len)
+        {
+            _dropped++;
+            return;
+        }
+        ring_write(&_ring, rec, len);
+
+        if (_blog_task && ring_used(&_ring) >= LOG_BIN_BATCH)
+            xTaskNotifyGive(_blog_task);
+    }
+}
+
+static const char *_get_ref(const uint8_t **p, const uint8_t *end, uint8_t inl, uint8_t bit)
+{
+    const char *s;
+
+    if (inl & bit)
+    {
+        s = (const char *)*p;
+        *p += strnlen(s, end - *p) + 1;
+        return s;
+    }
+
+    if (*p + 4 > end)
+        return "";
+    memcpy(&s, *p, 4);
+    *p += 4;
+    return s;
+}
+
+/*
+ * Take a record of ours apart again. Strings point into the image or the
+ * record, so the record must outlive what is made of it
+ */
+void log_binary_parse(const uint8_t *rec, LogRecord *r)
+{
+    const uint8_t *end = rec + 2 + rec[1];
+    const uint8_t *p = rec + 5;
+
+    r->level = rec[2] & 7;
+    r->isr = rec[2] & LOG_BIN_FLAG_ISR;
+    memcpy(&r->time, p, 4);
+    p += 4;
+    memcpy(&r->line, p, 2);
+    p += 2;
+    if (rec[2] & LOG_BIN_FLAG_NAME)
+        p += strnlen((const char *)p, end - p) + 1;
+    r->fmt = _get_ref(&p, end, rec[3], 1 << 0);
+    r->filename = _get_ref(&p, end, rec[3], 1 << 1);
+    r->layer = _get_ref(&p, end, rec[3], 1 << 2);
+    r->module = _get_ref(&p, end, rec[3], 1 << 3);
+    r->args = p;
+    r->end = end;
+}
+
+static uint32_t _get_u32(const uint8_t **p, const uint8_t *end)
+{
+    uint32_t v = 0;
+
+    if (*p + 4 <= end)
+    {
+        memcpy(&v, *p, 4);
+        *p += 4;
+    }
+    return v;
+}
+
+/*
+ * The message, as vsfmt would have made it from the arguments. Each
+ * conversion goes to sfmt on its own, with its words, so widths and all
+ * come out just the same
+ */
+void log_binary_format(char *buf, uint16_t len, const LogRecord *r)
+{
+    const char *f = r->fmt;
+    const uint8_t *a = r->args;
+    char spec[LOG_BIN_SPEC_MAX];
+    uint16_t n = 0;
+
+#define LOG_BIN_SFMT(v) (stars == 2 ? sfmt(buf + n, len - n, spec, star[0], star[1], v) : \
+                         stars ? sfmt(buf + n, len - n, spec, star[0], v) : \
+                         sfmt(buf + n, len - n, spec, v))
+
+    while (*f && n < len - 1)
+    {
+        const char *start = f;
+        uint32_t star[2];
+        uint8_t stars;
+        bool longer;
+
+        if (*f != '%')
+        {
+            buf[n++] = *f++;
+            continue;
+        }
+
+        f = _spec(f + 1, &stars, &longer);
+        for (uint8_t i = 0; i < stars; i++)
+            star[i] = _get_u32(&a, r->end);
+        if (!*f)
+            break;
+        f++;
+
+        if (f - start >= LOG_BIN_SPEC_MAX)
+            continue;
+        memcpy(spec, start, f - start);
+        spec[f - start] = 0;
+
+        switch (f[-1])
+        {
+            case '%':
+                buf[n++] = '%';
+                break;
+            case 's':
+            {
+                const char *s = a < r->end ? (const char *)a : "";
+                a += strnlen(s, r->end - a) + 1;
+                LOG_BIN_SFMT(s);
+                n += strlen(buf + n);
+                break;
+            }
+            case 'p':
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            case 'c':
+            {
+                uint32_t v = _get_u32(&a, r->end);
+                if (longer)
+                {
+                    unsigned long long v64 = v | (unsigned long long)_get_u32(&a, r->end) << 32;
+                    LOG_BIN_SFMT(v64);
+                }
+                else
+                    LOG_BIN_SFMT(v);
+                n += strlen(buf + n);
+                break;
+            }
+        }
+    }
+
+#undef LOG_BIN_SFMT
+
+    buf[n] = 0;
+}
+
+/* The ring to the phone, a packet at a time, straight out of the ring */
+static void _blog_thread(void *pvParameters)
+{
+    const uint8_t *data;
+    uint32_t n;
+
+    for( ;; )
+    {
+        ulTaskNotifyTake(pdTRUE, (_log_mode & LOG_BINARY_BT) ? LOG_BIN_FLUSH : portMAX_DELAY);
+
+        while (bluetooth_is_device_connected() && (n = ring_peek(&_ring, &data)))
+        {
+            if (n > LOG_BIN_PACKET)
+                n = LOG_BIN_PACKET;
+            bluetooth_send_packet(ENDPOINT_LOG_STREAM, (uint8_t *)data, n);
+            ring_consume(&_ring, n);
+        }
+    }
+}
+
+typedef struct __attribute__((__packed__)) LogStreamPacket {
+    uint8_t mode;
+    uint32_t dropped;
+    uint8_t level;
+} LogStreamPacket;
+
+/*
+ * Debug endpoint. The first byte is the new mode, LOG_BINARY_ bits, and
+ * a second sets log_level; any packet gets the mode, the dropped count
+ * and the level back. Turning binary on
+ * has every task send its name again, for a decoder that has just started
+ */
+void process_log_stream_packet(uint8_t *data, uint16_t len)
+{
+    static TaskStatus_t tasks[STACK_STATS_MAX];
+    LogStreamPacket pkt;
+    uint8_t was = _log_mode;
+
+    if (len)
+    {
+        uint8_t mode = data[0] & (LOG_BINARY_UART | LOG_BINARY_BT);
+
+        if (mode & ~was)
+        {
+            UBaseType_t ntasks = uxTaskGetSystemState(tasks, STACK_STATS_MAX, NULL);
+            for (UBaseType_t i = 0; i < ntasks; i++)
+                vTaskSetTaskNumber(tasks[i].xHandle, 0);
+        }
+
+        if ((mode & LOG_BINARY_BT) && !_blog_task)
+            _blog_task = xTaskCreateStatic(_blog_thread, "BLog", STACK_SZ_BLOG, NULL,
+                                           tskIDLE_PRIORITY + 1UL,
+                                           _blog_task_stack, &_blog_task_buf);
+        _log_mode = mode;
+        if (_blog_task)
+            xTaskNotifyGive(_blog_task);
+    }
+
+    if (len > 1)
+        log_set_level(data[1]);
+
+    pkt.mode = _log_mode;
+    pkt.dropped = _dropped;
+    pkt.level = log_level;
+    bluetooth_send_packet(ENDPOINT_LOG_STREAM, (uint8_t *)&pkt, sizeof(pkt));
+}
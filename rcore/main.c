@@ -8,12 +8,15 @@
 #include "rebbleos.h"
 #include "watchdog.h"
 #include "ambient.h"
+#include "stm32_power.h"
+#include "boot_profile.h"
 
 extern const char git_version[];
 
 int main(void)
 {
     SystemInit();
+    boot_profile_init();
 
     hardware_init();
 
@@ -21,6 +24,7 @@ int main(void)
     
     KERN_LOG("main", APP_LOG_LEVEL_INFO, "RebbleOS git: %s", git_version);
     
+    boot_profile_event(BootProfileScheduler);
     vTaskStartScheduler();  // should never return
     
     panic("vTaskStartScheduler returned?");
@@ -32,11 +36,16 @@ int main(void)
  */
 void hardware_init(void)
 {
+    boot_profile_step_start(BootProfilePlatform);
     platform_init();
+    boot_profile_step_end(BootProfilePlatform);
     debug_init();
     KERN_LOG("init", APP_LOG_LEVEL_INFO, "Debug Init");
     rcore_watchdog_init_early();
     KERN_LOG("init", APP_LOG_LEVEL_INFO, "Watchdog Init");
+    /* something on the screen while the modules come up */
+    hw_display_splash();
+    boot_profile_event(BootProfileSplash);
 }
 
 /*
@@ -44,6 +53,8 @@ void hardware_init(void)
  */
 
 void vApplicationTickHook(void) {
+    /* gate the clocks drivers let go of lazily */
+    stm32_power_tick();
 }
 
 /* vApplicationMallocFailedHook() will only be called if
@@ -58,6 +69,7 @@ void vApplicationTickHook(void) {
    provide information on how the remaining heap might be fragmented). */
 void vApplicationMallocFailedHook(void) {
     KERN_LOG("malloc", APP_LOG_LEVEL_ERROR, "Malloc Failed!");
+    log_flush();
     taskDISABLE_INTERRUPTS();
     for(;;);
 }
@@ -81,6 +93,7 @@ void vApplicationStackOverflowHook(xTaskHandle pxTask, signed char *pcTaskName)
         configCHECK_FOR_STACK_OVERFLOW is defined to 1 or 2.  This hook
         function is called if a stack overflow is detected. */
     KERN_LOG("init", APP_LOG_LEVEL_ERROR, "Stack Overflow!");
+    log_flush();
     taskDISABLE_INTERRUPTS();
     for(;;);
 }
@@ -7,6 +7,7 @@
  * Author: Michael Sullivan <sully@msully.net>.
  */
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * @brief A list traversal field that can be embedded in objects.
@@ -17,13 +18,15 @@ typedef struct list_node {
 } list_node;
 
 /**
- * @brief The head of a list
+ * @brief The head of a list. The list is circular through node, so
+ * the tail is head->node.prev; count is kept up by insert and remove.
  */
 typedef struct list_head {
     struct list_node node;
+    uint16_t count;
 } list_head;
 
-#define LIST_HEAD(name) { { .next = &name.node, .prev = &name.node } }
+#define LIST_HEAD(name) { { .next = &name.node, .prev = &name.node }, 0 }
 #define LIST_NODE() { .next = NULL, .prev = NULL }
 
 #define container_of(ptr, type, member) ({                           \
@@ -49,6 +52,7 @@ typedef struct list_head {
 static inline
 void list_init_head(list_head *head) {
     head->node.next = head->node.prev = &head->node;
+    head->count = 0;
 }
 
 static inline
@@ -79,6 +83,14 @@ list_node *list_get_tail(list_head *head) {
     return list_get_prev(head, &head->node);
 }
 
+/**
+ * @brief Number of nodes on the list, without walking it.
+ */
+static inline
+uint16_t list_count(list_head *head) {
+    return head->count;
+}
+
 
 /**
  * @brief List insertion.
@@ -86,7 +98,7 @@ list_node *list_get_tail(list_head *head) {
 static inline
 void list_insert_between(list_head *head, list_node *n,
                          list_node *n1, list_node *n2) {
-    (void)head;
+    head->count++;
     n->prev = n1;
     n2->prev = n;
     n->next = n2;
@@ -121,7 +133,7 @@ void list_insert_tail(list_head *head, list_node *node) {
  */
 static inline
 void list_remove(list_head *head, list_node *node) {
-    (void)head;
+    head->count--;
     node->next->prev = node->prev;
     node->prev->next = node->next;
     // To help catch bugs.
@@ -27,6 +27,8 @@ uint8_t notification_init(void)
 
 void notification_show_message(full_msg_t *msg, uint32_t timeout_ms)
 {
+    /* the window showing it releases it */
+    message_hold(msg);
     message_add(msg);
     
     if (!message_count())
@@ -56,6 +56,7 @@ void battery_overlay_display(OverlayWindow *overlay, Window *window);
 void battery_overlay_destroy(OverlayWindow *overlay, Window *window);
 void mini_message_overlay_display(OverlayWindow *overlay, Window *window);
 void mini_message_overlay_destroy(OverlayWindow *overlay, Window *window);
+void perf_hud_toggle(void);
 
 
 typedef struct notification_data_t {
@@ -8,26 +8,52 @@
 #include "protocol_notification.h"
 #include "notification_manager.h"
 #include "notification_message.h"
+#include "fs.h"
 
 /*
- * A little message handler
- * In the absence of a writable flash, we will store 
- * messages in here. 
- * XXX when we have write
- * 
+ * The message store. Messages live on their own heap, newest first on
+ * the list, at most MSG_STORE_MAX of them: the oldest goes to make room,
+ * for a new one or when the heap is full. One that comes again with the
+ * same id replaces the one we had.
+ * Whoever is showing a message holds it, and then it is only taken off
+ * the list, and freed at the last release.
+ *
+ * The store is written out to flash on every change, and read back the
+ * first time anyone wants it, so the history survives a reboot without
+ * costing the boot anything. Comment out MSG_HISTORY to keep it in RAM.
  */
 #define MSG_HEAP_SIZE 10000
+#define MSG_STORE_MAX 32
+
+#define MSG_HISTORY
+#define MSG_HISTORY_FILE  "notifhist"
+#define MSG_HISTORY_MAGIC 0x4E4F5431 /* NOT1 */
+
+typedef struct MessageHistoryHeader {
+    uint32_t magic;
+    uint16_t count;
+    /* then count of a uint16_t length and the packet, newest first */
+} __attribute__((__packed__)) MessageHistoryHeader;
 
 static uint8_t _notification_messages_heap[MSG_HEAP_SIZE] CCRAM;
 static qarena_t *_notification_arena;
 static list_head _messages_head = LIST_HEAD(_messages_head);
+static SemaphoreHandle_t _store_mutex;
+static StaticSemaphore_t _store_mutex_buf;
+static SemaphoreHandle_t _heap_mutex;
+static StaticSemaphore_t _heap_mutex_buf;
+static bool _history_loaded;
 
 static full_msg_t *_fake_message(char *text, char *action);
+static void _history_load(void);
+static void _history_save(void);
 
 
 void messages_init(void)
 {
     _notification_arena = qinit(_notification_messages_heap, MSG_HEAP_SIZE);
+    _store_mutex = xSemaphoreCreateMutexStatic(&_store_mutex_buf);
+    _heap_mutex = xSemaphoreCreateMutexStatic(&_heap_mutex_buf);
 
     /* create three samples */
 //     message_add(_fake_message("RebbleOS is here!", "To Moon"));
@@ -35,58 +61,284 @@ void messages_init(void)
 //     message_add(_fake_message("Missed Call: Bob", "Dismiss"));
 }
 
+/* built as the phone would send it, so it is stored like any other */
 static full_msg_t *_fake_message(char *text, char *action)
 {
-    full_msg_t *m = noty_calloc(1, sizeof(full_msg_t));
-    cmd_phone_notify_t *n = noty_calloc(1, sizeof(cmd_phone_notify_t));
-    m->header = n;
-    m->header->attr_count = 1;
-    m->header->action_count = 1;
-    
-    cmd_phone_attribute_t *new_attr = noty_calloc(1, sizeof(cmd_phone_attribute_t));
-    cmd_phone_action_t *new_act = noty_calloc(1, sizeof(cmd_phone_action_t));
-    new_attr->data = (uint8_t *)text;
-    new_act->data = (uint8_t *)action;
-    list_init_head(&m->attributes_list_head);
-    list_init_head(&m->actions_list_head);
-    list_init_node(&new_act->node);
-    list_init_node(&new_attr->node);
-    list_insert_tail(&m->attributes_list_head, &new_attr->node);
-    list_insert_tail(&m->actions_list_head, &new_act->node);
-    
+    uint8_t pkt[sizeof(cmd_phone_notify_t) + sizeof(cmd_phone_attribute_hdr_t) +
+                sizeof(cmd_phone_action_hdr_t) + 64] = { 0 };
+    cmd_phone_notify_t *n = (cmd_phone_notify_t *)pkt;
+    uint8_t *p = pkt + sizeof(cmd_phone_notify_t);
+    uint16_t text_len = strnlen(text, 32);
+    uint16_t action_len = strnlen(action, 32);
+    full_msg_t *m;
+
+    n->attr_count = 1;
+    n->action_count = 1;
+
+    cmd_phone_attribute_hdr_t *att = (cmd_phone_attribute_hdr_t *)p;
+    att->str_len = text_len;
+    p += sizeof(cmd_phone_attribute_hdr_t);
+    memcpy(p, text, text_len);
+    p += text_len;
+
+    cmd_phone_action_hdr_t *act = (cmd_phone_action_hdr_t *)p;
+    act->attr_count = 1;
+    act->str_len = action_len;
+    p += sizeof(cmd_phone_action_hdr_t);
+    memcpy(p, action, action_len);
+
+    notification_packet_push(pkt, &m);
     return m;
 }
 
+/* Off the list, and freed unless someone is still showing it. Locked */
+static void _message_drop(full_msg_t *msg)
+{
+    list_remove(&_messages_head, &msg->node);
+    if (msg->holds)
+        msg->dropped = true;
+    else
+        notification_packet_free(msg);
+}
+
+/* The oldest message no one is showing. Locked */
+static full_msg_t *_message_oldest(void)
+{
+    list_node *n;
+
+    for (n = list_get_tail(&_messages_head); n; n = list_get_prev(&_messages_head, n))
+    {
+        full_msg_t *msg = list_elem(n, full_msg_t, node);
+        if (!msg->holds)
+            return msg;
+    }
+    return NULL;
+}
+
+static full_msg_t *_message_find(uint32_t id)
+{
+    full_msg_t *msg;
+
+    list_foreach(msg, &_messages_head, full_msg_t, node)
+        if (msg->header->id == id)
+            return msg;
+    return NULL;
+}
+
+/* In with it, newest or, from the history, oldest. Locked */
+static void _message_insert(full_msg_t *msg, bool newest)
+{
+    full_msg_t *old = msg->header->id ? _message_find(msg->header->id) : NULL;
+
+    if (old && !newest)
+    {
+        /* we have a newer one already */
+        notification_packet_free(msg);
+        return;
+    }
+    if (old)
+        _message_drop(old);
+
+    if (!newest && list_count(&_messages_head) >= MSG_STORE_MAX)
+    {
+        /* older than all we have room for */
+        notification_packet_free(msg);
+        return;
+    }
+
+    while (list_count(&_messages_head) >= MSG_STORE_MAX)
+    {
+        full_msg_t *victim = _message_oldest();
+        if (!victim)
+            break;
+        _message_drop(victim);
+    }
+
+    list_init_node(&msg->node);
+    if (newest)
+        list_insert_head(&_messages_head, &msg->node);
+    else
+        list_insert_tail(&_messages_head, &msg->node);
+}
+
 void message_add(full_msg_t *msg)
 {
     /* we need to get the message into our list
      * it should already be allocated on our heap */
-    list_init_node(&msg->node);
-    list_insert_head(&_messages_head, &msg->node);
+    _history_load();
+
+    xSemaphoreTake(_store_mutex, portMAX_DELAY);
+    _message_insert(msg, true);
+    _history_save();
+    xSemaphoreGive(_store_mutex);
+}
+
+bool message_evict_oldest(void)
+{
+    xSemaphoreTake(_store_mutex, portMAX_DELAY);
+    full_msg_t *victim = _message_oldest();
+    if (victim)
+        _message_drop(victim);
+    xSemaphoreGive(_store_mutex);
+
+    return victim != NULL;
+}
+
+void message_hold(full_msg_t *msg)
+{
+    xSemaphoreTake(_store_mutex, portMAX_DELAY);
+    msg->holds++;
+    xSemaphoreGive(_store_mutex);
+}
+
+uint16_t message_hold_all(full_msg_t **msgs, uint16_t max)
+{
+    full_msg_t *msg;
+    uint16_t n = 0;
+
+    _history_load();
+
+    xSemaphoreTake(_store_mutex, portMAX_DELAY);
+    list_foreach(msg, &_messages_head, full_msg_t, node)
+    {
+        if (n == max)
+            break;
+        msg->holds++;
+        msgs[n++] = msg;
+    }
+    xSemaphoreGive(_store_mutex);
+
+    return n;
+}
+
+void message_release(full_msg_t *msg)
+{
+    xSemaphoreTake(_store_mutex, portMAX_DELAY);
+    if (--msg->holds == 0 && msg->dropped)
+        notification_packet_free(msg);
+    xSemaphoreGive(_store_mutex);
 }
 
 list_head *message_get_head(void)
 {
+    _history_load();
     return &_messages_head;
 }
 
 uint16_t message_count(void)
 {
-    uint16_t count = 0;
-    if (list_get_head(&_messages_head) == NULL)
-        return 0;
-    
-    full_msg_t *w;
-    list_foreach(w, &_messages_head, full_msg_t, node)
-        count++;
+    _history_load();
+    return list_count(&_messages_head);
+}
+
+#ifdef MSG_HISTORY
+
+/*
+ * Read back what was stored before the boot, under the ones that came
+ * since. It stops when the heap is full rather than evicting anything
+ * newer.
+ */
+static void _history_load(void)
+{
+    MessageHistoryHeader hdr;
+    struct file file;
+    struct fd fd;
+
+    if (_history_loaded)
+        return;
+
+    xSemaphoreTake(_store_mutex, portMAX_DELAY);
+    if (_history_loaded)
+    {
+        xSemaphoreGive(_store_mutex);
+        return;
+    }
+    _history_loaded = true;
+    xSemaphoreGive(_store_mutex);
+
+    if (fs_find_file(&file, MSG_HISTORY_FILE) < 0)
+        return;
+    fs_open(&fd, &file);
+    if (fs_read(&fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != MSG_HISTORY_MAGIC)
+        return;
+
+    uint16_t loaded = 0;
+    for (uint16_t i = 0; i < hdr.count; i++)
+    {
+        uint16_t len;
+        if (fs_read(&fd, &len, sizeof(len)) != sizeof(len) || len < sizeof(cmd_phone_notify_t))
+            break;
+
+        uint8_t *pkt = noty_calloc(1, len);
+        if (!pkt)
+            break;
+        full_msg_t *msg = NULL;
+        if (fs_read(&fd, pkt, len) == len)
+            notification_packet_push(pkt, &msg);
+        noty_free(pkt);
+        if (!msg)
+            break;
+
+        /* each older than the last */
+        xSemaphoreTake(_store_mutex, portMAX_DELAY);
+        _message_insert(msg, false);
+        xSemaphoreGive(_store_mutex);
+        loaded++;
+    }
+
+    SYS_LOG("NOTYM", APP_LOG_LEVEL_INFO, "%d messages from history", loaded);
+}
+
+/* All of it, over what was there. Locked */
+static void _history_save(void)
+{
+    MessageHistoryHeader hdr = {
+        .magic = MSG_HISTORY_MAGIC,
+        .count = list_count(&_messages_head),
+    };
+    size_t size = sizeof(hdr);
+    full_msg_t *msg;
+    struct fd fd;
+
+    list_foreach(msg, &_messages_head, full_msg_t, node)
+        size += sizeof(uint16_t) + msg->raw_len;
+
+    if (fs_creat(&fd, MSG_HISTORY_FILE, size) < 0)
+        return;
+    if (fs_write(&fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+        goto fail;
+
+    list_foreach(msg, &_messages_head, full_msg_t, node)
+    {
+        if (fs_write(&fd, &msg->raw_len, sizeof(uint16_t)) != sizeof(uint16_t) ||
+            fs_write(&fd, msg->raw, msg->raw_len) != msg->raw_len)
+            goto fail;
+    }
+
+    if (fs_commit(&fd) == 0)
+        return;
+fail:
+    fs_delete(&fd.file);
+}
+
+#else
+
+static void _history_load(void)
+{
+}
 
-    return count;
+static void _history_save(void)
+{
 }
 
+#endif
+
 void *noty_calloc(size_t count, size_t size)
 {
     /* uses a special qarena */
+    xSemaphoreTake(_heap_mutex, portMAX_DELAY);
     void *x = qalloc(_notification_arena, count * size);
+    xSemaphoreGive(_heap_mutex);
     if (x != NULL)
         memset(x, 0, count * size);
     return x;
@@ -94,6 +346,7 @@ void *noty_calloc(size_t count, size_t size)
 
 void noty_free(void *mem)
 {
+    xSemaphoreTake(_heap_mutex, portMAX_DELAY);
     qfree(_notification_arena, mem);
+    xSemaphoreGive(_heap_mutex);
 }
-
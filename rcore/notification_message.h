@@ -35,8 +35,41 @@ void noty_free(void *mem);
 uint16_t message_count(void);
 
 /**
- * @brief Add \ref full_msg_t message to the message stack
+ * @brief Add \ref full_msg_t message to the message stack. One with the
+ * same id as a message we have replaces it, and if the store is full the
+ * oldest message goes
  * 
  * @param full_msg_t the pebble message to add
  */
 void message_add(full_msg_t *msg);
+
+/**
+ * @brief Drop the oldest message no one is showing, to make room
+ * 
+ * @return false if there wasn't one
+ */
+bool message_evict_oldest(void);
+
+/**
+ * @brief Keep a message, and the strings got from it, while it is shown.
+ * It may leave the store meanwhile, but isn't freed until released
+ * 
+ * @param msg the message being shown
+ */
+void message_hold(full_msg_t *msg);
+
+/**
+ * @brief \ref message_hold the newest messages, up to max of them
+ * 
+ * @param msgs where to put them, newest first
+ * @param max room in msgs
+ * @return how many were held
+ */
+uint16_t message_hold_all(full_msg_t **msgs, uint16_t max);
+
+/**
+ * @brief Done showing a message
+ * 
+ * @param msg a message from \ref message_hold
+ */
+void message_release(full_msg_t *msg);
@@ -8,6 +8,15 @@
 #include "ngfxwrap.h"
 #include "overlay_manager.h"
 #include "ngfxwrap.h"
+#include "utils.h"
+#include "watchdog.h"
+#include "input_latency.h"
+
+/* Keep a copy of the last app frame without any overlays on it. When only an
+ * overlay changes (a timer ticking an animation along, say) we put the copy
+ * back and paint the overlays over it, rather than asking the app to redraw.
+ * Costs a framebuffer of RAM; comment out to always redraw the app */
+#define OVERLAY_FRAME_CACHE
 
 /* A message to talk to the overlay thread */
 typedef struct OverlayMessage {
@@ -25,13 +34,34 @@ static xQueueHandle _overlay_queue;
 static void _overlay_thread(void *pvParameters);
 static list_head _overlay_window_list_head = LIST_HEAD(_overlay_window_list_head);
 static void _overlay_window_draw(bool window_is_dirty);
+static void _overlay_window_paint(void);
+static void _overlay_window_redraw(void);
 static void _overlay_window_create(OverlayCreateCallback create_callback, void *context);
 static void _overlay_window_destroy(OverlayWindow *overlay_window, bool animated);
 
+/* How long the app waits for us to paint over its frame. Past that its
+ * frame goes out without us, better than the app hanging on us */
+#define OVERLAY_DRAW_DEADLINE pdMS_TO_TICKS(100)
+
+/* Busy this long without getting back to the queue and we have hung */
+#define OVERLAY_STALL_MS 5000
+
 /* Semaphore to start drawing */
 static SemaphoreHandle_t _ovl_done_sem;
 static StaticSemaphore_t _ovl_done_sem_buf;
 
+#ifdef OVERLAY_FRAME_CACHE
+static uint8_t _app_frame[MAX_FRAMEBUFFER_SIZE] __attribute__((aligned(4)));
+/* _app_frame holds what the app last drew */
+static bool _app_frame_valid;
+/* the framebuffer has overlay pixels on it, so isn't just the app */
+static bool _overlay_painted;
+#endif
+/* screen area the overlays covered when last painted */
+static GRect _overlay_drawn_rect;
+/* ...and that plus where they were the time before, which is what needs pushing */
+static GRect _overlay_region;
+
 uint8_t overlay_window_init(void)
 {   
     _ovl_done_sem = xSemaphoreCreateBinaryStatic(&_ovl_done_sem_buf);
@@ -80,13 +110,57 @@ void overlay_window_draw(bool window_is_dirty)
     OverlayMessage om = (OverlayMessage) {
         .command = OVERLAY_DRAW,
         .data = (void *)window_is_dirty,
-    };    
-    xQueueSendToBack(_overlay_queue, &om, 1000);
+    };
+    TickType_t deadline = xTaskGetTickCount() + OVERLAY_DRAW_DEADLINE;
+    
+    /* a paint that came in after we last gave up */
+    xSemaphoreTake(_ovl_done_sem, 0);
     
-    xSemaphoreTake(_ovl_done_sem, portMAX_DELAY);
+    if (!xQueueSendToBack(_overlay_queue, &om, OVERLAY_DRAW_DEADLINE) ||
+        !xSemaphoreTake(_ovl_done_sem, deadline - xTaskGetTickCount()))
+        SYS_LOG("overlay", APP_LOG_LEVEL_WARNING, "Overlay missed its draw deadline");
 }
 
 
+/*
+ * The app is about to draw. The app only repaints what it damaged, so
+ * it needs the framebuffer to hold its own last frame, not our overlays.
+ */
+void overlay_window_app_draw_begin(void)
+{
+#ifdef OVERLAY_FRAME_CACHE
+    if (_overlay_painted && _app_frame_valid)
+        memcpy(display_get_buffer(), _app_frame, sizeof(_app_frame));
+    _overlay_painted = false;
+    _app_frame_valid = false;
+#endif
+}
+
+/*
+ * The app has finished drawing and overlays are about to go on top.
+ * Remember what it looked like underneath.
+ */
+void overlay_window_app_draw_end(void)
+{
+#ifdef OVERLAY_FRAME_CACHE
+    memcpy(_app_frame, display_get_buffer(), sizeof(_app_frame));
+    _app_frame_valid = true;
+#endif
+}
+
+/*
+ * The screen area that has to be pushed out after the overlays are painted.
+ * That is where they are now plus wherever they were last time.
+ */
+GRect overlay_window_get_drawn_rect(void)
+{
+#ifdef OVERLAY_FRAME_CACHE
+    if (!RECT_EMPTY(_overlay_region))
+        return _overlay_region;
+#endif
+    return GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+}
+
 void overlay_window_destroy(OverlayWindow *overlay_window)
 {
     OverlayMessage om = (OverlayMessage) {
@@ -128,17 +202,7 @@ list_head *overlay_window_get_list_head(void)
 
 uint8_t overlay_window_count(void)
 {   
-    uint16_t count = 0;
-
-    if (list_get_head(&_overlay_window_list_head) == NULL)
-        return 0;
-
-    OverlayWindow *w;
-    list_foreach(w, &_overlay_window_list_head, OverlayWindow, node)
-    {
-        count++;
-    }
-    return count;
+    return list_count(&_overlay_window_list_head);
 }
 
 void overlay_window_stack_push(OverlayWindow *overlay_window, bool animated)
@@ -255,14 +319,24 @@ static void _overlay_window_destroy(OverlayWindow *overlay_window, bool animated
 
 static void _overlay_window_draw(bool window_is_dirty)
 {
-    app_running_thread *appthread = appmanager_get_thread(AppThreadMainApp);
-    
     if (appmanager_get_thread_type() != AppThreadOverlay)
     {
         SYS_LOG("ov win", APP_LOG_LEVEL_ERROR, "Someone not overlay thread is trying to draw. Tsk.");
         return;
     }
+    _overlay_window_paint();
+#ifdef OVERLAY_FRAME_CACHE
+    _overlay_painted = true;
+#endif
+    
+    xSemaphoreGive(_ovl_done_sem);     
+}
+
+static void _overlay_window_paint(void)
+{
     OverlayWindow *ow;
+    GRect drawn = GRect(0, 0, 0, 0);
+    
     list_foreach(ow, &_overlay_window_list_head, OverlayWindow, node)
     {
         Window *window = &ow->window;
@@ -270,12 +344,40 @@ static void _overlay_window_draw(bool window_is_dirty)
         /* we would normally check render scheduled here, but if
          * the main app has forced a redraw, then we have to do painting
          * regardless. So we paint. */
+        window->dirty_rect = GRect(0, 0, 0, 0);
         rbl_window_draw(window);
         
         window->is_render_scheduled = false;
+        drawn = rect_union(drawn, window->frame);
     }
-    
-    xSemaphoreGive(_ovl_done_sem);     
+
+    _overlay_region = rect_union(_overlay_drawn_rect, drawn);
+    _overlay_drawn_rect = drawn;
+}
+
+/*
+ * Something in an overlay changed, but the app didn't.
+ * If we have the app's last frame, paint over a copy of it and only push
+ * out the overlays. Otherwise the app has to redraw and we go on top.
+ */
+static void _overlay_window_redraw(void)
+{
+#ifdef OVERLAY_FRAME_CACHE
+    /* Only try for the lock. The app may hold it waiting on us to paint,
+     * which we wouldn't get round to if we blocked here.
+     * The framebuffer can't change under a frame that is going out */
+    if (_app_frame_valid && !display_is_busy() && display_buffer_lock_take(0))
+    {
+        memcpy(display_get_buffer(), _app_frame, sizeof(_app_frame));
+        _overlay_window_paint();
+        _overlay_painted = true;
+
+        display_draw_region(overlay_window_get_drawn_rect());
+        display_buffer_lock_give();
+        return;
+    }
+#endif
+    appmanager_post_draw_message(1);
 }
 
 static void _overlay_thread(void *pvParameters)
@@ -288,7 +390,8 @@ static void _overlay_thread(void *pvParameters)
     rwatch_neographics_init(_this_thread);
   
     _this_thread->status = AppThreadLoaded;
-    os_module_init_complete(0);
+    os_module_init_complete(OsModuleOverlay, INIT_RESP_OK);
+    uint8_t heartbeat = rcore_watchdog_heartbeat_register(OVERLAY_STALL_MS);
     
     while(1)
     {
@@ -297,16 +400,19 @@ static void _overlay_thread(void *pvParameters)
         if(next_timer == 0) 
         {
             appmanager_timer_expired(_this_thread);
-            /* When we need to update draw, we post it to the main app. This way
-             * we guarantee the background is drawn first.
+            /* The app's last frame is the background. If we don't have it, we
+             * post a draw to the main app so the background is drawn first.
              * App thread will then defer back to this thread to draw any overlays */
-            appmanager_post_draw_message(1);
+            _overlay_window_redraw();
             next_timer = appmanager_timer_get_next_expiry(_this_thread);
         }
         if (next_timer < 0)
             next_timer = portMAX_DELAY;
 
-        if (xQueueReceive(_overlay_queue, &data, next_timer))
+        rcore_watchdog_heartbeat_idle(heartbeat);
+        BaseType_t got = xQueueReceive(_overlay_queue, &data, next_timer);
+        rcore_watchdog_heartbeat_busy(heartbeat);
+        if (got)
         {
             switch(data.command)
             {
@@ -328,7 +434,9 @@ static void _overlay_thread(void *pvParameters)
                     assert(data.data && "You MUST provide a valid button message");
                     /* execute the button's callback */
                     ButtonMessage *message = (ButtonMessage *)data.data;
+                    input_latency_hop(InputHopHandler);
                     ((ClickHandler)(message->callback))((ClickRecognizerRef)(message->clickref), message->context);
+                    input_latency_hop(InputHopHandled);
                     break;
                 default:
                     assert(!"I don't know this command!");
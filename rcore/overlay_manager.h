@@ -86,6 +86,18 @@ void overlay_window_create_with_context(OverlayCreateCallback creation_callback,
  */
 void overlay_window_draw(bool window_is_dirty);
 
+/* Internal. Called by the app thread either side of it drawing its window */
+void overlay_window_app_draw_begin(void);
+void overlay_window_app_draw_end(void);
+
+/**
+ * @brief Get the area of the screen the overlays need pushing out
+ * 
+ * This is where they are now, and where they were last drawn
+ * @return GRect in screen coordinates. Full screen if we can't tell
+ */
+GRect overlay_window_get_drawn_rect(void);
+
 /**
  * @brief Clean up an \ref OverlayWindow.
  * 
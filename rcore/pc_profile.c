@@ -0,0 +1,186 @@
+/* pc_profile.c
+ * A sampling profiler: where the time goes, by address and by task
+ * RebbleOS
+ *
+ * A timer a few thousand times a second notes the PC it interrupted (see
+ * hw/drivers/stm32_pc_sample) in a histogram over .text, and which task
+ * was running, or that it was a handler. Nothing is instrumented, so it
+ * costs the same wherever the time is going, and it sees the inside of
+ * critical sections and kernel-masked handlers too.
+ *
+ * The dump logs the totals, the tasks by name, and the buckets that got
+ * any samples, a few per line. Utilities/pcprofile.py takes that and the
+ * ELF and gives a flat profile by function.
+ */
+
+#include "rebbleos.h"
+#include "pc_profile.h"
+#include "stm32_pc_sample.h"
+#include "watchdog.h"
+#include "endpoint.h"
+
+#ifdef PC_PROFILE
+
+#define PC_PROFILE_PER_LINE 8
+
+extern uint32_t _stext;
+extern uint32_t _etext;
+
+typedef struct PcProfileTask {
+    TaskHandle_t task;
+    uint32_t samples;
+} PcProfileTask;
+
+/* only for debugging, so it can have CCRAM; the sampler is the CPU */
+static CCRAM uint16_t _buckets[PC_PROFILE_BUCKETS];
+static PcProfileTask _tasks[PC_PROFILE_TASKS];
+static uint32_t _samples;
+static uint32_t _isr;
+static uint32_t _outside;    /* not in .text: RAM, or the bootloader */
+static uint32_t _saturated;  /* buckets that were full */
+static uint32_t _untasked;   /* tasks past PC_PROFILE_TASKS */
+static uint32_t _base;
+static uint8_t _shift;
+static uint32_t _hz;
+static bool _running;
+
+/*
+ * From the sampler, above the kernel. Nothing here may take a critical
+ * section; reading the current task handle doesn't
+ */
+static void _sample(uint32_t pc, uint8_t in_isr)
+{
+    _samples++;
+
+    uint32_t b = (pc - _base) >> _shift;
+    if (pc < _base || b >= PC_PROFILE_BUCKETS)
+        _outside++;
+    else if (_buckets[b] == UINT16_MAX)
+        _saturated++;
+    else
+        _buckets[b]++;
+
+    if (in_isr)
+    {
+        _isr++;
+        return;
+    }
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < PC_PROFILE_TASKS; i++)
+    {
+        if (_tasks[i].task == task || !_tasks[i].task)
+        {
+            _tasks[i].task = task;
+            _tasks[i].samples++;
+            return;
+        }
+    }
+    _untasked++;
+}
+
+/* Clear the counts and sample from now on */
+void pc_profile_start(uint32_t hz)
+{
+    uint32_t len = (uint32_t)&_etext - (uint32_t)&_stext;
+
+    pc_profile_stop();
+
+    if (!hz)
+        hz = PC_PROFILE_HZ;
+    if (hz > PC_PROFILE_HZ_MAX)
+        hz = PC_PROFILE_HZ_MAX;
+
+    _base = (uint32_t)&_stext;
+    _shift = 2;
+    while ((len >> _shift) >= PC_PROFILE_BUCKETS)
+        _shift++;
+
+    memset(_buckets, 0, sizeof(_buckets));
+    memset(_tasks, 0, sizeof(_tasks));
+    _samples = _isr = _outside = _saturated = _untasked = 0;
+    _hz = hz;
+    _running = true;
+
+    hw_pc_sample_start(hz, _sample);
+}
+
+void pc_profile_stop(void)
+{
+    if (!_running)
+        return;
+    hw_pc_sample_stop();
+    _running = false;
+}
+
+static const char *_task_name(TaskHandle_t task, const TaskStatus_t *tasks, UBaseType_t ntasks)
+{
+    for (UBaseType_t i = 0; i < ntasks; i++)
+        if (tasks[i].xHandle == task)
+            return tasks[i].pcTaskName;
+    return "(gone)";
+}
+
+/*
+ * Stop, and log what we have. The counts stay until the next start
+ */
+void pc_profile_dump(void)
+{
+    static TaskStatus_t tasks[STACK_STATS_MAX];
+    char line[PC_PROFILE_PER_LINE * 14 + 1];
+
+    pc_profile_stop();
+
+    UBaseType_t ntasks = uxTaskGetSystemState(tasks, STACK_STATS_MAX, NULL);
+
+    SYS_LOG("pcprof", APP_LOG_LEVEL_INFO, "pcprofile %lu samples at %lu Hz, base 0x%lx shift %d, isr %lu, outside %lu, saturated %lu, untasked %lu",
+            _samples, _hz, _base, _shift, _isr, _outside, _saturated, _untasked);
+    for (int i = 0; i < PC_PROFILE_TASKS && _tasks[i].task; i++)
+        SYS_LOG("pcprof", APP_LOG_LEVEL_INFO, "pctask %lu %s",
+                _tasks[i].samples, _task_name(_tasks[i].task, tasks, ntasks));
+
+    int n = 0, at = 0;
+    for (uint32_t b = 0; b < PC_PROFILE_BUCKETS; b++)
+    {
+        if (!_buckets[b])
+            continue;
+        at += snprintf(line + at, sizeof(line) - at, " %lx:%u", b, _buckets[b]);
+        if (++n == PC_PROFILE_PER_LINE)
+        {
+            SYS_LOG("pcprof", APP_LOG_LEVEL_INFO, "pcbucket%s", line);
+            n = at = 0;
+        }
+    }
+    if (n)
+        SYS_LOG("pcprof", APP_LOG_LEVEL_INFO, "pcbucket%s", line);
+}
+
+#else
+
+void pc_profile_start(uint32_t hz)
+{
+    SYS_LOG("pcprof", APP_LOG_LEVEL_INFO, "built without PC_PROFILE");
+}
+
+void pc_profile_stop(void)
+{
+}
+
+void pc_profile_dump(void)
+{
+    SYS_LOG("pcprof", APP_LOG_LEVEL_INFO, "built without PC_PROFILE");
+}
+
+#endif
+
+/*
+ * Debug endpoint. PcProfileStart and a rate to start over, anything else
+ * stops and dumps to the log
+ */
+void process_pc_profile_packet(uint8_t *data, uint16_t len)
+{
+    if (len >= 1 && data[0] == PcProfileStart)
+        pc_profile_start(len >= 3 ? data[1] | (data[2] << 8) : 0);
+    else
+        pc_profile_dump();
+}
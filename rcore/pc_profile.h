@@ -0,0 +1,31 @@
+#pragma once
+/* pc_profile.h
+ * A sampling profiler: where the time goes, by address and by task
+ * RebbleOS
+ *
+ * Built in with PC_PROFILE=1 on the make line; see
+ * Utilities/pcprofile.py for reading a dump
+ */
+
+#include <stdint.h>
+
+/* the rate when the packet doesn't name one. Much over 5kHz and the
+ * profiler is what gets profiled */
+#define PC_PROFILE_HZ 2000
+#define PC_PROFILE_HZ_MAX 5000
+
+/* The histogram covers .text, _stext to _etext, in this many buckets of
+ * the smallest power of two that spans it */
+#define PC_PROFILE_BUCKETS 4096
+#define PC_PROFILE_TASKS 24
+
+/* command byte of the debug endpoint's packet */
+enum {
+    PcProfileStopAndDump = 0,
+    PcProfileStart,          /* then the rate in Hz, u16 LE, or none */
+};
+
+void pc_profile_start(uint32_t hz);
+void pc_profile_stop(void);
+void pc_profile_dump(void);
+void process_pc_profile_packet(uint8_t *data, uint16_t len);
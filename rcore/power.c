@@ -14,10 +14,18 @@ static uint8_t _charge_mode_prev = 0;
 static uint8_t _charge_mode = 0;
 static uint16_t _bat_voltage = 0;
 static uint8_t _bat_pct = 0;
+static bool _saving = false;
+
+/* The PMIC's status changed. The OS thread reads it, I2C is no place for an ISR */
+static void _power_isr(void)
+{
+    send_os_msg(NULL, 0);
+}
 
 void power_init()
 {
     hw_power_init();
+    hw_power_set_isr(_power_isr);
     power_update_battery();
 }
 
@@ -40,6 +48,33 @@ uint8_t power_get_battery_level(void)
     return _bat_pct;
 }
 
+bool power_is_saving(void)
+{
+    return _saving;
+}
+
+/* Go into or out of saving power. True if it changed */
+static bool _power_saving_update(void)
+{
+    uint8_t mode = _charge_mode;
+    bool charging = mode != POWER_CHG_MODE_OFF && mode != POWER_CHG_FAULT;
+    bool saving;
+
+    if (charging)
+        saving = false;
+    else if (_saving)
+        saving = _bat_pct <= POWER_SAVING_EXIT_PERCENT;
+    else
+        saving = _bat_pct <= POWER_SAVING_PERCENT;
+
+    if (saving == _saving)
+        return false;
+
+    _saving = saving;
+    SYS_LOG("PWR", APP_LOG_LEVEL_INFO, "Power saving %s at %d%%", saving ? "on" : "off", _bat_pct);
+    return true;
+}
+
 void power_update_charge_mode(void)
 {
     uint8_t mode = hw_power_get_chg_status();
@@ -48,6 +83,7 @@ void power_update_charge_mode(void)
 
     _charge_mode_prev = mode;
     _charge_mode = mode;
+    _power_saving_update();
     
     /* Show the popup as something changed */
     notification_show_battery(5000);
@@ -61,9 +97,16 @@ void power_update_battery(void)
     _bat_pct = map_range(_bat_voltage, 2600, 3500, 0, 100);
     SYS_LOG("PWR", APP_LOG_LEVEL_INFO, "VBAT %ldmV %d%%", _bat_voltage, _bat_pct);
     
+    /* apps find out through their battery handler */
+    bool changed = _power_saving_update();
+    
     /* battery low */
     if (_bat_pct > 20)
+    {
+        if (changed)
+            battery_state_service_state_change();
         return;
+    }
     
     battery_state_service_state_change();
     
@@ -6,6 +6,7 @@
  * Author: Barry Carter <barry.carter@gmail.com>
  */
 
+#include <stdbool.h>
 #include "FreeRTOS.h"
 
 /**
@@ -59,3 +60,16 @@ void power_update_charge_mode(void);
  * @brief Get the value of the battery
  */
 void power_update_battery(void);
+
+/* Below this charge, and not charging, the watch saves power: animations
+ * and app frames come slower, windows switch without a slide, the
+ * backlight goes out sooner and second ticks come once a minute. It ends
+ * once the charge is back above the exit level, or a charger goes on */
+#define POWER_SAVING_PERCENT      10
+#define POWER_SAVING_EXIT_PERCENT 15
+
+/**
+ * @brief Whether the battery is low enough to be saving power
+ * Apps hear of it changing through the battery state service
+ */
+bool power_is_saving(void);
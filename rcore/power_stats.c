@@ -0,0 +1,131 @@
+/* power_stats.c
+ * How long each peripheral clock was on
+ * RebbleOS
+ *
+ * stm32_power sees every clock go on and off, and adds up the time each
+ * was on. Here that becomes a report over a window, from boot or the
+ * last reset: each clock's time on, the same scaled to a minute, and how
+ * many times it was asked for. With what cpu_stats says about the CPU,
+ * that is most of what a watchface costs in battery.
+ *
+ * DMA is clocked per controller, not per stream, so DMA1 and DMA2 are
+ * each every stream on them.
+ */
+
+#include "rebbleos.h"
+#include "power_stats.h"
+#include "stm32_power.h"
+#include "endpoint.h"
+
+static const char *const _reg_names[] = {
+#define MK_NAME(n, b) #n,
+    STM32_POWER_EXPANDO(MK_NAME)
+#undef MK_NAME
+};
+
+static TickType_t _window_start;
+
+/*
+ * Copy out the clocks that were on or asked for in the window, the
+ * longest on first. Returns how many; window_ms may be NULL
+ */
+uint8_t power_stats_get(PowerStats *stats, uint8_t max, uint32_t *window_ms)
+{
+    uint8_t count = 0;
+
+    for (int reg = 0; reg < STM32_POWER_MAX; reg++)
+    {
+        for (int bit = 0; bit < 32; bit++)
+        {
+            uint64_t cycles;
+            uint32_t requests;
+            const char *name;
+
+            if (!stm32_power_residency(reg, bit, &cycles, &requests, &name))
+                break;
+            if (!cycles && !requests)
+                continue;
+
+            PowerStats st = {
+                .reg = reg,
+                .bit = bit,
+                .on_ms = cycles / (hw_cycles_per_us() * 1000),
+                .requests = requests,
+            };
+
+            /* insertion sort; there are only a few dozen */
+            int i = count < max ? count++ : max;
+            while (i > 0 && stats[i - 1].on_ms < st.on_ms)
+            {
+                if (i < max)
+                    stats[i] = stats[i - 1];
+                i--;
+            }
+            if (i < max)
+                stats[i] = st;
+        }
+    }
+
+    if (window_ms)
+        *window_ms = (xTaskGetTickCount() - _window_start) * portTICK_PERIOD_MS;
+
+    return count;
+}
+
+/* Start a new window */
+void power_stats_reset(void)
+{
+    stm32_power_residency_reset();
+    _window_start = xTaskGetTickCount();
+}
+
+typedef struct __attribute__((__packed__)) PowerStatsPacket {
+    uint32_t window_ms;
+    uint8_t count;
+    PowerStats clock[POWER_STATS_MAX];
+} PowerStatsPacket;
+
+/* too big for the callers' stacks */
+static PowerStatsPacket _pkt;
+
+/*
+ * Log each clock's share of the window
+ */
+void power_stats_dump(void)
+{
+    memset(&_pkt, 0, sizeof(_pkt));
+    _pkt.count = power_stats_get(_pkt.clock, POWER_STATS_MAX, &_pkt.window_ms);
+
+    SYS_LOG("power", APP_LOG_LEVEL_INFO, "clocks over the last %lu ms", _pkt.window_ms);
+    for (uint8_t i = 0; i < _pkt.count; i++)
+    {
+        PowerStats *st = &_pkt.clock[i];
+        uint64_t cycles;
+        uint32_t requests;
+        const char *name;
+        char bit_name[12];
+
+        stm32_power_residency(st->reg, st->bit, &cycles, &requests, &name);
+        if (!name)
+        {
+            snprintf(bit_name, sizeof(bit_name), "%s.%d", _reg_names[st->reg], st->bit);
+            name = bit_name;
+        }
+        SYS_LOG("power", APP_LOG_LEVEL_INFO, "%s: %lu ms on, %lu ms a minute, %lu requests",
+                name, st->on_ms,
+                _pkt.window_ms ? (uint32_t)((uint64_t)st->on_ms * 60000 / _pkt.window_ms) : 0,
+                st->requests);
+    }
+}
+
+/*
+ * Debug endpoint. The stats are logged and sent back raw, and with
+ * PowerStatsDumpAndReset a new window starts
+ */
+void process_power_stats_packet(uint8_t *data, uint16_t len)
+{
+    power_stats_dump();
+    bluetooth_send_packet(ENDPOINT_POWER_STATS, (uint8_t *)&_pkt, sizeof(_pkt));
+    if (len >= 1 && data[0] == PowerStatsDumpAndReset)
+        power_stats_reset();
+}
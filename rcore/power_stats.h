@@ -0,0 +1,30 @@
+#pragma once
+/* power_stats.h
+ * How long each peripheral clock was on
+ * RebbleOS
+ */
+
+#include <stdint.h>
+
+/* most clocks reported, the ones that were on at all */
+#define POWER_STATS_MAX 48
+
+/* One clock over the window. reg is an stm32_power_register_t, bit the
+ * clock's bit in it */
+typedef struct __attribute__((__packed__)) PowerStats {
+    uint8_t reg;
+    uint8_t bit;
+    uint32_t on_ms;
+    uint32_t requests;
+} PowerStats;
+
+/* command byte of the debug endpoint's packet */
+enum {
+    PowerStatsDump = 0,
+    PowerStatsDumpAndReset,  /* and start a new window, say for the next watchface */
+};
+
+uint8_t power_stats_get(PowerStats *stats, uint8_t max, uint32_t *window_ms);
+void power_stats_reset(void);
+void power_stats_dump(void);
+void process_power_stats_packet(uint8_t *data, uint16_t len);
@@ -0,0 +1,157 @@
+/* endpoint.c
+ * Which handler gets each incoming packet, and where it runs
+ * RebbleOS
+ *
+ * Every endpoint we answer is a row in _endpoints: its id, the most
+ * payload it will take, and whether it runs inline on the BT cmd thread
+ * or deferred. Inline is for the handful of bytes a version or time
+ * request is. Anything that parses at length, opens windows or logs a
+ * lot is deferred: the payload is copied off the RX buffer and handed to
+ * the endpoint thread, and the cmd thread goes straight back to RX and
+ * TX. A deferred handler may bluetooth_send as normal.
+ */
+
+#include "rebbleos.h"
+#include "endpoint.h"
+#include "protocol_system.h"
+#include "protocol_notification.h"
+#include "protocol_putbytes.h"
+#include "protocol_screenshot.h"
+#include "frame_profile.h"
+#include "boot_profile.h"
+#include "cpu_stats.h"
+#include "power_stats.h"
+#include "sched_trace.h"
+#include "pc_profile.h"
+#include "input_latency.h"
+#include "crash_dump.h"
+#include "app_message.h"
+#include "data_logging.h"
+#include "blobdb.h"
+
+#define STACK_SZ_ENDPOINT configMINIMAL_STACK_SIZE + 600
+
+/* deferred packets waiting for the thread. More than this and they drop */
+#define ENDPOINT_QUEUE_LENGTH 4
+
+static const Endpoint _endpoints[] = {
+    { ENDPOINT_FIRMWARE_VERSION, 16,   EndpointInline,   process_version_packet },
+    { ENDPOINT_SET_TIME,         64,   EndpointInline,   process_set_time_packet },
+    { ENDPOINT_APP_MESSAGE,      APP_MESSAGE_PACKET_MAX, EndpointDeferred, process_app_message_packet },
+    { ENDPOINT_PHONE_MSG,        2048, EndpointDeferred, process_notification_packet },
+    { ENDPOINT_DATA_LOGGING,     64,   EndpointInline,   process_data_logging_packet },
+    { ENDPOINT_SCREENSHOT,       16,   EndpointDeferred, process_screenshot_packet },
+    { ENDPOINT_PUTBYTES,         2048, EndpointDeferred, process_putbytes_packet },
+    { ENDPOINT_BLOBDB,           2048, EndpointDeferred, process_blobdb_packet },
+    { ENDPOINT_FRAME_PROFILE,    16,   EndpointDeferred, process_frame_profile_packet },
+    { ENDPOINT_MEMORY_STATS,     16,   EndpointDeferred, process_memory_stats_packet },
+    { ENDPOINT_HEAP_SNAPSHOT,    16,   EndpointDeferred, process_heap_snapshot_packet },
+    { ENDPOINT_CRASH_DUMP,       16,   EndpointDeferred, process_crash_dump_packet },
+    { ENDPOINT_BOOT_PROFILE,     16,   EndpointDeferred, process_boot_profile_packet },
+    { ENDPOINT_CPU_STATS,        16,   EndpointDeferred, process_cpu_stats_packet },
+    { ENDPOINT_POWER_STATS,      16,   EndpointDeferred, process_power_stats_packet },
+    { ENDPOINT_SCHED_TRACE,      16,   EndpointDeferred, process_sched_trace_packet },
+    { ENDPOINT_PC_PROFILE,       16,   EndpointDeferred, process_pc_profile_packet },
+    { ENDPOINT_INPUT_LATENCY,    16,   EndpointDeferred, process_input_latency_packet },
+    { ENDPOINT_BT_STATS,         16,   EndpointDeferred, process_bt_stats_packet },
+    { ENDPOINT_LOG_STREAM,       16,   EndpointDeferred, process_log_stream_packet },
+};
+
+#define ENDPOINT_COUNT (sizeof(_endpoints) / sizeof(_endpoints[0]))
+
+typedef struct EndpointWork {
+    const Endpoint *endpoint;
+    uint8_t *data;
+    uint16_t len;
+} EndpointWork;
+
+static TaskHandle_t _endpoint_task;
+static StackType_t _endpoint_task_stack[STACK_SZ_ENDPOINT];
+static StaticTask_t _endpoint_task_buf;
+
+static QueueHandle_t _endpoint_queue;
+static StaticQueue_t _endpoint_queue_buf;
+static uint8_t _endpoint_queue_storage[ENDPOINT_QUEUE_LENGTH * sizeof(EndpointWork)];
+
+static void _endpoint_thread(void *pvParameters);
+
+void endpoint_init(void)
+{
+    _endpoint_queue = xQueueCreateStatic(ENDPOINT_QUEUE_LENGTH, sizeof(EndpointWork),
+                                         _endpoint_queue_storage, &_endpoint_queue_buf);
+    _endpoint_task = xTaskCreateStatic(_endpoint_thread,
+                                       "Endpt", STACK_SZ_ENDPOINT, NULL,
+                                       tskIDLE_PRIORITY + 2UL,
+                                       _endpoint_task_stack, &_endpoint_task_buf);
+}
+
+static const Endpoint *_endpoint_find(uint16_t endpoint)
+{
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++)
+        if (_endpoints[i].endpoint == endpoint)
+            return &_endpoints[i];
+
+    return NULL;
+}
+
+/*
+ * A whole packet, on the BT cmd thread. data is only good until we
+ * return
+ */
+void endpoint_dispatch(uint16_t endpoint, uint8_t *data, uint16_t len)
+{
+    const Endpoint *ep = _endpoint_find(endpoint);
+    EndpointWork work;
+
+    if (!ep)
+    {
+        SYS_LOG("endpt", APP_LOG_LEVEL_DEBUG, "Unimplemented endpoint 0x%x", endpoint);
+        return;
+    }
+
+    if (len > ep->max_payload)
+    {
+        SYS_LOG("endpt", APP_LOG_LEVEL_ERROR, "0x%x: payload %d > %d. Dropped",
+                endpoint, len, ep->max_payload);
+        return;
+    }
+
+    if (ep->run == EndpointInline)
+    {
+        ep->handler(data, len);
+        return;
+    }
+
+    /* a byte over, so a handler walking strings off the end finds a 0 */
+    work.endpoint = ep;
+    work.len = len;
+    work.data = system_calloc(1, len + 1);
+    if (!work.data)
+    {
+        SYS_LOG("endpt", APP_LOG_LEVEL_ERROR, "0x%x: no memory for %d. Dropped",
+                endpoint, len);
+        return;
+    }
+    memcpy(work.data, data, len);
+
+    /* never hold up RX for a slow handler */
+    if (!xQueueSendToBack(_endpoint_queue, &work, 0))
+    {
+        SYS_LOG("endpt", APP_LOG_LEVEL_ERROR, "0x%x: endpoint thread busy. Dropped", endpoint);
+        system_free(work.data);
+    }
+}
+
+static void _endpoint_thread(void *pvParameters)
+{
+    EndpointWork work;
+
+    for( ;; )
+    {
+        if (!xQueueReceive(_endpoint_queue, &work, portMAX_DELAY))
+            continue;
+
+        work.endpoint->handler(work.data, work.len);
+        system_free(work.data);
+    }
+}
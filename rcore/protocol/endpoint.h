@@ -1,11 +1,62 @@
 #pragma once
+#include <stdint.h>
 
 // endpoint functions
 #define ENDPOINT_SET_TIME               0x0b
 #define ENDPOINT_FIRMWARE_VERSION       0x10
+#define ENDPOINT_APP_MESSAGE            0x30
 #define ENDPOINT_PHONE_MSG              0xbc2
+#define ENDPOINT_DATA_LOGGING           0x1a7a
+#define ENDPOINT_SCREENSHOT             0x1f40
+#define ENDPOINT_PUTBYTES               0xbeef
+#define ENDPOINT_BLOBDB                 0xb1db
+/* ours, not Pebble's. Frame timing stats, see frame_profile.c */
+#define ENDPOINT_FRAME_PROFILE          0x5250
+/* ours too. Heap stats, see rebble_memory.c */
+#define ENDPOINT_MEMORY_STATS           0x5251
+/* ours too. Boot timing, see boot_profile.c */
+#define ENDPOINT_BOOT_PROFILE           0x5252
+/* ours too. CPU use per task and app, see cpu_stats.c */
+#define ENDPOINT_CPU_STATS              0x5253
+/* ours too. Scheduler timeline to the log, see sched_trace.c */
+#define ENDPOINT_SCHED_TRACE            0x5254
+/* ours too. BT byte counts and link parameters, see bluetooth.c */
+#define ENDPOINT_BT_STATS               0x5255
+/* ours too. Binary log records, see log_binary.c */
+#define ENDPOINT_LOG_STREAM             0x5256
+/* ours too. Sampling profiler, start and dump, see pc_profile.c */
+#define ENDPOINT_PC_PROFILE             0x5257
+/* ours too. Time each peripheral clock was on, see power_stats.c */
+#define ENDPOINT_POWER_STATS            0x5258
+/* ours too. Button to handler and to photon latency, see input_latency.c */
+#define ENDPOINT_INPUT_LATENCY          0x5259
+/* ours too. Every block of a heap to the log, see rebble_memory.c */
+#define ENDPOINT_HEAP_SNAPSHOT          0x525a
+/* ours too. The record of the last crash, see crash_dump.c */
+#define ENDPOINT_CRASH_DUMP             0x525b
 
 
 
 // function parameters
 #define FIRMWARE_VERSION_GETVERSION  0
+
+/* len is the payload's, however much the packet says it carries */
+typedef void (*EndpointHandler)(uint8_t *data, uint16_t len);
+
+typedef enum EndpointRun {
+    /* right there on the BT cmd thread. Only for quick ones */
+    EndpointInline,
+    /* on a copy of the payload, on the endpoint thread, so RX carries on */
+    EndpointDeferred,
+} EndpointRun;
+
+typedef struct Endpoint {
+    uint16_t endpoint;
+    /* longer payloads are dropped before the handler sees them */
+    uint16_t max_payload;
+    EndpointRun run;
+    EndpointHandler handler;
+} Endpoint;
+
+void endpoint_init(void);
+void endpoint_dispatch(uint16_t endpoint, uint8_t *data, uint16_t len);
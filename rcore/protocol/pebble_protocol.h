@@ -1,4 +1,5 @@
 #pragma once
 #include "endpoint.h"
 #include "protocol_notification.h"
+#include "protocol_putbytes.h"
 #include "protocol_system.h"
@@ -12,130 +12,160 @@
 #include "protocol_notification.h"
 #include "notification_manager.h"
 
-static void _copy_and_null_term_string(uint8_t **dest, uint8_t *src, uint16_t len);
+static void *_msg_bump(uint8_t **top, size_t size);
+static const char *_ref_text(full_msg_t *msg, notification_ref_t *ref);
+
+/* Everything belonging to a message lives in one block off the message
+ * heap: the message, the index, then the packet itself, untouched. The
+ * strings are only copied out and terminated when something draws them,
+ * so a storm of notifications no one reads costs one copy each */
+#define MSG_ALIGN(s) (((s) + 3) & ~3)
 
 /* notification processing */
 
-void process_notification_packet(uint8_t *data)
+void process_notification_packet(uint8_t *data, uint16_t len)
 {
     full_msg_t *msg;
-    notification_packet_push(data, &msg);
+
+    /* a full store makes way for new messages */
+    for (;;)
+    {
+        notification_packet_push(data, &msg);
+        if (msg)
+            break;
+        if (!message_evict_oldest())
+        {
+            SYS_LOG("PHPKT", APP_LOG_LEVEL_ERROR, "No room for the message");
+            return;
+        }
+    }
     notification_show_message(msg, 5000);
 }
 
+/* how long the packet is, walking its headers */
+static size_t _packet_len(uint8_t *data)
+{
+    cmd_phone_notify_t *msg = (cmd_phone_notify_t *)data;
+    uint8_t *p = data + sizeof(cmd_phone_notify_t);
+
+    for (uint8_t i = 0; i < msg->attr_count; i++)
+        p += sizeof(cmd_phone_attribute_hdr_t) + ((cmd_phone_attribute_hdr_t *)p)->str_len;
+
+    for (uint8_t i = 0; i < msg->action_count; i++)
+        p += sizeof(cmd_phone_action_hdr_t) + ((cmd_phone_action_hdr_t *)p)->str_len;
+
+    return p - data;
+}
+
 void notification_packet_push(uint8_t *data, full_msg_t **message)
 {
-    full_msg_t *new_msg = *message;
-    
-    /* create a real message as we are peeking at the buffer.
-     * lets be quick about this */
+    full_msg_t *new_msg;
+    uint8_t *top;
     cmd_phone_notify_t *msg = (cmd_phone_notify_t *)data;
+    size_t len = _packet_len(data);
+    uint8_t refs = msg->attr_count + msg->action_count;
+    size_t size = MSG_ALIGN(sizeof(full_msg_t)) + MSG_ALIGN(refs * sizeof(notification_ref_t)) + len;
 
-    SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X attrc %d actc %d", msg->attr_count, msg->action_count);
-    
-    new_msg = noty_calloc(1, sizeof(full_msg_t));
-    assert(new_msg);
-    new_msg->header = noty_calloc(1, sizeof(cmd_phone_notify_t));
-    memcpy(new_msg->header, msg, sizeof(cmd_phone_notify_t));
-    list_init_head(&new_msg->attributes_list_head);
-    list_init_head(&new_msg->actions_list_head);
-    
-    /* get the attributes */
-    uint8_t *p = data + sizeof(cmd_phone_notify_t);
+    top = noty_calloc(1, size);
+    if (!top)
+    {
+        *message = NULL;
+        return;
+    }
+
+    new_msg = _msg_bump(&top, sizeof(full_msg_t));
+    new_msg->attributes = _msg_bump(&top, refs * sizeof(notification_ref_t));
+    new_msg->actions = new_msg->attributes + msg->attr_count;
+    new_msg->raw = top;
+    new_msg->raw_len = len;
+    memcpy(new_msg->raw, data, len);
+    new_msg->header = (cmd_phone_notify_t *)new_msg->raw;
+
+    /* index the strings, nothing more */
+    uint8_t *p = new_msg->raw + sizeof(cmd_phone_notify_t);
     for (uint8_t i = 0; i < msg->attr_count; i++)
     {
-        
         cmd_phone_attribute_hdr_t *att = (cmd_phone_attribute_hdr_t *)p;
-        uint8_t *data = p + sizeof(cmd_phone_attribute_hdr_t);
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X ATTR ID:%d L:%d", att->attr_idx, att->str_len);
-        cmd_phone_attribute_t *new_attr = noty_calloc(1, sizeof(cmd_phone_attribute_t));
-        /* copy the head to the new attribute */
-        memcpy(new_attr, att, sizeof(cmd_phone_attribute_hdr_t));
-        /* copy the data in now */
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X COPY");
-        /* we'll null terminate strings too as they are pascal strings and seemingly not terminated */
-        _copy_and_null_term_string(&(new_attr->data), data, att->str_len);
-       
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X NODE");
-        list_init_node(&new_attr->node);
-        list_insert_tail(&new_msg->attributes_list_head, &new_attr->node);
+        notification_ref_t *ref = &new_msg->attributes[i];
+        ref->id = att->attr_idx;
+        ref->offset = p + sizeof(cmd_phone_attribute_hdr_t) - new_msg->raw;
+        ref->len = att->str_len;
         p += sizeof(cmd_phone_attribute_hdr_t) + att->str_len;
     }
 
-    /* get the actions */
     for (uint8_t i = 0; i < msg->action_count; i++)
     {
         cmd_phone_action_hdr_t *act = (cmd_phone_action_hdr_t *)p;
-        uint8_t *data = p + sizeof(cmd_phone_action_hdr_t);
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X ACT ID:%d L:%d AID:%d ALEN:%d", act->id, act->attr_count, act->attr_id, act->str_len);
-        cmd_phone_action_t *new_act = noty_calloc(1, sizeof(cmd_phone_action_t));
-        /* copy the head to the new action */
-        memcpy(new_act, act, sizeof(cmd_phone_action_hdr_t));
-        /* copy the data in now */
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X NEW ACT ID:%d L:%d AID:%d ALEN:%d", new_act->hdr.id, new_act->hdr.attr_count, new_act->hdr.attr_id, new_act->hdr.str_len);
-
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X COPY");
-        _copy_and_null_term_string(&new_act->data, data, act->str_len);
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X NODE");
-        list_init_node(&new_act->node);
-        list_insert_tail(&new_msg->actions_list_head, &new_act->node);
-        SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X NODE ADDED");
+        notification_ref_t *ref = &new_msg->actions[i];
+        ref->id = act->id;
+        ref->offset = p + sizeof(cmd_phone_action_hdr_t) - new_msg->raw;
+        ref->len = act->str_len;
         p += sizeof(cmd_phone_action_hdr_t) + act->str_len;
     }
-    SYS_LOG("PHPKT", APP_LOG_LEVEL_INFO, "X Done");
+
+    SYS_LOG("PHPKT", APP_LOG_LEVEL_DEBUG, "attrc %d actc %d, %d bytes", msg->attr_count, msg->action_count, size);
     *message = new_msg;
 }
 
-void _full_msg_free(full_msg_t *message)
-{  
-    cmd_phone_attribute_t *m;
-    list_node *l = list_get_head(&message->attributes_list_head);
-    while(l)
-    {
-        m = list_elem(l, cmd_phone_attribute_t, node);
-        list_remove(&message->attributes_list_head, &m->node);
-        /* free the string */
-        noty_free(m->data);
-        /* free the attribute */
-        noty_free(m);
-    }
-    
-    cmd_phone_action_t *a;
-    l = list_get_head(&message->actions_list_head);
-    while(l)
-    {
-        a = list_elem(l, cmd_phone_action_t, node);
-        list_remove(&message->actions_list_head, &a->node);
-        
-        /* free the string */
-        noty_free(a->data);
-        /* free the attribute */
-        noty_free(a);
-    }
-    
-    noty_free(message->header);
-    message->header = NULL;
+const char *notification_attribute_get(full_msg_t *msg, uint8_t n)
+{
+    if (n >= msg->header->attr_count)
+        return NULL;
+
+    return _ref_text(msg, &msg->attributes[n]);
+}
+
+const char *notification_action_get(full_msg_t *msg, uint8_t n)
+{
+    if (n >= msg->header->action_count)
+        return NULL;
+
+    return _ref_text(msg, &msg->actions[n]);
+}
+
+void notification_packet_free(full_msg_t *message)
+{
+    uint8_t refs = message->header->attr_count + message->header->action_count;
+
+    /* the index and the packet live in the message's own block, only the
+     * strings that were drawn have their own */
+    for (uint8_t i = 0; i < refs; i++)
+        if (message->attributes[i].text)
+            noty_free(message->attributes[i].text);
+
     noty_free(message);
-    message = NULL;
 }
 
+static void *_msg_bump(uint8_t **top, size_t size)
+{
+    void *x = *top;
+    *top += MSG_ALIGN(size);
+    return x;
+}
 
-/* we have pesky pascal strings. Turn them into null term strings */
-static void _copy_and_null_term_string(uint8_t **dest, uint8_t *src, uint16_t len)
+/* we have pesky pascal strings. The first time one is wanted it gets a
+ * terminated copy, which stays with the message after that */
+static const char *_ref_text(full_msg_t *msg, notification_ref_t *ref)
 {
-    if (src[len - 1] != '\0')
-    {
-        *dest = noty_calloc(1, len + 1);
-        assert(*dest && "Malloc Failed!");
+    if (ref->text)
+        return ref->text;
 
-        for(uint16_t i = 0; i < len; i++)
-            *(*dest + i) = src[i];
+    char *text = noty_calloc(1, ref->len + 1);
+    if (!text)
+        return "";
 
-        *(*dest + len) = '\0';
-    }
-    else
+    memcpy(text, msg->raw + ref->offset, ref->len);
+
+    /* the overlay and the notification app can both be drawing it */
+    taskENTER_CRITICAL();
+    if (ref->text)
     {
-        *dest = noty_calloc(1, len);
-        memcpy((uint8_t *)*dest, src, len);
+        taskEXIT_CRITICAL();
+        noty_free(text);
+        return ref->text;
     }
+    ref->text = text;
+    taskEXIT_CRITICAL();
+
+    return text;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include "node_list.h"
 
 
@@ -25,13 +26,6 @@ typedef struct {
     uint16_t str_len;
 } __attribute__((__packed__)) cmd_phone_attribute_hdr_t;
 
-typedef struct {
-    cmd_phone_attribute_hdr_t hdr;
-    list_node node;
-    uint8_t *data;
-} __attribute__((__packed__)) cmd_phone_attribute_t;
-
-
 typedef struct {
     uint8_t id;
     uint8_t cmd_id;
@@ -40,25 +34,42 @@ typedef struct {
     uint16_t str_len;
 } __attribute__((__packed__)) cmd_phone_action_hdr_t;
 
+/* Where one attribute's or action's string is in the raw packet. It is
+ * a pascal string, so it only gets a terminated copy, in text, the first
+ * time someone asks for it */
 typedef struct {
-    cmd_phone_action_hdr_t hdr;
-    list_node node;
-    uint8_t *data;
-} __attribute__((__packed__)) cmd_phone_action_t;
-
-
-
-
-
+    uint8_t id;
+    uint16_t offset;
+    uint16_t len;
+    char *text;
+} notification_ref_t;
 
+/* The packet as it came, in one block with the message, and an index of
+ * its attributes then its actions */
 typedef struct full_msg {
     cmd_phone_notify_t *header;
-    list_head attributes_list_head;
-    list_head actions_list_head;
+    uint8_t *raw;
+    uint16_t raw_len;
+    notification_ref_t *attributes;
+    notification_ref_t *actions;
     list_node node;
+    uint8_t holds;   /* being shown; see message_hold */
+    bool dropped;    /* off the store, to be freed at the last release */
 } full_msg_t;
 
 
 full_msg_t *notification_get(void);
-void process_notification_packet(uint8_t *data);
+void process_notification_packet(uint8_t *data, uint16_t len);
 void notification_packet_push(uint8_t *data, full_msg_t **message);
+void notification_packet_free(full_msg_t *message);
+
+/**
+ * @brief The text of the nth attribute, decoded now if no one has asked
+ * for it before. NULL if there isn't one
+ */
+const char *notification_attribute_get(full_msg_t *msg, uint8_t n);
+
+/**
+ * @brief The text of the nth action, as notification_attribute_get
+ */
+const char *notification_action_get(full_msg_t *msg, uint8_t n);
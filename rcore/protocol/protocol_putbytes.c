@@ -0,0 +1,257 @@
+/* protocol_putbytes.c
+ * PutBytes: app and file installs from the phone, straight to flash
+ * RebbleOS
+ *
+ * An install is an init giving the size and where it goes, any number of
+ * puts, a commit with the CRC of the lot, then an install. All numbers are
+ * big endian, and each command gets an ACK or NACK with the cookie.
+ *
+ * Nothing is held in RAM past the chunk in hand: the init makes a temp
+ * file the full size, each put goes into it with fs_write, and the commit
+ * reads it back off the flash through the hardware CRC unit, so what is
+ * checked is what was written. Only if that matches does the file take
+ * its name, replacing any old one.
+ *
+ * The phone waits for each put's ACK before sending the next. To keep
+ * the link busy we ACK a put as soon as it has been checked, then write
+ * it, so the next chunk comes in while the flash is busy with this one.
+ * That is a window of one chunk ahead; a write that goes wrong fails the
+ * next put or the commit instead. A commit's ACK always waits for the
+ * CRC.
+ *
+ * Runs deferred on the endpoint thread, so the flash never holds up RX.
+ */
+#include <stdlib.h>
+#include "rebbleos.h"
+#include "endpoint.h"
+#include "protocol_putbytes.h"
+#include "rebble_crc.h"
+#include "fs.h"
+
+/* read back for the CRC in pieces this big, one being CRCed by DMA while
+ * the other is read */
+#define PUTBYTES_CRC_CHUNK 256
+/* the fast link is kept this long past the last command */
+#define PUTBYTES_LINK_BOOST_MS 5000
+
+static struct {
+    uint32_t cookie;
+    uint32_t size;
+    uint32_t got;
+    uint8_t busy;
+    uint8_t failed;
+    uint8_t committed;
+    struct fd fd;
+} _pb;
+
+static uint32_t _next_cookie;
+static uint8_t _crc_buf[2][PUTBYTES_CRC_CHUNK] __attribute__((aligned(4)));
+
+static uint32_t _be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void _reply(uint8_t result, uint32_t cookie)
+{
+    uint8_t pkt[5];
+
+    pkt[0] = result;
+    pkt[1] = cookie >> 24;
+    pkt[2] = cookie >> 16;
+    pkt[3] = cookie >> 8;
+    pkt[4] = cookie;
+    bluetooth_send_packet(ENDPOINT_PUTBYTES, pkt, sizeof(pkt));
+}
+
+/* drop whatever is part done. The temp file is deleted, or if we lose
+ * power first, fs_init throws it away */
+static void _abort(void)
+{
+    if (_pb.busy && !_pb.committed)
+        fs_delete(&_pb.fd.file);
+    _pb.busy = 0;
+}
+
+/* where an init says its data goes. 0 if it's nowhere we can put it */
+static uint8_t _init_name(const uint8_t *data, char *name, size_t len)
+{
+    uint8_t type = data[5];
+
+    if (type & PUTBYTES_TYPE_HAS_APP_ID)
+    {
+        uint32_t app_id = _be32(data + 6);
+        switch (type & ~PUTBYTES_TYPE_HAS_APP_ID)
+        {
+            case PUTBYTES_TYPE_BINARY:
+                snprintf(name, len, "@%08lx/app", app_id);
+                return 1;
+            case PUTBYTES_TYPE_RESOURCES:
+                snprintf(name, len, "@%08lx/res", app_id);
+                return 1;
+            case PUTBYTES_TYPE_WORKER:
+                snprintf(name, len, "@%08lx/worker", app_id);
+                return 1;
+        }
+        return 0;
+    }
+
+    /* bank, then a terminated name. Firmware needs the bootloader's
+     * slots, which we don't have */
+    if (type != PUTBYTES_TYPE_FILE)
+        return 0;
+
+    strncpy(name, (const char *)data + 7, len - 1);
+    name[len - 1] = 0;
+    return name[0] != 0;
+}
+
+static void _init(uint8_t *data)
+{
+    char name[32];
+    uint32_t size = _be32(data + 1);
+
+    _abort();
+
+    if (!_init_name(data, name, sizeof(name)) || !size)
+    {
+        SYS_LOG("PUTB", APP_LOG_LEVEL_ERROR, "init: type %d not supported", data[5]);
+        _reply(PUTBYTES_NACK, 0);
+        return;
+    }
+
+    if (fs_creat(&_pb.fd, name, size) < 0)
+    {
+        SYS_LOG("PUTB", APP_LOG_LEVEL_ERROR, "init: no room for %s, %ld bytes", name, size);
+        _reply(PUTBYTES_NACK, 0);
+        return;
+    }
+
+    if (!_next_cookie)
+        _next_cookie = xTaskGetTickCount() | 1;
+    _pb.cookie = _next_cookie++;
+    _pb.size = size;
+    _pb.got = 0;
+    _pb.failed = 0;
+    _pb.committed = 0;
+    _pb.busy = 1;
+    bluetooth_link_boost(PUTBYTES_LINK_BOOST_MS);
+
+    SYS_LOG("PUTB", APP_LOG_LEVEL_INFO, "init: %s, %ld bytes, cookie %lx", name, size, _pb.cookie);
+    _reply(PUTBYTES_ACK, _pb.cookie);
+}
+
+static void _put(uint8_t *data)
+{
+    uint32_t cookie = _be32(data + 1);
+    uint32_t len = _be32(data + 5);
+
+    if (!_pb.busy || _pb.committed || cookie != _pb.cookie || _pb.failed ||
+        len > _pb.size - _pb.got)
+    {
+        _reply(PUTBYTES_NACK, cookie);
+        return;
+    }
+
+    /* the next one can be on its way while this is written */
+    _pb.got += len;
+    bluetooth_link_boost(PUTBYTES_LINK_BOOST_MS);
+    _reply(PUTBYTES_ACK, cookie);
+
+    if ((uint32_t)fs_write(&_pb.fd, data + 9, len) != len)
+    {
+        SYS_LOG("PUTB", APP_LOG_LEVEL_ERROR, "put: write failed at %ld", _pb.got - len);
+        _pb.failed = 1;
+    }
+}
+
+/* the temp file's CRC, off the flash */
+static uint32_t _crc_file(void)
+{
+    struct fd fd;
+    uint8_t which = 0;
+
+    fs_open(&fd, &_pb.fd.file);
+    rcore_crc_begin();
+    for (uint32_t left = _pb.size; left; )
+    {
+        uint32_t n = left < PUTBYTES_CRC_CHUNK ? left : PUTBYTES_CRC_CHUNK;
+
+        /* the feed before last is done with this buffer by now */
+        if ((uint32_t)fs_read(&fd, _crc_buf[which], n) != n)
+            break;
+        rcore_crc_feed(_crc_buf[which], n);
+        which ^= 1;
+        left -= n;
+    }
+
+    return rcore_crc_end();
+}
+
+static void _commit(uint8_t *data)
+{
+    uint32_t cookie = _be32(data + 1);
+    uint32_t crc = _be32(data + 5);
+
+    if (!_pb.busy || cookie != _pb.cookie || _pb.failed || _pb.got != _pb.size)
+    {
+        SYS_LOG("PUTB", APP_LOG_LEVEL_ERROR, "commit: %ld of %ld bytes", _pb.got, _pb.size);
+        _reply(PUTBYTES_NACK, cookie);
+        return;
+    }
+
+    uint32_t ours = _crc_file();
+    if (ours != crc)
+    {
+        SYS_LOG("PUTB", APP_LOG_LEVEL_ERROR, "commit: CRC %lx, phone says %lx", ours, crc);
+        _abort();
+        _reply(PUTBYTES_NACK, cookie);
+        return;
+    }
+
+    if (fs_commit(&_pb.fd) < 0)
+    {
+        _abort();
+        _reply(PUTBYTES_NACK, cookie);
+        return;
+    }
+
+    _pb.committed = 1;
+    _reply(PUTBYTES_ACK, cookie);
+}
+
+void process_putbytes_packet(uint8_t *data, uint16_t len)
+{
+    uint32_t cookie = _be32(data + 1);
+
+    switch (data[0])
+    {
+        case PUTBYTES_INIT:
+            _init(data);
+            break;
+        case PUTBYTES_PUT:
+            _put(data);
+            break;
+        case PUTBYTES_COMMIT:
+            _commit(data);
+            break;
+        case PUTBYTES_ABORT:
+            if (_pb.busy && cookie == _pb.cookie)
+                _abort();
+            _reply(PUTBYTES_ACK, cookie);
+            break;
+        case PUTBYTES_INSTALL:
+            /* the file is already where it belongs once committed */
+            if (!_pb.busy || cookie != _pb.cookie || !_pb.committed)
+            {
+                _reply(PUTBYTES_NACK, cookie);
+                break;
+            }
+            SYS_LOG("PUTB", APP_LOG_LEVEL_INFO, "install: cookie %lx done", cookie);
+            _pb.busy = 0;
+            _reply(PUTBYTES_ACK, cookie);
+            break;
+        default:
+            _reply(PUTBYTES_NACK, cookie);
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/* PutBytes commands, phone to watch */
+typedef enum putbytes_cmd {
+    PUTBYTES_INIT    = 1,
+    PUTBYTES_PUT     = 2,
+    PUTBYTES_COMMIT  = 3,
+    PUTBYTES_ABORT   = 4,
+    PUTBYTES_INSTALL = 5,
+} putbytes_cmd_t;
+
+/* what is being sent. With PUTBYTES_TYPE_HAS_APP_ID set, an app id
+ * follows in the init instead of a bank and file name */
+typedef enum putbytes_type {
+    PUTBYTES_TYPE_FIRMWARE     = 1,
+    PUTBYTES_TYPE_RECOVERY     = 2,
+    PUTBYTES_TYPE_SYSRESOURCES = 3,
+    PUTBYTES_TYPE_RESOURCES    = 4,
+    PUTBYTES_TYPE_BINARY       = 5,
+    PUTBYTES_TYPE_FILE         = 6,
+    PUTBYTES_TYPE_WORKER       = 7,
+} putbytes_type_t;
+
+#define PUTBYTES_TYPE_HAS_APP_ID 0x80
+
+/* the reply to each command: result, then the cookie */
+#define PUTBYTES_ACK  1
+#define PUTBYTES_NACK 2
+
+void process_putbytes_packet(uint8_t *data, uint16_t len);
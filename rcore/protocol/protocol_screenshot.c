@@ -0,0 +1,140 @@
+/* protocol_screenshot.c
+ * Screenshots: the framebuffer, streamed to the phone as it lies
+ * RebbleOS
+ *
+ * A take gets a header, with a result and the pixel format, width and
+ * height, big endian. Then the pixels follow, top row first, in as many
+ * packets as they take. Colour watches are one byte a pixel, GColor8.
+ * That is exactly how the framebuffer is laid out, so each packet goes
+ * straight out of the framebuffer. tintin's 1 bit rows are padded out to
+ * a word, so they are packed into a small buffer a row at a time first.
+ * Nothing the size of a frame is ever copied.
+ *
+ * The draw lock is held while the frame goes, so what is sent is one
+ * frame. The app misses a frame or two meanwhile.
+ *
+ * TAKE_RLE is for our test rigs. It sends the same, but each row is
+ * PackBits coded, which shrinks the flat fills of a UI to a fraction.
+ *
+ * Runs deferred on the endpoint thread.
+ */
+#include "rebbleos.h"
+#include "endpoint.h"
+#include "display.h"
+#include "protocol_screenshot.h"
+#include "packbits.h"
+
+#ifdef PBL_BW
+#define SCREENSHOT_VERSION      SCREENSHOT_VERSION_1BIT
+#define SCREENSHOT_ROW_BYTES    ((DISPLAY_COLS + 7) / 8)
+#define SCREENSHOT_FB_STRIDE    DISPLAY_ROW_BYTES
+#else
+#define SCREENSHOT_VERSION      SCREENSHOT_VERSION_8BIT
+#define SCREENSHOT_ROW_BYTES    DISPLAY_COLS
+#define SCREENSHOT_FB_STRIDE    DISPLAY_COLS
+#endif
+
+/* pixels in each packet */
+#define SCREENSHOT_CHUNK        1024
+/* the most a row can come to, PackBits coded */
+#define SCREENSHOT_RLE_ROW_MAX  PACKBITS_MAX(SCREENSHOT_ROW_BYTES)
+#define SCREENSHOT_LOCK_WAIT    pdMS_TO_TICKS(500)
+#define SCREENSHOT_LINK_BOOST_MS 2000
+
+static void _put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void _header(uint8_t result)
+{
+    uint8_t pkt[13];
+
+    pkt[0] = result;
+    _put_be32(pkt + 1, SCREENSHOT_VERSION);
+    _put_be32(pkt + 5, DISPLAY_COLS);
+    _put_be32(pkt + 9, DISPLAY_ROWS);
+    bluetooth_send_packet(ENDPOINT_SCREENSHOT, pkt, sizeof(pkt));
+}
+
+static void _send(const uint8_t *data, uint16_t len)
+{
+    bluetooth_link_boost(SCREENSHOT_LINK_BOOST_MS);
+    bluetooth_send_packet(ENDPOINT_SCREENSHOT, (uint8_t *)data, len);
+}
+
+void process_screenshot_packet(uint8_t *data, uint16_t len)
+{
+    const uint8_t *fb;
+    uint8_t *buf = NULL;
+    uint16_t used = 0;
+    bool rle;
+
+    if (!len || data[0] > SCREENSHOT_TAKE_RLE)
+    {
+        _header(SCREENSHOT_MALFORMED);
+        return;
+    }
+    rle = data[0] == SCREENSHOT_TAKE_RLE;
+
+    if (rle || SCREENSHOT_ROW_BYTES != SCREENSHOT_FB_STRIDE)
+    {
+        buf = system_malloc(SCREENSHOT_CHUNK);
+        if (!buf)
+        {
+            _header(SCREENSHOT_OUT_OF_MEMORY);
+            return;
+        }
+    }
+
+    if (!display_buffer_lock_take(SCREENSHOT_LOCK_WAIT))
+    {
+        _header(SCREENSHOT_BUSY);
+        system_free(buf);
+        return;
+    }
+
+    _header(SCREENSHOT_OK);
+    fb = hw_display_get_buffer();
+
+    if (!buf)
+    {
+        /* rows back to back, as the phone wants them */
+        for (uint32_t ofs = 0; ofs < DISPLAY_ROWS * SCREENSHOT_FB_STRIDE; ofs += SCREENSHOT_CHUNK)
+        {
+            uint32_t n = DISPLAY_ROWS * SCREENSHOT_FB_STRIDE - ofs;
+            _send(fb + ofs, n > SCREENSHOT_CHUNK ? SCREENSHOT_CHUNK : n);
+        }
+    }
+    else
+    {
+        for (uint16_t row = 0; row < DISPLAY_ROWS; row++)
+        {
+            const uint8_t *src = fb + row * SCREENSHOT_FB_STRIDE;
+
+            if (used + SCREENSHOT_RLE_ROW_MAX > SCREENSHOT_CHUNK)
+            {
+                _send(buf, used);
+                used = 0;
+            }
+
+            if (rle)
+            {
+                used += packbits_encode(buf + used, src, SCREENSHOT_ROW_BYTES);
+            }
+            else
+            {
+                memcpy(buf + used, src, SCREENSHOT_ROW_BYTES);
+                used += SCREENSHOT_ROW_BYTES;
+            }
+        }
+        if (used)
+            _send(buf, used);
+    }
+
+    display_buffer_lock_give();
+    system_free(buf);
+}
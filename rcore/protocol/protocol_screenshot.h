@@ -0,0 +1,18 @@
+#pragma once
+
+/* Screenshot requests, phone to watch. TAKE_RLE is ours, the phone only
+ * sends TAKE */
+#define SCREENSHOT_TAKE     0x00
+#define SCREENSHOT_TAKE_RLE 0x01
+
+/* the result at the start of the header */
+#define SCREENSHOT_OK               0
+#define SCREENSHOT_MALFORMED        1
+#define SCREENSHOT_OUT_OF_MEMORY    2
+#define SCREENSHOT_BUSY             3
+
+/* the pixel format in the header */
+#define SCREENSHOT_VERSION_1BIT     1
+#define SCREENSHOT_VERSION_8BIT     2
+
+void process_screenshot_packet(uint8_t *data, uint16_t len);
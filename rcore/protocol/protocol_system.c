@@ -4,7 +4,7 @@
 #include "endpoint.h"
 
 // firmware version processing
-void process_version_packet(uint8_t *data)
+void process_version_packet(uint8_t *data, uint16_t len)
 {
     switch(data[0])
     {
@@ -19,9 +19,22 @@ void process_version_packet(uint8_t *data)
 }
 
 
-void process_set_time_packet(uint8_t *data)
+/* The time is big endian, then the offset from UTC in minutes. The zone
+ * name that follows is ignored, and the phone gives no transitions, so
+ * the offset holds until it next sets the time */
+void process_set_time_packet(uint8_t *data, uint16_t len)
 {
-    cmd_set_time_t *time = (cmd_set_time_t *)data;
-    SYS_LOG("FWPKT", APP_LOG_LEVEL_INFO, "XXX Time Set cmd %d, ts %d tso %d, tz %d",
-            time->cmd, time->ts, time->tso, time->tz);
+    if (len < 5 || data[0] != TIME_SETTIME_UTC)
+    {
+        SYS_LOG("FWPKT", APP_LOG_LEVEL_INFO, "XXX Time cmd %d", len ? data[0] : -1);
+        return;
+    }
+
+    uint32_t ts = (uint32_t)data[1] << 24 | (uint32_t)data[2] << 16 |
+                  (uint32_t)data[3] << 8 | data[4];
+    SYS_LOG("FWPKT", APP_LOG_LEVEL_INFO, "Time set to %lu", ts);
+    rcore_time_set((time_t)ts);
+
+    if (len >= 7)
+        rcore_time_set_zone((int16_t)(data[5] << 8 | data[6]) * 60, NULL, 0);
 }
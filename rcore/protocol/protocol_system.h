@@ -1,6 +1,6 @@
 #pragma once
-void process_version_packet(uint8_t *data);
-void process_set_time_packet(uint8_t *data);
+void process_version_packet(uint8_t *data, uint16_t len);
+void process_set_time_packet(uint8_t *data, uint16_t len);
 
 /* This isn't actually our version, this is a faked out version for Pebble
  * app to at least consider talking to us over bluetooth */
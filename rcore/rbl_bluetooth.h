@@ -3,7 +3,6 @@
 #include "stdbool.h"
 
 #define TX_BUFFER_SIZE 250
-#define TX_TIMEOUT_MS 5
 
 typedef struct pbl_transport_packet_t {
     uint16_t length;
@@ -13,22 +12,42 @@ typedef struct pbl_transport_packet_t {
 
 
 
-typedef void (*tx_complete_callback)();
+/* a packet given to bluetooth_send_async has gone, or failed to. On the
+ * BTCmd thread, so be quick. The buffer is the caller's again */
+typedef void (*tx_complete_callback)(uint8_t *data, size_t len, bool sent);
 
 uint8_t bluetooth_init(void);
 void bluetooth_init_complete(uint8_t state);
 void bluetooth_data_rx_notify(size_t len);
 uint32_t bluetooth_send_serial_raw(uint8_t *data, size_t len);
 uint8_t bluetooth_send(uint8_t *data, size_t len);
+bool bluetooth_send_async(uint8_t *data, size_t len, tx_complete_callback cb);
 void bluetooth_send_packet(uint16_t endpoint, uint8_t *data, uint16_t len);
 uint32_t bluetooth_tx_buf_get_bytes(uint8_t *data, size_t len);
 void bluetooth_data_rx(uint8_t *data, size_t len);
 void bluetooth_tx_complete_from_isr(void);
 
 
+/* the link as the driver last heard it. LE interval in 1.25ms units and
+ * supervision timeout in 10ms, as the spec has them; 0s for whichever
+ * of LE or RFCOMM isn't up */
+typedef struct bt_link_params_t {
+    uint8_t fast;
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+    uint16_t att_mtu;
+    uint16_t rfcomm_frame;
+} __attribute__((__packed__)) bt_link_params_t;
+
+void bluetooth_link_boost(uint32_t ms);
+void bt_device_link_boost(uint32_t ms);
+void bt_device_link_params(bt_link_params_t *params);
+
 uint8_t hw_bluetooth_power_cycle(void);
 void hw_bluetooth_enable_cts_irq(void);
 void hw_bluetooth_disable_cts_irq(void);
+void hw_bluetooth_sleep(uint8_t sleep);
 stm32_usart_t *hw_bluetooth_get_usart(void);
 uint8_t hw_bluetooth_init(void);
 
@@ -36,3 +55,39 @@ uint8_t hw_bluetooth_init(void);
 void bluetooth_device_connected(void);
 void bluetooth_device_disconnected(void);
 bool bluetooth_is_device_connected(void);
+void bluetooth_get_byte_counts(uint32_t *tx_bytes, uint32_t *rx_bytes);
+
+/* most endpoints counted apart. The rest go in the last */
+#define BT_STATS_ENDPOINTS 12
+
+typedef struct __attribute__((__packed__)) BtEndpointStats {
+    uint16_t endpoint;
+    uint32_t tx_packets;
+    uint32_t tx_bytes;
+    uint32_t rx_packets;
+    uint32_t rx_bytes;
+} BtEndpointStats;
+
+/* how long something took, over count goes */
+typedef struct __attribute__((__packed__)) BtTimeStats {
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+} BtTimeStats;
+
+/* Since boot. Packets are whole Pebble protocol frames, the bytes their
+ * payloads; tx_bytes and rx_bytes are everything through the transport */
+typedef struct __attribute__((__packed__)) BtStats {
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+    uint32_t tx_timeouts;
+    uint32_t rx_lost_bytes;     /* RX ring full */
+    BtTimeStats tx_queue;       /* queued until the cmd thread took it up */
+    BtTimeStats tx_send;        /* handed to the stack until it said it was sent */
+    BtTimeStats rx_dispatch;    /* in from the stack until its endpoint got it */
+    uint8_t endpoint_count;
+    BtEndpointStats endpoint[BT_STATS_ENDPOINTS];
+} BtStats;
+
+void bluetooth_get_stats(BtStats *stats);
+void process_bt_stats_packet(uint8_t *data, uint16_t len);
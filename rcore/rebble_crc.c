@@ -0,0 +1,141 @@
+/* rebble_crc.c
+ * CRC32 as the SDK and mkpack make it (Utilities/stm32_crc.py), on the
+ * hardware CRC unit.
+ * RebbleOS
+ *
+ * There's one unit, so a CRC is taken between rcore_crc_begin and
+ * rcore_crc_end, and anyone else waits. rcore_crc_feed can be given any
+ * length of data, as it comes off the flash. Long runs go over DMA and
+ * the feed returns straight away, so the caller can get on with reading
+ * the next lot. The data fed must stay put until the next feed or the end.
+ */
+
+#include "rebbleos.h"
+#include "rebble_crc.h"
+
+/* Configure Logging */
+#define MODULE_NAME "crc"
+#define MODULE_TYPE "KERN"
+#define LOG_LEVEL RBL_LOG_LEVEL_ERROR
+
+/* Feeds shorter than this just get written in by the CPU */
+#define CRC_DMA_MIN_WORDS 64
+
+static SemaphoreHandle_t _crc_mutex;
+static StaticSemaphore_t _crc_mutex_buf;
+static SemaphoreHandle_t _crc_done;
+static StaticSemaphore_t _crc_done_buf;
+
+static uint8_t _crc_dma_busy;
+static uint8_t _crc_err;
+/* bytes past the last whole word fed */
+static uint8_t _crc_tail[4] __attribute__((aligned(4)));
+static uint8_t _crc_tail_len;
+
+uint8_t rcore_crc_init(void)
+{
+    _crc_mutex = xSemaphoreCreateMutexStatic(&_crc_mutex_buf);
+    _crc_done = xSemaphoreCreateBinaryStatic(&_crc_done_buf);
+    hw_crc_init();
+
+    return 0;
+}
+
+static void _crc_wait(void)
+{
+    if (!_crc_dma_busy)
+        return;
+
+    xSemaphoreTake(_crc_done, portMAX_DELAY);
+    _crc_dma_busy = 0;
+}
+
+void rcore_crc_begin(void)
+{
+    xSemaphoreTake(_crc_mutex, portMAX_DELAY);
+    hw_crc_reset();
+    _crc_tail_len = 0;
+    _crc_err = 0;
+}
+
+void rcore_crc_feed(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    /* top up the word left over from last time first */
+    if (_crc_tail_len)
+    {
+        while (_crc_tail_len < 4 && len)
+        {
+            _crc_tail[_crc_tail_len++] = *p++;
+            len--;
+        }
+        if (_crc_tail_len < 4)
+            return;
+
+        _crc_wait();
+        hw_crc_feed((const uint32_t *)_crc_tail, 1);
+        _crc_tail_len = 0;
+    }
+
+    size_t words = len / 4;
+    if (words)
+    {
+        _crc_wait();
+        if (words >= CRC_DMA_MIN_WORDS && hw_crc_feed_dma((const uint32_t *)p, words))
+            _crc_dma_busy = 1;
+        else
+            hw_crc_feed((const uint32_t *)p, words);
+        p += words * 4;
+        len -= words * 4;
+    }
+
+    memcpy(_crc_tail, p, len);
+    _crc_tail_len = len;
+}
+
+/* The CRC so far, and let the next one have the unit */
+uint32_t rcore_crc_end(void)
+{
+    uint32_t crc;
+
+    _crc_wait();
+
+    /* what's left is padded out at the front and turned around, per
+     * stm32_crc.py */
+    if (_crc_tail_len)
+    {
+        uint32_t word = 0;
+        for (uint8_t i = 0; i < _crc_tail_len; i++)
+            word |= _crc_tail[i] << (8 * (_crc_tail_len - 1 - i));
+        hw_crc_feed(&word, 1);
+    }
+
+    crc = hw_crc_value();
+    hw_crc_release();
+    if (_crc_err)
+    {
+        LOG_ERROR("CRC DMA failed");
+        crc = ~crc; /* so it can't match anything */
+    }
+    xSemaphoreGive(_crc_mutex);
+
+    return crc;
+}
+
+uint32_t rcore_crc32(const void *data, size_t len)
+{
+    rcore_crc_begin();
+    rcore_crc_feed(data, len);
+
+    return rcore_crc_end();
+}
+
+void rcore_crc_complete_isr(uint8_t err)
+{
+    BaseType_t woken = pdFALSE;
+
+    _crc_err |= err;
+    xSemaphoreGiveFromISR(_crc_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
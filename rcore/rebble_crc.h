@@ -0,0 +1,14 @@
+#pragma once
+/* rebble_crc.h
+ * CRC32 over the hardware CRC unit
+ * RebbleOS
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+uint8_t rcore_crc_init(void);
+void rcore_crc_begin(void);
+void rcore_crc_feed(const void *data, size_t len);
+uint32_t rcore_crc_end(void);
+uint32_t rcore_crc32(const void *data, size_t len);
+void rcore_crc_complete_isr(uint8_t err);
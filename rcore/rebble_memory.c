@@ -7,12 +7,129 @@
  */
 
 #include "rebbleos.h"
+#include "endpoint.h"
+#include "watchdog.h"
+#include "persist.h"
 
 /* Configure Logging */
 #define MODULE_NAME "mem"
 #define MODULE_TYPE "KERN"
 #define LOG_LEVEL RBL_LOG_LEVEL_ERROR //RBL_LOG_LEVEL_NONE
 
+#define CALLER __builtin_return_address(0)
+
+/* len bytes of p as hex into out, which has room for the terminator */
+static void _hex(char *out, const void *p, uint16_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t *b = p;
+
+    for (uint16_t j = 0; j < len; j++)
+    {
+        out[j * 2] = digits[b[j] >> 4];
+        out[j * 2 + 1] = digits[b[j] & 0xF];
+    }
+    out[len * 2] = 0;
+}
+
+#ifdef MEMORY_TRACE
+
+#define MEMORY_TRACE_ENTRIES 256
+
+enum {
+    MemoryTraceAlloc,
+    MemoryTraceFree,
+    MemoryTraceFail,
+};
+
+/* heap is an AppThreadType, or this */
+#define MEMORY_TRACE_SYSTEM 0xFF
+
+typedef struct __attribute__((__packed__)) MemoryTraceRecord {
+    uint32_t pc;
+    uint32_t ptr;
+    uint32_t size;
+    uint16_t tick;
+    uint8_t op;
+    uint8_t heap;
+} MemoryTraceRecord;
+
+static MemoryTraceRecord _trace[MEMORY_TRACE_ENTRIES];
+static uint32_t _trace_count;
+
+static void _trace_record(uint8_t op, uint8_t heap, void *ptr, size_t size, void *pc)
+{
+    taskENTER_CRITICAL();
+    MemoryTraceRecord *r = &_trace[_trace_count++ % MEMORY_TRACE_ENTRIES];
+    r->pc = (uint32_t)pc;
+    r->ptr = (uint32_t)ptr;
+    r->size = size;
+    r->tick = xTaskGetTickCount();
+    r->op = op;
+    r->heap = heap;
+    taskEXIT_CRITICAL();
+}
+
+#define TRACE(op, heap, ptr, size, pc) _trace_record(op, heap, ptr, size, pc)
+
+/*
+ * Log the ring, oldest first, a record per line in hex
+ */
+void memory_trace_dump(void)
+{
+    char hex[sizeof(MemoryTraceRecord) * 2 + 1];
+    uint32_t count = _trace_count;
+    uint32_t first = count > MEMORY_TRACE_ENTRIES ? count - MEMORY_TRACE_ENTRIES : 0;
+
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "memtrace %lu records, %lu dropped", count - first, first);
+    for (uint32_t i = first; i < count; i++)
+    {
+        MemoryTraceRecord r;
+        taskENTER_CRITICAL();
+        r = _trace[i % MEMORY_TRACE_ENTRIES];
+        taskEXIT_CRITICAL();
+
+        _hex(hex, &r, sizeof(r));
+        SYS_LOG("mem", APP_LOG_LEVEL_INFO, "memtrace %s", hex);
+    }
+}
+
+/* Who allocated ptr on heap, if the ring still has it. 0 if not */
+static uint32_t _trace_site(uint8_t heap, void *ptr)
+{
+    uint32_t count = _trace_count;
+    uint32_t first = count > MEMORY_TRACE_ENTRIES ? count - MEMORY_TRACE_ENTRIES : 0;
+    uint32_t pc = 0;
+
+    taskENTER_CRITICAL();
+    for (uint32_t i = count; i > first; i--)
+    {
+        MemoryTraceRecord *r = &_trace[(i - 1) % MEMORY_TRACE_ENTRIES];
+        if (r->ptr == (uint32_t)ptr && r->heap == heap && r->op == MemoryTraceAlloc)
+        {
+            pc = r->pc;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return pc;
+}
+
+#else
+
+#define TRACE(op, heap, ptr, size, pc) do { } while (0)
+
+void memory_trace_dump(void)
+{
+}
+
+static uint32_t _trace_site(uint8_t heap, void *ptr)
+{
+    return 0;
+}
+
+#endif
+
 void rblos_memory_init(void)
 {
 }
@@ -23,6 +140,7 @@ void *system_calloc(size_t count, size_t size)
         LOG_ERROR("XXX System Calloc. Check who did this");
 
     void *x = pvPortMalloc(count * size);
+    TRACE(x ? MemoryTraceAlloc : MemoryTraceFail, MEMORY_TRACE_SYSTEM, x, count * size, CALLER);
     if (x != NULL)
         memset(x, 0, count * size);
     return x;
@@ -32,33 +150,154 @@ void *system_malloc(size_t size)
 {
     if (appmanager_is_thread_system())
         LOG_ERROR("XXX System Malloc. Check who did this");
-    return pvPortMalloc(size);
+
+    void *x = pvPortMalloc(size);
+    TRACE(x ? MemoryTraceAlloc : MemoryTraceFail, MEMORY_TRACE_SYSTEM, x, size, CALLER);
+    return x;
 }
 
-void *app_malloc(size_t size)
+void system_free(void *mem)
 {
-    return app_calloc(1, size);    
+    TRACE(MemoryTraceFree, MEMORY_TRACE_SYSTEM, mem, 0, CALLER);
+    vPortFree(mem);
 }
 
-void *app_calloc(size_t count, size_t size)
+static void *_app_calloc(size_t size, void *caller)
 {
     app_running_thread *thread = appmanager_get_current_thread();
     assert(thread && "invalid thread");
-    void *x = qalloc(thread->arena, count * size);
+    void *x = qalloc(thread->arena, size);
+    /* the app's persist store can be written back and dropped for room */
+    if (x == NULL && persist_app_release(thread))
+        x = qalloc(thread->arena, size);
+    TRACE(x ? MemoryTraceAlloc : MemoryTraceFail, thread->thread_type, x, size, caller);
     if (x == NULL)
     {
         LOG_ERROR("!!! NO MEM!\n");
+        memory_trace_dump();
         return NULL;
     }
 
-    memset(x, 0, count * size);
+    memset(x, 0, size);
+    return x;
+}
+
+/*
+ * Small fixed size objects (windows, layers, animations) come out of
+ * per thread pools instead of having a heap block each. A pool page is one
+ * arena block cut into same sized slots, so they save the block header and
+ * don't chop up the heap. Pages stay with the thread until the app exits;
+ * app_free knows to put a slot back. Slots can't be realloc'd.
+ */
+#define APP_POOL_STEP 16
+#define APP_POOL_CLASSES 8 /* up to 128 bytes, anything bigger is a normal alloc */
+#define APP_POOL_PAGE 512
+
+typedef struct AppPoolPage {
+    struct AppPoolPage *next;
+    uint8_t *end;
+    uint8_t class;
+} AppPoolPage;
+
+typedef struct AppPools {
+    AppPoolPage *pages;
+    void *slots[APP_POOL_CLASSES];
+} AppPools;
+
+#define _POOL_SLOTS(page) ((uint8_t *)((page) + 1))
+
+static AppPools *_pools_get(app_running_thread *thread)
+{
+    if (!thread->pools)
+    {
+        thread->pools = qalloc(thread->arena, sizeof(AppPools));
+        if (thread->pools)
+            memset(thread->pools, 0, sizeof(AppPools));
+    }
+    return thread->pools;
+}
+
+static bool _pool_grow(app_running_thread *thread, AppPools *pools, uint8_t class)
+{
+    size_t slot = (class + 1) * APP_POOL_STEP;
+    uint16_t count = (APP_POOL_PAGE - sizeof(AppPoolPage)) / slot;
+    AppPoolPage *page = qalloc(thread->arena, sizeof(AppPoolPage) + count * slot);
+    if (!page)
+        return false;
+
+    page->class = class;
+    page->end = _POOL_SLOTS(page) + count * slot;
+    page->next = pools->pages;
+    pools->pages = page;
+
+    for (uint8_t *p = _POOL_SLOTS(page); p < page->end; p += slot)
+    {
+        *(void **)p = pools->slots[class];
+        pools->slots[class] = p;
+    }
+    return true;
+}
+
+/* Put mem back in its pool, if it came from one */
+static bool _pool_free(app_running_thread *thread, void *mem)
+{
+    AppPools *pools = thread->pools;
+    if (!pools)
+        return false;
+
+    for (AppPoolPage *page = pools->pages; page; page = page->next)
+    {
+        if ((uint8_t *)mem < _POOL_SLOTS(page) || (uint8_t *)mem >= page->end)
+            continue;
+
+        *(void **)mem = pools->slots[page->class];
+        pools->slots[page->class] = mem;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Get a zeroed object of size from the current thread's pools.
+ * Free it with app_free as usual.
+ */
+void *app_pool_calloc(size_t size)
+{
+    app_running_thread *thread = appmanager_get_current_thread();
+    assert(thread && "invalid thread");
+
+    uint8_t class = (size + APP_POOL_STEP - 1) / APP_POOL_STEP - 1;
+    AppPools *pools = size ? _pools_get(thread) : NULL;
+    if (!pools || class >= APP_POOL_CLASSES)
+        return _app_calloc(size, CALLER);
+
+    if (!pools->slots[class] && !_pool_grow(thread, pools, class))
+        return _app_calloc(size, CALLER);
+
+    void *x = pools->slots[class];
+    pools->slots[class] = *(void **)x;
+    TRACE(MemoryTraceAlloc, thread->thread_type, x, size, CALLER);
+    memset(x, 0, size);
     return x;
 }
 
+void *app_malloc(size_t size)
+{
+    return _app_calloc(size, CALLER);
+}
+
+void *app_calloc(size_t count, size_t size)
+{
+    return _app_calloc(count * size, CALLER);
+}
+
 void app_free(void *mem)
 {
     LOG_DEBUG("Free 0x%x", mem);
     app_running_thread *thread = appmanager_get_current_thread();
+    TRACE(MemoryTraceFree, thread->thread_type, mem, 0, CALLER);
+    if (mem && _pool_free(thread, mem))
+        return;
     qfree(thread->arena, mem);
 }
 
@@ -67,7 +306,13 @@ void *app_realloc(void *mem, size_t new_size)
     app_running_thread *thread = appmanager_get_current_thread();
     assert(thread && "invalid thread");
 
-    return qrealloc(thread->arena, mem, new_size);
+    void *x = qrealloc(thread->arena, mem, new_size);
+    /* one pointer going and another coming, even when they're the same */
+    if (x)
+        TRACE(MemoryTraceFree, thread->thread_type, mem, 0, CALLER);
+    TRACE(x ? MemoryTraceAlloc : MemoryTraceFail, thread->thread_type, x, new_size, CALLER);
+
+    return x;
 }
 
 uint32_t app_heap_bytes_free(void)
@@ -87,3 +332,200 @@ uint32_t app_heap_bytes_used(void)
 
     return qusedbytes(thread->arena);
 }
+
+/*
+ * Allocation stats for a thread's heap (thread_type is an AppThreadType).
+ * False if that thread has never had one
+ */
+bool app_heap_stats(uint8_t thread_type, qstats_t *stats)
+{
+    app_running_thread *thread = appmanager_get_thread(thread_type);
+    if (!thread || !thread->arena)
+    {
+        memset(stats, 0, sizeof(qstats_t));
+        return false;
+    }
+
+    qstats(thread->arena, stats);
+    return true;
+}
+
+typedef struct __attribute__((__packed__)) MemoryStatsPacket {
+    qstats_t thread[MAX_APP_THREADS];
+    HeapStats_t system;
+    uint8_t stack_count;
+    StackStats stack[STACK_STATS_MAX];
+    FlashStats flash;
+    FsStats fs;
+} MemoryStatsPacket;
+
+/* too big for the callers' stacks */
+static MemoryStatsPacket _pkt;
+
+static const char * const _thread_names[MAX_APP_THREADS] = {
+    [AppThreadMainApp] = "app",
+    [AppThreadWorker]  = "worker",
+    [AppThreadOverlay] = "overlay",
+};
+
+static void _memory_stats_get(MemoryStatsPacket *pkt)
+{
+    memset(pkt, 0, sizeof(MemoryStatsPacket));
+    for (uint8_t i = 0; i < MAX_APP_THREADS; i++)
+        app_heap_stats(i, &pkt->thread[i]);
+    vPortGetHeapStats(&pkt->system);
+    pkt->stack_count = rcore_watchdog_stack_stats(pkt->stack, STACK_STATS_MAX);
+    flash_stats(&pkt->flash);
+    fs_stats(&pkt->fs);
+}
+
+/*
+ * Log every heap's stats
+ */
+void memory_stats_dump(void)
+{
+    _memory_stats_get(&_pkt);
+    for (uint8_t i = 0; i < MAX_APP_THREADS; i++)
+    {
+        qstats_t *st = &_pkt.thread[i];
+        SYS_LOG("mem", APP_LOG_LEVEL_INFO, "%s: size %lu used %lu peak %lu largest free %lu in %lu free blocks",
+                _thread_names[i], st->size, st->used, st->peak, st->largest_free, st->free_blocks);
+        SYS_LOG("mem", APP_LOG_LEVEL_INFO, "%s: %lu allocs %lu frees, by size %lu %lu %lu %lu %lu %lu %lu %lu",
+                _thread_names[i], st->allocs, st->frees,
+                st->sizes[0], st->sizes[1], st->sizes[2], st->sizes[3],
+                st->sizes[4], st->sizes[5], st->sizes[6], st->sizes[7]);
+    }
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "system: free %lu min ever %lu largest free %lu in %lu free blocks",
+            _pkt.system.xAvailableHeapSpaceInBytes, _pkt.system.xMinimumEverFreeBytesRemaining,
+            _pkt.system.xSizeOfLargestFreeBlockInBytes, _pkt.system.xNumberOfFreeBlocks);
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "system: %lu allocs %lu frees",
+            _pkt.system.xNumberOfSuccessfulAllocations, _pkt.system.xNumberOfSuccessfulFrees);
+
+    FlashStats *fl = &_pkt.flash;
+#ifdef FLASH_CACHE
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "flash cache: %lu hits %lu misses", fl->cache_hits, fl->cache_misses);
+#endif
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "flash: %lu reads %lu bytes, waited %lu us all told, %lu us at most",
+            fl->reads, fl->bytes, fl->wait_us, fl->wait_max_us);
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "flash: reads taking under %dus and on up by twos %lu %lu %lu %lu %lu %lu %lu %lu",
+            FLASH_STATS_LATENCY_MIN_US, fl->latency[0], fl->latency[1], fl->latency[2], fl->latency[3],
+            fl->latency[4], fl->latency[5], fl->latency[6], fl->latency[7]);
+    for (uint8_t i = 0; i < fl->task_count; i++)
+        SYS_LOG("mem", APP_LOG_LEVEL_INFO, "flash: %.*s: %lu reads %lu bytes, waited %lu us",
+                configMAX_TASK_NAME_LEN, fl->task[i].name, fl->task[i].reads, fl->task[i].bytes, fl->task[i].wait_us);
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "fs: %lu finds reading %lu headers, %lu full scans; %lu seeks walking %lu pages, %lu pages walked reading",
+            _pkt.fs.finds, _pkt.fs.find_headers, _pkt.fs.find_scans, _pkt.fs.seeks, _pkt.fs.seek_walks, _pkt.fs.read_walks);
+    rcore_watchdog_stack_dump();
+}
+
+/*
+ * Debug endpoint. Any packet gets the stats logged and sent back raw
+ */
+void process_memory_stats_packet(uint8_t *data, uint16_t len)
+{
+    memory_stats_dump();
+    memory_trace_dump();
+    _memory_stats_get(&_pkt);
+    bluetooth_send_packet(ENDPOINT_MEMORY_STATS, (uint8_t *)&_pkt, sizeof(_pkt));
+}
+
+/*
+ * Heap snapshots: every block of a thread's heap to the log, where it is,
+ * its size, if it's free and, with MEMORY_TRACE, who allocated it. Two
+ * taken hours apart and diffed (Utilities/heapsnap.py) show what piled
+ * up, and how much longer a first fit walk has got.
+ * The blocks are copied out with the scheduler stopped, so a snapshot is
+ * of one moment, and logged after.
+ */
+#define HEAP_SNAPSHOT_PER_LINE 4
+/* room for blocks that appear between counting them and copying them */
+#define HEAP_SNAPSHOT_SLACK 16
+
+typedef struct __attribute__((__packed__)) HeapSnapshotRecord {
+    uint32_t ptr;
+    uint32_t size;  /* the whole block; bit 0 set if it's free */
+    uint32_t pc;    /* who allocated it, or 0 */
+} HeapSnapshotRecord;
+
+typedef struct HeapSnapshot {
+    HeapSnapshotRecord *rec;
+    uint16_t max;
+    uint16_t count;     /* blocks seen, which may be more than max */
+} HeapSnapshot;
+
+static void _heap_snapshot_block(void *ptr, uint32_t size, int is_free, void *ctx)
+{
+    HeapSnapshot *snap = ctx;
+
+    if (snap->rec && snap->count < snap->max)
+    {
+        snap->rec[snap->count].ptr = (uint32_t)ptr;
+        snap->rec[snap->count].size = size | (is_free ? 1 : 0);
+        snap->rec[snap->count].pc = 0;
+    }
+    snap->count++;
+}
+
+void memory_heap_snapshot(uint8_t thread_type)
+{
+    app_running_thread *thread = thread_type < MAX_APP_THREADS ? appmanager_get_thread(thread_type) : NULL;
+    HeapSnapshot snap = { 0 };
+    char line[HEAP_SNAPSHOT_PER_LINE * (sizeof(HeapSnapshotRecord) * 2 + 1) + 1];
+    uint16_t n;
+    int at = 0;
+
+    if (!thread || !thread->arena)
+    {
+        SYS_LOG("mem", APP_LOG_LEVEL_INFO, "heapsnap no heap %d", thread_type);
+        return;
+    }
+
+    vTaskSuspendAll();
+    qwalk(thread->arena, _heap_snapshot_block, &snap);
+    xTaskResumeAll();
+
+    snap.max = snap.count + HEAP_SNAPSHOT_SLACK;
+    snap.rec = system_malloc(snap.max * sizeof(HeapSnapshotRecord));
+    if (!snap.rec)
+    {
+        SYS_LOG("mem", APP_LOG_LEVEL_INFO, "heapsnap no memory for %d blocks", snap.max);
+        return;
+    }
+
+    snap.count = 0;
+    vTaskSuspendAll();
+    qwalk(thread->arena, _heap_snapshot_block, &snap);
+    xTaskResumeAll();
+
+    n = snap.count < snap.max ? snap.count : snap.max;
+    SYS_LOG("mem", APP_LOG_LEVEL_INFO, "heapsnap %s %d blocks of %d, size %lu used %lu at %lu",
+            _thread_names[thread_type], n, snap.count, thread->arena->size, thread->arena->used,
+            xTaskGetTickCount());
+    for (uint16_t i = 0; i < n; i++)
+    {
+        HeapSnapshotRecord *r = &snap.rec[i];
+
+        if (!(r->size & 1))
+            r->pc = _trace_site(thread_type, (void *)r->ptr);
+        _hex(line + at, r, sizeof(*r));
+        at += sizeof(*r) * 2;
+        line[at++] = ' ';
+        if ((i + 1) % HEAP_SNAPSHOT_PER_LINE == 0 || i + 1 == n)
+        {
+            line[at - 1] = 0;
+            SYS_LOG("mem", APP_LOG_LEVEL_INFO, "heapblk %s", line);
+            at = 0;
+        }
+    }
+
+    system_free(snap.rec);
+}
+
+/*
+ * Debug endpoint. The thread whose heap to take, an AppThreadType, or
+ * nothing for the app's
+ */
+void process_heap_snapshot_packet(uint8_t *data, uint16_t len)
+{
+    memory_heap_snapshot(len >= 1 ? data[0] : AppThreadMainApp);
+}
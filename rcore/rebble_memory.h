@@ -11,18 +11,36 @@
 #include <string.h>
 #include <stdlib.h>
 #include "stdbool.h"
+#include "qalloc.h"
+
+/* Record every alloc and free in a ring, with who called it. Dumped to
+ * the log with the memory stats and when an app runs out. See
+ * Utilities/memtrace.py to make sense of it */
+// #define MEMORY_TRACE
 
 #define malloc system_malloc
 #define calloc system_calloc
+#ifdef MEMORY_TRACE
+#define free system_free
+#else
 #define free vPortFree
+#endif
 
 void *system_calloc(size_t count, size_t size);
 void rblos_memory_init(void);
 void *system_malloc(size_t size);
+void system_free(void *mem);
 
 void *app_malloc(size_t size);
 void *app_calloc(size_t count, size_t size);
 void *app_realloc(void *mem, size_t new_size);
+void *app_pool_calloc(size_t size);
 void app_free(void *mem);
 uint32_t app_heap_bytes_free(void);
 uint32_t app_heap_bytes_used(void);
+bool app_heap_stats(uint8_t thread_type, qstats_t *stats);
+void memory_stats_dump(void);
+void memory_trace_dump(void);
+void process_memory_stats_packet(uint8_t *data, uint16_t len);
+void memory_heap_snapshot(uint8_t thread_type);
+void process_heap_snapshot_packet(uint8_t *data, uint16_t len);
@@ -14,12 +14,44 @@
 #define LOG_LEVEL RBL_LOG_LEVEL_ERROR //RBL_LOG_LEVEL_ERROR
 
 
+/* The time is the tick count on from one read of the RTC, as reading the
+ * RTC means waiting for its shadow registers. The two drift apart, and
+ * tickless idle rounds, so the OS thread puts it back to the RTC every so
+ * often (rcore_time_resync). The RTC only has whole seconds, so nearer
+ * than this the two can't be told apart */
+#define TIME_RESYNC_SLACK 2
+
+/* time_t is signed, and 32 or 64 bits */
+#define TIME_T_MAX ((time_t)~((time_t)1 << (sizeof(time_t) * 8 - 1)))
+#define TIME_T_MIN (-TIME_T_MAX - 1)
+
 static TickType_t _boot_ticks;
 static time_t _boot_time_t;
 
 static struct tm _global_tm;
 struct tm *boot_time_tm;
 
+/* Most conversions are for "now", a second on from the last one. Keep the
+ * day we last converted and walk the clock fields within it, so a full
+ * localtime only happens when the date changes. This works on local
+ * seconds, the zone's offset already added, so every day is 86400 */
+#define SECS_PER_DAY (24 * 60 * 60)
+static struct tm _cal_tm;
+static time_t _cal_midnight;
+static bool _cal_valid;
+
+/* The zone is the offset from UTC, and the times it changes, in order.
+ * Whoever sets the time hands them over already worked out, so there are
+ * no rules to evaluate here. The span between the transitions either side
+ * of the last conversion is kept, and the next conversion in it is a
+ * compare and an add */
+static TimeZoneTransition _zone[TIME_ZONE_TRANSITIONS];
+static uint8_t _zone_count;
+static int32_t _zone_base_offset; /* before the first transition */
+static time_t _zone_from, _zone_until; /* the span the offset below holds for */
+static int32_t _zone_offset;
+static bool _zone_valid;
+
 void rcore_time_init(void)
 {
     struct tm *tm;
@@ -38,24 +70,135 @@ time_t rcore_mktime(struct tm *tm)
     return mktime(tm);
 }
 
+/* The offset at UTC time t. Call in a critical section */
+static int32_t _zone_offset_at(time_t t)
+{
+    if (_zone_valid && t >= _zone_from && t < _zone_until)
+        return _zone_offset;
+
+    uint8_t i = 0;
+    while (i < _zone_count && _zone[i].at <= t)
+        i++;
+
+    /* i is the first transition still to come */
+    _zone_offset = i ? _zone[i - 1].offset : _zone_base_offset;
+    _zone_from = i ? _zone[i - 1].at : TIME_T_MIN;
+    _zone_until = i < _zone_count ? _zone[i].at : TIME_T_MAX;
+    _zone_valid = true;
+
+    return _zone_offset;
+}
+
+/*
+ * Set the zone. offset is seconds east of UTC up to the first of the
+ * transitions, which are in time order; with none, it is the offset
+ * always. Past TIME_ZONE_TRANSITIONS the last offset holds
+ */
+void rcore_time_set_zone(int32_t offset, const TimeZoneTransition *transitions, uint8_t count)
+{
+    if (count > TIME_ZONE_TRANSITIONS)
+        count = TIME_ZONE_TRANSITIONS;
+
+    taskENTER_CRITICAL();
+    if (count)
+        memcpy(_zone, transitions, count * sizeof(TimeZoneTransition));
+    _zone_count = count;
+    _zone_base_offset = offset;
+    _zone_valid = false;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * UTC seconds to the local calendar
+ */
 void rcore_localtime(struct tm *tm, time_t time)
 {
+    bool hit = false;
+
+    taskENTER_CRITICAL();
+    time += _zone_offset_at(time);
+    if (_cal_valid && time >= _cal_midnight && time - _cal_midnight < SECS_PER_DAY) {
+        uint32_t sec = time - _cal_midnight;
+        _cal_tm.tm_hour = sec / 3600;
+        _cal_tm.tm_min = (sec / 60) % 60;
+        _cal_tm.tm_sec = sec % 60;
+        *tm = _cal_tm;
+        hit = true;
+    }
+    taskEXIT_CRITICAL();
+
+    if (hit)
+        return;
+
     localtime_r(&time, tm);
+
+    taskENTER_CRITICAL();
+    _cal_tm = *tm;
+    _cal_midnight = time - (tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec);
+    _cal_valid = true;
+    taskEXIT_CRITICAL();
+}
+
+/* Move the clock by delta seconds. Ticks already worked out from the old
+ * time go off where they were, and are worked out again when they do */
+static void _time_shift(time_t delta)
+{
+    taskENTER_CRITICAL();
+    _boot_time_t += delta;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Put the clock back to the RTC, if it has wandered. From the OS thread
+ */
+void rcore_time_resync(void)
+{
+    time_t now, rtc;
+
+    rcore_time_ms(&now, NULL);
+    rtc = rcore_mktime(hw_get_time());
+
+    if (rtc - now > -TIME_RESYNC_SLACK && rtc - now < TIME_RESYNC_SLACK)
+        return;
+
+    SYS_LOG("rtime", APP_LOG_LEVEL_INFO, "Clock off the RTC by %ld s", (long)(rtc - now));
+    _time_shift(rtc - now);
+}
+
+/*
+ * The phone told us the time. UTC, which is local time here
+ */
+void rcore_time_set(time_t t)
+{
+    struct tm tm;
+    time_t now;
+
+    localtime_r(&t, &tm);
+    hw_set_date_time(tm);
+
+    rcore_time_ms(&now, NULL);
+    _time_shift(t - now);
 }
 
 uint16_t rcore_time_ms(time_t *tutc, uint16_t *ms)
 {
     TickType_t ticks_since_boot = xTaskGetTickCount() - _boot_ticks;
+    time_t boot_time_t;
+
+    /* it may be 64 bits, and moved under us */
+    taskENTER_CRITICAL();
+    boot_time_t = _boot_time_t;
+    taskEXIT_CRITICAL();
 
     if (tutc)
-        *tutc = _boot_time_t + (ticks_since_boot / configTICK_RATE_HZ);
+        *tutc = boot_time_t + (ticks_since_boot / configTICK_RATE_HZ);
 
     uint16_t new_ms = (ticks_since_boot % configTICK_RATE_HZ) * 1000 / configTICK_RATE_HZ;
 
     if (ms)
         *ms = new_ms;
 
-    LOG_DEBUG("TUTC %d %d %d %d\n", _boot_ticks, new_ms, *tutc, _boot_time_t + ticks_since_boot / configTICK_RATE_HZ);
+    LOG_DEBUG("TUTC %d %d %d\n", _boot_ticks, new_ms, boot_time_t + ticks_since_boot / configTICK_RATE_HZ);
     return new_ms;
 }
 
@@ -34,12 +34,24 @@ typedef enum {
 } TimeUnits;
 typedef void(*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
 
+/* Most offset changes a zone is told about ahead */
+#define TIME_ZONE_TRANSITIONS 4
+
+/* From at on (UTC), the offset is offset seconds east of UTC */
+typedef struct TimeZoneTransition {
+    time_t at;
+    int32_t offset;
+} TimeZoneTransition;
+
 void rcore_time_init(void);
 time_t rcore_mktime(struct tm *tm);
 void rcore_localtime(struct tm *tm, time_t time);
 struct tm *rcore_pbl_localtime(time_t *time);
 
 uint16_t rcore_time_ms(time_t *tutc, uint16_t *ms);
+void rcore_time_resync(void);
+void rcore_time_set(time_t t);
+void rcore_time_set_zone(int32_t offset, const TimeZoneTransition *transitions, uint8_t count);
 TickType_t rcore_time_to_ticks(time_t t, uint16_t ms);
 
 // private
@@ -21,11 +21,19 @@ void write_32(uint8_t *addr, int32_t val)
 
 
 /* Do delay for nTime milliseconds 
- * NOT safe unless scheduler is running
+ * From a task this sleeps, rounded up to a whole tick. Before the
+ * scheduler is up, or in an ISR, it has to spin
  */
 void delay_ms(uint32_t ms)
 {
-    vTaskDelay(pdMS_TO_TICKS(ms));
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || __get_IPSR())
+    {
+        while (ms--)
+            delay_us(1000);
+        return;
+    }
+    
+    vTaskDelay((ms * configTICK_RATE_HZ + 999) / 1000);
     return;   
 }
 
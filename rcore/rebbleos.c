@@ -7,6 +7,7 @@
 
 #include "FreeRTOS.h"
 #include "task.h"
+#include "event_groups.h"
 #include "stdio.h"
 #include "rebbleos.h"
 #include "watchdog.h"
@@ -14,13 +15,69 @@
 #include "overlay_manager.h"
 #include "notification_manager.h"
 #include "power.h"
+#include "boot_profile.h"
+#include "data_logging.h"
+#include "blobdb.h"
+#include "activity.h"
+#include "smartstrap.h"
+#include "crash_dump.h"
 
 typedef uint8_t (*mod_callback)(void);
 static TaskHandle_t _os_task;
-static SemaphoreHandle_t _os_init_sem;
 
 static void _os_thread(void *pvParameters);
-static void _module_init(mod_callback mod, const char *mod_name);
+static void _init_lane(void *pvParameters);
+
+static uint8_t _time_init(void);
+static uint8_t _late_init(void);
+static uint8_t _power_init(void);
+
+/* Boot modules, and what each has to wait for.
+ * Everything not waiting on anything else starts straight away: the boot
+ * is split over the OS thread and a helper lane, and async modules carry
+ * on in their own threads besides, so the slow steps -- the FPGA, the
+ * filesystem scan, the BT patch -- overlap. A module only blocks the ones
+ * that list it. Keep the table in an order that works run top to bottom */
+#define MOD(m) (1 << (OsModule##m))
+typedef struct os_module_t {
+    const char *name;
+    mod_callback init;
+    EventBits_t after;
+} os_module;
+
+static const os_module _modules[OsModuleMax] = {
+    [OsModuleCrc]           = { "CRC",           rcore_crc_init,        0 },
+    [OsModuleFlash]         = { "Flash Storage", flash_init,            MOD(Crc) },
+    [OsModuleCrashDump]     = { "Crash Dump",    crash_dump_init,       MOD(Flash) },
+    [OsModuleDisplay]       = { "Display",       display_init,          0 },
+    [OsModuleVibrate]       = { "Vibro",         vibrate_init,          0 },
+    [OsModuleButtons]       = { "Buttons",       rcore_buttons_init,    0 },
+    [OsModuleTime]          = { "Time",          _time_init,            0 },
+    [OsModuleAccel]         = { "Accel",         rcore_accel_init,      0 },
+    [OsModuleBacklight]     = { "Backlight",     rcore_backlight_init,  MOD(Accel) },
+    [OsModuleLate]          = { "Platform",      _late_init,            MOD(Display) | MOD(Flash) },
+    [OsModuleBluetooth]     = { "Bluetooth",     bluetooth_init,        MOD(Time) },
+    [OsModulePower]         = { "Power",         _power_init,           0 },
+    [OsModuleResources]     = { "Resources",     resource_init,         MOD(Flash) },
+    [OsModuleFonts]         = { "Fonts",         fonts_init,            MOD(Resources) },
+    [OsModuleNotifications] = { "Notifications", notification_init,     MOD(Flash) },
+    [OsModuleDataLogging]   = { "Data Logging",  data_logging_init,     MOD(Flash) },
+    [OsModuleBlobDb]        = { "BlobDB",        blobdb_init,           MOD(Flash) },
+    [OsModuleActivity]      = { "Activity",      activity_init,         MOD(Flash) | MOD(Time) | MOD(Accel) },
+    [OsModuleSmartstrap]    = { "Smartstrap",    smartstrap_init,       0 },
+    [OsModuleOverlay]       = { "Overlay",       overlay_window_init,   MOD(Display) | MOD(Fonts) },
+    [OsModuleAppManager]    = { "Main App",      appmanager_init,       MOD(Overlay) | MOD(Buttons) | MOD(Time) |
+                                                                        MOD(Backlight) | MOD(Notifications) },
+};
+
+/* a module's bit is set once it is up, whatever it came up as */
+static EventGroupHandle_t _mod_up;
+static StaticEventGroup_t _mod_up_buf;
+static uint8_t _mod_next;
+static TickType_t _mod_started[OsModuleMax];
+
+/* the helper lane runs off the RTOS heap, and gives it back once boot is done */
+#define INIT_LANE_STACK 1024
 
 
 /* The variable used to hold the queue's data structure. */
@@ -31,6 +88,11 @@ typedef struct os_msg_t {
 } os_msg;
 
 #define _QUEUE_LENGTH    2
+
+/* How often the battery voltage is read */
+#define OS_POWER_SAMPLE_MS 10000
+/* ...and every this many of those, the clock is checked against the RTC */
+#define OS_TIME_SYNC_SAMPLES 30
 #define _ITEM_SIZE       sizeof( os_msg )
 
 static StaticQueue_t _os_queue;
@@ -42,12 +104,13 @@ SystemSettings _system_settings =
 {
     .backlight_on_time = 3000,
     .backlight_intensity = 100, //%
+    .backlight_motion = 1,
 };
 
 
 void rebbleos_init(void)
 {   
-    _os_init_sem = xSemaphoreCreateBinary();
+    _mod_up = xEventGroupCreateStatic(&_mod_up_buf);
     _os_queue_handle = xQueueCreateStatic( _QUEUE_LENGTH,
                                  _ITEM_SIZE,
                                  _os_queue_buf,
@@ -55,6 +118,9 @@ void rebbleos_init(void)
 
     configASSERT( _os_queue_handle );
     
+    log_init();
+    /* before any module, they post from their ISRs */
+    defer_init();
     xTaskCreate(_os_thread, "OS", 1920, NULL, tskIDLE_PRIORITY + 6UL, &_os_task);
 }
 
@@ -62,113 +128,174 @@ char buf[100];
 static void _os_thread(void *pvParameters)
 {
     KERN_LOG("init", APP_LOG_LEVEL_INFO, "Starting Init...");
-    /* Load or init each module in an orderly fashion.
+    /* Load or init each module as soon as what it needs is up.
      * All modules support either sync or async loading
      * An async module might require such things as callbacks
      * or a delay before it is up. Once the module is up, it 
      * can report completion
      */
-    _module_init(flash_init,            "Flash Storage");
-    _module_init(vibrate_init,          "Vibro");
-    _module_init(display_init,          "Display");
-    _module_init(rcore_buttons_init,    "Buttons");
-    rtc_init();
-    rcore_time_init();
-    //rcore_ambient_init("Ambiance");
-    _module_init(rcore_backlight_init,  "Backlight");
-    platform_init_late();
-    rcore_watchdog_init_late();
-    KERN_LOG("OS", APP_LOG_LEVEL_INFO,  "Watchdog is ticking");
-    _module_init(bluetooth_init,        "Bluetooth");
-    power_init();
-    KERN_LOG("init", APP_LOG_LEVEL_INFO, "Power Init");
-
-    SYS_LOG("OS", APP_LOG_LEVEL_INFO,   "Init: Main hardware up. Starting OS modules");
-    _module_init(resource_init,         "Resources");
-    _module_init(notification_init,     "Notifications");
-    _module_init(overlay_window_init,   "Overlay");
-    _module_init(appmanager_init,       "Main App");
+    TickType_t boot = xTaskGetTickCount();
+    
+    /* no room for a second lane just means a slower boot */
+    if (xTaskCreate(_init_lane, "Init", INIT_LANE_STACK, NULL, tskIDLE_PRIORITY + 6UL, NULL) != pdPASS)
+        SYS_LOG("OS", APP_LOG_LEVEL_WARNING, "Init: one lane only");
+    _init_lane(NULL);
+    
+    EventBits_t all = (1 << OsModuleMax) - 1;
+    if ((xEventGroupWaitBits(_mod_up, all, pdFALSE, pdTRUE, pdMS_TO_TICKS(5000)) & all) != all)
+    {
+        SYS_LOG("OS", APP_LOG_LEVEL_ERROR, "Init: Async module Init Failed");
+        assert(!"Init: An async task failed to come up when it should!");
+    }
+    SYS_LOG("OS", APP_LOG_LEVEL_INFO, "Init: all up in %d ms", (xTaskGetTickCount() - boot) * portTICK_PERIOD_MS);
+    boot_profile_event(BootProfileAllUp);
 
     /* This is a runloop for all generic OS related stuff. */
     
     os_msg msg;
-    uint8_t count = 0;
+    TickType_t next_sample = xTaskGetTickCount() + pdMS_TO_TICKS(OS_POWER_SAMPLE_MS);
+    uint8_t samples = 0;
     while(1)
     {
-        /* block forever in slumber? */
-        if(xQueueReceive(_os_queue_handle, &(msg), pdMS_TO_TICKS(1000)))
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = (int32_t)(next_sample - now) > 0 ? next_sample - now : 0;
+        
+        /* asleep unless there is something to send, or the PMIC says so */
+        if (xQueueReceive(_os_queue_handle, &(msg), wait))
         {
-            bluetooth_send((uint8_t *)msg.data, msg.len);
+            if (msg.data)
+                bluetooth_send((uint8_t *)msg.data, msg.len);
+            else
+                power_update_charge_mode();
+            continue;
         }
         
-        /* Update the power detection. When interrupts are found remove me */
+        /* The battery has no interrupt. The charge mode is looked at too,
+         * in case the PMIC's never comes */
         power_update_charge_mode();
-                
-        if (count == 10)
+        power_update_battery();
+        if (++samples == OS_TIME_SYNC_SAMPLES)
         {
-            /* get battery voltage */
-            power_update_battery();
-            count = 0;
-            continue;
+            rcore_time_resync();
+            samples = 0;
         }
-        count++;
+        next_sample = xTaskGetTickCount() + pdMS_TO_TICKS(OS_POWER_SAMPLE_MS);
     }
 
     /* delete end done fin */
     vTaskDelete( NULL );
 }
 
+/*
+ * From an ISR. Data goes out over BT; no data is the PMIC saying the
+ * power state changed. A full queue already has the OS thread on its way
+ */
 void send_os_msg(char *data, size_t len)
 {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     os_msg msg = {
         .data = data,
         .len = len
     };
-    xQueueSendFromISR(_os_queue_handle, &msg, NULL);
+    xQueueSendFromISR(_os_queue_handle, &msg, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 
-static int8_t _last_init_result = -1;
-static void _module_init(mod_callback mod, const char *mod_name)
+static uint8_t _time_init(void)
 {
-    uint8_t mres = mod();
+    rtc_init();
+    rcore_time_init();
+    //rcore_ambient_init("Ambiance");
+    return INIT_RESP_OK;
+}
+
+static uint8_t _late_init(void)
+{
+    platform_init_late();
+    rcore_watchdog_init_late();
+    KERN_LOG("OS", APP_LOG_LEVEL_INFO,  "Watchdog is ticking");
+    return INIT_RESP_OK;
+}
+
+static uint8_t _power_init(void)
+{
+    power_init();
+    return INIT_RESP_OK;
+}
+
+/* Wee module is up. or at least no more work to do */   
+static void _module_up(OsModule mod, uint8_t mres)
+{
+    const char *mod_name = _modules[mod].name;
+    uint32_t ms = (xTaskGetTickCount() - _mod_started[mod]) * portTICK_PERIOD_MS;
+
+    boot_profile_module_end(mod);
 
-    /* are we going async? */
-    if (mres == INIT_RESP_ASYNC_WAIT)
-    {
-        /* Sleep and wait for the module to come up */
-        if (!xSemaphoreTake(_os_init_sem, pdMS_TO_TICKS(5000)))
-        {
-            SYS_LOG("OS", APP_LOG_LEVEL_ERROR, "Init: Async module Init Failed", mod_name);
-            assert(!"Init: An async task failed to come up when it should!");
-        }
-        else
-        {
-            mres = _last_init_result;
-        }
-    }
-    
-    /* Wee module is up. or at least no more work to do */   
     switch(mres)
     {
         case INIT_RESP_OK:
-            SYS_LOG("OS", APP_LOG_LEVEL_INFO, "Init: %s", mod_name);
+            SYS_LOG("OS", APP_LOG_LEVEL_INFO, "Init: %s (%d ms)", mod_name, ms);
             break;
         case INIT_RESP_NOT_SUPPORTED:
             SYS_LOG("OS", APP_LOG_LEVEL_WARNING, "Init: Module %s NOT supported", mod_name);
             break;
         case INIT_RESP_ERROR:
-            SYS_LOG("OS", APP_LOG_LEVEL_ERROR, "Init: Module %s broken.", mod_name);
+            SYS_LOG("OS", APP_LOG_LEVEL_ERROR, "Init: Module %s broken. (%d ms)", mod_name, ms);
     }
 
-    return;
-    
+    xEventGroupSetBits(_mod_up, 1 << mod);
+}
+
+/* Take modules off the table in order until there are none left, waiting
+ * on whatever each one needs. Taking them in order means anything we wait
+ * on has already been started by someone */
+static void _init_lane(void *pvParameters)
+{
+    for (;;)
+    {
+        taskENTER_CRITICAL();
+        uint8_t mod = _mod_next;
+        if (mod < OsModuleMax)
+            _mod_next++;
+        taskEXIT_CRITICAL();
+
+        if (mod >= OsModuleMax)
+            break;
+
+        const os_module *m = &_modules[mod];
+        if (m->after &&
+            (xEventGroupWaitBits(_mod_up, m->after, pdFALSE, pdTRUE, pdMS_TO_TICKS(5000)) & m->after) != m->after)
+        {
+            SYS_LOG("OS", APP_LOG_LEVEL_ERROR, "Init: %s gave up waiting", m->name);
+            assert(!"Init: An async task failed to come up when it should!");
+        }
+
+        _mod_started[mod] = xTaskGetTickCount();
+        boot_profile_module_start(mod);
+        uint8_t mres = m->init();
+
+        /* are we going async? it'll tell us when it's up */
+        if (mres != INIT_RESP_ASYNC_WAIT)
+            _module_up(mod, mres);
+    }
+
+    if (xTaskGetCurrentTaskHandle() != _os_task)
+        vTaskDelete(NULL);
+}
+
+void os_module_init_complete(OsModule module, uint8_t result)
+{
+    /* bluetooth says so again every time it power cycles */
+    if (xEventGroupGetBits(_mod_up) & (1 << module))
+        return;
+
+    _module_up(module, result);
 }
 
-void os_module_init_complete(uint8_t result)
+const char *os_module_name(OsModule module)
 {
-    _last_init_result = result;
-    xSemaphoreGive(_os_init_sem);
+    return _modules[module].name;
 }
 
 SystemSettings *rebbleos_get_settings(void)
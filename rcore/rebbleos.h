@@ -16,9 +16,11 @@
 #include "platform.h"
 #include "appmanager.h"
 #include "ambient.h"
+#include "gyro.h"
 #include "task.h"
 #include "semphr.h"
 #include "display.h"
+#include "frame_profile.h"
 #include "rebble_time.h"
 #include "main.h"
 #include "log.h"
@@ -26,6 +28,8 @@
 #include "flash.h"
 #include "resource.h"
 #include "rebble_util.h"
+#include "rebble_crc.h"
+#include "defer.h"
 #include "rbl_bluetooth.h"
 
 #define VERSION "v0.0.0.2"
@@ -42,13 +46,42 @@ typedef struct SystemSettings {
     uint16_t backlight_on_time;
     uint16_t vibrate_intensity;
     uint16_t vibrate_pattern;
+    uint8_t backlight_motion;  /* a flick of the wrist lights it */
     // may need 16t
     uint8_t modules_enabled_flag;
     uint8_t modules_error_flag;
 } SystemSettings;
 
+/* Everything brought up at boot, see _modules in rebbleos.c */
+typedef enum OsModule {
+    OsModuleCrc,
+    OsModuleFlash,
+    OsModuleCrashDump,
+    OsModuleDisplay,
+    OsModuleVibrate,
+    OsModuleButtons,
+    OsModuleTime,
+    OsModuleAccel,
+    OsModuleBacklight,
+    OsModuleLate,
+    OsModuleBluetooth,
+    OsModulePower,
+    OsModuleResources,
+    OsModuleFonts,
+    OsModuleNotifications,
+    OsModuleDataLogging,
+    OsModuleBlobDb,
+    OsModuleActivity,
+    OsModuleSmartstrap,
+    OsModuleOverlay,
+    OsModuleAppManager,
+    OsModuleMax
+} OsModule;
+
 void rebbleos_init(void);
-void os_module_init_complete(uint8_t result);
+void os_module_init_complete(OsModule module, uint8_t result);
+const char *os_module_name(OsModule module);
+void send_os_msg(char *data, size_t len);
 SystemSettings *rebbleos_get_settings(void);
 
 #define INIT_RESP_OK            0
@@ -8,6 +8,7 @@
 #include "rebbleos.h"
 #include "platform.h"
 #include "flash.h"
+#include "librebble.h"
 
 
 /* Configure Logging */
@@ -28,34 +29,216 @@ typedef struct ResHandleFileHeader
     uint32_t crc;
 } ResHandleFileHeader;
 
+/* Set in index for a resource mkpack stored LZ4 compressed. Its data is
+ * then the compressed length, as a uint32_t, followed by one LZ4 block.
+ * size is always what it unpacks to. The RAM tables keep it in offset */
+#define RES_FLAG_LZ4 0x80000000
+
+/* Check each fully loaded resource against its CRC. Comment out to trust
+ * the flash */
+#define RESOURCE_CHECK_CRC
+
+/* The resource tables, held in RAM so finding a resource doesn't cost a
+ * flash read. The system pack's is read at boot. Each app thread gets the
+ * table of the app it's running, read as the app is launched. We only
+ * keep what we use of each entry; anything past the end of the table
+ * goes to flash as before */
+#define RES_SYS_TABLE_MAX 254
+#define RES_APP_TABLE_MAX 128
+
+typedef struct ResTableEntry
+{
+    uint32_t offset;
+    uint32_t size;
+} ResTableEntry;
+
+typedef struct ResTable
+{
+    uint16_t startpage; /* of the resource file this is from */
+    uint16_t count;
+    ResTableEntry entries[RES_APP_TABLE_MAX];
+} ResTable;
+
+static ResTableEntry _sys_table[RES_SYS_TABLE_MAX] CCRAM;
+static uint16_t _sys_table_count;
+static ResTable _app_tables[MAX_APP_THREADS] CCRAM;
+/* read ahead for the app the launcher has highlighted, and handed over
+ * if that's the one that gets launched */
+static ResTable _staged_table CCRAM;
+
+
+/* System bitmaps are cached in their own heap, shared by every thread,
+ * so the same icon isn't read and decoded again by every app and overlay
+ * that shows it. They are read only.
+ *
+ * Each thread's references are counted separately. A thread drops them
+ * with gbitmap_destroy, or all at once when its caches are reset on the
+ * way into a new app, so a leaky app can't pin an icon forever. Bitmaps
+ * nobody holds stay loaded, and are evicted least recently used first
+ * when we need the room.
+ */
+#define RES_BITMAP_CACHE_ENTRIES 8
+
+typedef struct ResBitmapCache
+{
+    uint32_t resource_id;
+    GBitmap *bitmap; /* one allocation: the GBitmap, pixels, then palette */
+    uint8_t refs[MAX_APP_THREADS];
+    uint32_t last_used;
+} ResBitmapCache;
+
+static uint8_t _bitmap_heap[MEMORY_SIZE_RES_BITMAP_CACHE];
+static qarena_t *_bitmap_arena;
+static ResBitmapCache _bitmap_cache[RES_BITMAP_CACHE_ENTRIES];
+static uint32_t _bitmap_cache_clock;
+static SemaphoreHandle_t _bitmap_mutex;
+static StaticSemaphore_t _bitmap_mutex_buf;
+
+/* read a table's entries in a few at a time */
+#define RES_TABLE_CHUNK 16
+
+static uint16_t _resource_table_read(ResTableEntry *table, uint16_t max, struct fd *fd, uint32_t address)
+{
+    ResHandleFileHeader chunk[RES_TABLE_CHUNK];
+    uint32_t count;
+
+    if (fd)
+        fs_read(fd, &count, sizeof(count));
+    else
+        flash_read_bytes(address + RES_COUNT, (uint8_t *)&count, sizeof(count));
+
+    if (count > max)
+        count = max;
+
+    for (uint16_t i = 0; i < count; i += RES_TABLE_CHUNK)
+    {
+        uint16_t n = (count - i < RES_TABLE_CHUNK) ? count - i : RES_TABLE_CHUNK;
+
+        if (fd)
+        {
+            fs_seek(fd, RES_TABLE_START + i * sizeof(ResHandleFileHeader), FS_SEEK_SET);
+            fs_read(fd, chunk, n * sizeof(ResHandleFileHeader));
+        }
+        else
+            flash_read_bytes(address + RES_TABLE_START + i * sizeof(ResHandleFileHeader), (uint8_t *)chunk, n * sizeof(ResHandleFileHeader));
+
+        for (uint16_t j = 0; j < n; j++)
+        {
+            table[i + j].offset = chunk[j].offset | (chunk[j].index & RES_FLAG_LZ4);
+            table[i + j].size = chunk[j].size;
+        }
+    }
+
+    return count;
+}
 
 uint8_t resource_init()
 {
+    _bitmap_arena = qinit(_bitmap_heap, MEMORY_SIZE_RES_BITMAP_CACHE);
+    _bitmap_mutex = xSemaphoreCreateMutexStatic(&_bitmap_mutex_buf);
+
+    _sys_table_count = _resource_table_read(_sys_table, RES_SYS_TABLE_MAX, NULL, REGION_RES_START);
+    for (uint8_t i = 0; i < MAX_APP_THREADS; i++)
+        _app_tables[i].count = 0;
+    _staged_table.count = 0;
+    LOG_INFO("%d system resources", _sys_table_count);
+
     return 0;
 }
 
+/*
+ * Read the table of the app a thread is about to run. NULL for an app
+ * with no resource file of its own; lookups then go to flash
+ */
+void resource_app_table_load(AppThreadType thread_type, const struct file *file)
+{
+    ResTable *table = &_app_tables[thread_type];
+    struct fd fd;
+
+    table->count = 0;
+    if (!file || !file->size)
+        return;
+
+    if (_staged_table.count && _staged_table.startpage == file->startpage)
+    {
+        table->startpage = _staged_table.startpage;
+        table->count = _staged_table.count;
+        memcpy(table->entries, _staged_table.entries, _staged_table.count * sizeof(ResTableEntry));
+        _staged_table.count = 0;
+        return;
+    }
+
+    fs_open(&fd, file);
+    table->startpage = file->startpage;
+    table->count = _resource_table_read(table->entries, RES_APP_TABLE_MAX, &fd, 0);
+}
+
+/*
+ * Read the table of an app that might be launched next, so the launch
+ * doesn't have to. Only the app manager thread loads or stages tables
+ */
+void resource_app_table_prefetch(const struct file *file)
+{
+    struct fd fd;
+
+    if (!file || !file->size)
+        return;
+    if (_staged_table.count && _staged_table.startpage == file->startpage)
+        return;
+
+    fs_open(&fd, file);
+    _staged_table.count = 0;
+    _staged_table.startpage = file->startpage;
+    _staged_table.count = _resource_table_read(_staged_table.entries, RES_APP_TABLE_MAX, &fd, 0);
+}
+
 /* We pass around a pointer to the block of flash or memory where the resource lives */
 ResHandleFileHeader _resource_get_res_handle_header(ResHandle res_handle)
 {
     ResHandleFileHeader new_header;
     struct fd fd;
-    uint8_t is_system = res_handle > REGION_RES_START + RES_TABLE_START &&
-                        res_handle < REGION_RES_START + RES_TABLE_START + ((254) * sizeof(ResHandleFileHeader));
+    uint8_t is_system = res_handle >= REGION_RES_START + RES_TABLE_START &&
+                        res_handle < REGION_RES_START + RES_TABLE_START + ((RES_SYS_TABLE_MAX) * sizeof(ResHandleFileHeader));
 
     if (is_system)
     {
-        flash_read_bytes(res_handle, (uint8_t *)&new_header, sizeof(ResHandleFileHeader));
+        uint32_t idx = (res_handle - REGION_RES_START - RES_TABLE_START) / sizeof(ResHandleFileHeader);
+
+        if (idx < _sys_table_count)
+        {
+            new_header.index = (idx + 1) | (_sys_table[idx].offset & RES_FLAG_LZ4);
+            new_header.offset = _sys_table[idx].offset & ~RES_FLAG_LZ4;
+            new_header.size = _sys_table[idx].size;
+            new_header.crc = 0;
+        }
+        else
+            flash_read_bytes(res_handle, (uint8_t *)&new_header, sizeof(ResHandleFileHeader));
     }
     else
     {
         App *app = appmanager_get_current_app();
         assert(app && "No App?");
-        fs_open(&fd, &app->resource_file);
-        fs_seek(&fd, res_handle, FS_SEEK_SET);
-        /* get the resource from the flash.
-         * each resource is in a big array in the flash, so we get the offsets for the resouce
-         * by multiplying out by the size of each resource */
-        fs_read(&fd, &new_header, sizeof(ResHandleFileHeader));
+        AppThreadType thread_type = appmanager_get_thread_type();
+        ResTable *table = thread_type < MAX_APP_THREADS ? &_app_tables[thread_type] : NULL;
+        uint32_t idx = (res_handle - RES_TABLE_START) / sizeof(ResHandleFileHeader);
+
+        if (table && table->count && table->startpage == app->resource_file.startpage &&
+            res_handle >= RES_TABLE_START && idx < table->count)
+        {
+            new_header.index = (idx + 1) | (table->entries[idx].offset & RES_FLAG_LZ4);
+            new_header.offset = table->entries[idx].offset & ~RES_FLAG_LZ4;
+            new_header.size = table->entries[idx].size;
+            new_header.crc = 0;
+        }
+        else
+        {
+            fs_open(&fd, &app->resource_file);
+            fs_seek(&fd, res_handle, FS_SEEK_SET);
+            /* get the resource from the flash.
+             * each resource is in a big array in the flash, so we get the offsets for the resouce
+             * by multiplying out by the size of each resource */
+            fs_read(&fd, &new_header, sizeof(ResHandleFileHeader));
+        }
     }
 
     LOG_DEBUG("Resource sys:%d idx:%d adr:0x%x sz:%d", is_system, new_header.index, new_header.offset, new_header.size);
@@ -70,6 +253,28 @@ ResHandleFileHeader _resource_get_res_handle_header(ResHandle res_handle)
 }
 
 
+#ifdef RESOURCE_CHECK_CRC
+/* The RAM tables leave the CRC out, it's only wanted for full loads */
+static uint32_t _resource_get_crc(ResHandle res_handle, const struct file *file)
+{
+    uint32_t crc;
+    uint32_t at = res_handle + offsetof(ResHandleFileHeader, crc);
+
+    if (!file)
+    {
+        flash_read_bytes(at, (uint8_t *)&crc, sizeof(crc));
+        return crc;
+    }
+
+    struct fd fd;
+    fs_open(&fd, file);
+    fs_seek(&fd, at, FS_SEEK_SET);
+    fs_read(&fd, &crc, sizeof(crc));
+
+    return crc;
+}
+#endif
+
 bool _resource_is_sane(ResHandleFileHeader *res_handle)
 {
     size_t sz = res_handle->size;
@@ -89,6 +294,150 @@ bool _resource_is_sane(ResHandleFileHeader *res_handle)
     return true;
 }
 
+/* Compressed resources are read a chunk at a time as they unpack */
+#define RES_LZ4_CHUNK 64
+
+typedef struct ResStream
+{
+    struct fd *fd;      /* NULL for the system pack */
+    uint32_t address;   /* of the next chunk, for the system pack */
+    uint32_t left;      /* compressed bytes not read yet */
+    uint8_t pos;
+    uint8_t len;
+    uint8_t buf[RES_LZ4_CHUNK];
+} ResStream;
+
+static bool _res_stream_fill(ResStream *s)
+{
+    if (!s->left)
+        return false;
+
+    s->len = s->left < RES_LZ4_CHUNK ? s->left : RES_LZ4_CHUNK;
+    if (s->fd)
+        fs_read(s->fd, s->buf, s->len);
+    else
+    {
+        flash_read_bytes(s->address, s->buf, s->len);
+        s->address += s->len;
+    }
+    s->left -= s->len;
+    s->pos = 0;
+
+    return true;
+}
+
+static int _res_stream_byte(ResStream *s)
+{
+    if (s->pos == s->len && !_res_stream_fill(s))
+        return -1;
+
+    return s->buf[s->pos++];
+}
+
+/* LZ4 lengths of 15 carry on in bytes, until one isn't 255 */
+static int32_t _lz4_length(ResStream *s, int32_t len)
+{
+    int b;
+
+    if (len != 15)
+        return len;
+
+    do
+    {
+        if ((b = _res_stream_byte(s)) < 0)
+            return -1;
+        len += b;
+    } while (b == 255);
+
+    return len;
+}
+
+/*
+ * Unpack an LZ4 block straight into buffer, stopping once out_len bytes
+ * are out. Matches only ever look back at what we have written already,
+ * so there's nothing to keep but the chunk being read.
+ * Returns the bytes unpacked, -1 if the block is bad
+ */
+static int32_t _resource_lz4_unpack(ResStream *s, uint8_t *buffer, size_t out_len)
+{
+    size_t out = 0;
+
+    while (out < out_len)
+    {
+        int token = _res_stream_byte(s);
+        if (token < 0)
+            break;
+
+        int32_t len = _lz4_length(s, token >> 4);
+        if (len < 0)
+            return -1;
+
+        while (len)
+        {
+            if (s->pos == s->len && !_res_stream_fill(s))
+                return -1;
+
+            size_t n = s->len - s->pos;
+            if (n > (size_t)len)
+                n = len;
+            if (n > out_len - out)
+                n = out_len - out;
+            memcpy(buffer + out, s->buf + s->pos, n);
+            s->pos += n;
+            out += n;
+            len -= n;
+            if (out == out_len)
+                return out;
+        }
+
+        /* the last sequence is only literals */
+        int lo = _res_stream_byte(s);
+        if (lo < 0)
+            break;
+        int hi = _res_stream_byte(s);
+        uint32_t offset = lo | (hi << 8);
+        if (hi < 0 || !offset || offset > out)
+            return -1;
+
+        len = _lz4_length(s, token & 0xF);
+        if (len < 0)
+            return -1;
+
+        /* a byte at a time, as a match can overlap what it's making */
+        for (len += 4; len && out < out_len; len--, out++)
+            buffer[out] = buffer[out - offset];
+    }
+
+    return out;
+}
+
+static void _resource_load_lz4(ResHandleFileHeader resource_header, uint8_t *buffer, size_t max_length, const struct file *file)
+{
+    ResStream s;
+    struct fd fd;
+    uint32_t clen;
+    size_t want = (max_length && max_length < resource_header.size) ? max_length : resource_header.size;
+
+    s.pos = s.len = 0;
+    if (file)
+    {
+        fs_open(&fd, file);
+        fs_seek(&fd, APP_RES_START + resource_header.offset + 0xC, FS_SEEK_SET);
+        fs_read(&fd, &clen, sizeof(clen));
+        s.fd = &fd;
+    }
+    else
+    {
+        flash_read_bytes(REGION_RES_START + RES_START + resource_header.offset, (uint8_t *)&clen, sizeof(clen));
+        s.fd = NULL;
+        s.address = REGION_RES_START + RES_START + resource_header.offset + sizeof(clen);
+    }
+    s.left = clen;
+
+    if (_resource_lz4_unpack(&s, buffer, want) != want)
+        LOG_ERROR("Res: bad LZ4 data for res %d", resource_header.index & ~RES_FLAG_LZ4);
+}
+
 void _resource_load_file(ResHandleFileHeader resource_header, uint8_t *buffer, size_t max_length, const struct file *file)
 {
     LOG_DEBUG("Loading Start adr:0x%x", resource_header.offset);
@@ -99,6 +448,12 @@ void _resource_load_file(ResHandleFileHeader resource_header, uint8_t *buffer, s
         return;
     }
 
+    if (resource_header.index & RES_FLAG_LZ4)
+    {
+        _resource_load_lz4(resource_header, buffer, max_length, file);
+        return;
+    }
+
     if (!file)
     {
         flash_read_bytes(REGION_RES_START + RES_START + resource_header.offset, buffer, resource_header.size);
@@ -139,13 +494,64 @@ uint8_t *resource_fully_load_resource(ResHandle res_handle, const struct file *f
 
     _resource_load_file(_handle, buffer, 0, file);
 
+#ifdef RESOURCE_CHECK_CRC
+    uint32_t crc = rcore_crc32(buffer, sz);
+    if (crc != _resource_get_crc(res_handle, file))
+    {
+        LOG_ERROR("Res %d CRC 0x%x doesn't match", _handle.index & ~RES_FLAG_LZ4, crc);
+        app_free(buffer);
+        return NULL;
+    }
+#endif
+
     return buffer;
 }
 
+/*
+ * Point straight at a system resource in flash, where the flash is memory
+ * mapped, and it's stored uncompressed. NULL if it can't be. Give it back with resource_unmap
+ */
+const uint8_t *resource_map_flash(ResHandle res_handle, size_t *size)
+{
+    ResHandleFileHeader _handle = _resource_get_res_handle_header(res_handle);
+
+    if (!_handle.size || (_handle.index & RES_FLAG_LZ4))
+        return NULL;
+
+    const uint8_t *ptr = flash_map(REGION_RES_START + RES_START + _handle.offset, _handle.size);
+    if (ptr && size)
+        *size = _handle.size;
+
+    return ptr;
+}
+
+/*
+ * A read only resource, without copying it if we can help it. App
+ * resources are split over the filesystem's pages, so they, and everything
+ * on a platform that can't map flash, are loaded into the app heap instead
+ */
+const uint8_t *resource_map(ResHandle res_handle, const struct file *file, size_t *size)
+{
+    const uint8_t *ptr = NULL;
+
+    if (!file)
+        ptr = resource_map_flash(res_handle, size);
+
+    if (!ptr)
+        ptr = resource_fully_load_resource(res_handle, file, size);
+
+    return ptr;
+}
+
+void resource_unmap(const uint8_t *ptr)
+{
+    if (!flash_unmap(ptr))
+        app_free((void *)ptr);
+}
+
 uint8_t *resource_fully_load_id_system(uint32_t resource_id)
 {
     ResHandle res_handle = resource_get_handle_system(resource_id);
-    ResHandleFileHeader _handle = _resource_get_res_handle_header(res_handle);
     uint8_t *buffer = resource_fully_load_resource(res_handle, NULL, NULL);
 
     return buffer;
@@ -198,7 +604,28 @@ void resource_load(ResHandle resource_handle, uint8_t *buffer, size_t max_length
     _resource_load_file(_handle, buffer, max_length, &app->resource_file);
 }
 
+/*
+ * Load a system resource into a buffer the caller owns
+ */
+void resource_load_system(ResHandle resource_handle, uint8_t *buffer, size_t max_length)
+{
+    ResHandleFileHeader _handle = _resource_get_res_handle_header(resource_handle);
+
+    _resource_load_file(_handle, buffer, max_length, NULL);
+}
+
 size_t resource_load_byte_range(ResHandle res_handle, uint32_t start_offset, uint8_t *buffer, size_t num_bytes)
+{
+    App *app = appmanager_get_current_app();
+
+    return resource_load_byte_range_file(res_handle, &app->resource_file, start_offset, buffer, num_bytes);
+}
+
+/*
+ * Read part of a resource from file, or from the system resources if file
+ * is NULL. Returns the number of bytes read
+ */
+size_t resource_load_byte_range_file(ResHandle res_handle, const struct file *file, uint32_t start_offset, uint8_t *buffer, size_t num_bytes)
 {
     ResHandleFileHeader _handle = _resource_get_res_handle_header(res_handle);
 
@@ -208,15 +635,32 @@ size_t resource_load_byte_range(ResHandle res_handle, uint32_t start_offset, uin
         return 0;
     }
 
-    if (!_resource_is_sane(&_handle))
+    if (!_resource_is_sane(&_handle) || start_offset >= _handle.size)
         return 0;
 
-    size_t sz = _handle.size;
+    if (num_bytes > _handle.size - start_offset)
+        num_bytes = _handle.size - start_offset;
 
-    App *app = appmanager_get_current_app();
+    /* can't start part way into a compressed one, only unpack from the top */
+    if (_handle.index & RES_FLAG_LZ4)
+    {
+        if (start_offset)
+        {
+            LOG_ERROR("Res: can't read from %d into compressed res %d", start_offset, _handle.index & ~RES_FLAG_LZ4);
+            return 0;
+        }
+        _resource_load_lz4(_handle, buffer, num_bytes, file);
+        return num_bytes;
+    }
+
+    if (!file)
+    {
+        flash_read_bytes(REGION_RES_START + RES_START + _handle.offset + start_offset, buffer, num_bytes);
+        return num_bytes;
+    }
 
     struct fd fd;
-    fs_open(&fd, &app->resource_file);
+    fs_open(&fd, file);
     fs_seek(&fd, APP_RES_START + _handle.offset + 0xC + start_offset, FS_SEEK_SET);
     fs_read(&fd, buffer, num_bytes);
 
@@ -250,3 +694,177 @@ GBitmap *gbitmap_create_with_resource_proxy(uint32_t resource_id)
     return gbitmap_create_with_resource_app(resource_id, &app->resource_file);
 }
 
+
+static bool _bitmap_is_held(const ResBitmapCache *item)
+{
+    for (uint8_t i = 0; i < MAX_APP_THREADS; i++)
+        if (item->refs[i])
+            return true;
+
+    return false;
+}
+
+/* Free the least recently used bitmap nobody holds. False if there isn't one */
+static bool _bitmap_evict_one(void)
+{
+    ResBitmapCache *victim = NULL;
+
+    for (uint8_t i = 0; i < RES_BITMAP_CACHE_ENTRIES; i++)
+    {
+        ResBitmapCache *item = &_bitmap_cache[i];
+        if (!item->bitmap || _bitmap_is_held(item))
+            continue;
+        if (!victim || item->last_used < victim->last_used)
+            victim = item;
+    }
+
+    if (!victim)
+        return false;
+
+    LOG_DEBUG("Evicting bitmap %d", victim->resource_id);
+    qfree(_bitmap_arena, victim->bitmap);
+    victim->bitmap = NULL;
+    victim->resource_id = 0;
+    return true;
+}
+
+static ResBitmapCache *_bitmap_free_slot(void)
+{
+    for (uint8_t i = 0; i < RES_BITMAP_CACHE_ENTRIES; i++)
+        if (!_bitmap_cache[i].bitmap)
+            return &_bitmap_cache[i];
+
+    return NULL;
+}
+
+/*
+ * Move a bitmap decoded into the caller's heap into the shared one.
+ * NULL if it won't fit, in which case the caller keeps its copy. Call locked
+ */
+static ResBitmapCache *_bitmap_cache_store(uint32_t resource_id, GBitmap *decoded)
+{
+    size_t pixels = decoded->row_size_bytes * decoded->raw_bitmap_size.h;
+    size_t palette = decoded->palette ? decoded->palette_size * sizeof(GColor) : 0;
+    uint8_t *buffer;
+
+    ResBitmapCache *slot = _bitmap_free_slot();
+    if (!slot && _bitmap_evict_one())
+        slot = _bitmap_free_slot();
+    if (!slot)
+        return NULL;
+
+    while (!(buffer = qalloc(_bitmap_arena, sizeof(GBitmap) + pixels + palette)))
+    {
+        if (!_bitmap_evict_one())
+            return NULL;
+    }
+
+    GBitmap *bitmap = (GBitmap *)buffer;
+    memcpy(bitmap, decoded, sizeof(GBitmap));
+    bitmap->addr = buffer + sizeof(GBitmap);
+    memcpy(bitmap->addr, decoded->addr, pixels);
+    if (palette)
+    {
+        bitmap->palette = (GColor *)(bitmap->addr + pixels);
+        memcpy(bitmap->palette, decoded->palette, palette);
+    }
+    bitmap->free_data_on_destroy = false;
+    bitmap->free_palette_on_destroy = false;
+
+    memset(slot->refs, 0, sizeof(slot->refs));
+    slot->resource_id = resource_id;
+    slot->bitmap = bitmap;
+
+    return slot;
+}
+
+/*
+ * Get a shared, read only bitmap of a system resource. Give it back with
+ * gbitmap_destroy. If the cache is full of bitmaps in use you get a
+ * private copy in your own heap instead, which gbitmap_destroy also frees
+ */
+GBitmap *resource_bitmap_get(uint32_t resource_id)
+{
+    ResBitmapCache *item = NULL;
+    AppThreadType thread_type = appmanager_get_thread_type();
+
+    if (thread_type >= MAX_APP_THREADS)
+        return NULL;
+
+    xSemaphoreTake(_bitmap_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < RES_BITMAP_CACHE_ENTRIES; i++)
+    {
+        if (_bitmap_cache[i].bitmap && _bitmap_cache[i].resource_id == resource_id)
+        {
+            item = &_bitmap_cache[i];
+            break;
+        }
+    }
+
+    if (!item)
+    {
+        GBitmap *decoded = gbitmap_create_with_resource_uncached(resource_id);
+        if (!decoded || !decoded->addr)
+        {
+            xSemaphoreGive(_bitmap_mutex);
+            return decoded;
+        }
+
+        item = _bitmap_cache_store(resource_id, decoded);
+        if (!item)
+        {
+            xSemaphoreGive(_bitmap_mutex);
+            LOG_INFO("Bitmap cache full, %d stays in the caller's heap", resource_id);
+            return decoded;
+        }
+        n_gbitmap_destroy(decoded);
+    }
+
+    if (item->refs[thread_type] < UINT8_MAX)
+        item->refs[thread_type]++;
+    item->last_used = ++_bitmap_cache_clock;
+    GBitmap *bitmap = item->bitmap;
+    xSemaphoreGive(_bitmap_mutex);
+
+    return bitmap;
+}
+
+/*
+ * Drop a reference to a bitmap from resource_bitmap_get.
+ * False if bitmap isn't one of ours
+ */
+bool resource_bitmap_put(GBitmap *bitmap)
+{
+    AppThreadType thread_type = appmanager_get_thread_type();
+    uint8_t *p = (uint8_t *)bitmap;
+
+    if (p < _bitmap_heap || p >= _bitmap_heap + sizeof(_bitmap_heap))
+        return false;
+
+    xSemaphoreTake(_bitmap_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < RES_BITMAP_CACHE_ENTRIES; i++)
+    {
+        ResBitmapCache *item = &_bitmap_cache[i];
+        if (item->bitmap == bitmap && thread_type < MAX_APP_THREADS && item->refs[thread_type])
+            item->refs[thread_type]--;
+    }
+    xSemaphoreGive(_bitmap_mutex);
+
+    return true;
+}
+
+/*
+ * The calling thread is starting over; whatever it held, it doesn't now
+ */
+void resource_bitmap_cache_reset(void)
+{
+    AppThreadType thread_type = appmanager_get_thread_type();
+
+    if (thread_type >= MAX_APP_THREADS)
+        return;
+
+    xSemaphoreTake(_bitmap_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < RES_BITMAP_CACHE_ENTRIES; i++)
+        _bitmap_cache[i].refs[thread_type] = 0;
+    xSemaphoreGive(_bitmap_mutex);
+}
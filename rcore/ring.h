@@ -0,0 +1,160 @@
+#pragma once
+/* ring.h
+ * A lock-free byte ring for one producer and one consumer
+ * RebbleOS
+ *
+ * One side may be an ISR, the other a thread, with no critical section
+ * and no copy through the kernel. Each index is only ever written by its
+ * own side: the producer owns head, the consumer owns tail. Both run
+ * freely and are masked on use, so the size must be a power of two and
+ * full and empty are never confused.
+ *
+ * For more than one producer (ISRs that nest, say) this is not enough;
+ * serialise them first, or use a queue.
+ *
+ *   static uint8_t _rx_buf[512];
+ *   static ring _rx = RING_INIT(_rx_buf);
+ *
+ *   ISR:     n = ring_reserve(&_rx, &p); ... fill p[0..n) ...; ring_commit(&_rx, n);
+ *   thread:  n = ring_peek(&_rx, &p);    ... use p[0..n) ...;  ring_consume(&_rx, n);
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct ring {
+    uint8_t *buf;
+    uint32_t size;  /* power of two */
+    uint32_t head;  /* bytes ever committed, producer's */
+    uint32_t tail;  /* bytes ever consumed, consumer's */
+} ring;
+
+#define RING_INIT(b) { .buf = (b), .size = sizeof(b), .head = 0, .tail = 0 }
+
+/* The other side's index is read with acquire, so what it wrote to the
+ * buffer before moving it is seen. Ours is published with release, so the
+ * buffer is written before the index says so */
+#define _RING_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define _RING_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+/**
+ * @brief Set up a ring over buf. size must be a power of two
+ */
+static inline
+void ring_init(ring *r, uint8_t *buf, uint32_t size) {
+    r->buf = buf;
+    r->size = size;
+    r->head = r->tail = 0;
+}
+
+/**
+ * @brief Bytes waiting to be read. Either side
+ */
+static inline
+uint32_t ring_used(const ring *r) {
+    return _RING_LOAD(r->head) - _RING_LOAD(r->tail);
+}
+
+/**
+ * @brief Bytes that could be written. Either side
+ */
+static inline
+uint32_t ring_free(const ring *r) {
+    return r->size - ring_used(r);
+}
+
+/* Producer */
+
+/**
+ * @brief Point p at the free space, up to the end of the buffer.
+ * Returns how much there is in one piece. Nothing is the reader's until
+ * ring_commit; if it wraps, commit and reserve again for the rest
+ */
+static inline
+uint32_t ring_reserve(ring *r, uint8_t **p) {
+    uint32_t head = r->head;
+    uint32_t free = r->size - (head - _RING_LOAD(r->tail));
+    uint32_t ofs = head & (r->size - 1);
+    uint32_t to_end = r->size - ofs;
+
+    *p = r->buf + ofs;
+    return free < to_end ? free : to_end;
+}
+
+/**
+ * @brief Hand n reserved bytes over to the reader
+ */
+static inline
+void ring_commit(ring *r, uint32_t n) {
+    _RING_STORE(r->head, r->head + n);
+}
+
+/**
+ * @brief Copy in as much of data as fits, in at most two pieces.
+ * Returns how much that was
+ */
+static inline
+uint32_t ring_write(ring *r, const void *data, uint32_t len) {
+    const uint8_t *d = (const uint8_t *)data;
+    uint32_t done = 0;
+    uint8_t *p;
+
+    while (done < len) {
+        uint32_t n = ring_reserve(r, &p);
+        if (!n)
+            break;
+        if (n > len - done)
+            n = len - done;
+        memcpy(p, d + done, n);
+        ring_commit(r, n);
+        done += n;
+    }
+    return done;
+}
+
+/* Consumer */
+
+/**
+ * @brief Point p at what is waiting, up to the end of the buffer, without
+ * taking it. Returns how much there is in one piece
+ */
+static inline
+uint32_t ring_peek(ring *r, const uint8_t **p) {
+    uint32_t tail = r->tail;
+    uint32_t used = _RING_LOAD(r->head) - tail;
+    uint32_t ofs = tail & (r->size - 1);
+    uint32_t to_end = r->size - ofs;
+
+    *p = r->buf + ofs;
+    return used < to_end ? used : to_end;
+}
+
+/**
+ * @brief Done with n bytes from the peek, the producer may have them back
+ */
+static inline
+void ring_consume(ring *r, uint32_t n) {
+    _RING_STORE(r->tail, r->tail + n);
+}
+
+/**
+ * @brief Copy out up to len bytes. Returns how many
+ */
+static inline
+uint32_t ring_read(ring *r, void *data, uint32_t len) {
+    uint8_t *d = (uint8_t *)data;
+    uint32_t done = 0;
+    const uint8_t *p;
+
+    while (done < len) {
+        uint32_t n = ring_peek(r, &p);
+        if (!n)
+            break;
+        if (n > len - done)
+            n = len - done;
+        memcpy(d + done, p, n);
+        ring_consume(r, n);
+        done += n;
+    }
+    return done;
+}
@@ -0,0 +1,368 @@
+/* rocky.c
+ * Rocky.js watchfaces: the snapshot, the JS arena and the canvas
+ * RebbleOS
+ *
+ * A Rocky app's JavaScript comes as a resource, compiled ahead of time to
+ * the engine's bytecode snapshot. Nothing is parsed on the watch: the
+ * snapshot is mapped where the resource is, or on a platform that can't
+ * map it, read into the app heap in one go, and run from there. A
+ * resource of source rather than a snapshot is turned away.
+ *
+ * The engine's heap is an arena of its own, one block of the app heap
+ * with everything but ROCKY_APP_RESERVE in it, so the GC has a fixed
+ * space to work in and the rest of the app can't be starved by it. It
+ * all goes back in one free when the app quits.
+ *
+ * The canvas binding doesn't draw. Each call from JS goes into a batch,
+ * and when the draw handler returns the batch is drawn in one go, with
+ * colour and width changes that change nothing left out. If the batch
+ * fills up before then, what is in it is drawn and it starts again.
+ *
+ * The engine itself is a port, built in with ROCKY_ENGINE, that provides
+ * the rocky_engine_ calls. Without one, a Rocky app gets an empty event
+ * loop, as it always has.
+ */
+
+#include "rebbleos.h"
+#include "librebble.h"
+#include "resource.h"
+#include "qalloc.h"
+#include "rocky.h"
+
+typedef enum RockyOpType {
+    RockyOpFillColor,
+    RockyOpStrokeColor,
+    RockyOpStrokeWidth,
+    RockyOpFillRect,
+    RockyOpStrokeRect,
+    RockyOpLine,
+    RockyOpFillCircle,
+    RockyOpStrokeCircle,
+    RockyOpText,
+} RockyOpType;
+
+typedef struct RockyOp {
+    uint8_t type;
+    uint8_t arg;        /* colour or width */
+    int16_t v[4];
+    uint16_t text;      /* into the batch's text */
+} RockyOp;
+
+typedef struct RockyBatch {
+    RockyOp op[ROCKY_CANVAS_OPS];
+    uint16_t count;
+    char text[ROCKY_CANVAS_TEXT];
+    uint16_t text_used;
+} RockyBatch;
+
+static qarena_t *_arena;
+static RockyBatch *_batch;
+static GContext *_ctx;
+static Window *_window;
+
+/* The arena */
+
+void *rocky_alloc(size_t size)
+{
+    return qalloc(_arena, size);
+}
+
+void *rocky_realloc(void *ptr, size_t size)
+{
+    return qrealloc(_arena, ptr, size);
+}
+
+void rocky_free(void *ptr)
+{
+    qfree(_arena, ptr);
+}
+
+/* The canvas */
+
+static void _flush(void)
+{
+    /* what the context has, so changes to the same can be skipped */
+    int16_t fill = -1, stroke = -1, width = -1;
+    /* canvas defaults, black and 1 wide */
+    uint8_t want_fill = 0xC0, want_stroke = 0xC0, want_width = 1;
+
+    for (uint16_t i = 0; i < _batch->count; i++)
+    {
+        RockyOp *op = &_batch->op[i];
+        GRect r = GRect(op->v[0], op->v[1], op->v[2], op->v[3]);
+
+        switch (op->type)
+        {
+        case RockyOpFillColor:
+            want_fill = op->arg;
+            continue;
+        case RockyOpStrokeColor:
+            want_stroke = op->arg;
+            continue;
+        case RockyOpStrokeWidth:
+            want_width = op->arg;
+            continue;
+        case RockyOpFillRect:
+        case RockyOpFillCircle:
+        case RockyOpText:
+            if (fill != want_fill)
+            {
+                graphics_context_set_fill_color(_ctx, (GColor){ .argb = want_fill });
+                graphics_context_set_text_color(_ctx, (GColor){ .argb = want_fill });
+                fill = want_fill;
+            }
+            break;
+        default:
+            if (stroke != want_stroke)
+            {
+                graphics_context_set_stroke_color(_ctx, (GColor){ .argb = want_stroke });
+                stroke = want_stroke;
+            }
+            if (width != want_width)
+            {
+                graphics_context_set_stroke_width(_ctx, want_width);
+                width = want_width;
+            }
+            break;
+        }
+
+        switch (op->type)
+        {
+        case RockyOpFillRect:
+            graphics_fill_rect(_ctx, r, 0, GCornerNone);
+            break;
+        case RockyOpStrokeRect:
+            graphics_draw_rect(_ctx, r, 0, GCornerNone);
+            break;
+        case RockyOpLine:
+            graphics_draw_line(_ctx, GPoint(op->v[0], op->v[1]), GPoint(op->v[2], op->v[3]));
+            break;
+        case RockyOpFillCircle:
+            graphics_fill_circle(_ctx, GPoint(op->v[0], op->v[1]), op->v[2]);
+            break;
+        case RockyOpStrokeCircle:
+            graphics_draw_circle(_ctx, GPoint(op->v[0], op->v[1]), op->v[2]);
+            break;
+        case RockyOpText:
+            graphics_draw_text(_ctx, &_batch->text[op->text], fonts_get_system_font(FONT_KEY_GOTHIC_18),
+                               r, GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, NULL);
+            break;
+        }
+    }
+
+    /* the state carries on into the next batch */
+    _batch->count = 0;
+    _batch->text_used = 0;
+    _batch->op[_batch->count++] = (RockyOp){ .type = RockyOpFillColor, .arg = want_fill };
+    _batch->op[_batch->count++] = (RockyOp){ .type = RockyOpStrokeColor, .arg = want_stroke };
+    _batch->op[_batch->count++] = (RockyOp){ .type = RockyOpStrokeWidth, .arg = want_width };
+}
+
+static RockyOp *_op(uint8_t type)
+{
+    /* only from the draw handler */
+    if (!_ctx)
+        return NULL;
+
+    if (_batch->count == ROCKY_CANVAS_OPS)
+        _flush();
+
+    RockyOp *op = &_batch->op[_batch->count++];
+    op->type = type;
+    return op;
+}
+
+static void _op4(uint8_t type, int16_t a, int16_t b, int16_t c, int16_t d)
+{
+    RockyOp *op = _op(type);
+
+    if (!op)
+        return;
+    op->v[0] = a;
+    op->v[1] = b;
+    op->v[2] = c;
+    op->v[3] = d;
+}
+
+static void _op_arg(uint8_t type, uint8_t arg)
+{
+    RockyOp *op = _op(type);
+
+    if (op)
+        op->arg = arg;
+}
+
+void rocky_canvas_fill_color(uint8_t argb)
+{
+    _op_arg(RockyOpFillColor, argb);
+}
+
+void rocky_canvas_stroke_color(uint8_t argb)
+{
+    _op_arg(RockyOpStrokeColor, argb);
+}
+
+void rocky_canvas_stroke_width(uint8_t width)
+{
+    _op_arg(RockyOpStrokeWidth, width);
+}
+
+void rocky_canvas_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h)
+{
+    _op4(RockyOpFillRect, x, y, w, h);
+}
+
+void rocky_canvas_stroke_rect(int16_t x, int16_t y, int16_t w, int16_t h)
+{
+    _op4(RockyOpStrokeRect, x, y, w, h);
+}
+
+void rocky_canvas_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+    _op4(RockyOpLine, x0, y0, x1, y1);
+}
+
+void rocky_canvas_fill_circle(int16_t x, int16_t y, int16_t r)
+{
+    _op4(RockyOpFillCircle, x, y, r, 0);
+}
+
+void rocky_canvas_stroke_circle(int16_t x, int16_t y, int16_t r)
+{
+    _op4(RockyOpStrokeCircle, x, y, r, 0);
+}
+
+void rocky_canvas_text(const char *text, int16_t x, int16_t y, int16_t w, int16_t h)
+{
+    size_t len = strlen(text) + 1;
+    uint16_t at;
+
+    if (!_ctx || len > ROCKY_CANVAS_TEXT)
+        return;
+    /* the engine's string may not outlive the call, so it is copied */
+    if (_batch->count == ROCKY_CANVAS_OPS || _batch->text_used + len > ROCKY_CANVAS_TEXT)
+        _flush();
+
+    at = _batch->text_used;
+    memcpy(&_batch->text[at], text, len);
+    _batch->text_used += len;
+
+    _op4(RockyOpText, x, y, w, h);
+    _batch->op[_batch->count - 1].text = at;
+}
+
+void rocky_request_draw(void)
+{
+    if (_window)
+        layer_mark_dirty(window_get_root_layer(_window));
+}
+
+#ifdef ROCKY_ENGINE
+
+static void *_arena_block;
+static const uint8_t *_snapshot;
+
+static void _update_proc(Layer *layer, GContext *ctx)
+{
+    GRect bounds = layer_get_bounds(layer);
+
+    _ctx = ctx;
+    _batch->count = 0;
+    _batch->text_used = 0;
+    rocky_engine_draw(bounds.size.w, bounds.size.h);
+    _flush();
+    _ctx = NULL;
+}
+
+static void _tick(struct tm *tick_time, TimeUnits units_changed)
+{
+    rocky_engine_tick(RockyMinuteChange);
+    if (units_changed & HOUR_UNIT)
+        rocky_engine_tick(RockyHourChange);
+    if (units_changed & DAY_UNIT)
+        rocky_engine_tick(RockyDayChange);
+}
+
+static void _rocky_stop(void)
+{
+    tick_timer_service_unsubscribe();
+    rocky_engine_stop();
+    window_stack_remove(_window, false);
+    window_destroy(_window);
+    _window = NULL;
+    app_free(_arena_block);
+    _arena = NULL;
+    resource_unmap(_snapshot);
+    _snapshot = NULL;
+}
+
+static bool _rocky_start(uint16_t resource_id)
+{
+    App *app = appmanager_get_current_app();
+    TickType_t started = xTaskGetTickCount();
+    const RockySnapshotHeader *hdr;
+    uint32_t arena_size;
+    size_t size;
+
+    /* first, so a snapshot loaded into the heap isn't counted in the arena */
+    _snapshot = resource_map(resource_get_handle(resource_id), &app->resource_file, &size);
+    if (!_snapshot)
+    {
+        SYS_LOG("rocky", APP_LOG_LEVEL_ERROR, "no resource %d", resource_id);
+        return false;
+    }
+    hdr = (const RockySnapshotHeader *)_snapshot;
+    if (size < sizeof(*hdr) || hdr->magic != ROCKY_SNAPSHOT_MAGIC || hdr->version != ROCKY_SNAPSHOT_VERSION)
+    {
+        SYS_LOG("rocky", APP_LOG_LEVEL_ERROR, "resource %d isn't a snapshot we can run", resource_id);
+        goto unmap;
+    }
+
+    arena_size = app_heap_bytes_free();
+    arena_size = arena_size > ROCKY_APP_RESERVE ? arena_size - ROCKY_APP_RESERVE : 0;
+    if (arena_size < ROCKY_ARENA_MIN || !(_arena_block = app_malloc(arena_size)))
+    {
+        SYS_LOG("rocky", APP_LOG_LEVEL_ERROR, "%d bytes is not enough for JS", arena_size);
+        goto unmap;
+    }
+    _arena = qinit(_arena_block, arena_size);
+    _batch = rocky_alloc(sizeof(RockyBatch));
+
+    _window = window_create();
+    layer_set_update_proc(window_get_root_layer(_window), _update_proc);
+    window_stack_push(_window, false);
+
+    if (!_batch || !rocky_engine_start(_snapshot + sizeof(*hdr), size - sizeof(*hdr)))
+    {
+        SYS_LOG("rocky", APP_LOG_LEVEL_ERROR, "the snapshot didn't start");
+        _rocky_stop();
+        return false;
+    }
+    tick_timer_service_subscribe(MINUTE_UNIT, _tick);
+
+    SYS_LOG("rocky", APP_LOG_LEVEL_INFO, "started in %d ms, %d byte snapshot, %d of %d arena bytes used",
+            (xTaskGetTickCount() - started) * portTICK_PERIOD_MS, size, qusedbytes(_arena), arena_size);
+    return true;
+
+unmap:
+    resource_unmap(_snapshot);
+    _snapshot = NULL;
+    return false;
+}
+
+#endif
+
+void rocky_event_loop_with_resource(uint16_t resource_id)
+{
+#ifdef ROCKY_ENGINE
+    if (_rocky_start(resource_id))
+    {
+        app_event_loop();
+        _rocky_stop();
+        return;
+    }
+#else
+    SYS_LOG("rocky", APP_LOG_LEVEL_WARNING, "no JS engine in this build");
+#endif
+    app_event_loop();
+}
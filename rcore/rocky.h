@@ -0,0 +1,65 @@
+#pragma once
+/* rocky.h
+ * Rocky.js watchfaces: the snapshot, the JS arena and the canvas
+ * RebbleOS
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* "PJS\0" */
+#define ROCKY_SNAPSHOT_MAGIC    0x00534a50
+#define ROCKY_SNAPSHOT_VERSION  1
+
+/* Ahead of the engine's snapshot in the app's resource */
+typedef struct __attribute__((__packed__)) RockySnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+} RockySnapshotHeader;
+
+/* what the arena leaves of the app heap, for windows, layers and fonts */
+#define ROCKY_APP_RESERVE       (6 * 1024)
+/* less than this and the engine isn't started */
+#define ROCKY_ARENA_MIN         (16 * 1024)
+
+/* draw calls held before they go to the screen */
+#define ROCKY_CANVAS_OPS        96
+#define ROCKY_CANVAS_TEXT       512
+
+typedef enum RockyTick {
+    RockySecondChange,
+    RockyMinuteChange,
+    RockyHourChange,
+    RockyDayChange,
+} RockyTick;
+
+/* For an engine port */
+
+/* The JS heap. One block of the app heap, freed as one when the app quits */
+void *rocky_alloc(size_t size);
+void *rocky_realloc(void *ptr, size_t size);
+void rocky_free(void *ptr);
+
+/* From the engine's draw handler. Colours are GColor8 argb. Nothing is
+ * drawn until the handler returns */
+void rocky_canvas_fill_color(uint8_t argb);
+void rocky_canvas_stroke_color(uint8_t argb);
+void rocky_canvas_stroke_width(uint8_t width);
+void rocky_canvas_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h);
+void rocky_canvas_stroke_rect(int16_t x, int16_t y, int16_t w, int16_t h);
+void rocky_canvas_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+void rocky_canvas_fill_circle(int16_t x, int16_t y, int16_t r);
+void rocky_canvas_stroke_circle(int16_t x, int16_t y, int16_t r);
+void rocky_canvas_text(const char *text, int16_t x, int16_t y, int16_t w, int16_t h);
+
+/* the engine wants its draw handler run */
+void rocky_request_draw(void);
+
+/* What the engine port provides, in a ROCKY_ENGINE build. start runs the
+ * snapshot's top level, which registers its handlers; the snapshot stays
+ * where it is until stop */
+bool rocky_engine_start(const uint8_t *snapshot, size_t len);
+void rocky_engine_draw(int16_t w, int16_t h);
+void rocky_engine_tick(RockyTick tick);
+void rocky_engine_stop(void);
@@ -0,0 +1,151 @@
+/* sched_trace.c
+ * A timeline of what the scheduler did
+ * RebbleOS
+ *
+ * The kernel's trace hooks (see sched_trace.h) and the IRQ handlers that
+ * are marked up drop a small record into a ring as things happen. It is
+ * a flight recorder: it runs all the time, and the oldest records go.
+ *
+ * The dump stops recording, logs which task numbers are which tasks and
+ * then the ring, oldest first, a few records per line in hex.
+ * Utilities/schedtrace.py turns that into a Chrome trace, which
+ * chrome://tracing or Perfetto will show as a timeline.
+ */
+
+#include "rebbleos.h"
+#include "sched_trace.h"
+#include "watchdog.h"
+#include "endpoint.h"
+#include "crash_dump.h"
+
+#ifdef SCHED_TRACE
+
+/* a power of two. It's only for debugging, so it can have CCRAM */
+#define SCHED_TRACE_ENTRIES 1024
+#define SCHED_TRACE_PER_LINE 4
+
+static CCRAM SchedTraceRecord _trace[SCHED_TRACE_ENTRIES];
+static uint32_t _trace_count;
+static volatile bool _trace_paused;
+
+/*
+ * From the kernel's hooks, any task or ISR. The kernel is often already
+ * in a critical section, so this nests
+ */
+void sched_trace_record(uint8_t event, uint8_t arg, const void *obj)
+{
+    if (_trace_paused)
+        return;
+
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    SchedTraceRecord *r = &_trace[_trace_count++ & (SCHED_TRACE_ENTRIES - 1)];
+    r->cycles = hw_cycle_count();
+    r->event = event;
+    r->arg = arg;
+    r->obj = ((uint32_t)obj >> 2) & 0xFFFF;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/* The exception number is whatever is running now */
+void sched_trace_isr(uint8_t event)
+{
+    sched_trace_record(event, 0, (const void *)((SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) << 2));
+}
+
+static void _hex(char *out, const uint8_t *b, uint16_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    for (uint16_t j = 0; j < len; j++)
+    {
+        out[j * 2] = digits[b[j] >> 4];
+        out[j * 2 + 1] = digits[b[j] & 0xF];
+    }
+    out[len * 2] = 0;
+}
+
+/*
+ * Log the task names and the ring. Recording stops while we do, or the
+ * log would only trace itself
+ */
+void sched_trace_dump(void)
+{
+    static TaskStatus_t tasks[STACK_STATS_MAX];
+    char hex[sizeof(SchedTraceRecord) * SCHED_TRACE_PER_LINE * 2 + 1];
+
+    _trace_paused = true;
+
+    uint32_t count = _trace_count;
+    uint32_t first = count > SCHED_TRACE_ENTRIES ? count - SCHED_TRACE_ENTRIES : 0;
+    UBaseType_t ntasks = uxTaskGetSystemState(tasks, STACK_STATS_MAX, NULL);
+
+    SYS_LOG("strace", APP_LOG_LEVEL_INFO, "schedtrace %lu records, %lu dropped, %lu cycles/us",
+            count - first, first, hw_cycles_per_us());
+    for (UBaseType_t i = 0; i < ntasks; i++)
+        SYS_LOG("strace", APP_LOG_LEVEL_INFO, "schedtask %lu %s", tasks[i].xTaskNumber, tasks[i].pcTaskName);
+
+    for (uint32_t i = first; i < count; i += SCHED_TRACE_PER_LINE)
+    {
+        uint16_t n = count - i < SCHED_TRACE_PER_LINE ? count - i : SCHED_TRACE_PER_LINE;
+        SchedTraceRecord r[SCHED_TRACE_PER_LINE];
+
+        for (uint16_t j = 0; j < n; j++)
+            r[j] = _trace[(i + j) & (SCHED_TRACE_ENTRIES - 1)];
+        _hex(hex, (const uint8_t *)r, n * sizeof(SchedTraceRecord));
+        SYS_LOG("strace", APP_LOG_LEVEL_INFO, "schedtrace %s", hex);
+    }
+
+    /* start over, so the next dump is all new */
+    _trace_count = 0;
+    _trace_paused = false;
+}
+
+/* For crash_dump: the newest records, oldest first */
+void sched_trace_crash_spans(CrashDumpSpan span[2], uint32_t max)
+{
+    uint32_t count = _trace_count;
+    uint32_t n = max / sizeof(SchedTraceRecord);
+    uint32_t first, run;
+
+    if (n > count)
+        n = count;
+    if (n > SCHED_TRACE_ENTRIES)
+        n = SCHED_TRACE_ENTRIES;
+    first = (count - n) & (SCHED_TRACE_ENTRIES - 1);
+    run = SCHED_TRACE_ENTRIES - first < n ? SCHED_TRACE_ENTRIES - first : n;
+
+    span[0].data = &_trace[first];
+    span[0].len = run * sizeof(SchedTraceRecord);
+    span[1].data = _trace;
+    span[1].len = (n - run) * sizeof(SchedTraceRecord);
+}
+
+#else
+
+void sched_trace_record(uint8_t event, uint8_t arg, const void *obj)
+{
+}
+
+void sched_trace_isr(uint8_t event)
+{
+}
+
+void sched_trace_dump(void)
+{
+    SYS_LOG("strace", APP_LOG_LEVEL_INFO, "built without SCHED_TRACE");
+}
+
+void sched_trace_crash_spans(CrashDumpSpan span[2], uint32_t max)
+{
+    span[0].len = span[1].len = 0;
+}
+
+#endif
+
+/*
+ * Debug endpoint. Any packet gets the trace dumped to the log
+ */
+void process_sched_trace_packet(uint8_t *data, uint16_t len)
+{
+    sched_trace_dump();
+}
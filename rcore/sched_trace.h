@@ -0,0 +1,81 @@
+#pragma once
+/* sched_trace.h
+ * A timeline of what the scheduler did
+ * RebbleOS
+ *
+ * Included from FreeRTOSConfig.h, so it can't pull in FreeRTOS itself
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Uncomment to record task switches, queue and semaphore traffic, task
+ * notifications and interrupts into a ring. Dumped to the log by the
+ * debug endpoint, see Utilities/schedtrace.py to turn it into a Chrome
+ * trace. Off, every hook below compiles away to nothing */
+// #define SCHED_TRACE
+
+typedef enum SchedTraceEvent {
+    SchedTraceSwitchIn,      /* arg is the task number */
+    SchedTraceSwitchOut,
+    SchedTraceQueueSend,     /* arg is the queue type, obj the queue */
+    SchedTraceQueueSendIsr,
+    SchedTraceQueueReceive,
+    SchedTraceQueueReceiveIsr,
+    SchedTraceQueueBlockSend,
+    SchedTraceQueueBlockReceive,
+    SchedTraceNotify,        /* arg is the task notified */
+    SchedTraceNotifyIsr,
+    SchedTraceNotifyTake,
+    SchedTraceIsrEnter,      /* obj is the exception number */
+    SchedTraceIsrExit,
+} SchedTraceEvent;
+
+/* Queues are told apart by address, (addr >> 2) & 0xFFFF. The cycles
+ * are the core cycle counter, which wraps about every 40s and stops in
+ * STOP mode */
+typedef struct __attribute__((__packed__)) SchedTraceRecord {
+    uint32_t cycles;
+    uint8_t event;
+    uint8_t arg;
+    uint16_t obj;
+} SchedTraceRecord;
+
+void sched_trace_record(uint8_t event, uint8_t arg, const void *obj);
+void sched_trace_isr(uint8_t event);
+void sched_trace_dump(void);
+void process_sched_trace_packet(uint8_t *data, uint16_t len);
+
+#ifdef SCHED_TRACE
+
+#  define SCHED_TRACE_SWITCHED_IN() \
+    sched_trace_record(SchedTraceSwitchIn, pxCurrentTCB->uxTCBNumber, NULL)
+#  define traceTASK_SWITCHED_OUT() \
+    sched_trace_record(SchedTraceSwitchOut, pxCurrentTCB->uxTCBNumber, NULL)
+
+/* A semaphore give is a send, a take a receive */
+#  define traceQUEUE_SEND(q)              sched_trace_record(SchedTraceQueueSend, (q)->ucQueueType, (q))
+#  define traceQUEUE_SEND_FROM_ISR(q)     sched_trace_record(SchedTraceQueueSendIsr, (q)->ucQueueType, (q))
+#  define traceQUEUE_RECEIVE(q)           sched_trace_record(SchedTraceQueueReceive, (q)->ucQueueType, (q))
+#  define traceQUEUE_RECEIVE_FROM_ISR(q)  sched_trace_record(SchedTraceQueueReceiveIsr, (q)->ucQueueType, (q))
+#  define traceBLOCKING_ON_QUEUE_SEND(q)    sched_trace_record(SchedTraceQueueBlockSend, (q)->ucQueueType, (q))
+#  define traceBLOCKING_ON_QUEUE_RECEIVE(q) sched_trace_record(SchedTraceQueueBlockReceive, (q)->ucQueueType, (q))
+
+#  define traceTASK_NOTIFY()              sched_trace_record(SchedTraceNotify, pxTCB->uxTCBNumber, NULL)
+#  define traceTASK_NOTIFY_FROM_ISR()     sched_trace_record(SchedTraceNotifyIsr, pxTCB->uxTCBNumber, NULL)
+#  define traceTASK_NOTIFY_GIVE_FROM_ISR() sched_trace_record(SchedTraceNotifyIsr, pxTCB->uxTCBNumber, NULL)
+#  define traceTASK_NOTIFY_TAKE()         sched_trace_record(SchedTraceNotifyTake, pxCurrentTCB->uxTCBNumber, NULL)
+#  define traceTASK_NOTIFY_WAIT()         sched_trace_record(SchedTraceNotifyTake, pxCurrentTCB->uxTCBNumber, NULL)
+
+/* FreeRTOS 9 has no interrupt hooks of its own. Put these first and last
+ * in an IRQ handler */
+#  define traceISR_ENTER()                sched_trace_isr(SchedTraceIsrEnter)
+#  define traceISR_EXIT()                 sched_trace_isr(SchedTraceIsrExit)
+
+#else
+
+#  define SCHED_TRACE_SWITCHED_IN()
+#  define traceISR_ENTER()
+#  define traceISR_EXIT()
+
+#endif
@@ -1,6 +1,1089 @@
 /* smartstrap.c
- * routines for [...]
+ * Smartstraps: the strap protocol on its own port, and attributes for apps
  * RebbleOS
  *
  * Author: Barry Carter <barry.carter@gmail.com>
+ *
+ * The strap talks HDLC-style frames on one wire: a flag either end, 0x7d
+ * escaping, a version, flags, a profile and a CRC-8. Link control brings
+ * it up at 9600 and then to the fastest rate it says it has; raw data
+ * and the generic service carry what apps read and write. A strap with
+ * something to say sends a break, and is asked what about.
+ *
+ * Nothing here is per byte. The port receives by circular DMA into
+ * _rx_buf, and its interrupt, at half and full and when the line goes
+ * quiet, only commits what has come into a ring over that buffer and
+ * wakes the smartstrap thread. The thread takes the ring a contiguous
+ * run at a time, and unstuffs it a run between escapes at a time, with
+ * memchr to find its way back to a flag. Going out, a frame is stuffed
+ * and CRCed whole into _tx and goes into the port's DMA ring in one
+ * write. So the interrupt rate is that of the DMA, whatever the strap
+ * streams at.
+ *
+ * Apps' attributes are on their heap, and hang off _attrs while they
+ * live. One request is on the wire at a time, in the order the
+ * attributes were made; reads, writes, notifications and services coming
+ * and going are told to the app on its own thread through
+ * APP_SERVICE_SMARTSTRAP. The port is only up while the app has
+ * subscribed or has attributes.
+ */
+
+#include "rebbleos.h"
+#include "ring.h"
+#include "smartstrap.h"
+
+#define STACK_SZ_SMARTSTRAP (configMINIMAL_STACK_SIZE + 200)
+
+/* the most an attribute holds */
+#define SS_DATA_MAX         512
+#define SS_SERVICES_MAX     16
+#define SS_EVENTS           16
+
+#define SS_FLAG             0x7e
+#define SS_ESCAPE           0x7d
+#define SS_ESCAPE_XOR       0x20
+#define SS_BREAK            0x00
+
+/* version, flags, profile; the CRC after the payload */
+#define SS_FRAME_VERSION    1
+#define SS_FRAME_HEADER     7
+#define SS_FLAG_READ        (1 << 0)
+#define SS_FLAG_MASTER      (1 << 1)
+#define SS_FLAG_NOTIFY      (1 << 2)
+
+#define SS_PROFILE_LINK     1
+#define SS_PROFILE_RAW      2
+#define SS_PROFILE_GENERIC  3
+
+#define SS_LINK_VERSION     1
+#define SS_LINK_STATUS      1
+#define SS_LINK_PROFILES    2
+#define SS_LINK_BAUD        3
+#define SS_STATUS_OK        0
+#define SS_STATUS_BAUD      1
+#define SS_STATUS_DISCONNECT 2
+
+/* version, service, attribute, type, error, length; then the data */
+#define SS_GENERIC_VERSION  1
+#define SS_GENERIC_HEADER   9
+#define SS_GENERIC_READ     0
+#define SS_GENERIC_WRITE    1
+#define SS_GENERIC_WRITE_READ 2
+
+#define SS_MANAGEMENT_SERVICE 0x0101
+#define SS_ATTR_DISCOVERY   0x0001
+#define SS_ATTR_NOTIFY_INFO 0x0002
+
+#define SS_FRAME_MAX        (SS_FRAME_HEADER + SS_GENERIC_HEADER + SS_DATA_MAX + 1)
+
+#define SS_BAUD_INITIAL     9600
+#define SS_LINK_TIMEOUT     pdMS_TO_TICKS(250)
+/* looking for a strap, and seeing it's still there */
+#define SS_PROBE_PERIOD     pdMS_TO_TICKS(1000)
+#define SS_PING_PERIOD      pdMS_TO_TICKS(5000)
+#define SS_PING_MISSES      3
+
+/* what the thread is woken with */
+#define SS_NOTIFY_RX        (1 << 0)
+#define SS_NOTIFY_KICK      (1 << 1)
+#define SS_NOTIFY_RUN       (1 << 2)
+
+static const uint32_t _bauds[] = {
+    9600, 14400, 19200, 28800, 38400, 57600, 62500, 115200, 125000, 230400, 250000, 460800
+};
+
+typedef enum SsAttrState {
+    SsAttrIdle,
+    SsAttrWriting,     /* the app has the buffer, between begin and end */
+    SsAttrQueued,
+    SsAttrInFlight,
+    SsAttrDelivering,  /* done, and the app not told yet */
+} SsAttrState;
+
+struct SmartstrapAttribute {
+    SmartstrapAttribute *next;
+    SmartstrapServiceId service_id;
+    SmartstrapAttributeId attribute_id;
+    uint8_t state;
+    uint8_t type;   /* SS_GENERIC_, what is asked of it */
+    uint16_t len;   /* to write, or that was read */
+    uint16_t size;
+    uint8_t buf[];
+};
+
+typedef enum SsState {
+    SsOff,
+    SsProbing,
+    SsLinking,
+    SsConnected,
+} SsState;
+
+/* the request on the wire. The link ones are their SS_LINK_ types */
+typedef enum SsOpKind {
+    SsOpNone,
+    SsOpStatus = SS_LINK_STATUS,
+    SsOpProfiles = SS_LINK_PROFILES,
+    SsOpBaud = SS_LINK_BAUD,
+    SsOpDiscover,
+    SsOpNotifyInfo,
+    SsOpAttr,
+} SsOpKind;
+
+typedef struct SsOp {
+    uint8_t kind;
+    SmartstrapServiceId service_id;
+    SmartstrapAttributeId attribute_id;
+    SmartstrapAttribute *attr;  /* NULL once the app destroys it */
+    TickType_t deadline;
+} SsOp;
+
+typedef enum SsEventKind {
+    SsEventRead,
+    SsEventWrite,
+    SsEventNotify,
+    SsEventAvailability,
+} SsEventKind;
+
+typedef struct SsEvent {
+    uint8_t kind;
+    uint8_t result;     /* or, for availability, whether it is */
+    bool done;          /* the attribute is the app's again once told */
+    SmartstrapServiceId service_id;
+    SmartstrapAttribute *attr;
+} SsEvent;
+
+static TaskHandle_t _ss_task;
+static StaticTask_t _ss_task_buf;
+static StackType_t _ss_task_stack[STACK_SZ_SMARTSTRAP];
+static void _ss_thread(void *pvParameters);
+
+static SemaphoreHandle_t _ss_mutex;
+static StaticSemaphore_t _ss_mutex_buf;
+
+static bool _present;
+static uint8_t _crc_table[256];
+
+/* the DMA's, and the ring the ISR keeps over it */
+static uint8_t _rx_buf[1024];
+static ring _rx = RING_INIT(_rx_buf);
+static uint32_t _rx_overruns;
+
+/* everything below is under the mutex */
+static SmartstrapHandlers _handlers;
+static bool _subscribed;
+static SmartstrapAttribute *_attrs;
+static TickType_t _timeout = pdMS_TO_TICKS(SMARTSTRAP_TIMEOUT_DEFAULT);
+static bool _want;
+
+static SsEvent _events[SS_EVENTS];
+static uint8_t _ev_head, _ev_tail;
+
+/* and these are the thread's */
+static bool _running;
+static SsState _state;
+static SsOp _op;
+static uint32_t _baud;
+static bool _has_raw, _has_generic;
+static SmartstrapServiceId _services[SS_SERVICES_MAX];
+static uint8_t _nservices;
+static TickType_t _probe_at;
+static TickType_t _last_heard;
+static uint8_t _misses;
+static bool _notify_pending;
+
+static uint8_t _frame[SS_FRAME_MAX];
+static uint16_t _frame_len;
+static bool _frame_sync, _frame_escape;
+static uint32_t _bad_frames;
+
+static uint8_t _tx[2 * SS_FRAME_MAX + 2];
+static uint16_t _tx_len;
+static uint8_t _tx_crc;
+
+uint8_t smartstrap_init(void)
+{
+    _ss_mutex = xSemaphoreCreateMutexStatic(&_ss_mutex_buf);
+    _present = hw_smartstrap_init();
+    if (!_present)
+    {
+        KERN_LOG("strap", APP_LOG_LEVEL_INFO, "No smartstrap port");
+        return 0;
+    }
+
+    /* CRC-8, x^8 + x^5 + x^3 + x^2 + x + 1, a byte at a time */
+    for (int i = 0; i < 256; i++)
+    {
+        uint8_t c = i;
+        for (int b = 0; b < 8; b++)
+            c = (c & 0x80) ? (c << 1) ^ 0x2f : c << 1;
+        _crc_table[i] = c;
+    }
+
+    _ss_task = xTaskCreateStatic(_ss_thread, "Strap", STACK_SZ_SMARTSTRAP, NULL,
+                                 tskIDLE_PRIORITY + 4UL, _ss_task_stack, &_ss_task_buf);
+    return 0;
+}
+
+static uint8_t _crc8(uint8_t crc, const uint8_t *p, size_t n)
+{
+    while (n--)
+        crc = _crc_table[crc ^ *p++];
+    return crc;
+}
+
+/* how far into p before a byte that has to be escaped */
+static size_t _run(const uint8_t *p, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        if (p[i] == SS_FLAG || p[i] == SS_ESCAPE)
+            break;
+    return i;
+}
+
+/*
+ * From the port's interrupt: commit what the DMA has written since last
+ * time, and leave it to the thread
+ */
+static void _rx_isr(void)
+{
+    BaseType_t woken = pdFALSE;
+    uint32_t pos = hw_smartstrap_rx_pos();
+    uint32_t fresh = (pos - _rx.head) & (_rx.size - 1);
+
+    if (!fresh)
+        return;
+
+    /* the thread is a buffer behind, and the DMA has been over what it
+     * hadn't taken. Whatever frame that was fails its CRC */
+    if (fresh > ring_free(&_rx))
+    {
+        fresh = ring_free(&_rx);
+        _rx_overruns++;
+    }
+    ring_commit(&_rx, fresh);
+
+    xTaskNotifyFromISR(_ss_task, SS_NOTIFY_RX, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/* Tell the app, next time round its loop */
+static void _event(uint8_t kind, uint8_t result, bool done, SmartstrapServiceId service_id,
+                   SmartstrapAttribute *attr)
+{
+    if ((uint8_t)(_ev_head - _ev_tail) == SS_EVENTS)
+    {
+        KERN_LOG("strap", APP_LOG_LEVEL_WARNING, "App is behind, event dropped");
+        if (attr && done)
+            attr->state = SsAttrIdle;
+        return;
+    }
+
+    /* a notification leaves the attribute as it was */
+    if (attr && kind != SsEventNotify)
+        attr->state = SsAttrDelivering;
+    _events[_ev_head % SS_EVENTS] = (SsEvent) {
+        .kind = kind,
+        .result = result,
+        .done = done,
+        .service_id = service_id,
+        .attr = attr,
+    };
+    _ev_head++;
+    appmanager_post_service_event(APP_SERVICE_SMARTSTRAP);
+}
+
+/* TX */
+
+static void _tx_put(const uint8_t *p, size_t n)
+{
+    _tx_crc = _crc8(_tx_crc, p, n);
+    while (n)
+    {
+        size_t run = _run(p, n);
+        memcpy(_tx + _tx_len, p, run);
+        _tx_len += run;
+        p += run;
+        n -= run;
+        if (!n)
+            break;
+        _tx[_tx_len++] = SS_ESCAPE;
+        _tx[_tx_len++] = *p++ ^ SS_ESCAPE_XOR;
+        n--;
+    }
+}
+
+/*
+ * A whole frame, stuffed into _tx, and out in one go
+ */
+static void _send(uint32_t flags, uint16_t profile, const uint8_t *head, size_t head_len,
+                  const uint8_t *data, size_t len)
+{
+    flags |= SS_FLAG_MASTER;
+    uint8_t hdr[SS_FRAME_HEADER] = {
+        SS_FRAME_VERSION, flags, flags >> 8, flags >> 16, flags >> 24, profile, profile >> 8
+    };
+    uint8_t crc;
+
+    _tx_len = 0;
+    _tx_crc = 0;
+    _tx[_tx_len++] = SS_FLAG;
+    _tx_put(hdr, sizeof(hdr));
+    _tx_put(head, head_len);
+    _tx_put(data, len);
+    crc = _tx_crc;
+    _tx_put(&crc, 1);
+    _tx[_tx_len++] = SS_FLAG;
+
+    hw_smartstrap_write(_tx, _tx_len);
+}
+
+static void _start_op(uint8_t kind, SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id,
+                      SmartstrapAttribute *attr, TickType_t timeout)
+{
+    _op.kind = kind;
+    _op.service_id = service_id;
+    _op.attribute_id = attribute_id;
+    _op.attr = attr;
+    _op.deadline = xTaskGetTickCount() + timeout;
+}
+
+static void _send_link(uint8_t type)
+{
+    uint8_t link[2] = { SS_LINK_VERSION, type };
+
+    _send(SS_FLAG_READ, SS_PROFILE_LINK, link, sizeof(link), NULL, 0);
+    _start_op(type, 0, 0, NULL, SS_LINK_TIMEOUT);
+}
+
+static void _send_generic(uint32_t flags, SmartstrapServiceId service_id, SmartstrapAttributeId attribute_id,
+                          uint8_t type, const uint8_t *data, uint16_t len)
+{
+    uint8_t head[SS_GENERIC_HEADER] = {
+        SS_GENERIC_VERSION, service_id, service_id >> 8, attribute_id, attribute_id >> 8,
+        type, 0, len, len >> 8
+    };
+
+    _send(flags, SS_PROFILE_GENERIC, head, sizeof(head), data, len);
+}
+
+static void _set_baud(uint32_t baud)
+{
+    if (baud == _baud)
+        return;
+    hw_smartstrap_set_baud(baud);
+    _baud = baud;
+}
+
+/* The link */
+
+static bool _available(SmartstrapServiceId service_id)
+{
+    for (int i = 0; i < _nservices; i++)
+        if (_services[i] == service_id)
+            return true;
+    return false;
+}
+
+static void _connected(const uint8_t *ids, uint16_t len)
+{
+    _state = SsConnected;
+    _misses = 0;
+    _nservices = 0;
+    if (_has_raw)
+        _services[_nservices++] = SMARTSTRAP_RAW_DATA_SERVICE_ID;
+    for (int i = 0; i + 1 < len && _nservices < SS_SERVICES_MAX; i += 2)
+        _services[_nservices++] = ids[i] | (ids[i + 1] << 8);
+
+    for (int i = 0; i < _nservices; i++)
+        _event(SsEventAvailability, true, false, _services[i], NULL);
+
+    KERN_LOG("strap", APP_LOG_LEVEL_INFO, "Connected at %lu baud, %d services", _baud, _nservices);
+}
+
+/*
+ * The strap has gone, or never came. Fail what it had, and go back to
+ * looking for it at the starting rate
+ */
+static void _disconnect(void)
+{
+    bool was = _state == SsConnected;
+
+    _op.kind = SsOpNone;
+    for (SmartstrapAttribute *a = _attrs; a; a = a->next)
+        if (a->state == SsAttrQueued || a->state == SsAttrInFlight)
+            _event(a->type == SS_GENERIC_READ ? SsEventRead : SsEventWrite, SmartstrapResultNotPresent, true,
+                   a->service_id, a);
+
+    if (was)
+    {
+        for (int i = 0; i < _nservices; i++)
+            _event(SsEventAvailability, false, false, _services[i], NULL);
+        KERN_LOG("strap", APP_LOG_LEVEL_INFO, "Disconnected. %lu bad frames, %lu overruns",
+                 _bad_frames, _rx_overruns);
+    }
+
+    _nservices = 0;
+    _notify_pending = false;
+    _misses = 0;
+    _state = SsProbing;
+    _probe_at = xTaskGetTickCount();
+    _set_baud(SS_BAUD_INITIAL);
+}
+
+/* RX */
+
+static void _link_reply(const uint8_t *p, uint16_t n)
+{
+    if (n < 3 || p[0] != SS_LINK_VERSION || p[1] != _op.kind)
+        return;
+    _op.kind = SsOpNone;
+
+    switch (p[1])
+    {
+        case SS_LINK_STATUS:
+            _misses = 0;
+            if (p[2] == SS_STATUS_DISCONNECT)
+                _disconnect();
+            else if (p[2] == SS_STATUS_BAUD)
+                _send_link(SS_LINK_BAUD);
+            else if (_state == SsProbing)
+            {
+                _state = SsLinking;
+                _send_link(SS_LINK_PROFILES);
+            }
+            break;
+        case SS_LINK_PROFILES:
+            _has_raw = _has_generic = false;
+            for (int i = 2; i + 1 < n; i += 2)
+            {
+                uint16_t profile = p[i] | (p[i + 1] << 8);
+                _has_raw |= profile == SS_PROFILE_RAW;
+                _has_generic |= profile == SS_PROFILE_GENERIC;
+            }
+            _send_link(SS_LINK_BAUD);
+            break;
+        case SS_LINK_BAUD:
+            if (p[2] < sizeof(_bauds) / sizeof(_bauds[0]))
+                _set_baud(_bauds[p[2]]);
+            if (_state == SsConnected)
+                break;
+            if (_has_generic)
+            {
+                _send_generic(SS_FLAG_READ, SS_MANAGEMENT_SERVICE, SS_ATTR_DISCOVERY, SS_GENERIC_READ, NULL, 0);
+                _start_op(SsOpDiscover, SS_MANAGEMENT_SERVICE, SS_ATTR_DISCOVERY, NULL, SS_LINK_TIMEOUT);
+            }
+            else
+                _connected(NULL, 0);
+            break;
+    }
+}
+
+/*
+ * The attribute's answer. Read into its buffer, and the app told
+ */
+static void _attr_reply(uint8_t error, const uint8_t *data, uint16_t len)
+{
+    SmartstrapAttribute *a = _op.attr;
+    uint8_t result = error ? SmartstrapResultAttributeUnsupported : SmartstrapResultOk;
+
+    _op.kind = SsOpNone;
+    if (!a)
+        return;
+
+    if (len > a->size)
+        len = a->size;
+    memcpy(a->buf, data, len);
+    a->len = len;
+
+    if (a->type == SS_GENERIC_WRITE_READ)
+        _event(SsEventWrite, result, false, a->service_id, a);
+    _event(SsEventRead, result, true, a->service_id, a);
+}
+
+static void _generic_reply(const uint8_t *p, uint16_t n)
+{
+    if (n < SS_GENERIC_HEADER || p[0] != SS_GENERIC_VERSION)
+        return;
+
+    SmartstrapServiceId service_id = p[1] | (p[2] << 8);
+    SmartstrapAttributeId attribute_id = p[3] | (p[4] << 8);
+    uint8_t error = p[6];
+    uint16_t len = p[7] | (p[8] << 8);
+    const uint8_t *data = p + SS_GENERIC_HEADER;
+
+    if (len > n - SS_GENERIC_HEADER)
+        len = n - SS_GENERIC_HEADER;
+    if (!_op.kind || service_id != _op.service_id || attribute_id != _op.attribute_id)
+        return;
+
+    switch (_op.kind)
+    {
+        case SsOpDiscover:
+            _op.kind = SsOpNone;
+            _connected(data, error ? 0 : len);
+            break;
+        case SsOpNotifyInfo:
+            _op.kind = SsOpNone;
+            if (error || len < 4)
+                break;
+            service_id = data[0] | (data[1] << 8);
+            attribute_id = data[2] | (data[3] << 8);
+            for (SmartstrapAttribute *a = _attrs; a; a = a->next)
+                if (a->service_id == service_id && a->attribute_id == attribute_id)
+                {
+                    _event(SsEventNotify, SmartstrapResultOk, false, service_id, a);
+                    break;
+                }
+            break;
+        case SsOpAttr:
+            _attr_reply(error, data, len);
+            break;
+    }
+}
+
+static void _frame_done(const uint8_t *buf, uint16_t len)
+{
+    if (len < SS_FRAME_HEADER + 1 || _crc8(0, buf, len) || buf[0] != SS_FRAME_VERSION)
+    {
+        _bad_frames++;
+        return;
+    }
+
+    uint32_t flags = buf[1] | (buf[2] << 8) | (buf[3] << 16) | ((uint32_t)buf[4] << 24);
+    uint16_t profile = buf[5] | (buf[6] << 8);
+    const uint8_t *p = buf + SS_FRAME_HEADER;
+    uint16_t n = len - SS_FRAME_HEADER - 1;
+
+    /* ours, heard back on the one wire */
+    if (flags & SS_FLAG_MASTER)
+        return;
+
+    _last_heard = xTaskGetTickCount();
+    switch (profile)
+    {
+        case SS_PROFILE_LINK:
+            _link_reply(p, n);
+            break;
+        case SS_PROFILE_RAW:
+            if (_op.kind == SsOpAttr && _op.service_id == SMARTSTRAP_RAW_DATA_SERVICE_ID)
+                _attr_reply(0, p, n);
+            break;
+        case SS_PROFILE_GENERIC:
+            _generic_reply(p, n);
+            break;
+    }
+}
+
+/*
+ * Unstuff a run of what came in: whole runs between escapes and flags
+ * are copied at once, and outside a frame it skips straight to the next
+ * flag
+ */
+static void _decode(const uint8_t *p, uint32_t n)
+{
+    while (n)
+    {
+        if (!_frame_sync)
+        {
+            const uint8_t *flag = memchr(p, SS_FLAG, n);
+            if (!flag)
+                return;
+            n -= flag + 1 - p;
+            p = flag + 1;
+            _frame_sync = true;
+            _frame_len = 0;
+            _frame_escape = false;
+            continue;
+        }
+
+        if (_frame_escape)
+        {
+            _frame_escape = false;
+            if (*p == SS_FLAG || _frame_len == sizeof(_frame))
+            {
+                _bad_frames++;
+                _frame_sync = false;
+                continue;
+            }
+            _frame[_frame_len++] = *p++ ^ SS_ESCAPE_XOR;
+            n--;
+            continue;
+        }
+
+        /* a break between frames: the strap has something to say */
+        if (!_frame_len && *p == SS_BREAK)
+        {
+            _notify_pending = _state == SsConnected;
+            p++;
+            n--;
+            continue;
+        }
+
+        size_t run = _run(p, n);
+        if (_frame_len + run > sizeof(_frame))
+        {
+            _bad_frames++;
+            _frame_sync = false;
+            p += run;
+            n -= run;
+            continue;
+        }
+        memcpy(_frame + _frame_len, p, run);
+        _frame_len += run;
+        p += run;
+        n -= run;
+        if (!n)
+            break;
+
+        if (*p == SS_ESCAPE)
+            _frame_escape = true;
+        else
+        {
+            /* the end of one is the start of the next */
+            if (_frame_len)
+                _frame_done(_frame, _frame_len);
+            _frame_len = 0;
+        }
+        p++;
+        n--;
+    }
+}
+
+static void _rx_drain(void)
+{
+    const uint8_t *p;
+    uint32_t n;
+
+    while ((n = ring_peek(&_rx, &p)))
+    {
+        _decode(p, n);
+        ring_consume(&_rx, n);
+    }
+}
+
+/* The thread */
+
+static void _start_attr(SmartstrapAttribute *a)
+{
+    bool read = a->type != SS_GENERIC_WRITE;
+    const uint8_t *data = a->type == SS_GENERIC_READ ? NULL : a->buf;
+    uint16_t len = a->type == SS_GENERIC_READ ? 0 : a->len;
+
+    if (a->service_id == SMARTSTRAP_RAW_DATA_SERVICE_ID)
+        _send(read ? SS_FLAG_READ : 0, SS_PROFILE_RAW, NULL, 0, data, len);
+    else
+        _send_generic(read ? SS_FLAG_READ : 0, a->service_id, a->attribute_id, a->type, data, len);
+
+    /* a write alone has no answer, it's done once it's sent */
+    if (!read)
+    {
+        _event(SsEventWrite, SmartstrapResultOk, true, a->service_id, a);
+        return;
+    }
+
+    a->state = SsAttrInFlight;
+    _start_op(SsOpAttr, a->service_id, a->attribute_id, a, _timeout);
+}
+
+static void _op_timeout(void)
+{
+    uint8_t kind = _op.kind;
+    SmartstrapAttribute *a = _op.attr;
+
+    _op.kind = SsOpNone;
+    switch (kind)
+    {
+        case SsOpAttr:
+            if (a)
+                _event(a->type == SS_GENERIC_READ ? SsEventRead : SsEventWrite, SmartstrapResultTimeOut, true,
+                       a->service_id, a);
+            break;
+        case SsOpNotifyInfo:
+            break;
+        case SsOpStatus:
+            if (_state == SsConnected && ++_misses < SS_PING_MISSES)
+                break;
+            /* fall through */
+        default:
+            if (_state != SsProbing)
+                _disconnect();
+            break;
+    }
+}
+
+/*
+ * Whatever is due: a timeout, the next request, a look for the strap,
+ * or a ping to see it's still there
+ */
+static void _poll(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if (_op.kind)
+    {
+        if ((int32_t)(now - _op.deadline) < 0)
+            return;
+        _op_timeout();
+    }
+
+    switch (_state)
+    {
+        case SsProbing:
+            if ((int32_t)(now - _probe_at) < 0)
+                return;
+            _probe_at = now + SS_PROBE_PERIOD;
+            _send_link(SS_LINK_STATUS);
+            return;
+        case SsConnected:
+            break;
+        default:
+            return;
+    }
+
+    if (_notify_pending)
+    {
+        _notify_pending = false;
+        _send_generic(SS_FLAG_READ | SS_FLAG_NOTIFY, SS_MANAGEMENT_SERVICE, SS_ATTR_NOTIFY_INFO,
+                      SS_GENERIC_READ, NULL, 0);
+        _start_op(SsOpNotifyInfo, SS_MANAGEMENT_SERVICE, SS_ATTR_NOTIFY_INFO, NULL, _timeout);
+        return;
+    }
+
+    for (SmartstrapAttribute *a = _attrs; a; a = a->next)
+    {
+        if (a->state != SsAttrQueued)
+            continue;
+        _start_attr(a);
+        if (_op.kind)
+            return;
+    }
+
+    if ((int32_t)(now - _last_heard) >= SS_PING_PERIOD)
+        _send_link(SS_LINK_STATUS);
+}
+
+/* how long until _poll has something to do */
+static TickType_t _wait(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t at;
+
+    if (!_running)
+        return portMAX_DELAY;
+    if (_op.kind)
+        at = _op.deadline;
+    else if (_state == SsProbing)
+        at = _probe_at;
+    else
+        at = _last_heard + SS_PING_PERIOD;
+
+    return (int32_t)(at - now) > 0 ? at - now : 0;
+}
+
+/* Bring the port up or down, as the app wants it */
+static void _run_changed(void)
+{
+    if (_want && !_running)
+    {
+        ring_init(&_rx, _rx_buf, sizeof(_rx_buf));
+        _frame_sync = false;
+        hw_smartstrap_start(_rx_buf, sizeof(_rx_buf), _rx_isr);
+        _running = true;
+        _baud = SS_BAUD_INITIAL;
+        _state = SsProbing;
+        _probe_at = xTaskGetTickCount();
+    }
+    else if (!_want && _running)
+    {
+        _disconnect();
+        hw_smartstrap_stop();
+        _running = false;
+        _state = SsOff;
+    }
+}
+
+static void _ss_thread(void *pvParameters)
+{
+    uint32_t bits;
+
+    for (;;)
+    {
+        bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, _wait());
+
+        xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+        if (bits & SS_NOTIFY_RUN)
+            _run_changed();
+        if (_running)
+        {
+            _rx_drain();
+            _poll();
+        }
+        xSemaphoreGive(_ss_mutex);
+    }
+}
+
+/* The port runs while the app might want it. With the mutex */
+static void _update_running(void)
+{
+    bool want = _subscribed || _attrs;
+
+    if (want == _want)
+        return;
+    _want = want;
+    xTaskNotify(_ss_task, SS_NOTIFY_RUN, eSetBits);
+}
+
+/* App API */
+
+SmartstrapResult smartstrap_subscribe(SmartstrapHandlers handlers)
+{
+    if (!_present)
+        return SmartstrapResultNotPresent;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    _handlers = handlers;
+    _subscribed = true;
+    _update_running();
+    xSemaphoreGive(_ss_mutex);
+    return SmartstrapResultOk;
+}
+
+void smartstrap_unsubscribe(void)
+{
+    if (!_present)
+        return;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    memset(&_handlers, 0, sizeof(_handlers));
+    _subscribed = false;
+    _update_running();
+    xSemaphoreGive(_ss_mutex);
+}
+
+void smartstrap_set_timeout(uint16_t timeout_ms)
+{
+    _timeout = pdMS_TO_TICKS(timeout_ms);
+}
+
+bool smartstrap_service_is_available(SmartstrapServiceId service_id)
+{
+    bool available;
+
+    if (!_present)
+        return false;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    available = _state == SsConnected && _available(service_id);
+    xSemaphoreGive(_ss_mutex);
+    return available;
+}
+
+SmartstrapAttribute *smartstrap_attribute_create(SmartstrapServiceId service_id,
+                                                 SmartstrapAttributeId attribute_id,
+                                                 size_t buffer_length)
+{
+    if (!_present || !buffer_length || buffer_length > SS_DATA_MAX)
+        return NULL;
+
+    SmartstrapAttribute *a = app_calloc(1, sizeof(SmartstrapAttribute) + buffer_length);
+    if (!a)
+        return NULL;
+    a->service_id = service_id;
+    a->attribute_id = attribute_id;
+    a->size = buffer_length;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    /* at the end, so requests go in the order attributes were made */
+    SmartstrapAttribute **pp = &_attrs;
+    while (*pp)
+        pp = &(*pp)->next;
+    *pp = a;
+    _update_running();
+    xSemaphoreGive(_ss_mutex);
+
+    return a;
+}
+
+void smartstrap_attribute_destroy(SmartstrapAttribute *attribute)
+{
+    if (!attribute)
+        return;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    for (SmartstrapAttribute **pp = &_attrs; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == attribute)
+        {
+            *pp = attribute->next;
+            break;
+        }
+    }
+    /* an answer on its way has nowhere to go now */
+    if (_op.attr == attribute)
+        _op.attr = NULL;
+    for (uint8_t i = _ev_tail; i != _ev_head; i++)
+        if (_events[i % SS_EVENTS].attr == attribute)
+            _events[i % SS_EVENTS].attr = NULL;
+    _update_running();
+    xSemaphoreGive(_ss_mutex);
+
+    app_free(attribute);
+}
+
+SmartstrapServiceId smartstrap_attribute_get_service_id(SmartstrapAttribute *attribute)
+{
+    return attribute ? attribute->service_id : 0;
+}
+
+SmartstrapAttributeId smartstrap_attribute_get_attribute_id(SmartstrapAttribute *attribute)
+{
+    return attribute ? attribute->attribute_id : 0;
+}
+
+/*
+ * Queue a request on the attribute, if it isn't busy and the strap has
+ * its service. With the mutex
+ */
+static SmartstrapResult _queue(SmartstrapAttribute *a, uint8_t type)
+{
+    if (_state != SsConnected)
+        return SmartstrapResultNotPresent;
+    if (!_available(a->service_id))
+        return SmartstrapResultServiceUnavailable;
+
+    a->type = type;
+    a->state = SsAttrQueued;
+    xTaskNotify(_ss_task, SS_NOTIFY_KICK, eSetBits);
+    return SmartstrapResultOk;
+}
+
+SmartstrapResult smartstrap_attribute_read(SmartstrapAttribute *attribute)
+{
+    SmartstrapResult result;
+
+    if (!attribute)
+        return SmartstrapResultInvalidArgs;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    if (attribute->state != SsAttrIdle)
+        result = SmartstrapResultBusy;
+    else
+        result = _queue(attribute, SS_GENERIC_READ);
+    xSemaphoreGive(_ss_mutex);
+    return result;
+}
+
+SmartstrapResult smartstrap_attribute_begin_write(SmartstrapAttribute *attribute,
+                                                  uint8_t **buffer, size_t *buffer_length)
+{
+    SmartstrapResult result = SmartstrapResultOk;
+
+    if (!attribute || !buffer || !buffer_length)
+        return SmartstrapResultInvalidArgs;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    if (attribute->state != SsAttrIdle)
+        result = SmartstrapResultBusy;
+    else
+    {
+        attribute->state = SsAttrWriting;
+        *buffer = attribute->buf;
+        *buffer_length = attribute->size;
+    }
+    xSemaphoreGive(_ss_mutex);
+    return result;
+}
+
+SmartstrapResult smartstrap_attribute_end_write(SmartstrapAttribute *attribute,
+                                                size_t write_length, bool request_read)
+{
+    SmartstrapResult result;
+
+    if (!attribute || write_length > attribute->size)
+        return SmartstrapResultInvalidArgs;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    if (attribute->state != SsAttrWriting)
+        result = SmartstrapResultInvalidArgs;
+    else
+    {
+        attribute->len = write_length;
+        result = _queue(attribute, request_read ? SS_GENERIC_WRITE_READ : SS_GENERIC_WRITE);
+        if (result != SmartstrapResultOk)
+            attribute->state = SsAttrIdle;
+    }
+    xSemaphoreGive(_ss_mutex);
+    return result;
+}
+
+/*
+ * On the app's thread. The mutex isn't held over the handlers, so they
+ * can read and write again
+ */
+void smartstrap_deliver(void)
+{
+    SsEvent ev;
+    SmartstrapHandlers h;
+
+    if (!_present)
+        return;
+
+    for (;;)
+    {
+        xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+        if (_ev_tail == _ev_head)
+        {
+            xSemaphoreGive(_ss_mutex);
+            return;
+        }
+        ev = _events[_ev_tail % SS_EVENTS];
+        _ev_tail++;
+        if (ev.attr && ev.done)
+            ev.attr->state = SsAttrIdle;
+        h = _handlers;
+        xSemaphoreGive(_ss_mutex);
+
+        switch (ev.kind)
+        {
+            case SsEventRead:
+                if (ev.attr && h.did_read)
+                    h.did_read(ev.attr, ev.result, ev.attr->buf, ev.result == SmartstrapResultOk ? ev.attr->len : 0);
+                break;
+            case SsEventWrite:
+                if (ev.attr && h.did_write)
+                    h.did_write(ev.attr, ev.result);
+                break;
+            case SsEventNotify:
+                if (ev.attr && h.notified)
+                    h.notified(ev.attr);
+                break;
+            case SsEventAvailability:
+                if (h.availability_did_change)
+                    h.availability_did_change(ev.service_id, ev.result);
+                break;
+        }
+    }
+}
+
+/*
+ * Forget the app's attributes, they went with its heap, and let the port
+ * go
  */
+void smartstrap_app_reset(void)
+{
+    if (!_present)
+        return;
+
+    xSemaphoreTake(_ss_mutex, portMAX_DELAY);
+    memset(&_handlers, 0, sizeof(_handlers));
+    _subscribed = false;
+    _attrs = NULL;
+    _op.attr = NULL;
+    _ev_head = _ev_tail = 0;
+    _timeout = pdMS_TO_TICKS(SMARTSTRAP_TIMEOUT_DEFAULT);
+    _update_running();
+    xSemaphoreGive(_ss_mutex);
+}
@@ -1,6 +1,65 @@
-/* smartstrap.c
- * routines for [...]
+#pragma once
+/* smartstrap.h
+ * Smartstraps: the strap protocol on its own port, and attributes for apps
  * RebbleOS
  *
  * Author: Barry Carter <barry.carter@gmail.com>
  */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SMARTSTRAP_TIMEOUT_DEFAULT 250
+#define SMARTSTRAP_RAW_DATA_SERVICE_ID   0
+#define SMARTSTRAP_RAW_DATA_ATTRIBUTE_ID 0
+
+typedef enum {
+    SmartstrapResultOk = 0,
+    SmartstrapResultInvalidArgs,
+    SmartstrapResultNotPresent,
+    SmartstrapResultBusy,
+    SmartstrapResultServiceUnavailable,
+    SmartstrapResultAttributeUnsupported,
+    SmartstrapResultTimeOut,
+} SmartstrapResult;
+
+typedef uint16_t SmartstrapServiceId;
+typedef uint16_t SmartstrapAttributeId;
+typedef struct SmartstrapAttribute SmartstrapAttribute;
+
+typedef void (*SmartstrapServiceAvailabilityHandler)(SmartstrapServiceId service_id, bool is_available);
+typedef void (*SmartstrapReadHandler)(SmartstrapAttribute *attribute, SmartstrapResult result,
+                                      const uint8_t *data, size_t length);
+typedef void (*SmartstrapWriteHandler)(SmartstrapAttribute *attribute, SmartstrapResult result);
+typedef void (*SmartstrapNotifyHandler)(SmartstrapAttribute *attribute);
+
+typedef struct {
+    SmartstrapServiceAvailabilityHandler availability_did_change;
+    SmartstrapReadHandler did_read;
+    SmartstrapWriteHandler did_write;
+    SmartstrapNotifyHandler notified;
+} SmartstrapHandlers;
+
+SmartstrapResult smartstrap_subscribe(SmartstrapHandlers handlers);
+void smartstrap_unsubscribe(void);
+void smartstrap_set_timeout(uint16_t timeout_ms);
+bool smartstrap_service_is_available(SmartstrapServiceId service_id);
+
+SmartstrapAttribute *smartstrap_attribute_create(SmartstrapServiceId service_id,
+                                                 SmartstrapAttributeId attribute_id,
+                                                 size_t buffer_length);
+void smartstrap_attribute_destroy(SmartstrapAttribute *attribute);
+SmartstrapServiceId smartstrap_attribute_get_service_id(SmartstrapAttribute *attribute);
+SmartstrapAttributeId smartstrap_attribute_get_attribute_id(SmartstrapAttribute *attribute);
+SmartstrapResult smartstrap_attribute_read(SmartstrapAttribute *attribute);
+SmartstrapResult smartstrap_attribute_begin_write(SmartstrapAttribute *attribute,
+                                                  uint8_t **buffer, size_t *buffer_length);
+SmartstrapResult smartstrap_attribute_end_write(SmartstrapAttribute *attribute,
+                                                size_t write_length, bool request_read);
+
+uint8_t smartstrap_init(void);
+/* on the app's thread, for APP_SERVICE_SMARTSTRAP */
+void smartstrap_deliver(void);
+/* the app has gone, or is about to start */
+void smartstrap_app_reset(void);
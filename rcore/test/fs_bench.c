@@ -0,0 +1,222 @@
+/* fs_bench.c
+ * Counts the flash reads the filesystem and resources cost, natively on
+ * the desk, over a whole flash image. Built and run by `make fsbench`,
+ * see hw/platform/host
+ * RebbleOS
+ *
+ * Each phase is what the watch does at boot or on a launch: the resource
+ * and filesystem checks, the app manifest out of appdb, finding each
+ * app's files, and loading every resource, the system's and each app's.
+ * For each, the flash reads and bytes it took, and the filesystem's own
+ * counts, see fs_stats. Flash here is memory, so the time is only a guide;
+ * the reads are what the watch pays for. Run it before and after a change
+ * to an index or cache, on the same image, to see what it bought.
+ *
+ * The lookups and loads are run -n times. The first pass is cold, the
+ * rest are warm, and averaged.
+ *
+ *   fs_bench [-n passes] image
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include "rebbleos.h"
+#include "flash.h"
+#include "fs.h"
+
+#define BENCH_PASSES    5
+/* past either pack's table */
+#define BENCH_MAX_RES   512
+
+typedef struct BenchCount {
+    uint64_t ns;
+    FlashStats flash;
+    FsStats fs;
+    uint32_t items;
+} BenchCount;
+
+static const char *_names[] = { "appdb", "pmap", "appicons", "notifstr", "nosuchfile" };
+
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _start(BenchCount *c)
+{
+    flash_stats(&c->flash);
+    fs_stats(&c->fs);
+    c->items = 0;
+    c->ns = _now_ns();
+}
+
+/* what it cost since _start, added to total */
+static void _stop(BenchCount *c, BenchCount *total)
+{
+    FlashStats flash;
+    FsStats fs;
+
+    c->ns = _now_ns() - c->ns;
+    flash_stats(&flash);
+    fs_stats(&fs);
+
+    total->ns += c->ns;
+    total->items += c->items;
+    total->flash.reads += flash.reads - c->flash.reads;
+    total->flash.bytes += flash.bytes - c->flash.bytes;
+    total->fs.finds += fs.finds - c->fs.finds;
+    total->fs.find_headers += fs.find_headers - c->fs.find_headers;
+    total->fs.find_scans += fs.find_scans - c->fs.find_scans;
+    total->fs.seeks += fs.seeks - c->fs.seeks;
+    total->fs.seek_walks += fs.seek_walks - c->fs.seek_walks;
+    total->fs.read_walks += fs.read_walks - c->fs.read_walks;
+}
+
+static void _print(const char *phase, const BenchCount *total, uint32_t passes)
+{
+    printf("%-16s %6" PRIu32 " %6" PRIu32 " %8" PRIu64 " %7" PRIu32 " %9" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 "\n",
+           phase, passes, total->items / passes, total->ns / passes / 1000,
+           total->flash.reads / passes, total->flash.bytes / passes,
+           total->fs.finds / passes, total->fs.find_headers / passes, total->fs.find_scans / passes,
+           total->fs.seeks / passes, (total->fs.seek_walks + total->fs.read_walks) / passes);
+}
+
+/* every well known file, then each app's */
+static void _find(BenchCount *c)
+{
+    struct file file;
+    char name[17];
+    App *app;
+
+    for (int i = 0; i < sizeof(_names) / sizeof(_names[0]); i++, c->items++)
+        fs_find_file(&file, _names[i]);
+
+    list_foreach(app, app_manager_get_apps_head(), App, node)
+    {
+        if (app->is_internal)
+            continue;
+        snprintf(name, sizeof(name), "@%08lx/app", app->id);
+        fs_find_file(&file, name);
+        snprintf(name, sizeof(name), "@%08lx/res", app->id);
+        fs_find_file(&file, name);
+        snprintf(name, sizeof(name), "@%08lx/worker", app->id);
+        fs_find_file(&file, name);
+        c->items += 3;
+    }
+}
+
+static void _load_system(BenchCount *c)
+{
+    for (uint32_t id = 1; id < BENCH_MAX_RES && resource_size(resource_get_handle_system(id)); id++, c->items++)
+    {
+        uint8_t *p = resource_fully_load_id_system(id);
+        if (p)
+            app_free(p);
+    }
+}
+
+/* as a launch has it: the table, then what the app asks for */
+static void _load_apps(BenchCount *c)
+{
+    App *bench = appmanager_get_current_app();
+    App *app;
+
+    list_foreach(app, app_manager_get_apps_head(), App, node)
+    {
+        if (app->is_internal || !app->resource_file.size)
+            continue;
+
+        bench->resource_file = app->resource_file;
+        resource_app_table_load(AppThreadMainApp, &app->resource_file);
+        for (uint32_t id = 1; id < BENCH_MAX_RES && resource_size(resource_get_handle(id)); id++, c->items++)
+        {
+            uint8_t *p = resource_fully_load_id_app(id);
+            if (p)
+                app_free(p);
+        }
+    }
+    bench->resource_file = (struct file) { 0, 0, 0 };
+}
+
+/* once cold, then passes - 1 times warm */
+static void _phase(const char *phase, void (*fn)(BenchCount *c), uint32_t passes)
+{
+    BenchCount c, cold = { 0 }, warm = { 0 };
+    char name[24];
+
+    _start(&c);
+    fn(&c);
+    _stop(&c, &cold);
+    snprintf(name, sizeof(name), "%s cold", phase);
+    _print(name, &cold, 1);
+
+    if (passes < 2)
+        return;
+    for (uint32_t n = 1; n < passes; n++)
+    {
+        _start(&c);
+        fn(&c);
+        _stop(&c, &warm);
+    }
+    snprintf(name, sizeof(name), "%s warm", phase);
+    _print(name, &warm, passes - 1);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t passes = BENCH_PASSES;
+    BenchCount c, total;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                passes = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n passes] image\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || !passes)
+    {
+        fprintf(stderr, "usage: %s [-n passes] image\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-16s %6s %6s %8s %7s %9s %6s %6s %6s %6s %6s\n",
+           "phase", "passes", "items", "us/pass", "reads", "bytes", "finds", "hdrs", "scans", "seeks", "walks");
+
+    /* the system resource table, and the fonts */
+    memset(&total, 0, sizeof(total));
+    _start(&c);
+    host_init(argv[optind]);
+    _stop(&c, &total);
+    _print("resource init", &total, 1);
+
+    memset(&total, 0, sizeof(total));
+    _start(&c);
+    fs_init();
+    _stop(&c, &total);
+    _print("fs init", &total, 1);
+
+    memset(&total, 0, sizeof(total));
+    _start(&c);
+    appmanager_app_loader_init();
+    _stop(&c, &total);
+    _print("manifest", &total, 1);
+
+    _phase("find", _find, passes);
+    _phase("system res", _load_system, passes);
+    _phase("app res", _load_apps, passes);
+
+    return 0;
+}
@@ -12,17 +12,12 @@
 #include "platform.h"
 #include "vibrate.h"
 #include "task.h"
-#include "semphr.h"
 #include <stdbool.h>
 
-#define VIBRATE_QUEUE_MAX_WAIT_TICKS  20    // chosen by fair dice roll
-
-#define VIBRATE_QUEUE_MAX_ITEMS 5
-
 /**
  * Initialization of default patterns. 
  * buffer: contains the sequence of pairs, where each pair is composed of a frequency (at which the motor will spin)
- *      ,and a duration of spin (in milliseconds).
+ *      ,and a duration of spin (in milliseconds). A frequency of 0 is the motor off.
  * length:is the length of the buffer
  * 
  * TODO Maybe load these dinamically at some point
@@ -78,27 +73,12 @@ static const VibratePattern_t _default_vibrate_patterns[VIBRATE_CMD_MAX] = {
     }
 };
 
-static TaskHandle_t _vibrate_task;
-static xQueueHandle _vibrate_queue;
-
-static void _enable(uint8_t enabled);
-static void _set_frequency(uint16_t frequency);
-static void _vibrate_thread(void *pvParameters);
-static void _print_pattern(const VibratePattern_t *pattern);
-
-
 /*
- * Initialize the vibration controller and tasks
+ * Initialize the vibration controller
  */
 uint8_t vibrate_init(void)
 {
-    int rv;
     hw_vibrate_init();
-    _vibrate_queue = xQueueCreate(VIBRATE_QUEUE_MAX_ITEMS, sizeof(VibratePattern_t*));
-    
-    rv = xTaskCreate(_vibrate_thread, "Vibrate", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY + 2UL, &_vibrate_task); /* XXX: allocate statically later */
-    assert(rv == pdPASS);
-    
     
     return 0;
 }
@@ -121,89 +101,25 @@ void vibrate_command(VibrateCmd_t command)
 }
 
 /**
- * Play a given pattern.
+ * Play a given pattern, from the start. Anything already playing stops.
+ * The hardware steps through it on a timer, so the pattern must stay
+ * around until it's done.
  * @param pattern Pointer to a struct containing a defined pattern.
  */
 void vibrate_play_pattern(const VibratePattern_t *pattern)
 {
-    (void) xQueueSendToBack(_vibrate_queue, &pattern, VIBRATE_QUEUE_MAX_WAIT_TICKS);   
+    /* one caller at a time gets to swap the pattern over */
+    taskENTER_CRITICAL();
+    hw_vibrate_play(pattern->buffer, pattern->length);
+    taskEXIT_CRITICAL();
 }
 
 /**
- * Stop playing a pattern. If the _vibrate_thread is currently blocked by vTaskDelay,
- * the pattern will be stopped when vTaskDelay returns.
+ * Stop playing a pattern, straight away.
  */
 void vibrate_stop(void)
 {
-    
-    (void) xQueueSendToBack(_vibrate_queue, &_default_vibrate_patterns[VIBRATE_CMD_STOP], VIBRATE_QUEUE_MAX_WAIT_TICKS);    
-}
-
-static void _print_pattern(const VibratePattern_t *pattern)
-{
-//     printf(">>> vibrate @%u:\n", pattern);
-//     printf("\tlength:%d, val[%d]=(.frequency=%u, .duration=%u)\n",
-//            pattern->length,
-//            pattern->cur_buffer_index,
-//            pattern->buffer[pattern->cur_buffer_index].frequency,
-//            pattern->buffer[pattern->cur_buffer_index].duration_ms
-//     );
-}
-
-/**
- * Start vibratin
- */
-static void _enable(uint8_t enabled)
-{
-    hw_vibrate_enable(enabled);
-}
-
-/**
- * Set vibration frequency
- */
-static void _set_frequency(uint16_t frequency)
-{
-    // TODO set the motor frequency here
-}
-
-/*
- * The main task for driving patterns out of the motor
- */
-static void _vibrate_thread(void *pvParameters)
-{
-    static const VibratePattern_t *current_pattern = &_default_vibrate_patterns[VIBRATE_CMD_STOP];
-
-    while(1)
-    {
-        uint32_t buf_idx = 0;
-        
-        if (!xQueueReceive(_vibrate_queue, &current_pattern, portMAX_DELAY))
-        {
-            continue;
-        }
-        
-        buf_idx = 0;
-        
-        while (buf_idx < current_pattern->length)
-        {
-            _set_frequency(current_pattern->buffer[buf_idx].frequency);
-            _enable(true);
-            vTaskDelay(current_pattern->buffer[buf_idx].duration_ms / portTICK_RATE_MS);
-            _enable(false);
-            
-            if (xQueueReceive(_vibrate_queue, &current_pattern, 0))
-            {
-                // if we just received another pattern (including stop), start playing it from the beginning
-                buf_idx = 0;
-            }
-            else
-            {
-                buf_idx++;
-            }
-            
-            _print_pattern(current_pattern);
-        }
-        
-        current_pattern = &_default_vibrate_patterns[VIBRATE_CMD_STOP];
-    }
+    taskENTER_CRITICAL();
+    hw_vibrate_stop();
+    taskEXIT_CRITICAL();
 }
@@ -5,12 +5,50 @@
  * Authors: Barry Carter <barry.carter@gmail.com>, Joshua Wise <joshua@joshuawise.com>
  */
 
+#include <string.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
 #include "platform.h" /* WATCHDOG_RESET_MS */
-#include "task.h" /* xTaskCreate, vTaskDelay */
+#include "task.h" /* xTaskCreate, vTaskDelay, uxTaskGetSystemState */
+#include "log.h" /* SYS_LOG */
+#include "watchdog.h"
+#include "cpu_stats.h"
 
-static StackType_t _watchdog_stack[configMINIMAL_STACK_SIZE];
+/* the sampler logs from here, so it needs more than the bare minimum */
+#define WATCHDOG_STACK_SIZE (configMINIMAL_STACK_SIZE + 100)
+
+/* How often the watchdog thread looks at everyone's stack, and how
+ * close to the bottom a task gets before we complain */
+#define STACK_SAMPLE_MS  5000
+#define STACK_WARN_BYTES 128
+
+/* A loop that takes longer than this to get back to waiting is logged */
+#define SLOW_LOOP_MS     100
+
+static StackType_t _watchdog_stack[WATCHDOG_STACK_SIZE];
 static StaticTask_t _watchdog_task;
 static void _threadmain_watchdog(void *pvParameters);
+static void _stack_sample(void);
+
+static TaskStatus_t _task_status[STACK_STATS_MAX];
+/* lowest free stack each task has had, by name. Kept across restarts of
+ * a task, so an app thread remembers the hungriest app */
+static StackStats _stack_stats[STACK_STATS_MAX];
+static uint8_t _stack_stats_count;
+
+/* Tasks we don't feed the dog without. A task is busy from waking up
+ * until it next goes to wait, and busy for longer than its timeout is a
+ * stall. Waiting, however long, isn't */
+typedef struct Heartbeat {
+    TaskHandle_t task; /* NULL if the slot is free */
+    TickType_t timeout;
+    TickType_t busy_since;
+    bool busy;
+} Heartbeat;
+
+static Heartbeat _heartbeats[WATCHDOG_HEARTBEATS];
+static TaskHandle_t _stalled;
+static bool _heartbeats_ok(void);
 
 /* Early watchdog initialization.  Call as early as possible during boot --
  * starts the watchdog timer counting, and resets it once to allow for a
@@ -28,7 +66,7 @@ void rcore_watchdog_init_late() {
     (void) xTaskCreateStatic(
         _threadmain_watchdog,             /* Function pointer */
         "rcore_watchdog",               /* Task name - for debugging only*/
-        configMINIMAL_STACK_SIZE,         /* Stack depth in words */
+        WATCHDOG_STACK_SIZE,              /* Stack depth in words */
         (void*) NULL,                     /* Pointer to tasks arguments (parameter) */
         tskIDLE_PRIORITY + 5UL,           /* Task priority */
         _watchdog_stack,                  /* Stack pointer */
@@ -38,9 +76,211 @@ void rcore_watchdog_init_late() {
 
 static void _threadmain_watchdog(void *pvParameters)
 {
+    TickType_t next_sample = 0;
+    
     while(1)
     {
-        hw_watchdog_reset();
+        /* Nobody else will reset us if a heartbeat has stopped. We get
+         * the hardware's timeout to say who it was */
+        if (_heartbeats_ok())
+            hw_watchdog_reset();
+        if ((int32_t)(xTaskGetTickCount() - next_sample) >= 0)
+        {
+            _stack_sample();
+            next_sample = xTaskGetTickCount() + pdMS_TO_TICKS(STACK_SAMPLE_MS);
+        }
         vTaskDelay(WATCHDOG_RESET_MS / portTICK_RATE_MS);
     }
 }
+
+static StackStats *_stack_stats_find(const char *name)
+{
+    for (uint8_t i = 0; i < _stack_stats_count; i++)
+        if (!strncmp(_stack_stats[i].name, name, configMAX_TASK_NAME_LEN))
+            return &_stack_stats[i];
+    
+    if (_stack_stats_count == STACK_STATS_MAX)
+        return NULL;
+    
+    StackStats *st = &_stack_stats[_stack_stats_count++];
+    strncpy(st->name, name, configMAX_TASK_NAME_LEN);
+    st->min_free = UINT16_MAX;
+    
+    return st;
+}
+
+/* FreeRTOS paints every stack when the task is made (we have
+ * configCHECK_FOR_STACK_OVERFLOW 2), so the high water mark is just
+ * how much paint is left. That walk is done with the scheduler
+ * suspended, hence only every few seconds. The CPU accounting gets
+ * the same walk rather than doing its own */
+static void _stack_sample(void)
+{
+    UBaseType_t count = uxTaskGetSystemState(_task_status, STACK_STATS_MAX, NULL);
+    
+    if (!count)
+    {
+        SYS_LOG("wdog", APP_LOG_LEVEL_WARNING, "more than %d tasks, raise STACK_STATS_MAX", STACK_STATS_MAX);
+        return;
+    }
+    
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        TaskStatus_t *ts = &_task_status[i];
+        uint32_t free_bytes = ts->usStackHighWaterMark * sizeof(StackType_t);
+        StackStats *st = _stack_stats_find(ts->pcTaskName);
+        
+        if (!st || free_bytes >= st->min_free)
+            continue;
+        
+        st->min_free = free_bytes;
+        if (free_bytes < STACK_WARN_BYTES)
+            SYS_LOG("wdog", APP_LOG_LEVEL_WARNING, "%s stack nearly full, %lu bytes left", ts->pcTaskName, free_bytes);
+    }
+    
+    cpu_stats_sample(_task_status, count);
+}
+
+/*
+ * The PC a task that is switched out will go back to. The port pushes
+ * r4-r11 and EXC_RETURN on top of the exception frame, with s16-s31
+ * between them if the task was using the FPU
+ */
+static uint32_t _task_pc(TaskHandle_t task)
+{
+    /* pxTopOfStack is the first thing in the TCB */
+    uint32_t *sp = *(uint32_t **)task;
+    uint32_t exc_return = sp[8];
+
+    sp += 9;
+    if (!(exc_return & 0x10))
+        sp += 16;
+    return sp[6];
+}
+
+/*
+ * true if every heartbeat is waiting, or busy but within its time
+ */
+static bool _heartbeats_ok(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    bool ok = true;
+
+    for (uint8_t i = 0; i < WATCHDOG_HEARTBEATS; i++)
+    {
+        Heartbeat *hb = &_heartbeats[i];
+        TaskHandle_t task;
+
+        taskENTER_CRITICAL();
+        task = hb->task;
+        bool stalled = task && hb->busy && now - hb->busy_since > hb->timeout;
+        uint32_t pc = stalled ? _task_pc(task) : 0;
+        taskEXIT_CRITICAL();
+
+        if (!stalled)
+            continue;
+
+        ok = false;
+        if (task == _stalled)
+            continue;
+        _stalled = task;
+        SYS_LOG("wdog", APP_LOG_LEVEL_ERROR, "%s stalled %lu ms, at pc 0x%08lx. Letting the watchdog go",
+                pcTaskGetName(task), (now - hb->busy_since) * portTICK_PERIOD_MS, pc);
+    }
+
+    if (ok)
+        _stalled = NULL;
+    return ok;
+}
+
+/*
+ * For the calling task: don't feed the watchdog while it has been busy
+ * for more than timeout_ms. Returns the id to check in with, or
+ * WATCHDOG_HEARTBEAT_NONE if there is no room. Starts out waiting
+ */
+uint8_t rcore_watchdog_heartbeat_register(uint32_t timeout_ms)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    uint8_t id = WATCHDOG_HEARTBEAT_NONE;
+
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < WATCHDOG_HEARTBEATS; i++)
+    {
+        if (_heartbeats[i].task == task)
+        {
+            id = i;
+            break;
+        }
+        if (!_heartbeats[i].task && id == WATCHDOG_HEARTBEAT_NONE)
+            id = i;
+    }
+    if (id != WATCHDOG_HEARTBEAT_NONE)
+    {
+        _heartbeats[id].task = task;
+        _heartbeats[id].timeout = pdMS_TO_TICKS(timeout_ms);
+        _heartbeats[id].busy = false;
+    }
+    taskEXIT_CRITICAL();
+
+    if (id == WATCHDOG_HEARTBEAT_NONE)
+        SYS_LOG("wdog", APP_LOG_LEVEL_WARNING, "no heartbeat for %s, raise WATCHDOG_HEARTBEATS",
+                pcTaskGetName(task));
+    return id;
+}
+
+/*
+ * Woken up, with work to do
+ */
+void rcore_watchdog_heartbeat_busy(uint8_t id)
+{
+    if (id >= WATCHDOG_HEARTBEATS)
+        return;
+
+    _heartbeats[id].busy_since = xTaskGetTickCount();
+    _heartbeats[id].busy = true;
+}
+
+/*
+ * Done, about to wait again. Says so if that took a while
+ */
+void rcore_watchdog_heartbeat_idle(uint8_t id)
+{
+    if (id >= WATCHDOG_HEARTBEATS || !_heartbeats[id].busy)
+        return;
+
+    _heartbeats[id].busy = false;
+    TickType_t took = xTaskGetTickCount() - _heartbeats[id].busy_since;
+    if (took > pdMS_TO_TICKS(SLOW_LOOP_MS))
+        SYS_LOG("wdog", APP_LOG_LEVEL_WARNING, "slow loop: %s took %lu ms",
+                pcTaskGetName(_heartbeats[id].task), took * portTICK_PERIOD_MS);
+}
+
+/*
+ * A task is being deleted, or is done checking in
+ */
+void rcore_watchdog_heartbeat_forget(TaskHandle_t task)
+{
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < WATCHDOG_HEARTBEATS; i++)
+        if (_heartbeats[i].task == task)
+            _heartbeats[i].task = NULL;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Copy out the lowest free stack seen for every task, returns how many
+ */
+uint8_t rcore_watchdog_stack_stats(StackStats *stats, uint8_t max)
+{
+    uint8_t count = _stack_stats_count < max ? _stack_stats_count : max;
+    
+    memcpy(stats, _stack_stats, count * sizeof(StackStats));
+    return count;
+}
+
+void rcore_watchdog_stack_dump(void)
+{
+    for (uint8_t i = 0; i < _stack_stats_count; i++)
+        SYS_LOG("wdog", APP_LOG_LEVEL_INFO, "%.*s: min free stack %u bytes",
+                configMAX_TASK_NAME_LEN, _stack_stats[i].name, _stack_stats[i].min_free);
+}
@@ -3,6 +3,28 @@
  * Entry points for care and feeding of watchdog
  * RebbleOS
  */
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* most tasks the stack sampler keeps track of */
+#define STACK_STATS_MAX 16
+
+typedef struct __attribute__((__packed__)) StackStats {
+    char name[configMAX_TASK_NAME_LEN]; /* not terminated if it fills the field */
+    uint16_t min_free; /* bytes */
+} StackStats;
  
+/* most tasks that can check in with the watchdog */
+#define WATCHDOG_HEARTBEATS 4
+#define WATCHDOG_HEARTBEAT_NONE 0xFF
+
 extern void rcore_watchdog_init_early();
 extern void rcore_watchdog_init_late();
+uint8_t rcore_watchdog_stack_stats(StackStats *stats, uint8_t max);
+void rcore_watchdog_stack_dump(void);
+uint8_t rcore_watchdog_heartbeat_register(uint32_t timeout_ms);
+void rcore_watchdog_heartbeat_busy(uint8_t id);
+void rcore_watchdog_heartbeat_idle(uint8_t id);
+void rcore_watchdog_heartbeat_forget(TaskHandle_t task);
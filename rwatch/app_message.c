@@ -0,0 +1,588 @@
+/* app_message.c
+ * implementation of PebbleOS AppMessage
+ * libRebbleOS
+ *
+ * The phone pushes a dictionary at the app with a given UUID, and each
+ * push gets an ACK or a NACK back with its transaction id. The app's
+ * pushes go the same way.
+ *
+ * What comes in is copied once, off the endpoint thread's packet and into
+ * the inbox, which the app has on its own heap from app_message_open. The
+ * app's handler is then given an iterator over it where it lies. The inbox
+ * holds as many dictionaries back to back as will fit, each ACKed once the
+ * handler is done with it. So a phone that sends ahead of the ACKs has
+ * that many in flight; one that won't fit yet is NACKed as busy, and the
+ * phone sends it again. A full size one takes the whole inbox, as it
+ * would on PebbleOS.
+ *
+ * Going out, the outbox is APP_MESSAGE_OUTBOX_WINDOW of the size the app
+ * asked for, if its heap has the room, so the next can be written while
+ * the last waits for its ACK. Each is sent straight out of where the app
+ * wrote it, with room left in front for the header. Sent and failed are
+ * told in the order things were sent.
+ *
+ * Only the foreground app has AppMessage. Its state hangs off its thread,
+ * and _am_mutex keeps the endpoint thread out while the app opens or goes.
+ */
+
+#include "librebble.h"
+#include "appmanager.h"
+#include "endpoint.h"
+#include "app_message.h"
+
+#define APP_MESSAGE_PUSH    0x01
+#define APP_MESSAGE_REQUEST 0x02
+#define APP_MESSAGE_ACK     0xff
+#define APP_MESSAGE_NACK    0x7f
+
+/* command, transaction id and UUID, then the dictionary */
+#define APP_MESSAGE_HEADER      (2 + sizeof(Uuid))
+#define APP_MESSAGE_INBOX_MAX   (APP_MESSAGE_PACKET_MAX - APP_MESSAGE_HEADER)
+#define APP_MESSAGE_OUTBOX_MAX  656
+
+#define APP_MESSAGE_OUTBOX_WINDOW 2
+/* how long the phone has to ACK a push of ours */
+#define APP_MESSAGE_TIMEOUT pdMS_TO_TICKS(10000)
+
+typedef struct __attribute__((__packed__)) InboxEntry {
+    uint16_t len;  /* of the dictionary that follows */
+    uint8_t txid;
+    uint8_t wrap;  /* nothing more up here, the next is at the start */
+} InboxEntry;
+
+#define INBOX_ENTRY_SIZE(len) ((sizeof(InboxEntry) + (len) + 3) & ~3)
+
+typedef enum OutboxState {
+    OutboxFree,
+    OutboxWriting,
+    OutboxInFlight,
+    OutboxDone,
+} OutboxState;
+
+typedef struct OutboxSlot {
+    OutboxState state;
+    uint8_t txid;
+    AppMessageResult result;
+    TickType_t sent_at;
+    DictionaryIterator iter;
+} OutboxSlot;
+
+typedef struct AppMessageState {
+    CoreTimer timer; /* must be at the start of the struct! */
+    bool timer_queued;
+    Uuid uuid;
+    void *context;
+    AppMessageInboxReceived inbox_received;
+    AppMessageInboxDropped inbox_dropped;
+    AppMessageOutboxSent outbox_sent;
+    AppMessageOutboxFailed outbox_failed;
+
+    uint8_t *inbox;
+    uint16_t inbox_size;  /* of the buffer */
+    uint16_t inbox_max;   /* the biggest dictionary the app will take */
+    uint16_t in_head;     /* where the next goes */
+    uint16_t in_tail;     /* the next for the app */
+    uint8_t in_count;
+    AppMessageResult in_dropped;
+
+    uint8_t *outbox;
+    uint16_t outbox_max;
+    uint8_t out_slots;
+    uint8_t out_head;     /* slots ever begun */
+    uint8_t out_tail;     /* slots ever told about */
+    uint8_t next_txid;
+    OutboxSlot out[APP_MESSAGE_OUTBOX_WINDOW];
+} AppMessageState;
+
+#define OUT_SLOT(am, n)     (&(am)->out[(uint8_t)(n) % (am)->out_slots])
+#define OUT_BUF(am, slot)   ((am)->outbox + ((slot) - (am)->out) * (APP_MESSAGE_HEADER + (am)->outbox_max))
+
+static SemaphoreHandle_t _am_mutex;
+static StaticSemaphore_t _am_mutex_buf;
+
+void app_message_init(void)
+{
+    _am_mutex = xSemaphoreCreateMutexStatic(&_am_mutex_buf);
+}
+
+/* the running app's, if it opened one */
+static AppMessageState *_am_state(void)
+{
+    app_running_thread *thread = appmanager_get_current_thread();
+
+    if (!thread || thread->thread_type != AppThreadMainApp)
+        return NULL;
+
+    return thread->app_message;
+}
+
+static void _reply(uint8_t result, uint8_t txid)
+{
+    uint8_t pkt[2] = { result, txid };
+
+    bluetooth_send_packet(ENDPOINT_APP_MESSAGE, pkt, sizeof(pkt));
+}
+
+/* Inbox */
+
+/*
+ * Where an entry of len can go, or -1 if not until the app has taken
+ * some. One that won't fit before the end goes at the start, if the app
+ * is past that far, and a wrap mark is left for the reader. With the lock
+ */
+static int _inbox_reserve(AppMessageState *am, uint16_t len)
+{
+    uint16_t need = INBOX_ENTRY_SIZE(len);
+
+    if (!am->in_count)
+        am->in_head = am->in_tail = 0;
+
+    if (!am->in_count || am->in_head > am->in_tail)
+    {
+        if (am->in_head + need <= am->inbox_size)
+            return am->in_head;
+        if (need > am->in_tail)
+            return -1;
+
+        if (am->in_head + sizeof(InboxEntry) <= am->inbox_size)
+            ((InboxEntry *)&am->inbox[am->in_head])->wrap = 1;
+        return 0;
+    }
+
+    /* already wrapped, the space is up to the tail */
+    if (am->in_head + need <= am->in_tail)
+        return am->in_head;
+
+    return -1;
+}
+
+/* The oldest entry, with the lock */
+static InboxEntry *_inbox_peek(AppMessageState *am)
+{
+    if (!am->in_count)
+        return NULL;
+
+    if (am->in_tail + sizeof(InboxEntry) > am->inbox_size ||
+        ((InboxEntry *)&am->inbox[am->in_tail])->wrap)
+        am->in_tail = 0;
+
+    return (InboxEntry *)&am->inbox[am->in_tail];
+}
+
+static void _push(uint8_t *data, uint16_t len)
+{
+    app_running_thread *thread = appmanager_get_thread(AppThreadMainApp);
+    uint8_t txid = data[1];
+    uint8_t *dict = data + APP_MESSAGE_HEADER;
+    uint16_t dict_len = len - APP_MESSAGE_HEADER;
+    AppMessageResult dropped = APP_MSG_OK;
+    AppMessageState *am;
+    int ofs = -1;
+
+    if (len < APP_MESSAGE_HEADER || !dict_valid(dict, dict_len))
+    {
+        SYS_LOG("appmsg", APP_LOG_LEVEL_ERROR, "push %d: bad dictionary", txid);
+        _reply(APP_MESSAGE_NACK, txid);
+        return;
+    }
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    am = thread->app_message;
+    if (am && memcmp(&am->uuid, data + 2, sizeof(Uuid)))
+        am = NULL;
+
+    if (am && dict_len > am->inbox_max)
+        dropped = APP_MSG_BUFFER_OVERFLOW;
+    else if (am && (ofs = _inbox_reserve(am, dict_len)) < 0)
+        dropped = APP_MSG_BUSY;
+    else if (am)
+    {
+        InboxEntry *e = (InboxEntry *)&am->inbox[ofs];
+        e->len = dict_len;
+        e->txid = txid;
+        e->wrap = 0;
+        memcpy(e + 1, dict, dict_len);
+        am->in_head = ofs + INBOX_ENTRY_SIZE(dict_len);
+        am->in_count++;
+    }
+
+    if (dropped)
+        am->in_dropped = dropped;
+    xSemaphoreGive(_am_mutex);
+
+    /* not for the app that's running, or no room. The phone tries again */
+    if (ofs < 0)
+        _reply(APP_MESSAGE_NACK, txid);
+    if (am)
+        appmanager_post_service_event(APP_SERVICE_APP_MESSAGE);
+}
+
+/* The phone has had one of ours */
+static void _ack(uint8_t txid, AppMessageResult result)
+{
+    AppMessageState *am;
+    bool found = false;
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    am = appmanager_get_thread(AppThreadMainApp)->app_message;
+    for (uint8_t i = 0; am && i < am->out_slots; i++)
+    {
+        if (am->out[i].state == OutboxInFlight && am->out[i].txid == txid)
+        {
+            am->out[i].state = OutboxDone;
+            am->out[i].result = result;
+            found = true;
+        }
+    }
+    xSemaphoreGive(_am_mutex);
+
+    if (found)
+        appmanager_post_service_event(APP_SERVICE_APP_MESSAGE);
+}
+
+/*
+ * Deferred, on the endpoint thread
+ */
+void process_app_message_packet(uint8_t *data, uint16_t len)
+{
+    if (len < 2)
+        return;
+
+    switch (data[0])
+    {
+        case APP_MESSAGE_PUSH:
+            _push(data, len);
+            break;
+        case APP_MESSAGE_ACK:
+            _ack(data[1], APP_MSG_OK);
+            break;
+        case APP_MESSAGE_NACK:
+            _ack(data[1], APP_MSG_SEND_REJECTED);
+            break;
+        default:
+            /* a request wants the app's view of things, which we haven't got */
+            _reply(APP_MESSAGE_NACK, data[1]);
+            break;
+    }
+}
+
+/* Outbox */
+
+/* Keep the timer for whichever push of ours has been waiting longest */
+static void _outbox_timer_arm(AppMessageState *am)
+{
+    TickType_t now = xTaskGetTickCount();
+    OutboxSlot *oldest = NULL;
+
+    if (am->timer_queued)
+    {
+        appmanager_timer_remove(&am->timer);
+        am->timer_queued = false;
+    }
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < am->out_slots; i++)
+        if (am->out[i].state == OutboxInFlight &&
+            (!oldest || now - am->out[i].sent_at > now - oldest->sent_at))
+            oldest = &am->out[i];
+    xSemaphoreGive(_am_mutex);
+
+    if (!oldest)
+        return;
+
+    am->timer.when = oldest->sent_at + APP_MESSAGE_TIMEOUT;
+    appmanager_timer_add(&am->timer);
+    am->timer_queued = true;
+}
+
+static void _outbox_timeout(CoreTimer *timer)
+{
+    AppMessageState *am = (AppMessageState *)timer;
+    TickType_t now = xTaskGetTickCount();
+
+    am->timer_queued = false;
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < am->out_slots; i++)
+    {
+        if (am->out[i].state == OutboxInFlight &&
+            now - am->out[i].sent_at >= APP_MESSAGE_TIMEOUT)
+        {
+            am->out[i].state = OutboxDone;
+            am->out[i].result = APP_MSG_SEND_TIMEOUT;
+        }
+    }
+    xSemaphoreGive(_am_mutex);
+
+    app_message_deliver();
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator)
+{
+    AppMessageState *am = _am_state();
+    OutboxSlot *slot;
+    AppMessageResult rv = APP_MSG_OK;
+
+    if (!am)
+        return APP_MSG_INVALID_STATE;
+    if (!iterator)
+        return APP_MSG_INVALID_ARGS;
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    slot = OUT_SLOT(am, am->out_head);
+    if (slot->state != OutboxFree)
+        rv = APP_MSG_BUSY;
+    else
+        slot->state = OutboxWriting;
+    xSemaphoreGive(_am_mutex);
+
+    if (rv != APP_MSG_OK)
+        return rv;
+
+    dict_write_begin(&slot->iter, OUT_BUF(am, slot) + APP_MESSAGE_HEADER, am->outbox_max);
+    *iterator = &slot->iter;
+    return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void)
+{
+    AppMessageState *am = _am_state();
+    OutboxSlot *slot;
+    uint8_t *pkt;
+    uint16_t len;
+
+    if (!am)
+        return APP_MSG_INVALID_STATE;
+
+    slot = OUT_SLOT(am, am->out_head);
+    if (slot->state != OutboxWriting)
+        return APP_MSG_INVALID_STATE;
+
+    len = dict_write_end(&slot->iter);
+    pkt = OUT_BUF(am, slot);
+    pkt[0] = APP_MESSAGE_PUSH;
+    pkt[1] = slot->txid = am->next_txid++;
+    memcpy(pkt + 2, &am->uuid, sizeof(Uuid));
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    slot->sent_at = xTaskGetTickCount();
+    if (bluetooth_is_device_connected())
+    {
+        slot->state = OutboxInFlight;
+    }
+    else
+    {
+        slot->state = OutboxDone;
+        slot->result = APP_MSG_NOT_CONNECTED;
+    }
+    am->out_head++;
+    xSemaphoreGive(_am_mutex);
+
+    if (slot->state == OutboxDone)
+    {
+        appmanager_post_service_event(APP_SERVICE_APP_MESSAGE);
+        return APP_MSG_OK;
+    }
+
+    bluetooth_send_packet(ENDPOINT_APP_MESSAGE, pkt, APP_MESSAGE_HEADER + len);
+    _outbox_timer_arm(am);
+    return APP_MSG_OK;
+}
+
+/*
+ * On the app thread, from the runloop. Hands the app what has come in,
+ * ACKing each as it goes, and tells it how its own went
+ */
+void app_message_deliver(void)
+{
+    AppMessageState *am = _am_state();
+    AppMessageResult dropped;
+    DictionaryIterator iter;
+    InboxEntry *e;
+    OutboxSlot *slot;
+    bool sent = false;
+
+    if (!am)
+        return;
+
+    for (;;)
+    {
+        xSemaphoreTake(_am_mutex, portMAX_DELAY);
+        e = _inbox_peek(am);
+        xSemaphoreGive(_am_mutex);
+        if (!e)
+            break;
+
+        /* the phone can't have the space until we're done with it */
+        dict_read_begin_from_buffer(&iter, (uint8_t *)(e + 1), e->len);
+        if (am->inbox_received)
+            am->inbox_received(&iter, am->context);
+        _reply(APP_MESSAGE_ACK, e->txid);
+
+        xSemaphoreTake(_am_mutex, portMAX_DELAY);
+        am->in_tail += INBOX_ENTRY_SIZE(e->len);
+        am->in_count--;
+        xSemaphoreGive(_am_mutex);
+    }
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    dropped = am->in_dropped;
+    am->in_dropped = APP_MSG_OK;
+    xSemaphoreGive(_am_mutex);
+    if (dropped && am->inbox_dropped)
+        am->inbox_dropped(dropped, am->context);
+
+    while (am->out_tail != am->out_head)
+    {
+        slot = OUT_SLOT(am, am->out_tail);
+        if (slot->state != OutboxDone)
+            break;
+
+        if (slot->result == APP_MSG_OK && am->outbox_sent)
+            am->outbox_sent(&slot->iter, am->context);
+        else if (slot->result != APP_MSG_OK && am->outbox_failed)
+            am->outbox_failed(&slot->iter, slot->result, am->context);
+
+        xSemaphoreTake(_am_mutex, portMAX_DELAY);
+        slot->state = OutboxFree;
+        am->out_tail++;
+        xSemaphoreGive(_am_mutex);
+        sent = true;
+    }
+
+    if (sent)
+        _outbox_timer_arm(am);
+}
+
+/* The app */
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound)
+{
+    app_running_thread *thread = appmanager_get_current_thread();
+    AppMessageState *am;
+
+    if (!thread || thread->thread_type != AppThreadMainApp || thread->app_message)
+        return APP_MSG_INVALID_STATE;
+
+    am = app_calloc(1, sizeof(AppMessageState));
+    if (!am)
+        return APP_MSG_OUT_OF_MEMORY;
+
+    am->inbox_max = size_inbound < APP_MESSAGE_INBOX_MAX ? size_inbound : APP_MESSAGE_INBOX_MAX;
+    am->inbox_size = INBOX_ENTRY_SIZE(am->inbox_max);
+    am->inbox = app_malloc(am->inbox_size);
+
+    /* a second outbox only if there is the room, one will do */
+    am->outbox_max = size_outbound < APP_MESSAGE_OUTBOX_MAX ? size_outbound : APP_MESSAGE_OUTBOX_MAX;
+    for (am->out_slots = APP_MESSAGE_OUTBOX_WINDOW; am->out_slots; am->out_slots--)
+        if ((am->outbox = app_malloc(am->out_slots * (APP_MESSAGE_HEADER + am->outbox_max))))
+            break;
+
+    if (!am->inbox || !am->outbox)
+    {
+        app_free(am->inbox);
+        app_free(am);
+        return APP_MSG_OUT_OF_MEMORY;
+    }
+
+    /* a loaded app starts with its header. Ours have no UUID, and no one
+     * on the phone to talk to */
+    if (!thread->app->is_internal)
+        memcpy(&am->uuid, &((ApplicationHeader *)thread->heap)->uuid, sizeof(Uuid));
+    am->timer.callback = _outbox_timeout;
+
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    thread->app_message = am;
+    xSemaphoreGive(_am_mutex);
+
+    return APP_MSG_OK;
+}
+
+/*
+ * A new app is going on the thread, or the last one is gone. Whatever it
+ * had went with its heap; the endpoint thread has to stop looking there
+ */
+void app_message_app_reset(app_running_thread *thread)
+{
+    xSemaphoreTake(_am_mutex, portMAX_DELAY);
+    thread->app_message = NULL;
+    xSemaphoreGive(_am_mutex);
+}
+
+void app_message_deregister_callbacks(void)
+{
+    AppMessageState *am = _am_state();
+
+    if (!am)
+        return;
+
+    am->inbox_received = NULL;
+    am->inbox_dropped = NULL;
+    am->outbox_sent = NULL;
+    am->outbox_failed = NULL;
+    am->context = NULL;
+}
+
+void *app_message_get_context(void)
+{
+    AppMessageState *am = _am_state();
+
+    return am ? am->context : NULL;
+}
+
+void *app_message_set_context(void *context)
+{
+    AppMessageState *am = _am_state();
+    void *was;
+
+    if (!am)
+        return NULL;
+
+    was = am->context;
+    am->context = context;
+    return was;
+}
+
+/* Each returns the one it replaced */
+#define _APP_MESSAGE_REGISTER(type, field, cb) \
+    do { \
+        AppMessageState *am = _am_state(); \
+        type was; \
+        if (!am) \
+            return NULL; \
+        was = am->field; \
+        am->field = cb; \
+        if (am->field) \
+            MK_THUMB_CB(am->field); \
+        return was; \
+    } while (0)
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback)
+{
+    _APP_MESSAGE_REGISTER(AppMessageInboxReceived, inbox_received, received_callback);
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback)
+{
+    _APP_MESSAGE_REGISTER(AppMessageInboxDropped, inbox_dropped, dropped_callback);
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback)
+{
+    _APP_MESSAGE_REGISTER(AppMessageOutboxSent, outbox_sent, sent_callback);
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback)
+{
+    _APP_MESSAGE_REGISTER(AppMessageOutboxFailed, outbox_failed, failed_callback);
+}
+
+uint32_t app_message_inbox_size_maximum(void)
+{
+    return APP_MESSAGE_INBOX_MAX;
+}
+
+uint32_t app_message_outbox_size_maximum(void)
+{
+    return APP_MESSAGE_OUTBOX_MAX;
+}
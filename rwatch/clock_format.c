@@ -0,0 +1,224 @@
+/* clock_format.c
+ * strftime for things that format the same string every tick
+ * libRebbleOS
+ *
+ * The format is broken up once into literal runs, which are copied into
+ * the text there and then, and conversions, each knowing which units it
+ * follows. A tick then only formats the conversions its units touch, and
+ * moves the rest of the text along if one of them changed length.
+ */
+
+#include <string.h>
+#include "clock_format.h"
+#include "strftime.h"
+
+#define ALL_UNITS (SECOND_UNIT | MINUTE_UNIT | HOUR_UNIT | DAY_UNIT | MONTH_UNIT | YEAR_UNIT)
+
+static const char *_composite(char spec)
+{
+    switch (spec)
+    {
+        case 'c': return "%a %b %e %H:%M:%S %Y";
+        case 'D':
+        case 'x': return "%m/%d/%y";
+        case 'F': return "%Y-%m-%d";
+        case 'r': return "%I:%M:%S %p";
+        case 'R': return "%H:%M";
+        case 'T':
+        case 'X': return "%H:%M:%S";
+    }
+    return NULL;
+}
+
+static uint8_t _units(char spec)
+{
+    switch (spec)
+    {
+        case 'S':
+            return SECOND_UNIT;
+        case 'M':
+            return MINUTE_UNIT;
+        case 'H': case 'k': case 'I': case 'l': case 'p':
+            return HOUR_UNIT;
+        case 'd': case 'e': case 'j': case 'u': case 'w': case 'a': case 'A':
+        case 'U': case 'V': case 'W': case 'G':
+            return DAY_UNIT;
+        case 'm': case 'b': case 'h': case 'B':
+            return MONTH_UNIT;
+        case 'C': case 'y': case 'Y':
+            return YEAR_UNIT;
+    }
+    return 0;
+}
+
+static bool _literal(ClockFormat *cf, const char *s, uint8_t len)
+{
+    ClockFormatOp *op = cf->op_count ? &cf->ops[cf->op_count - 1] : NULL;
+
+    if (!len)
+        return true;
+    if (cf->text_len + len >= CLOCK_FORMAT_TEXT)
+        return false;
+
+    /* runs either side of a composite, or around a %%, are one run */
+    if (!op || op->spec)
+    {
+        if (cf->op_count == CLOCK_FORMAT_OPS)
+            return false;
+        op = &cf->ops[cf->op_count++];
+        op->spec = 0;
+        op->units = 0;
+        op->start = cf->text_len;
+        op->len = 0;
+    }
+    memcpy(cf->text + cf->text_len, s, len);
+    op->len += len;
+    cf->text_len += len;
+    return true;
+}
+
+static bool _parse(ClockFormat *cf, const char *format)
+{
+    while (*format)
+    {
+        const char *run = format;
+        const char *sub;
+        ClockFormatOp *op;
+
+        while (*format && *format != '%')
+            format++;
+        if (!_literal(cf, run, format - run))
+            return false;
+        if (!*format)
+            break;
+
+        format++;
+        switch (*format)
+        {
+            case '\0':
+                return true;
+            case '%':
+                if (!_literal(cf, "%", 1))
+                    return false;
+                break;
+            case 'n':
+                if (!_literal(cf, "\n", 1))
+                    return false;
+                break;
+            case 't':
+                if (!_literal(cf, "\t", 1))
+                    return false;
+                break;
+            case 'Z':
+                /* strftime has no zone names */
+                break;
+            default:
+                if ((sub = _composite(*format)))
+                {
+                    if (!_parse(cf, sub))
+                        return false;
+                    break;
+                }
+                if (!_units(*format))
+                {
+                    /* strftime echoes what it doesn't know */
+                    if (!_literal(cf, format - 1, 2))
+                        return false;
+                    break;
+                }
+                if (cf->op_count == CLOCK_FORMAT_OPS)
+                    return false;
+                op = &cf->ops[cf->op_count++];
+                op->spec = *format;
+                op->units = _units(*format);
+                op->start = cf->text_len;
+                op->len = 0;
+        }
+        format++;
+    }
+    return true;
+}
+
+bool clock_format_init(ClockFormat *cf, const char *format)
+{
+    memset(cf, 0, sizeof(ClockFormat));
+    if (!_parse(cf, format))
+    {
+        memset(cf, 0, sizeof(ClockFormat));
+        return false;
+    }
+    cf->text[cf->text_len] = '\0';
+    return true;
+}
+
+void clock_format_invalidate(ClockFormat *cf)
+{
+    cf->valid = false;
+}
+
+uint8_t clock_format_cached(ClockFormat *cf, const struct tm *t, TimeUnits units_changed, uint8_t *first)
+{
+    uint8_t lo = CLOCK_FORMAT_TEXT, hi = 0;
+    uint8_t old_len = cf->text_len;
+    bool moved = false;
+    uint8_t units = units_changed;
+    char spec[3] = { '%', 0, 0 };
+    char field[12];
+
+    if (!units || !cf->valid)
+        units = ALL_UNITS;
+    cf->valid = true;
+
+    for (uint8_t i = 0; i < cf->op_count; i++)
+    {
+        ClockFormatOp *op = &cf->ops[i];
+        char *at = cf->text + op->start;
+        uint8_t len, n;
+
+        if (!(op->units & units))
+            continue;
+
+        spec[1] = op->spec;
+        len = strftime(field, sizeof(field), spec, t);
+        if (cf->text_len - op->len + len >= CLOCK_FORMAT_TEXT)
+            len = CLOCK_FORMAT_TEXT - 1 - (cf->text_len - op->len);
+
+        /* where it starts to differ */
+        for (n = 0; n < len && n < op->len && at[n] == field[n]; n++)
+            ;
+        if (n == len && len == op->len)
+            continue;
+        if (op->start + n < lo)
+            lo = op->start + n;
+
+        if (len == op->len)
+        {
+            uint8_t e = len;
+            while (at[e - 1] == field[e - 1])
+                e--;
+            memcpy(at + n, field + n, e - n);
+            if (op->start + e > hi)
+                hi = op->start + e;
+            continue;
+        }
+
+        /* a different length moves everything after it */
+        memmove(at + len, at + op->len, cf->text_len - op->start - op->len);
+        memcpy(at + n, field + n, len - n);
+        for (uint8_t j = i + 1; j < cf->op_count; j++)
+            cf->ops[j].start = cf->ops[j].start + len - op->len;
+        cf->text_len = cf->text_len + len - op->len;
+        op->len = len;
+        moved = true;
+    }
+
+    cf->text[cf->text_len] = '\0';
+    /* a change of length reaches the end of the old text, or the new */
+    if (moved)
+        hi = old_len > cf->text_len ? old_len : cf->text_len;
+    if (lo >= hi)
+        return 0;
+    if (first)
+        *first = lo;
+    return hi - lo;
+}
@@ -0,0 +1,45 @@
+#pragma once
+/* clock_format.h
+ * strftime for things that format the same string every tick
+ * libRebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "rebble_time.h"
+
+/* Conversions and literal runs a format may break into, composites expanded */
+#define CLOCK_FORMAT_OPS 16
+/* Longest text it keeps, terminator included */
+#define CLOCK_FORMAT_TEXT 32
+
+typedef struct ClockFormatOp {
+    char spec;      /* conversion character, or 0 for literal text */
+    uint8_t units;  /* the TimeUnits a change of which can change it */
+    uint8_t start;  /* where its text is, in text */
+    uint8_t len;
+} ClockFormatOp;
+
+typedef struct ClockFormat {
+    ClockFormatOp ops[CLOCK_FORMAT_OPS];
+    uint8_t op_count;
+    uint8_t text_len;
+    bool valid;     /* text is what the format gave for the last time */
+    char text[CLOCK_FORMAT_TEXT];
+} ClockFormat;
+
+/* Parse format once; false if it has more to it than fits */
+bool clock_format_init(ClockFormat *cf, const char *format);
+
+/*
+ * Bring cf->text up to date for t, given what changed since the last
+ * call (a tick handler's units_changed, or 0 when it isn't known, for
+ * all of it). Only the fields depending on those are formatted again.
+ * Returns the number of characters that changed, and if any, the first
+ * in first; a seconds tick usually comes back with one or two
+ */
+uint8_t clock_format_cached(ClockFormat *cf, const struct tm *t, TimeUnits units_changed, uint8_t *first);
+
+/* Next call formats everything, as after a time or zone change */
+void clock_format_invalidate(ClockFormat *cf);
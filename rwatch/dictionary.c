@@ -0,0 +1,352 @@
+/* dictionary.c
+ * implementation of PebbleOS Dictionary and Tuple
+ * libRebbleOS
+ */
+
+#include <stdarg.h>
+#include "librebble.h"
+#include "dictionary.h"
+
+struct __attribute__((__packed__)) Dictionary {
+    uint8_t count;
+    Tuple head[];
+};
+
+#define TUPLE_SIZE(t)   (sizeof(Tuple) + (t)->length)
+#define TUPLE_NEXT(t)   ((Tuple *)((uint8_t *)(t) + TUPLE_SIZE(t)))
+
+/* the tuple at t, if all of it is before end */
+static Tuple *_tuple_at(Tuple *t, const void *end)
+{
+    if ((uint8_t *)t + sizeof(Tuple) > (uint8_t *)end ||
+        (uint8_t *)t + TUPLE_SIZE(t) > (uint8_t *)end)
+        return NULL;
+
+    return t;
+}
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...)
+{
+    uint32_t size = sizeof(Dictionary) + tuple_count * sizeof(Tuple);
+    va_list ap;
+
+    va_start(ap, tuple_count);
+    for (uint8_t i = 0; i < tuple_count; i++)
+        size += va_arg(ap, uint32_t);
+    va_end(ap);
+
+    return size;
+}
+
+static uint16_t _tuplet_length(const Tuplet *tuplet)
+{
+    switch (tuplet->type)
+    {
+        case TUPLE_BYTE_ARRAY:
+            return tuplet->bytes.length;
+        case TUPLE_CSTRING:
+            return tuplet->cstring.length;
+        default:
+            return tuplet->integer.width;
+    }
+}
+
+uint32_t dict_calc_buffer_size_from_tuplets(const Tuplet * const tuplets, const uint8_t tuplets_count)
+{
+    uint32_t size = sizeof(Dictionary);
+
+    for (uint8_t i = 0; i < tuplets_count; i++)
+        size += sizeof(Tuple) + _tuplet_length(&tuplets[i]);
+
+    return size;
+}
+
+uint32_t dict_size(DictionaryIterator *iter)
+{
+    return (uint8_t *)iter->end - (uint8_t *)iter->dictionary;
+}
+
+/*
+ * Writing. end is how far the buffer goes until dict_write_end, then
+ * where the dictionary does
+ */
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t * const buffer, const uint16_t size)
+{
+    if (!iter || !buffer)
+        return DICT_INVALID_ARGS;
+    if (size < sizeof(Dictionary))
+        return DICT_NOT_ENOUGH_STORAGE;
+
+    iter->dictionary = (Dictionary *)buffer;
+    iter->dictionary->count = 0;
+    iter->cursor = iter->dictionary->head;
+    iter->end = buffer + size;
+
+    return DICT_OK;
+}
+
+static DictionaryResult _dict_write(DictionaryIterator *iter, const uint32_t key, TupleType type,
+                                    const void *data, const uint16_t length)
+{
+    if (!iter || !iter->dictionary || (length && !data))
+        return DICT_INVALID_ARGS;
+    if ((uint8_t *)iter->cursor + sizeof(Tuple) + length > (uint8_t *)iter->end)
+        return DICT_NOT_ENOUGH_STORAGE;
+
+    Tuple *t = iter->cursor;
+    t->key = key;
+    t->type = type;
+    t->length = length;
+    memcpy(t->value, data, length);
+
+    iter->cursor = TUPLE_NEXT(t);
+    iter->dictionary->count++;
+
+    return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t * const data, const uint16_t size)
+{
+    return _dict_write(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char * const cstring)
+{
+    return _dict_write(iter, key, TUPLE_CSTRING, cstring, cstring ? strlen(cstring) + 1 : 0);
+}
+
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer,
+                                const uint8_t width_bytes, const bool is_signed)
+{
+    if (width_bytes != 1 && width_bytes != 2 && width_bytes != 4)
+        return DICT_INVALID_ARGS;
+
+    return _dict_write(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value)
+{
+    return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value)
+{
+    return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value)
+{
+    return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_int8(DictionaryIterator *iter, const uint32_t key, const int8_t value)
+{
+    return dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+DictionaryResult dict_write_int16(DictionaryIterator *iter, const uint32_t key, const int16_t value)
+{
+    return dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value)
+{
+    return dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+DictionaryResult dict_write_tuplet(DictionaryIterator *iter, const Tuplet * const tuplet)
+{
+    switch (tuplet->type)
+    {
+        case TUPLE_BYTE_ARRAY:
+            return dict_write_data(iter, tuplet->key, tuplet->bytes.data, tuplet->bytes.length);
+        case TUPLE_CSTRING:
+            return _dict_write(iter, tuplet->key, TUPLE_CSTRING, tuplet->cstring.data, tuplet->cstring.length);
+        case TUPLE_UINT:
+        case TUPLE_INT:
+            /* little endian, so the low bytes of storage are the value */
+            return dict_write_int(iter, tuplet->key, &tuplet->integer.storage, tuplet->integer.width,
+                                  tuplet->type == TUPLE_INT);
+        default:
+            return DICT_INVALID_ARGS;
+    }
+}
+
+/* Returns the size of the finished dictionary */
+uint32_t dict_write_end(DictionaryIterator *iter)
+{
+    if (!iter || !iter->dictionary)
+        return 0;
+
+    iter->end = iter->cursor;
+    return dict_size(iter);
+}
+
+/*
+ * Reading. Nothing is copied, the tuples are handed back where they lie
+ * in buffer
+ */
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer, const uint16_t size)
+{
+    if (!iter || !buffer || size < sizeof(Dictionary))
+        return NULL;
+
+    iter->dictionary = (Dictionary *)buffer;
+    iter->end = buffer + size;
+
+    return dict_read_first(iter);
+}
+
+Tuple *dict_read_first(DictionaryIterator *iter)
+{
+    iter->cursor = iter->dictionary->head;
+    return dict_read_next(iter);
+}
+
+Tuple *dict_read_next(DictionaryIterator *iter)
+{
+    Tuple *t = _tuple_at(iter->cursor, iter->end);
+
+    if (t)
+        iter->cursor = TUPLE_NEXT(t);
+
+    return t;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key)
+{
+    Tuple *t = iter->dictionary->head;
+
+    while ((t = _tuple_at(t, iter->end)))
+    {
+        if (t->key == key)
+            return t;
+        t = TUPLE_NEXT(t);
+    }
+
+    return NULL;
+}
+
+bool dict_valid(const uint8_t *buffer, uint16_t size)
+{
+    const Dictionary *d = (const Dictionary *)buffer;
+    const void *end = buffer + size;
+    Tuple *t;
+
+    if (size < sizeof(Dictionary))
+        return false;
+
+    t = (Tuple *)d->head;
+    for (uint8_t i = 0; i < d->count; i++)
+    {
+        if (!_tuple_at(t, end))
+            return false;
+        t = TUPLE_NEXT(t);
+    }
+
+    return (uint8_t *)t == (uint8_t *)end;
+}
+
+DictionaryResult dict_serialize_tuplets_to_buffer_with_iter(DictionaryIterator *iter,
+                                                            const Tuplet * const tuplets, const uint8_t tuplets_count,
+                                                            uint8_t *buffer, uint32_t *size_in_out)
+{
+    DictionaryResult rv;
+
+    if (!size_in_out)
+        return DICT_INVALID_ARGS;
+
+    rv = dict_write_begin(iter, buffer, *size_in_out > UINT16_MAX ? UINT16_MAX : *size_in_out);
+    for (uint8_t i = 0; rv == DICT_OK && i < tuplets_count; i++)
+        rv = dict_write_tuplet(iter, &tuplets[i]);
+
+    if (rv == DICT_OK)
+        *size_in_out = dict_write_end(iter);
+
+    return rv;
+}
+
+DictionaryResult dict_serialize_tuplets_to_buffer(const Tuplet * const tuplets, const uint8_t tuplets_count,
+                                                  uint8_t *buffer, uint32_t *size_in_out)
+{
+    DictionaryIterator iter;
+
+    return dict_serialize_tuplets_to_buffer_with_iter(&iter, tuplets, tuplets_count, buffer, size_in_out);
+}
+
+/* The buffer only lives as long as the callback */
+DictionaryResult dict_serialize_tuplets(DictionarySerializeCallback callback, void *context,
+                                        const Tuplet * const tuplets, const uint8_t tuplets_count)
+{
+    uint32_t size = dict_calc_buffer_size_from_tuplets(tuplets, tuplets_count);
+    uint8_t *buffer = app_malloc(size);
+    DictionaryResult rv;
+
+    if (!buffer)
+        return DICT_MALLOC_FAILED;
+
+    rv = dict_serialize_tuplets_to_buffer(tuplets, tuplets_count, buffer, &size);
+    if (rv == DICT_OK)
+        callback(buffer, size, context);
+
+    app_free(buffer);
+    return rv;
+}
+
+/*
+ * Bring dest up to date with source. The old dest is kept aside while the
+ * new one is written over it, so the callback can have both tuples.
+ * Keys that are new to dest are added after the rest, unless only
+ * existing keys are wanted; their old tuple is NULL
+ */
+DictionaryResult dict_merge(DictionaryIterator *dest, uint32_t *dest_max_size_in_out,
+                            DictionaryIterator *source, const bool update_existing_keys_only,
+                            const DictionaryKeyUpdatedCallback key_callback, void *context)
+{
+    DictionaryIterator old;
+    DictionaryResult rv = DICT_OK;
+    uint32_t old_size;
+    uint8_t *copy;
+    Tuple *t, *from;
+
+    if (!dest || !dest_max_size_in_out || !source)
+        return DICT_INVALID_ARGS;
+
+    old_size = dict_size(dest);
+    if (old_size < sizeof(Dictionary))
+        return DICT_INVALID_ARGS;
+
+    copy = app_malloc(old_size);
+    if (!copy)
+        return DICT_MALLOC_FAILED;
+    memcpy(copy, dest->dictionary, old_size);
+    dict_read_begin_from_buffer(&old, copy, old_size);
+
+    dict_write_begin(dest, (uint8_t *)dest->dictionary, *dest_max_size_in_out);
+
+    for (t = dict_read_first(&old); t && rv == DICT_OK; t = dict_read_next(&old))
+    {
+        from = dict_find(source, t->key);
+        rv = _dict_write(dest, t->key, from ? from->type : t->type,
+                         from ? from->value : t->value, from ? from->length : t->length);
+        if (rv == DICT_OK && from && key_callback)
+            key_callback(t->key, (Tuple *)((uint8_t *)dest->cursor - TUPLE_SIZE(from)), t, context);
+    }
+
+    if (!update_existing_keys_only)
+    {
+        for (from = dict_read_first(source); from && rv == DICT_OK; from = dict_read_next(source))
+        {
+            if (dict_find(&old, from->key))
+                continue;
+            rv = _dict_write(dest, from->key, from->type, from->value, from->length);
+            if (rv == DICT_OK && key_callback)
+                key_callback(from->key, (Tuple *)((uint8_t *)dest->cursor - TUPLE_SIZE(from)), NULL, context);
+        }
+    }
+
+    *dest_max_size_in_out = dict_write_end(dest);
+    app_free(copy);
+
+    return rv;
+}
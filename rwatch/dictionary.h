@@ -0,0 +1,121 @@
+#pragma once
+/* dictionary.h
+ * declarations for PebbleOS Dictionary and Tuple
+ * libRebbleOS
+ *
+ * A dictionary is a count and then the tuples back to back, each a key,
+ * a type and a length and then the value. It is the same in memory as on
+ * the wire, little endian, so what comes from the phone is read where it
+ * lies and what an app writes goes out as it is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef enum {
+    TUPLE_BYTE_ARRAY = 0,
+    TUPLE_CSTRING = 1,
+    TUPLE_UINT = 2,
+    TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((__packed__)) Tuple {
+    uint32_t key;
+    TupleType type:8;
+    uint16_t length;
+    union {
+        uint8_t data[0];
+        char cstring[0];
+        uint8_t uint8;
+        uint16_t uint16;
+        uint32_t uint32;
+        int8_t int8;
+        int16_t int16;
+        int32_t int32;
+    } value[];
+} Tuple;
+
+struct Dictionary;
+typedef struct Dictionary Dictionary;
+
+/* laid out as the SDK's, apps keep them on their own stacks */
+typedef struct {
+    Dictionary *dictionary;
+    const void *end;
+    Tuple *cursor;
+} DictionaryIterator;
+
+typedef enum {
+    DICT_OK = 0,
+    DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+    DICT_INVALID_ARGS = 1 << 2,
+    DICT_INTERNAL_INCONSISTENCY = 1 << 3,
+    DICT_MALLOC_FAILED = 1 << 4,
+} DictionaryResult;
+
+typedef struct Tuplet {
+    TupleType type;
+    uint32_t key;
+    union {
+        struct {
+            const uint8_t *data;
+            const uint16_t length;
+        } bytes;
+        struct {
+            const char *data;
+            const uint16_t length;
+        } cstring;
+        struct {
+            uint32_t storage;
+            const uint16_t width;
+        } integer;
+    };
+} Tuplet;
+
+#define TupletBytes(_key, _data, _length) \
+    ((const Tuplet) { .type = TUPLE_BYTE_ARRAY, .key = _key, .bytes = { .data = _data, .length = _length } })
+#define TupletCString(_key, _cstring) \
+    ((const Tuplet) { .type = TUPLE_CSTRING, .key = _key, .cstring = { .data = _cstring, .length = _cstring ? strlen(_cstring) + 1 : 0 } })
+#define TupletInteger(_key, _integer) \
+    ((const Tuplet) { .type = ((__typeof__(_integer))-1 < 0) ? TUPLE_INT : TUPLE_UINT, .key = _key, .integer = { .storage = _integer, .width = sizeof(_integer) } })
+
+typedef void (*DictionarySerializeCallback)(const uint8_t * const data, const uint16_t size, void *context);
+typedef void (*DictionaryKeyUpdatedCallback)(const uint32_t key, const Tuple *new_tuple, const Tuple *old_tuple, void *context);
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+uint32_t dict_calc_buffer_size_from_tuplets(const Tuplet * const tuplets, const uint8_t tuplets_count);
+uint32_t dict_size(DictionaryIterator *iter);
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t * const buffer, const uint16_t size);
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t * const data, const uint16_t size);
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char * const cstring);
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer, const uint8_t width_bytes, const bool is_signed);
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value);
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value);
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value);
+DictionaryResult dict_write_int8(DictionaryIterator *iter, const uint32_t key, const int8_t value);
+DictionaryResult dict_write_int16(DictionaryIterator *iter, const uint32_t key, const int16_t value);
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value);
+DictionaryResult dict_write_tuplet(DictionaryIterator *iter, const Tuplet * const tuplet);
+uint32_t dict_write_end(DictionaryIterator *iter);
+
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer, const uint16_t size);
+Tuple *dict_read_first(DictionaryIterator *iter);
+Tuple *dict_read_next(DictionaryIterator *iter);
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+
+DictionaryResult dict_serialize_tuplets(DictionarySerializeCallback callback, void *context,
+                                        const Tuplet * const tuplets, const uint8_t tuplets_count);
+DictionaryResult dict_serialize_tuplets_to_buffer(const Tuplet * const tuplets, const uint8_t tuplets_count,
+                                                  uint8_t *buffer, uint32_t *size_in_out);
+DictionaryResult dict_serialize_tuplets_to_buffer_with_iter(DictionaryIterator *iter,
+                                                            const Tuplet * const tuplets, const uint8_t tuplets_count,
+                                                            uint8_t *buffer, uint32_t *size_in_out);
+DictionaryResult dict_merge(DictionaryIterator *dest, uint32_t *dest_max_size_in_out,
+                            DictionaryIterator *source, const bool update_existing_keys_only,
+                            const DictionaryKeyUpdatedCallback key_callback, void *context);
+
+/* for what comes in off the wire. true if buffer is one whole dictionary,
+ * nothing running off the end */
+bool dict_valid(const uint8_t *buffer, uint16_t size);
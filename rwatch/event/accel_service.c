@@ -0,0 +1,266 @@
+/* routines that implement the PebbleOS accelerometer api
+ * libRebbleOS
+ *
+ * Batches are made in the sensor's FIFO, see rcore/gyro.c. The accel
+ * thread puts each burst in a ring here and says when a batch is in, and
+ * the handler gets it on the app's loop. An app that is behind gets each
+ * batch it missed in turn, up to what the ring holds; past that the
+ * oldest go.
+ *
+ * Taps come from the sensor's own detector, and wait in a small queue
+ * for the app's loop in the same way.
+ */
+
+#include "librebble.h"
+#include "accel_service.h"
+
+/* more than two of the largest batch */
+#define ACCEL_RING_SAMPLES 64
+/* taps waiting for the app; more in one go are dropped */
+#define ACCEL_TAPS 4
+
+static AccelDataHandler _data_handler;
+static AccelRawDataHandler _raw_handler;
+static uint32_t _samples_per_update = ACCEL_SAMPLES_PER_UPDATE_MAX;
+static AccelSamplingRate _rate = ACCEL_SAMPLING_25HZ;
+
+static SemaphoreHandle_t _ring_mutex;
+static StaticSemaphore_t _ring_mutex_buf;
+/* under the mutex */
+static hw_accel_sample_t _ring[ACCEL_RING_SAMPLES];
+static uint16_t _head;  /* oldest */
+static uint16_t _count;
+static uint64_t _newest_ms;
+static uint16_t _period_ms;
+
+static AccelTapHandler _tap_handler;
+/* under a critical section */
+static struct {
+    uint8_t axis;
+    int8_t direction;
+} _taps[ACCEL_TAPS];
+static uint8_t _ntaps;
+
+static hw_accel_sample_t _samples[ACCEL_SAMPLES_PER_UPDATE_MAX];
+static AccelData _data[ACCEL_SAMPLES_PER_UPDATE_MAX];
+
+/*
+ * On the accel thread, with each burst off the sensor
+ */
+static void _accel_sink(const hw_accel_sample_t *samples, uint16_t n, uint64_t newest_ms, uint16_t hz)
+{
+    bool ready;
+
+    xSemaphoreTake(_ring_mutex, portMAX_DELAY);
+    for (uint16_t i = 0; i < n; i++)
+    {
+        if (_count == ACCEL_RING_SAMPLES)
+        {
+            _head = (_head + 1) % ACCEL_RING_SAMPLES;
+            _count--;
+        }
+        _ring[(_head + _count) % ACCEL_RING_SAMPLES] = samples[i];
+        _count++;
+    }
+    _newest_ms = newest_ms;
+    _period_ms = 1000 / hz;
+    ready = _samples_per_update && _count >= _samples_per_update;
+    xSemaphoreGive(_ring_mutex);
+
+    if (ready)
+        appmanager_post_service_event(APP_SERVICE_ACCEL);
+}
+
+/*
+ * Up to max of the oldest samples, and when the first of them was taken
+ */
+static uint16_t _ring_read(hw_accel_sample_t *buf, uint16_t max, uint64_t *first_ms)
+{
+    uint16_t n;
+
+    xSemaphoreTake(_ring_mutex, portMAX_DELAY);
+    n = max < _count ? max : _count;
+    *first_ms = _newest_ms - (uint64_t)(_count - 1) * _period_ms;
+    for (uint16_t i = 0; i < n; i++)
+        buf[i] = _ring[(_head + i) % ACCEL_RING_SAMPLES];
+    _head = (_head + n) % ACCEL_RING_SAMPLES;
+    _count -= n;
+    xSemaphoreGive(_ring_mutex);
+
+    return n;
+}
+
+static void _restart(void)
+{
+    if (!_ring_mutex)
+        _ring_mutex = xSemaphoreCreateMutexStatic(&_ring_mutex_buf);
+
+    xSemaphoreTake(_ring_mutex, portMAX_DELAY);
+    _head = _count = 0;
+    xSemaphoreGive(_ring_mutex);
+
+    if ((_data_handler || _raw_handler) && _samples_per_update)
+        rcore_accel_start(AccelUserApp, _rate, _samples_per_update, _accel_sink);
+    else
+        rcore_accel_stop(AccelUserApp);
+}
+
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler)
+{
+    _raw_handler = NULL;
+    _data_handler = handler;
+    _samples_per_update = samples_per_update > ACCEL_SAMPLES_PER_UPDATE_MAX ? ACCEL_SAMPLES_PER_UPDATE_MAX : samples_per_update;
+    _restart();
+}
+
+void accel_raw_data_service_subscribe(uint32_t samples_per_update, AccelRawDataHandler handler)
+{
+    _data_handler = NULL;
+    _raw_handler = handler;
+    _samples_per_update = samples_per_update > ACCEL_SAMPLES_PER_UPDATE_MAX ? ACCEL_SAMPLES_PER_UPDATE_MAX : samples_per_update;
+    _restart();
+}
+
+void accel_data_service_unsubscribe(void)
+{
+    _data_handler = NULL;
+    _raw_handler = NULL;
+    _restart();
+}
+
+int accel_service_peek(AccelData *data)
+{
+    hw_accel_sample_t sample;
+    time_t t;
+    uint16_t ms;
+
+    if (_data_handler || _raw_handler)
+        return -1;
+    if (!rcore_accel_peek(&sample))
+        return -1;
+
+    data->x = sample.x;
+    data->y = sample.y;
+    data->z = sample.z;
+    data->did_vibrate = false;
+    rcore_time_ms(&t, &ms);
+    data->timestamp = (uint64_t)t * 1000 + ms;
+
+    return 0;
+}
+
+int accel_service_set_sampling_rate(AccelSamplingRate rate)
+{
+    if (rate != ACCEL_SAMPLING_10HZ && rate != ACCEL_SAMPLING_25HZ &&
+        rate != ACCEL_SAMPLING_50HZ && rate != ACCEL_SAMPLING_100HZ)
+        return -1;
+
+    _rate = rate;
+    _restart();
+    return 0;
+}
+
+int accel_service_set_samples_per_update(uint32_t num_samples)
+{
+    if (num_samples > ACCEL_SAMPLES_PER_UPDATE_MAX)
+        return -1;
+
+    _samples_per_update = num_samples;
+    _restart();
+    return 0;
+}
+
+/*
+ * On the app thread, from the runloop. Whole batches only; the rest
+ * waits for the FIFO to bring it up to one
+ */
+void accel_service_deliver(void)
+{
+    uint64_t first_ms;
+    uint16_t n;
+
+    while ((_data_handler || _raw_handler) && _samples_per_update && _count >= _samples_per_update)
+    {
+        n = _ring_read(_samples, _samples_per_update, &first_ms);
+
+        if (_raw_handler)
+        {
+            /* the same three shorts */
+            _raw_handler((AccelRawData *)_samples, n, first_ms);
+            continue;
+        }
+
+        for (uint16_t i = 0; i < n; i++)
+        {
+            _data[i].x = _samples[i].x;
+            _data[i].y = _samples[i].y;
+            _data[i].z = _samples[i].z;
+            _data[i].did_vibrate = false;
+            _data[i].timestamp = first_ms + (uint64_t)i * _period_ms;
+        }
+        _data_handler(_data, n);
+    }
+}
+
+/*
+ * On the accel thread, when the sensor saw a tap
+ */
+static void _tap_sink(uint8_t axis, int8_t direction)
+{
+    bool first;
+
+    taskENTER_CRITICAL();
+    first = !_ntaps;
+    if (_ntaps < ACCEL_TAPS)
+    {
+        _taps[_ntaps].axis = axis;
+        _taps[_ntaps].direction = direction;
+        _ntaps++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (first)
+        appmanager_post_service_event(APP_SERVICE_ACCEL_TAP);
+}
+
+void accel_tap_service_subscribe(AccelTapHandler handler)
+{
+    _tap_handler = handler;
+    rcore_accel_tap_subscribe(AccelUserApp, handler ? _tap_sink : NULL);
+}
+
+void accel_tap_service_unsubscribe(void)
+{
+    _tap_handler = NULL;
+    rcore_accel_tap_subscribe(AccelUserApp, NULL);
+    taskENTER_CRITICAL();
+    _ntaps = 0;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * On the app thread, from the runloop
+ */
+void accel_tap_service_deliver(void)
+{
+    uint8_t axis;
+    int8_t direction;
+
+    for (;;)
+    {
+        taskENTER_CRITICAL();
+        if (!_ntaps)
+        {
+            taskEXIT_CRITICAL();
+            return;
+        }
+        axis = _taps[0].axis;
+        direction = _taps[0].direction;
+        _ntaps--;
+        memmove(&_taps[0], &_taps[1], _ntaps * sizeof(_taps[0]));
+        taskEXIT_CRITICAL();
+
+        if (_tap_handler)
+            _tap_handler((AccelAxisType)axis, direction);
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+/* accel_service.h
+ * routines that implement the PebbleOS accelerometer api
+ * libRebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief A sample from the accelerometer, in mG
+ */
+typedef struct __attribute__((__packed__)) AccelData {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    bool did_vibrate;    /* the vibe motor was running, so take it with a pinch of salt */
+    uint64_t timestamp;  /* ms since the epoch */
+} AccelData;
+
+/**
+ * @brief A sample from the accelerometer, in mG, without the extras
+ */
+typedef struct AccelRawData {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} AccelRawData;
+
+typedef enum {
+    ACCEL_AXIS_X = 0,
+    ACCEL_AXIS_Y = 1,
+    ACCEL_AXIS_Z = 2,
+} AccelAxisType;
+
+typedef enum {
+    ACCEL_SAMPLING_10HZ = 10,
+    ACCEL_SAMPLING_25HZ = 25,
+    ACCEL_SAMPLING_50HZ = 50,
+    ACCEL_SAMPLING_100HZ = 100,
+} AccelSamplingRate;
+
+/* the most an app can have in one update */
+#define ACCEL_SAMPLES_PER_UPDATE_MAX 25
+
+typedef void (*AccelDataHandler)(AccelData *data, uint32_t num_samples);
+typedef void (*AccelRawDataHandler)(AccelRawData *data, uint32_t num_samples, uint64_t timestamp);
+typedef void (*AccelTapHandler)(AccelAxisType axis, int32_t direction);
+
+/**
+ * @brief Subscribe to the accelerometer. The handler gets samples_per_update
+ * samples at a time, at the sampling rate
+ *
+ * @param samples_per_update how many samples to batch up, up to 25. 0 peeks only
+ * @param handler called with each batch
+ */
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler);
+
+/**
+ * @brief As @ref accel_data_service_subscribe, the samples without the extras
+ * and one timestamp, of the first
+ */
+void accel_raw_data_service_subscribe(uint32_t samples_per_update, AccelRawDataHandler handler);
+
+/**
+ * @brief Stop the samples, and the accelerometer if nobody else wants it
+ */
+void accel_data_service_unsubscribe(void);
+
+/**
+ * @brief Sample the accelerometer once, now
+ *
+ * @param data filled in
+ * @return 0, or -1 if the data service is subscribed or there is no accelerometer
+ */
+int accel_service_peek(AccelData *data);
+
+/**
+ * @brief Change the sampling rate
+ *
+ * @return 0, or -1 if the rate isn't one of @ref AccelSamplingRate
+ */
+int accel_service_set_sampling_rate(AccelSamplingRate rate);
+
+/**
+ * @brief Change how many samples come in each update
+ *
+ * @return 0, or -1 if it is more than 25
+ */
+int accel_service_set_samples_per_update(uint32_t num_samples);
+
+/**
+ * @brief Subscribe to taps and flicks. The sensor spots them itself, so
+ * this costs nothing until one comes
+ *
+ * @param handler called with the axis and direction, 1 or -1, of each
+ */
+void accel_tap_service_subscribe(AccelTapHandler handler);
+
+/**
+ * @brief Stop hearing about taps
+ */
+void accel_tap_service_unsubscribe(void);
+
+void accel_service_deliver(void);
+void accel_tap_service_deliver(void);
@@ -20,10 +20,22 @@ struct AppTimer {
     void *priv;
     uint8_t scheduled;
     AppTimerHandle id;
+    AppTimer *next;   /* next in our hash bucket */
+    AppTimer **pprev; /* whatever points at us in the bucket */
 };
 
+/* Handles are looked up through a small hash per thread, chained through
+ * the timers themselves. Ids are handed out in order, so they spread
+ * evenly over the buckets and a chain is rarely longer than one */
+#define APP_TIMER_BUCKETS 16 /* power of two */
+#define APP_TIMER_BUCKET(id) ((id) & (APP_TIMER_BUCKETS - 1))
+
+static AppTimer *_app_timers[MAX_APP_THREADS][APP_TIMER_BUCKETS];
+
 uint16_t _app_timer_next_free_id(void);
 AppTimer *_app_timer_get_by_id(AppTimerHandle id);
+static void _app_timer_link(AppTimer *timer);
+static void _app_timer_unlink(AppTimer *timer);
 
 void _app_timer_callback(CoreTimer *_timer)
 {
@@ -32,6 +44,7 @@ void _app_timer_callback(CoreTimer *_timer)
     /* If we had a real "handle" system, then we could free it here, and the
      * handle could simply be dead (at least, until reused).  */
     timer->scheduled = 0;
+    _app_timer_unlink(timer);
     
     timer->cb(timer->priv);
     
@@ -52,6 +65,7 @@ AppTimerHandle app_timer_register(uint32_t ms, AppTimerCallback cb, void *priv)
     timer->priv = priv;
     timer->scheduled = 1;
     timer->id = _app_timer_next_free_id();
+    _app_timer_link(timer);
     appmanager_timer_add(&timer->timer);
 
     return (AppTimerHandle)timer->id;
@@ -80,41 +94,58 @@ void app_timer_cancel(AppTimerHandle timer_handle)
     
     if (timer->scheduled)
         appmanager_timer_remove(&timer->timer);
+    _app_timer_unlink(timer);
     
     app_free(timer);
 }
 
+/* The app's heap is going away, and its timers with it */
+void app_timer_reset(AppThreadType thread_type)
+{
+    memset(_app_timers[thread_type], 0, sizeof(_app_timers[thread_type]));
+}
+
+static void _app_timer_link(AppTimer *timer)
+{
+    AppTimer **bucket = &_app_timers[appmanager_get_thread_type()][APP_TIMER_BUCKET(timer->id)];
+
+    timer->next = *bucket;
+    timer->pprev = bucket;
+    if (*bucket)
+        (*bucket)->pprev = &timer->next;
+    *bucket = timer;
+}
+
+static void _app_timer_unlink(AppTimer *timer)
+{
+    if (!timer->pprev)
+        return;
+
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
 
 AppTimer *_app_timer_get_by_id(AppTimerHandle id)
 {
-    app_running_thread *_this_thread = appmanager_get_current_thread();
-    CoreTimer **tnext = &_this_thread->timer_head;
-
-    while (*tnext) {
-        if (((AppTimer *)(*tnext))->id == id) {
-            return (AppTimer *)*tnext;
-        }
-        tnext = &(*tnext)->next;
-    }
+    AppTimer *timer = _app_timers[appmanager_get_thread_type()][APP_TIMER_BUCKET(id)];
+
+    while (timer && timer->id != id)
+        timer = timer->next;
     
-    return NULL;
+    return timer;
 }
 
+/* 0 is what register hands back when it fails, and once the ids wrap a
+ * long-lived timer could still be holding the next one */
 static uint16_t _timer = 0;
 uint16_t _app_timer_next_free_id(void)
 {
-    return _timer++;
-    
-    app_running_thread *_this_thread = appmanager_get_current_thread();
-    CoreTimer **tnext = &_this_thread->timer_head;
-    uint16_t high = 0;
-    while (*tnext) {
-        if (((AppTimer *)(*tnext))->id > high)
-        {
-            high = ((AppTimer *)(*tnext))->id;
-        }
-        tnext = &(*tnext)->next;
-    }
-    
-    return high++;
+    do {
+        _timer++;
+    } while (!_timer || _app_timer_get_by_id(_timer));
+
+    return _timer;
 }
@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "appmanager.h"
 
 typedef struct AppTimer AppTimer;
 typedef uint16_t AppTimerHandle;
@@ -17,3 +18,4 @@ typedef void (*AppTimerCallback)(void *priv);
 AppTimerHandle app_timer_register(uint32_t ms, AppTimerCallback cb, void *priv);
 bool app_timer_reschedule(AppTimerHandle timer, uint32_t ms);
 void app_timer_cancel(AppTimerHandle timer);
+void app_timer_reset(AppThreadType thread_type);
@@ -0,0 +1,34 @@
+#pragma once
+/* app_worker.h
+ * Background workers, and talking to them
+ * libRebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum AppWorkerResult {
+    APP_WORKER_RESULT_SUCCESS = 0,
+    APP_WORKER_RESULT_NO_WORKER = 1,
+    APP_WORKER_RESULT_DIFFERENT_APP = 2,
+    APP_WORKER_RESULT_NOT_RUNNING = 3,
+    APP_WORKER_RESULT_ALREADY_RUNNING = 4,
+    APP_WORKER_RESULT_ASKING_CONFIRMATION = 5,
+} AppWorkerResult;
+
+typedef struct AppWorkerMessage {
+    uint16_t data0;
+    uint16_t data1;
+    uint16_t data2;
+} AppWorkerMessage;
+
+typedef void (*AppWorkerMessageHandler)(uint16_t type, AppWorkerMessage *data);
+
+AppWorkerResult app_worker_launch(void);
+AppWorkerResult app_worker_kill(void);
+bool app_worker_is_running(void);
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler);
+bool app_worker_message_unsubscribe(void);
+void app_worker_send_message(uint8_t type, AppWorkerMessage *data);
+void worker_event_loop(void);
+void worker_launch_app(void);
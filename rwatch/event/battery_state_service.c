@@ -34,9 +34,20 @@ void battery_state_service_unsubscribe(void)
     _state_handler = NULL;
 }
 
+/*
+ * The charge changed. Any thread; the handler is called from the app's loop
+ */
 void battery_state_service_state_change(void)
 {
     SYS_LOG("BATT", APP_LOG_LEVEL_INFO, "Update");
+    appmanager_post_service_event(APP_SERVICE_BATTERY);
+}
+
+/*
+ * On the app thread, from the runloop
+ */
+void battery_state_service_deliver(void)
+{
     if (_state_handler != NULL)
         _state_handler(battery_state_service_peek());
 }
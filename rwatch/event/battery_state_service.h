@@ -37,3 +37,5 @@ void battery_state_service_subscribe(BatteryStateHandler handler);
 void battery_state_service_unsubscribe(void);
 
 void battery_state_service_state_change(void);
+
+void battery_state_service_deliver(void);
@@ -57,16 +57,30 @@ void connection_service_unsubscribe(void)
     }
 }
 
+/*
+ * The link came or went. From the BT thread, so the subscribers are
+ * called later on the app's loop
+ */
 void connection_service_update(bool connected)
+{
+    appmanager_post_service_event(APP_SERVICE_CONNECTION);
+}
+
+/*
+ * On the app thread, from the runloop. Several changes may have been
+ * folded into this one, so it is the state now that is passed on
+ */
+void connection_service_deliver(void)
 {
     app_running_thread *_this_thread = appmanager_get_current_thread();
+    bool connected = bluetooth_is_device_connected();
     connection_service_subscriber *conn;
     list_foreach(conn, &_subscriber_list_head, connection_service_subscriber, node)
     {
         if (conn->thread == _this_thread &&
             conn->conn_handlers.pebble_app_connection_handler)
         {
-                conn->conn_handlers.pebble_app_connection_handler(connected);
+            conn->conn_handlers.pebble_app_connection_handler(connected);
         }
     }
 }
@@ -15,3 +15,4 @@ bool bluetooth_connection_service_peek(void);
 void bluetooth_connection_service_subscribe(ConnectionHandler handler);
 void bluetooth_connection_service_unsubscribe(void);
 void connection_service_update(bool connected);
+void connection_service_deliver(void);
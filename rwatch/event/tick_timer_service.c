@@ -7,54 +7,74 @@
 
 #include "librebble.h"
 #include "appmanager.h"
+#include "power.h"
 
-typedef struct TickTimerState {
+/* Everything on a thread that wants to know the time changed -- the app's
+ * tick handler, status bars -- hangs off one clock per thread. That's one
+ * timer on the thread for the smallest unit anyone wants, and one
+ * conversion per tick, fanned out to all of them. Every thread's clock
+ * works to the same RTC second, so they all see the same boundary */
+typedef struct TickClock {
     CoreTimer timer; /* must be at the start of the struct! */
     int onqueue;
-    TimeUnits units;
-    TickHandler handler;
     struct tm lasttm;
-} TickTimerState;
+    time_t lasttime; /* lasttm, as a time_t */
+    TickListener *head;
+    TickListener *dispatch_next; /* who is next up in a pass over head */
+} TickClock;
 
-/* XXX: this should probably be per-app.  oh, well */
-static TickTimerState _state = {.onqueue = 0};
+static TickClock _clocks[MAX_APP_THREADS];
 
-static void _tick_timer_callback(CoreTimer *timer);
+/* the app's own tick_timer_service subscription */
+static TickListener _app_listener[MAX_APP_THREADS];
+static TickHandler _app_handler[MAX_APP_THREADS];
+
+static void _tick_clock_callback(CoreTimer *timer);
+
+static TimeUnits _tick_clock_units(TickClock *clock)
+{
+    TimeUnits units = 0;
+
+    for (TickListener *l = clock->head; l; l = l->next)
+        units |= l->units;
+
+    return units;
+}
 
 /* Updates the timer interval to fire for the next smallest requested unit,
  * then add to the timer queue.  */
-static void _tick_timer_update_next(TickTimerState *state)
+static void _tick_clock_update_next(TickClock *clock)
 {
-    if (state->onqueue) {
-        appmanager_timer_remove(&state->timer);
+    if (clock->onqueue) {
+        appmanager_timer_remove(&clock->timer);
+        clock->onqueue = 0;
     }
+
+    TimeUnits units = _tick_clock_units(clock);
+    if (!units)
+        return;
     
-    /* Figure out the desired time. */
-    time_t dtime;
-    struct tm nexttm;
-    
-    dtime = rcore_mktime(&state->lasttm);
+    /* Figure out the desired time. Round down from the last tick rather
+     * than going back through mktime; the fields say how far into the
+     * minute and hour we are */
+    time_t dtime = clock->lasttime;
 
-    if (state->units & SECOND_UNIT) {
-        dtime = dtime + 1;
-    } else if (state->units & MINUTE_UNIT) {
-        dtime = dtime + 60;
+    /* on a low battery, seconds come all at once on the minute */
+    if ((units & SECOND_UNIT) && power_is_saving())
+        units = (units & ~SECOND_UNIT) | MINUTE_UNIT;
 
-        rcore_localtime(&nexttm, dtime);
-        nexttm.tm_sec = 0;
-        dtime = rcore_mktime(&nexttm);
-    } else if (state->units & (HOUR_UNIT | DAY_UNIT | MONTH_UNIT | YEAR_UNIT)) {
+    if (units & SECOND_UNIT) {
+        dtime = dtime + 1;
+    } else if (units & MINUTE_UNIT) {
+        dtime = dtime - clock->lasttm.tm_sec + 60;
+    } else if (units & (HOUR_UNIT | DAY_UNIT | MONTH_UNIT | YEAR_UNIT)) {
         /* Everyone else gets woken up hourly, and we'll just cancel it
          * later if it wasn't requested.  */
-        dtime = dtime + 60 * 60;
-
-        rcore_localtime(&nexttm, dtime);
-        nexttm.tm_min = nexttm.tm_sec = 0;
-        dtime = rcore_mktime(&nexttm);
+        dtime = dtime - clock->lasttm.tm_min * 60 - clock->lasttm.tm_sec + 60 * 60;
     }
     uint32_t when = rcore_time_to_ticks(dtime, 0);
 TickType_t now = xTaskGetTickCount();
-    SYS_LOG("tick", APP_LOG_LEVEL_INFO, "dtime %ld, when %d, now %d", dtime, when, now);
+    SYS_LOG("tick", APP_LOG_LEVEL_DEBUG, "dtime %ld, when %d, now %d", dtime, when, now);
     /* if it seems like we need to add no time, its likely becuase
      * this timer is slight ms offset with wall rtc time.
      * To stop it spamming the timer by repeatedly adding itself to the front
@@ -63,65 +83,133 @@ TickType_t now = xTaskGetTickCount();
      */
     if (when == 0)
         when = 2;
-    state->timer.when = when;
-    state->timer.callback = _tick_timer_callback;
-    appmanager_timer_add(&state->timer);
-    state->onqueue = 1;
+    clock->timer.when = when;
+    clock->timer.callback = _tick_clock_callback;
+    appmanager_timer_add(&clock->timer);
+    clock->onqueue = 1;
 }
 
-static void _tick_timer_callback(CoreTimer *timer)
+static void _tick_clock_sync(TickClock *clock)
 {
-    TickTimerState *state = (TickTimerState *) timer;
+    rcore_time_ms(&clock->lasttime, NULL);
+    rcore_localtime(&clock->lasttm, clock->lasttime);
+}
+
+static void _tick_clock_callback(CoreTimer *timer)
+{
+    TickClock *clock = (TickClock *) timer;
     
     time_t time;
     struct tm tm;
     
-    state->onqueue = 0;
+    clock->onqueue = 0;
     
     rcore_time_ms(&time, NULL);
     rcore_localtime(&tm, time);
     
     TimeUnits units = 0;
     /* XXX: Does a real pebbleos return a bitmask, or only the MSB? */
-    if (tm.tm_sec != state->lasttm.tm_sec) units |= SECOND_UNIT;
-    if (tm.tm_min != state->lasttm.tm_min) units |= MINUTE_UNIT;
-    if (tm.tm_hour != state->lasttm.tm_hour) units |= HOUR_UNIT;
-    if (tm.tm_mday != state->lasttm.tm_mday) units |= DAY_UNIT;
-    if (tm.tm_mon != state->lasttm.tm_mon) units |= MONTH_UNIT;
-    if (tm.tm_year != state->lasttm.tm_year) units |= YEAR_UNIT;
+    if (tm.tm_sec != clock->lasttm.tm_sec) units |= SECOND_UNIT;
+    if (tm.tm_min != clock->lasttm.tm_min) units |= MINUTE_UNIT;
+    if (tm.tm_hour != clock->lasttm.tm_hour) units |= HOUR_UNIT;
+    if (tm.tm_mday != clock->lasttm.tm_mday) units |= DAY_UNIT;
+    if (tm.tm_mon != clock->lasttm.tm_mon) units |= MONTH_UNIT;
+    if (tm.tm_year != clock->lasttm.tm_year) units |= YEAR_UNIT;
 
     /* Update before we call in -- otherwise, they could unsubscribe, and
      * we'd just blissfully readd ourselves to the queue.  */
-    memcpy(&state->lasttm, &tm, sizeof(tm));
-    _tick_timer_update_next(state);
+    memcpy(&clock->lasttm, &tm, sizeof(tm));
+    clock->lasttime = time;
+    _tick_clock_update_next(clock);
     
-    if (units & state->units)
-        state->handler(&tm, units);
+    /* anyone can come or go from inside a callback; unsubscribe steps
+     * dispatch_next past whoever leaves */
+    clock->dispatch_next = clock->head;
+    while (clock->dispatch_next) {
+        TickListener *l = clock->dispatch_next;
+        clock->dispatch_next = l->next;
+
+        if (units & l->units) {
+            /* each gets their own copy, to scribble on if they like */
+            struct tm ltm = tm;
+            l->callback(l, &ltm, units);
+        }
+    }
+}
+
+void tick_listener_subscribe(TickListener *listener)
+{
+    TickClock *clock = &_clocks[appmanager_get_thread_type()];
+
+    if (!clock->head)
+        _tick_clock_sync(clock);
+
+    listener->next = clock->head;
+    clock->head = listener;
+
+    _tick_clock_update_next(clock);
+}
+
+void tick_listener_unsubscribe(TickListener *listener)
+{
+    TickClock *clock = &_clocks[appmanager_get_thread_type()];
+    TickListener **lnext = &clock->head;
+
+    while (*lnext) {
+        if (*lnext == listener) {
+            if (clock->dispatch_next == listener)
+                clock->dispatch_next = listener->next;
+            *lnext = listener->next;
+            _tick_clock_update_next(clock);
+            return;
+        }
+        lnext = &(*lnext)->next;
+    }
+}
+
+/* Power saving came or went. Work out this thread's next tick again */
+void tick_timer_resync(void)
+{
+    TickClock *clock = &_clocks[appmanager_get_thread_type()];
+
+    if (clock->head)
+        _tick_clock_update_next(clock);
+}
+
+/* The thread's timers and the app's heap are getting thrown away */
+void tick_timer_reset(AppThreadType thread_type)
+{
+    memset(&_clocks[thread_type], 0, sizeof(TickClock));
+    _app_handler[thread_type] = NULL;
+}
+
+static void _app_tick(TickListener *listener, struct tm *tick_time, TimeUnits units)
+{
+    _app_handler[listener - _app_listener](tick_time, units);
 }
 
 void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler)
 {
-    TickTimerState *state = &_state;
+    AppThreadType type = appmanager_get_thread_type();
+    TickListener *listener = &_app_listener[type];
 
-    time_t time;
-    
-    rcore_time_ms(&time, NULL);
-    rcore_localtime(&state->lasttm, time);
-    
-    state->units = tick_units;
-    state->handler = handler;
+    if (_app_handler[type])
+        tick_listener_unsubscribe(listener);
+
+    listener->units = tick_units;
+    listener->callback = _app_tick;
+    _app_handler[type] = handler;
     
-    _tick_timer_update_next(state);
+    tick_listener_subscribe(listener);
 }
 
 void tick_timer_service_unsubscribe(void)
 {
-    TickTimerState *state = &_state;
-    
-    if (state->onqueue) {
-        appmanager_timer_remove(&state->timer);
-        state->onqueue = 0;
-    }
-}
+    AppThreadType type = appmanager_get_thread_type();
 
+    if (!_app_handler[type])
+        return;
 
+    tick_listener_unsubscribe(&_app_listener[type]);
+    _app_handler[type] = NULL;
+}
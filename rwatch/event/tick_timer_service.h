@@ -6,5 +6,21 @@
  * Author: Barry Carter <barry.carter@gmail.com>
  */
 
+#include "appmanager.h"
+
+/* Something in the firmware that wants to hear about time ticking over.
+ * Listeners are per thread, and are called back on the thread that
+ * subscribed them */
+typedef struct TickListener {
+    TimeUnits units;
+    void (*callback)(struct TickListener *listener, struct tm *tick_time, TimeUnits units_changed);
+    struct TickListener *next;
+} TickListener;
+
 void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
 void tick_timer_service_unsubscribe(void);
+
+void tick_listener_subscribe(TickListener *listener);
+void tick_listener_unsubscribe(TickListener *listener);
+void tick_timer_resync(void);
+void tick_timer_reset(AppThreadType thread_type);
@@ -0,0 +1,243 @@
+/* unobstructed_area_service.c
+ * The part of the screen an app has to itself, and changes to it
+ * libRebbleOS
+ *
+ * When the area changes, the app is asked to lay itself out for where
+ * it ends up once, with its change handler at full progress, before the
+ * animation starts. The layer frames from before and after are kept, and
+ * each frame of the animation moves the layers between the two, rather
+ * than asking the app to lay everything out again every frame. The app
+ * hears change again at the end, and did_change.
+ */
+
+#include "librebble.h"
+#include "appmanager.h"
+#include "utils.h"
+#include "unobstructed_area_service.h"
+
+typedef struct UnobstructedLayout {
+    uint8_t count;
+    Layer *layer[UNOBSTRUCTED_LAYOUT_LAYERS];
+    GRect from[UNOBSTRUCTED_LAYOUT_LAYERS];
+    GRect to[UNOBSTRUCTED_LAYOUT_LAYERS];
+} UnobstructedLayout;
+
+static UnobstructedAreaHandlers _handlers;
+static void *_context;
+static bool _subscribed;
+
+/* all on the app thread, but for _pending */
+static GRect _area = { { 0, 0 }, { DISPLAY_COLS, DISPLAY_ROWS } };
+static GRect _from_area, _to_area;
+static Animation *_animation;
+static UnobstructedLayout *_layout;
+
+static GRect _pending = { { 0, 0 }, { DISPLAY_COLS, DISPLAY_ROWS } };
+static bool _pending_animated;
+
+static GRect _lerp(GRect from, GRect to, AnimationProgress progress)
+{
+    return GRect(ANIM_LERP(from.origin.x, to.origin.x, progress),
+                 ANIM_LERP(from.origin.y, to.origin.y, progress),
+                 ANIM_LERP(from.size.w, to.size.w, progress),
+                 ANIM_LERP(from.size.h, to.size.h, progress));
+}
+
+void unobstructed_area_service_subscribe(UnobstructedAreaHandlers handlers, void *context)
+{
+    if (handlers.will_change)
+        MK_THUMB_CB(handlers.will_change);
+    if (handlers.change)
+        MK_THUMB_CB(handlers.change);
+    if (handlers.did_change)
+        MK_THUMB_CB(handlers.did_change);
+
+    _handlers = handlers;
+    _context = context;
+    _subscribed = true;
+}
+
+void unobstructed_area_service_unsubscribe(void)
+{
+    _subscribed = false;
+}
+
+GRect unobstructed_area_get(void)
+{
+    return _area;
+}
+
+void unobstructed_area_set(GRect area, bool animated)
+{
+    taskENTER_CRITICAL();
+    _pending = area;
+    _pending_animated = animated;
+    taskEXIT_CRITICAL();
+
+    appmanager_post_service_event(APP_SERVICE_UNOBSTRUCTED);
+}
+
+/* Note where the tree's layers are now */
+static void _layout_walk(UnobstructedLayout *layout, Layer *layer)
+{
+    for (Layer *child = layer->child; child && layout->count < UNOBSTRUCTED_LAYOUT_LAYERS; child = child->sibling)
+    {
+        layout->layer[layout->count] = child;
+        layout->from[layout->count] = child->frame;
+        layout->count++;
+        _layout_walk(layout, child);
+    }
+}
+
+/*
+ * Have the app lay out for the final area, and keep whichever layers
+ * that moved with both of their frames. Then put them back, and the
+ * area, until the animation takes them there
+ */
+static void _layout_capture(Window *window)
+{
+    UnobstructedLayout *layout = app_calloc(1, sizeof(UnobstructedLayout));
+    uint8_t moved = 0;
+
+    if (!layout)
+        return;
+
+    _layout_walk(layout, window_get_root_layer(window));
+
+    _area = _to_area;
+    _handlers.change(ANIMATION_NORMALIZED_MAX, _context);
+    _area = _from_area;
+
+    for (uint8_t i = 0; i < layout->count; i++)
+    {
+        Layer *layer = layout->layer[i];
+        if (RECT_EQ(layer->frame, layout->from[i]))
+            continue;
+        layout->layer[moved] = layer;
+        layout->from[moved] = layout->from[i];
+        layout->to[moved] = layer->frame;
+        layer->frame = layout->from[i];
+        moved++;
+    }
+    layout->count = moved;
+    _layout = layout;
+}
+
+static void _update(Animation *animation, const AnimationProgress progress)
+{
+    Window *window = window_stack_get_top_window();
+
+    _area = _lerp(_from_area, _to_area, progress);
+    if (_layout)
+        for (uint8_t i = 0; i < _layout->count; i++)
+            _layout->layer[i]->frame = _lerp(_layout->from[i], _layout->to[i], progress);
+
+    /* anything may be laid out against the area, and the obstruction is moving anyway */
+    if (window)
+        layer_mark_dirty(window_get_root_layer(window));
+}
+
+static void _stopped(Animation *animation, bool finished, void *context)
+{
+    _area = _to_area;
+    if (_layout)
+    {
+        for (uint8_t i = 0; i < _layout->count; i++)
+            _layout->layer[i]->frame = _layout->to[i];
+        app_free(_layout);
+        _layout = NULL;
+    }
+    _animation = NULL;
+
+    if (_subscribed && _handlers.change)
+        _handlers.change(ANIMATION_NORMALIZED_MAX, _context);
+    if (_subscribed && _handlers.did_change)
+        _handlers.did_change(_context);
+}
+
+static void _teardown(Animation *animation)
+{
+    animation_destroy(animation);
+}
+
+static const AnimationImplementation _impl = {
+    .update = _update,
+    .teardown = _teardown,
+};
+
+void unobstructed_area_deliver(void)
+{
+    Window *window = window_stack_get_top_window();
+    GRect area;
+    bool animated;
+
+    taskENTER_CRITICAL();
+    area = _pending;
+    animated = _pending_animated;
+    taskEXIT_CRITICAL();
+
+    /* one on the way goes straight to where it was going */
+    if (_animation)
+        animation_unschedule(_animation);
+    if (RECT_EQ(area, _area))
+        return;
+
+    _from_area = _area;
+    _to_area = area;
+    if (_subscribed && _handlers.will_change)
+        _handlers.will_change(area, _context);
+
+    if (!animated || !window)
+    {
+        _stopped(NULL, true, NULL);
+        if (window)
+            layer_mark_dirty(window_get_root_layer(window));
+        return;
+    }
+
+    if (_subscribed && _handlers.change)
+        _layout_capture(window);
+
+    _animation = animation_create();
+    if (!_animation)
+    {
+        _stopped(NULL, true, NULL);
+        return;
+    }
+    animation_set_duration(_animation, UNOBSTRUCTED_AREA_MS);
+    animation_set_implementation(_animation, &_impl);
+    animation_set_handlers(_animation, (AnimationHandlers) { .stopped = _stopped }, NULL);
+    animation_schedule(_animation);
+}
+
+void unobstructed_area_release(Layer *layer)
+{
+    if (!_layout)
+        return;
+
+    for (uint8_t i = 0; i < _layout->count; i++)
+        if (_layout->layer[i] == layer)
+        {
+            _layout->count--;
+            _layout->layer[i] = _layout->layer[_layout->count];
+            _layout->from[i] = _layout->from[_layout->count];
+            _layout->to[i] = _layout->to[_layout->count];
+            return;
+        }
+}
+
+/*
+ * The app's memory, the layout and animation with it, is going or gone.
+ * The next one starts with whatever is in the way now, already there
+ */
+void unobstructed_area_app_reset(void)
+{
+    _subscribed = false;
+    _animation = NULL;
+    _layout = NULL;
+
+    taskENTER_CRITICAL();
+    _area = _pending;
+    taskEXIT_CRITICAL();
+    _to_area = _from_area = _area;
+}
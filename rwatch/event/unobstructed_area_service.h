@@ -0,0 +1,37 @@
+#pragma once
+/* unobstructed_area_service.h
+ * The part of the screen an app has to itself, and changes to it
+ * libRebbleOS
+ */
+
+#include "librebble.h"
+#include "animation.h"
+
+/* How long the obstruction takes to come or go */
+#define UNOBSTRUCTED_AREA_MS 250
+/* Most layers whose frames are carried between the two layouts */
+#define UNOBSTRUCTED_LAYOUT_LAYERS 24
+
+typedef void (*UnobstructedAreaWillChangeHandler)(GRect final_unobstructed_screen_area, void *context);
+typedef void (*UnobstructedAreaChangeHandler)(AnimationProgress progress, void *context);
+typedef void (*UnobstructedAreaDidChangeHandler)(void *context);
+
+typedef struct UnobstructedAreaHandlers {
+    UnobstructedAreaWillChangeHandler will_change;
+    UnobstructedAreaChangeHandler change;
+    UnobstructedAreaDidChangeHandler did_change;
+} UnobstructedAreaHandlers;
+
+void unobstructed_area_service_subscribe(UnobstructedAreaHandlers handlers, void *context);
+void unobstructed_area_service_unsubscribe(void);
+
+/* The unobstructed part of the screen, as the app sees it right now */
+GRect unobstructed_area_get(void);
+/* Something (a peek, quick view) now leaves the app area of the screen. Any thread */
+void unobstructed_area_set(GRect area, bool animated);
+/* On the app thread, for APP_SERVICE_UNOBSTRUCTED */
+void unobstructed_area_deliver(void);
+/* layer is going away; stop moving it */
+void unobstructed_area_release(Layer *layer);
+/* the app has gone, or is about to start */
+void unobstructed_area_app_reset(void);
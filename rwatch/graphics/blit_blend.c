@@ -0,0 +1,135 @@
+/* blit_blend.c
+ * Alpha blending onto 8 bit framebuffers, four pixels to a word
+ * libRebbleOS
+ *
+ * A GColor8 is ARGB2222, so the source says how much of itself to draw
+ * in its top two bits: none, a third, two thirds or all. ngfx would work
+ * that out a pixel at a time. Here a word of four source pixels goes over
+ * a word of four framebuffer pixels at once.
+ *
+ * The colour channels are two bits each, and halving adds of whole words
+ * with the low bit of each channel masked off before the shift don't carry
+ * from one channel into the next. The average of source and framebuffer
+ * is one of them, and averaging that again with either end gives the
+ * quarter and three quarter mixes, which stand in for the thirds: no
+ * channel is out by more than a step. Which of the four each pixel gets
+ * is picked by its alpha, with __usub8 and __sel on a core with the SIMD
+ * instructions, and with masks made the same way in plain C on one without.
+ *
+ * The framebuffer keeps its own alpha bits.
+ */
+
+#include "librebble.h"
+#include "blit_blend.h"
+
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#endif
+
+#define RGB_BITS    0x3F3F3F3Fu
+#define HIGH_BITS   0x2A2A2A2Au
+#define ALPHA_BITS  0xC0C0C0C0u
+
+/* Of each channel, (a + b) / 2 rounded down */
+static inline uint32_t _avg(uint32_t a, uint32_t b)
+{
+    return (a & b) + (((a ^ b) & HIGH_BITS) >> 1);
+}
+
+/* Each byte of x where that byte of alpha is at least k, else of y */
+static inline uint32_t _pick(uint32_t alpha, uint32_t k, uint32_t x, uint32_t y)
+{
+#if defined(__ARM_FEATURE_SIMD32)
+    /* only for the GE flags it leaves */
+    (void)__usub8(alpha, k);
+    return __sel(x, y);
+#else
+    uint32_t m = ((alpha | 0x80808080u) - k) & 0x80808080u;
+    m = (m >> 7) * 0xFF;
+    return (x & m) | (y & ~m);
+#endif
+}
+
+/* Four pixels of s over four of d */
+static inline uint32_t _blend(uint32_t d, uint32_t s)
+{
+    uint32_t alpha = (s >> 6) & 0x03030303u;
+    uint32_t sc = s & RGB_BITS, dc = d & RGB_BITS;
+    uint32_t half = _avg(sc, dc);
+    uint32_t hi = _pick(alpha, 0x03030303u, sc, _avg(sc, half));
+    uint32_t lo = _pick(alpha, 0x01010101u, _avg(half, dc), dc);
+
+    return (d & ALPHA_BITS) | _pick(alpha, 0x02020202u, hi, lo);
+}
+
+static inline uint8_t _blend_byte(uint8_t d, uint8_t s)
+{
+    return _blend(d, s);
+}
+
+/*
+ * Draw width by height pixels of src over dst, each as much as its alpha
+ * says. Both must already be clipped to their buffers
+ */
+void blit_blend_copy(uint8_t *dst, uint16_t dst_stride, const uint8_t *src, uint16_t src_stride,
+                     uint16_t width, uint16_t height)
+{
+    for (uint16_t row = 0; row < height; row++, dst += dst_stride, src += src_stride)
+    {
+        uint16_t x = 0;
+
+        /* up to a word boundary of the framebuffer */
+        for (; x < width && ((uintptr_t)(dst + x) & 3); x++)
+            dst[x] = _blend_byte(dst[x], src[x]);
+
+        for (; x + 4 <= width; x += 4)
+        {
+            uint32_t s, d;
+
+            memcpy(&s, src + x, 4);
+            /* all clear is nothing to do, all opaque is a copy */
+            if (!(s & ALPHA_BITS))
+                continue;
+            if ((s & ALPHA_BITS) == ALPHA_BITS)
+            {
+                *(uint32_t *)(dst + x) = s;
+                continue;
+            }
+            d = *(uint32_t *)(dst + x);
+            *(uint32_t *)(dst + x) = _blend(d, s);
+        }
+
+        for (; x < width; x++)
+            dst[x] = _blend_byte(dst[x], src[x]);
+    }
+}
+
+/*
+ * Lay argb over width by height pixels of dst, as much as its alpha says
+ */
+void blit_blend_fill(uint8_t *dst, uint16_t dst_stride, uint16_t width, uint16_t height, uint8_t argb)
+{
+    uint32_t s = argb * 0x01010101u;
+
+    if (!(argb & 0xC0))
+        return;
+
+    for (uint16_t row = 0; row < height; row++, dst += dst_stride)
+    {
+        uint16_t x = 0;
+
+        for (; x < width && ((uintptr_t)(dst + x) & 3); x++)
+            dst[x] = _blend_byte(dst[x], argb);
+
+        for (; x + 4 <= width; x += 4)
+            *(uint32_t *)(dst + x) = _blend(*(uint32_t *)(dst + x), s);
+
+        for (; x < width; x++)
+            dst[x] = _blend_byte(dst[x], argb);
+    }
+}
+
+uint8_t blit_blend_pixel(uint8_t dst, uint8_t argb)
+{
+    return _blend_byte(dst, argb);
+}
@@ -0,0 +1,11 @@
+#pragma once
+/* blit_blend.h
+ * Alpha blending onto 8 bit framebuffers, four pixels to a word
+ * libRebbleOS
+ */
+
+void blit_blend_copy(uint8_t *dst, uint16_t dst_stride, const uint8_t *src, uint16_t src_stride,
+                     uint16_t width, uint16_t height);
+void blit_blend_fill(uint8_t *dst, uint16_t dst_stride, uint16_t width, uint16_t height, uint8_t argb);
+/* one pixel of argb over dst, as the above do it */
+uint8_t blit_blend_pixel(uint8_t dst, uint8_t argb);
@@ -0,0 +1,140 @@
+/* blit_bw.c
+ * Word at a time fills and blits for 1 bit framebuffers
+ * libRebbleOS
+ *
+ * ngfx walks 1bpp surfaces a pixel at a time. Here each row is done 32
+ * pixels to a word, with masks for the ragged ends, so a full width fill
+ * on tintin is five stores a row.
+ *
+ * Pixel x is bit (x & 7) of byte (x >> 3). On a little endian core that
+ * makes it bit (x & 31) of word (x >> 5), so we can load whole words
+ * without shuffling bytes about. Both buffers and their strides have to
+ * be word aligned; callers fall back to ngfx when they aren't.
+ */
+
+#include "librebble.h"
+#include "blit_bw.h"
+
+static bool _is_word_aligned(const uint8_t *buf, uint16_t stride)
+{
+    return !(((uintptr_t)buf | stride) & 3);
+}
+
+/* Masks for the first and last words of a run from x0 up to, not
+ * including, x1 */
+static inline uint32_t _mask_from(int16_t x)
+{
+    return ~0u << (x & 31);
+}
+
+static inline uint32_t _mask_to(int16_t x)
+{
+    return ~0u >> (31 - ((x - 1) & 31));
+}
+
+/*
+ * 32 source pixels starting at bit. Anything off either end of the row
+ * reads as 0, and is masked off by the caller anyway
+ */
+static inline uint32_t _src_bits(const uint32_t *row, int16_t words, int32_t bit)
+{
+    int32_t w = bit >= 0 ? bit >> 5 : -((31 - bit) >> 5);
+    uint8_t s = bit & 31;
+    uint32_t lo = (w >= 0 && w < words) ? row[w] : 0;
+
+    if (!s)
+        return lo;
+
+    uint32_t hi = (w + 1 >= 0 && w + 1 < words) ? row[w + 1] : 0;
+    return (lo >> s) | (hi << (32 - s));
+}
+
+/*
+ * Fill rect, which must already be clipped to the buffer, with white or
+ * black. Returns false if the buffer isn't one we can do
+ */
+bool blit_bw_fill(uint8_t *fb, uint16_t stride, GRect rect, bool white)
+{
+    if (!_is_word_aligned(fb, stride) || rect.size.w <= 0 || rect.size.h <= 0)
+        return false;
+
+    int16_t x0 = rect.origin.x, x1 = rect.origin.x + rect.size.w;
+    int16_t w0 = x0 >> 5, w1 = (x1 - 1) >> 5;
+    uint32_t first = _mask_from(x0), last = _mask_to(x1);
+    uint32_t fill = white ? ~0u : 0;
+
+    if (w0 == w1)
+        first &= last;
+
+    for (int16_t y = rect.origin.y; y < rect.origin.y + rect.size.h; y++)
+    {
+        uint32_t *d = (uint32_t *)(fb + y * stride);
+
+        d[w0] = (d[w0] & ~first) | (fill & first);
+        if (w0 == w1)
+            continue;
+        for (int16_t w = w0 + 1; w < w1; w++)
+            d[w] = fill;
+        d[w1] = (d[w1] & ~last) | (fill & last);
+    }
+
+    return true;
+}
+
+/* Put the masked bits of s into d the way op says */
+static inline uint32_t _compose(uint32_t d, uint32_t s, uint32_t m, GCompOp op)
+{
+    switch (op)
+    {
+        case GCompOpAssign:         return (d & ~m) | (s & m);
+        case GCompOpAssignInverted: return (d & ~m) | (~s & m);
+        case GCompOpOr:             return d | (s & m);
+        case GCompOpAnd:            return d & (s | ~m);
+        case GCompOpClear:          return d & ~(s & m);
+        default:                    return d;
+    }
+}
+
+/*
+ * Composite size pixels from src at from onto dst at to. The rect has to
+ * be clipped to both buffers already. Returns false for anything we
+ * don't do, which is unaligned buffers and GCompOpSet
+ */
+bool blit_bw_copy(uint8_t *dst, uint16_t dst_stride, GPoint to,
+                  const uint8_t *src, uint16_t src_stride, GPoint from,
+                  GSize size, GCompOp op)
+{
+    if (!_is_word_aligned(dst, dst_stride) || !_is_word_aligned(src, src_stride))
+        return false;
+    if (op != GCompOpAssign && op != GCompOpAssignInverted && op != GCompOpOr &&
+        op != GCompOpAnd && op != GCompOpClear)
+        return false;
+    if (size.w <= 0 || size.h <= 0)
+        return true;
+
+    int16_t x0 = to.x, x1 = to.x + size.w;
+    int16_t w0 = x0 >> 5, w1 = (x1 - 1) >> 5;
+    uint32_t first = _mask_from(x0), last = _mask_to(x1);
+    /* source pixel for destination pixel x is x + delta */
+    int32_t delta = from.x - to.x;
+    int16_t src_words = src_stride / 4;
+
+    for (int16_t y = 0; y < size.h; y++)
+    {
+        uint32_t *d = (uint32_t *)(dst + (to.y + y) * dst_stride);
+        const uint32_t *s = (const uint32_t *)(src + (from.y + y) * src_stride);
+
+        for (int16_t w = w0; w <= w1; w++)
+        {
+            uint32_t m = ~0u;
+            if (w == w0)
+                m &= first;
+            if (w == w1)
+                m &= last;
+
+            d[w] = _compose(d[w], _src_bits(s, src_words, w * 32 + delta), m, op);
+        }
+    }
+
+    return true;
+}
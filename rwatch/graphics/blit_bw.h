@@ -0,0 +1,10 @@
+#pragma once
+/* blit_bw.h
+ * Word at a time fills and blits for 1 bit framebuffers
+ * libRebbleOS
+ */
+
+bool blit_bw_fill(uint8_t *fb, uint16_t stride, GRect rect, bool white);
+bool blit_bw_copy(uint8_t *dst, uint16_t dst_stride, GPoint to,
+                  const uint8_t *src, uint16_t src_stride, GPoint from,
+                  GSize size, GCompOp op);
@@ -0,0 +1,90 @@
+/* blit_palette.c
+ * Blits of 1, 2 and 4 bit palettised bitmaps onto 8 bit framebuffers
+ * libRebbleOS
+ *
+ * Icons and PBIs mostly come palettised, and stay that way in memory, at
+ * an eighth to a half of the 8 bit size. Here they are drawn straight
+ * from the packed indices, looking each one up as it goes, so nothing has
+ * to expand them first.
+ *
+ * Pixels are packed from the top of the byte down. Palettes that are all
+ * opaque are done here, and for GCompOpSet any palette, its translucent
+ * colours blended as blit_blend does them.
+ */
+
+#include "librebble.h"
+#include "blit_palette.h"
+#include "blit_blend.h"
+
+static uint8_t _bpp(uint8_t format)
+{
+    switch (format)
+    {
+        case GBitmapFormat1BitPalette: return 1;
+        case GBitmapFormat2BitPalette: return 2;
+        case GBitmapFormat4BitPalette: return 4;
+        default:                       return 0;
+    }
+}
+
+/*
+ * Work out what each index draws for op. Returns false if the bitmap or
+ * its palette is not one we can do
+ */
+bool blit_palette_prepare(BlitPalette *bp, const GBitmap *bitmap, GCompOp op)
+{
+    bp->bpp = _bpp(bitmap->format);
+    if (!bp->bpp || !bitmap->palette)
+        return false;
+    if (op != GCompOpAssign && op != GCompOpSet)
+        return false;
+
+    uint8_t entries = 1 << bp->bpp;
+    if (bitmap->palette_size && bitmap->palette_size < entries)
+        entries = bitmap->palette_size;
+
+    bp->drawn = 0;
+    bp->blended = 0;
+    memset(bp->color, 0, sizeof(bp->color));
+    for (uint8_t i = 0; i < entries; i++)
+    {
+        uint8_t argb = bitmap->palette[i].argb;
+        uint8_t alpha = argb >> 6;
+
+        bp->color[i] = argb;
+        if (alpha == 3)
+            bp->drawn |= 1 << i;
+        else if (op != GCompOpSet)
+            return false;
+        else if (alpha != 0)
+            bp->blended |= 1 << i;
+    }
+    return true;
+}
+
+/*
+ * Draw size pixels of src, from from, at to in dst. Both must already be
+ * clipped to their buffers
+ */
+void blit_palette_copy(const BlitPalette *bp, uint8_t *dst, uint16_t dst_stride, GPoint to,
+                       const uint8_t *src, uint16_t src_stride, GPoint from, GSize size)
+{
+    const uint8_t bpp = bp->bpp;
+    const uint8_t mask = (1 << bpp) - 1;
+
+    for (int16_t row = 0; row < size.h; row++)
+    {
+        const uint8_t *s = src + (from.y + row) * src_stride;
+        uint8_t *d = dst + (to.y + row) * dst_stride + to.x;
+        uint32_t bit = from.x * bpp;
+
+        for (int16_t x = 0; x < size.w; x++, bit += bpp)
+        {
+            uint8_t idx = (s[bit >> 3] >> (8 - bpp - (bit & 7))) & mask;
+            if (bp->drawn & (1 << idx))
+                d[x] = bp->color[idx];
+            else if (bp->blended & (1 << idx))
+                d[x] = blit_blend_pixel(d[x], bp->color[idx]);
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+/* blit_palette.h
+ * Blits of 1, 2 and 4 bit palettised bitmaps onto 8 bit framebuffers
+ * libRebbleOS
+ */
+
+/* The palette as it will be drawn: a colour per index, which indices are
+ * drawn over what is there, and which are blended with it */
+typedef struct BlitPalette {
+    uint8_t bpp;
+    uint16_t drawn;
+    uint16_t blended;
+    uint8_t color[16];
+} BlitPalette;
+
+bool blit_palette_prepare(BlitPalette *bp, const GBitmap *bitmap, GCompOp op);
+void blit_palette_copy(const BlitPalette *bp, uint8_t *dst, uint16_t dst_stride, GPoint to,
+                       const uint8_t *src, uint16_t src_stride, GPoint from, GSize size);
@@ -0,0 +1,90 @@
+#pragma once
+/* font_format.h
+ * The Pebble font resource layout
+ * libRebbleOS
+ */
+
+#define FONT_FEATURE_OFFSET_16 0x01
+#define FONT_FEATURE_RLE4      0x02
+
+/* Pebble font resource layout */
+typedef struct __attribute__((__packed__)) FontHeader {
+    uint8_t version;
+    uint8_t line_height;
+    uint16_t glyph_amount;
+    uint16_t wildcard_codepoint;
+    /* v2 */
+    uint8_t hash_table_size;
+    uint8_t codepoint_bytes;
+    /* v3 */
+    uint8_t fontinfo_size;
+    uint8_t features;
+} FontHeader;
+
+typedef struct __attribute__((__packed__)) FontHashEntry {
+    uint8_t hash;
+    uint8_t count;
+    uint16_t offset;
+} FontHashEntry;
+
+typedef struct __attribute__((__packed__)) GlyphHeader {
+    uint8_t width;
+    uint8_t height;
+    int8_t left;
+    int8_t top;
+    int8_t advance;
+} GlyphHeader;
+
+/* Where the parts of a v2 or v3 font are */
+typedef struct FontLayout {
+    uint8_t header_size;
+    uint8_t offset_bytes;
+    uint8_t entry_size;
+    /* header, hash table and offset tables. The glyphs start here */
+    uint32_t tables_size;
+} FontLayout;
+
+/* False if the font isn't one we can read */
+static inline bool font_layout(const FontHeader *hdr, FontLayout *layout)
+{
+    if (hdr->version < 2)
+        return false;
+    if (!hdr->hash_table_size || (hdr->codepoint_bytes != 2 && hdr->codepoint_bytes != 4))
+        return false;
+
+    layout->header_size = hdr->version >= 3 ? hdr->fontinfo_size : 8;
+    layout->offset_bytes = (hdr->version >= 3 && (hdr->features & FONT_FEATURE_OFFSET_16)) ? 2 : 4;
+    layout->entry_size = hdr->codepoint_bytes + layout->offset_bytes;
+    layout->tables_size = layout->header_size + hdr->hash_table_size * sizeof(FontHashEntry) +
+                          hdr->glyph_amount * layout->entry_size;
+    return true;
+}
+
+/* The offset table entry for codepoint, NULL if the font hasn't got it */
+static inline uint8_t *font_find_entry(const uint8_t *font, const FontLayout *layout, uint32_t codepoint)
+{
+    const FontHeader *hdr = (const FontHeader *)font;
+    const FontHashEntry *hash_table = (const FontHashEntry *)(font + layout->header_size);
+    const uint8_t *offset_tables = (const uint8_t *)(hash_table + hdr->hash_table_size);
+
+    const FontHashEntry *bucket = &hash_table[codepoint % hdr->hash_table_size];
+    const uint8_t *entry = offset_tables + bucket->offset;
+
+    for (uint8_t i = 0; i < bucket->count; i++, entry += layout->entry_size)
+    {
+        uint32_t cp = 0;
+        memcpy(&cp, entry, hdr->codepoint_bytes);
+        if (cp == codepoint)
+            return (uint8_t *)entry;
+    }
+
+    return NULL;
+}
+
+/* Offsets count 32 bit words from the end of the tables */
+static inline uint32_t font_entry_offset(const FontHeader *hdr, const FontLayout *layout, const uint8_t *entry)
+{
+    uint32_t offset = 0;
+    memcpy(&offset, entry + hdr->codepoint_bytes, layout->offset_bytes);
+    return offset;
+}
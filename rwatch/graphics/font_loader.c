@@ -8,53 +8,83 @@
 #include "rebbleos.h"
 #include "librebble.h"
 #include "platform_res.h"
+#include "glyph_cache.h"
+#include "font_pager.h"
 
 
 
 
-/* totally hacky, but at least vaguely thread safe
- * We now have a cache size of 1 for each thread
+/* System fonts are cached in their own heap, shared by every thread.
+ * They are read only, so once loaded anyone can draw with them. Where the
+ * flash is memory mapped they aren't loaded at all, we point at them.
+ *
+ * A font can't be thrown out while a thread that asked for it is still
+ * running, as it will be holding the pointer. Each thread drops its claim
+ * when its fonts are reset, which for an app is on its way in. Unclaimed
+ * fonts stay loaded, so the next app likely gets them for free, and are
+ * evicted least recently used first when we need the room.
  */
+#define FONT_CACHE_ENTRIES 6
 
 typedef struct GFontCache
 {
     uint32_t resource_id;
     GFont font;
+    uint8_t users; /* bitmask of AppThreadType holding the font */
+    uint32_t last_used;
 } GFontCache;
 
 uint16_t _fonts_get_resource_id_for_key(const char *key);
 GFont fonts_get_system_font_by_resource_id(uint32_t resource_id);
 
-static GFontCache _app_font_cache;
-static GFontCache _ovl_font_cache;
+static uint8_t _font_heap[MEMORY_SIZE_FONT_CACHE];
+static qarena_t *_font_arena;
+static GFontCache _font_cache[FONT_CACHE_ENTRIES];
+static uint32_t _font_cache_clock;
+static SemaphoreHandle_t _font_mutex;
+static StaticSemaphore_t _font_mutex_buf;
+
+/* When the cache is full of fonts in use, we fall back to
+ * loading into the caller's heap, one font per thread */
+static GFontCache _thread_font[MAX_APP_THREADS];
+
+uint8_t fonts_init(void)
+{
+    _font_arena = qinit(_font_heap, MEMORY_SIZE_FONT_CACHE);
+    _font_mutex = xSemaphoreCreateMutexStatic(&_font_mutex_buf);
+
+    return glyph_cache_init();
+}
 
 void fonts_resetcache()
 {
     AppThreadType thread_type = appmanager_get_thread_type();
     
     KERN_LOG("font", APP_LOG_LEVEL_DEBUG, "Purging fonts");
-    /* This is pretty terrible. We assume that the app is removing the memory 
-     * for the font before we kill the cache entry */
-    if (thread_type == AppThreadMainApp)
-    {
-        /* reset it to available. */
-        _app_font_cache.resource_id = 0;
-        _app_font_cache.font = NULL;
-    }
-    else if (thread_type == AppThreadOverlay)
-    {
-        /* reset it to available. */
-        _ovl_font_cache.resource_id = 0;
-        _ovl_font_cache.font = NULL;
-    }
-    else
+
+    if (thread_type >= MAX_APP_THREADS)
     {
         KERN_LOG("font", APP_LOG_LEVEL_ERROR, "Why you need fonts?");
+        return;
     }
+
+    xSemaphoreTake(_font_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < FONT_CACHE_ENTRIES; i++)
+        _font_cache[i].users &= ~(1 << thread_type);
+    xSemaphoreGive(_font_mutex);
+
+    /* This is pretty terrible. We assume that the app is removing the memory 
+     * for the font before we kill the cache entry.
+     * Custom fonts die with the app heap, so their glyphs go too */
+    glyph_cache_reset();
+    if (thread_type == AppThreadMainApp)
+        font_pager_reset();
+    flash_unmap(_thread_font[thread_type].font);
+    _thread_font[thread_type].resource_id = 0;
+    _thread_font[thread_type].font = NULL;
 }
 
-// get a system font and then cache it. Ugh.
-// TODO make this not suck (RAM)
+// get a system font and then cache it.
 GFont fonts_get_system_font(const char *font_key)
 {
     uint16_t res_id = _fonts_get_resource_id_for_key(font_key);
@@ -62,40 +92,134 @@ GFont fonts_get_system_font(const char *font_key)
     return fonts_get_system_font_by_resource_id(res_id);
 }
 
+/* Free the least recently used font nobody holds. False if there isn't one */
+static bool _fonts_evict_one(void)
+{
+    GFontCache *victim = NULL;
+
+    for (uint8_t i = 0; i < FONT_CACHE_ENTRIES; i++)
+    {
+        GFontCache *item = &_font_cache[i];
+        if (!item->font || item->users)
+            continue;
+        if (!victim || item->last_used < victim->last_used)
+            victim = item;
+    }
+
+    if (!victim)
+        return false;
+
+    KERN_LOG("font", APP_LOG_LEVEL_DEBUG, "Evicting font %d", victim->resource_id);
+    glyph_cache_purge_font(victim->font);
+    if (!flash_unmap(victim->font))
+        qfree(_font_arena, victim->font);
+    victim->font = NULL;
+    victim->resource_id = 0;
+    return true;
+}
+
+static GFontCache *_fonts_free_slot(void)
+{
+    for (uint8_t i = 0; i < FONT_CACHE_ENTRIES; i++)
+        if (!_font_cache[i].font)
+            return &_font_cache[i];
+
+    return NULL;
+}
+
+/* Load a font into the shared heap. NULL if it won't fit. Call locked */
+static GFontCache *_fonts_cache_load(uint32_t resource_id)
+{
+    ResHandle handle = resource_get_handle_system(resource_id);
+    size_t size = resource_size(handle);
+    uint8_t *buffer;
+
+    if (!size)
+        return NULL;
+
+    GFontCache *slot = _fonts_free_slot();
+    if (!slot && _fonts_evict_one())
+        slot = _fonts_free_slot();
+    if (!slot)
+        return NULL;
+
+    const uint8_t *mapped = resource_map_flash(handle, NULL);
+    if (mapped)
+    {
+        slot->resource_id = resource_id;
+        slot->font = (GFont)mapped;
+        slot->users = 0;
+        return slot;
+    }
+
+    while (!(buffer = qalloc(_font_arena, size)))
+    {
+        if (!_fonts_evict_one())
+            return NULL;
+    }
+
+    resource_load_system(handle, buffer, size);
+    slot->resource_id = resource_id;
+    slot->font = (GFont)buffer;
+    slot->users = 0;
+
+    return slot;
+}
+
 /*
  * Load a system font from the resource table
- * Will save into a cheesey cache so it isn't loaded over and over.
+ * Will save into the shared font cache so it isn't loaded over and over.
  */
 GFont fonts_get_system_font_by_resource_id(uint32_t resource_id)
 {
-    GFontCache *cache_item;
+    GFontCache *cache_item = NULL;
     AppThreadType thread_type = appmanager_get_thread_type();  
     
-    if (thread_type == AppThreadMainApp)
+    if (thread_type >= MAX_APP_THREADS)
     {
-        cache_item = &_app_font_cache;
+        KERN_LOG("font", APP_LOG_LEVEL_ERROR, "Why you need fonts?");
+        return NULL;
     }
-    else if (thread_type == AppThreadOverlay)
+
+    xSemaphoreTake(_font_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < FONT_CACHE_ENTRIES; i++)
     {
-        cache_item = &_ovl_font_cache;
+        if (_font_cache[i].font && _font_cache[i].resource_id == resource_id)
+        {
+            cache_item = &_font_cache[i];
+            break;
+        }
     }
-    else
+    
+    /* not cached, load */
+    if (!cache_item)
+        cache_item = _fonts_cache_load(resource_id);
+
+    if (cache_item)
     {
-        KERN_LOG("font", APP_LOG_LEVEL_ERROR, "Why you need fonts?");
+        cache_item->users |= 1 << thread_type;
+        cache_item->last_used = ++_font_cache_clock;
+        GFont font = cache_item->font;
+        xSemaphoreGive(_font_mutex);
+        return font;
     }
+    xSemaphoreGive(_font_mutex);
 
+    /* Everything in the cache is in use. Do it the old way */
+    KERN_LOG("font", APP_LOG_LEVEL_WARNING, "Font cache full, loading %d into app heap", resource_id);
+    cache_item = &_thread_font[thread_type];
     if (cache_item->resource_id == resource_id)
     {
         return cache_item->font;
     }
     
-    /* not cached, load */   
     if (cache_item->resource_id > 0 && cache_item->font)
     {
-        app_free(cache_item->font);
+        glyph_cache_purge_font(cache_item->font);
+        resource_unmap((const uint8_t *)cache_item->font);
     }
     
-    uint8_t *buffer = resource_fully_load_id_system(resource_id);
+    const uint8_t *buffer = resource_map(resource_get_handle_system(resource_id), NULL, NULL);
     
     cache_item->font = (GFont)buffer;
     cache_item->resource_id = resource_id;
@@ -104,10 +228,15 @@ GFont fonts_get_system_font_by_resource_id(uint32_t resource_id)
 }
 
 /*
- * Load a custom font
+ * Load a custom font. Big ones keep only their tables in the heap,
+ * and page their glyphs in as they are drawn
  */
 GFont fonts_load_custom_font(ResHandle handle, const struct file* file)
 {
+    GFont paged = font_pager_load(handle, file);
+    if (paged)
+        return paged;
+
     uint8_t *buffer = resource_fully_load_resource(handle, file, NULL);
     
     return (GFont)buffer;
@@ -124,7 +253,9 @@ GFont fonts_load_custom_font_proxy(ResHandle handle)
  */
 void fonts_unload_custom_font(GFont font)
 {
-    app_free(font);
+    glyph_cache_purge_font(font);
+    if (!font_pager_unload(font))
+        app_free(font);
 }
 
 #define EQ_FONT(font) (strncmp(key, "RESOURCE_ID_" #font, strlen(key)) == 0) return RESOURCE_ID_ ## font;
@@ -6,6 +6,7 @@
  * Author: Barry Carter <barry.carter@gmail.com>
  */
 
+uint8_t fonts_init(void);
 void fonts_resetcache();
 GFont fonts_get_system_font(const char *key);
 GFont fonts_load_custom_font(ResHandle handle, const struct file* file);
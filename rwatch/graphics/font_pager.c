@@ -0,0 +1,356 @@
+/* font_pager.c
+ * Big custom fonts, with their glyphs paged in from the resource
+ * libRebbleOS
+ *
+ * A custom font is loaded whole into the app's heap, and a big or CJK
+ * font can be most of it. Nearly all of that is glyph bitmaps, of which a
+ * screen of text needs a few. So for big fonts we only load the header
+ * and tables, which is what finding a glyph takes, and after them, where
+ * the glyphs would start, a pool for the glyphs in use.
+ *
+ * Every offset in the tables points into the pool. Glyphs that aren't in
+ * point at the wildcard glyph, which always is, so whatever reads the
+ * font, ngfx included, only ever finds glyphs that are there, if not
+ * always the right one. Before text is drawn its glyphs are read in and
+ * their offsets pointed at them. They go round the pool in turn, and the
+ * offset goes back to the wildcard when a glyph is pushed out. The glyphs
+ * of the text being drawn are never pushed out for each other.
+ *
+ * App resources are spread over the filesystem's pages, so there is
+ * nothing to map. Compressed and RLE fonts are loaded whole, as before.
+ * Everything lives in the app's heap, so only the app thread pages.
+ */
+
+#include "rebbleos.h"
+#include "librebble.h"
+#include "font_format.h"
+#include "font_pager.h"
+#include "glyph_cache.h"
+
+#define FONT_PAGER_FONTS 4
+#define FONT_PAGER_SLOTS 64
+/* Fonts with less glyph data than this are loaded whole */
+#define FONT_PAGER_MIN_GLYPHS 8192
+/* The pool is an eighth of the glyph data, within these */
+#define FONT_PAGER_POOL_MIN 2048
+#define FONT_PAGER_POOL_MAX 8192
+
+typedef struct FontPagerSlot {
+    uint8_t *entry;      /* the glyph's offset table entry, NULL if free */
+    uint16_t at;         /* in the pool, in words */
+    uint16_t words;
+    uint32_t last_used;
+    uint32_t pinned;     /* the draw that needs it */
+} FontPagerSlot;
+
+typedef struct FontPager {
+    uint8_t *font;       /* header and tables, then the pool */
+    ResHandle handle;
+    const struct file *file;
+    FontLayout layout;
+    uint8_t *wildcard;   /* its entry. It sits at the start of the pool */
+    uint16_t pool_words;
+    uint16_t next;       /* where the next glyph goes */
+    uint32_t clock;
+    FontPagerSlot slots[FONT_PAGER_SLOTS];
+} FontPager;
+
+static FontPager *_pagers[FONT_PAGER_FONTS];
+
+static bool _is_app_thread(void)
+{
+    return appmanager_get_thread_type() == AppThreadMainApp;
+}
+
+static FontPager *_pager_find(GFont font)
+{
+    for (uint8_t i = 0; i < FONT_PAGER_FONTS; i++)
+        if (_pagers[i] && _pagers[i]->font == (uint8_t *)font)
+            return _pagers[i];
+
+    return NULL;
+}
+
+static bool _read(FontPager *p, uint32_t offset, void *buf, size_t len)
+{
+    return resource_load_byte_range_file(p->handle, p->file, offset, buf, len) == len;
+}
+
+static void _entry_set(FontPager *p, uint8_t *entry, uint32_t offset)
+{
+    memcpy(entry + ((const FontHeader *)p->font)->codepoint_bytes, &offset, p->layout.offset_bytes);
+}
+
+static void _slot_evict(FontPager *p, FontPagerSlot *slot)
+{
+    _entry_set(p, slot->entry, 0);
+    slot->entry = NULL;
+}
+
+/* A free slot, or the least recently used one nothing is drawing with */
+static FontPagerSlot *_slot_get(FontPager *p)
+{
+    FontPagerSlot *victim = NULL;
+
+    /* the wildcard in slot 0 stays */
+    for (uint16_t i = 1; i < FONT_PAGER_SLOTS; i++)
+    {
+        FontPagerSlot *s = &p->slots[i];
+        if (!s->entry)
+            return s;
+        if (s->pinned == p->clock)
+            continue;
+        if (!victim || s->last_used < victim->last_used)
+            victim = s;
+    }
+
+    if (victim)
+        _slot_evict(p, victim);
+    return victim;
+}
+
+/* Room for words at the head of the pool, pushing out what's there and
+ * going round what the current draw needs. -1 if there is no room */
+static int32_t _pool_alloc(FontPager *p, uint16_t words)
+{
+    const uint16_t base = p->slots[0].words; /* the wildcard */
+    uint16_t at = p->next;
+    bool wrapped = false;
+
+    for (;;)
+    {
+        if (at + words > p->pool_words)
+        {
+            if (wrapped)
+                return -1;
+            wrapped = true;
+            at = base;
+        }
+
+        FontPagerSlot *held = NULL;
+        for (uint16_t i = 1; i < FONT_PAGER_SLOTS && !held; i++)
+        {
+            FontPagerSlot *s = &p->slots[i];
+            if (s->entry && s->pinned == p->clock && s->at < at + words && s->at + s->words > at)
+                held = s;
+        }
+        if (!held)
+            break;
+        at = held->at + held->words;
+    }
+
+    for (uint16_t i = 1; i < FONT_PAGER_SLOTS; i++)
+    {
+        FontPagerSlot *s = &p->slots[i];
+        if (s->entry && s->at < at + words && s->at + s->words > at)
+            _slot_evict(p, s);
+    }
+
+    p->next = at + words;
+    return at;
+}
+
+/* Read the glyph of entry into the pool at a free slot */
+static bool _page_in(FontPager *p, uint8_t *entry, bool pin)
+{
+    const FontHeader *hdr = (const FontHeader *)p->font;
+
+    if (entry == p->wildcard)
+        return true;
+
+    if (font_entry_offset(hdr, &p->layout, entry))
+    {
+        for (uint16_t i = 1; i < FONT_PAGER_SLOTS; i++)
+        {
+            FontPagerSlot *s = &p->slots[i];
+            if (s->entry != entry)
+                continue;
+            s->last_used = p->clock;
+            if (pin)
+                s->pinned = p->clock;
+            return true;
+        }
+    }
+
+    /* where it really is, from the copy of the table in the resource */
+    uint32_t offset = 0;
+    GlyphHeader gh;
+    if (!_read(p, (entry - p->font) + hdr->codepoint_bytes, &offset, p->layout.offset_bytes) ||
+        !_read(p, p->layout.tables_size + offset * 4, &gh, sizeof(gh)))
+        return false;
+
+    uint16_t bytes = sizeof(GlyphHeader) + (gh.width * gh.height + 7) / 8;
+    uint16_t words = (bytes + 3) / 4;
+
+    FontPagerSlot *slot = _slot_get(p);
+    if (!slot)
+        return false;
+    int32_t at = _pool_alloc(p, words);
+    if (at < 0)
+        return false;
+
+    uint8_t *to = p->font + p->layout.tables_size + at * 4;
+    if (!_read(p, p->layout.tables_size + offset * 4, to, bytes))
+        return false;
+
+    slot->entry = entry;
+    slot->at = at;
+    slot->words = words;
+    slot->last_used = p->clock;
+    slot->pinned = pin ? p->clock : 0;
+    _entry_set(p, entry, at);
+    return true;
+}
+
+/*
+ * Load a custom font with only its tables resident, if it is big enough
+ * to be worth it and one we can page. NULL to load it whole
+ */
+GFont font_pager_load(ResHandle handle, const struct file *file)
+{
+    FontHeader hdr;
+    FontLayout layout;
+    FontPager **free_pager = NULL;
+
+    if (!file || !_is_app_thread())
+        return NULL;
+
+    for (uint8_t i = 0; i < FONT_PAGER_FONTS && !free_pager; i++)
+        if (!_pagers[i])
+            free_pager = &_pagers[i];
+    if (!free_pager)
+        return NULL;
+
+    memset(&hdr, 0, sizeof(hdr));
+    if (resource_load_byte_range_file(handle, file, 0, (uint8_t *)&hdr, sizeof(hdr)) != sizeof(hdr))
+        return NULL;
+    if (!font_layout(&hdr, &layout) || (hdr.version >= 3 && (hdr.features & FONT_FEATURE_RLE4)))
+        return NULL;
+
+    size_t size = resource_size(handle);
+    if (size < layout.tables_size + FONT_PAGER_MIN_GLYPHS)
+        return NULL;
+
+    uint32_t pool = (size - layout.tables_size) / 8;
+    if (pool < FONT_PAGER_POOL_MIN)
+        pool = FONT_PAGER_POOL_MIN;
+    if (pool > FONT_PAGER_POOL_MAX)
+        pool = FONT_PAGER_POOL_MAX;
+
+    FontPager *p = app_calloc(1, sizeof(FontPager));
+    uint8_t *font = app_malloc(layout.tables_size + pool);
+    if (!p || !font)
+        goto fail;
+
+    p->font = font;
+    p->handle = handle;
+    p->file = file;
+    p->layout = layout;
+    p->pool_words = pool / 4;
+    p->clock = 1;
+
+    /* a compressed resource can't be read from part way, and fails here */
+    if (!_read(p, 0, font, layout.tables_size))
+        goto fail;
+
+    /* the wildcard goes first, for good, while the table still has its offset */
+    p->wildcard = font_find_entry(font, &layout, hdr.wildcard_codepoint);
+    if (!p->wildcard)
+        goto fail;
+
+    GlyphHeader gh;
+    uint32_t offset = font_entry_offset(&hdr, &layout, p->wildcard);
+    if (!_read(p, layout.tables_size + offset * 4, &gh, sizeof(gh)))
+        goto fail;
+    uint16_t bytes = sizeof(GlyphHeader) + (gh.width * gh.height + 7) / 8;
+    if (bytes > pool / 2 || !_read(p, layout.tables_size + offset * 4, font + layout.tables_size, bytes))
+        goto fail;
+
+    p->slots[0].entry = p->wildcard;
+    p->slots[0].words = (bytes + 3) / 4;
+    p->next = p->slots[0].words;
+
+    /* and everything else points at it, until it is read in */
+    uint8_t *entry = font + layout.header_size + hdr.hash_table_size * sizeof(FontHashEntry);
+    for (uint16_t i = 0; i < hdr.glyph_amount; i++, entry += layout.entry_size)
+        _entry_set(p, entry, 0);
+
+    *free_pager = p;
+    return (GFont)font;
+
+fail:
+    if (font)
+        app_free(font);
+    if (p)
+        app_free(p);
+    return NULL;
+}
+
+/* False if font isn't one of ours */
+bool font_pager_unload(GFont font)
+{
+    for (uint8_t i = 0; i < FONT_PAGER_FONTS; i++)
+    {
+        if (!_pagers[i] || _pagers[i]->font != (uint8_t *)font)
+            continue;
+        app_free(_pagers[i]->font);
+        app_free(_pagers[i]);
+        _pagers[i] = NULL;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * The app's heap has gone, and our fonts with it
+ */
+void font_pager_reset(void)
+{
+    memset(_pagers, 0, sizeof(_pagers));
+}
+
+/*
+ * Read in every glyph text needs, and hold them until the next draw.
+ * False if some of them are standing in for the wildcard
+ */
+bool font_pager_prepare(GFont font, const char *text)
+{
+    FontPager *p = _pager_find(font);
+    bool ok = true;
+
+    if (!p)
+        return true;
+    if (!_is_app_thread())
+        return false;
+
+    p->clock++;
+    while (text && *text)
+    {
+        uint8_t *entry = font_find_entry(p->font, &p->layout, glyph_cache_next(&text));
+        if (entry && !_page_in(p, entry, true))
+            ok = false;
+    }
+
+    return ok;
+}
+
+/* Whether font's glyphs move about under it */
+bool font_pager_is_paged(GFont font)
+{
+    return _pager_find(font) != NULL;
+}
+
+/* Read in one glyph, without holding it */
+bool font_pager_page_in(GFont font, uint32_t codepoint)
+{
+    FontPager *p = _pager_find(font);
+
+    if (!p)
+        return true;
+    if (!_is_app_thread())
+        return false;
+
+    uint8_t *entry = font_find_entry(p->font, &p->layout, codepoint);
+    return !entry || _page_in(p, entry, false);
+}
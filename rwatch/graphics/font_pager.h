@@ -0,0 +1,12 @@
+#pragma once
+/* font_pager.h
+ * Big custom fonts, with their glyphs paged in from the resource
+ * libRebbleOS
+ */
+
+GFont font_pager_load(ResHandle handle, const struct file *file);
+bool font_pager_unload(GFont font);
+void font_pager_reset(void);
+bool font_pager_prepare(GFont font, const char *text);
+bool font_pager_page_in(GFont font, uint32_t codepoint);
+bool font_pager_is_paged(GFont font);
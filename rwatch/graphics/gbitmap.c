@@ -11,39 +11,200 @@
 #include "png.h"
 #include "ngfxwrap.h"
 
+/* PBI (raw Pebble bitmap) layout. Pixel rows follow the header, then
+ * the palette for the palettised formats, one GColor per entry */
+typedef struct __attribute__((__packed__)) PbiHeader {
+    uint16_t row_size_bytes;
+    uint16_t info_flags;
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+} PbiHeader;
+
+#define PBI_FORMAT(flags) (((flags) >> 1) & 0x1F)
+
+static const uint8_t _png_signature[] = { 0x89, 'P', 'N', 'G' };
+
+static bool _is_png(const uint8_t *data, size_t size)
+{
+    return size >= sizeof(_png_signature) && !memcmp(data, _png_signature, sizeof(_png_signature));
+}
+
+static uint16_t _pbi_palette_size(uint8_t format)
+{
+    switch (format)
+    {
+        case GBitmapFormat1BitPalette: return 2;
+        case GBitmapFormat2BitPalette: return 4;
+        case GBitmapFormat4BitPalette: return 16;
+        default:                       return 0;
+    }
+}
+
 /*
- * Load a resource into the GBitmap by resource id
+ * Point bitmap at the pixels and palette of a PBI, in place.
+ * Returns false if the header doesn't make sense for size bytes
  */
-GBitmap *gbitmap_create_with_resource(uint32_t resource_id)
+static bool _pbi_to_gbitmap(GBitmap *bitmap, uint8_t *data, size_t size)
 {
-    uint8_t *png_data = resource_fully_load_id_system(resource_id);
-    ResHandle res_handle = resource_get_handle_system(resource_id);
-    size_t png_data_size = resource_size(res_handle);
+    PbiHeader hdr;
+
+    if (size < sizeof(PbiHeader))
+        return false;
+    memcpy(&hdr, data, sizeof(PbiHeader));
+
+    uint8_t format = PBI_FORMAT(hdr.info_flags);
+    if (format > GBitmapFormat8BitCircular || hdr.w < 0 || hdr.h < 0)
+        return false;
+
+    size_t pixel_bytes = hdr.row_size_bytes * hdr.h;
+    uint16_t palette_size = _pbi_palette_size(format);
+    if (sizeof(PbiHeader) + pixel_bytes + palette_size * sizeof(n_GColor) > size)
+        return false;
 
-    if (!png_data)
+    memset(bitmap, 0, sizeof(GBitmap));
+    bitmap->addr = data + sizeof(PbiHeader);
+    bitmap->row_size_bytes = hdr.row_size_bytes;
+    bitmap->format = format;
+    bitmap->bounds = GRect(hdr.x, hdr.y, hdr.w, hdr.h);
+    bitmap->raw_bitmap_size = GSize(hdr.x + hdr.w, hdr.y + hdr.h);
+    if (palette_size)
+    {
+        bitmap->palette = (n_GColor *)(bitmap->addr + pixel_bytes);
+        bitmap->palette_size = palette_size;
+    }
+
+    return true;
+}
+
+/*
+ * Make a bitmap of a PBI resource we loaded, taking the buffer over
+ */
+static GBitmap *_gbitmap_create_with_pbi(uint8_t *data, size_t size)
+{
+    GBitmap *bitmap = app_malloc(sizeof(GBitmap));
+    if (!bitmap)
+    {
+        app_free(data);
+        return NULL;
+    }
+
+    if (!_pbi_to_gbitmap(bitmap, data, size))
+    {
+        SYS_LOG("gbitmap", APP_LOG_LEVEL_ERROR, "Not a PBI, %d bytes", (int)size);
+        app_free(data);
+        app_free(bitmap);
         return NULL;
+    }
 
-    return gbitmap_create_from_png_data(png_data, png_data_size);
+    /* Slide everything down over the header so the pixels start the
+     * allocation, and destroy can free the lot in one go. The palette
+     * comes along with them */
+    size_t body = size - sizeof(PbiHeader);
+    memmove(data, data + sizeof(PbiHeader), body);
+    if (bitmap->palette)
+        bitmap->palette = (n_GColor *)((uint8_t *)bitmap->palette - sizeof(PbiHeader));
+    bitmap->addr = data;
+    bitmap->free_data_on_destroy = true;
+    bitmap->free_palette_on_destroy = false;
+
+    return bitmap;
 }
 
-GBitmap *gbitmap_create_with_resource_app(uint32_t resource_id, const struct file *file)
+typedef struct GBitmapResource {
+    ResHandle handle;
+    const struct file *file;
+} GBitmapResource;
+
+static unsigned long _resource_read(void *ctx, unsigned long offset, unsigned char *out, unsigned long len)
 {
-    size_t png_size;
-    uint8_t *png_data = (uint8_t*)resource_fully_load_id_app_file(resource_id, file, &png_size);
+    GBitmapResource *res = (GBitmapResource *)ctx;
 
-    if (!png_data)
+    return resource_load_byte_range_file(res->handle, res->file, offset, out, len);
+}
+
+/*
+ * PNGs are decoded a window at a time straight off flash, so only the
+ * pixels ever land on the heap. PBIs are loaded whole and used in place
+ */
+static GBitmap *_gbitmap_create_with_handle(ResHandle handle, const struct file *file)
+{
+    GBitmapResource res = { handle, file };
+    uint8_t signature[sizeof(_png_signature)];
+    size_t size = resource_size(handle);
+
+    if (resource_load_byte_range_file(handle, file, 0, signature, sizeof(signature)) != sizeof(signature))
         return NULL;
 
-    return gbitmap_create_from_png_data(png_data, png_size);
+    if (_is_png(signature, sizeof(signature)))
+    {
+        GBitmap *bitmap = (GBitmap*)app_malloc(sizeof(GBitmap));
+        if (!bitmap)
+            return NULL;
+
+        png_to_gbitmap_streamed(bitmap, _resource_read, &res, size);
+        return bitmap;
+    }
+
+    uint8_t *data = resource_fully_load_resource(handle, file, &size);
+    if (!data)
+        return NULL;
+
+    return _gbitmap_create_with_pbi(data, size);
+}
+
+/*
+ * Load a resource into the GBitmap by resource id.
+ * System bitmaps are shared and read only, see resource_bitmap_get
+ */
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id)
+{
+    return resource_bitmap_get(resource_id);
+}
+
+/*
+ * Decode a system resource into a bitmap of the caller's own
+ */
+GBitmap *gbitmap_create_with_resource_uncached(uint32_t resource_id)
+{
+    return _gbitmap_create_with_handle(resource_get_handle_system(resource_id), NULL);
+}
+
+GBitmap *gbitmap_create_with_resource_app(uint32_t resource_id, const struct file *file)
+{
+    return _gbitmap_create_with_handle(resource_get_handle(resource_id), file);
 }
 
 /*
- * Create a new bitmap with the given data
+ * Create a new bitmap with the given PBI data. The bitmap points into
+ * data, which stays the caller's and has to outlive it
  */
 GBitmap *gbitmap_create_with_data(uint8_t *data)
 {
-    // TODO: Implement PBI (issue #52)
-    return NULL;
+    if (!data)
+        return NULL;
+
+    GBitmap *bitmap = app_malloc(sizeof(GBitmap));
+    if (!bitmap)
+        return NULL;
+
+    /* we aren't told how big it is, so trust the header */
+    PbiHeader hdr;
+    memcpy(&hdr, data, sizeof(PbiHeader));
+    size_t size = sizeof(PbiHeader) + hdr.row_size_bytes * hdr.h +
+                  _pbi_palette_size(PBI_FORMAT(hdr.info_flags)) * sizeof(n_GColor);
+
+    if (!_pbi_to_gbitmap(bitmap, data, size))
+    {
+        app_free(bitmap);
+        return NULL;
+    }
+
+    bitmap->free_data_on_destroy = false;
+    bitmap->free_palette_on_destroy = false;
+
+    return bitmap;
 }
 
 /*
@@ -58,6 +219,17 @@ GBitmap *gbitmap_create_from_png_data(uint8_t *png_data, size_t png_data_size)
     return bitmap;
 }
 
+/*
+ * Shared bitmaps go back to the cache. Anything else is ours to free
+ */
+void gbitmap_destroy(GBitmap *bitmap)
+{
+    if (!bitmap || resource_bitmap_put(bitmap))
+        return;
+
+    n_gbitmap_destroy(bitmap);
+}
+
 GBitmapDataRowInfo gbitmap_get_data_row_info(const GBitmap * bitmap, uint16_t y)
 {
     uint8_t *data = gbitmap_get_data(bitmap);
@@ -32,6 +32,13 @@ GBitmap *gbitmap_create_with_resource(uint32_t resource_id);
 GBitmap *gbitmap_create_with_resource_app(uint32_t resource_id, const struct file *file);
 GBitmap *gbitmap_create_with_data(uint8_t *data);
 GBitmap *gbitmap_create_from_png_data(uint8_t *png_data, size_t png_data_size);
+GBitmap *gbitmap_create_with_resource_uncached(uint32_t resource_id);
+void gbitmap_destroy(GBitmap *bitmap);
+
+/* shared system bitmaps, in resource.c */
+GBitmap *resource_bitmap_get(uint32_t resource_id);
+bool resource_bitmap_put(GBitmap *bitmap);
+void resource_bitmap_cache_reset(void);
 
 typedef struct GBitmapDataRowInfo {
     uint8_t* data;
@@ -0,0 +1,482 @@
+/* glyph_cache.c
+ * Expanded glyph bitmaps for the text fast path
+ * libRebbleOS
+ *
+ * ngfx decodes every glyph out of the font blob each time it draws one.
+ * Watchfaces draw the same handful of digits over and over, so for the
+ * simple case (one line that fits in its box) we decode each glyph once
+ * into a byte per pixel mask and blit it ourselves.
+ *
+ * Anything else, or any font we don't understand, goes to ngfx as before.
+ */
+
+#include "rebbleos.h"
+#include "librebble.h"
+#include "glyph_cache.h"
+#include "font_format.h"
+#include "font_pager.h"
+
+/* Find a glyph in the font blob. NULL if the font isn't one we can read */
+static const uint8_t *_font_find_glyph(const uint8_t *font, uint32_t codepoint)
+{
+    const FontHeader *hdr = (const FontHeader *)font;
+    FontLayout layout;
+
+    if (!font_layout(hdr, &layout))
+        return NULL;
+
+    const uint8_t *entry = font_find_entry(font, &layout, codepoint);
+    if (!entry)
+        return NULL;
+
+    return font + layout.tables_size + font_entry_offset(hdr, &layout, entry) * 4;
+}
+
+/* How far a glyph moves the pen, or -1 if we can't read the font */
+int16_t glyph_cache_get_advance(GFont font, uint32_t codepoint)
+{
+    font_pager_page_in(font, codepoint);
+    const uint8_t *data = _font_find_glyph((const uint8_t *)font, codepoint);
+    if (!data)
+        data = _font_find_glyph((const uint8_t *)font, ((const FontHeader *)font)->wildcard_codepoint);
+    if (!data)
+        return -1;
+
+    return ((const GlyphHeader *)data)->advance;
+}
+
+/* Pull the next codepoint off a UTF-8 string */
+uint32_t glyph_cache_utf8_next(const char **text)
+{
+    const uint8_t *s = (const uint8_t *)*text;
+    uint32_t cp;
+    uint8_t extra;
+
+    if (s[0] < 0x80)      { cp = s[0];        extra = 0; }
+    else if (s[0] < 0xE0) { cp = s[0] & 0x1F; extra = 1; }
+    else if (s[0] < 0xF0) { cp = s[0] & 0x0F; extra = 2; }
+    else                  { cp = s[0] & 0x07; extra = 3; }
+
+    s++;
+    for (; extra && (*s & 0xC0) == 0x80; extra--, s++)
+        cp = (cp << 6) | (*s & 0x3F);
+
+    *text = (const char *)s;
+    return cp;
+}
+
+/*
+ * ASCII glyphs by codepoint, for the fonts text is being drawn in right
+ * now. Hashing every digit of every redraw costs more than the drawing.
+ * Built on first use and dropped with the font. Paged fonts move their
+ * glyphs about, so they go the long way.
+ */
+#define GLYPH_ASCII_FONTS 4
+#define GLYPH_ASCII_NONE 0xFFFF
+
+struct GlyphAscii {
+    GFont font;
+    uint8_t users;
+    uint32_t last_used;
+    const uint8_t *glyphs;
+    /* words from glyphs, the wildcard's where the font hasn't got one */
+    uint16_t offset[GLYPH_ASCII_CODEPOINTS];
+};
+
+static GlyphAscii _ascii[GLYPH_ASCII_FONTS];
+static uint32_t _ascii_clock;
+static SemaphoreHandle_t _ascii_mutex;
+static StaticSemaphore_t _ascii_mutex_buf;
+
+static void _ascii_init(void)
+{
+    _ascii_mutex = xSemaphoreCreateMutexStatic(&_ascii_mutex_buf);
+}
+
+/* Forget font's table, or every idle one for NULL */
+static void _ascii_drop(GFont font)
+{
+    xSemaphoreTake(_ascii_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < GLYPH_ASCII_FONTS; i++)
+        if (font ? _ascii[i].font == font : !_ascii[i].users)
+            _ascii[i].font = NULL;
+    xSemaphoreGive(_ascii_mutex);
+}
+
+static bool _ascii_build(GlyphAscii *a, GFont font)
+{
+    const uint8_t *f = (const uint8_t *)font;
+    const FontHeader *hdr = (const FontHeader *)font;
+    FontLayout layout;
+
+    if (!font_layout(hdr, &layout))
+        return false;
+
+    uint32_t wildcard = GLYPH_ASCII_NONE;
+    const uint8_t *entry = font_find_entry(f, &layout, hdr->wildcard_codepoint);
+    if (entry)
+        wildcard = font_entry_offset(hdr, &layout, entry);
+
+    for (uint8_t cp = 0; cp < GLYPH_ASCII_CODEPOINTS; cp++)
+    {
+        entry = font_find_entry(f, &layout, cp);
+        uint32_t offset = entry ? font_entry_offset(hdr, &layout, entry) : wildcard;
+        /* a font this big can go the long way */
+        if (offset > GLYPH_ASCII_NONE)
+            return false;
+        a->offset[cp] = offset;
+    }
+
+    a->glyphs = f + layout.tables_size;
+    a->font = font;
+    return true;
+}
+
+/*
+ * Hold the ASCII table of font for a run of lookups, building it if need
+ * be. NULL if the font can't have one; look glyphs up the long way
+ */
+const GlyphAscii *glyph_cache_ascii_begin(GFont font)
+{
+    GlyphAscii *a = NULL;
+
+    if (!font || font_pager_is_paged(font))
+        return NULL;
+
+    xSemaphoreTake(_ascii_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < GLYPH_ASCII_FONTS && !a; i++)
+        if (_ascii[i].font == font)
+            a = &_ascii[i];
+
+    if (!a)
+    {
+        /* tables someone is reading stay put */
+        for (uint8_t i = 0; i < GLYPH_ASCII_FONTS; i++)
+        {
+            GlyphAscii *e = &_ascii[i];
+            if (e->users)
+                continue;
+            if (!a || !e->font || (a->font && e->last_used < a->last_used))
+                a = e;
+        }
+        if (a)
+        {
+            a->font = NULL;
+            if (!_ascii_build(a, font))
+                a = NULL;
+        }
+    }
+
+    if (a)
+    {
+        a->users++;
+        a->last_used = ++_ascii_clock;
+    }
+    xSemaphoreGive(_ascii_mutex);
+
+    return a;
+}
+
+void glyph_cache_ascii_end(const GlyphAscii *ascii)
+{
+    if (!ascii)
+        return;
+
+    xSemaphoreTake(_ascii_mutex, portMAX_DELAY);
+    ((GlyphAscii *)ascii)->users--;
+    xSemaphoreGive(_ascii_mutex);
+}
+
+/* The glyph for an ASCII codepoint, NULL if the font has none */
+static inline const uint8_t *_ascii_glyph(const GlyphAscii *a, uint32_t codepoint)
+{
+    uint16_t offset = a->offset[codepoint];
+    if (offset == GLYPH_ASCII_NONE)
+        return NULL;
+    return a->glyphs + offset * 4;
+}
+
+/* glyph_cache_get_advance, from the table while it's ASCII */
+int16_t glyph_cache_ascii_advance(const GlyphAscii *ascii, GFont font, uint32_t codepoint)
+{
+    if (!ascii || codepoint >= GLYPH_ASCII_CODEPOINTS)
+        return glyph_cache_get_advance(font, codepoint);
+
+    const uint8_t *data = _ascii_glyph(ascii, codepoint);
+    if (!data)
+        return -1;
+
+    return ((const GlyphHeader *)data)->advance;
+}
+
+/* Masks are blitted a byte per pixel, which only works on 8 bit displays.
+ * Off until the metrics are checked against ngfx output on hardware */
+// #define GLYPH_CACHE_DRAW_TEXT
+
+#if defined(GLYPH_CACHE_DRAW_TEXT) && !defined(REBBLE_PLATFORM_TINTIN)
+
+#define GLYPH_CACHE_ENTRIES 64
+/* Longest string the fast path will take */
+#define GLYPH_TEXT_MAX 32
+
+typedef struct GlyphCacheEntry {
+    GFont font;
+    uint32_t codepoint;
+    GlyphHeader header;
+    uint32_t last_used;
+    uint8_t *mask; /* width * height, 0x00 or 0xFF */
+} GlyphCacheEntry;
+
+static uint8_t _glyph_heap[MEMORY_SIZE_GLYPH_CACHE];
+static qarena_t *_glyph_arena;
+static GlyphCacheEntry _glyphs[GLYPH_CACHE_ENTRIES];
+static uint32_t _glyph_clock;
+static SemaphoreHandle_t _glyph_mutex;
+static StaticSemaphore_t _glyph_mutex_buf;
+
+uint8_t glyph_cache_init(void)
+{
+    _glyph_arena = qinit(_glyph_heap, MEMORY_SIZE_GLYPH_CACHE);
+    _glyph_mutex = xSemaphoreCreateMutexStatic(&_glyph_mutex_buf);
+    _ascii_init();
+
+    return INIT_RESP_OK;
+}
+
+static void _glyph_free(GlyphCacheEntry *entry)
+{
+    if (entry->mask)
+        qfree(_glyph_arena, entry->mask);
+    entry->mask = NULL;
+    entry->font = NULL;
+}
+
+/*
+ * Drop every glyph. Fonts are keyed by address, so when the fonts
+ * they came from might have gone, so must they.
+ */
+void glyph_cache_reset(void)
+{
+    xSemaphoreTake(_glyph_mutex, portMAX_DELAY);
+    for (uint16_t i = 0; i < GLYPH_CACHE_ENTRIES; i++)
+        _glyph_free(&_glyphs[i]);
+    xSemaphoreGive(_glyph_mutex);
+    _ascii_drop(NULL);
+}
+
+/* Drop the glyphs of one font that is about to be freed */
+void glyph_cache_purge_font(GFont font)
+{
+    xSemaphoreTake(_glyph_mutex, portMAX_DELAY);
+    for (uint16_t i = 0; i < GLYPH_CACHE_ENTRIES; i++)
+        if (_glyphs[i].font == font)
+            _glyph_free(&_glyphs[i]);
+    xSemaphoreGive(_glyph_mutex);
+    _ascii_drop(font);
+}
+
+/* Throw out the least recently used glyph not needed by the current draw */
+static bool _glyph_evict_one(void)
+{
+    GlyphCacheEntry *victim = NULL;
+
+    for (uint16_t i = 0; i < GLYPH_CACHE_ENTRIES; i++)
+    {
+        GlyphCacheEntry *e = &_glyphs[i];
+        if (!e->font || e->last_used == _glyph_clock)
+            continue;
+        if (!victim || e->last_used < victim->last_used)
+            victim = e;
+    }
+
+    if (!victim)
+        return false;
+
+    _glyph_free(victim);
+    return true;
+}
+
+/* Get a glyph, decoding it on a miss. Call locked */
+static GlyphCacheEntry *_glyph_get(const GlyphAscii *ascii, GFont font, uint32_t codepoint)
+{
+    GlyphCacheEntry *slot = NULL;
+
+    for (uint16_t i = 0; i < GLYPH_CACHE_ENTRIES; i++)
+    {
+        GlyphCacheEntry *e = &_glyphs[i];
+        if (e->font == font && e->codepoint == codepoint)
+        {
+            e->last_used = _glyph_clock;
+            return e;
+        }
+        if (!e->font && !slot)
+            slot = e;
+    }
+
+    const FontHeader *hdr = (const FontHeader *)font;
+    if (hdr->version >= 3 && (hdr->features & FONT_FEATURE_RLE4))
+        return NULL;
+
+    const uint8_t *data;
+    if (ascii && codepoint < GLYPH_ASCII_CODEPOINTS)
+    {
+        data = _ascii_glyph(ascii, codepoint);
+    }
+    else
+    {
+        data = _font_find_glyph((const uint8_t *)font, codepoint);
+        if (!data)
+            data = _font_find_glyph((const uint8_t *)font, hdr->wildcard_codepoint);
+    }
+    if (!data)
+        return NULL;
+
+    GlyphHeader gh;
+    memcpy(&gh, data, sizeof(GlyphHeader));
+    uint16_t pixels = gh.width * gh.height;
+
+    if (!slot && _glyph_evict_one())
+    {
+        for (uint16_t i = 0; i < GLYPH_CACHE_ENTRIES && !slot; i++)
+            if (!_glyphs[i].font)
+                slot = &_glyphs[i];
+    }
+    if (!slot)
+        return NULL;
+
+    uint8_t *mask = NULL;
+    if (pixels)
+    {
+        while (!(mask = qalloc(_glyph_arena, pixels)))
+        {
+            if (!_glyph_evict_one())
+                return NULL;
+        }
+
+        /* 1 bit per pixel, LSB first, rows run on without padding */
+        const uint8_t *bits = data + sizeof(GlyphHeader);
+        for (uint16_t i = 0; i < pixels; i++)
+            mask[i] = (bits[i >> 3] & (1 << (i & 7))) ? 0xFF : 0x00;
+    }
+
+    slot->font = font;
+    slot->codepoint = codepoint;
+    slot->header = gh;
+    slot->mask = mask;
+    slot->last_used = _glyph_clock;
+
+    return slot;
+}
+
+static void _glyph_blit(uint8_t *fb, const GlyphCacheEntry *g, int16_t x, int16_t y, uint8_t color)
+{
+    for (uint8_t row = 0; row < g->header.height; row++)
+    {
+        int16_t py = y + row;
+        if (py < 0 || py >= DISPLAY_ROWS)
+            continue;
+
+#ifdef PBL_ROUND
+        /* only the part of the row behind the glass */
+        int16_t left = display_spans[py].x0 - x;
+        int16_t right = display_spans[py].x1 - x;
+#else
+        int16_t left = -x;
+        int16_t right = DISPLAY_COLS - x;
+#endif
+        int16_t c0 = left > 0 ? left : 0;
+        int16_t c1 = right < g->header.width ? right : g->header.width;
+
+        const uint8_t *m = g->mask + row * g->header.width;
+        uint8_t *dst = fb + py * DISPLAY_COLS;
+        for (int16_t col = c0; col < c1; col++)
+            dst[x + col] = (dst[x + col] & ~m[col]) | (color & m[col]);
+    }
+}
+
+/*
+ * Draw a single line of text that fits in box, in screen coordinates.
+ * Returns false if it isn't that simple, and ngfx should do it.
+ */
+bool glyph_cache_draw_text(uint8_t *fb, GFont font, const char *text, GRect box,
+                           GTextAlignment alignment, GColor color)
+{
+    GlyphCacheEntry *glyphs[GLYPH_TEXT_MAX];
+    uint8_t count = 0;
+    int16_t width = 0;
+
+    if (!font || !text || (color.argb & 0xC0) != 0xC0)
+        return false;
+    if (((const FontHeader *)font)->line_height > box.size.h)
+        return false;
+
+    const GlyphAscii *ascii = glyph_cache_ascii_begin(font);
+    xSemaphoreTake(_glyph_mutex, portMAX_DELAY);
+    /* everything touched by this draw is stamped, so we don't evict it */
+    _glyph_clock++;
+
+    while (*text)
+    {
+        uint32_t cp = glyph_cache_next(&text);
+        if (cp == '\n' || count == GLYPH_TEXT_MAX)
+            goto slow;
+
+        GlyphCacheEntry *g = _glyph_get(ascii, font, cp);
+        if (!g)
+            goto slow;
+
+        glyphs[count++] = g;
+        width += g->header.advance;
+        if (width > box.size.w)
+            goto slow;
+    }
+
+    int16_t x = box.origin.x;
+    if (alignment == GTextAlignmentCenter)
+        x += (box.size.w - width) / 2;
+    else if (alignment == GTextAlignmentRight)
+        x += box.size.w - width;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        GlyphCacheEntry *g = glyphs[i];
+        if (g->mask)
+            _glyph_blit(fb, g, x + g->header.left, box.origin.y + g->header.top, color.argb);
+        x += g->header.advance;
+    }
+
+    xSemaphoreGive(_glyph_mutex);
+    glyph_cache_ascii_end(ascii);
+    return true;
+
+slow:
+    xSemaphoreGive(_glyph_mutex);
+    glyph_cache_ascii_end(ascii);
+    return false;
+}
+
+#else
+
+uint8_t glyph_cache_init(void)
+{
+    _ascii_init();
+    return INIT_RESP_OK;
+}
+
+void glyph_cache_reset(void)
+{
+    _ascii_drop(NULL);
+}
+
+void glyph_cache_purge_font(GFont font)
+{
+    _ascii_drop(font);
+}
+
+bool glyph_cache_draw_text(uint8_t *fb, GFont font, const char *text, GRect box,
+                           GTextAlignment alignment, GColor color)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+/* glyph_cache.h
+ * Expanded glyph bitmaps for the text fast path
+ * libRebbleOS
+ */
+
+uint8_t glyph_cache_init(void);
+void glyph_cache_reset(void);
+void glyph_cache_purge_font(GFont font);
+int16_t glyph_cache_get_advance(GFont font, uint32_t codepoint);
+uint32_t glyph_cache_utf8_next(const char **text);
+
+/* The next codepoint, without a call for ASCII */
+static inline uint32_t glyph_cache_next(const char **text)
+{
+    uint8_t c = (uint8_t)**text;
+    if (c < 0x80)
+    {
+        (*text)++;
+        return c;
+    }
+    return glyph_cache_utf8_next(text);
+}
+
+#define GLYPH_ASCII_CODEPOINTS 128
+typedef struct GlyphAscii GlyphAscii;
+const GlyphAscii *glyph_cache_ascii_begin(GFont font);
+void glyph_cache_ascii_end(const GlyphAscii *ascii);
+int16_t glyph_cache_ascii_advance(const GlyphAscii *ascii, GFont font, uint32_t codepoint);
+
+bool glyph_cache_draw_text(uint8_t *fb, GFont font, const char *text, GRect box,
+                           GTextAlignment alignment, GColor color);
@@ -0,0 +1,244 @@
+/* gpath_cache.c
+ * Rotated points and scanlines for filled paths
+ * libRebbleOS
+ *
+ * ngfx rotates and rasterises a path from scratch every time it is filled.
+ * Watch hands get filled every frame but only turn once a minute, so we
+ * keep the rotated outline as spans per row, relative to the path's
+ * offset, and fill by memsetting them. Moving a path costs nothing;
+ * rotating it or changing its points builds it again.
+ *
+ * We only learn a path's angle through gpath_rotate_to_app, so a path we
+ * aren't tracking (pushed out of the table, say) goes to ngfx until it is
+ * next rotated. Everything lives in the app's heap, so only the app
+ * thread gets to use it.
+ */
+
+#include "librebble.h"
+#include "display.h"
+#include "utils.h"
+#include "gpath_cache.h"
+
+#define GPATH_CACHE_ENTRIES 8
+/* Anything with more points than this goes to ngfx */
+#define GPATH_CACHE_MAX_POINTS 32
+
+typedef struct GPathCacheEntry {
+    const n_GPath *path;
+    int32_t angle;
+    uint32_t last_used;
+    bool is_built;
+    /* what it was built from, so we notice the app editing its points */
+    uint16_t num_points;
+    n_GPoint *points;    /* one allocation: points, then row_start, then xs */
+    int16_t top;         /* first row, relative to the offset */
+    uint16_t rows;
+    uint16_t *row_start; /* index into xs of each row's crossings, rows + 1 of them */
+    int16_t *xs;         /* crossings in pairs, sorted along the row */
+} GPathCacheEntry;
+
+static GPathCacheEntry _entries[GPATH_CACHE_ENTRIES];
+static uint32_t _clock;
+
+static bool _is_app_thread(void)
+{
+    return appmanager_get_thread_type() == AppThreadMainApp;
+}
+
+static void _entry_unbuild(GPathCacheEntry *e)
+{
+    if (e->points)
+        app_free(e->points);
+    e->points = NULL;
+    e->is_built = false;
+}
+
+static GPathCacheEntry *_entry_find(const n_GPath *path)
+{
+    for (uint16_t i = 0; i < GPATH_CACHE_ENTRIES; i++)
+        if (_entries[i].path == path)
+            return &_entries[i];
+
+    return NULL;
+}
+
+/* Find path, or start tracking it in a free or the least recently used slot */
+static GPathCacheEntry *_entry_track(const n_GPath *path)
+{
+    GPathCacheEntry *e = _entry_find(path);
+    if (e)
+        return e;
+
+    e = &_entries[0];
+    for (uint16_t i = 0; i < GPATH_CACHE_ENTRIES && e->path; i++)
+        if (!_entries[i].path || _entries[i].last_used < e->last_used)
+            e = &_entries[i];
+
+    _entry_unbuild(e);
+    e->path = path;
+    e->angle = 0;
+    e->last_used = ++_clock;
+    return e;
+}
+
+/*
+ * Rotate the path and work out where each row's pixel centres cross its
+ * edges. Pixels between each pair of crossings are inside.
+ */
+static bool _entry_build(GPathCacheEntry *e, const n_GPath *path)
+{
+    uint16_t n = path->num_points;
+    n_GPoint p[GPATH_CACHE_MAX_POINTS];
+
+    trig_rotate_points(p, path->points, n, e->angle, (n_GPoint) { 0, 0 });
+
+    int16_t top = p[0].y, bottom = p[0].y;
+    uint32_t crossings = 0;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        const n_GPoint *a = &p[i], *b = &p[(i + 1) % n];
+        top = MIN(top, a->y);
+        bottom = MAX(bottom, a->y);
+        crossings += a->y < b->y ? b->y - a->y : a->y - b->y;
+    }
+
+    uint16_t rows = bottom - top;
+    uint8_t *buf = app_malloc(n * sizeof(n_GPoint) + (rows + 1) * sizeof(uint16_t) + crossings * sizeof(int16_t));
+    if (!buf)
+        return false;
+
+    e->points = (n_GPoint *)buf;
+    e->row_start = (uint16_t *)(buf + n * sizeof(n_GPoint));
+    e->xs = (int16_t *)(e->row_start + rows + 1);
+    memcpy(e->points, path->points, n * sizeof(n_GPoint));
+    e->num_points = n;
+    e->top = top;
+    e->rows = rows;
+
+    uint16_t k = 0;
+    for (uint16_t r = 0; r < rows; r++)
+    {
+        /* the middle of the row, 16.16 */
+        int32_t cy = ((int32_t)(top + r) << 16) + 0x8000;
+        e->row_start[r] = k;
+
+        for (uint16_t i = 0; i < n; i++)
+        {
+            const n_GPoint *a = &p[i], *b = &p[(i + 1) % n];
+            if (a->y == b->y)
+                continue;
+            if (a->y > b->y)
+            {
+                const n_GPoint *t = a;
+                a = b;
+                b = t;
+            }
+            if (cy < ((int32_t)a->y << 16) || cy >= ((int32_t)b->y << 16))
+                continue;
+
+            int32_t xf = ((int32_t)a->x << 16) +
+                (int32_t)(((int64_t)(cy - ((int32_t)a->y << 16)) * (b->x - a->x)) / (b->y - a->y));
+            /* first pixel whose middle is past the edge */
+            int16_t x = (xf - 0x8000 + 0xFFFF) >> 16;
+
+            uint16_t j = k++;
+            for (; j > e->row_start[r] && e->xs[j - 1] > x; j--)
+                e->xs[j] = e->xs[j - 1];
+            e->xs[j] = x;
+        }
+    }
+    e->row_start[rows] = k;
+    e->is_built = true;
+
+    return true;
+}
+
+/*
+ * The app's heap has gone, and our allocations with it
+ */
+void gpath_cache_reset(void)
+{
+    memset(_entries, 0, sizeof(_entries));
+}
+
+void gpath_cache_created(const n_GPath *path)
+{
+    if (!path || !_is_app_thread())
+        return;
+
+    _entry_track(path);
+}
+
+void gpath_cache_destroyed(const n_GPath *path)
+{
+    if (!_is_app_thread())
+        return;
+
+    GPathCacheEntry *e = _entry_find(path);
+    if (!e)
+        return;
+
+    _entry_unbuild(e);
+    e->path = NULL;
+}
+
+void gpath_cache_rotated(const n_GPath *path, int32_t angle)
+{
+    if (!path || !_is_app_thread())
+        return;
+
+    GPathCacheEntry *e = _entry_track(path);
+    if (e->angle != angle)
+        _entry_unbuild(e);
+    e->angle = angle;
+}
+
+/*
+ * Fill path with its top left at origin, in screen coordinates.
+ * Returns false if ngfx has to do it.
+ */
+bool gpath_cache_fill(n_GContext *ctx, const n_GPath *path, n_GPoint origin)
+{
+#ifdef PBL_BW
+    return false;
+#else
+    if (!_is_app_thread() || (ctx->fill_color.argb & 0xC0) != 0xC0)
+        return false;
+    if (path->num_points < 3 || path->num_points > GPATH_CACHE_MAX_POINTS)
+        return false;
+
+    GPathCacheEntry *e = _entry_find(path);
+    if (!e)
+        return false;
+    e->last_used = ++_clock;
+
+    if (e->is_built && (e->num_points != path->num_points ||
+                        memcmp(e->points, path->points, e->num_points * sizeof(n_GPoint))))
+        _entry_unbuild(e);
+    if (!e->is_built && !_entry_build(e, path))
+        return false;
+
+    uint8_t *fb = display_get_buffer();
+    uint8_t color = ctx->fill_color.argb;
+
+    for (uint16_t r = 0; r < e->rows; r++)
+    {
+        int16_t y = origin.y + e->top + r;
+        if (y < 0)
+            continue;
+        if (y >= DISPLAY_ROWS)
+            break;
+
+        uint8_t *row = fb + y * DISPLAY_COLS;
+        for (uint16_t k = e->row_start[r]; k + 1 < e->row_start[r + 1]; k += 2)
+        {
+            int16_t x0 = MAX(origin.x + e->xs[k], 0);
+            int16_t x1 = MIN(origin.x + e->xs[k + 1], DISPLAY_COLS);
+            if (x1 > x0)
+                memset(row + x0, color, x1 - x0);
+        }
+    }
+
+    return true;
+#endif
+}
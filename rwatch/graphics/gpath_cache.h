@@ -0,0 +1,11 @@
+#pragma once
+/* gpath_cache.h
+ * Rotated points and scanlines for filled paths
+ * libRebbleOS
+ */
+
+void gpath_cache_reset(void);
+void gpath_cache_created(const n_GPath *path);
+void gpath_cache_destroyed(const n_GPath *path);
+void gpath_cache_rotated(const n_GPath *path, int32_t angle);
+bool gpath_cache_fill(n_GContext *ctx, const n_GPath *path, n_GPoint origin);
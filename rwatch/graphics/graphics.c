@@ -10,6 +10,14 @@
 #include "png.h"
 #include "graphics_wrapper.h"
 #include "display.h"
+#include "utils.h"
+#include "glyph_cache.h"
+#include "font_pager.h"
+#include "gpath_cache.h"
+#include "pdc_cache.h"
+#include "blit_bw.h"
+#include "blit_palette.h"
+#include "blit_blend.h"
 
 /* Configure Logging */
 #define MODULE_NAME "grphcs"
@@ -40,10 +48,249 @@ static n_GPoint _jimmy_layer_point_offset(n_GContext *ctx, n_GPoint point)
 }
 
 
+/* Clip a screen rect to the display. Returns false if nothing is left */
+static bool _clip_to_screen(GRect *rect)
+{
+    int16_t x0 = MAX(rect->origin.x, 0);
+    int16_t y0 = MAX(rect->origin.y, 0);
+    int16_t x1 = MIN(rect->origin.x + rect->size.w, DISPLAY_COLS);
+    int16_t y1 = MIN(rect->origin.y + rect->size.h, DISPLAY_ROWS);
+
+    if (x1 <= x0 || y1 <= y0)
+        return false;
+
+    *rect = GRect(x0, y0, x1 - x0, y1 - y0);
+    return true;
+}
+
+#ifdef PBL_ROUND
+/*
+ * From row *y, the next run of rows of rect that the glass cuts the same
+ * way, narrowed to the glass. Rows that are all off the glass are skipped.
+ * Returns false when the rect is done
+ */
+static bool _glass_next_run(const GRect *rect, int16_t *y, GRect *run)
+{
+    int16_t x0 = rect->origin.x;
+    int16_t x1 = rect->origin.x + rect->size.w;
+    int16_t y1 = rect->origin.y + rect->size.h;
+
+    for (; *y < y1; (*y)++)
+    {
+        int16_t a = MAX(x0, display_spans[*y].x0);
+        int16_t b = MIN(x1, display_spans[*y].x1);
+        if (b <= a)
+            continue;
+
+        int16_t top = *y;
+        for ((*y)++; *y < y1; (*y)++)
+            if (MAX(x0, display_spans[*y].x0) != a || MIN(x1, display_spans[*y].x1) != b)
+                break;
+
+        *run = GRect(a, top, b - a, *y - top);
+        return true;
+    }
+    return false;
+}
+#endif
+
+#ifndef PBL_BW
+/* Translucent fills are laid over what is there, see blit_blend */
+static bool _blend_fill(GRect rect, uint8_t argb)
+{
+#ifdef PBL_ROUND
+    int16_t y = rect.origin.y;
+    GRect run;
+    while (_glass_next_run(&rect, &y, &run))
+        blit_blend_fill(display_get_buffer() + run.origin.y * DISPLAY_COLS + run.origin.x, DISPLAY_COLS,
+                        run.size.w, run.size.h, argb);
+#else
+    blit_blend_fill(display_get_buffer() + rect.origin.y * DISPLAY_COLS + rect.origin.x, DISPLAY_COLS,
+                    rect.size.w, rect.size.h, argb);
+#endif
+    return true;
+}
+#endif
+
+/* Square opaque fills are just a memset per row, let the 2d engine have them.
+ * Translucent ones are blended, and clear ones draw nothing. On 1bpp they
+ * are a word store per 32 pixels */
+static bool _hw_fill_rect(n_GContext *ctx, GRect rect)
+{
+#ifdef PBL_BW
+    if (ctx->fill_color.argb != GColorWhite.argb && ctx->fill_color.argb != GColorBlack.argb)
+        return false;
+    if (!_clip_to_screen(&rect))
+        return false;
+
+    return blit_bw_fill(display_get_buffer(), DISPLAY_ROW_BYTES, rect,
+                        ctx->fill_color.argb == GColorWhite.argb);
+#else
+    uint8_t alpha = ctx->fill_color.argb & 0xC0;
+
+    if (!alpha)
+        return true;
+    if (!_clip_to_screen(&rect))
+        return false;
+    if (alpha != 0xC0)
+        return _blend_fill(rect, ctx->fill_color.argb);
+
+#ifdef PBL_ROUND
+    /* Only what is behind the glass. Runs too small for the 2d engine,
+     * mostly single rows near the top and bottom, are a memset each */
+    int16_t y = rect.origin.y;
+    GRect run;
+    while (_glass_next_run(&rect, &y, &run))
+    {
+        uint8_t *fb = display_get_buffer() + run.origin.y * DISPLAY_COLS + run.origin.x;
+        if (hw_gfx_fill(fb, DISPLAY_COLS, run.size.w, run.size.h, ctx->fill_color.argb))
+            continue;
+        for (int16_t i = 0; i < run.size.h; i++, fb += DISPLAY_COLS)
+            memset(fb, ctx->fill_color.argb, run.size.w);
+    }
+    return true;
+#else
+    uint8_t *fb = display_get_buffer() + rect.origin.y * DISPLAY_COLS + rect.origin.x;
+    return hw_gfx_fill(fb, DISPLAY_COLS, rect.size.w, rect.size.h, ctx->fill_color.argb);
+#endif
+#endif
+}
+
+#ifdef PBL_BW
+/* Untiled 1 bit blits go a word at a time. blit_bw says no to the
+ * compositing modes it doesn't do */
+static bool _hw_draw_bitmap(n_GContext *ctx, const GBitmap *bitmap, GRect rect)
+{
+    if (bitmap->format != n_GBitmapFormat1Bit)
+        return false;
+    if (rect.size.w > bitmap->bounds.size.w || rect.size.h > bitmap->bounds.size.h)
+        return false;
+
+    GRect clipped = rect;
+    if (!_clip_to_screen(&clipped))
+        return false;
+
+    GPoint from = GPoint(bitmap->bounds.origin.x + clipped.origin.x - rect.origin.x,
+                         bitmap->bounds.origin.y + clipped.origin.y - rect.origin.y);
+
+    return blit_bw_copy(display_get_buffer(), DISPLAY_ROW_BYTES, clipped.origin,
+                        bitmap->addr, bitmap->row_size_bytes, from,
+                        clipped.size, ctx->comp_op);
+}
+#else
+/* Untiled 1, 2 and 4 bit palettised blits look each pixel up as they go,
+ * and blend the translucent ones for Set */
+static bool _hw_draw_palette(n_GContext *ctx, const GBitmap *bitmap, GRect rect)
+{
+    BlitPalette bp;
+
+    if (!blit_palette_prepare(&bp, bitmap, ctx->comp_op))
+        return false;
+    if (rect.size.w > bitmap->bounds.size.w || rect.size.h > bitmap->bounds.size.h)
+        return false;
+
+    GRect clipped = rect;
+    if (!_clip_to_screen(&clipped))
+        return false;
+
+#ifdef PBL_ROUND
+    int16_t y = clipped.origin.y;
+    GRect run;
+    while (_glass_next_run(&clipped, &y, &run))
+        blit_palette_copy(&bp, display_get_buffer(), DISPLAY_COLS, run.origin,
+                          bitmap->addr, bitmap->row_size_bytes,
+                          GPoint(bitmap->bounds.origin.x + run.origin.x - rect.origin.x,
+                                 bitmap->bounds.origin.y + run.origin.y - rect.origin.y),
+                          run.size);
+#else
+    blit_palette_copy(&bp, display_get_buffer(), DISPLAY_COLS, clipped.origin,
+                      bitmap->addr, bitmap->row_size_bytes,
+                      GPoint(bitmap->bounds.origin.x + clipped.origin.x - rect.origin.x,
+                             bitmap->bounds.origin.y + clipped.origin.y - rect.origin.y),
+                      clipped.size);
+#endif
+    return true;
+}
+
+/* An untiled 8 bit Set blit is blended by each pixel's alpha, four
+ * pixels at a time */
+static void _blend_bitmap(const GBitmap *bitmap, GRect rect, GRect clipped)
+{
+#ifdef PBL_ROUND
+    int16_t y = clipped.origin.y;
+    GRect run;
+    while (_glass_next_run(&clipped, &y, &run))
+        blit_blend_copy(display_get_buffer() + run.origin.y * DISPLAY_COLS + run.origin.x, DISPLAY_COLS,
+                        bitmap->addr
+                        + (bitmap->bounds.origin.y + run.origin.y - rect.origin.y) * bitmap->row_size_bytes
+                        + (bitmap->bounds.origin.x + run.origin.x - rect.origin.x),
+                        bitmap->row_size_bytes, run.size.w, run.size.h);
+#else
+    blit_blend_copy(display_get_buffer() + clipped.origin.y * DISPLAY_COLS + clipped.origin.x, DISPLAY_COLS,
+                    bitmap->addr
+                    + (bitmap->bounds.origin.y + clipped.origin.y - rect.origin.y) * bitmap->row_size_bytes
+                    + (bitmap->bounds.origin.x + clipped.origin.x - rect.origin.x),
+                    bitmap->row_size_bytes, clipped.size.w, clipped.size.h);
+#endif
+}
+
+/* An untiled 8 bit Assign blit is a straight copy, and a Set blit a blend.
+ * Anything else, or anything that tiles, stays with ngfx */
+static bool _hw_draw_bitmap(n_GContext *ctx, const GBitmap *bitmap, GRect rect)
+{
+    if (bitmap->format != n_GBitmapFormat8Bit)
+        return _hw_draw_palette(ctx, bitmap, rect);
+    if (ctx->comp_op != n_GCompOpAssign && ctx->comp_op != n_GCompOpSet)
+        return false;
+    if (rect.size.w > bitmap->bounds.size.w || rect.size.h > bitmap->bounds.size.h)
+        return false;
+
+    GRect clipped = rect;
+    if (!_clip_to_screen(&clipped))
+        return false;
+
+    if (ctx->comp_op == n_GCompOpSet)
+    {
+        _blend_bitmap(bitmap, rect, clipped);
+        return true;
+    }
+
+#ifdef PBL_ROUND
+    /* As for fills, only what is behind the glass */
+    int16_t y = clipped.origin.y;
+    GRect run;
+    while (_glass_next_run(&clipped, &y, &run))
+    {
+        const uint8_t *src = bitmap->addr
+            + (bitmap->bounds.origin.y + run.origin.y - rect.origin.y) * bitmap->row_size_bytes
+            + (bitmap->bounds.origin.x + run.origin.x - rect.origin.x);
+        uint8_t *fb = display_get_buffer() + run.origin.y * DISPLAY_COLS + run.origin.x;
+
+        if (hw_gfx_copy(fb, DISPLAY_COLS, src, bitmap->row_size_bytes, run.size.w, run.size.h))
+            continue;
+        for (int16_t i = 0; i < run.size.h; i++, fb += DISPLAY_COLS, src += bitmap->row_size_bytes)
+            memcpy(fb, src, run.size.w);
+    }
+    return true;
+#else
+    const uint8_t *src = bitmap->addr
+        + (bitmap->bounds.origin.y + clipped.origin.y - rect.origin.y) * bitmap->row_size_bytes
+        + (bitmap->bounds.origin.x + clipped.origin.x - rect.origin.x);
+    uint8_t *fb = display_get_buffer() + clipped.origin.y * DISPLAY_COLS + clipped.origin.x;
+
+    return hw_gfx_copy(fb, DISPLAY_COLS, src, bitmap->row_size_bytes,
+                       clipped.size.w, clipped.size.h);
+#endif
+}
+#endif
+
 // void n_graphics_fill_rect_app(n_GContext * ctx, n_GRect rect, uint16_t radius, n_GCornerMask mask);
 void graphics_fill_rect(n_GContext * ctx, n_GRect rect, uint16_t radius, n_GCornerMask mask)
 {
-    n_graphics_fill_rect(ctx, _jimmy_layer_offset(ctx, rect), radius, mask);
+    GRect offsetted = _jimmy_layer_offset(ctx, rect);
+    if ((radius == 0 || mask == n_GCornerNone) && _hw_fill_rect(ctx, offsetted))
+        return;
+    n_graphics_fill_rect(ctx, offsetted, radius, mask);
 }
 
 void graphics_fill_circle(n_GContext * ctx, n_GPoint p, uint16_t radius)
@@ -69,7 +316,12 @@ void graphics_draw_text(
     n_GTextAttributes * text_attributes)
 {
     LOG_DEBUG("text");
-    n_graphics_draw_text(ctx, text, font, _jimmy_layer_offset(ctx, box),
+    GRect offsetted = _jimmy_layer_offset(ctx, box);
+    /* glyphs standing in for the wildcard mustn't get into the glyph cache */
+    if (font_pager_prepare(font, text) &&
+        glyph_cache_draw_text(display_get_buffer(), font, text, offsetted, alignment, ctx->text_color))
+        return;
+    n_graphics_draw_text(ctx, text, font, offsetted,
                             overflow_mode, alignment,
                             text_attributes);
 }
@@ -78,6 +330,8 @@ void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap, GRect re
 {
     LOG_DEBUG("gbir");
     GRect offsetted = _jimmy_layer_offset(ctx, rect);
+    if (_hw_draw_bitmap(ctx, bitmap, offsetted))
+        return;
     n_graphics_draw_bitmap_in_rect(ctx, bitmap, offsetted);
 }
 
@@ -125,10 +379,25 @@ void graphics_release_frame_buffer(n_GContext *context, GBitmap *bitmap)
 }
 
 
+n_GPath *gpath_create_app(n_GPathInfo * path_info)
+{
+    n_GPath *path = n_gpath_create(path_info);
+    gpath_cache_created(path);
+    return path;
+}
+
+void gpath_destroy_app(n_GPath * path)
+{
+    gpath_cache_destroyed(path);
+    n_gpath_destroy(path);
+}
+
 void gpath_fill_app(n_GContext * ctx, n_GPath * path)
 {
     GPoint off = path->offset;
     GPoint r = _jimmy_layer_point_offset(ctx, path->offset);
+    if (gpath_cache_fill(ctx, path, r))
+        return;
     path->offset.x = r.x;
     path->offset.y = r.y;
     n_gpath_fill(ctx, path);
@@ -153,6 +422,7 @@ void gpath_rotate_to_app(n_GPath * path, int32_t angle)
 //     path->offset.x = r.x;
 //     path->offset.y = r.y;
     n_gpath_rotate_to(path, angle);
+    gpath_cache_rotated(path, angle);
 //     path->offset = off;
 }
 
@@ -166,6 +436,19 @@ void gpath_move_to_app(n_GPath * path, n_GPoint offset)
 //     path->offset = off;
 }
 
+void gdraw_command_image_draw_app(n_GContext * ctx, n_GDrawCommandImage * image, n_GPoint offset)
+{
+    if (pdc_cache_draw(ctx, image, offset))
+        return;
+    n_gdraw_command_image_draw(ctx, image, offset);
+}
+
+void gdraw_command_image_destroy_app(n_GDrawCommandImage * image)
+{
+    pdc_cache_destroyed(image);
+    n_gdraw_command_image_destroy(image);
+}
+
 void grect_align(GRect *rect, const GRect *inside_rect, const GAlign alignment, const bool clip)
 {
     int16_t x = 0, y = 0;
@@ -17,14 +17,20 @@ void graphics_draw_text_app(
 void graphics_draw_pixel_app(n_GContext * ctx, n_GPoint p);
 void graphics_draw_rect_app(n_GContext * ctx, n_GRect rect, uint16_t radius, n_GCornerMask mask);
 void graphics_draw_bitmap_in_rect_app(GContext *ctx, const GBitmap *bitmap, GRect rect);
+n_GPath *gpath_create_app(n_GPathInfo * path_info);
+void gpath_destroy_app(n_GPath * path);
 void gpath_fill_app(n_GContext * ctx, n_GPath * path);
 void gpath_draw_app(n_GContext * ctx, n_GPath * path);
 void gpath_rotate_to_app(n_GPath * path, int32_t angle);
 void gpath_move_to_app(n_GPath * path, n_GPoint offset);
+void gdraw_command_image_draw_app(n_GContext * ctx, n_GDrawCommandImage * image, n_GPoint offset);
+void gdraw_command_image_destroy_app(n_GDrawCommandImage * image);
 
-// (VoidFunc)graphics_draw_round_rect_app,
+/* batch fixed point geometry, in math_sin.c */
+void trig_rotate_points(n_GPoint *to, const n_GPoint *from, uint16_t count, int32_t angle, n_GPoint offset);
+void trig_polar_points(n_GPoint *to, n_GPoint center, int16_t radius, int32_t angle, int32_t step, uint16_t count);
 
-// n_GPath * gpath_create_app(n_GPathInfo * path_info);
+// (VoidFunc)graphics_draw_round_rect_app,
 
 GBitmap *graphics_capture_frame_buffer(n_GContext *context);
 GBitmap *graphics_capture_frame_buffer_format(n_GContext *context, GBitmap format);
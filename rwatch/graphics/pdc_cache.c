@@ -0,0 +1,315 @@
+/* pdc_cache.c
+ * Draw command images, rasterised once and blitted after
+ * libRebbleOS
+ *
+ * ngfx walks every command of a draw command image each time it is drawn.
+ * Action bar and notification icons get drawn over and over and come out
+ * the same every time, so the first time ngfx draws one we keep the
+ * pixels it made, and after that it is a blit.
+ *
+ * To tell what ngfx drew from what was there already, it draws the image
+ * twice, over black and then over white, and puts the screen back after.
+ * Pixels that came out the same both times are the image, and ones that
+ * stayed black then white are clear. Anything else means it blended, and
+ * that image stays with ngfx until it changes.
+ *
+ * Every draw walks the commands for a hash of everything that goes into
+ * them, so an app changing a colour or moving a point is noticed. That is
+ * a lot cheaper than drawing them. Everything lives in the app's heap, so
+ * only the app thread gets to use it.
+ */
+
+#include "librebble.h"
+#include "display.h"
+#include "utils.h"
+#include "draw_command.h"
+#include "pdc_cache.h"
+
+#define PDC_CACHE_ENTRIES 8
+/* Anything that covers more than this goes to ngfx */
+#define PDC_CACHE_MAX_PIXELS (80 * 80)
+
+/* the backgrounds it is drawn over to find the clear pixels */
+#define PDC_CACHE_UNDER_A 0xC0
+#define PDC_CACHE_UNDER_B 0xFF
+
+typedef struct PdcCacheEntry {
+    const n_GDrawCommandImage *image;
+    uint32_t hash;
+    uint32_t last_used;
+    bool is_built;
+    bool is_blended;     /* ngfx has to draw this one, until it changes */
+    n_GRect box;         /* all it can touch, relative to the origin */
+    uint8_t *pixels;     /* box.size.w by box.size.h, 0 where it is clear */
+} PdcCacheEntry;
+
+static PdcCacheEntry _entries[PDC_CACHE_ENTRIES];
+static uint32_t _clock;
+
+static bool _is_app_thread(void)
+{
+    return appmanager_get_thread_type() == AppThreadMainApp;
+}
+
+static inline uint32_t _hash(uint32_t h, uint32_t v)
+{
+    return (h ^ v) * 16777619u;
+}
+
+/*
+ * Hash the image, and work out the box its strokes and fills can reach.
+ * ngfx doesn't clip to the image's bounds, so neither can we
+ */
+static bool _image_walk(n_GDrawCommandImage *image, uint32_t *hash, n_GRect *box)
+{
+    n_GDrawCommandList *list = n_gdraw_command_image_get_command_list(image);
+    if (!list)
+        return false;
+
+    n_GSize size = n_gdraw_command_image_get_bounds_size(image);
+    uint32_t n = n_gdraw_command_list_get_num_commands(list);
+    int16_t x0 = 0, y0 = 0, x1 = size.w, y1 = size.h;
+    uint32_t h = _hash(2166136261u, ((uint32_t)(uint16_t)size.w << 16) | (uint16_t)size.h);
+    h = _hash(h, n);
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        n_GDrawCommand *cmd = n_gdraw_command_list_get_command(list, i);
+        uint8_t type = n_gdraw_command_get_type(cmd);
+        uint8_t width = n_gdraw_command_get_stroke_width(cmd);
+        uint16_t radius = n_gdraw_command_get_radius(cmd);
+        uint16_t points = n_gdraw_command_get_num_points(cmd);
+
+        h = _hash(h, type | (n_gdraw_command_get_hidden(cmd) << 8) | (width << 16) |
+                     (n_gdraw_command_get_path_open(cmd) << 24));
+        h = _hash(h, n_gdraw_command_get_fill_color(cmd).argb |
+                     (n_gdraw_command_get_stroke_color(cmd).argb << 8) | (radius << 16));
+
+        /* half the stroke, and a pixel for antialiasing and rounding */
+        int16_t grow = (width + 1) / 2 + 1;
+        if (type == n_GDrawCommandTypeCircle)
+            grow += radius;
+
+        for (uint16_t p = 0; p < points; p++)
+        {
+            n_GPoint pt = n_gdraw_command_get_point(cmd, p);
+            h = _hash(h, ((uint32_t)(uint16_t)pt.x << 16) | (uint16_t)pt.y);
+
+            /* precise points are in eighths */
+            if (type == n_GDrawCommandTypePrecisePath)
+            {
+                pt.x >>= 3;
+                pt.y >>= 3;
+            }
+            x0 = MIN(x0, pt.x - grow);
+            y0 = MIN(y0, pt.y - grow);
+            x1 = MAX(x1, pt.x + grow + 1);
+            y1 = MAX(y1, pt.y + grow + 1);
+        }
+    }
+
+    *hash = h;
+    *box = GRect(x0, y0, x1 - x0, y1 - y0);
+    return true;
+}
+
+static void _entry_unbuild(PdcCacheEntry *e)
+{
+    if (e->pixels)
+        app_free(e->pixels);
+    e->pixels = NULL;
+    e->is_built = false;
+    e->is_blended = false;
+}
+
+static PdcCacheEntry *_entry_find(const n_GDrawCommandImage *image)
+{
+    for (uint16_t i = 0; i < PDC_CACHE_ENTRIES; i++)
+        if (_entries[i].image == image)
+            return &_entries[i];
+
+    return NULL;
+}
+
+/* Find image, or start tracking it in a free or the least recently used slot */
+static PdcCacheEntry *_entry_track(const n_GDrawCommandImage *image)
+{
+    PdcCacheEntry *e = _entry_find(image);
+    if (e)
+        return e;
+
+    e = &_entries[0];
+    for (uint16_t i = 0; i < PDC_CACHE_ENTRIES && e->image; i++)
+        if (!_entries[i].image || _entries[i].last_used < e->last_used)
+            e = &_entries[i];
+
+    _entry_unbuild(e);
+    e->image = image;
+    e->hash = 0;
+    return e;
+}
+
+static void _region_copy(uint8_t *to, uint16_t to_stride, const uint8_t *from, uint16_t from_stride, n_GSize size)
+{
+    for (int16_t row = 0; row < size.h; row++)
+        memcpy(to + row * to_stride, from + row * from_stride, size.w);
+}
+
+static void _region_fill(uint8_t *fb, n_GSize size, uint8_t color)
+{
+    for (int16_t row = 0; row < size.h; row++)
+        memset(fb + row * DISPLAY_COLS, color, size.w);
+}
+
+/*
+ * Have ngfx draw the image over each background, and keep what it drew.
+ * The whole box has to be on screen. The screen is as it was after
+ */
+static bool _entry_build(PdcCacheEntry *e, n_GContext *ctx, n_GDrawCommandImage *image, n_GPoint origin)
+{
+    n_GRect r = GRect(origin.x + e->box.origin.x, origin.y + e->box.origin.y,
+                      e->box.size.w, e->box.size.h);
+    if (r.origin.x < 0 || r.origin.y < 0 ||
+        r.origin.x + r.size.w > DISPLAY_COLS || r.origin.y + r.size.h > DISPLAY_ROWS)
+        return false;
+
+    uint16_t len = r.size.w * r.size.h;
+    uint8_t *pixels = app_malloc(len);
+    uint8_t *saved = app_malloc(len);
+    if (!pixels || !saved)
+    {
+        if (pixels)
+            app_free(pixels);
+        if (saved)
+            app_free(saved);
+        return false;
+    }
+
+    uint8_t *fb = display_get_buffer() + r.origin.y * DISPLAY_COLS + r.origin.x;
+    _region_copy(saved, r.size.w, fb, DISPLAY_COLS, r.size);
+
+    _region_fill(fb, r.size, PDC_CACHE_UNDER_A);
+    n_gdraw_command_image_draw(ctx, image, origin);
+    _region_copy(pixels, r.size.w, fb, DISPLAY_COLS, r.size);
+
+    _region_fill(fb, r.size, PDC_CACHE_UNDER_B);
+    n_gdraw_command_image_draw(ctx, image, origin);
+
+    bool blended = false;
+    for (int16_t row = 0; row < r.size.h && !blended; row++)
+    {
+        uint8_t *a = pixels + row * r.size.w;
+        const uint8_t *b = fb + row * DISPLAY_COLS;
+        for (int16_t x = 0; x < r.size.w; x++)
+        {
+            if (a[x] == b[x] && (a[x] & 0xC0) == 0xC0)
+                continue;
+            if (a[x] == PDC_CACHE_UNDER_A && b[x] == PDC_CACHE_UNDER_B)
+            {
+                a[x] = 0;
+                continue;
+            }
+            blended = true;
+            break;
+        }
+    }
+
+    _region_copy(fb, DISPLAY_COLS, saved, r.size.w, r.size);
+    app_free(saved);
+
+    if (blended)
+    {
+        app_free(pixels);
+        e->is_blended = true;
+        return false;
+    }
+
+    e->pixels = pixels;
+    e->is_built = true;
+    return true;
+}
+
+static void _entry_blit(const PdcCacheEntry *e, n_GPoint origin)
+{
+    uint8_t *fb = display_get_buffer();
+    int16_t x = origin.x + e->box.origin.x;
+
+    for (int16_t row = 0; row < e->box.size.h; row++)
+    {
+        int16_t y = origin.y + e->box.origin.y + row;
+        if (y < 0)
+            continue;
+        if (y >= DISPLAY_ROWS)
+            break;
+
+#ifdef PBL_ROUND
+        int16_t c0 = MAX(display_spans[y].x0 - x, 0);
+        int16_t c1 = MIN(display_spans[y].x1 - x, e->box.size.w);
+#else
+        int16_t c0 = MAX(-x, 0);
+        int16_t c1 = MIN(DISPLAY_COLS - x, e->box.size.w);
+#endif
+        const uint8_t *src = e->pixels + row * e->box.size.w;
+        uint8_t *dst = fb + y * DISPLAY_COLS;
+        for (int16_t c = c0; c < c1; c++)
+            if (src[c])
+                dst[x + c] = src[c];
+    }
+}
+
+/*
+ * The app's heap has gone, and our allocations with it
+ */
+void pdc_cache_reset(void)
+{
+    memset(_entries, 0, sizeof(_entries));
+}
+
+void pdc_cache_destroyed(const n_GDrawCommandImage *image)
+{
+    if (!_is_app_thread())
+        return;
+
+    PdcCacheEntry *e = _entry_find(image);
+    if (!e)
+        return;
+
+    _entry_unbuild(e);
+    e->image = NULL;
+}
+
+/*
+ * Draw image with its origin at origin, in screen coordinates.
+ * Returns false if ngfx has to do it.
+ */
+bool pdc_cache_draw(n_GContext *ctx, n_GDrawCommandImage *image, n_GPoint origin)
+{
+#ifdef PBL_BW
+    return false;
+#else
+    uint32_t hash;
+    n_GRect box;
+
+    if (!image || !_is_app_thread())
+        return false;
+    if (!_image_walk(image, &hash, &box) || box.size.w * box.size.h > PDC_CACHE_MAX_PIXELS)
+        return false;
+
+    PdcCacheEntry *e = _entry_track(image);
+    e->last_used = ++_clock;
+
+    if (e->hash != hash || memcmp(&e->box, &box, sizeof(box)))
+    {
+        _entry_unbuild(e);
+        e->hash = hash;
+        e->box = box;
+    }
+    if (e->is_blended)
+        return false;
+    if (!e->is_built && !_entry_build(e, ctx, image, origin))
+        return false;
+
+    _entry_blit(e, origin);
+    return true;
+#endif
+}
@@ -0,0 +1,9 @@
+#pragma once
+/* pdc_cache.h
+ * Draw command images, rasterised once and blitted after
+ * libRebbleOS
+ */
+
+void pdc_cache_reset(void);
+void pdc_cache_destroyed(const n_GDrawCommandImage *image);
+bool pdc_cache_draw(n_GContext *ctx, n_GDrawCommandImage *image, n_GPoint origin);
@@ -41,6 +41,7 @@
 #include "vibes.h"
 
 #include "display.h"
+#include "frame_profile.h"
 #include "animation.h"
 #include "buttons.h"
 #include "rebble_time.h"
@@ -51,6 +52,13 @@
 #include "app_timer.h"
 #include "font_loader.h"
 #include "connection_service.h"
+#include "accel_service.h"
+#include "app_worker.h"
+#include "persist.h"
+#include "app_message.h"
+#include "data_logging.h"
+#include "smartstrap.h"
+#include "unobstructed_area_service.h"
 
 void rbl_draw(void);
 struct tm *rbl_get_tm(void);
@@ -12,263 +12,263 @@
 #include <inttypes.h>
 #include "librebble.h"
 
-// taken from 
-// https://github.com/jonpry/pebblesim/blob/master/sin.c
-// it has no license
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
 
-// lookup points on the first quarter sin wave
-// generated by tintin/tools/trigTable.py
+// lookup points on the first quarter sin wave, every 64 of TRIG_MAX_ANGLE,
+// so finding a point is a shift.
+// round(TRIG_MAX_RATIO * sin(i * pi / 512)) for i in 0..256
 static const int32_t SIN_LOOKUP[] = {
 0,
-401,
-801,
-1202,
-1602,
-2002,
-2403,
-2803,
-3203,
-3603,
-4003,
-4403,
-4802,
-5202,
-5601,
-6000,
-6399,
-6797,
-7195,
-7593,
-7991,
-8389,
-8786,
-9182,
-9579,
-9975,
-10371,
-10766,
-11161,
-11555,
-11949,
-12343,
-12736,
-13129,
-13521,
-13913,
-14304,
-14694,
-15085,
-15474,
-15863,
-16251,
-16639,
-17026,
-17413,
-17798,
-18184,
-18568,
-18952,
-19335,
-19717,
-20099,
-20480,
-20860,
-21239,
-21618,
-21996,
-22372,
-22749,
-23124,
-23498,
-23872,
-24244,
-24616,
-24987,
-25356,
-25725,
-26093,
-26460,
-26826,
-27191,
-27555,
-27918,
-28280,
-28641,
-29000,
-29359,
-29717,
-30073,
-30428,
-30783,
-31136,
-31487,
-31838,
-32188,
-32536,
-32883,
-33229,
-33574,
-33917,
-34259,
-34600,
-34939,
-35278,
-35614,
-35950,
-36284,
-36617,
-36949,
-37279,
-37608,
-37935,
-38261,
-38585,
-38908,
-39230,
-39550,
-39869,
-40186,
-40502,
-40816,
-41128,
-41439,
-41749,
-42057,
-42363,
-42668,
-42971,
-43273,
-43573,
-43871,
-44168,
-44463,
-44757,
-45048,
-45338,
-45627,
-45913,
-46198,
-46482,
-46763,
-47043,
-47321,
-47597,
-47872,
-48144,
-48415,
-48684,
-48951,
-49217,
-49480,
-49742,
-50002,
-50260,
-50516,
-50770,
-51023,
-51273,
-51521,
-51768,
-52013,
-52255,
-52496,
-52735,
-52972,
-53207,
-53440,
-53670,
-53899,
-54126,
-54351,
-54574,
-54794,
-55013,
-55230,
-55444,
-55657,
-55867,
-56076,
-56282,
-56486,
-56688,
-56888,
-57086,
-57281,
-57475,
-57666,
-57856,
-58043,
-58228,
-58410,
-58591,
-58769,
-58945,
-59119,
-59291,
-59461,
-59628,
-59793,
-59956,
-60116,
-60275,
-60431,
-60585,
-60736,
-60886,
-61033,
-61177,
-61320,
-61460,
-61598,
-61734,
-61867,
-61998,
-62126,
-62253,
-62377,
-62498,
-62618,
-62735,
-62850,
-62962,
-63072,
-63179,
-63285,
-63388,
-63488,
-63586,
-63682,
-63775,
-63866,
-63955,
-64041,
-64125,
-64206,
-64286,
-64362,
-64436,
-64508,
-64578,
-64645,
-64709,
-64771,
-64831,
-64889,
-64943,
-64996,
-65046,
-65094,
-65139,
-65182,
-65222,
-65260,
-65295,
-65328,
-65359,
-65387,
-65413,
-65436,
-65457,
+402,
+804,
+1206,
+1608,
+2010,
+2412,
+2814,
+3216,
+3617,
+4019,
+4420,
+4821,
+5222,
+5623,
+6023,
+6424,
+6824,
+7223,
+7623,
+8022,
+8421,
+8820,
+9218,
+9616,
+10014,
+10411,
+10808,
+11204,
+11600,
+11996,
+12391,
+12785,
+13179,
+13573,
+13966,
+14359,
+14751,
+15142,
+15533,
+15924,
+16313,
+16703,
+17091,
+17479,
+17866,
+18253,
+18639,
+19024,
+19408,
+19792,
+20175,
+20557,
+20939,
+21319,
+21699,
+22078,
+22456,
+22834,
+23210,
+23586,
+23960,
+24334,
+24707,
+25079,
+25450,
+25820,
+26189,
+26557,
+26925,
+27291,
+27656,
+28020,
+28383,
+28745,
+29106,
+29465,
+29824,
+30181,
+30538,
+30893,
+31247,
+31600,
+31952,
+32302,
+32651,
+32999,
+33346,
+33692,
+34036,
+34379,
+34721,
+35061,
+35400,
+35738,
+36074,
+36409,
+36743,
+37075,
+37406,
+37736,
+38064,
+38390,
+38715,
+39039,
+39361,
+39682,
+40001,
+40319,
+40635,
+40950,
+41263,
+41575,
+41885,
+42194,
+42500,
+42806,
+43109,
+43411,
+43712,
+44011,
+44308,
+44603,
+44897,
+45189,
+45479,
+45768,
+46055,
+46340,
+46624,
+46905,
+47185,
+47464,
+47740,
+48014,
+48287,
+48558,
+48827,
+49095,
+49360,
+49624,
+49885,
+50145,
+50403,
+50659,
+50913,
+51166,
+51416,
+51664,
+51911,
+52155,
+52398,
+52638,
+52877,
+53113,
+53348,
+53580,
+53811,
+54039,
+54266,
+54490,
+54713,
+54933,
+55151,
+55367,
+55582,
+55794,
+56003,
+56211,
+56417,
+56620,
+56822,
+57021,
+57218,
+57413,
+57606,
+57797,
+57985,
+58171,
+58356,
+58537,
+58717,
+58895,
+59070,
+59243,
+59414,
+59582,
+59749,
+59913,
+60075,
+60234,
+60391,
+60546,
+60699,
+60850,
+60998,
+61144,
+61287,
+61429,
+61567,
+61704,
+61838,
+61970,
+62100,
+62227,
+62352,
+62475,
+62595,
+62713,
+62829,
+62942,
+63053,
+63161,
+63267,
+63371,
+63472,
+63571,
+63668,
+63762,
+63853,
+63943,
+64030,
+64114,
+64196,
+64276,
+64353,
+64428,
+64500,
+64570,
+64638,
+64703,
+64765,
+64826,
+64883,
+64939,
+64992,
+65042,
+65090,
+65136,
+65179,
+65219,
+65258,
+65293,
+65327,
+65357,
+65386,
+65412,
+65435,
+65456,
 65475,
 65491,
 65504,
@@ -279,34 +279,139 @@ static const int32_t SIN_LOOKUP[] = {
 65535
 };
 
+// atan(i / 64) in TRIG_MAX_ANGLE units for i in 0..64, the first octant
+static const int16_t ATAN_LOOKUP[] = {
+0, 163, 326, 489, 651, 813, 975, 1136,
+1297, 1457, 1617, 1775, 1933, 2090, 2246, 2401,
+2555, 2708, 2860, 3010, 3159, 3307, 3453, 3599,
+3742, 3884, 4025, 4164, 4302, 4438, 4572, 4705,
+4836, 4966, 5094, 5220, 5344, 5467, 5589, 5708,
+5826, 5943, 6058, 6171, 6282, 6392, 6500, 6607,
+6712, 6815, 6917, 7018, 7117, 7214, 7310, 7405,
+7498, 7589, 7679, 7768, 7856, 7942, 8026, 8110,
+8192
+};
+
 int32_t sin_lookup(int32_t angle) {
-  int32_t mult = 1;
+	int32_t mult = 1;
 
 	// modify the input angle and output multiplier for use in a first quadrent sine lookup
 	if (angle < 0) {
 		angle = -angle;
 		mult = -mult;
 	}
-	if (angle >= TRIG_MAX_ANGLE) {
-		angle %= TRIG_MAX_ANGLE;
-	}
+	angle &= TRIG_MAX_ANGLE - 1;
 	if (angle >= TRIG_MAX_ANGLE / 2) {
 		mult = -mult;
 		angle -= TRIG_MAX_ANGLE / 2;
 	}
-	if (angle >= TRIG_MAX_ANGLE / 4 && angle <= TRIG_MAX_ANGLE / 2) {
+	if (angle > TRIG_MAX_ANGLE / 4) {
 		angle = TRIG_MAX_ANGLE / 2 - angle;
 	}
 
-	// if I can interpolate linearly
-	int32_t lookup_angle =  angle * 4 / 0xff;
-	if ((uint32_t)(lookup_angle + 1) < sizeof(SIN_LOOKUP) / sizeof(int32_t)) {
-		return  mult * (SIN_LOOKUP[lookup_angle] + ((angle * 4) % 0xff) * (SIN_LOOKUP[lookup_angle + 1] - SIN_LOOKUP[lookup_angle]) / 0xff);
-	}
-	
-	return mult * SIN_LOOKUP[lookup_angle];
+	// interpolate between the two points either side
+	int32_t i = angle >> 6;
+	if (i == 256)
+		return mult * SIN_LOOKUP[256];
+
+	int32_t frac = angle & 63;
+	return mult * (SIN_LOOKUP[i] + ((frac * (SIN_LOOKUP[i + 1] - SIN_LOOKUP[i])) >> 6));
 }
 
 int32_t cos_lookup(int32_t angle) {
 	return sin_lookup(angle + TRIG_MAX_ANGLE / 4);
 }
+
+/*
+ * Angle of the point (x, y) from the x axis, 0 to TRIG_MAX_ANGLE, going
+ * the same way as sin_lookup. Folded into the first octant so the ratio
+ * is 0 to 1 and one divide does it.
+ */
+int32_t atan2_lookup(int16_t y, int16_t x) {
+	if (!x && !y)
+		return 0;
+
+	int32_t ax = x < 0 ? -x : x;
+	int32_t ay = y < 0 ? -y : y;
+	bool steep = ay > ax;
+	uint32_t ratio = steep ? ((uint32_t)ax << 16) / ay : ((uint32_t)ay << 16) / ax;
+
+	int32_t i = ratio >> 10;
+	int32_t angle = i == 64 ? ATAN_LOOKUP[64]
+	              : ATAN_LOOKUP[i] + ((int32_t)(ratio & 1023) * (ATAN_LOOKUP[i + 1] - ATAN_LOOKUP[i]) >> 10);
+
+	if (steep)
+		angle = TRIG_MAX_ANGLE / 4 - angle;
+	if (x < 0)
+		angle = TRIG_MAX_ANGLE / 2 - angle;
+	if (y < 0)
+		angle = TRIG_MAX_ANGLE - angle;
+
+	return angle & (TRIG_MAX_ANGLE - 1);
+}
+
+/*
+ * Integer square root, rounded down. A bit of the root per loop, no divides
+ */
+uint32_t isqrt(uint32_t n) {
+	uint32_t root = 0;
+	uint32_t bit;
+
+	if (!n)
+		return 0;
+
+	// highest power of 4 <= n
+	bit = 1u << ((31 - __builtin_clz(n)) & ~1);
+	while (bit) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+/*
+ * Rotate count points about the origin by angle, then move them by offset.
+ * Clockwise on screen, the same as gpath rotation. from and to can be the
+ * same array. sin and cos are worked out once for the lot, at 15 bits so
+ * a point packs into one word and goes through a dual multiply.
+ */
+void trig_rotate_points(GPoint *to, const GPoint *from, uint16_t count, int32_t angle, GPoint offset) {
+	int32_t s = sin_lookup(angle) >> 1;
+	int32_t c = cos_lookup(angle) >> 1;
+#if defined(__ARM_FEATURE_DSP)
+	uint32_t cs = ((uint32_t)(uint16_t)s << 16) | (uint16_t)c;
+#endif
+
+	for (uint16_t i = 0; i < count; i++) {
+#if defined(__ARM_FEATURE_DSP)
+		uint32_t xy = ((uint32_t)(uint16_t)from[i].y << 16) | (uint16_t)from[i].x;
+		int32_t x = __smusd(xy, cs);   // x cos - y sin
+		int32_t y = __smuadx(xy, cs);  // x sin + y cos
+#else
+		int32_t x = from[i].x * c - from[i].y * s;
+		int32_t y = from[i].x * s + from[i].y * c;
+#endif
+		to[i].x = ((x + (1 << 14)) >> 15) + offset.x;
+		to[i].y = ((y + (1 << 14)) >> 15) + offset.y;
+	}
+}
+
+/*
+ * count points radius out from center, starting at angle and step apart.
+ * Angle 0 is straight up and goes clockwise, like the hands of a clock,
+ * so hour ticks are trig_polar_points(p, c, r, 0, TRIG_MAX_ANGLE / 12, 12)
+ */
+void trig_polar_points(GPoint *to, GPoint center, int16_t radius, int32_t angle, int32_t step, uint16_t count) {
+	for (uint16_t i = 0; i < count; i++, angle += step) {
+		int32_t s = sin_lookup(angle);
+		int32_t c = cos_lookup(angle);
+		to[i].x = center.x + ((s * radius + (1 << 15)) >> 16);
+		to[i].y = center.y - ((c * radius + (1 << 15)) >> 16);
+	}
+}
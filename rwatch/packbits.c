@@ -0,0 +1,88 @@
+/* packbits.c
+ * PackBits run length coding, for the flat fills of a UI
+ * libRebbleOS
+ *
+ * As TIFF has it: n up to 127 is the n + 1 bytes after it as they are,
+ * n from 129 is the next byte 257 - n times. 128 is never written.
+ */
+
+#include <string.h>
+#include "packbits.h"
+
+uint32_t packbits_encode(uint8_t *out, const uint8_t *in, uint32_t len)
+{
+    uint32_t used = 0;
+    uint32_t i = 0;
+    uint32_t n;
+
+    while (i < len)
+    {
+        for (n = 1; i + n < len && n < 128 && in[i + n] == in[i]; n++)
+            ;
+
+        if (n > 1)
+        {
+            if (out)
+            {
+                out[used] = 257 - n;
+                out[used + 1] = in[i];
+            }
+            used += 2;
+        }
+        else
+        {
+            /* up to where a run of three starts. Breaking out for two
+             * would cost as much as it saved */
+            while (i + n < len && n < 128 &&
+                   !(i + n + 2 < len && in[i + n] == in[i + n + 1] &&
+                     in[i + n] == in[i + n + 2]))
+                n++;
+            if (out)
+            {
+                out[used] = n - 1;
+                memcpy(out + used + 1, in + i, n);
+            }
+            used += 1 + n;
+        }
+        i += n;
+    }
+
+    return used;
+}
+
+uint32_t packbits_decode(uint8_t *out, uint32_t out_len, const uint8_t *in, uint32_t in_len)
+{
+    uint32_t o = 0;
+    uint32_t i = 0;
+
+    while (i < in_len && o < out_len)
+    {
+        uint8_t c = in[i++];
+        uint32_t n;
+
+        if (c < 128)
+        {
+            n = c + 1;
+            if (n > in_len - i)
+                n = in_len - i;
+            if (n > out_len - o)
+                n = out_len - o;
+            memcpy(out + o, in + i, n);
+            i += c + 1;
+        }
+        else if (c > 128 && i < in_len)
+        {
+            n = 257 - c;
+            if (n > out_len - o)
+                n = out_len - o;
+            memset(out + o, in[i++], n);
+        }
+        else
+        {
+            continue;
+        }
+        o += n;
+    }
+
+    return o;
+}
@@ -0,0 +1,22 @@
+#pragma once
+/* packbits.h
+ * PackBits run length coding, for the flat fills of a UI
+ * libRebbleOS
+ */
+
+#include <stdint.h>
+
+/* The most len bytes can come to, coded */
+#define PACKBITS_MAX(len) ((len) + ((len) + 127) / 128)
+
+/*
+ * Code len bytes of in to out. out may be NULL, to find out how much
+ * room it takes first. Returns the bytes written, or that would be
+ */
+uint32_t packbits_encode(uint8_t *out, const uint8_t *in, uint32_t len);
+
+/*
+ * Undo packbits_encode: in_len coded bytes into at most out_len bytes
+ * of out. Returns the bytes written
+ */
+uint32_t packbits_decode(uint8_t *out, uint32_t out_len, const uint8_t *in, uint32_t in_len);
@@ -37,6 +37,8 @@ struct n_GRect;
 
 int32_t sin_lookup(int32_t angle);
 int32_t cos_lookup(int32_t angle);
+int32_t atan2_lookup(int16_t y, int16_t x);
+uint32_t isqrt(uint32_t n);
 
 
 
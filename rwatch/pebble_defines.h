@@ -54,7 +54,6 @@
 #define GBitmapFormat8BitCircular n_GBitmapFormat8BitCircular
 
 #define GBitmap struct n_GBitmap
-#define gbitmap_destroy n_gbitmap_destroy
 #define gbitmap_get_bytes_per_row n_gbitmap_get_bytes_per_row
 #define gbitmap_get_format n_gbitmap_get_format
 #define gbitmap_get_data n_gbitmap_get_data
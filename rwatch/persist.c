@@ -0,0 +1,371 @@
+/* persist.c
+ * implementation of PebbleOS persistent storage
+ * libRebbleOS
+ */
+
+#include "librebble.h"
+#include "appmanager.h"
+#include "fs.h"
+#include "persist.h"
+
+/* Each app's store is read into RAM, on its own heap, when it starts,
+ * and persist_ calls only ever touch that copy. Changes go back to flash
+ * as one file: PERSIST_FLUSH_DELAY after the first of them, when the app
+ * quits, or when the app heap runs dry and wants the room back. So an
+ * app saving its settings every minute costs a write every few minutes
+ * at most, and none at all if they didn't change.
+ *
+ * The file is just the records back to back, each a key and a length
+ * and then the data. A store tops out at 4K, same as on PebbleOS */
+#define PERSIST_FLUSH_DELAY pdMS_TO_TICKS(5 * 60 * 1000)
+#define PERSIST_STORE_MAX   4096
+#define PERSIST_GROW        256
+
+typedef struct __attribute__((__packed__)) PersistRecord {
+    uint32_t key;
+    uint16_t len;
+} PersistRecord;
+
+typedef struct PersistStore {
+    CoreTimer timer; /* must be at the start of the struct! */
+    bool timer_queued;
+    bool loaded;
+    bool dirty;
+    uint8_t *buf;
+    uint16_t used;
+    uint16_t alloc;
+    char name[16];
+} PersistStore;
+
+#define REC(st, ofs)    ((PersistRecord *)&(st)->buf[ofs])
+#define REC_DATA(r)     ((uint8_t *)(r) + sizeof(PersistRecord))
+#define REC_SIZE(r)     (sizeof(PersistRecord) + (r)->len)
+
+static bool _persist_reserve(PersistStore *st, uint16_t size)
+{
+    if (size <= st->alloc)
+        return true;
+    
+    size = (size + PERSIST_GROW - 1) & ~(PERSIST_GROW - 1);
+    uint8_t *buf = app_realloc(st->buf, size);
+    if (!buf)
+        return false;
+    
+    st->buf = buf;
+    st->alloc = size;
+    return true;
+}
+
+/* Read the store in, if it isn't already. A record that runs off the
+ * end is where whatever wrote it stopped, so we stop there too */
+static bool _persist_load(PersistStore *st)
+{
+    struct file file;
+    struct fd fd;
+    
+    if (st->loaded)
+        return true;
+    
+    st->used = 0;
+    if (fs_find_file(&file, st->name) == 0 && file.size)
+    {
+        uint16_t size = file.size > PERSIST_STORE_MAX ? PERSIST_STORE_MAX : file.size;
+        
+        if (!_persist_reserve(st, size))
+            return false;
+        
+        fs_open(&fd, &file);
+        size = fs_read(&fd, st->buf, size);
+        
+        while (st->used + sizeof(PersistRecord) <= size &&
+               st->used + REC_SIZE(REC(st, st->used)) <= size)
+            st->used += REC_SIZE(REC(st, st->used));
+    }
+    
+    st->loaded = true;
+    return true;
+}
+
+static void _persist_flush(PersistStore *st)
+{
+    struct file file;
+    struct fd fd;
+    
+    if (st->timer_queued)
+    {
+        appmanager_timer_remove(&st->timer);
+        st->timer_queued = false;
+    }
+    
+    if (!st->dirty)
+        return;
+    
+    if (!st->used)
+    {
+        if (fs_find_file(&file, st->name) == 0)
+            fs_delete(&file);
+    }
+    else if (fs_creat(&fd, st->name, st->used) < 0 ||
+             fs_write(&fd, st->buf, st->used) != st->used ||
+             fs_commit(&fd) < 0)
+    {
+        SYS_LOG("persist", APP_LOG_LEVEL_ERROR, "couldn't write %s back", st->name);
+        return;
+    }
+    
+    st->dirty = false;
+}
+
+static void _persist_timer_callback(CoreTimer *timer)
+{
+    PersistStore *st = (PersistStore *)timer;
+    
+    st->timer_queued = false;
+    _persist_flush(st);
+}
+
+/* the first change starts the clock, the ones after ride along */
+static void _persist_changed(PersistStore *st)
+{
+    st->dirty = true;
+    if (st->timer_queued)
+        return;
+    
+    st->timer.when = xTaskGetTickCount() + PERSIST_FLUSH_DELAY;
+    st->timer.callback = _persist_timer_callback;
+    appmanager_timer_add(&st->timer);
+    st->timer_queued = true;
+}
+
+static PersistStore *_persist_store(void)
+{
+    app_running_thread *thread = appmanager_get_current_thread();
+    PersistStore *st = thread ? thread->persist : NULL;
+    
+    if (!st || !_persist_load(st))
+        return NULL;
+    return st;
+}
+
+static int _persist_find(PersistStore *st, uint32_t key)
+{
+    for (uint16_t ofs = 0; ofs < st->used; ofs += REC_SIZE(REC(st, ofs)))
+        if (REC(st, ofs)->key == key)
+            return ofs;
+    return -1;
+}
+
+static PersistRecord *_persist_get(uint32_t key)
+{
+    PersistStore *st = _persist_store();
+    int ofs;
+    
+    if (!st || (ofs = _persist_find(st, key)) < 0)
+        return NULL;
+    return REC(st, ofs);
+}
+
+static int _persist_write(uint32_t key, const void *data, size_t size)
+{
+    PersistStore *st = _persist_store();
+    uint16_t old = 0;
+    int ofs;
+    
+    if (!st)
+        return E_ERROR;
+    
+    if (size > PERSIST_DATA_MAX_LENGTH)
+        size = PERSIST_DATA_MAX_LENGTH;
+    
+    ofs = _persist_find(st, key);
+    if (ofs >= 0)
+    {
+        PersistRecord *r = REC(st, ofs);
+        
+        /* same as it was, so nothing to write back */
+        if (r->len == size && !memcmp(REC_DATA(r), data, size))
+            return size;
+        old = REC_SIZE(r);
+    }
+    
+    uint16_t need = st->used - old + sizeof(PersistRecord) + size;
+    if (need > PERSIST_STORE_MAX)
+        return E_OUT_OF_STORAGE;
+    if (!_persist_reserve(st, st->used + sizeof(PersistRecord) + size))
+        return E_OUT_OF_MEMORY;
+    
+    if (ofs >= 0)
+    {
+        memmove(&st->buf[ofs], &st->buf[ofs + old], st->used - ofs - old);
+        st->used -= old;
+    }
+    
+    PersistRecord *r = REC(st, st->used);
+    r->key = key;
+    r->len = size;
+    memcpy(REC_DATA(r), data, size);
+    st->used += REC_SIZE(r);
+    
+    _persist_changed(st);
+    return size;
+}
+
+bool persist_exists(const uint32_t key)
+{
+    return _persist_get(key) != NULL;
+}
+
+int persist_get_size(const uint32_t key)
+{
+    PersistRecord *r = _persist_get(key);
+    
+    return r ? r->len : E_DOES_NOT_EXIST;
+}
+
+bool persist_read_bool(const uint32_t key)
+{
+    PersistRecord *r = _persist_get(key);
+    
+    return r && r->len && REC_DATA(r)[0];
+}
+
+int32_t persist_read_int(const uint32_t key)
+{
+    PersistRecord *r = _persist_get(key);
+    int32_t v = 0;
+    
+    if (r)
+        memcpy(&v, REC_DATA(r), r->len < sizeof(v) ? r->len : sizeof(v));
+    return v;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size)
+{
+    PersistRecord *r = _persist_get(key);
+    size_t n;
+    
+    if (!r)
+        return E_DOES_NOT_EXIST;
+    
+    n = r->len < buffer_size ? r->len : buffer_size;
+    memcpy(buffer, REC_DATA(r), n);
+    return n;
+}
+
+int persist_read_string(const uint32_t key, char *buffer, const size_t buffer_size)
+{
+    int n = persist_read_data(key, buffer, buffer_size);
+    
+    /* strings are kept with their terminator, unless one got cut short */
+    if (n > 0)
+        buffer[n - 1] = 0;
+    return n;
+}
+
+status_t persist_write_bool(const uint32_t key, const bool value)
+{
+    uint8_t v = value;
+    
+    return _persist_write(key, &v, sizeof(v));
+}
+
+status_t persist_write_int(const uint32_t key, const int32_t value)
+{
+    return _persist_write(key, &value, sizeof(value));
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size)
+{
+    return _persist_write(key, data, size);
+}
+
+int persist_write_string(const uint32_t key, const char *cstring)
+{
+    return _persist_write(key, cstring, strlen(cstring) + 1);
+}
+
+status_t persist_delete(const uint32_t key)
+{
+    PersistStore *st = _persist_store();
+    int ofs;
+    
+    if (!st || (ofs = _persist_find(st, key)) < 0)
+        return E_DOES_NOT_EXIST;
+    
+    uint16_t size = REC_SIZE(REC(st, ofs));
+    memmove(&st->buf[ofs], &st->buf[ofs + size], st->used - ofs - size);
+    st->used -= size;
+    
+    _persist_changed(st);
+    return S_SUCCESS;
+}
+
+int persist_read_data__deprecated(const uint32_t key, const size_t buffer_size, void *buffer)
+{
+    return persist_read_data(key, buffer, buffer_size);
+}
+
+int persist_read_string__deprecated(const uint32_t key, const size_t buffer_size, char *buffer)
+{
+    return persist_read_string(key, buffer, buffer_size);
+}
+
+int persist_write_data__deprecated(const uint32_t key, const size_t size, const void *data)
+{
+    return persist_write_data(key, data, size);
+}
+
+/*
+ * Set up the running app's store, and read it in. On the app's thread,
+ * so it all lands on its heap, which takes it away again at exit
+ */
+void persist_app_open(app_running_thread *thread)
+{
+    App *app = thread->app;
+    PersistStore *st = app_calloc(1, sizeof(PersistStore));
+    
+    thread->persist = st;
+    if (!st)
+        return;
+    
+    if (app->is_internal)
+        snprintf(st->name, sizeof(st->name), "%.12s/ps", app->name);
+    else
+        snprintf(st->name, sizeof(st->name), "@%08lx/ps", app->id);
+    
+    _persist_load(st);
+}
+
+/* The app is done; anything it changed goes back now */
+void persist_app_close(app_running_thread *thread)
+{
+    if (!thread->persist)
+        return;
+    
+    _persist_flush(thread->persist);
+    thread->persist = NULL;
+}
+
+/*
+ * The app heap is out. Write the store back, and give up its RAM; the
+ * next persist_ call reads it in again. False if there was nothing to
+ * give, or it couldn't be written
+ */
+bool persist_app_release(app_running_thread *thread)
+{
+    PersistStore *st = thread->persist;
+    
+    if (!st || !st->buf)
+        return false;
+    
+    _persist_flush(st);
+    if (st->dirty)
+        return false;
+    
+    app_free(st->buf);
+    st->buf = NULL;
+    st->alloc = 0;
+    st->used = 0;
+    st->loaded = false;
+    return true;
+}
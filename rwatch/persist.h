@@ -0,0 +1,56 @@
+#pragma once
+/* persist.h
+ * declarations for PebbleOS persistent storage
+ * libRebbleOS
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef int32_t status_t;
+
+typedef enum StatusCode {
+    S_SUCCESS = 0,
+    E_ERROR = -1,
+    E_UNKNOWN = -2,
+    E_INVALID_ARGUMENT = -3,
+    E_OUT_OF_MEMORY = -4,
+    E_OUT_OF_STORAGE = -5,
+    E_OUT_OF_RESOURCES = -6,
+    E_RANGE = -7,
+    E_DOES_NOT_EXIST = -8,
+    E_INVALID_OPERATION = -9,
+    E_BUSY = -10,
+    S_TRUE = 1,
+    S_FALSE = 0,
+    S_NO_MORE_ITEMS = 2,
+    S_NO_ACTION_REQUIRED = 3,
+} StatusCode;
+
+#define PERSIST_DATA_MAX_LENGTH 256
+#define PERSIST_STRING_MAX_LENGTH PERSIST_DATA_MAX_LENGTH
+
+struct app_running_thread_t;
+
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+bool persist_read_bool(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size);
+int persist_read_string(const uint32_t key, char *buffer, const size_t buffer_size);
+status_t persist_write_bool(const uint32_t key, const bool value);
+status_t persist_write_int(const uint32_t key, const int32_t value);
+int persist_write_data(const uint32_t key, const void *data, const size_t size);
+int persist_write_string(const uint32_t key, const char *cstring);
+status_t persist_delete(const uint32_t key);
+
+/* SDK 2 had the buffer and its size the other way round */
+int persist_read_data__deprecated(const uint32_t key, const size_t buffer_size, void *buffer);
+int persist_read_string__deprecated(const uint32_t key, const size_t buffer_size, char *buffer);
+int persist_write_data__deprecated(const uint32_t key, const size_t size, const void *data);
+
+/* for the appmanager and the heap, on the app's own thread */
+void persist_app_open(struct app_running_thread_t *thread);
+void persist_app_close(struct app_running_thread_t *thread);
+bool persist_app_release(struct app_running_thread_t *thread);
@@ -40,6 +40,16 @@ struct ActionMenuLevel
     ActionMenuItem items[];
 };
 
+/* Where a row's text goes, and in what. Every row of every level is laid
+ * out the same, so this is worked out once when the window loads */
+typedef struct ActionMenuLayout
+{
+    GFont font[2];          /* plain, focused */
+    GRect label_rect[2];
+    GFont indicator_font;
+    GRect indicator_rect;
+} ActionMenuLayout;
+
 struct ActionMenu
 {
     Window window;
@@ -49,6 +59,7 @@ struct ActionMenu
     uint16_t level_index;
     bool is_frozen;
     Window *result_window;
+    ActionMenuLayout layout;
 };
 
 const char *action_menu_item_get_label(const ActionMenuItem *item)
@@ -89,14 +100,23 @@ ActionMenuItem *action_menu_level_add_action(ActionMenuLevel *level, const char
     return new_item;
 }
 
+/*
+ * The menu layer keeps its cells from level to level, so this only
+ * measures the new level's rows. The selection is reset on the old
+ * layout first; the reload then repaints the lot anyway
+ */
+static void _show_level(ActionMenu *action_menu)
+{
+    MenuIndex zero_index = { .row = 0, .section = 0 };
+    menu_layer_set_selected_index(action_menu->menu_layer, zero_index, MenuRowAlignNone, false);
+    menu_layer_reload_data(action_menu->menu_layer);
+}
+
 static void _child_level_action_performed_callback(ActionMenu *action_menu, const ActionMenuItem *action, void *context)
 {
     action_menu->level_index++;
     action_menu->cur_level = (ActionMenuLevel*)action->action_data;
-
-    MenuIndex zero_index = { .row = 0, .section = 0 };
-    menu_layer_set_selected_index(action_menu->menu_layer, zero_index, MenuRowAlignCenter, false);
-    menu_layer_reload_data(action_menu->menu_layer);
+    _show_level(action_menu);
     // TODO: start animation
 }
 
@@ -176,33 +196,43 @@ static uint16_t _get_num_rows_callback(MenuLayer *menu_layer, uint16_t section_i
     return action_menu->cur_level->count;
 }
 
+static void _layout_rows(ActionMenuLayout *layout, int16_t w)
+{
+    int16_t h[2] = { ACTION_MENU_CELL_HEIGHT, ACTION_MENU_FOCUSED_CELL_HEIGHT };
+
+    layout->font[0] = fonts_get_system_font(ACTION_MENU_CELL_FONT);
+    layout->font[1] = fonts_get_system_font(ACTION_MENU_FOCUSED_CELL_FONT);
+    for (int i = 0; i < 2; i++)
+        layout->label_rect[i] = PBL_IF_RECT_ELSE(
+            GRect(ACTION_MENU_SIDEBAR_SIZE + 6, h[i] / 2 - 16,
+                  w - 2 * ACTION_MENU_SIDEBAR_SIZE, 24), /* rect */
+            GRect(0, h[i] / 2 - 16, w, 24)  /* round */
+        );
+
+    layout->indicator_font = fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD);
+    layout->indicator_rect = PBL_IF_RECT_ELSE(
+        GRect(w - ACTION_MENU_SIDEBAR_SIZE, h[1] / 2 - 24,
+              ACTION_MENU_SIDEBAR_SIZE, 16), /* rect */
+        GRect(0, 28, w, 16)       /* round TODO: Fix text size calculation and use text_height + padding */
+    );
+}
+
 static void _draw_row_callback(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index, void *context)
 {
-    GRect frame = cell_layer->frame;
     ActionMenu *action_menu = (ActionMenu *) context;
+    ActionMenuLayout *layout = &action_menu->layout;
     
     bool is_highlighted = menu_layer_is_index_selected(action_menu->menu_layer, cell_index);
     ctx->text_color = is_highlighted ? GColorWhite : GColorDarkGray;
     const char *item_label = action_menu->cur_level->items[cell_index->row].label;
     
     GTextAlignment align = MENU_DEFAULT_TEXT_ALIGNMENT;
-    GFont item_font = fonts_get_system_font(is_highlighted ? ACTION_MENU_FOCUSED_CELL_FONT : ACTION_MENU_CELL_FONT);
-    GRect item_rect = PBL_IF_RECT_ELSE(
-        GRect(ACTION_MENU_SIDEBAR_SIZE + 6, frame.size.h / 2 - 16,
-              frame.size.w - 2 * ACTION_MENU_SIDEBAR_SIZE, 24), /* rect */
-        GRect(0, frame.size.h / 2 - 16, frame.size.w, 24)  /* round */
-    );
-    graphics_draw_text(ctx, item_label, item_font, item_rect, GTextOverflowModeTrailingEllipsis, align, NULL);
+    graphics_draw_text(ctx, item_label, layout->font[is_highlighted], layout->label_rect[is_highlighted],
+                       GTextOverflowModeTrailingEllipsis, align, NULL);
 
     // draw level indicator
     if (is_highlighted && action_menu->cur_level->items[cell_index->row].cb == _child_level_action_performed_callback) {
-        GFont indicator_font = fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD);
-        GRect indicator_rect = PBL_IF_RECT_ELSE(
-            GRect(frame.size.w - ACTION_MENU_SIDEBAR_SIZE, frame.size.h/2 - 24,
-                  ACTION_MENU_SIDEBAR_SIZE, 16), /* rect */
-            GRect(0, 28, frame.size.w, 16)       /* round TODO: Fix text size calculation and use text_height + padding */
-        );
-        graphics_draw_text(ctx, ACTION_MENU_LEVEL_INDICATOR, indicator_font, indicator_rect, 
+        graphics_draw_text(ctx, ACTION_MENU_LEVEL_INDICATOR, layout->indicator_font, layout->indicator_rect, 
                                GTextOverflowModeTrailingEllipsis, align, NULL);
     }
 }
@@ -252,10 +282,7 @@ static void _action_menu_prev_level(ClickRecognizerRef recognizer, void* context
         if (action_menu->level_index > 0) {
             action_menu->level_index--;
             action_menu->cur_level = action_menu->cur_level->parent;
-
-            MenuIndex zero_index = { .row = 0, .section = 0 };
-            menu_layer_set_selected_index(action_menu->menu_layer, zero_index, MenuRowAlignCenter, false);
-            menu_layer_reload_data(action_menu->menu_layer);
+            _show_level(action_menu);
         } else {
             action_menu_close(action_menu, true);
         }
@@ -277,6 +304,7 @@ static void _action_menu_window_load(Window *window)
     GRect full_frame = layer_get_frame(root_layer);
     window_set_background_color(window, GColorBlack);
     window_set_click_config_provider_with_context(window, _action_menu_click_provider, action_menu);
+    _layout_rows(&action_menu->layout, full_frame.size.w);
     
     // Create the menu
     action_menu->menu_layer = menu_layer_create(full_frame);
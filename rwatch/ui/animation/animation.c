@@ -39,6 +39,8 @@
 #include "appmanager.h"
 #include "FreeRTOS.h"
 #include "property_animation.h"
+#include "utils.h"
+#include "power.h"
 
 /* Configure Logging */
 #define MODULE_NAME "anim"
@@ -48,10 +50,69 @@
 
 #define ANIMATION_FPS 60
 #define ANIMATION_TICKS (pdMS_TO_TICKS(1000) / ANIMATION_FPS)
+/* Slowest we'll drop to when frames can't go out fast enough */
+#define ANIMATION_FPS_MIN 15
+#define ANIMATION_TICKS_MAX (pdMS_TO_TICKS(1000) / ANIMATION_FPS_MIN)
+/* On time frames in a row before we try going faster again */
+#define ANIMATION_RECOVER_FRAMES 30
+/* Fastest we'll go while the battery is low */
+#define ANIMATION_FPS_SAVING 20
+#define ANIMATION_TICKS_SAVING (pdMS_TO_TICKS(1000) / ANIMATION_FPS_SAVING)
 
 static Animation *_animation_play_next(Animation *anim);
 static void _animation_update(Animation *anim);
 
+/* The standard curves, sampled at 65 points over the run and linearly
+ * interpolated between. Worked out by the compiler, so stepping an
+ * animation is a lookup and a multiply rather than a divide per frame */
+#define CURVE_POINTS 64
+#define CURVE_SQ(i) ((uint32_t)ANIMATION_NORMALIZED_MAX * (i) * (i) / (CURVE_POINTS * CURVE_POINTS))
+#define CURVE_EASE_IN(i)  CURVE_SQ(i)
+#define CURVE_EASE_OUT(i) (ANIMATION_NORMALIZED_MAX - CURVE_SQ(CURVE_POINTS - (i)))
+#define CURVE_EASE_IN_OUT(i) ((i) < CURVE_POINTS / 2 ? 2 * CURVE_SQ(i) \
+                                                     : ANIMATION_NORMALIZED_MAX - 2 * CURVE_SQ(CURVE_POINTS - (i)))
+
+#define CURVE_4(f, i)  f(i), f((i) + 1), f((i) + 2), f((i) + 3)
+#define CURVE_16(f, i) CURVE_4(f, i), CURVE_4(f, (i) + 4), CURVE_4(f, (i) + 8), CURVE_4(f, (i) + 12)
+#define CURVE_64(f)    CURVE_16(f, 0), CURVE_16(f, 16), CURVE_16(f, 32), CURVE_16(f, 48), f(64)
+
+static const uint16_t _curve_ease_in[] = { CURVE_64(CURVE_EASE_IN) };
+static const uint16_t _curve_ease_out[] = { CURVE_64(CURVE_EASE_OUT) };
+static const uint16_t _curve_ease_in_out[] = { CURVE_64(CURVE_EASE_IN_OUT) };
+
+/*
+ * Look progress up in a table of count evenly spaced points.
+ * Scaling by 65536 rather than ANIMATION_NORMALIZED_MAX keeps it to shifts,
+ * and is out by less than a point at the top end, where we snap to the end
+ */
+static AnimationProgress _curve_lookup(const uint16_t *table, uint16_t count, AnimationProgress progress)
+{
+    if (progress >= ANIMATION_NORMALIZED_MAX)
+        return table[count - 1];
+
+    uint32_t pos = progress * (count - 1);
+    uint32_t i = pos >> 16;
+    uint32_t frac = pos & 0xFFFF;
+    int32_t span = (int32_t)table[i + 1] - table[i];
+
+    return table[i] + ((span * (int32_t)frac) >> 16);
+}
+
+/* Every animation on a thread is stepped off one clock, in one pass per
+ * frame. However many are running, that's one timer in the thread's list
+ * and one draw after it. Animations wait on the clock in no order; there
+ * are never enough of them for it to matter */
+typedef struct AnimationClock {
+    CoreTimer timer;     /* our one entry in the thread's timer heap */
+    Animation *head;     /* everything waiting on a frame */
+    TickType_t interval; /* ticks per frame. Grows if frames come late */
+    uint8_t on_time;     /* frames in a row that weren't late */
+    bool armed;          /* timer is in the thread's list */
+    bool in_pass;        /* stepping animations, so hold off re-arming */
+} AnimationClock;
+
+static AnimationClock _clocks[MAX_APP_THREADS];
+
 /* XXX: The memory allocation story here is kind of a mess.  We do an
  * app_malloc on this, and store a bunch of state in the application's
  * memory -- you know, where the application could trample on it.  This is
@@ -67,7 +128,7 @@ static void _animation_update(Animation *anim);
 
 Animation *animation_create()
 {
-    Animation *anim = app_calloc(1, sizeof(Animation));
+    Animation *anim = app_pool_calloc(sizeof(Animation));
     if (!anim) {
         LOG_ERROR("No Memory");
         return NULL;
@@ -82,6 +143,7 @@ void animation_ctor(Animation* animation)
 {
     list_init_node(&animation->sequence_node);
     list_init_node(&animation->sequence_head);
+    animation->clock_next = NULL;
     animation->playcount = 1;
     animation->playcount_count = 0;
     animation->curve = AnimationCurveEaseInOut;
@@ -95,6 +157,9 @@ bool animation_destroy(Animation *anim)
 
     LOG_DEBUG("[%x] animation_destroy", anim);
 
+    if (anim->onqueue)
+        _clock_remove(anim);
+
     animation_dtor(anim);
     app_free(anim);
 
@@ -105,6 +170,141 @@ void animation_dtor(Animation* animation)
 {
 }
 
+static AnimationClock *_clock_get(void)
+{
+    return &_clocks[appmanager_get_thread_type()];
+}
+
+static TickType_t _clock_interval(AnimationClock *clock)
+{
+    TickType_t interval = clock->interval ? clock->interval : ANIMATION_TICKS;
+
+    if (power_is_saving())
+        return MAX(interval, ANIMATION_TICKS_SAVING);
+    return interval;
+}
+
+static void _clock_tick(CoreTimer *timer);
+
+/* Put the clock's timer in for whichever animation wants a frame first */
+static void _clock_arm(AnimationClock *clock)
+{
+    if (clock->in_pass)
+        return;
+
+    if (clock->armed)
+        appmanager_timer_remove(&clock->timer);
+    clock->armed = false;
+
+    if (!clock->head)
+        return;
+
+    TickType_t when = clock->head->timer.when;
+    for (Animation *anim = clock->head->clock_next; anim; anim = anim->clock_next)
+        if (anim->timer.when < when)
+            when = anim->timer.when;
+
+    clock->timer.when = when;
+    clock->timer.callback = _clock_tick;
+    appmanager_timer_add(&clock->timer);
+    clock->armed = true;
+}
+
+/* Step anim again at when */
+static void _clock_add(Animation *anim, TickType_t when)
+{
+    AnimationClock *clock = _clock_get();
+
+    anim->timer.when = when;
+    anim->clock_next = clock->head;
+    clock->head = anim;
+    anim->onqueue = 1;
+    _clock_arm(clock);
+}
+
+static void _clock_unlink(AnimationClock *clock, Animation *anim)
+{
+    Animation **next = &clock->head;
+
+    while (*next && *next != anim)
+        next = &(*next)->clock_next;
+
+    assert(*next && "animation is not on the clock");
+    *next = anim->clock_next;
+    anim->clock_next = NULL;
+    anim->onqueue = 0;
+}
+
+static void _clock_remove(Animation *anim)
+{
+    AnimationClock *clock = _clock_get();
+
+    _clock_unlink(clock, anim);
+    _clock_arm(clock);
+}
+
+/*
+ * A late frame means the thread was still busy with the last one, usually
+ * drawing it or waiting for the display to take it, so leave longer between
+ * frames. Speed back up once a run of them go out on time.
+ */
+static void _clock_adapt(AnimationClock *clock, TickType_t late)
+{
+    TickType_t interval = _clock_interval(clock);
+
+    if (late > interval)
+    {
+        clock->interval = MIN(interval * 2, ANIMATION_TICKS_MAX);
+        clock->on_time = 0;
+        LOG_DEBUG("Frame late by %d, now every %d ticks", late, clock->interval);
+    }
+    else if (interval > ANIMATION_TICKS && ++clock->on_time >= ANIMATION_RECOVER_FRAMES)
+    {
+        clock->interval = MAX(interval / 2, ANIMATION_TICKS);
+        clock->on_time = 0;
+    }
+}
+
+/* Step every animation that is due this frame */
+static void _clock_tick(CoreTimer *timer)
+{
+    AnimationClock *clock = (AnimationClock *)timer;
+    TickType_t now = xTaskGetTickCount();
+
+    clock->armed = false;
+    _clock_adapt(clock, now - clock->timer.when);
+
+    /* near enough to this frame to go with it */
+    TickType_t due = now + _clock_interval(clock) / 2;
+
+    clock->in_pass = true;
+    property_animation_batch_begin();
+    for (;;)
+    {
+        Animation *anim = clock->head;
+        while (anim && anim->timer.when > due)
+            anim = anim->clock_next;
+        if (!anim)
+            break;
+
+        /* updates can schedule, unschedule and free anything, so start over each time */
+        _clock_unlink(clock, anim);
+        _animation_update(anim);
+    }
+    property_animation_batch_end();
+    clock->in_pass = false;
+
+    _clock_arm(clock);
+}
+
+/*
+ * The thread's timers were thrown away, and its animations with them
+ */
+void animation_clock_reset(AppThreadType thread_type)
+{
+    memset(&_clocks[thread_type], 0, sizeof(AnimationClock));
+}
+
 /* We use a double linked list from nose_list.h, but only the structure.
  * Node_list has the tail pointing back to the head, and vice versa. It has a 
  * requirement that the head node must be known at all times. Additionally,
@@ -291,10 +491,10 @@ static void _animation_complete(Animation *anim)
 static void _animation_update(Animation *anim)
 {
     if (anim->onqueue)
-        appmanager_timer_remove(&anim->timer);
+        _clock_remove(anim);
 
-    anim->onqueue = 0;
     TickType_t now = xTaskGetTickCount();
+    TickType_t interval = _clock_interval(_clock_get());
     TickType_t progress = now - anim->startticks;
 
     if (anim->duration == ANIMATION_DURATION_INFINITE) 
@@ -304,8 +504,7 @@ static void _animation_update(Animation *anim)
             animation_schedule(anim);
             return;
         }
-        anim->timer.when = now + ANIMATION_TICKS;
-        appmanager_timer_add(&anim->timer);
+        _clock_add(anim, now + interval);
         return;
     }
 
@@ -316,7 +515,6 @@ static void _animation_update(Animation *anim)
         _animation_complete(anim);
         return;
     }
-    anim->timer.when = now + ANIMATION_TICKS;
     progress *= ANIMATION_NORMALIZED_MAX;
     progress /= anim->duration;
 
@@ -340,23 +538,18 @@ static void _animation_update(Animation *anim)
         case AnimationCurveLinear:
             break;
         case AnimationCurveEaseIn:
-            progress = ((progress * progress) / ANIMATION_NORMALIZED_MAX);
+            progress = _curve_lookup(_curve_ease_in, sizeof(_curve_ease_in) / sizeof(uint16_t), progress);
             break;
         case AnimationCurveEaseOut:
-            progress -= ANIMATION_NORMALIZED_MAX;
-            progress = -(progress * progress / ANIMATION_NORMALIZED_MAX) + ANIMATION_NORMALIZED_MAX;
+            progress = _curve_lookup(_curve_ease_out, sizeof(_curve_ease_out) / sizeof(uint16_t), progress);
             break;
         case AnimationCurveEaseInOut:
-            if (progress < ANIMATION_NORMALIZED_MAX / 2){
-                progress = ((progress * progress) / (ANIMATION_NORMALIZED_MAX / 2));
-            }
-            else {
-                progress -= ANIMATION_NORMALIZED_MAX;
-                progress = -((progress * progress) / (ANIMATION_NORMALIZED_MAX / 2)) + ANIMATION_NORMALIZED_MAX;
-            }
+            progress = _curve_lookup(_curve_ease_in_out, sizeof(_curve_ease_in_out) / sizeof(uint16_t), progress);
             break;
         case AnimationCurveCustomFunction:
-            if (anim->curve_function)
+            if (anim->curve_table)
+                progress = _curve_lookup(anim->curve_table, anim->curve_table_count, progress);
+            else if (anim->curve_function)
                 progress = anim->curve_function(progress);
             break;
         case AnimationCurveCustomInterpolationFunction:
@@ -368,16 +561,7 @@ static void _animation_update(Animation *anim)
     if (anim->impl.update)
         anim->impl.update(anim, (uint32_t) progress);
 
-    anim->onqueue = 1;
-    appmanager_timer_add(&anim->timer);
-}
-
-static void _anim_callback(CoreTimer *timer)
-{
-    Animation *anim = (Animation *) timer;
-
-    anim->onqueue = 0;
-    _animation_update(anim);
+    _clock_add(anim, now + interval);
 }
 
 /* Anims added to a sequence are not allowed to be changed.
@@ -402,22 +586,18 @@ static bool _animation_schedule_one(Animation *anim)
     _animation_started(anim);
 
     if (anim->onqueue)
-        appmanager_timer_remove(&anim->timer);
+        _clock_remove(anim);
 
     anim->startticks = xTaskGetTickCount();
     anim->scheduled = 1;
-    anim->onqueue = 0;
     anim->timer.when = 0;
-    anim->timer.callback = _anim_callback;
 
     /* If we are delaying, add the timer to the queue.
        when it times out it will call update*/
     if (anim->delay > 0) {
         LOG_INFO("[%x] Delay %d", anim, anim->delay);
-        anim->timer.when = anim->startticks + anim->delay;
-        anim->startticks = anim->timer.when;
-        anim->onqueue = 1;
-        appmanager_timer_add(&anim->timer);
+        anim->startticks = anim->startticks + anim->delay;
+        _clock_add(anim, anim->startticks);
         return true;
     }
 
@@ -471,6 +651,8 @@ bool animation_unschedule(Animation *anim)
         return true;
 
     anim->scheduled = 0;
+    if (anim->onqueue)
+        _clock_remove(anim);
 
     if (anim->anim_handlers.stopped)
         anim->anim_handlers.stopped(anim, false, anim->context);
@@ -642,7 +824,33 @@ bool animation_set_custom_curve(Animation * anim, AnimationCurveFunction curve_f
     if (_is_immutable(anim))
         return false;
 
+    anim->curve_function = curve_function;
     MK_THUMB_CB(anim->curve_function);
+    anim->curve_table = NULL;
+    anim->curve = AnimationCurveCustomFunction;
+
+    return true;
+}
+
+/*
+ * Use a curve given as a table of count points, evenly spaced from the
+ * start of the animation to the end, each 0 to ANIMATION_NORMALIZED_MAX.
+ * Progress in between is interpolated. Cheaper than a curve function,
+ * which gets called every frame. The table is not copied, so keep it
+ * around (const data is ideal) for as long as the animation is.
+ */
+bool animation_set_custom_curve_table(Animation *anim, const uint16_t *table, uint16_t count)
+{
+    if (!anim || !table || count < 2)
+        return false;
+
+    if (_is_immutable(anim))
+        return false;
+
+    anim->curve_table = table;
+    anim->curve_table_count = count;
+    anim->curve_function = NULL;
+    anim->curve = AnimationCurveCustomFunction;
 
     return true;
 }
@@ -686,10 +894,11 @@ const AnimationImplementation *animation_get_implementation(Animation *anim)
 Animation *animation_clone(Animation *from)
 {
     /* TODO sequences */
-    Animation *newanim = app_calloc(1, sizeof(Animation));
+    Animation *newanim = app_pool_calloc(sizeof(Animation));
     memcpy(newanim, from, sizeof(Animation));
     newanim->scheduled = 0;
     newanim->onqueue = 0;
+    newanim->clock_next = NULL;
     newanim->playcount_count = 0;
     return newanim;
 }
@@ -71,7 +71,8 @@ typedef enum {
 // animation
 typedef struct Animation
 {
-    CoreTimer timer;
+    CoreTimer timer; /* only .when is used, for when the clock next steps us */
+    struct Animation *clock_next;
     
     uint8_t scheduled;
     uint8_t onqueue;
@@ -87,6 +88,8 @@ typedef struct Animation
     AnimationImplementation impl;
     AnimationHandlers anim_handlers;
     AnimationCurveFunction curve_function;
+    const uint16_t *curve_table; /* used instead of curve_function if set */
+    uint16_t curve_table_count;
     list_node sequence_node;
     list_node sequence_head;
     void *context; /* for generic use */
@@ -125,4 +128,6 @@ bool animation_unschedule(Animation *animation);
 void animation_unschedule_all(void);
 bool animation_is_scheduled(Animation *animation);
 bool animation_set_custom_curve(Animation * anim, AnimationCurveFunction curve_function);
+bool animation_set_custom_curve_table(Animation *anim, const uint16_t *table, uint16_t count);
+void animation_clock_reset(AppThreadType thread_type);
 Animation *animation_clone(Animation *from);
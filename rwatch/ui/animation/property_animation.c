@@ -10,6 +10,110 @@
 #include "FreeRTOS.h"
 #include "property_animation.h"
 #include "animation.h"
+#include "utils.h"
+
+/*
+ * Layer frames and bounds set by animations in one pass of the animation
+ * clock. The layers move there and then, but their damage is added up
+ * and handed to the window once, at the end of the pass, however many
+ * animations moved them. One per thread, like the clocks.
+ */
+#define PROPERTY_BATCH_LAYERS 8
+
+typedef struct PropertyBatch {
+    bool active;
+    uint8_t count;
+    Layer *layer[PROPERTY_BATCH_LAYERS];
+    Window *window[PROPERTY_BATCH_LAYERS];
+    GRect from[PROPERTY_BATCH_LAYERS]; /* where each was on screen before this pass */
+} PropertyBatch;
+
+static PropertyBatch _batches[MAX_APP_THREADS];
+
+static void _batch_flush(PropertyBatch *batch)
+{
+    Window *window = NULL;
+    GRect damage = GRect(0, 0, 0, 0);
+
+    for (uint8_t i = 0; i < batch->count; i++)
+    {
+        Layer *layer = batch->layer[i];
+        GRect area = batch->from[i];
+
+        /* taken out of the tree since: that dirtied where it was already */
+        if (layer->window == batch->window[i])
+            area = rect_union(area, layer_convert_rect_to_screen(layer,
+                                                                 GRect(0, 0, layer->frame.size.w, layer->frame.size.h)));
+
+        if (window && window != batch->window[i])
+        {
+            window_dirty_rect(window, damage);
+            damage = GRect(0, 0, 0, 0);
+        }
+        window = batch->window[i];
+        damage = rect_union(damage, area);
+    }
+    if (window)
+        window_dirty_rect(window, damage);
+    batch->count = 0;
+}
+
+/* False if layer is to be set the usual way */
+static bool _batch_add(Layer *layer)
+{
+    PropertyBatch *batch = &_batches[appmanager_get_thread_type()];
+
+    if (!batch->active || !layer->window)
+        return false;
+
+    for (uint8_t i = 0; i < batch->count; i++)
+        if (batch->layer[i] == layer)
+            return true;
+
+    if (batch->count == PROPERTY_BATCH_LAYERS)
+        _batch_flush(batch);
+
+    batch->layer[batch->count] = layer;
+    batch->window[batch->count] = layer->window;
+    batch->from[batch->count] = layer_convert_rect_to_screen(layer, GRect(0, 0, layer->frame.size.w, layer->frame.size.h));
+    batch->count++;
+    return true;
+}
+
+/* A setter we don't know might look at the damage, or scroll, so it gets it as it stands */
+static void _batch_settle(void)
+{
+    PropertyBatch *batch = &_batches[appmanager_get_thread_type()];
+
+    if (batch->count)
+        _batch_flush(batch);
+}
+
+void property_animation_batch_begin(void)
+{
+    _batches[appmanager_get_thread_type()].active = true;
+}
+
+void property_animation_batch_end(void)
+{
+    PropertyBatch *batch = &_batches[appmanager_get_thread_type()];
+
+    _batch_flush(batch);
+    batch->active = false;
+}
+
+/* layer is going away; it can't be left in the batch */
+void property_animation_batch_release(Layer *layer)
+{
+    PropertyBatch *batch = &_batches[appmanager_get_thread_type()];
+
+    for (uint8_t i = 0; i < batch->count; i++)
+        if (batch->layer[i] == layer)
+        {
+            _batch_flush(batch);
+            return;
+        }
+}
 
 void property_animation_update_grect(PropertyAnimation * property_animation, const uint32_t distance_normalized)
 {
@@ -24,6 +128,20 @@ void property_animation_update_grect(PropertyAnimation * property_animation, con
                                ANIM_LERP(from->origin.y, to->origin.y, distance_normalized), 
                                ANIM_LERP(from->size.w, to->size.w, distance_normalized), 
                                ANIM_LERP(from->size.h, to->size.h, distance_normalized));
+
+        if (property_animation->impl.accessors.setter.grect == (GRectSetter) layer_set_frame)
+        {
+            Layer *layer = (Layer *) property_animation->subject;
+            if (RECT_EQ(layer->frame, new_rect))
+                return;
+            if (_batch_add(layer))
+            {
+                layer->frame = new_rect;
+                return;
+            }
+        }
+        else
+            _batch_settle();
         property_animation->impl.accessors.setter.grect(property_animation->subject, new_rect);
     }
 }
@@ -35,8 +153,22 @@ void property_animation_update_gpoint(PropertyAnimation * property_animation, co
         GPoint *from = (GPoint *) property_animation->values.from;
         GPoint *to = (GPoint *) property_animation->values.to;
         
-        GPoint new_origin = GPoint(ANIM_LERP(from->x, from->x, distance_normalized), 
+        GPoint new_origin = GPoint(ANIM_LERP(from->x, to->x, distance_normalized), 
                                    ANIM_LERP(from->y, to->y, distance_normalized));
+
+        if (property_animation->impl.accessors.setter.gpoint == (GPointSetter) layer_set_bounds_origin)
+        {
+            Layer *layer = (Layer *) property_animation->subject;
+            if (POINT_EQ(layer->bounds.origin, new_origin))
+                return;
+            if (_batch_add(layer))
+            {
+                layer->bounds.origin = new_origin;
+                return;
+            }
+        }
+        else
+            _batch_settle();
         property_animation->impl.accessors.setter.gpoint(property_animation->subject, new_origin);
     }
 }
@@ -48,6 +180,7 @@ void property_animation_update_int16(PropertyAnimation * property_animation, con
         int16_t *from = (int16_t *) property_animation->values.from;
         int16_t *to = (int16_t *) property_animation->values.to;
         
+        _batch_settle();
         property_animation->impl.accessors.setter.int16(property_animation->subject, ANIM_LERP(*from, *to, distance_normalized));
     }
 }
@@ -59,6 +192,7 @@ void property_animation_update_uint32(PropertyAnimation * property_animation, co
         uint32_t *from = (uint32_t *) property_animation->values.from;
         uint32_t *to = (uint32_t *) property_animation->values.to;
         
+        _batch_settle();
         property_animation->impl.accessors.setter.uint32(property_animation->subject, ANIM_LERP(*from, *to, distance_normalized));
     }
 }
@@ -76,6 +210,7 @@ void property_animation_update_gcolor8(PropertyAnimation * property_animation, c
         new_gcolor.b = ANIM_LERP(from->b, to->b, distance_normalized);
         new_gcolor.a = ANIM_LERP(from->a, to->a, distance_normalized);
         
+        _batch_settle();
         property_animation->impl.accessors.setter.gcolor(property_animation->subject, new_gcolor);
     }
 }
@@ -124,7 +259,7 @@ PropertyAnimation * property_animation_create(const PropertyAnimationImplementat
 {
     SYS_LOG("property_animation", APP_LOG_LEVEL_INFO, "property_animation_create");
     
-    PropertyAnimation *property_animation = app_calloc(1, sizeof(PropertyAnimation));
+    PropertyAnimation *property_animation = app_pool_calloc(sizeof(PropertyAnimation));
     animation_ctor(&property_animation->animation);
     
     property_animation->animation.impl = implementation->base;
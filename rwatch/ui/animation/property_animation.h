@@ -81,3 +81,9 @@ Animation * property_animation_get_animation(PropertyAnimation * property_animat
 bool property_animation_subject(PropertyAnimation * property_animation, void * subject, bool set);
 bool property_animation_from(PropertyAnimation * property_animation, void * from, size_t size, bool set);
 bool property_animation_to(PropertyAnimation * property_animation, void * to, size_t size, bool set);
+
+/* Around a pass of the animation clock: layer frames and bounds origins set
+ * in between are damaged together at the end */
+void property_animation_batch_begin(void);
+void property_animation_batch_end(void);
+void property_animation_batch_release(struct Layer *layer);
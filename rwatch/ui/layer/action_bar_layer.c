@@ -12,7 +12,7 @@
 
 ActionBarLayer *action_bar_layer_create()
 {
-    ActionBarLayer *action_bar = (ActionBarLayer*)app_calloc(1, sizeof(ActionBarLayer));
+    ActionBarLayer *action_bar = (ActionBarLayer*)app_pool_calloc(sizeof(ActionBarLayer));
     
     GRect frame = GRect(DISPLAY_COLS-ACTION_BAR_WIDTH, 0, ACTION_BAR_WIDTH, DISPLAY_ROWS);
     
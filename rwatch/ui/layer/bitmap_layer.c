@@ -19,6 +19,7 @@ void bitmap_layer_ctor(BitmapLayer *blayer, GRect frame)
     blayer->layer.container = blayer;
     blayer->compositing_mode = GCompOpAssign;
     blayer->background = GColorWhite;
+    blayer->layer.opaque = true;
     blayer->alignment = GAlignCenter;
     
     layer_set_update_proc(&blayer->layer, _bitmap_update_proc);
@@ -34,7 +35,7 @@ void bitmap_layer_dtor(BitmapLayer *bitmap_layer)
 
 BitmapLayer *bitmap_layer_create(GRect frame)
 {
-    BitmapLayer* blayer = app_calloc(1, sizeof(BitmapLayer));
+    BitmapLayer* blayer = app_pool_calloc(sizeof(BitmapLayer));
     bitmap_layer_ctor(blayer, frame);
     
     return blayer;
@@ -69,6 +70,8 @@ void bitmap_layer_set_alignment(BitmapLayer *bitmap_layer, GAlign alignment)
 void bitmap_layer_set_background_color(BitmapLayer *bitmap_layer, GColor color)
 {
     bitmap_layer->background = color;
+    /* a solid background hides whatever is under us */
+    bitmap_layer->layer.opaque = (color.argb & 0xC0) == 0xC0;
 }
 
 void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode)
@@ -137,5 +140,8 @@ static void _bitmap_update_proc(Layer *layer, GContext *nGContext)
     // fill the background
     graphics_context_set_fill_color(nGContext, bitmap_layer->background);
     graphics_fill_rect(nGContext, layer->bounds, 0, GCornerNone);
-    n_graphics_draw_bitmap_in_rect(nGContext, bitmap_layer->bitmap, target);
+    /* GCompOpSet blends by the bitmap's alpha, see blit_blend */
+    graphics_context_set_compositing_mode(nGContext, bitmap_layer->compositing_mode);
+    graphics_draw_bitmap_in_rect(nGContext, bitmap_layer->bitmap, target);
+    graphics_context_set_compositing_mode(nGContext, GCompOpAssign);
 }
@@ -11,13 +11,19 @@
 static void _layer_remove_node(Layer *to_be_removed);
 static void _layer_insert_node(Layer *layer_to_insert, Layer *sibling_layer, bool below);
 static void _layer_delete_tree(Layer *layer);
-static Layer *_layer_find_parent(Layer *orig_layer, Layer *layer);
-static void _layer_walk(const Layer *layer, GContext *context);
+static void _layer_walk(const Layer *layer, GContext *context, LayerDrawState *state);
+static void _layer_find_occluders(const Layer *layer, GPoint origin, LayerDrawState *state);
+static bool _layer_is_covered(const LayerDrawState *state, GRect rect, uint16_t order);
+static bool _layer_expand_damage(const Layer *layer, GPoint origin, LayerDrawState *state);
+static void _layer_find_moved(const Layer *layer, GPoint origin, LayerDrawState *state, uint8_t *phase);
+
+/* The region draw in progress, for update procs that keep to the damage */
+static LayerDrawState *_draw_state;
 
 // Layer Functions
 Layer *layer_create(GRect frame)
 {
-    Layer* layer = app_calloc(1, sizeof(Layer));
+    Layer* layer = app_pool_calloc(sizeof(Layer));
     if (layer == NULL)
     {
         SYS_LOG("layer", APP_LOG_LEVEL_ERROR, "NO MEMORY FOR LAYER!");
@@ -43,7 +49,10 @@ void layer_ctor(Layer* layer, GRect frame)
     layer->frame = frame;
     layer->child = NULL;
     layer->sibling = NULL;
+    layer->prev = NULL;
     layer->parent = NULL;
+    layer->opaque = false;
+    layer->paints_damage = false;
 }
 
 void layer_destroy(Layer* layer)
@@ -55,6 +64,8 @@ void layer_dtor(Layer *layer)
 {
     // remove our node
     SYS_LOG("layer", APP_LOG_LEVEL_ERROR, "Layer DTOR");
+    property_animation_batch_release(layer);
+    unobstructed_area_release(layer);
     _layer_remove_node(layer);
     // free the children too...
     /* @ginge Actually, Pebble doesn't do this so we dont either */
@@ -62,9 +73,30 @@ void layer_dtor(Layer *layer)
      * NOTE: cleanup after yourself! */
 }
 
+/*
+ * The part of the bounds nothing covers. Only the app's own windows are
+ * ever obstructed; overlays are drawn over whatever is in the way
+ */
 GRect layer_get_unobstructed_bounds(Layer *layer)
 {
-    return layer->bounds;
+    GRect bounds = layer->bounds;
+    GRect screen, area;
+    int16_t x0, y0, x1, y1;
+
+    if (appmanager_get_thread_type() != AppThreadMainApp)
+        return bounds;
+
+    screen = layer_convert_rect_to_screen(layer, bounds);
+    area = unobstructed_area_get();
+    x0 = MAX(screen.origin.x, area.origin.x);
+    y0 = MAX(screen.origin.y, area.origin.y);
+    x1 = MIN(screen.origin.x + screen.size.w, area.origin.x + area.size.w);
+    y1 = MIN(screen.origin.y + screen.size.h, area.origin.y + area.size.h);
+    if (x1 <= x0 || y1 <= y0)
+        return GRect(bounds.origin.x, bounds.origin.y, 0, 0);
+
+    return GRect(bounds.origin.x + x0 - screen.origin.x, bounds.origin.y + y0 - screen.origin.y,
+                 x1 - x0, y1 - y0);
 }
 
 void layer_set_update_proc(Layer *layer, void *proc)
@@ -77,46 +109,51 @@ void layer_add_child(Layer *parent_layer, Layer *child_layer)
     if (parent_layer == NULL || child_layer == NULL)
         return;
 
-    if(parent_layer->child == child_layer)
+    if (child_layer->parent == parent_layer)
     {
         SYS_LOG("layer", APP_LOG_LEVEL_ERROR, "LAYER IS ALREADY CHILD");
         return;
     }
-    
-    // if parent isn't already with child, it will become it
-    // this will set the root node for all other elements in this parent
-    if (parent_layer->child == NULL)
+
+    // a layer only has the one parent
+    _layer_remove_node(child_layer);
+
+    // on the end of the children, so drawn last, on top
+    Layer *first = parent_layer->child;
+    if (first == NULL)
     {
         parent_layer->child = child_layer;
-        child_layer->parent = parent_layer;
-        child_layer->window = parent_layer->window;
-        return;
+        child_layer->prev = child_layer;
     }
-    
-    Layer *child = parent_layer->child;
-    
-    // now find the parents childs siblings
-    while(child->sibling)
+    else
     {
-        if (child == child_layer)
-        {
-            SYS_LOG("layer", APP_LOG_LEVEL_ERROR, "LAYER IS ALREADY CHILD\n");
-            return;
-        }
-        child = child->sibling;
+        first->prev->sibling = child_layer;
+        child_layer->prev = first->prev;
+        first->prev = child_layer;
     }
-    
-    child->sibling = child_layer;
+
+    child_layer->sibling = NULL;
     child_layer->parent = parent_layer;
     child_layer->window = parent_layer->window;
 
     layer_mark_dirty(parent_layer);
 }
 
+/*
+ * Flag a layer as needing a repaint. The layer's area on screen is
+ * added to its window's damage so the display only has to push
+ * the pixels that changed
+ */
 void layer_mark_dirty(Layer *layer)
 {
-    //layer->window
-    window_dirty(true);
+    if (layer == NULL || layer->window == NULL)
+    {
+        window_dirty(true);
+        return;
+    }
+
+    GRect rect = layer_convert_rect_to_screen(layer, GRect(0, 0, layer->frame.size.w, layer->frame.size.h));
+    window_dirty_rect(layer->window, rect);
 }
 
 void layer_set_bounds(Layer *layer, GRect bounds)
@@ -139,11 +176,23 @@ GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point)
     {
         point = GPoint(point.x + current_layer->frame.origin.x,
                        point.y + current_layer->frame.origin.y);
-        current_layer = layer->parent;
+        current_layer = current_layer->parent;
     } 
     return point;
 }
 
+GRect layer_convert_rect_to_screen(const Layer *layer, GRect rect)
+{
+    rect.origin = layer_convert_point_to_screen(layer, rect.origin);
+    
+    if (layer->window)
+    {
+        rect.origin.x += layer->window->frame.origin.x;
+        rect.origin.y += layer->window->frame.origin.y;
+    }
+    return rect;
+}
+
 GPoint layer_get_bounds_origin(Layer* layer)
 {
     return layer->bounds.origin;
@@ -159,6 +208,8 @@ void layer_set_bounds_origin(Layer* layer, GPoint origin) {
 void layer_set_frame(Layer *layer, GRect frame)
 {
     if (!RECT_EQ(layer->frame, frame)) {
+        /* wherever it was needs painting over too */
+        layer_mark_dirty(layer);
         layer->frame = frame;
         layer_mark_dirty(layer);
     }
@@ -176,12 +227,15 @@ struct Window *layer_get_window(const Layer *layer)
 
 void layer_remove_from_parent(Layer *child)
 {
+    if (child->parent)
+        layer_mark_dirty(child);
     _layer_remove_node(child);
 }
 
 void layer_remove_child_layers(Layer *parent)
 {
     _layer_delete_tree(parent->child);
+    parent->child = NULL;
 }
 
 void layer_insert_below_sibling(Layer *layer_to_insert, Layer *below_sibling_layer)
@@ -196,7 +250,11 @@ void layer_insert_above_sibling(Layer *layer_to_insert, Layer *above_sibling_lay
 
 void layer_set_hidden(Layer *layer, bool hidden)
 {
+    if (layer->hidden == hidden)
+        return;
+
     layer->hidden = hidden;
+    layer_mark_dirty(layer);
 }
 
 bool layer_get_hidden(const Layer *layer)
@@ -206,7 +264,86 @@ bool layer_get_hidden(const Layer *layer)
 
 void layer_draw(const Layer *layer, GContext *context)
 {
-    _layer_walk(layer, context);
+    FRAME_PROFILE_START(t);
+    _layer_walk(layer, context, NULL);
+    FRAME_PROFILE_STOP(FrameProfileLayerWalk, t);
+}
+
+/*
+ * Draw only the layers whose frames touch the damage, and that aren't
+ * hidden under an opaque layer drawn after them.
+ * state must have been through layer_draw_prepare first.
+ */
+void layer_draw_region(const Layer *layer, GContext *context, LayerDrawState *state)
+{
+    state->order = 0;
+    _draw_state = state;
+    FRAME_PROFILE_START(t);
+    _layer_walk(layer, context, state);
+    FRAME_PROFILE_STOP(FrameProfileLayerWalk, t);
+    _draw_state = NULL;
+}
+
+/*
+ * The screen area being repainted, for update procs of layers that
+ * set paints_damage. Outside a region draw that's the whole screen.
+ */
+GRect layer_draw_get_damage(void)
+{
+    if (!_draw_state)
+        return GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+
+    return _draw_state->damage;
+}
+
+/*
+ * A paints_damage layer painted more than it was asked to. Layers drawn
+ * after it that overlap now get redrawn, and the area gets pushed out.
+ */
+void layer_draw_add_damage(GRect rect)
+{
+    if (_draw_state)
+        _draw_state->damage = rect_union(_draw_state->damage, rect);
+}
+
+/*
+ * Work out what a draw of the tree actually has to touch.
+ * First we note where the opaque layers are, so anything fully underneath
+ * one can be skipped. Then damage is grown until it covers every layer that
+ * still paints into it: ngfx can't clip for us, so a layer that gets
+ * repainted at all is repainted whole, and anything stacked on it then
+ * needs redrawing as well. Like Pebble, we assume layers keep to their frames.
+ * Layers that set paints_damage are trusted to keep to the damage instead.
+ * If state->moved is set, that subtree's pixels have been shifted within
+ * moved_rect, so whatever is stacked on top of it there joins the damage.
+ * origin is the screen position the layer's frame is relative to.
+ */
+void layer_draw_prepare(const Layer *layer, GPoint origin, GRect damage, LayerDrawState *state)
+{
+    state->damage = damage;
+    state->occluder_count = 0;
+    state->order = 0;
+    _layer_find_occluders(layer, origin, state);
+
+    if (state->moved)
+    {
+        uint8_t phase = 0;
+        _layer_find_moved(layer, origin, state, &phase);
+    }
+
+    do
+        state->order = 0;
+    while (_layer_expand_damage(layer, origin, state));
+}
+
+/*
+ * Does anything opaque in the tree cover rect? Anything drawn
+ * underneath the whole tree, like the window background, can be
+ * skipped if so.
+ */
+bool layer_draw_state_covers(const LayerDrawState *state, GRect rect)
+{
+    return _layer_is_covered(state, rect, 0);
 }
 
 void layer_apply_frame_offset(const Layer *layer, GContext *context)
@@ -235,102 +372,252 @@ bool layer_get_clips(const Layer *layer)
 
 /* Private functions */
 
+/*
+ * Children are a list from parent->child, drawn first to last. Each
+ * knows its parent and the sibling before it, and the first's prev is
+ * the last, so all of this is done without a search
+ */
 static void _layer_insert_node(Layer *layer_to_insert, Layer *sibling_layer, bool below)
 {
+    Layer *parent = sibling_layer->parent;
+
+    if (parent == NULL || layer_to_insert == sibling_layer)
+        return;
+
+    _layer_remove_node(layer_to_insert);
+
     if (below)
     {
-        // first find the sibling that points to parent
-        Layer *parent = _layer_find_parent(sibling_layer, sibling_layer);
-        layer_to_insert->parent = parent->parent;
-        layer_to_insert->sibling = parent->sibling;
-        parent->sibling = layer_to_insert;
+        // slot the node in before, so it's drawn first
+        if (parent->child == sibling_layer)
+            parent->child = layer_to_insert;
+        else
+            sibling_layer->prev->sibling = layer_to_insert;
+        layer_to_insert->prev = sibling_layer->prev;
+        layer_to_insert->sibling = sibling_layer;
+        sibling_layer->prev = layer_to_insert;
     }
     else
     {
         // slot the node in after
-        layer_to_insert->parent = sibling_layer->parent;
+        if (sibling_layer->sibling)
+            sibling_layer->sibling->prev = layer_to_insert;
+        else
+            parent->child->prev = layer_to_insert;
+        layer_to_insert->prev = sibling_layer;
         layer_to_insert->sibling = sibling_layer->sibling;
         sibling_layer->sibling = layer_to_insert;
     }
+    layer_to_insert->parent = parent;
     layer_to_insert->window = sibling_layer->window;
 }
 
 static void _layer_remove_node(Layer *to_be_removed)
 {
-    if (to_be_removed->parent == NULL)
-        return;
-    
-    Layer *parent = _layer_find_parent(to_be_removed, to_be_removed->parent);
-    // remove our node by pointing next to parents next, jumping over us
+    Layer *parent = to_be_removed->parent;
+
+    /* root layers have nothing to leave */
     if (parent == NULL)
-    {
-        SYS_LOG("window", APP_LOG_LEVEL_INFO, "ROOT layers rem %d %d %d %d", to_be_removed, parent, parent->sibling, parent->child);
-        
-        /* we are the root node */
         return;
-    }
-    
-    if (parent->sibling == to_be_removed)
-    {
-        parent->sibling = to_be_removed->sibling;
-    }
-    else if (parent->child == to_be_removed)
-    {
-        parent->child = NULL;
-    }
-    to_be_removed->parent = NULL;   
+
+    // remove our node by pointing our neighbours at each other, jumping over us
+    Layer *next = to_be_removed->sibling;
+    if (parent->child == to_be_removed)
+        parent->child = next;
+    else
+        to_be_removed->prev->sibling = next;
+
+    if (next)
+        next->prev = to_be_removed->prev;
+    else if (parent->child)
+        parent->child->prev = to_be_removed->prev;
+
+    to_be_removed->parent = NULL;
+    to_be_removed->sibling = NULL;
+    to_be_removed->prev = NULL;
 }
 
 /*
- * Recurse through the btree.
- * As we are storing layers as a btree where each sibling
- * is the next layer of the same child as layer->parent
- * layer->child is the head of a new list of siblings where layer->child == new parent
- * This will recurse the children, the siblings of children in a layer
- * When exhaused it will walk the siblings of the parent, etc etc until
- * either 1) no more ram 2) completion
+ * Draw layer, its children and its siblings, children after their
+ * parent and before the parent's next sibling.
+ * Siblings are a list and children know their parent, so the walk
+ * follows the links rather than recursing; the only stack it needs is
+ * the context offset under each layer it is inside, and that's the
+ * depth of the tree, not its size. A tree deeper than that goes on in a
+ * fresh walk.
  */
-static void _layer_walk(const Layer *layer, GContext *context)
+#define LAYER_WALK_DEPTH 8
+
+static void _layer_walk(const Layer *layer, GContext *context, LayerDrawState *state)
 {
-    if (layer)
+    GRect offsets[LAYER_WALK_DEPTH];
+    uint8_t depth = 0;
+
+    while (layer)
     {
         if (layer->hidden == false) // we don't draw hidden layers or their children
         {
             GRect previous_offset = context->offset;
             layer_apply_frame_offset(layer, context);
 
-            if (layer->update_proc)
+            GRect screen = GRect(context->offset.origin.x, context->offset.origin.y,
+                                 layer->frame.size.w, layer->frame.size.h);
+            uint16_t order = state ? ++state->order : 0;
+
+            /* untouched layers keep last frame's pixels. Children don't
+             * clip to their parent, so they still get a look in */
+            if (layer->update_proc &&
+                (!state || (RECT_INTERSECTS(screen, state->damage) &&
+                            !_layer_is_covered(state, screen, order))))
+            {
+                FRAME_PROFILE_START(t);
                 layer->update_proc((Layer *)layer, context);
-
-            // walk this elements sub elements recursively before moving on to the next element
-            _layer_walk(layer->child, context);
+                FRAME_PROFILE_STOP(FrameProfileUpdateProc, t);
+            }
+
+            // this element's sub elements before moving on to the next element
+            if (layer->child && depth < LAYER_WALK_DEPTH)
+            {
+                offsets[depth++] = previous_offset;
+                layer = layer->child;
+                continue;
+            }
+            _layer_walk(layer->child, context, state);
 
             context->offset = previous_offset; // restore offset
         }
-        _layer_walk(layer->sibling, context);
+
+        // out of any parents we have finished, to the next sibling
+        while (!layer->sibling && depth)
+        {
+            layer = layer->parent;
+            context->offset = offsets[--depth];
+        }
+        layer = layer->sibling;
     }
 }
 
-static Layer *_layer_find_parent(Layer *orig_layer, Layer *layer)
+/*
+ * The part of a layer it promises to paint solid, in screen coordinates.
+ * The built in layers fill their bounds (or their whole frame), so the
+ * overlap of the two is always safe to claim.
+ */
+static GRect _layer_opaque_rect(const Layer *layer, GPoint pos)
 {
-    if (layer)
-    {       
-        if (layer->sibling == orig_layer || layer->child == orig_layer)
+    int16_t x0 = MAX(layer->bounds.origin.x, 0);
+    int16_t y0 = MAX(layer->bounds.origin.y, 0);
+    int16_t x1 = MIN(layer->bounds.origin.x + layer->bounds.size.w, layer->frame.size.w);
+    int16_t y1 = MIN(layer->bounds.origin.y + layer->bounds.size.h, layer->frame.size.h);
+
+    if (x1 <= x0 || y1 <= y0)
+        return GRect(0, 0, 0, 0);
+
+    return GRect(pos.x + x0, pos.y + y0, x1 - x0, y1 - y0);
+}
+
+/*
+ * Collect the opaque layers in draw order. If there are more than we
+ * have room for, the rest just don't get to hide anything.
+ */
+static void _layer_find_occluders(const Layer *layer, GPoint origin, LayerDrawState *state)
+{
+    for (; layer; layer = layer->sibling)
+    {
+        if (layer->hidden)
+            continue;
+
+        GPoint pos = GPoint(origin.x + layer->frame.origin.x, origin.y + layer->frame.origin.y);
+        uint16_t order = ++state->order;
+
+        if (layer->opaque && layer->update_proc && state->occluder_count < LAYER_MAX_OCCLUDERS)
         {
-            return layer;
+            GRect rect = _layer_opaque_rect(layer, pos);
+            if (!RECT_EMPTY(rect))
+            {
+                state->occluder[state->occluder_count] = rect;
+                state->occluder_order[state->occluder_count] = order;
+                state->occluder_count++;
+            }
         }
-        
-        // walk this elements sub elements recursively before moving on to the next element
-        Layer *found_layer = NULL;
-        found_layer = _layer_find_parent(orig_layer, layer->child);
-        if (found_layer)
-            return found_layer;
-        
-        found_layer = _layer_find_parent(orig_layer, layer->sibling);
-        if (found_layer)
-            return found_layer;
+
+        _layer_find_occluders(layer->child, pos, state);
+    }
+}
+
+/* Is rect painted over by an opaque layer drawn after order? */
+static bool _layer_is_covered(const LayerDrawState *state, GRect rect, uint16_t order)
+{
+    for (uint8_t i = 0; i < state->occluder_count; i++)
+    {
+        if (state->occluder_order[i] > order && RECT_CONTAINS(state->occluder[i], rect))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * One pass of growing the damage in layer_draw_prepare.
+ * Returns true if damage grew, in which case layers we already
+ * passed may now intersect it and we go again.
+ */
+static bool _layer_expand_damage(const Layer *layer, GPoint origin, LayerDrawState *state)
+{
+    bool grew = false;
+
+    for (; layer; layer = layer->sibling)
+    {
+        if (layer->hidden)
+            continue;
+
+        GPoint pos = GPoint(origin.x + layer->frame.origin.x, origin.y + layer->frame.origin.y);
+        GRect screen = GRect(pos.x, pos.y, layer->frame.size.w, layer->frame.size.h);
+        uint16_t order = ++state->order;
+
+        /* covered layers don't paint, so they can't spread the damage */
+        if (layer->update_proc && !layer->paints_damage && !RECT_EMPTY(screen) &&
+            RECT_INTERSECTS(screen, state->damage) && !RECT_CONTAINS(state->damage, screen) &&
+            !_layer_is_covered(state, screen, order))
+        {
+            state->damage = rect_union(state->damage, screen);
+            grew = true;
+        }
+
+        if (_layer_expand_damage(layer->child, pos, state))
+            grew = true;
+    }
+
+    return grew;
+}
+
+/*
+ * Anything drawn after the moved subtree that overlaps where it moved
+ * had its pixels dragged along, so has to be redrawn. What's under it
+ * was covered by it, or the scroll wouldn't have been allowed.
+ * phase goes 0 before the subtree, 1 in it, 2 after it.
+ */
+static void _layer_find_moved(const Layer *layer, GPoint origin, LayerDrawState *state, uint8_t *phase)
+{
+    for (; layer; layer = layer->sibling)
+    {
+        if (layer->hidden)
+            continue;
+
+        GPoint pos = GPoint(origin.x + layer->frame.origin.x, origin.y + layer->frame.origin.y);
+        GRect screen = GRect(pos.x, pos.y, layer->frame.size.w, layer->frame.size.h);
+
+        if (layer == state->moved)
+        {
+            *phase = 1;
+            _layer_find_moved(layer->child, pos, state, phase);
+            *phase = 2;
+            continue;
+        }
+
+        if (*phase == 2 && layer->update_proc && RECT_INTERSECTS(screen, state->moved_rect))
+            state->damage = rect_union(state->damage, screen);
+
+        _layer_find_moved(layer->child, pos, state, phase);
     }
-    return NULL;
 }
 
 int inj = 0;
@@ -22,6 +22,7 @@ typedef struct Layer
 {
     struct Layer *child;
     struct Layer *sibling;
+    struct Layer *prev; /* sibling before us. The first child's is the last child */
     struct Layer *parent;
     void *container; // pointer to parent type, if any. i.e. a textlayer
     struct Window  *window;
@@ -31,8 +32,25 @@ typedef struct Layer
     LayerUpdateProc update_proc;
     void *callback_data;
     bool hidden;
+    bool opaque; /* update_proc paints all of bounds (within the frame) solid */
+    bool paints_damage; /* update_proc keeps to layer_draw_get_damage, reporting any spill */
 } Layer;
 
+/* Most opaque layers one draw will use to skip what's beneath them */
+#define LAYER_MAX_OCCLUDERS 8
+
+/* Working state for drawing a layer tree. Set up by layer_draw_prepare */
+typedef struct LayerDrawState
+{
+    GRect damage; /* screen area being repainted */
+    GRect occluder[LAYER_MAX_OCCLUDERS]; /* solid screen rects, in draw order */
+    uint16_t occluder_order[LAYER_MAX_OCCLUDERS]; /* when each of those gets drawn */
+    uint8_t occluder_count;
+    uint16_t order;
+    const Layer *moved; /* subtree whose pixels were shifted rather than repainted */
+    GRect moved_rect; /* screen area they were shifted within */
+} LayerDrawState;
+
 
 // Layer Functions
 
@@ -55,7 +73,7 @@ GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point);
 GPoint layer_get_bounds_origin(Layer* layer); // Not in the original API, but necessary for property_animation
 void layer_set_bounds_origin(Layer* layer, GPoint origin);
 GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point); //TODO
-GRect layer_convert_rect_to_screen(const Layer *layer, GRect rect); //TODO
+GRect layer_convert_rect_to_screen(const Layer *layer, GRect rect);
 struct Window *layer_get_window(const Layer *layer);
 void layer_remove_from_parent(Layer *child);
 void layer_remove_child_layers(Layer *parent);
@@ -67,6 +85,11 @@ void layer_set_clips(Layer *layer, bool clips);  //TODO
 bool layer_get_clips(const Layer *layer); //TODO
 void *layer_get_data(const Layer *layer); //TODO
 void layer_draw(const Layer *layer, GContext *context);
+void layer_draw_prepare(const Layer *layer, GPoint origin, GRect damage, LayerDrawState *state);
+bool layer_draw_state_covers(const LayerDrawState *state, GRect rect);
+void layer_draw_region(const Layer *layer, GContext *context, LayerDrawState *state);
+GRect layer_draw_get_damage(void);
+void layer_draw_add_damage(GRect rect);
 // updates context offset based on layer frame, used to properly adjust layer drawing calls
 void layer_apply_frame_offset(const Layer *layer, GContext *context);
 
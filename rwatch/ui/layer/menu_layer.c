@@ -10,6 +10,7 @@
 extern void graphics_draw_bitmap_in_rect(GContext *, const GBitmap *, GRect);
 
 static void menu_layer_update_proc(Layer *layer, GContext *nGContext);
+static void _menu_layer_update_fast_scroll(MenuLayer *menu_layer);
 
 #define MenuRow(section, row, x, y, h) ((MenuCellSpan){ (x), (y), (h), 0, false, MenuIndex((section), (row)) })
 #define MenuHeader(section, x, y, h) ((MenuCellSpan){ (x), (y), (h), 0, true, MenuIndex((section), 0) })
@@ -17,6 +18,8 @@ static void menu_layer_update_proc(Layer *layer, GContext *nGContext);
 #define BUTTON_REPEAT_INTERVAL_MS 600
 #define BUTTON_LONG_CLICK_DELAY_MS 500
 #define ANIMATE_ON_CLICK true
+/* How far past the screen edges we still draw cells */
+#define MENU_DRAW_MARGIN MENU_CELL_BASIC_CELL_HEIGHT
 
 void menu_layer_ctor(MenuLayer *mlayer, GRect frame)
 {
@@ -26,6 +29,7 @@ void menu_layer_ctor(MenuLayer *mlayer, GRect frame)
 
     mlayer->column_count = 1;
     mlayer->cells_count = 0;
+    mlayer->cells_capacity = 0;
     mlayer->selected = MenuIndex(0, 0);
     mlayer->end_index = MenuIndex(0, 1);
     mlayer->bg_color = GColorWhite;
@@ -45,19 +49,22 @@ void menu_layer_ctor(MenuLayer *mlayer, GRect frame)
     layer_set_update_proc(&mlayer->layer, menu_layer_update_proc);
 
     scroll_layer_add_child(&mlayer->scroll_layer, &mlayer->layer);
+    _menu_layer_update_fast_scroll(mlayer);
 }
 
 void menu_layer_dtor(MenuLayer *menu)
 {
     layer_dtor(&menu->layer);
     scroll_layer_dtor(&menu->scroll_layer);
-    if (menu->cells_count > 0)
+    if (menu->cells_capacity > 0)
         app_free(menu->cells);
+    if (menu->sections_count > 0)
+        app_free(menu->sections);
 }
 
 MenuLayer *menu_layer_create(GRect frame)
 {
-    MenuLayer *mlayer = (MenuLayer *)app_calloc(1, sizeof(MenuLayer));
+    MenuLayer *mlayer = (MenuLayer *)app_pool_calloc(sizeof(MenuLayer));
     menu_layer_ctor(mlayer, frame);
     return mlayer;
 }
@@ -124,14 +131,118 @@ void menu_layer_set_selected_next(MenuLayer *menu_layer, bool up, MenuRowAlign s
     menu_layer_set_selected_index(menu_layer, get_next_index(menu_layer, up), scroll_align, animated);
 }
 
-static MenuCellSpan *_get_cell_span(MenuLayer *menu_layer, const MenuIndex *index)
+static int16_t _get_cell_height(MenuLayer *menu_layer, MenuIndex *index)
 {
-    // TODO: optimize, binary search should be enough
-    for (size_t cell = 0; cell < menu_layer->cells_count; ++cell)
-        if (menu_index_compare(index, &menu_layer->cells[cell].index) == 0 && !menu_layer->cells[cell].header)
-            return &menu_layer->cells[cell];
+    return menu_layer->callbacks.get_cell_height
+        ? menu_layer->callbacks.get_cell_height(menu_layer, index, menu_layer->context)
+        : MENU_CELL_BASIC_CELL_HEIGHT;
+}
+
+static int16_t _get_column_x(const MenuLayer *menu_layer, uint16_t column)
+{
+    uint16_t cell_width = menu_layer->layer.frame.size.w / menu_layer->column_count;
+    uint16_t oversized_columns = menu_layer->layer.frame.size.w % menu_layer->column_count;
+
+    return column * cell_width + (column > 0 && column < oversized_columns);
+}
+
+// Virtual layout -------------
+//
+// Rows sit on a grid of their section's row height, the one exception
+// being the selected row's line, which may be taller (or shorter) and
+// pushes the rest of its section along.
+
+static uint16_t _section_lines(const MenuLayer *menu_layer, const MenuSectionSpan *section)
+{
+    return (section->rows + menu_layer->column_count - 1) / menu_layer->column_count;
+}
+
+/* Lay the sections out around the selection. Returns the content height */
+static int16_t _virtual_place_sections(MenuLayer *menu_layer)
+{
+    int16_t y = 0;
+
+    menu_layer->selected_h = 0;
+    for (uint16_t i = 0; i < menu_layer->sections_count; ++i)
+    {
+        MenuSectionSpan *section = &menu_layer->sections[i];
+        section->y = y;
+        y += section->header_h + _section_lines(menu_layer, section) * section->row_h;
+
+        if (i == menu_layer->selected.section && menu_layer->selected.row < section->rows)
+        {
+            MenuIndex index = menu_layer->selected;
+            int16_t h = _get_cell_height(menu_layer, &index);
+            // the rest of a shared row lines up with the tallest
+            if (menu_layer->column_count > 1)
+                h = MAX(h, section->row_h);
+            menu_layer->selected_h = h;
+            y += h - section->row_h;
+        }
+    }
+
+    return y;
+}
+
+static void _virtual_cell_span(const MenuLayer *menu_layer, const MenuIndex *index, MenuCellSpan *span)
+{
+    const MenuSectionSpan *section = &menu_layer->sections[index->section];
+    uint16_t line = index->row / menu_layer->column_count;
+    int16_t y = section->y + section->header_h + line * section->row_h;
+    int16_t h = section->row_h;
+
+    if (index->section == menu_layer->selected.section)
+    {
+        uint16_t selected_line = menu_layer->selected.row / menu_layer->column_count;
+        if (line == selected_line)
+            h = menu_layer->selected_h;
+        else if (line > selected_line)
+            y += menu_layer->selected_h - section->row_h;
+    }
 
-    return NULL;
+    *span = MenuRow(index->section, index->row,
+                    _get_column_x(menu_layer, index->row % menu_layer->column_count), y, h);
+}
+
+/* Where a row is, or would go, in the cells table. Headers sort before their rows */
+static size_t _cell_position(const MenuLayer *menu_layer, uint16_t section, uint16_t row)
+{
+    size_t lo = 0, hi = menu_layer->cells_count;
+    MenuIndex index = MenuIndex(section, row);
+
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        const MenuCellSpan *cell = &menu_layer->cells[mid];
+        int16_t cmp = menu_index_compare(&cell->index, &index);
+        if (cmp < 0 || (cmp == 0 && cell->header))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static bool _get_cell_span(MenuLayer *menu_layer, const MenuIndex *index, MenuCellSpan *span)
+{
+    if (menu_layer->is_virtual)
+    {
+        if (index->section >= menu_layer->sections_count ||
+            index->row >= menu_layer->sections[index->section].rows)
+            return false;
+
+        _virtual_cell_span(menu_layer, index, span);
+        return true;
+    }
+
+    size_t cell = _cell_position(menu_layer, index->section, index->row);
+    if (cell >= menu_layer->cells_count || menu_layer->cells[cell].header ||
+        menu_index_compare(index, &menu_layer->cells[cell].index) != 0)
+        return false;
+
+    *span = menu_layer->cells[cell];
+    return true;
 }
 
 static int16_t _get_aligned_edge_position(int16_t height, MenuRowAlign align)
@@ -147,14 +258,50 @@ static int16_t _get_aligned_edge_position(int16_t height, MenuRowAlign align)
     }
 }
 
-void _menu_layer_update_scroll_offset(MenuLayer* menu_layer, MenuRowAlign scroll_align, bool animated) {
+/*
+ * Our layer is made as tall as the content so that the layer walk finds
+ * it however far it's scrolled, and at least as tall as the view so that
+ * the background we paint covers it
+ */
+static void _menu_layer_fit_frame(MenuLayer *menu_layer, int16_t h)
+{
+    GRect frame = layer_get_frame(&menu_layer->layer);
+    GSize view = layer_get_frame(&menu_layer->scroll_layer.layer).size;
+
+    frame.size.h = MAX(h, view.h);
+    layer_set_frame(&menu_layer->layer, frame);
+}
+
+static void _menu_layer_set_content_height(MenuLayer *menu_layer, int16_t h)
+{
+    GSize size = scroll_layer_get_content_size(&menu_layer->scroll_layer);
+    if (size.h == h)
+        return;
+
+    size.h = h;
+    scroll_layer_set_content_size(&menu_layer->scroll_layer, size);
+    _menu_layer_fit_frame(menu_layer, h);
+}
+
+/* Moving pixels on scroll only works if we paint the view solid, and the cursor scrolls with us */
+static void _menu_layer_update_fast_scroll(MenuLayer *menu_layer)
+{
+    bool solid = (menu_layer->bg_color.argb & 0xC0) == 0xC0 && !menu_layer->callbacks.draw_background;
+
+    menu_layer->layer.paints_damage = !menu_layer->is_center_focus;
+    scroll_layer_set_fast_scroll(&menu_layer->scroll_layer, solid && !menu_layer->is_center_focus);
+}
+
+/* false if the content stays where it is */
+bool _menu_layer_update_scroll_offset(MenuLayer* menu_layer, MenuRowAlign scroll_align, bool animated) {
     MenuIndex index = menu_layer_get_selected_index(menu_layer);
-    MenuCellSpan *cell = _get_cell_span(menu_layer, &index);
+    MenuCellSpan span;
+    MenuCellSpan *cell = _get_cell_span(menu_layer, &index, &span) ? &span : NULL;
     if (cell && scroll_align != MenuRowAlignNone)
     {
         if (menu_layer->is_center_focus)
             scroll_align = MenuRowAlignCenter;
-        GSize size = layer_get_frame(&menu_layer->layer).size;
+        GSize size = layer_get_frame(&menu_layer->scroll_layer.layer).size;
         int16_t span_pos = cell->y + _get_aligned_edge_position(cell->h, scroll_align);
         int16_t frame_pos = _get_aligned_edge_position(size.h, scroll_align);
 
@@ -168,23 +315,68 @@ void _menu_layer_update_scroll_offset(MenuLayer* menu_layer, MenuRowAlign scroll
             int16_t min_offset = MIN(size.h - full_content_height, 0);
             new_offset.y = CLAMP(new_offset.y, min_offset, 0);
         }
+
+        // already there, or on the way: don't start an animation that goes nowhere
+        GPoint target = menu_layer->scroll_layer.scroll_offset.origin;
+        if (new_offset.x == target.x && new_offset.y == target.y)
+            return false;
+
         scroll_layer_set_content_offset(&menu_layer->scroll_layer, new_offset, animated);
+        return true;
     }
+    return false;
+}
+
+/*
+ * A new selection that moves nothing only changes how the old and new
+ * rows are drawn, so only they need repainting. False if it isn't that
+ * simple, and the whole menu has to be
+ */
+static bool _menu_layer_dirty_selection(MenuLayer *menu_layer, const MenuIndex *old_index, const MenuIndex *new_index)
+{
+    Layer *layer = &menu_layer->layer;
+    MenuCellSpan spans[2];
+    uint16_t cell_width = layer->frame.size.w / menu_layer->column_count;
+
+    if (!layer->paints_damage || !layer->window || menu_layer->is_reload_scheduled)
+        return false;
+
+    // in a virtual menu the selected row can be a different height
+    if (menu_layer->is_virtual &&
+        (old_index->section >= menu_layer->sections_count ||
+         menu_layer->selected_h != menu_layer->sections[old_index->section].row_h ||
+         menu_layer->selected_h != menu_layer->sections[new_index->section].row_h))
+        return false;
+
+    if (!_get_cell_span(menu_layer, old_index, &spans[0]) || !_get_cell_span(menu_layer, new_index, &spans[1]))
+        return false;
+
+    for (int i = 0; i < 2; i++)
+        window_dirty_rect(layer->window,
+                          layer_convert_rect_to_screen(layer, GRect(spans[i].x, spans[i].y, cell_width, spans[i].h)));
+    return true;
 }
 
 void menu_layer_set_selected_index(MenuLayer *menu_layer, MenuIndex index, MenuRowAlign scroll_align, bool animated)
 {
     if (menu_index_compare(&menu_layer->selected, &index) != 0)
     {
+        MenuIndex old_index = menu_layer->selected;
+
         if (menu_layer->callbacks.selection_will_change != NULL)
             menu_layer->callbacks.selection_will_change(menu_layer, &index, &menu_layer->selected, menu_layer->context);
         menu_layer->selected = index;
 
         if (menu_layer->reload_behaviour == MenuLayerReloadBehaviourOnSelection)
             menu_layer->is_reload_scheduled = true;
+
+        // the selected row may be a different height to the rest
+        if (menu_layer->is_virtual)
+            _menu_layer_set_content_height(menu_layer, _virtual_place_sections(menu_layer));
         
-        _menu_layer_update_scroll_offset(menu_layer, scroll_align, animated);
-        layer_mark_dirty(&menu_layer->layer);
+        if (_menu_layer_update_scroll_offset(menu_layer, scroll_align, animated) ||
+            !_menu_layer_dirty_selection(menu_layer, &old_index, &index))
+            layer_mark_dirty(&menu_layer->layer);
 
         if (menu_layer->callbacks.selection_changed != NULL)
             menu_layer->callbacks.selection_changed(menu_layer, &index, &menu_layer->selected, menu_layer->context);
@@ -217,6 +409,7 @@ void menu_layer_set_center_focused(MenuLayer *menu_layer, bool center_focused)
 {
     if (menu_layer->is_center_focus != center_focused) {
         menu_layer->is_center_focus = center_focused;
+        _menu_layer_update_fast_scroll(menu_layer);
 
         _menu_layer_update_scroll_offset(menu_layer, MenuRowAlignCenter, false);
     }
@@ -234,10 +427,66 @@ void menu_layer_set_callbacks(MenuLayer *menu_layer, void *callback_context, Men
     assert(callbacks.get_num_rows && "'get_num_rows' callback has to be specified");
     menu_layer->callbacks = callbacks;
     menu_layer->context = callback_context;
+    _menu_layer_update_fast_scroll(menu_layer);
 
     menu_layer_reload_data(menu_layer);
 }
 
+void menu_layer_set_virtual(MenuLayer *menu_layer, bool is_virtual)
+{
+    if (menu_layer->is_virtual == is_virtual)
+        return;
+
+    menu_layer->is_virtual = is_virtual;
+    if (menu_layer->cells_capacity > 0)
+        app_free(menu_layer->cells);
+    if (menu_layer->sections_count > 0)
+        app_free(menu_layer->sections);
+    menu_layer->cells_count = 0;
+    menu_layer->cells_capacity = 0;
+    menu_layer->sections_count = 0;
+
+    if (menu_layer->callbacks.get_num_rows)
+        menu_layer_reload_data(menu_layer);
+}
+
+static void _virtual_measure_section(MenuLayer *menu_layer, uint16_t i)
+{
+    MenuSectionSpan *section = &menu_layer->sections[i];
+    section->rows = get_num_rows(menu_layer, i);
+
+    // measure a row that isn't selected, the selected one can be special
+    MenuIndex probe = MenuIndex(i, 0);
+    if (i == menu_layer->selected.section && menu_layer->selected.row == 0 && section->rows > 1)
+        probe.row = 1;
+    section->row_h = section->rows ? _get_cell_height(menu_layer, &probe) : 0;
+}
+
+/* One height callback per section, plus the selection */
+static int16_t _menu_layer_reload_virtual(MenuLayer *menu_layer, uint16_t sections)
+{
+    if (menu_layer->sections_count != sections)
+    {
+        if (menu_layer->sections_count > 0)
+            app_free(menu_layer->sections);
+
+        menu_layer->sections_count = sections;
+        if (sections > 0)
+            menu_layer->sections = (MenuSectionSpan *)app_calloc(sections, sizeof(MenuSectionSpan));
+    }
+
+    for (uint16_t i = 0; i < sections; ++i)
+    {
+        MenuSectionSpan *section = &menu_layer->sections[i];
+        section->header_h = menu_layer->callbacks.get_header_height
+            ? menu_layer->callbacks.get_header_height(menu_layer, i, menu_layer->context)
+            : 0;
+        _virtual_measure_section(menu_layer, i);
+    }
+
+    return _virtual_place_sections(menu_layer);
+}
+
 void menu_layer_reload_data(MenuLayer *menu_layer)
 {
     menu_layer->is_reload_scheduled = false;
@@ -249,6 +498,17 @@ void menu_layer_reload_data(MenuLayer *menu_layer)
     uint16_t last_section = (uint16_t) (sections - 1);
     menu_layer->end_index = MenuIndex(last_section, get_num_rows(menu_layer, last_section));
 
+    if (menu_layer->is_virtual)
+    {
+        GSize size = layer_get_frame(&menu_layer->layer).size;
+        size.h = _menu_layer_reload_virtual(menu_layer, sections);
+        scroll_layer_set_content_size(&menu_layer->scroll_layer, size);
+        _menu_layer_fit_frame(menu_layer, size.h);
+        _menu_layer_update_scroll_offset(menu_layer, MenuRowAlignCenter, false);
+        layer_mark_dirty(&menu_layer->layer);
+        return;
+    }
+
     // count cells
     size_t cells = 0;
     for (uint16_t section = 0; section < sections; ++section)
@@ -259,21 +519,19 @@ void menu_layer_reload_data(MenuLayer *menu_layer)
         cells += menu_layer->callbacks.get_num_rows(menu_layer, section, menu_layer->context);
     }
 
-    // allocate cells array if needed
-    if (menu_layer->cells_count != cells)
+    // allocate cells array if needed; a smaller one fits in what we have
+    if (menu_layer->cells_capacity < cells)
     {
-        if (menu_layer->cells_count > 0)
+        if (menu_layer->cells_capacity > 0)
             app_free(menu_layer->cells);
 
-        menu_layer->cells_count = cells;
-        if (cells > 0)
-           menu_layer->cells = (MenuCellSpan *)app_calloc(cells, sizeof(MenuCellSpan));
+        menu_layer->cells_capacity = cells;
+        menu_layer->cells = (MenuCellSpan *)app_calloc(cells, sizeof(MenuCellSpan));
     }
+    menu_layer->cells_count = cells;
 
     // generate cells
     size_t cell = 0;
-    uint16_t cell_width = menu_layer->layer.frame.size.w / menu_layer->column_count;
-    uint16_t oversized_columns = menu_layer->layer.frame.size.w % menu_layer->column_count;
     int16_t column = 0;
     int16_t y = 0;
     int16_t h = 0;
@@ -293,13 +551,11 @@ void menu_layer_reload_data(MenuLayer *menu_layer)
         for (uint16_t row = 0; row < rows; ++row)
         {
             MenuIndex index = MenuIndex(section, row);
-            int16_t cur_h = menu_layer->callbacks.get_cell_height
-                ? menu_layer->callbacks.get_cell_height(menu_layer, &index, menu_layer->context)
-                : MENU_CELL_BASIC_CELL_HEIGHT;
+            int16_t cur_h = _get_cell_height(menu_layer, &index);
             if (cur_h > h)
                 h = cur_h;
 
-            int16_t x = column * cell_width + (column > 0 && column < oversized_columns);
+            int16_t x = _get_column_x(menu_layer, column);
             menu_layer->cells[cell++] = MenuRow(section, row, x, y, h);
 
             column++;
@@ -323,10 +579,175 @@ void menu_layer_reload_data(MenuLayer *menu_layer)
     GSize size = layer_get_frame(&menu_layer->layer).size;
     size.h = y + (column == 0 ? 0 : h);
     scroll_layer_set_content_size(&menu_layer->scroll_layer, size);
+    _menu_layer_fit_frame(menu_layer, size.h);
+    _menu_layer_update_scroll_offset(menu_layer, MenuRowAlignCenter, false);
+    layer_mark_dirty(&menu_layer->layer);
+}
+
+// Partial reloads -------------
+//
+// These patch the layout when rows change, rather than measuring
+// everything again. The callbacks must already return the new data.
+// Grids reflow on any change, so multi column menus reload in full.
+
+static void _menu_layer_rows_changed(MenuLayer *menu_layer, uint16_t section)
+{
+    if (section == menu_layer->end_index.section)
+        menu_layer->end_index.row = get_num_rows(menu_layer, section);
+
+    if (menu_layer->is_virtual)
+        _menu_layer_set_content_height(menu_layer, _virtual_place_sections(menu_layer));
+
     _menu_layer_update_scroll_offset(menu_layer, MenuRowAlignCenter, false);
     layer_mark_dirty(&menu_layer->layer);
 }
 
+/* Move everything from cell on by dy, renumbering rows of section by drow */
+static void _cells_shift(MenuLayer *menu_layer, size_t cell, uint16_t section, int16_t drow, int16_t dy)
+{
+    for (; cell < menu_layer->cells_count; ++cell)
+    {
+        MenuCellSpan *span = &menu_layer->cells[cell];
+        if (span->index.section == section && !span->header)
+            span->index.row += drow;
+        span->y += dy;
+    }
+}
+
+void menu_layer_reload_rows(MenuLayer *menu_layer, uint16_t section, uint16_t first_row, uint16_t count)
+{
+    if (menu_layer->is_virtual)
+    {
+        _virtual_measure_section(menu_layer, section);
+        _menu_layer_rows_changed(menu_layer, section);
+        return;
+    }
+
+    if (menu_layer->column_count > 1)
+    {
+        menu_layer_reload_data(menu_layer);
+        return;
+    }
+
+    size_t cell = _cell_position(menu_layer, section, first_row);
+    int16_t dy = 0;
+
+    for (; count && cell < menu_layer->cells_count; --count, ++cell)
+    {
+        MenuCellSpan *span = &menu_layer->cells[cell];
+        if (span->header || span->index.section != section)
+            break;
+
+        int16_t h = _get_cell_height(menu_layer, &span->index);
+        span->y += dy;
+        dy += h - span->h;
+        span->h = h;
+    }
+
+    if (dy)
+    {
+        _cells_shift(menu_layer, cell, section, 0, dy);
+        _menu_layer_set_content_height(menu_layer, scroll_layer_get_content_size(&menu_layer->scroll_layer).h + dy);
+    }
+
+    _menu_layer_rows_changed(menu_layer, section);
+}
+
+void menu_layer_insert_rows(MenuLayer *menu_layer, uint16_t section, uint16_t first_row, uint16_t count)
+{
+    // keep the same row selected
+    if (menu_layer->selected.section == section && menu_layer->selected.row >= first_row)
+        menu_layer->selected.row += count;
+
+    if (menu_layer->is_virtual)
+    {
+        if (!menu_layer->sections[section].row_h)
+            _virtual_measure_section(menu_layer, section);
+        else
+            menu_layer->sections[section].rows += count;
+        _menu_layer_rows_changed(menu_layer, section);
+        return;
+    }
+
+    if (menu_layer->column_count > 1 || !count)
+    {
+        menu_layer_reload_data(menu_layer);
+        return;
+    }
+
+    size_t cell = _cell_position(menu_layer, section, first_row);
+    int16_t y = cell ? menu_layer->cells[cell - 1].y + menu_layer->cells[cell - 1].h : 0;
+
+    if (menu_layer->cells_count + count > menu_layer->cells_capacity)
+    {
+        menu_layer->cells_capacity = menu_layer->cells_count + count;
+        menu_layer->cells = (MenuCellSpan *)app_realloc(menu_layer->cells, menu_layer->cells_capacity * sizeof(MenuCellSpan));
+    }
+    memmove(&menu_layer->cells[cell + count], &menu_layer->cells[cell],
+            (menu_layer->cells_count - cell) * sizeof(MenuCellSpan));
+    menu_layer->cells_count += count;
+
+    int16_t dy = 0;
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        MenuIndex index = MenuIndex(section, first_row + i);
+        int16_t h = _get_cell_height(menu_layer, &index);
+        menu_layer->cells[cell + i] = MenuRow(section, first_row + i, 0, y + dy, h);
+        dy += h;
+    }
+
+    _cells_shift(menu_layer, cell + count, section, count, dy);
+    _menu_layer_set_content_height(menu_layer, scroll_layer_get_content_size(&menu_layer->scroll_layer).h + dy);
+    _menu_layer_rows_changed(menu_layer, section);
+}
+
+void menu_layer_delete_rows(MenuLayer *menu_layer, uint16_t section, uint16_t first_row, uint16_t count)
+{
+    MenuIndex *selected = &menu_layer->selected;
+    if (selected->section == section && selected->row >= first_row)
+        selected->row = selected->row >= first_row + count ? selected->row - count : first_row;
+
+    if (menu_layer->is_virtual)
+    {
+        MenuSectionSpan *sect = &menu_layer->sections[section];
+        sect->rows -= MIN(count, sect->rows - MIN(first_row, sect->rows));
+        if (selected->section == section && selected->row >= sect->rows && sect->rows)
+            selected->row = sect->rows - 1;
+        _menu_layer_rows_changed(menu_layer, section);
+        return;
+    }
+
+    if (menu_layer->column_count > 1)
+    {
+        menu_layer_reload_data(menu_layer);
+        return;
+    }
+
+    size_t cell = _cell_position(menu_layer, section, first_row);
+    size_t end = cell;
+    int16_t dy = 0;
+
+    while (end < menu_layer->cells_count && end - cell < count &&
+           !menu_layer->cells[end].header && menu_layer->cells[end].index.section == section)
+        dy -= menu_layer->cells[end++].h;
+
+    memmove(&menu_layer->cells[cell], &menu_layer->cells[end],
+            (menu_layer->cells_count - end) * sizeof(MenuCellSpan));
+    menu_layer->cells_count -= end - cell;
+
+    _cells_shift(menu_layer, cell, section, -(int16_t)(end - cell), dy);
+
+    // don't leave the selection past the end of its section
+    if (selected->section == section && selected->row > 0 &&
+        (cell >= menu_layer->cells_count || menu_layer->cells[cell].header ||
+         menu_layer->cells[cell].index.section != section) &&
+        selected->row == first_row)
+        selected->row--;
+
+    _menu_layer_set_content_height(menu_layer, scroll_layer_get_content_size(&menu_layer->scroll_layer).h + dy);
+    _menu_layer_rows_changed(menu_layer, section);
+}
+
 // Input handling -------------
 
 void menu_layer_set_click_config_provider(MenuLayer *menu_layer, ClickConfigProvider provider)
@@ -390,6 +811,7 @@ void menu_layer_set_normal_colors(MenuLayer *menu_layer, GColor background, GCol
 {
     menu_layer->bg_color = background;
     menu_layer->fg_color = foreground;
+    _menu_layer_update_fast_scroll(menu_layer);
     layer_mark_dirty(&menu_layer->layer);
 }
 
@@ -437,21 +859,123 @@ static void menu_layer_draw_cell(GContext *context, const MenuLayer *menu_layer,
     // TODO: draw separator
 }
 
+/* damage is what we were asked to paint, in screen coordinates */
+static void menu_layer_draw_span(GContext *context, const MenuLayer *menu_layer,
+                                 MenuCellSpan *span, Layer *layer, GRect frame, uint16_t cell_width,
+                                 GRect damage)
+{
+    layer->callback_data = span;
+    layer->frame = GRect(span->x, span->y, (span->header ? frame.size.w : cell_width), span->h);
+    // TODO: update bounds
+
+    GRect offset = context->offset;
+    layer_apply_frame_offset(layer, context);
+
+    GRect screen = GRect(context->offset.origin.x, context->offset.origin.y, layer->frame.size.w, layer->frame.size.h);
+    if (menu_layer->layer.paints_damage && !RECT_CONTAINS(damage, screen))
+    {
+        // cells are painted whole, so the rest of its background is ours too
+        if (!menu_layer->callbacks.draw_background)
+        {
+            graphics_context_set_fill_color(context, menu_layer->bg_color);
+            graphics_fill_rect(context, GRect(0, 0, layer->frame.size.w, layer->frame.size.h), 0, GCornerNone);
+        }
+        layer_draw_add_damage(screen);
+    }
+
+    menu_layer_draw_cell(context, menu_layer, span, layer);
+
+    context->offset = offset;
+    layer->frame = frame;
+}
+
+/* Draw the rows of a virtual menu that are between top and bottom */
+static void menu_layer_draw_virtual(GContext *context, MenuLayer *menu_layer, Layer *layer,
+                                    GRect frame, uint16_t cell_width, int16_t top, int16_t bottom,
+                                    GRect damage)
+{
+    for (uint16_t i = 0; i < menu_layer->sections_count; ++i)
+    {
+        MenuSectionSpan *section = &menu_layer->sections[i];
+        uint16_t lines = _section_lines(menu_layer, section);
+        int16_t extra = (i == menu_layer->selected.section) ? menu_layer->selected_h - section->row_h : 0;
+        int16_t section_bottom = section->y + section->header_h + lines * section->row_h + extra;
+
+        if (section->y >= bottom)
+            break;
+        if (section_bottom <= top)
+            continue;
+
+        if (menu_layer->callbacks.get_header_height && section->y + section->header_h > top)
+        {
+            MenuCellSpan span = MenuHeader(i, 0, section->y, section->header_h);
+            menu_layer_draw_span(context, menu_layer, &span, layer, frame, cell_width, damage);
+        }
+
+        // jump straight to the first line that could be on screen
+        int16_t rows_top = section->y + section->header_h;
+        uint16_t line = 0;
+        int16_t skip = top - rows_top - (extra < 0 ? -extra : extra);
+        if (section->row_h > 0 && skip > section->row_h)
+            line = skip / section->row_h - 1;
+
+        for (; line < lines; ++line)
+        {
+            uint16_t row = line * menu_layer->column_count;
+            MenuIndex index = MenuIndex(i, row);
+            MenuCellSpan span;
+            _virtual_cell_span(menu_layer, &index, &span);
+
+            if (span.y >= bottom)
+                break;
+            if (span.y + span.h <= top)
+                continue;
+
+            for (; row < section->rows && row < (line + 1) * menu_layer->column_count; ++row)
+            {
+                index.row = row;
+                _virtual_cell_span(menu_layer, &index, &span);
+                menu_layer_draw_span(context, menu_layer, &span, layer, frame, cell_width, damage);
+            }
+        }
+    }
+}
+
 static void menu_layer_update_proc(Layer *layer, GContext *nGContext)
 {
     MenuLayer *menu_layer = (MenuLayer *) layer->container;
-    GRect frame = layer_get_frame(layer);
-    uint16_t cell_width = frame.size.w / menu_layer->column_count;
 
     if (menu_layer->is_reload_scheduled || menu_layer->reload_behaviour == MenuLayerReloadBehaviourOnRender)
         menu_layer_reload_data(menu_layer);
+
+    GRect frame = layer_get_frame(layer);
+    uint16_t cell_width = frame.size.w / menu_layer->column_count;
+    GSize view = layer_get_frame(&menu_layer->scroll_layer.layer).size;
+    GPoint content_offset = scroll_layer_get_content_offset(&menu_layer->scroll_layer);
+
+    // Only what's near the visible part of the scroll layer gets drawn,
+    // and if we can keep to the damage, only what's in that
+    int16_t top = -content_offset.y - MENU_DRAW_MARGIN;
+    int16_t bottom = top + view.h + 2 * MENU_DRAW_MARGIN;
+    GRect damage = layer_draw_get_damage();
+    GRect fill = frame;
+
+    if (layer->paints_damage)
+    {
+        int16_t damage_top = damage.origin.y - nGContext->offset.origin.y;
+        top = MAX(top, damage_top);
+        bottom = MIN(bottom, damage_top + damage.size.h);
+        fill = GRect(0, top, frame.size.w, MAX(0, bottom - top));
+    }
     
     // Draw background
     if (menu_layer->is_center_focus)
     {
         GPoint scroll_offset = scroll_layer_get_content_offset(&menu_layer->scroll_layer);
-        MenuCellSpan* focused_cell = _get_cell_span(menu_layer, &menu_layer->selected);
-        GRect cursor_rect = GRect(focused_cell->x, (layer->frame.size.h / 2) - (focused_cell->h / 2) - scroll_offset.y,
+        MenuCellSpan focused_span = { 0 };
+        _get_cell_span(menu_layer, &menu_layer->selected, &focused_span);
+        MenuCellSpan* focused_cell = &focused_span;
+        GRect cursor_rect = GRect(focused_cell->x, (view.h / 2) - (focused_cell->h / 2) - scroll_offset.y,
                                   cell_width, focused_cell->h);
 
         graphics_context_set_fill_color(nGContext, menu_layer->bg_color);
@@ -472,24 +996,24 @@ static void menu_layer_update_proc(Layer *layer, GContext *nGContext)
         graphics_fill_rect(nGContext, cursor_rect, 0, GCornerNone);
     } else if (!menu_layer->callbacks.draw_background) {
         graphics_context_set_fill_color(nGContext, menu_layer->bg_color);
-        graphics_fill_rect(nGContext, frame, 0, GCornerNone);
+        graphics_fill_rect(nGContext, fill, 0, GCornerNone);
     }
 
     // Draw cells
-    for (size_t cell = 0; cell < menu_layer->cells_count; ++cell)
+    if (menu_layer->is_virtual)
     {
-        // TODO: only draw visible cells based on layer frame/bounds
-        MenuCellSpan *span = menu_layer->cells + cell;
-        layer->callback_data = span;
-        layer->frame = GRect(span->x, span->y, (span->header ? frame.size.w : cell_width), span->h);
-        // TODO: update bounds
-
-        GRect offset = nGContext->offset;
-        layer_apply_frame_offset(layer, nGContext);
-
-        menu_layer_draw_cell(nGContext, menu_layer, span, layer);
+        menu_layer_draw_virtual(nGContext, menu_layer, layer, frame, cell_width, top, bottom, damage);
+    }
+    else
+    {
+        for (size_t cell = 0; cell < menu_layer->cells_count; ++cell)
+        {
+            MenuCellSpan *span = menu_layer->cells + cell;
+            if (span->y >= bottom || span->y + span->h <= top)
+                continue;
 
-        nGContext->offset = offset;
+            menu_layer_draw_span(nGContext, menu_layer, span, layer, frame, cell_width, damage);
+        }
     }
 
     layer->frame = frame;
@@ -42,6 +42,16 @@ typedef struct MenuCellSpan
   MenuIndex index;
 } MenuCellSpan;
 
+//! Where a section sits when the \ref MenuLayer is virtual. Rows are not stored,
+//! they are worked out from this when needed.
+typedef struct MenuSectionSpan
+{
+  int16_t y;
+  int16_t header_h;
+  int16_t row_h;
+  uint16_t rows;
+} MenuSectionSpan;
+
 struct MenuLayer;
 
 typedef uint16_t (*MenuLayerGetNumberOfSectionsCallback)(struct MenuLayer *menu_layer, void *context);
@@ -109,7 +119,11 @@ typedef struct MenuLayer
 
   uint16_t column_count;
   size_t cells_count;
+  size_t cells_capacity; /* kept across reloads, so a menu changing level doesn't reallocate */
   MenuCellSpan *cells;
+  size_t sections_count;
+  MenuSectionSpan *sections;
+  int16_t selected_h;
   MenuIndex selected;
   MenuIndex end_index;
 
@@ -121,6 +135,7 @@ typedef struct MenuLayer
   bool is_center_focus;
   bool is_bottom_padding_enabled;
   bool is_reload_scheduled;
+  bool is_virtual;
 } MenuLayer;
 
 void menu_layer_ctor(MenuLayer *mlayer, GRect frame);
@@ -158,6 +173,18 @@ MenuIndex menu_layer_get_selected_index(const MenuLayer *menu_layer);
 
 void menu_layer_reload_data(MenuLayer *menu_layer);
 
+//! Measures `count` rows from `first_row` of `section` again, moving the rows after
+//! them to fit, rather than reloading the whole menu.
+void menu_layer_reload_rows(MenuLayer *menu_layer, uint16_t section, uint16_t first_row, uint16_t count);
+
+//! Tells the \ref MenuLayer that `count` rows were added to `section` at `first_row`.
+//! The callbacks must already report them. The selected row stays selected.
+void menu_layer_insert_rows(MenuLayer *menu_layer, uint16_t section, uint16_t first_row, uint16_t count);
+
+//! Tells the \ref MenuLayer that `count` rows were removed from `section` at `first_row`.
+//! The callbacks must already have stopped reporting them.
+void menu_layer_delete_rows(MenuLayer *menu_layer, uint16_t section, uint16_t first_row, uint16_t count);
+
 bool menu_cell_layer_is_highlighted(const Layer *layer);
 
 void menu_layer_set_normal_colors(MenuLayer *menu_layer, GColor background, GColor foreground);
@@ -180,6 +207,14 @@ bool menu_layer_is_index_selected(const MenuLayer *menu_layer, MenuIndex *index)
 //! @param num_columns The count of columns to set for the \ref MenuLayer.
 void menu_layer_set_column_count(MenuLayer *menu_layer, uint16_t num_columns);
 
+//! Makes the \ref MenuLayer virtual, for menus with a lot of rows. Rather than asking
+//! for and keeping the position of every cell, every row of a section is taken to be
+//! as tall as its first unselected row, and only the selected row is asked for its own
+//! height. Reloads then cost one callback per section, and only cells on screen are drawn.
+//! @param menu_layer Pointer to the \ref MenuLayer to change.
+//! @param is_virtual Whether the rows of each section can be assumed to be the same height.
+void menu_layer_set_virtual(MenuLayer *menu_layer, bool is_virtual);
+
 //! Sets the reload behaviour for the \ref MenuLayer. This mode decides when the menu
 //! data is reloaded via the \ref MenuLayerCallbacks.
 //! @param menu_layer Pointer to the \ref MenuLayer for which to set the reload behaviour.
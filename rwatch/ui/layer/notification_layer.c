@@ -12,12 +12,53 @@
 #include "property_animation.h"
 #include "librebble.h"
 #include "ngfxwrap.h"
+#include "display.h"
 
 static void _notification_layer_load(Window *window);
 static void _notification_layer_unload(Window *window);
 static void _notification_layer_update_proc(Layer *layer, GContext *ctx);
 static void _click_config_provider(void *context);
 
+/*
+ * The active notification's content, kept as it was drawn, so scrolling
+ * through it is a copy instead of laying out and drawing the title and
+ * body again every step. Rows are taken from the framebuffer the first
+ * time they are drawn, so the cache fills in as the notification is read.
+ * Most rows are text on white: a row of one or two colours keeps a bit a
+ * pixel, and only the header and icon rows are kept whole.
+ * Rows that don't fit the budget are drawn live, as is any draw not at
+ * the top left of the screen (a window sliding in). Round screens clip to
+ * the glass where a row is drawn, not where it scrolls to, so they, and
+ * the 1 bit displays, always draw live.
+ */
+#if !defined(PBL_BW) && !defined(PBL_ROUND)
+#define NOTIFICATION_CACHE
+#endif
+
+#ifdef NOTIFICATION_CACHE
+
+/* content rows the scroll can bring on screen */
+#define NOTIFICATION_CACHE_ROWS (DISPLAY_ROWS * 2)
+/* this comes out of the overlay's heap */
+#define NOTIFICATION_CACHE_BYTES 6144
+#define NOTIFICATION_ROW_NONE 0xFFFF
+#define NOTIFICATION_ROW_BITS ((DISPLAY_COLS + 7) / 8)
+
+typedef enum {
+    NotificationRowSolid,      /* one colour */
+    NotificationRowTwoColour,  /* colour for set bits, colour for clear, then the bits MSB first */
+    NotificationRowRaw,        /* DISPLAY_COLS pixels */
+} NotificationRowKind;
+
+typedef struct NotificationCache {
+    const Notification *notification;
+    uint16_t used;
+    uint16_t row[NOTIFICATION_CACHE_ROWS]; /* into data, or NOTIFICATION_ROW_NONE */
+    uint8_t data[NOTIFICATION_CACHE_BYTES];
+} NotificationCache;
+
+#endif
+
 static void notification_layer_ctor(NotificationLayer *notification_layer, GRect frame)
 {
     layer_ctor(&notification_layer->layer, frame);
@@ -41,6 +82,9 @@ static void notification_layer_dtor(NotificationLayer *notification_layer)
         break;
     }
 
+    if (notification_layer->cache)
+        app_free(notification_layer->cache);
+
     layer_remove_from_parent(&notification_layer->status_bar.layer);
     status_bar_layer_dtor(&notification_layer->status_bar);
     layer_dtor(&notification_layer->layer);
@@ -74,7 +118,8 @@ NotificationLayer *notification_layer_create(GRect frame)
     notification_layer_ctor(notification_layer, frame);
     
     status_bar_layer_ctor(&notification_layer->status_bar);
-    status_bar_layer_set_colors(&notification_layer->status_bar, notification_layer->active->color, GColorBlack);
+    /* nothing is active yet. Pushing one sets its colours */
+    status_bar_layer_set_colors(&notification_layer->status_bar, GColorBlack, GColorWhite);
     layer_add_child(&notification_layer->layer, status_bar_layer_get_layer(&notification_layer->status_bar));
     
 #ifdef PBL_RECT
@@ -323,13 +368,137 @@ static void _click_config_provider(void *context)
     window_set_click_context(BUTTON_ID_BACK, context);
 }
 
-static void _notification_layer_update_proc(Layer *layer, GContext *ctx)
+#ifdef NOTIFICATION_CACHE
+
+/* The cache of the active notification, NULL if this draw can't use it */
+static NotificationCache *_cache_get(NotificationLayer *notification_layer, GContext *ctx)
+{
+    if (ctx->offset.origin.x || ctx->offset.origin.y)
+        return NULL;
+    if (notification_layer->offset > NOTIFICATION_CACHE_ROWS - DISPLAY_ROWS)
+        return NULL;
+
+    NotificationCache *cache = notification_layer->cache;
+    if (!cache)
+    {
+        if (notification_layer->cache_failed)
+            return NULL;
+
+        cache = notification_layer->cache = app_malloc(sizeof(NotificationCache));
+        if (!cache)
+        {
+            SYS_LOG("notification_layer", APP_LOG_LEVEL_INFO, "No memory to cache, drawing live");
+            notification_layer->cache_failed = true;
+            return NULL;
+        }
+        cache->notification = NULL;
+    }
+
+    if (cache->notification != notification_layer->active)
+    {
+        cache->notification = notification_layer->active;
+        cache->used = 0;
+        memset(cache->row, 0xFF, sizeof(cache->row));
+    }
+
+    return cache;
+}
+
+/* Put the rows on screen back from the cache, if it has them all */
+static bool _cache_draw(NotificationCache *cache, uint16_t offset)
+{
+    for (int16_t y = 0; y < DISPLAY_ROWS; y++)
+        if (cache->row[offset + y] == NOTIFICATION_ROW_NONE)
+            return false;
+
+    uint8_t *fb = display_get_buffer();
+    for (int16_t y = 0; y < DISPLAY_ROWS; y++, fb += DISPLAY_COLS)
+    {
+        const uint8_t *src = cache->data + cache->row[offset + y];
+
+        if (src[0] == NotificationRowSolid)
+        {
+            memset(fb, src[1], DISPLAY_COLS);
+        }
+        else if (src[0] == NotificationRowTwoColour)
+        {
+            const uint8_t *bits = src + 3;
+            for (int16_t x = 0; x < DISPLAY_COLS; x++)
+                fb[x] = (bits[x >> 3] & (0x80 >> (x & 7))) ? src[1] : src[2];
+        }
+        else
+        {
+            memcpy(fb, src + 1, DISPLAY_COLS);
+        }
+    }
+
+    return true;
+}
+
+/* Keep the rows just drawn that the cache hasn't got, while there's room */
+static void _cache_capture(NotificationCache *cache, uint16_t offset)
+{
+    const uint8_t *fb = display_get_buffer();
+
+    for (int16_t y = 0; y < DISPLAY_ROWS; y++, fb += DISPLAY_COLS)
+    {
+        uint16_t r = offset + y;
+        if (cache->row[r] != NOTIFICATION_ROW_NONE)
+            continue;
+
+        uint8_t a = fb[0], b = fb[0];
+        NotificationRowKind kind = NotificationRowSolid;
+        for (int16_t x = 1; x < DISPLAY_COLS; x++)
+        {
+            if (fb[x] == a || fb[x] == b)
+                continue;
+            if (a != b)
+            {
+                kind = NotificationRowRaw;
+                break;
+            }
+            b = fb[x];
+            kind = NotificationRowTwoColour;
+        }
+
+        uint16_t len = kind == NotificationRowSolid ? 2 :
+                       kind == NotificationRowTwoColour ? 3 + NOTIFICATION_ROW_BITS :
+                       1 + DISPLAY_COLS;
+        /* a smaller row further down might still fit */
+        if (cache->used + len > NOTIFICATION_CACHE_BYTES)
+            continue;
+
+        uint8_t *dst = cache->data + cache->used;
+        dst[0] = kind;
+        if (kind == NotificationRowSolid)
+        {
+            dst[1] = a;
+        }
+        else if (kind == NotificationRowTwoColour)
+        {
+            dst[1] = a;
+            dst[2] = b;
+            memset(dst + 3, 0, NOTIFICATION_ROW_BITS);
+            for (int16_t x = 0; x < DISPLAY_COLS; x++)
+                if (fb[x] == a)
+                    dst[3 + (x >> 3)] |= 0x80 >> (x & 7);
+        }
+        else
+        {
+            memcpy(dst + 1, fb, DISPLAY_COLS);
+        }
+
+        cache->row[r] = cache->used;
+        cache->used += len;
+    }
+}
+
+#endif
+
+/* Everything that scrolls: the header, icon, app, title and body */
+static void _notification_draw_content(Layer *layer, GContext *ctx, NotificationLayer *notification_layer)
 {
-    NotificationLayer *notification_layer = container_of(layer, NotificationLayer, layer);
-    assert(notification_layer);
     Notification *notification = notification_layer->active;
-    if (!notification)
-        return;
     int offset = -STATUS_BAR_LAYER_HEIGHT + notification_layer->offset; // offset for the status_bar
     GRect bounds = layer_get_unobstructed_bounds(layer);
     
@@ -391,6 +560,27 @@ static void _notification_layer_update_proc(Layer *layer, GContext *ctx)
     
     // Draw the body:
     graphics_draw_text(ctx, body, fonts_get_system_font(FONT_KEY_GOTHIC_24), body_rect, GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
+}
+
+static void _notification_layer_update_proc(Layer *layer, GContext *ctx)
+{
+    NotificationLayer *notification_layer = container_of(layer, NotificationLayer, layer);
+    assert(notification_layer);
+    Notification *notification = notification_layer->active;
+    if (!notification)
+        return;
+
+#ifdef NOTIFICATION_CACHE
+    NotificationCache *cache = _cache_get(notification_layer, ctx);
+    if (!cache || !_cache_draw(cache, notification_layer->offset))
+    {
+        _notification_draw_content(layer, ctx, notification_layer);
+        if (cache)
+            _cache_capture(cache, notification_layer->offset);
+    }
+#else
+    _notification_draw_content(layer, ctx, notification_layer);
+#endif
     
     // Draw the indicator:
     graphics_context_set_fill_color(ctx, GColorBlack);
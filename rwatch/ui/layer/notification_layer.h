@@ -47,6 +47,9 @@ typedef struct NotificationLayer
     uint8_t notif_count;
     uint8_t selected_notif;
     list_head notif_list_head;
+
+    struct NotificationCache *cache; /* the active notification as drawn */
+    bool cache_failed;
 } NotificationLayer;
 
 Notification* notification_create(const char *app_name, const char *title, const char *body, GBitmap *icon, GColor color);
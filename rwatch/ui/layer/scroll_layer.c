@@ -34,7 +34,7 @@ void scroll_layer_dtor(ScrollLayer* slayer)
 
 ScrollLayer *scroll_layer_create(GRect frame)
 {
-    ScrollLayer* slayer = app_calloc(1, sizeof(ScrollLayer));
+    ScrollLayer* slayer = app_pool_calloc(sizeof(ScrollLayer));
     scroll_layer_ctor(slayer, frame);
 
     return slayer;
@@ -103,6 +103,63 @@ void scroll_layer_set_context(ScrollLayer *scroll_layer, void *context)
     scroll_layer->context = context ? context : scroll_layer;
 }
 
+/*
+ * Each step of a scroll. Where we can, the pixels already on screen are
+ * moved and only the strip scrolled into view is drawn, rather than
+ * repainting the whole view every step.
+ */
+static void _scroll_layer_set_content_frame(ScrollLayer *scroll_layer, GRect frame)
+{
+    Layer *content = &scroll_layer->content_sublayer;
+    GRect current = content->frame;
+    int16_t dy = frame.origin.y - current.origin.y;
+
+    if (scroll_layer->is_fast_scroll && dy && content->window &&
+        frame.origin.x == current.origin.x && SIZE_EQ(frame.size, current.size))
+    {
+        GSize view = layer_get_frame(&scroll_layer->layer).size;
+        GRect rect = layer_convert_rect_to_screen(&scroll_layer->layer, GRect(0, 0, view.w, view.h));
+
+        if (window_scroll_region(content->window, content, rect, dy))
+        {
+            content->frame = frame;
+            return;
+        }
+    }
+
+    layer_set_frame(content, frame);
+}
+
+static GRect _scroll_layer_get_content_frame(ScrollLayer *scroll_layer)
+{
+    return layer_get_frame(&scroll_layer->content_sublayer);
+}
+
+static void _scroll_layer_animation_teardown(Animation *animation)
+{
+    property_animation_destroy((PropertyAnimation *)animation);
+}
+
+static const PropertyAnimationImplementation _scroll_impl = {
+    .base = {
+        .update = (AnimationUpdateImplementation) property_animation_update_grect,
+        .teardown = (AnimationTeardownImplementation) _scroll_layer_animation_teardown,
+    },
+    .accessors = {
+        .setter = { .grect = (GRectSetter) _scroll_layer_set_content_frame },
+        .getter = { .grect = (GRectGetter) _scroll_layer_get_content_frame },
+    },
+};
+
+/*
+ * Let scrolling move what's on screen instead of repainting it. Only
+ * for content that paints the whole of the scroll layer's frame solid.
+ */
+void scroll_layer_set_fast_scroll(ScrollLayer *scroll_layer, bool enabled)
+{
+    scroll_layer->is_fast_scroll = enabled;
+}
+
 void scroll_layer_set_content_offset(ScrollLayer *scroll_layer, GPoint offset, bool animated)
 {
     GSize slayer_size = layer_get_frame(&scroll_layer->layer).size;
@@ -114,7 +171,7 @@ void scroll_layer_set_content_offset(ScrollLayer *scroll_layer, GPoint offset, b
                                  frame.size.w,
                                  frame.size.h);
     
-    scroll_layer->animation = property_animation_create_layer_frame(&scroll_layer->content_sublayer, &scroll_layer->prev_scroll_offset, &scroll_layer->scroll_offset);
+    scroll_layer->animation = property_animation_create(&_scroll_impl, scroll_layer, &scroll_layer->prev_scroll_offset, &scroll_layer->scroll_offset);
     Animation *anim = property_animation_get_animation(scroll_layer->animation);
     animation_set_duration(anim, 100);
     animation_schedule(anim);
@@ -32,6 +32,7 @@ typedef struct ScrollLayer
     GRect scroll_offset;
     ScrollLayerCallbacks callbacks;
     void *context;
+    bool is_fast_scroll; /* content paints the whole view solid, so scrolling can shift pixels */
 } ScrollLayer;
 
 void scroll_layer_ctor(ScrollLayer* slayer, GRect frame);
@@ -50,6 +51,7 @@ GPoint scroll_layer_get_content_offset(ScrollLayer *scroll_layer);
 void scroll_layer_set_content_size(ScrollLayer *scroll_layer, GSize size);
 GSize scroll_layer_get_content_size(const ScrollLayer *scroll_layer);
 void scroll_layer_set_frame(ScrollLayer *scroll_layer, GRect frame);
+void scroll_layer_set_fast_scroll(ScrollLayer *scroll_layer, bool enabled);
 void scroll_layer_scroll_up_click_handler(ClickRecognizerRef recognizer, void *context);
 void scroll_layer_scroll_down_click_handler(ClickRecognizerRef recognizer, void *context);
 void scroll_layer_set_shadow_hidden(ScrollLayer *scroll_layer, bool hidden);
@@ -9,23 +9,80 @@
 #include "node_list.h"
 #include "status_bar_layer.h"
 #include "appmanager.h"
+#include "glyph_cache.h"
+#include "utils.h"
+
+/* the text sits in the bottom this many rows of the bar */
+#define STATUS_BAR_TEXT_HEIGHT 18
+/* slack either side of the measured clock, for the text drawer's rounding */
+#define STATUS_BAR_CLOCK_SLACK 2
 
 static void _draw(Layer *layer, GContext *context);
 
-static void _schedule_timer(StatusBarLayer* status_bar)
+static GRect _text_frame(StatusBarLayer *status_bar)
 {
-    TickType_t delay = pdMS_TO_TICKS(1000 * (60 - status_bar->last_time.tm_sec));
-    status_bar->timer.when = xTaskGetTickCount() + delay;
-    appmanager_timer_add(&status_bar->timer);
+    GRect frame = layer_get_frame(&status_bar->layer);
+
+    return GRect(0, frame.size.h - STATUS_BAR_TEXT_HEIGHT, frame.size.w, STATUS_BAR_TEXT_HEIGHT);
 }
 
-static void _timer_callback(CoreTimer* timer) {
-    StatusBarLayer* status_bar = container_of(timer, StatusBarLayer, timer);
+/*
+ * Format the clock, and work out where it lands in the bar so a new
+ * minute only has to repaint that. If the font can't be measured, the
+ * whole text row it is. False if the text came out the same
+ */
+static bool _format_clock(StatusBarLayer *status_bar, TimeUnits units)
+{
+    GFont font = fonts_get_system_font(FONT_KEY_GOTHIC_14);
+    GRect text_frame = _text_frame(status_bar);
+    const GlyphAscii *ascii;
+    const char *p = status_bar->clock.text;
+    int16_t width = 0;
 
-    memcpy(&status_bar->last_time, rebble_time_get_tm(), sizeof(struct tm));
-    layer_mark_dirty(&status_bar->layer);
+    if (!clock_format_cached(&status_bar->clock, &status_bar->last_time, units, NULL))
+        return false;
 
-    _schedule_timer(status_bar);
+    ascii = glyph_cache_ascii_begin(font);
+    while (*p)
+    {
+        int16_t adv = glyph_cache_ascii_advance(ascii, font, glyph_cache_next(&p));
+        if (adv < 0)
+        {
+            width = -1;
+            break;
+        }
+        width += adv;
+    }
+    glyph_cache_ascii_end(ascii);
+
+    status_bar->clock_rect = text_frame;
+    if (width >= 0 && width + 2 * STATUS_BAR_CLOCK_SLACK < text_frame.size.w)
+    {
+        width += 2 * STATUS_BAR_CLOCK_SLACK;
+        status_bar->clock_rect.origin.x = (text_frame.size.w - width) / 2;
+        status_bar->clock_rect.size.w = width;
+    }
+    return true;
+}
+
+static void _tick(TickListener *listener, struct tm *tick_time, TimeUnits units)
+{
+    StatusBarLayer* status_bar = container_of(listener, StatusBarLayer, tick);
+    GRect old_rect = status_bar->clock_rect;
+
+    memcpy(&status_bar->last_time, tick_time, sizeof(struct tm));
+    if (!_format_clock(status_bar, units) || status_bar->text)
+        return;
+
+    // only the clock changed, so only it needs repainting
+    Window *window = layer_get_window(&status_bar->layer);
+    if (!window)
+    {
+        layer_mark_dirty(&status_bar->layer);
+        return;
+    }
+    window_dirty_rect(window, layer_convert_rect_to_screen(&status_bar->layer,
+                                                           rect_union(old_rect, status_bar->clock_rect)));
 }
 
 void status_bar_layer_ctor(StatusBarLayer *status_bar)
@@ -33,26 +90,31 @@ void status_bar_layer_ctor(StatusBarLayer *status_bar)
     GRect frame = GRect(0, 0, DISPLAY_COLS, STATUS_BAR_LAYER_HEIGHT);
     layer_ctor(&status_bar->layer, frame);
     layer_set_update_proc(&status_bar->layer, _draw);
+    status_bar->layer.paints_damage = true;
     layer_mark_dirty(&status_bar->layer);
 
     status_bar->background_color = GColorBlack;
     status_bar->foreground_color = GColorWhite;
     status_bar->separator_mode = StatusBarLayerSeparatorModeNone;
     status_bar->text = NULL;
-    status_bar->timer.callback = _timer_callback;
+    status_bar->tick.units = MINUTE_UNIT;
+    status_bar->tick.callback = _tick;
 
     memcpy(&status_bar->last_time, rebble_time_get_tm(), sizeof(struct tm));
-    _schedule_timer(status_bar);
+    clock_format_init(&status_bar->clock, "%R");
+    _format_clock(status_bar, 0);
+    tick_listener_subscribe(&status_bar->tick);
 }
 
 void status_bar_layer_dtor(StatusBarLayer *sblayer)
 {
+    tick_listener_unsubscribe(&sblayer->tick);
     layer_dtor(&sblayer->layer);
 }
 
 StatusBarLayer *status_bar_layer_create(void)
 {
-    StatusBarLayer *status_bar = (StatusBarLayer*)app_calloc(1, sizeof(StatusBarLayer));    
+    StatusBarLayer *status_bar = (StatusBarLayer*)app_pool_calloc(sizeof(StatusBarLayer));    
     status_bar_layer_ctor(status_bar);
     
     return status_bar;
@@ -108,31 +170,55 @@ static void _draw(Layer *layer, GContext *context)
 {
     StatusBarLayer *status_bar = (StatusBarLayer *) layer;
     GRect full_frame = layer_get_frame(layer);
-    
+    GRect text_frame = _text_frame(status_bar);
+    GRect text_rect = status_bar->text ? text_frame : status_bar->clock_rect;
+
+    // Keep to the damage, in our coordinates. The text is drawn whole, so
+    // if it pokes into the damage, all of it gets repainted
+    GRect damage = layer_draw_get_damage();
+    GRect paint = GRect(damage.origin.x - context->offset.origin.x,
+                        damage.origin.y - context->offset.origin.y,
+                        damage.size.w, damage.size.h);
+    bool draw_text = RECT_INTERSECTS(paint, text_rect);
+
+    if (draw_text && !RECT_CONTAINS(paint, text_rect))
+    {
+        paint = rect_union(paint, text_rect);
+        layer_draw_add_damage(layer_convert_rect_to_screen(layer, text_rect));
+    }
+    int16_t x0 = MAX(paint.origin.x, 0);
+    int16_t y0 = MAX(paint.origin.y, 0);
+    int16_t x1 = MIN(paint.origin.x + paint.size.w, full_frame.size.w);
+    int16_t y1 = MIN(paint.origin.y + paint.size.h, full_frame.size.h);
+    if (x1 <= x0 || y1 <= y0)
+        return;
+    paint = GRect(x0, y0, x1 - x0, y1 - y0);
+
     // Draw the background
     graphics_context_set_fill_color(context, status_bar->background_color);
-    graphics_fill_rect(context, full_frame, 0, GCornerNone);
+    graphics_fill_rect(context, paint, 0, GCornerNone);
 
-    if (status_bar->separator_mode == StatusBarLayerSeparatorModeDotted)
+    int16_t sep_y = full_frame.size.h - 2;
+    if (status_bar->separator_mode == StatusBarLayerSeparatorModeDotted &&
+        sep_y >= paint.origin.y && sep_y < paint.origin.y + paint.size.h)
     {
         graphics_context_set_stroke_color(context, status_bar->foreground_color);
-        for(int i = 0; i < full_frame.size.w; i += 2)
+        for(int i = paint.origin.x & ~1; i < paint.origin.x + paint.size.w; i += 2)
         {
-            n_graphics_draw_pixel(context, n_GPoint(i, full_frame.size.h - 2));
+            if (i >= paint.origin.x)
+                n_graphics_draw_pixel(context, n_GPoint(i, sep_y));
         }
     }
-    
+
+    if (!draw_text)
+        return;
+
     // Draw the text
-    GRect text_frame = full_frame;
-    text_frame.origin.y = full_frame.size.h - 18;
     graphics_context_set_text_color(context, status_bar->foreground_color);
     GFont text_font = fonts_get_system_font(FONT_KEY_GOTHIC_14);
 
     if (status_bar->text == NULL) {
-        char time_string[8];
-        strftime(time_string, 8, "%R", &status_bar->last_time);
-
-        graphics_draw_text(context, time_string, text_font, text_frame,
+        graphics_draw_text(context, status_bar->clock.text, text_font, text_frame,
                                GTextOverflowModeTrailingEllipsis, GTextAlignmentCenter, 0);
     }
     else {
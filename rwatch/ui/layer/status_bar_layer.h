@@ -11,6 +11,8 @@
 #include "rect.h"
 #include "size.h"
 #include "bitmap_layer.h"
+#include "tick_timer_service.h"
+#include "clock_format.h"
 
 #define STATUS_BAR_LAYER_HEIGHT (PBL_PLATFORM_SWITCH(16, 16, 24, 16, 20))
 
@@ -28,7 +30,9 @@ typedef struct StatusBarLayer
     StatusBarLayerSeparatorMode separator_mode;
     const char *text;
     struct tm last_time;
-    CoreTimer timer;
+    ClockFormat clock; /* last_time as drawn */
+    GRect clock_rect; /* where that lands, in the layer */
+    TickListener tick;
 } StatusBarLayer;
 
 void status_bar_layer_ctor(StatusBarLayer *sblayer);
@@ -7,6 +7,8 @@
 
 #include "librebble.h"
 #include "text.h"
+#include "utils.h"
+#include "glyph_cache.h"
 
 void text_layer_draw(struct Layer *layer, GContext *context);
 
@@ -17,6 +19,7 @@ void text_layer_ctor(TextLayer *tlayer, GRect frame)
     tlayer->layer.container = tlayer;
     tlayer->text_color = GColorBlack;
     tlayer->background_color = GColorWhite;
+    tlayer->layer.opaque = true;
     tlayer->text_alignment = GTextAlignmentLeft;
     tlayer->font = fonts_get_system_font(FONT_KEY_GOTHIC_14_BOLD);
 
@@ -33,7 +36,7 @@ void text_layer_dtor(TextLayer *tlayer)
 // Layer Functions
 TextLayer *text_layer_create(GRect frame)
 {
-    TextLayer* tlayer = app_calloc(1, sizeof(TextLayer));
+    TextLayer* tlayer = app_pool_calloc(sizeof(TextLayer));
     text_layer_ctor(tlayer, frame);
     
     return tlayer;
@@ -64,6 +67,8 @@ const char *text_layer_get_text(TextLayer *text_layer)
 void text_layer_set_background_color(TextLayer *text_layer, GColor color)
 {
     text_layer->background_color = color;
+    /* a solid background hides whatever is under us */
+    text_layer->layer.opaque = (color.argb & 0xC0) == 0xC0;
     layer_mark_dirty(&text_layer->layer);
 }
 
@@ -91,9 +96,149 @@ void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_al
     layer_mark_dirty(&text_layer->layer);
 }
 
+/* Apps reuse their buffers, so the pointer alone won't tell us the text changed */
+static uint32_t _text_hash(const char *text)
+{
+    uint32_t hash = 5381;
+
+    while (*text)
+        hash = hash * 33 + (uint8_t)*text++;
+
+    return hash;
+}
+
+static void _layout_add_line(TextLayerLayout *layout, const char *text, const char *start)
+{
+    if (layout->line_count < TEXT_LAYER_LAYOUT_LINES)
+        layout->line_start[layout->line_count] = start - text;
+    layout->line_count++;
+}
+
+/*
+ * Greedy word wrap into width. Words too long for a line of their own
+ * are broken where they hit the edge.
+ * Returns false if the font isn't one we can measure.
+ */
+static bool _text_layer_measure(TextLayerLayout *layout, const char *text, GFont font, int16_t width)
+{
+    const char *p = text;
+    const char *word = text;
+    int16_t line_w = 0, word_w = 0, max_w = 0;
+    const GlyphAscii *ascii = glyph_cache_ascii_begin(font);
+
+    layout->line_count = 0;
+    _layout_add_line(layout, text, text);
+
+    while (*p)
+    {
+        const char *c = p;
+        uint32_t cp = glyph_cache_next(&p);
+
+        if (cp == '\n')
+        {
+            max_w = MAX(max_w, line_w);
+            _layout_add_line(layout, text, p);
+            line_w = word_w = 0;
+            word = p;
+            continue;
+        }
+
+        int16_t adv = glyph_cache_ascii_advance(ascii, font, cp);
+        if (adv < 0)
+        {
+            glyph_cache_ascii_end(ascii);
+            return false;
+        }
+
+        if (cp == ' ')
+        {
+            /* spaces are allowed to hang off the end */
+            line_w += adv;
+            word_w = 0;
+            word = p;
+            continue;
+        }
+
+        if (line_w && line_w + adv > width)
+        {
+            if (word_w < line_w)
+            {
+                /* take the word down with us */
+                max_w = MAX(max_w, line_w - word_w);
+                _layout_add_line(layout, text, word);
+                line_w = word_w;
+            }
+            else
+            {
+                max_w = MAX(max_w, line_w);
+                _layout_add_line(layout, text, c);
+                line_w = word_w = 0;
+                word = c;
+            }
+        }
+
+        line_w += adv;
+        word_w += adv;
+    }
+
+    glyph_cache_ascii_end(ascii);
+    max_w = MAX(max_w, line_w);
+    layout->content_size = GSize(max_w, layout->line_count * font->line_height);
+
+    return true;
+}
+
+/*
+ * Line breaks for the current text, worked out again only when the text,
+ * font, width, overflow or alignment change. NULL if we can't measure it.
+ */
+static TextLayerLayout *_text_layer_layout(TextLayer *tlayer)
+{
+    TextLayerLayout *layout = &tlayer->layout_cache;
+    int16_t width = tlayer->layer.frame.size.w;
+
+    if (!tlayer->text || !tlayer->font)
+        return NULL;
+
+    uint32_t hash = _text_hash(tlayer->text);
+
+    if (layout->text != tlayer->text ||
+        layout->hash != hash ||
+        layout->font != tlayer->font ||
+        layout->width != width ||
+        layout->overflow_mode != tlayer->overflow_mode ||
+        layout->text_alignment != tlayer->text_alignment)
+    {
+        layout->text = tlayer->text;
+        layout->hash = hash;
+        layout->font = tlayer->font;
+        layout->width = width;
+        layout->overflow_mode = tlayer->overflow_mode;
+        layout->text_alignment = tlayer->text_alignment;
+        layout->valid = _text_layer_measure(layout, tlayer->text, tlayer->font, width);
+    }
+
+    return layout->valid ? layout : NULL;
+}
+
 GSize text_layer_get_content_size(TextLayer *text_layer)
 {
-    return text_layer->layer.bounds.size;
+    TextLayerLayout *layout = _text_layer_layout(text_layer);
+
+    if (!layout)
+        return text_layer->layer.bounds.size;
+
+    GSize size = layout->content_size;
+
+    /* everything but word wrap stops at the last line that fits */
+    if (text_layer->overflow_mode != GTextOverflowModeWordWrap)
+    {
+        uint8_t line_height = text_layer->font->line_height;
+        uint16_t lines = MAX(1, text_layer->layer.frame.size.h / line_height);
+        size.h = MIN(size.h, lines * line_height);
+    }
+
+    return size;
 }
 
 void text_layer_set_size(TextLayer *text_layer, const GSize max_size)
@@ -121,8 +266,29 @@ void text_layer_draw(struct Layer *layer, GContext *context)
     GRect bounds = GRect(0, 0, layer->frame.size.w, layer->frame.size.h);
     graphics_fill_rect(context, bounds, 0, GCornerNone);
 
-    graphics_draw_text(context, tlayer->text, tlayer->font,
-                       bounds, tlayer->overflow_mode,
+    const char *text = tlayer->text;
+    GRect text_box = bounds;
+    TextLayerLayout *layout = _text_layer_layout(tlayer);
+
+    /* When scrolled, start from the first line still on screen
+     * rather than having ngfx wrap everything above it again */
+    if (layout && tlayer->overflow_mode == GTextOverflowModeWordWrap)
+    {
+        uint8_t line_height = tlayer->font->line_height;
+        uint16_t known = MIN(layout->line_count, TEXT_LAYER_LAYOUT_LINES);
+        uint16_t first = 0;
+
+        while (first + 1 < known && (first + 1) * line_height < bounds.size.h &&
+               context->offset.origin.y + (first + 1) * line_height <= 0)
+            first++;
+
+        text += layout->line_start[first];
+        text_box.origin.y += first * line_height;
+        text_box.size.h -= first * line_height;
+    }
+
+    graphics_draw_text(context, text, tlayer->font,
+                       text_box, tlayer->overflow_mode,
                        tlayer->text_alignment, &tlayer->text_attributes);
 }
 
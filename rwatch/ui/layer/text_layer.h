@@ -8,12 +8,30 @@
 
 #include "librebble.h"
 
+/* Line starts we remember. Lines past this are still measured */
+#define TEXT_LAYER_LAYOUT_LINES 16
+
+/* Where the text breaks, and what that was worked out for */
+typedef struct TextLayerLayout
+{
+    const char *text;
+    uint32_t hash;
+    GFont font;
+    int16_t width;
+    GTextOverflowMode overflow_mode;
+    GTextAlignment text_alignment;
+    bool valid;
+    uint16_t line_count;
+    uint16_t line_start[TEXT_LAYER_LAYOUT_LINES];
+    GSize content_size;
+} TextLayerLayout;
+
 typedef struct TextLayer
 {
     Layer layer;
     const char *text;
     GFont font;
-//     GTextLayoutCacheRef layout_cache;
+    TextLayerLayout layout_cache;
     GColor text_color;
     GColor background_color;
     GTextOverflowMode overflow_mode;
@@ -233,6 +233,8 @@ void notification_window_update_proc(Layer *layer, GContext *ctx)
 
 void notification_window_unload(Window *window)
 {
+    status_bar_layer_destroy(status_bar);
+    status_bar = NULL;
     
     app_free(notification_window);
 }
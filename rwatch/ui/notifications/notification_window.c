@@ -39,10 +39,10 @@ static void _notif_man_window_load(Window *window)
 
     NotificationLayer *notif_layer = notification_layer_create(bounds);
     
-    cmd_phone_attribute_t *a;
-    list_foreach(a, &message->message->attributes_list_head, cmd_phone_attribute_t, node)
+    const char *text;
+    for (uint8_t i = 0; (text = notification_attribute_get(message->message, i)); i++)
     {
-        Notification *notification = notification_create(app, title, (char*)a->data, gbitmap_create_with_resource(RESOURCE_ID_SPEECH_BUBBLE), GColorRed);        
+        Notification *notification = notification_create(app, title, text, gbitmap_create_with_resource(RESOURCE_ID_SPEECH_BUBBLE), GColorRed);        
         notification_layer_stack_push_notification(notif_layer, notification);
     }
         
@@ -62,6 +62,7 @@ static void _notif_man_window_unload(Window *window)
 {
     notification_message *nm = (notification_message *)window->context;
     notification_layer_destroy(nm->notification_layer);
+    message_release(nm->message);
     
     
 }
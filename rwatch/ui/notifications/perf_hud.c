@@ -0,0 +1,191 @@
+/* perf_hud.c
+ * A strip of live frame stats over whatever is running
+ * RebbleOS
+ *
+ * Lives on the overlay thread. It refreshes off an overlay timer, which
+ * repaints over the cached app frame and pushes out only our strip, so
+ * the app isn't asked to draw and the numbers stay its own.
+ */
+#include "rebbleos.h"
+#include "notification_manager.h"
+#include "overlay_manager.h"
+#include "qalloc.h"
+
+#ifdef PERF_HUD
+
+#define PERF_HUD_HEIGHT     48
+#define PERF_HUD_REFRESH_MS 1000
+
+typedef struct PerfHudSample {
+    uint32_t frames;
+    uint32_t bt_bytes;
+    BtTimeStats bt_queue;
+    BtTimeStats bt_send;
+    BtTimeStats bt_rx;
+    uint32_t bt_timeouts;
+    TickType_t at;
+} PerfHudSample;
+
+static OverlayWindow *_hud;
+static bool _visible;
+static AppTimerHandle _timer;
+static PerfHudSample _last;
+
+/* what's on screen */
+static uint16_t _fps_x10;
+static uint32_t _render_us;
+static uint32_t _display_us;
+static uint32_t _heap_used;
+static uint32_t _bt_bytes_per_s;
+static uint32_t _bt_queue_us;
+static uint32_t _bt_send_us;
+static uint32_t _bt_rx_us;
+static uint32_t _bt_timeouts;
+
+static void _hud_window_load(Window *window);
+static void _hud_window_unload(Window *window);
+static void _draw_hud(Layer *layer, GContext *ctx);
+
+static uint32_t _cycles_to_us(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000);
+}
+
+/* the average over the last refresh, or 0 if there were none */
+static uint32_t _avg_us(const BtTimeStats *now, const BtTimeStats *last)
+{
+    uint32_t n = now->count - last->count;
+
+    return n ? (now->total_us - last->total_us) / n : 0;
+}
+
+static void _hud_sample(void)
+{
+    PerfHudSample now;
+    /* off the overlay thread's stack */
+    static BtStats bt;
+
+    bluetooth_get_stats(&bt);
+    now.frames = frame_profile_frame_count();
+    now.bt_bytes = bt.tx_bytes + bt.rx_bytes;
+    now.bt_queue = bt.tx_queue;
+    now.bt_send = bt.tx_send;
+    now.bt_rx = bt.rx_dispatch;
+    now.bt_timeouts = bt.tx_timeouts;
+    now.at = xTaskGetTickCount();
+
+    uint32_t ms = (now.at - _last.at) * portTICK_PERIOD_MS;
+    if (_last.at && ms)
+    {
+        _fps_x10 = (now.frames - _last.frames) * 10000 / ms;
+        _bt_bytes_per_s = (now.bt_bytes - _last.bt_bytes) * 1000 / ms;
+        _bt_queue_us = _avg_us(&now.bt_queue, &_last.bt_queue);
+        _bt_send_us = _avg_us(&now.bt_send, &_last.bt_send);
+        _bt_rx_us = _avg_us(&now.bt_rx, &_last.bt_rx);
+    }
+    _bt_timeouts = now.bt_timeouts;
+    _last = now;
+
+    _render_us = _cycles_to_us(frame_profile_last(FrameProfileWindowDraw) +
+                               frame_profile_last(FrameProfileOverlayDraw));
+    _display_us = _cycles_to_us(frame_profile_last(FrameProfileDisplayWait));
+
+    /* app_heap_bytes_used would give us our own heap */
+    app_running_thread *app = appmanager_get_thread(AppThreadMainApp);
+    _heap_used = app->arena ? qusedbytes(app->arena) : 0;
+}
+
+static void _hud_timer(void *data)
+{
+    _hud_sample();
+    if (_hud)
+        layer_mark_dirty(window_get_root_layer(&_hud->window));
+    _timer = app_timer_register(PERF_HUD_REFRESH_MS, _hud_timer, NULL);
+}
+
+/* overlay thread */
+static void _hud_creating(OverlayWindow *overlay_window, Window *window)
+{
+    _hud = overlay_window;
+
+    window->frame = GRect(0, 0, DISPLAY_COLS, PERF_HUD_HEIGHT);
+    window->background_color = GColorBlack;
+    window_set_window_handlers(window, (WindowHandlers) {
+        .load = _hud_window_load,
+        .unload = _hud_window_unload,
+    });
+
+    overlay_window_stack_push(overlay_window, false);
+}
+
+/*
+ * Show or hide the HUD. Called from the button thread
+ */
+void perf_hud_toggle(void)
+{
+    if (!_visible)
+    {
+        _visible = true;
+        overlay_window_create(_hud_creating);
+        return;
+    }
+
+    /* still on its way up */
+    if (!_hud)
+        return;
+
+    _visible = false;
+    overlay_window_destroy(_hud);
+}
+
+static void _hud_window_load(Window *window)
+{
+    Layer *layer = window_get_root_layer(window);
+
+    memset(&_last, 0, sizeof(_last));
+    _hud_sample();
+    layer_set_update_proc(layer, _draw_hud);
+    _timer = app_timer_register(PERF_HUD_REFRESH_MS, _hud_timer, NULL);
+
+    layer_mark_dirty(layer);
+    window_dirty(true);
+}
+
+static void _hud_window_unload(Window *window)
+{
+    if (_timer)
+        app_timer_cancel(_timer);
+    _timer = 0;
+    _hud = NULL;
+}
+
+static void _draw_hud(Layer *layer, GContext *ctx)
+{
+    char line[3][32];
+
+    snprintf(line[0], sizeof(line[0]), "%d.%d fps  draw %luus",
+             _fps_x10 / 10, _fps_x10 % 10, _render_us);
+    snprintf(line[1], sizeof(line[1]), "dma %luus heap %lu bt %lu/s",
+             _display_us, _heap_used, _bt_bytes_per_s);
+    snprintf(line[2], sizeof(line[2]), "bt q %lu tx %lu rx %luus to %lu",
+             _bt_queue_us, _bt_send_us, _bt_rx_us, _bt_timeouts);
+
+    ctx->text_color = GColorWhite;
+    graphics_draw_text(ctx, line[0], fonts_get_system_font(FONT_KEY_GOTHIC_14),
+                       GRect(2, -2, DISPLAY_COLS - 4, 16),
+                       GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
+    graphics_draw_text(ctx, line[1], fonts_get_system_font(FONT_KEY_GOTHIC_14),
+                       GRect(2, 14, DISPLAY_COLS - 4, 16),
+                       GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
+    graphics_draw_text(ctx, line[2], fonts_get_system_font(FONT_KEY_GOTHIC_14),
+                       GRect(2, 30, DISPLAY_COLS - 4, 16),
+                       GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
+}
+
+#else
+
+void perf_hud_toggle(void)
+{
+}
+
+#endif
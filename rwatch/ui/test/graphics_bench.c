@@ -0,0 +1,275 @@
+/* graphics_bench.c
+ * Times the graphics stack drawing a few stock scenes, natively on the
+ * desk. Built and run by `make gbench`, see hw/platform/host
+ * RebbleOS
+ *
+ * Each scene is a fresh app: a window is pushed, and driven for a number
+ * of frames as a user would drive it, buttons and all. A frame is what the
+ * app thread does for one: fire the timers that came due in the last 33ms
+ * (animations, mostly), then window_draw, just as the runloop calls it.
+ * Only that is timed. Allocations are counted off the app's arena.
+ *
+ * Damage is honoured, so a scene that only moves a hand pays for the hand.
+ * -f paints the whole window every frame instead, for the worst case.
+ *
+ *   graphics_bench [-f] [-n frames] [-s scene] pbpack
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include "rebbleos.h"
+#include "librebble.h"
+#include "notification_layer.h"
+#include "platform_res.h"
+
+#define BENCH_FRAME_MS 33
+#define BENCH_FRAMES   300
+
+typedef struct BenchScene {
+    const char *name;
+    WindowHandlers handlers;
+    /* called before each frame is drawn, to move things along */
+    void (*frame)(Window *window, uint32_t n);
+} BenchScene;
+
+/* Menu: thirty rows, a press down every fifth frame, and back up */
+
+#define MENU_ROWS 30
+
+static SimpleMenuLayer *_menu;
+static SimpleMenuItem _menu_items[MENU_ROWS];
+static SimpleMenuSection _menu_section = { .title = "Settings", .items = _menu_items, .num_items = MENU_ROWS };
+static char _menu_titles[MENU_ROWS][16];
+
+static void _menu_load(Window *window)
+{
+    Layer *layer = window_get_root_layer(window);
+
+    for (int i = 0; i < MENU_ROWS; i++)
+    {
+        snprintf(_menu_titles[i], sizeof(_menu_titles[i]), "Item %d", i);
+        _menu_items[i] = (SimpleMenuItem) { .title = _menu_titles[i], .subtitle = "A subtitle" };
+    }
+    _menu = simple_menu_layer_create(layer_get_bounds(layer), window, &_menu_section, 1, NULL);
+    layer_add_child(layer, simple_menu_layer_get_layer(_menu));
+}
+
+static void _menu_unload(Window *window)
+{
+    simple_menu_layer_destroy(_menu);
+}
+
+static void _menu_frame(Window *window, uint32_t n)
+{
+    if (n % 5 == 0)
+        host_button_click((n / 5) / (MENU_ROWS - 1) % 2 ? BUTTON_ID_UP : BUTTON_ID_DOWN);
+}
+
+/* Notification: three of them, scrolled through and back */
+
+static NotificationLayer *_notif;
+static const char *_notif_body =
+    "Are we still on for tonight? I was thinking we could try that new place "
+    "on the corner, the one with the long queue. If it's too busy there's "
+    "always the pub. Let me know, and bring the umbrella, it's meant to pour.";
+
+static void _notif_load(Window *window)
+{
+    Layer *layer = window_get_root_layer(window);
+    static const GColor colors[] = { GColorRed, GColorBlue, GColorIslamicGreen };
+
+    _notif = notification_layer_create(layer_get_bounds(layer));
+    for (int i = 0; i < 3; i++)
+    {
+        Notification *n = notification_create("Messages", "Alex", _notif_body,
+                                              gbitmap_create_with_resource(RESOURCE_ID_SPEECH_BUBBLE), colors[i]);
+        notification_layer_stack_push_notification(_notif, n);
+    }
+    notification_layer_configure_click_config(_notif, window, NULL);
+    layer_add_child(layer, notification_layer_get_layer(_notif));
+}
+
+static void _notif_unload(Window *window)
+{
+    notification_layer_destroy(_notif);
+}
+
+static void _notif_frame(Window *window, uint32_t n)
+{
+    if (n % 15 == 0)
+        host_button_click((n / 15) % 12 < 6 ? BUTTON_ID_DOWN : BUTTON_ID_UP);
+}
+
+/* Analog face: ticks, hands as paths, and a second hand each frame */
+
+static Layer *_face;
+static GPath *_hour_path;
+static GPath *_minute_path;
+static GPoint _hour_points[] = { { -4, 10 }, { 4, 10 }, { 3, -40 }, { -3, -40 } };
+static GPoint _minute_points[] = { { -3, 10 }, { 3, 10 }, { 2, -60 }, { -2, -60 } };
+static GPathInfo _hour_info = { .num_points = 4, .points = _hour_points };
+static GPathInfo _minute_info = { .num_points = 4, .points = _minute_points };
+
+static void _face_update(Layer *layer, GContext *ctx)
+{
+    GRect bounds = layer_get_bounds(layer);
+    GPoint center = GPoint(bounds.size.w / 2, bounds.size.h / 2);
+    struct tm *t = rebble_time_get_tm();
+
+    graphics_context_set_fill_color(ctx, GColorDukeBlue);
+    graphics_fill_rect(ctx, bounds, 0, GCornerNone);
+    graphics_context_set_fill_color(ctx, GColorWhite);
+    graphics_fill_circle(ctx, center, 68);
+
+    graphics_context_set_stroke_color(ctx, GColorBlack);
+    graphics_context_set_stroke_width(ctx, 2);
+    for (int i = 0; i < 12; i++)
+    {
+        int32_t a = TRIG_MAX_ANGLE * i / 12;
+        int16_t r = i % 3 ? 60 : 54;
+        graphics_draw_line(ctx,
+            GPoint(center.x + sin_lookup(a) * r / TRIG_MAX_RATIO, center.y - cos_lookup(a) * r / TRIG_MAX_RATIO),
+            GPoint(center.x + sin_lookup(a) * 66 / TRIG_MAX_RATIO, center.y - cos_lookup(a) * 66 / TRIG_MAX_RATIO));
+    }
+
+    graphics_context_set_fill_color(ctx, GColorBlack);
+    gpath_move_to_app(_hour_path, center);
+    gpath_rotate_to_app(_hour_path, TRIG_MAX_ANGLE * ((t->tm_hour % 12) * 60 + t->tm_min) / 720);
+    gpath_fill_app(ctx, _hour_path);
+    gpath_move_to_app(_minute_path, center);
+    gpath_rotate_to_app(_minute_path, TRIG_MAX_ANGLE * t->tm_min / 60);
+    gpath_fill_app(ctx, _minute_path);
+
+    int32_t s = TRIG_MAX_ANGLE * t->tm_sec / 60;
+    graphics_context_set_stroke_color(ctx, GColorRed);
+    graphics_context_set_stroke_width(ctx, 1);
+    graphics_draw_line(ctx, center,
+        GPoint(center.x + sin_lookup(s) * 64 / TRIG_MAX_RATIO, center.y - cos_lookup(s) * 64 / TRIG_MAX_RATIO));
+    graphics_fill_circle(ctx, center, 4);
+}
+
+static void _face_load(Window *window)
+{
+    Layer *layer = window_get_root_layer(window);
+
+    _hour_path = gpath_create_app(&_hour_info);
+    _minute_path = gpath_create_app(&_minute_info);
+    _face = layer_create(layer_get_bounds(layer));
+    layer_set_update_proc(_face, _face_update);
+    layer_add_child(layer, _face);
+}
+
+static void _face_unload(Window *window)
+{
+    layer_destroy(_face);
+    gpath_destroy_app(_hour_path);
+    gpath_destroy_app(_minute_path);
+}
+
+/* a second a frame, as a tick service would mark it */
+static void _face_frame(Window *window, uint32_t n)
+{
+    host_advance(1000 - BENCH_FRAME_MS);
+    layer_mark_dirty(_face);
+}
+
+static const BenchScene _scenes[] = {
+    { "menu",         { .load = _menu_load,  .unload = _menu_unload },  _menu_frame },
+    { "notification", { .load = _notif_load, .unload = _notif_unload }, _notif_frame },
+    { "analog",       { .load = _face_load,  .unload = _face_unload },  _face_frame },
+};
+
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _run(const char *pbpack, const BenchScene *scene, uint32_t frames, bool full)
+{
+    uint64_t total = 0, best = UINT64_MAX, worst = 0;
+    uint32_t allocs, frees;
+    qarena_t *arena;
+
+    host_init(pbpack);
+    arena = appmanager_get_current_thread()->arena;
+
+    Window *window = window_create();
+    window_set_window_handlers(window, scene->handlers);
+    window_stack_push(window, false);
+    window_load_click_config(window);
+    /* the first frame loads fonts and bitmaps, and isn't counted */
+    window_draw(NULL);
+
+    allocs = arena->allocs;
+    frees = arena->frees;
+
+    for (uint32_t n = 0; n < frames; n++)
+    {
+        scene->frame(window, n);
+        if (full)
+            window_dirty(true);
+
+        uint64_t start = _now_ns();
+        host_advance(BENCH_FRAME_MS);
+        window_draw(NULL);
+        uint64_t ns = _now_ns() - start;
+
+        total += ns;
+        best = ns < best ? ns : best;
+        worst = ns > worst ? ns : worst;
+    }
+
+    printf("%-13s %6" PRIu32 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %9.2f %9.2f %8" PRIu32 "\n",
+           scene->name, frames, total / frames, best, worst,
+           (double)(arena->allocs - allocs) / frames, (double)(arena->frees - frees) / frames,
+           arena->peak);
+
+    window_stack_pop_all(false);
+    window_destroy(window);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frames = BENCH_FRAMES;
+    const char *only = NULL;
+    bool full = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "fn:s:")) != -1)
+    {
+        switch (c)
+        {
+            case 'f':
+                full = true;
+                break;
+            case 'n':
+                frames = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                only = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-f] [-n frames] [-s scene] pbpack\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || !frames)
+    {
+        fprintf(stderr, "usage: %s [-f] [-n frames] [-s scene] pbpack\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-13s %6s %10s %10s %10s %9s %9s %8s\n",
+           "scene", "frames", "ns/frame", "best", "worst", "allocs/f", "frees/f", "peak");
+    for (int i = 0; i < sizeof(_scenes) / sizeof(_scenes[0]); i++)
+        if (!only || !strcmp(only, _scenes[i].name))
+            _run(argv[optind], &_scenes[i], frames, full);
+
+    return 0;
+}
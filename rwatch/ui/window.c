@@ -12,16 +12,15 @@
 #include "animation.h"
 #include "overlay_manager.h"
 #include "notification_manager.h"
+#include "utils.h"
+#include "power.h"
+#include "packbits.h"
 
 static list_head _window_list_head = LIST_HEAD(_window_list_head);
 
 static void _window_load_proc(Window *window);
+static bool _window_transition_is_running(void);
 
-static bool _anim_direction_left = true;
-static void _animation_util_push_fb(GRect rect, int16_t distance);
-static void _animation_setup(bool direction_left);
-static void _push_animation_update(Animation *animation,
-                                  const AnimationProgress progress);
 
 
 /*
@@ -29,7 +28,7 @@ static void _push_animation_update(Animation *animation,
  */
 Window *window_create(void)
 {
-    Window *window = app_calloc(1, sizeof(Window));
+    Window *window = app_pool_calloc(sizeof(Window));
 
     if (window == NULL)
     {
@@ -65,43 +64,345 @@ void window_set_window_handlers(Window *window, WindowHandlers handlers)
     window->window_handlers = handlers;
 }
 
-static void _push_animation_setup(Animation *animation) {
-    SYS_LOG("window", APP_LOG_LEVEL_INFO, "Anim window ease in.");
+/*
+ * When a window is pushed, the last frame of the one it covers is kept,
+ * PackBits coded on the app heap, and popping back to that window puts it
+ * on screen straight away. The window still draws for real after; the
+ * snapshot only fills the wait. Only ever the one window, only if it
+ * codes small and the heap can spare it, and it is thrown away the moment
+ * anything on that window is marked dirty.
+ * Comment out to always wait for the draw on the way back
+ */
+#define WINDOW_SNAPSHOT
+/* the most a snapshot may code to... */
+#define WINDOW_SNAPSHOT_MAX (MAX_FRAMEBUFFER_SIZE / 4)
+/* ...and the heap left to the app once it is taken */
+#define WINDOW_SNAPSHOT_HEAP_SPARE 8192
+#define WINDOW_SNAPSHOT_LOCK_WAIT pdMS_TO_TICKS(20)
+
+#ifdef WINDOW_SNAPSHOT
+static Window *_snapshot_window;
+static uint8_t *_snapshot;
+static uint32_t _snapshot_len;
+
+static void _window_snapshot_drop(void)
+{
+    if (_snapshot)
+        app_free(_snapshot);
+    _snapshot = NULL;
+    _snapshot_len = 0;
+    _snapshot_window = NULL;
+}
+
+/* window is about to be covered. Keep what the screen shows of it */
+static void _window_snapshot_take(Window *window)
+{
+    uint8_t *fb;
+    uint32_t len;
+
+    _window_snapshot_drop();
+    /* only a finished frame of its own: nothing waiting to draw, nothing over it */
+    if (!window || window->is_render_scheduled ||
+        overlay_window_count() > 0 || _window_transition_is_running())
+        return;
+
+    if (!display_buffer_lock_take(WINDOW_SNAPSHOT_LOCK_WAIT))
+        return;
+    fb = display_get_buffer();
+    len = packbits_encode(NULL, fb, MAX_FRAMEBUFFER_SIZE);
+    if (len <= WINDOW_SNAPSHOT_MAX && app_heap_bytes_free() >= len + WINDOW_SNAPSHOT_HEAP_SPARE)
+        _snapshot = app_malloc(len);
+    if (_snapshot)
+    {
+        packbits_encode(_snapshot, fb, MAX_FRAMEBUFFER_SIZE);
+        _snapshot_len = len;
+        _snapshot_window = window;
+    }
+    display_buffer_lock_give();
+}
+
+/* window changed, or is going; what was kept of it is no good now */
+static void _window_snapshot_forget(Window *window)
+{
+    if (_snapshot_window == window)
+        _window_snapshot_drop();
+}
+
+/* Unpack window's snapshot into buf. False if there isn't one */
+static bool _window_snapshot_restore(Window *window, uint8_t *buf)
+{
+    bool restored = false;
+
+    if (_snapshot_window != window)
+        return false;
+
+    restored = packbits_decode(buf, MAX_FRAMEBUFFER_SIZE, _snapshot, _snapshot_len) == MAX_FRAMEBUFFER_SIZE;
+    _window_snapshot_drop();
+    return restored;
+}
+
+/*
+ * window is back on top, with no slide. Send its snapshot out now,
+ * rather than after it has drawn
+ */
+static void _window_snapshot_show(Window *window)
+{
+    if (_snapshot_window != window)
+        return;
+
+    if (overlay_window_count() > 0 || !display_buffer_lock_take(WINDOW_SNAPSHOT_LOCK_WAIT))
+    {
+        _window_snapshot_drop();
+        return;
+    }
+    /* the last frame may still be going out of the buffer */
+    while (display_is_busy())
+        vTaskDelay(1);
+    if (_window_snapshot_restore(window, display_get_buffer()))
+        display_draw();
+    display_buffer_lock_give();
+}
+
+#else
+
+static void _window_snapshot_take(Window *window)
+{
+}
+
+static void _window_snapshot_forget(Window *window)
+{
+}
+
+static bool _window_snapshot_restore(Window *window, uint8_t *buf)
+{
+    return false;
+}
+
+static void _window_snapshot_show(Window *window)
+{
+}
+
+#endif
+
+/* The app heap the snapshot was on is gone with the app */
+void window_app_reset(void)
+{
+#ifdef WINDOW_SNAPSHOT
+    _snapshot = NULL;
+    _snapshot_len = 0;
+    _snapshot_window = NULL;
+#endif
 }
 
-static void _push_animation_update(Animation *animation,
-                                  const AnimationProgress progress)
+/*
+ * Window transitions slide the incoming window in over the outgoing one.
+ * The outgoing window is whatever is left in the framebuffer, and the
+ * incoming one is drawn once into _transition_image, so each step is a
+ * shift and a copy however much is on the windows.
+ * Costs a framebuffer of RAM; comment out to switch windows without a slide
+ */
+#define WINDOW_TRANSITION_CACHE
+#define WINDOW_TRANSITION_MS 1200
+
+#if defined(WINDOW_TRANSITION_CACHE) && !defined(PBL_BW)
+typedef struct WindowTransition {
+    Window *window;       /* the window sliding in */
+    Animation *animation;
+    bool from_right;      /* comes in from the right edge, else from the left */
+    bool is_captured;     /* _transition_image holds window */
+    int16_t shown;        /* columns of window on screen */
+    int16_t target;       /* ...and how many there should be by the next draw */
+} WindowTransition;
+
+static WindowTransition _transition;
+static uint8_t _transition_image[MAX_FRAMEBUFFER_SIZE] __attribute__((aligned(4)));
+
+static void _transition_update(Animation *animation, const AnimationProgress progress)
 {
-    Window *window = window_stack_get_top_window(); 
-    int existx = window->frame.origin.x; 
-    int newx, delta; 
-     
-    if (*((bool*)animation->context) == true) 
-    { 
-        newx = ANIM_LERP(DISPLAY_COLS, 0, progress) - 1; 
-        delta = (existx - newx);
-        if (delta && existx > 0)
+    if (_transition.animation != animation || !_transition.window)
+        return;
+
+    _transition.target = ANIM_LERP(0, DISPLAY_COLS, progress);
+    _transition.window->is_render_scheduled = true;
+}
+
+static void _transition_teardown(Animation *animation)
+{
+    if (_transition.animation == animation)
+    {
+        /* land it, and paint anything the window did while it was moving */
+        _transition.animation = NULL;
+        _transition.target = DISPLAY_COLS;
+        if (_transition.window)
+            _transition.window->is_render_scheduled = true;
+    }
+    animation_destroy(animation);
+}
+
+static void _window_transition_stop(void)
+{
+    if (_transition.animation)
+        animation_unschedule(_transition.animation);
+    _transition.animation = NULL;
+    _transition.window = NULL;
+}
+
+/*
+ * Slide window onto the screen over what is there now. Nothing is drawn
+ * until the next window_draw
+ */
+static void _window_transition_start(Window *window, bool from_right)
+{
+    _window_transition_stop();
+
+    Animation *animation = animation_create();
+    if (!animation)
+        return;
+
+    const AnimationImplementation implementation = {
+        .update = _transition_update,
+        .teardown = _transition_teardown
+    };
+    animation_set_implementation(animation, &implementation);
+    animation_set_duration(animation, WINDOW_TRANSITION_MS);
+
+    _transition = (WindowTransition) {
+        .window = window,
+        .animation = animation,
+        .from_right = from_right,
+    };
+    animation_schedule(animation);
+}
+
+/* Trade the framebuffer and _transition_image over */
+static void _window_transition_swap(uint8_t *fb)
+{
+    uint32_t *a = (uint32_t *)fb;
+    uint32_t *b = (uint32_t *)_transition_image;
+
+    for (uint32_t i = 0; i < sizeof(_transition_image) / 4; i++)
+    {
+        uint32_t t = a[i];
+        a[i] = b[i];
+        b[i] = t;
+    }
+}
+
+/*
+ * Move the slide on from shown to target columns. The outgoing window's
+ * pixels shift over in place, and the incoming window is copied in
+ * whole from its image, since all of it moved
+ */
+static void _window_transition_composite(uint8_t *fb, int16_t shown, int16_t target)
+{
+    int16_t rest = DISPLAY_COLS - target;
+
+    for (int16_t y = 0; y < DISPLAY_ROWS; y++)
+    {
+        uint8_t *row = fb + y * DISPLAY_COLS;
+        const uint8_t *image = _transition_image + y * DISPLAY_COLS;
+
+        if (_transition.from_right)
         {
-            _animation_util_push_fb(GRect(delta, 0, DISPLAY_COLS - delta, DISPLAY_ROWS), -delta);
+            memmove(row, row + (target - shown), rest);
+            memcpy(row + rest, image, target);
         }
-    } 
-    else 
+        else
+        {
+            memmove(row + target, row + shown, rest);
+            memcpy(row, image + rest, target);
+        }
+    }
+}
+
+/*
+ * Draw the next step of the slide, if there is one going.
+ * The first step draws the incoming window, the only time it gets drawn
+ * until the slide is done; the window's own damage piles up until then.
+ * Returns true if the framebuffer moved
+ */
+static bool _window_transition_draw(Window *wind)
+{
+    if (!_transition.window)
+        return false;
+
+    if (_transition.window != wind)
     {
-        newx = ANIM_LERP(-DISPLAY_COLS, 0, progress);
-        delta = newx - existx;
-        if (delta && existx < 0)
-            _animation_util_push_fb(GRect(DISPLAY_COLS + existx + 1, 0, DISPLAY_COLS - delta + 1, DISPLAY_ROWS), delta);
-    } 
+        /* something else came up on top. Stop sliding and just paint it */
+        _window_transition_stop();
+        window_dirty(true);
+        return false;
+    }
 
-    window->frame.origin.x = newx; 
-    window_dirty(true); 
+    uint8_t *fb = display_get_buffer();
+
+    if (!_transition.is_captured && _window_snapshot_restore(wind, _transition_image))
+    {
+        /* on the way back, the incoming window is as it was left. It
+         * draws for real once it lands, as its damage is still all of it */
+        _transition.is_captured = true;
+    }
+    else if (!_transition.is_captured)
+    {
+        /* keep the outgoing window, draw the incoming over it, then trade */
+        memcpy(_transition_image, fb, sizeof(_transition_image));
+        window_dirty(true);
+        rbl_window_draw(wind);
+        wind->dirty_rect = GRect(0, 0, 0, 0);
+        _window_transition_swap(fb);
+        _transition.is_captured = true;
+    }
+
+    int16_t target = MIN(_transition.target, DISPLAY_COLS);
+    if (target > _transition.shown)
+    {
+        _window_transition_composite(fb, _transition.shown, target);
+        _transition.shown = target;
+    }
+
+    if (_transition.shown == DISPLAY_COLS && !_transition.animation)
+        _transition.window = NULL;
+
+    return true;
 }
 
-static void _push_animation_teardown(Animation *animation) {
-    SYS_LOG("window", APP_LOG_LEVEL_INFO, "Animation finished!");
-    animation_destroy(animation);
+static bool _window_transition_is_running(void)
+{
+    return _transition.window != NULL;
+}
+
+/* window is going away, so don't slide it in */
+static void _window_transition_forget(Window *window)
+{
+    if (_transition.window == window)
+        _window_transition_stop();
+}
+
+#else
+
+static void _window_transition_stop(void)
+{
+}
+
+static void _window_transition_start(Window *window, bool from_right)
+{
 }
 
+static bool _window_transition_draw(Window *wind)
+{
+    return false;
+}
+
+static bool _window_transition_is_running(void)
+{
+    return false;
+}
+
+static void _window_transition_forget(Window *window)
+{
+}
+
+#endif
 
 /* 
  * Get the head node for a window list
@@ -127,6 +428,7 @@ void window_stack_push(Window *window, bool animated)
         return;
     }
 
+    _window_snapshot_take(window_stack_get_top_window());
     list_init_node(&window->node);
     /* It is only valid to window push into a window */
     list_insert_head(&_window_list_head, &window->node);
@@ -135,44 +437,20 @@ void window_stack_push(Window *window, bool animated)
 
 void window_stack_push_configure(Window *window, bool animated)
 {
-    if (animated)
+    /* a slide is a lot of frames to spend on a low battery */
+    if (animated && !power_is_saving())
     {
-        Window *window = window_stack_get_top_window();
-        window->frame.origin.x = DISPLAY_COLS;
         App *app = appmanager_get_current_app();
         /* A quicky hack to determine direction of scroll
          * If we are an app => face, then we go left
          * Face to app => right
          */
-        if (app->type == APP_TYPE_FACE)
-            _animation_setup(true);
-        else 
-            _animation_setup(false);
+        _window_transition_start(window, app->type == APP_TYPE_FACE);
     }
     window_configure(window);
     window_dirty(true);
 }
 
-static void _animation_setup(bool direction_left)
-{
-    // Animate the window change
-    Animation *animation = animation_create();
-    animation_set_duration(animation, 1200);
-    
-    const AnimationImplementation implementation = {
-        .setup = _push_animation_setup,
-        .update = _push_animation_update,
-        .teardown = _push_animation_teardown
-    };
-    animation_set_implementation(animation, &implementation);
- 
-    _anim_direction_left = direction_left;
-    animation->context = (void*)&_anim_direction_left;
-    
-    // Play the animation
-    animation_schedule(animation);
-}
-
 /*
  * Remove the top_window from the list
  */
@@ -216,10 +494,19 @@ bool window_stack_remove(Window *window, bool animated)
     if (top_window == window) {
         top_window = list_elem(list_get_head(lh), Window, node);
         if (top_window) {
+            /* back the other way to a push */
+            if (animated && !power_is_saving())
+                _window_transition_start(top_window, appmanager_get_current_app()->type != APP_TYPE_FACE);
+            if (!_window_transition_is_running())
+                _window_snapshot_show(top_window);
             window_configure(top_window);
             window_dirty(true);
         }
     }
+    else
+    {
+        _window_snapshot_forget(window);
+    }
 
     return true;
 }
@@ -234,22 +521,9 @@ Window *window_stack_get_top_window(void)
 
 uint16_t window_count(void)
 {
-    uint16_t count = 0;
-    Window *w;
-    
     assert(!appmanager_is_thread_overlay() && "Please use overlay_window_count");
-        
-    if (list_get_head(&_window_list_head) == NULL)
-        return 0;
-    
-    list_foreach(w, &_window_list_head, Window, node)
-    {
-        count++;
-    }
-    
-    SYS_LOG("window", APP_LOG_LEVEL_INFO, "COUNT %d", count);
-    
-    return count;
+
+    return list_count(&_window_list_head);
 }
 
 /*
@@ -295,6 +569,9 @@ void window_destroy(Window *window)
         return;
     }
     
+    _window_transition_forget(window);
+    _window_snapshot_forget(window);
+
     /* Check the node isn't already detached */
     if (!(window->node.next == NULL && window->node.prev == NULL))
         list_remove(lh, &window->node);
@@ -347,10 +624,141 @@ void window_dirty(bool is_dirty)
         return;
 
     wind->is_render_scheduled = is_dirty;
+    wind->dirty_rect = is_dirty ? GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS) : GRect(0, 0, 0, 0);
+    /* it's all being painted anyway */
+    wind->scroll_rect = GRect(0, 0, 0, 0);
+    wind->scroll_dy = 0;
+}
+
+/*
+ * Add an area of the screen to a window's damage.
+ * Anything that isn't the top app window (overlays, windows further
+ * down the stack) falls back to dirtying the whole screen
+ */
+void window_dirty_rect(Window *window, GRect rect)
+{
+    Window *wind = window_stack_get_top_window();
+    
+    if (!wind)
+        return;
+    
+    if (window != wind)
+    {
+        _window_snapshot_forget(window);
+        window_dirty(true);
+        return;
+    }
+    
+    int16_t x0 = CLAMP(rect.origin.x, 0, DISPLAY_COLS);
+    int16_t y0 = CLAMP(rect.origin.y, 0, DISPLAY_ROWS);
+    int16_t x1 = CLAMP(rect.origin.x + rect.size.w, 0, DISPLAY_COLS);
+    int16_t y1 = CLAMP(rect.origin.y + rect.size.h, 0, DISPLAY_ROWS);
+
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    GRect *dirty = &wind->dirty_rect;
+    if (dirty->size.w > 0 && dirty->size.h > 0)
+    {
+        x0 = MIN(x0, dirty->origin.x);
+        y0 = MIN(y0, dirty->origin.y);
+        x1 = MAX(x1, dirty->origin.x + dirty->size.w);
+        y1 = MAX(y1, dirty->origin.y + dirty->size.h);
+    }
+    
+    *dirty = GRect(x0, y0, x1 - x0, y1 - y0);
+    wind->is_render_scheduled = true;
+}
+
+/*
+ * Scroll part of the screen instead of repainting it. At the next draw
+ * the pixels in rect move down by dy (up if negative), and only the strip
+ * that uncovers gets repainted. layer is what moved, and must paint the
+ * whole of rect solid.
+ * Returns false if there's damage in rect already, or a scroll elsewhere,
+ * in which case the caller should mark it dirty as usual.
+ */
+bool window_scroll_region(Window *window, const Layer *layer, GRect rect, int16_t dy)
+{
+    Window *wind = window_stack_get_top_window();
+
+#ifdef REBBLE_PLATFORM_TINTIN
+    /* not worth the bit twiddling on 1bpp */
+    return false;
+#endif
+    if (!wind || window != wind || !dy)
+        return false;
+
+    int16_t x0 = CLAMP(rect.origin.x, 0, DISPLAY_COLS);
+    int16_t y0 = CLAMP(rect.origin.y, 0, DISPLAY_ROWS);
+    int16_t x1 = CLAMP(rect.origin.x + rect.size.w, 0, DISPLAY_COLS);
+    int16_t y1 = CLAMP(rect.origin.y + rect.size.h, 0, DISPLAY_ROWS);
+    rect = GRect(x0, y0, x1 - x0, y1 - y0);
+
+    if (RECT_EMPTY(rect))
+        return false;
+    if (!RECT_EMPTY(wind->scroll_rect))
+    {
+        if (!RECT_EQ(wind->scroll_rect, rect) || wind->scroll_layer != layer)
+            return false;
+    }
+    else if (!RECT_EMPTY(wind->dirty_rect) && RECT_INTERSECTS(wind->dirty_rect, rect))
+    {
+        return false;
+    }
+
+    int16_t total = wind->scroll_dy + dy;
+    if (total >= rect.size.h || -total >= rect.size.h)
+        return false;
+
+    wind->scroll_rect = rect;
+    wind->scroll_dy = total;
+    wind->scroll_layer = layer;
+    wind->is_render_scheduled = true;
+    return true;
+}
+
+/* Shift rows of the framebuffer within rect by dy */
+static void _window_shift_pixels(GRect rect, int16_t dy)
+{
+    uint8_t *fb = display_get_buffer();
+    uint16_t stride = DISPLAY_COLS;
+    uint16_t x = rect.origin.x, w = rect.size.w;
+    int16_t rows = rect.size.h - (dy < 0 ? -dy : dy);
+
+    if (w == stride)
+    {
+        int16_t from = dy > 0 ? rect.origin.y : rect.origin.y - dy;
+        memmove(fb + (from + dy) * stride, fb + from * stride, rows * stride);
+        return;
+    }
+
+    /* copy away from the direction of travel so we don't tread on rows we still need */
+    for (int16_t i = 0; i < rows; i++)
+    {
+        int16_t from = dy > 0 ? rect.origin.y + rows - 1 - i : rect.origin.y - dy + i;
+        memcpy(fb + (from + dy) * stride + x, fb + from * stride + x, w);
+    }
+}
+
+/*
+ * Get the damaged area of the top window in screen coordinates.
+ * If nobody told us what changed, assume it all did
+ */
+GRect window_get_dirty_rect(void)
+{
+    Window *wind = window_stack_get_top_window();
+    
+    if (!wind || wind->dirty_rect.size.w == 0 || wind->dirty_rect.size.h == 0)
+        return GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+    
+    return wind->dirty_rect;
 }
 
 /* 
  * Draw a window.
+ * Only the window's damage is repainted; everything else is left as
+ * it was last frame. On return dirty_rect holds the area that was drawn.
  */
 void rbl_window_draw(Window *window)
 {
@@ -363,9 +771,49 @@ void rbl_window_draw(Window *window)
     frame.origin.x += windowframe.origin.x; 
     /* Apply window offset too */
     context->offset = frame;
-    context->fill_color = window->background_color;
-    graphics_fill_rect(context, GRect(0, 0, frame.size.w, frame.size.h), 0, GCornerNone);
-    layer_draw(window->root_layer, context);
+
+    GRect damage = window->dirty_rect;
+    GRect moved = window->scroll_rect;
+    LayerDrawState state = { 0 };
+
+    if (!RECT_EMPTY(moved))
+    {
+        /* move what's already there, and only paint what's uncovered */
+        int16_t dy = window->scroll_dy;
+        _window_shift_pixels(moved, dy);
+        GRect strip = dy > 0 ? GRect(moved.origin.x, moved.origin.y, moved.size.w, dy)
+                             : GRect(moved.origin.x, moved.origin.y + moved.size.h + dy, moved.size.w, -dy);
+        damage = rect_union(damage, strip);
+        state.moved = window->scroll_layer;
+        state.moved_rect = moved;
+
+        window->scroll_rect = GRect(0, 0, 0, 0);
+        window->scroll_dy = 0;
+        window->scroll_layer = NULL;
+    }
+    else if (RECT_EMPTY(damage))
+    {
+        damage = GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+    }
+
+    layer_draw_prepare(window->root_layer, frame.origin, damage, &state);
+    damage = state.damage;
+
+    /* background, clipped to the damage. Skipped if a layer paints over it anyway */
+    int16_t x0 = MAX(damage.origin.x, frame.origin.x);
+    int16_t y0 = MAX(damage.origin.y, frame.origin.y);
+    int16_t x1 = MIN(damage.origin.x + damage.size.w, frame.origin.x + frame.size.w);
+    int16_t y1 = MIN(damage.origin.y + damage.size.h, frame.origin.y + frame.size.h);
+    if (x1 > x0 && y1 > y0 &&
+        !layer_draw_state_covers(&state, GRect(x0, y0, x1 - x0, y1 - y0)))
+    {
+        context->fill_color = window->background_color;
+        graphics_fill_rect(context, GRect(x0 - frame.origin.x, y0 - frame.origin.y, x1 - x0, y1 - y0), 0, GCornerNone);
+    }
+    layer_draw_region(window->root_layer, context, &state);
+
+    /* whatever got painted, or moved, has to go out to the display */
+    window->dirty_rect = rect_union(state.damage, moved);
 }
 
 /*
@@ -380,8 +828,9 @@ void rbl_window_draw(Window *window)
  * Overlay will call to paint out the framebuffer.
  * Display drawing is async, so if a display draw is already in progress, we 
  * also wait for that to complete.
+ * drawn, if given, is set to the area of the screen that was repainted.
  */
-bool window_draw(void)
+bool window_draw(GRect *drawn)
 {
     if (appmanager_is_thread_overlay())
     {
@@ -395,9 +844,23 @@ bool window_draw(void)
     }
 
     Window *wind = window_stack_get_top_window();
+    bool slid = _window_transition_draw(wind);
+    bool damaged = !RECT_EMPTY(wind->dirty_rect) || !RECT_EMPTY(wind->scroll_rect);
+
+    /* mid slide, the window's own damage waits until it has landed */
+    if (slid && (_window_transition_is_running() || !damaged))
+    {
+        if (drawn)
+            *drawn = GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+        wind->is_render_scheduled = false;
+        return true;
+    }
 
     rbl_window_draw(wind);
+    if (drawn)
+        *drawn = slid ? GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS) : wind->dirty_rect;
     wind->is_render_scheduled = false;
+    wind->dirty_rect = GRect(0, 0, 0, 0);
     
     return true;
 }
@@ -566,65 +1029,6 @@ void window_load_click_config(Window *window)
 }
 
 
-/* This prob shouldn't be in here, but I feel it doesn't live in 
-   animation either */
-
-/* 
- * Grab the screenbuffer and push it off the screen left or right by n
- * pixels.
- */
-static void _animation_util_push_fb(GRect rect, int16_t distance)
-{
-#ifdef PBL_BW
-#  warning XXX: PBL_BW no push_fb support
-    return;
-#else
-    /* To revisit at some later time.
-     * The issue I can't find time to fix is that pushfb happens
-     * while we are painting */
-    return;
-    
-    uint8_t *fb = display_get_buffer();
-    if (!display_buffer_lock_take(0))
-        return;
-    
-    if (rect.origin.x < 0) rect.origin.x = 0;
-    if (rect.origin.x > DISPLAY_COLS) rect.origin.x = DISPLAY_COLS;
-    if (rect.origin.y < 0) rect.origin.y = 0;
-    if (rect.origin.y > DISPLAY_ROWS) rect.origin.y = DISPLAY_ROWS;
-    
-    uint8_t *origin = &fb[(rect.origin.y * DISPLAY_COLS) + rect.origin.x];
-    uint8_t *p;
-    int8_t incr = distance > 0 ? -1 : 1;
-
-    for (int16_t y = 0; y < rect.size.h; y++)
-    {
-        uint16_t x = distance > 0 ? rect.size.w - 1 : 0;
-       
-        p = origin + (y * DISPLAY_COLS) + x;
-        
-        for (;;)
-        {      
-            *(p + distance) = *p;
-            
-            x += incr;
-            p += incr;
-            
-            if (distance < 0 && x >= rect.size.w)
-                break;
-            else if (distance > 0 && x <= 0)
-                break;
-            
-            if ((p + distance > origin + (DISPLAY_COLS * rect.size.h) + rect.size.w) ||
-                p > origin + DISPLAY_ROWS * DISPLAY_COLS)
-                continue;
-        }
-        
-    }
-    display_buffer_lock_give();
-#endif
-}
-
 bool window_get_fullscreen(Window *window)
 {
     return true;
@@ -52,6 +52,10 @@ typedef struct Window
     const char *debug_name;
     void *context;
     GRect frame;
+    GRect dirty_rect; /* screen area touched since the last draw */
+    GRect scroll_rect; /* screen area to shift by scroll_dy before the next draw */
+    int16_t scroll_dy;
+    const struct Layer *scroll_layer; /* the layer whose contents are being shifted */
     list_node node;
 } Window;
 
@@ -87,7 +91,11 @@ Window * window_stack_get_top_window(void);
 
 void window_configure(Window *window);
 void window_dirty(bool is_dirty);
-bool window_draw(void);
+void window_app_reset(void);
+void window_dirty_rect(Window *window, GRect rect);
+GRect window_get_dirty_rect(void);
+bool window_scroll_region(Window *window, const struct Layer *layer, GRect rect, int16_t dy);
+bool window_draw(GRect *drawn);
 void rbl_window_draw(Window *window);
 
 uint16_t window_count(void);
@@ -9,3 +9,28 @@
 #define POINT_EQ(p1, p2) ((p1).x == (p2).x && (p1).y == (p2).y)
 #define SIZE_EQ(s1, s2) ((s1).w == (s2).w && (s1).h == (s2).h)
 #define RECT_EQ(r1, r2) (POINT_EQ((r1).origin, (r2).origin) && SIZE_EQ((r1).size, (r2).size))
+#define RECT_EMPTY(r) ((r).size.w <= 0 || (r).size.h <= 0)
+#define RECT_INTERSECTS(r1, r2) ((r1).origin.x < (r2).origin.x + (r2).size.w && \
+                                 (r2).origin.x < (r1).origin.x + (r1).size.w && \
+                                 (r1).origin.y < (r2).origin.y + (r2).size.h && \
+                                 (r2).origin.y < (r1).origin.y + (r1).size.h)
+#define RECT_CONTAINS(outer, inner) ((inner).origin.x >= (outer).origin.x && \
+                                     (inner).origin.y >= (outer).origin.y && \
+                                     (inner).origin.x + (inner).size.w <= (outer).origin.x + (outer).size.w && \
+                                     (inner).origin.y + (inner).size.h <= (outer).origin.y + (outer).size.h)
+
+/* Smallest rect holding both. An empty rect doesn't count */
+static inline GRect rect_union(GRect r1, GRect r2)
+{
+    if (RECT_EMPTY(r1))
+        return r2;
+    if (RECT_EMPTY(r2))
+        return r1;
+
+    int16_t x0 = MIN(r1.origin.x, r2.origin.x);
+    int16_t y0 = MIN(r1.origin.y, r2.origin.y);
+    int16_t x1 = MAX(r1.origin.x + r1.size.w, r2.origin.x + r2.size.w);
+    int16_t y1 = MAX(r1.origin.y + r1.size.h, r2.origin.y + r2.size.h);
+
+    return GRect(x0, y0, x1 - x0, y1 - y0);
+}